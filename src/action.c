@@ -47,10 +47,13 @@ static const char* action_names[] = {
     [action_reload] = "reload",
     [action_antialiasing] = "antialiasing",
     [action_svg_rerender] = "svg_rerender",
+    [action_level] = "level",
+    [action_window] = "window",
     [action_info] = "info",
     [action_exec] = "exec",
     [action_export] = "export",
     [action_status] = "status",
+    [action_memstat] = "memstat",
     [action_exit] = "exit",
 };
 
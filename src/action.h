@@ -41,10 +41,13 @@ enum action_type {
     action_reload,
     action_antialiasing,
     action_svg_rerender,
+    action_level,
+    action_window,
     action_info,
     action_exec,
     action_export,
     action_status,
+    action_memstat,
     action_exit,
 };
 
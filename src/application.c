@@ -6,12 +6,16 @@
 
 #include "array.h"
 #include "buildcfg.h"
+#include "fcache.h"
 #include "font.h"
 #include "gallery.h"
 #include "imglist.h"
 #include "info.h"
+#include "memstat.h"
+#include "server.h"
 #include "shellcmd.h"
 #include "sway.h"
+#include "tpool.h"
 #include "ui.h"
 #include "viewer.h"
 
@@ -23,6 +27,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/eventfd.h>
+#include <time.h>
 #include <unistd.h>
 
 // Special ids for windows size and position
@@ -31,6 +36,9 @@
 #define SIZE_FROM_PARENT (SIZE_MAX - 2)
 #define POS_FROM_PARENT  SSIZE_MAX
 
+// Directory of the decoded frames cache
+#define FCACHE_DIR "/swayimg/frames"
+
 /** Main loop state */
 enum loop_state {
     loop_run,
@@ -48,14 +56,16 @@ struct watchfd {
 /** Event types. */
 enum event_type {
     event_action, ///< Apply action
-    event_redraw, ///< Redraw window request
     event_drag,   ///< Mouse or touch drag operation
+    event_drop,   ///< End of drag operation
 };
 
 /* Event queue. */
 struct event_queue {
     struct list list;     ///< Links to prev/next entry
     enum event_type type; ///< Event type
+    size_t repeat;        ///< Number of action repetitions
+    bool autorepeat;      ///< Event created by key repeat
     union event_params {  ///< Event parameters
         const struct action* action;
         struct drag {
@@ -71,10 +81,13 @@ struct application {
 
     struct watchfd* wfds; ///< FD polling descriptors
     size_t wfds_num;      ///< Number of polling FD
+    bool wfds_changed;    ///< Set of polling FD was changed
 
     struct event_queue* events;  ///< Event queue
     pthread_mutex_t events_lock; ///< Event queue lock
     int event_signal;            ///< Queue change notification
+    bool redraw;                 ///< Redraw request, protected by events_lock
+    struct timespec last_frame;  ///< Start time of the last redraw
 
     struct action_seq sigusr1; ///< Actions applied by USR1 signal
     struct action_seq sigusr2; ///< Actions applied by USR2 signal
@@ -85,56 +98,108 @@ struct application {
     struct wndrect window; ///< Preferable window position and size
     bool wnd_decor;        ///< Window decoration: borders and title
     char* app_id;          ///< Application id (app_id name)
+    bool server;           ///< Accept requests from other instances
 };
 
 /** Global application context. */
 static struct application ctx;
 
 #ifdef HAVE_SWAYWM
+/** Sway IPC exchange performed in background during startup. */
+struct sway_query {
+    pthread_t tid;        ///< Query thread id
+    bool active;          ///< Query thread is running
+    bool done;            ///< Query is completed, result is applied
+    int border;           ///< Border size of the parent window
+    bool decor;           ///< Window decoration is enabled
+    bool fullscreen;      ///< Parent window is in full screen mode
+    bool success;         ///< Parent window geometry is valid
+    struct wndrect rect;  ///< Geometry of the parent window
+    struct wndrect wnd;   ///< Window geometry to set (not full screen)
+};
+static struct sway_query sway_query;
+
 /**
- * Setup window position via Sway IPC.
- * @param cfg config instance
+ * Sway query thread: get parent window geometry and set window position
+ * via sway rules.
+ * @param data pointer to the query context
+ * @return NULL
  */
-static void sway_setup(const struct config* cfg)
+static void* sway_thread(void* data)
 {
-    struct wndrect parent;
-    bool fullscreen;
-    int border;
+    struct sway_query* query = data;
+    struct wndrect* wnd = &query->wnd;
     int ipc;
 
     ipc = sway_connect();
     if (ipc == INVALID_SWAY_IPC) {
-        return; // sway not available
+        return NULL; // sway not available
     }
-    if (!sway_current(ipc, &parent, &border, &fullscreen)) {
-        sway_disconnect(ipc);
-        return;
+
+    query->success =
+        sway_current(ipc, &query->rect, &query->border, &query->fullscreen);
+    if (query->success && !query->fullscreen) {
+        if (wnd->width == SIZE_FROM_PARENT) {
+            wnd->width = query->rect.width;
+            wnd->height = query->rect.height;
+            if (query->decor) {
+                wnd->width -= query->border * 2;
+                wnd->height -= query->border * 2;
+            }
+        }
+        if (wnd->x == POS_FROM_PARENT) {
+            wnd->x = query->rect.x;
+            wnd->y = query->rect.y;
+        }
+        // set window position via sway rules
+        sway_add_rules(ipc, wnd->x, wnd->y);
     }
 
-    if (fullscreen) {
-        ctx.window.width = SIZE_FULLSCREEN;
-        ctx.window.height = SIZE_FULLSCREEN;
-        sway_disconnect(ipc);
-        return;
+    sway_disconnect(ipc);
+
+    return NULL;
+}
+
+/**
+ * Start setup of window position via Sway IPC in background.
+ * @param cfg config instance
+ */
+static void sway_setup_start(const struct config* cfg)
+{
+    sway_query.decor = config_get_bool(cfg, CFG_GENERAL, CFG_GNRL_DECOR);
+    sway_query.wnd = ctx.window;
+
+    sway_query.active =
+        pthread_create(&sway_query.tid, NULL, sway_thread, &sway_query) == 0;
+    if (!sway_query.active) {
+        sway_thread(&sway_query);
     }
+}
 
-    if (ctx.window.width == SIZE_FROM_PARENT) {
-        ctx.window.width = parent.width;
-        ctx.window.height = parent.height;
-        if (config_get_bool(cfg, CFG_GENERAL, CFG_GNRL_DECOR)) {
-            ctx.window.width -= border * 2;
-            ctx.window.height -= border * 2;
-        }
+/**
+ * Finish setup of window position: wait for Sway IPC query and apply its
+ * result to the window geometry.
+ */
+static void sway_setup_finish(void)
+{
+    if (sway_query.done) {
+        return;
     }
-    if (ctx.window.x == POS_FROM_PARENT) {
-        ctx.window.x = parent.x;
-        ctx.window.y = parent.y;
+    if (sway_query.active) {
+        pthread_join(sway_query.tid, NULL);
+        sway_query.active = false;
     }
+    sway_query.done = true;
 
-    // set window position via sway rules
-    sway_add_rules(ipc, ctx.window.x, ctx.window.y);
-
-    sway_disconnect(ipc);
+    if (!sway_query.success) {
+        return;
+    }
+    if (sway_query.fullscreen) {
+        ctx.window.width = SIZE_FULLSCREEN;
+        ctx.window.height = SIZE_FULLSCREEN;
+    } else {
+        ctx.window = sway_query.wnd;
+    }
 }
 #endif // HAVE_SWAYWM
 
@@ -201,9 +266,127 @@ static void execute_cmd(const char* expr, const char* path)
     app_redraw();
 }
 
+/**
+ * Redraw window, time of rendering is shown in the next frame.
+ */
+static void redraw_window(void)
+{
+    struct pixmap* window;
+    struct timespec start, end;
+    double frame, render;
+
+    window = ui_draw_begin();
+    if (!window) {
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ctx.mode_handlers[ctx.mode_current].redraw(window);
+    ui_draw_commit();
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    render = (end.tv_sec - start.tv_sec) * 1000.0 +
+        (end.tv_nsec - start.tv_nsec) / 1000000.0;
+    info_update(info_render_time, "%.1f ms", render);
+
+    frame = (start.tv_sec - ctx.last_frame.tv_sec) * 1000.0 +
+        (start.tv_nsec - ctx.last_frame.tv_nsec) / 1000000.0;
+    if (frame > 0 && frame < 1000.0) {
+        info_update(info_frame_time, "%.1f ms (%.0f fps)", frame,
+                    1000.0 / frame);
+    } else {
+        info_update(info_frame_time, "idle");
+    }
+    ctx.last_frame = start;
+}
+
+/**
+ * Check if consecutive actions of the same type can be merged into one.
+ * @param type action type to check
+ * @return true if action can be merged
+ */
+static bool is_mergeable(enum action_type type)
+{
+    switch (type) {
+        case action_prev_file:
+        case action_next_file:
+        case action_step_left:
+        case action_step_right:
+        case action_step_up:
+        case action_step_down:
+        case action_zoom:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * Check if actions are equal.
+ * @param a,b actions to compare
+ * @return true if actions have the same type and parameters
+ */
+static bool is_same_action(const struct action* a, const struct action* b)
+{
+    if (a->type != b->type) {
+        return false;
+    }
+    if (!a->params || !b->params) {
+        return a->params == b->params;
+    }
+    return strcmp(a->params, b->params) == 0;
+}
+
+/**
+ * Merge consecutive queued actions into the specified one, so the input
+ * received while a slow operation was in progress is applied at once:
+ * next/prev file actions result in a single jump without decoding
+ * intermediate images.
+ * @param entry event removed from the queue head
+ */
+static void merge_events(struct event_queue* entry)
+{
+    const struct action* action = entry->param.action;
+    const struct action* opposite = NULL;
+    ssize_t net = entry->repeat;
+
+    if (!is_mergeable(action->type)) {
+        return;
+    }
+
+    pthread_mutex_lock(&ctx.events_lock);
+    while (ctx.events && ctx.events->type == event_action) {
+        struct event_queue* next = ctx.events;
+        const struct action* next_action = next->param.action;
+        if (is_same_action(action, next_action)) {
+            net += next->repeat;
+        } else if ((action->type == action_next_file &&
+                    next_action->type == action_prev_file) ||
+                   (action->type == action_prev_file &&
+                    next_action->type == action_next_file)) {
+            opposite = next_action;
+            net -= next->repeat;
+        } else {
+            break;
+        }
+        entry->autorepeat = entry->autorepeat && next->autorepeat;
+        ctx.events = list_remove(next);
+        free(next);
+    }
+    pthread_mutex_unlock(&ctx.events_lock);
+
+    if (net < 0) {
+        entry->param.action = opposite;
+        net = -net;
+    }
+    entry->repeat = net;
+}
+
 /** Notification callback: handle event queue. */
 static void handle_event_queue(__attribute__((unused)) void* data)
 {
+    bool redraw;
+
     // reset notification
     uint64_t value;
     ssize_t len;
@@ -222,6 +405,13 @@ static void handle_event_queue(__attribute__((unused)) void* data)
         if (!entry) {
             continue;
         }
+        if (entry->type == event_action) {
+            merge_events(entry);
+            if (entry->repeat == 0) {
+                free(entry); // opposite actions canceled each other
+                continue;
+            }
+        }
 
         switch (entry->type) {
             case event_action: {
@@ -235,6 +425,9 @@ static void handle_event_queue(__attribute__((unused)) void* data)
                         info_update(info_status, "%s", action->params);
                         app_redraw();
                         break;
+                    case action_memstat:
+                        memstat_dump(stderr);
+                        break;
                     case action_fullscreen:
                         ui_toggle_fullscreen();
                         break;
@@ -260,39 +453,60 @@ static void handle_event_queue(__attribute__((unused)) void* data)
                         }
                         break;
                     default:
-                        ctx.mode_handlers[ctx.mode_current].action(action);
+                        ctx.mode_handlers[ctx.mode_current].action(
+                            action, entry->repeat);
                         break;
                 }
             } break;
-            case event_redraw: {
-                struct pixmap* window = ui_draw_begin();
-                if (window) {
-                    ctx.mode_handlers[ctx.mode_current].redraw(window);
-                    ui_draw_commit();
-                }
-            } break;
             case event_drag:
                 if (ctx.mode_handlers[ctx.mode_current].drag) {
                     ctx.mode_handlers[ctx.mode_current].drag(
                         entry->param.drag.dx, entry->param.drag.dy);
                 }
                 break;
+            case event_drop:
+                if (ctx.mode_handlers[ctx.mode_current].drop) {
+                    ctx.mode_handlers[ctx.mode_current].drop();
+                }
+                break;
         }
 
         free(entry);
     }
+
+    // redraw window once after all queued events
+    pthread_mutex_lock(&ctx.events_lock);
+    redraw = ctx.redraw;
+    ctx.redraw = false;
+    pthread_mutex_unlock(&ctx.events_lock);
+    if (redraw && ctx.state == loop_run) {
+        redraw_window();
+    }
+}
+
+/**
+ * Raise event queue notification.
+ */
+static void notify_queue(void)
+{
+    const uint64_t value = 1;
+    ssize_t len;
+
+    do {
+        len = write(ctx.event_signal, &value, sizeof(value));
+    } while (len == -1 && errno == EINTR);
 }
 
 /**
  * Append event to queue.
  * @param evt event type
  * @param evp event parameters
+ * @param repeat number of action repetitions, 0 for non-repeated event
  */
-static void append_event(enum event_type evt, const union event_params* evp)
+static void append_event(enum event_type evt, const union event_params* evp,
+                         size_t repeat)
 {
     struct event_queue* entry;
-    const uint64_t value = 1;
-    ssize_t len;
 
     // create new entry
     entry = calloc(1, sizeof(*entry));
@@ -300,6 +514,8 @@ static void append_event(enum event_type evt, const union event_params* evp)
         return;
     }
     entry->type = evt;
+    entry->repeat = repeat ? repeat : 1;
+    entry->autorepeat = repeat != 0;
     if (evp) {
         memcpy(&entry->param, evp, sizeof(*evp));
     }
@@ -309,10 +525,7 @@ static void append_event(enum event_type evt, const union event_params* evp)
     ctx.events = list_append(ctx.events, entry);
     pthread_mutex_unlock(&ctx.events_lock);
 
-    // raise notification
-    do {
-        len = write(ctx.event_signal, &value, sizeof(value));
-    } while (len == -1 && errno == EINTR);
+    notify_queue();
 }
 
 /**
@@ -336,7 +549,7 @@ static void on_signal(int signum)
 
     for (size_t i = 0; i < sigact->num; ++i) {
         const union event_params evp = { .action = &sigact->sequence[i] };
-        append_event(event_action, &evp);
+        append_event(event_action, &evp, 0);
     }
 }
 
@@ -397,6 +610,25 @@ static struct image* create_imglist(const char* const* sources, size_t num)
     return image;
 }
 
+/** Startup job: image list created in parallel with UI initialization. */
+struct startup {
+    const char* const* sources; ///< List of sources
+    size_t num;                 ///< Number of sources in the list
+    struct image* image;        ///< First image to show
+};
+
+/**
+ * Startup thread: create image list and load the first image.
+ * @param data pointer to the startup job
+ * @return NULL
+ */
+static void* startup_thread(void* data)
+{
+    struct startup* job = data;
+    job->image = create_imglist(job->sources, job->num);
+    return NULL;
+}
+
 /**
  * Load config.
  * @param cfg config instance
@@ -404,6 +636,7 @@ static struct image* create_imglist(const char* const* sources, size_t num)
 static void load_config(const struct config* cfg)
 {
     const char* value;
+    size_t limit;
 
     // startup mode
     static const char* modes[] = { CFG_MODE_VIEWER, CFG_MODE_GALLERY };
@@ -459,6 +692,7 @@ static void load_config(const struct config* cfg)
     }
 
     ctx.wnd_decor = config_get_bool(cfg, CFG_GENERAL, CFG_GNRL_DECOR);
+    ctx.server = config_get_bool(cfg, CFG_GENERAL, CFG_GNRL_SERVER);
 
     // signal actions
     value = config_get(cfg, CFG_GENERAL, CFG_GNRL_SIGUSR1);
@@ -481,42 +715,124 @@ static void load_config(const struct config* cfg)
         value = config_get_default(CFG_GENERAL, CFG_GNRL_APP_ID);
     }
     str_dup(value, &ctx.app_id);
+
+    // memory limit for single decoded image
+    limit = config_get_num(cfg, CFG_GENERAL, CFG_GNRL_IMG_MEM, 0, 1024 * 1024);
+    image_set_limit(limit * 1024 * 1024);
+
+    // number of threads used by decoders
+    image_set_threads(
+        config_get_num(cfg, CFG_GENERAL, CFG_GNRL_DEC_THRD, 0, 1024));
+
+    // decoding in a separate process
+    image_set_isolation(
+        config_get_bool(cfg, CFG_GENERAL, CFG_GNRL_ISOLATE),
+        config_get_num(cfg, CFG_GENERAL, CFG_GNRL_ISO_TIME, 0, 3600));
+
+    // decoding mode of RAW images
+    static const char* raw_modes[] = {
+        [raw_full] = "full",
+        [raw_half] = "half",
+        [raw_preview] = "preview",
+    };
+    image_set_raw_mode(config_get_oneof(cfg, CFG_GENERAL, CFG_GNRL_RAW_MODE,
+                                        raw_modes, ARRAY_SIZE(raw_modes)));
+
+    // persistent cache of slowly decoded images
+    limit = config_get_num(cfg, CFG_GENERAL, CFG_GNRL_FCACHE, 0, 1024 * 1024);
+    if (limit) {
+        char path[PATH_MAX];
+        if (fs_envpath("XDG_CACHE_HOME", FCACHE_DIR, path, sizeof(path)) ||
+            fs_envpath("HOME", "/.cache" FCACHE_DIR, path, sizeof(path))) {
+            fcache_init(path, limit * 1024 * 1024,
+                        config_get_num(cfg, CFG_GENERAL, CFG_GNRL_FCACHE_TM, 0,
+                                       3600 * 1000));
+        }
+    }
 }
 
 bool app_init(const struct config* cfg, const char* const* sources, size_t num)
 {
+    struct startup job = { .sources = sources, .num = num };
     struct image* first_image;
     struct sigaction sigact;
+    bool ui_ok;
 
     load_config(cfg);
-    imglist_init(cfg);
 
-    first_image = create_imglist(sources, num);
-    if (!first_image) {
-        imglist_destroy();
-        return false;
+    // setup window position and size, the sway IPC exchange is done in
+    // background while other subsystems are initialized
+#ifdef HAVE_SWAYWM
+    if (ctx.window.width != SIZE_FULLSCREEN) {
+        sway_setup_start(cfg);
     }
+#endif // HAVE_SWAYWM
+
+    tpool_init(cfg);
+    font_init(cfg); // font is loaded in background
+    imglist_init(cfg);
 
-    // setup window position and size
 #ifdef HAVE_SWAYWM
-    if (ctx.window.width != SIZE_FULLSCREEN) {
-        sway_setup(cfg);
+    if (ctx.window.width == SIZE_FROM_PARENT) {
+        // the way of loading depends on the parent window size
+        sway_setup_finish();
     }
 #endif // HAVE_SWAYWM
-    if (ctx.window.width == SIZE_FULLSCREEN) {
-        ui_toggle_fullscreen();
-    } else if (ctx.window.width == SIZE_FROM_IMAGE ||
-               ctx.window.width == SIZE_FROM_PARENT) {
+
+    if (ctx.window.width == SIZE_FROM_IMAGE ||
+        ctx.window.width == SIZE_FROM_PARENT) {
         // determine window size from the first image
-        const struct pixmap* pm = &first_image->frames[0].pm;
-        ctx.window.width = pm->width;
-        ctx.window.height = pm->height;
+        first_image = create_imglist(sources, num);
+#ifdef HAVE_SWAYWM
+        sway_setup_finish();
+#endif // HAVE_SWAYWM
+        if (!first_image) {
+            imglist_destroy();
+            font_destroy();
+            return false;
+        }
+        if (ctx.window.width == SIZE_FULLSCREEN) {
+            ui_toggle_fullscreen();
+        } else {
+            ctx.window.width = first_image->frames[0].pm.width;
+            ctx.window.height = first_image->frames[0].pm.height;
+        }
+        ui_ok = ui_init(ctx.app_id, ctx.window.width, ctx.window.height,
+                        ctx.wnd_decor);
+    } else {
+        // load the first image while waiting for sway and connecting to
+        // Wayland
+        pthread_t tid;
+        const bool parallel =
+            pthread_create(&tid, NULL, startup_thread, &job) == 0;
+        if (!parallel) {
+            startup_thread(&job);
+        }
+#ifdef HAVE_SWAYWM
+        sway_setup_finish();
+#endif // HAVE_SWAYWM
+        if (ctx.window.width == SIZE_FULLSCREEN) {
+            ui_toggle_fullscreen();
+        }
+        ui_ok = ui_init(ctx.app_id, ctx.window.width, ctx.window.height,
+                        ctx.wnd_decor);
+        if (parallel) {
+            pthread_join(tid, NULL);
+        }
+        first_image = job.image;
+        if (!first_image) {
+            if (ui_ok) {
+                ui_destroy();
+            }
+            imglist_destroy();
+            font_destroy();
+            return false;
+        }
     }
 
-    // user interface initialization
-    if (!ui_init(ctx.app_id, ctx.window.width, ctx.window.height,
-                 ctx.wnd_decor)) {
+    if (!ui_ok) {
         imglist_destroy();
+        font_destroy();
         return false;
     }
 
@@ -528,12 +844,12 @@ bool app_init(const struct config* cfg, const char* const* sources, size_t num)
         perror("Unable to create eventfd");
         imglist_destroy();
         ui_destroy();
+        font_destroy();
         return false;
     }
     pthread_mutex_init(&ctx.events_lock, NULL);
 
     // initialize other subsystems
-    font_init(cfg);
     keybind_init(cfg);
     info_init(cfg);
     viewer_init(cfg, &ctx.mode_handlers[mode_viewer]);
@@ -554,11 +870,44 @@ bool app_init(const struct config* cfg, const char* const* sources, size_t num)
 
     ctx.mode_handlers[ctx.mode_current].activate(first_image);
 
+    if (ctx.server) {
+        server_init();
+    }
+
     return true;
 }
 
+bool app_thumbnails(const struct config* cfg, const char* const* sources,
+                    size_t num)
+{
+    bool rc = false;
+
+    load_config(cfg);
+    tpool_init(cfg);
+    imglist_init(cfg);
+
+    if (!imglist_load(sources, num)) {
+        fprintf(stderr, "Image list is empty, no files to process\n");
+    } else if (ui_init_headless(ctx.window.width, ctx.window.height)) {
+        gallery_init(cfg, &ctx.mode_handlers[mode_gallery]);
+        rc = gallery_generate();
+        gallery_destroy();
+        ui_destroy();
+    }
+
+    imglist_destroy();
+    fcache_destroy();
+    tpool_destroy();
+    action_free(&ctx.sigusr1);
+    action_free(&ctx.sigusr2);
+    free(ctx.app_id);
+
+    return rc;
+}
+
 void app_destroy(void)
 {
+    server_destroy();
     gallery_destroy();
     viewer_destroy();
     ui_destroy();
@@ -566,9 +915,13 @@ void app_destroy(void)
     info_destroy();
     keybind_destroy();
     font_destroy();
+    fcache_destroy();
+    tpool_destroy();
 
     for (size_t i = 0; i < ctx.wfds_num; ++i) {
-        close(ctx.wfds[i].fd);
+        if (ctx.wfds[i].fd != -1) {
+            close(ctx.wfds[i].fd);
+        }
     }
     free(ctx.wfds);
 
@@ -595,31 +948,91 @@ void app_watch(int fd, fd_callback cb, void* data)
         ctx.wfds[ctx.wfds_num].data = data;
         ctx.wfds[ctx.wfds_num].callback = cb;
         ++ctx.wfds_num;
+        ctx.wfds_changed = true;
     }
 }
 
-bool app_run(void)
+void app_unwatch(int fd)
 {
-    struct pollfd* fds;
+    // the entry is removed on the next iteration of the main loop, so it is
+    // safe to call it from the handler
+    for (size_t i = 0; i < ctx.wfds_num; ++i) {
+        if (ctx.wfds[i].fd == fd) {
+            ctx.wfds[i].fd = -1;
+            ctx.wfds_changed = true;
+            break;
+        }
+    }
+}
+
+bool app_open(const char* const* sources, size_t num, bool recursive,
+              bool from_file)
+{
+    const struct mode_handlers* mode = &ctx.mode_handlers[ctx.mode_current];
+    struct image* current = mode->deactivate();
+    struct image* image = imglist_add(sources, num, recursive, from_file);
 
-    // file descriptors to poll
-    fds = calloc(1, ctx.wfds_num * sizeof(struct pollfd));
-    if (!fds) {
-        perror("Failed to allocate memory");
+    // decoded images, thumbnails and glyphs stay in caches, so switching to
+    // the already loaded images is instant
+    mode->activate(image ? image : current);
+    app_redraw();
+
+    return image != NULL;
+}
+
+/**
+ * Remove unwatched descriptors and fill the polling array.
+ * @param fds pointer to the polling array, reallocated if needed
+ * @return false if not enough memory
+ */
+static bool update_pollfd(struct pollfd** fds)
+{
+    size_t num = 0;
+    struct pollfd* ptr;
+
+    for (size_t i = 0; i < ctx.wfds_num; ++i) {
+        if (ctx.wfds[i].fd != -1) {
+            ctx.wfds[num++] = ctx.wfds[i];
+        }
+    }
+    ctx.wfds_num = num;
+    ctx.wfds_changed = false;
+
+    ptr = realloc(*fds, (num ? num : 1) * sizeof(*ptr));
+    if (!ptr) {
         return false;
     }
-    for (size_t i = 0; i < ctx.wfds_num; ++i) {
-        fds[i].fd = ctx.wfds[i].fd;
-        fds[i].events = POLLIN;
+    *fds = ptr;
+    for (size_t i = 0; i < num; ++i) {
+        ptr[i].fd = ctx.wfds[i].fd;
+        ptr[i].events = POLLIN;
+        ptr[i].revents = 0;
     }
 
+    return true;
+}
+
+bool app_run(void)
+{
+    struct pollfd* fds = NULL;
+
     // main event loop
     ctx.state = loop_run;
     while (ctx.state == loop_run) {
+        size_t num;
+
+        // file descriptors to poll, the set is changed by handlers
+        if ((ctx.wfds_changed || !fds) && !update_pollfd(&fds)) {
+            perror("Failed to allocate memory");
+            ctx.state = loop_error;
+            break;
+        }
+        num = ctx.wfds_num;
+
         ui_event_prepare();
 
         // poll events
-        if (poll(fds, ctx.wfds_num, -1) < 0) {
+        if (poll(fds, num, -1) < 0) {
             if (errno != EINTR) {
                 perror("Error polling events");
                 ctx.state = loop_error;
@@ -627,9 +1040,9 @@ bool app_run(void)
             }
         }
 
-        // call handlers for each active event
-        for (size_t i = 0; ctx.state == loop_run && i < ctx.wfds_num; ++i) {
-            if (fds[i].revents & POLLIN) {
+        // call handlers for each active event, skip unwatched ones
+        for (size_t i = 0; ctx.state == loop_run && i < num; ++i) {
+            if ((fds[i].revents & POLLIN) && ctx.wfds[i].fd == fds[i].fd) {
                 ctx.wfds[i].callback(ctx.wfds[i].data);
             }
         }
@@ -656,27 +1069,23 @@ void app_reload(void)
 {
     static const struct action action = { .type = action_reload };
     const union event_params evp = { .action = &action };
-    append_event(event_action, &evp);
+    append_event(event_action, &evp, 0);
 }
 
 void app_redraw(void)
 {
-    // remove the same event to append new one to tail
+    bool notify;
+
+    // all requests are merged into a single redraw, which is handled after
+    // the other queued events
     pthread_mutex_lock(&ctx.events_lock);
-    list_for_each(ctx.events, struct event_queue, it) {
-        if (it->type == event_redraw) {
-            if (list_is_last(it)) {
-                pthread_mutex_unlock(&ctx.events_lock);
-                return;
-            }
-            ctx.events = list_remove(it);
-            free(it);
-            break;
-        }
-    }
+    notify = !ctx.redraw;
+    ctx.redraw = true;
     pthread_mutex_unlock(&ctx.events_lock);
 
-    append_event(event_redraw, NULL);
+    if (notify) {
+        notify_queue();
+    }
 }
 
 void app_on_imglist(const struct image* image, enum fsevent event)
@@ -689,7 +1098,7 @@ void app_on_resize(void)
     ctx.mode_handlers[ctx.mode_current].resize();
 }
 
-void app_on_keyboard(xkb_keysym_t key, uint8_t mods)
+void app_on_keyboard(xkb_keysym_t key, uint8_t mods, size_t repeat)
 {
     const struct keybind* kb = keybind_find(key, mods);
 
@@ -698,9 +1107,12 @@ void app_on_keyboard(xkb_keysym_t key, uint8_t mods)
             const union event_params evp = {
                 .action = &kb->actions.sequence[i],
             };
-            append_event(event_action, &evp);
+            // non-mergeable actions are applied once per timer tick
+            const size_t count =
+                (repeat && !is_mergeable(evp.action->type)) ? 1 : repeat;
+            append_event(event_action, &evp, count);
         }
-    } else {
+    } else if (!repeat) {
         char* name = keybind_name(key, mods);
         if (name) {
             info_update(info_status, "Key %s is not bound", name);
@@ -710,6 +1122,20 @@ void app_on_keyboard(xkb_keysym_t key, uint8_t mods)
     }
 }
 
+void app_on_key_release(void)
+{
+    // drop navigation queued by key repeat but not yet handled
+    pthread_mutex_lock(&ctx.events_lock);
+    list_for_each(ctx.events, struct event_queue, it) {
+        if (it->type == event_action && it->autorepeat &&
+            is_mergeable(it->param.action->type)) {
+            ctx.events = list_remove(it);
+            free(it);
+        }
+    }
+    pthread_mutex_unlock(&ctx.events_lock);
+}
+
 void app_on_drag(int dx, int dy)
 {
     union event_params evp;
@@ -728,5 +1154,10 @@ void app_on_drag(int dx, int dy)
 
     evp.drag.dx = dx;
     evp.drag.dy = dy;
-    append_event(event_drag, &evp);
+    append_event(event_drag, &evp, 0);
+}
+
+void app_on_drop(void)
+{
+    append_event(event_drop, NULL, 0);
 }
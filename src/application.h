@@ -23,6 +23,16 @@ typedef void (*fd_callback)(void* data);
  */
 bool app_init(const struct config* cfg, const char* const* sources, size_t num);
 
+/**
+ * Generate gallery thumbnails for all sources without a compositor and exit.
+ * @param cfg config instance
+ * @param sources list of sources
+ * @param num number of sources in the list
+ * @return true if all thumbnails were generated successfully
+ */
+bool app_thumbnails(const struct config* cfg, const char* const* sources,
+                    size_t num);
+
 /**
  * Destroy global application context.
  */
@@ -36,6 +46,25 @@ void app_destroy(void);
  */
 void app_watch(int fd, fd_callback cb, void* data);
 
+/**
+ * Remove file descriptor from polling in main loop, the descriptor is not
+ * closed.
+ * @param fd file descriptor to remove
+ */
+void app_unwatch(int fd);
+
+/**
+ * Add sources to the image list and show the first of them (request from
+ * another instance in the server mode).
+ * @param sources list of sources
+ * @param num number of sources in the list
+ * @param recursive read directories recursively
+ * @param from_file interpret sources as text lists of image files
+ * @return true if sources were opened
+ */
+bool app_open(const char* const* sources, size_t num, bool recursive,
+              bool from_file);
+
 /**
  * Run application.
  * @return true if application was closed by user, false on errors
@@ -80,11 +109,23 @@ void app_on_resize(void);
  * Handler of external event: key/mouse press.
  * @param key code of key pressed
  * @param mods key modifiers (ctrl/alt/shift)
+ * @param repeat number of key repeats, 0 for key press
+ */
+void app_on_keyboard(xkb_keysym_t key, uint8_t mods, size_t repeat);
+
+/**
+ * Handler of external event: key release, cancels pending actions created
+ * by key repeat.
  */
-void app_on_keyboard(xkb_keysym_t key, uint8_t mods);
+void app_on_key_release(void);
 
 /**
  * Handler of external event: mouse/touch drag.
  * @param dx,dy delta between old and new position
  */
 void app_on_drag(int dx, int dy);
+
+/**
+ * Handler of external event: end of mouse/touch drag.
+ */
+void app_on_drop(void);
@@ -168,3 +168,15 @@ ssize_t str_search_index(const char** array, size_t array_sz, const char* value,
     }
     return -1;
 }
+
+uint64_t str_hash(const void* data, size_t size, uint64_t hash)
+{
+    const uint8_t* ptr = data;
+
+    while (size--) {
+        hash ^= *ptr++;
+        hash *= 0x100000001b3;
+    }
+
+    return hash;
+}
@@ -6,6 +6,7 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <sys/types.h>
 
 #ifndef ARRAY_SIZE
@@ -74,3 +75,15 @@ size_t str_split(const char* text, char delimeter, struct str_slice* slices,
 ssize_t str_search_index(const char** array, size_t array_sz, const char* value,
                          size_t value_len);
 #define str_index(a, v, s) str_search_index((a), ARRAY_SIZE(a), v, s)
+
+// Initial value of the hash
+#define STR_HASH_INIT 0xcbf29ce484222325
+
+/**
+ * Compute hash of the data (64-bit FNV-1a).
+ * @param data pointer to the data
+ * @param size size of the data in bytes
+ * @param hash initial value: STR_HASH_INIT or the hash of the previous part
+ * @return hash value
+ */
+uint64_t str_hash(const void* data, size_t size, uint64_t hash);
@@ -0,0 +1,209 @@
+// SPDX-License-Identifier: MIT
+// Thumbnail atlas: slab allocator with fixed-size slots for thumbnails.
+// Copyright (C) 2025 Artem Senichev <artemsen@gmail.com>
+
+#include "atlas.h"
+
+#include "memstat.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Number of slots in a single slab
+#define SLAB_SLOTS 32
+
+/** Slab: single memory block split into slots. */
+struct slab {
+    uint8_t* data; ///< Slots memory
+    size_t used;   ///< Number of allocated slots
+};
+
+/** Free slot, the pointer is stored in the slot memory. */
+struct free_slot {
+    struct free_slot* next; ///< Next free slot
+};
+
+/** Atlas context. */
+struct atlas {
+    size_t slot_size;       ///< Size of a single slot in bytes, 0=disabled
+    struct slab* slabs;     ///< Array of slabs
+    size_t num_slabs;       ///< Number of slabs in array
+    struct free_slot* free; ///< Head of the free slots list
+    pthread_mutex_t lock;   ///< Atlas access lock
+};
+
+/** Global atlas context. */
+static struct atlas ctx = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/**
+ * Get slab that contains the pointer.
+ * @param ptr pointer to check
+ * @return pointer to the slab or NULL if pointer is not in atlas
+ */
+static struct slab* find_slab(const void* ptr)
+{
+    const uint8_t* addr = ptr;
+    const size_t slab_size = ctx.slot_size * SLAB_SLOTS;
+
+    for (size_t i = 0; i < ctx.num_slabs; ++i) {
+        struct slab* slab = &ctx.slabs[i];
+        if (addr >= slab->data && addr < slab->data + slab_size) {
+            return slab;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Add new slab and put its slots to the free list.
+ * @return false if not enough memory
+ */
+static bool add_slab(void)
+{
+    struct slab* slabs;
+    uint8_t* data;
+
+    data = malloc(ctx.slot_size * SLAB_SLOTS);
+    if (!data) {
+        return false;
+    }
+    slabs = realloc(ctx.slabs, (ctx.num_slabs + 1) * sizeof(*slabs));
+    if (!slabs) {
+        free(data);
+        return false;
+    }
+    ctx.slabs = slabs;
+    ctx.slabs[ctx.num_slabs].data = data;
+    ctx.slabs[ctx.num_slabs].used = 0;
+    ++ctx.num_slabs;
+    memstat_set(memstat_thumb, ctx.num_slabs * ctx.slot_size * SLAB_SLOTS);
+
+    for (size_t i = SLAB_SLOTS; i > 0; --i) {
+        struct free_slot* slot =
+            (struct free_slot*)(data + (i - 1) * ctx.slot_size);
+        slot->next = ctx.free;
+        ctx.free = slot;
+    }
+
+    return true;
+}
+
+/**
+ * Release slab: remove its slots from the free list and free memory.
+ * @param slab slab to release, all its slots must be free
+ */
+static void release_slab(struct slab* slab)
+{
+    const uint8_t* begin = slab->data;
+    const uint8_t* end = begin + ctx.slot_size * SLAB_SLOTS;
+    struct free_slot** it = &ctx.free;
+
+    while (*it) {
+        const uint8_t* addr = (const uint8_t*)*it;
+        if (addr >= begin && addr < end) {
+            *it = (*it)->next;
+        } else {
+            it = &(*it)->next;
+        }
+    }
+
+    free(slab->data);
+    *slab = ctx.slabs[--ctx.num_slabs];
+    memstat_set(memstat_thumb, ctx.num_slabs * ctx.slot_size * SLAB_SLOTS);
+}
+
+void atlas_init(size_t width, size_t height)
+{
+    atlas_destroy();
+
+    pthread_mutex_lock(&ctx.lock);
+    ctx.slot_size = width * height * sizeof(argb_t);
+    if (ctx.slot_size < sizeof(struct free_slot)) {
+        ctx.slot_size = sizeof(struct free_slot);
+    }
+    pthread_mutex_unlock(&ctx.lock);
+}
+
+void atlas_destroy(void)
+{
+    pthread_mutex_lock(&ctx.lock);
+    for (size_t i = 0; i < ctx.num_slabs; ++i) {
+        free(ctx.slabs[i].data);
+    }
+    free(ctx.slabs);
+    ctx.slabs = NULL;
+    ctx.num_slabs = 0;
+    memstat_set(memstat_thumb, 0);
+    ctx.free = NULL;
+    ctx.slot_size = 0;
+    pthread_mutex_unlock(&ctx.lock);
+}
+
+size_t atlas_memory(void)
+{
+    size_t memory;
+
+    pthread_mutex_lock(&ctx.lock);
+    memory = ctx.num_slabs * ctx.slot_size * SLAB_SLOTS;
+    pthread_mutex_unlock(&ctx.lock);
+
+    return memory;
+}
+
+bool atlas_alloc(struct pixmap* pm, size_t width, size_t height)
+{
+    const size_t size = width * height * sizeof(argb_t);
+    struct free_slot* slot = NULL;
+
+    if (size == 0) {
+        return false;
+    }
+
+    pthread_mutex_lock(&ctx.lock);
+    if (size <= ctx.slot_size && (ctx.free || add_slab())) {
+        slot = ctx.free;
+        ctx.free = slot->next;
+        ++find_slab(slot)->used;
+    }
+    pthread_mutex_unlock(&ctx.lock);
+
+    if (!slot) {
+        return pixmap_create(pm, width, height);
+    }
+
+    memset(slot, 0, size);
+    pm->width = width;
+    pm->height = height;
+    pm->data = (argb_t*)slot;
+
+    return true;
+}
+
+void atlas_free(struct pixmap* pm)
+{
+    struct slab* slab;
+
+    if (!pm->data) {
+        return;
+    }
+
+    pthread_mutex_lock(&ctx.lock);
+    slab = find_slab(pm->data);
+    if (slab) {
+        struct free_slot* slot = (struct free_slot*)pm->data;
+        slot->next = ctx.free;
+        ctx.free = slot;
+        if (--slab->used == 0 && ctx.num_slabs > 1) {
+            release_slab(slab);
+        }
+    }
+    pthread_mutex_unlock(&ctx.lock);
+
+    if (!slab) {
+        pixmap_free(pm);
+    }
+}
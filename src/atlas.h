@@ -0,0 +1,39 @@
+// SPDX-License-Identifier: MIT
+// Thumbnail atlas: slab allocator with fixed-size slots for thumbnails.
+// Copyright (C) 2025 Artem Senichev <artemsen@gmail.com>
+
+#pragma once
+
+#include "pixmap.h"
+
+/**
+ * Initialize atlas.
+ * @param width,height max size of thumbnail stored in a single slot
+ */
+void atlas_init(size_t width, size_t height);
+
+/**
+ * Destroy atlas, all slots must be released before.
+ */
+void atlas_destroy(void);
+
+/**
+ * Get size of memory allocated by the atlas.
+ * @return size of all slabs in bytes
+ */
+size_t atlas_memory(void);
+
+/**
+ * Create pixel map in an atlas slot, heap is used if the pixel map doesn't
+ * fit into the slot or the atlas is not initialized.
+ * @param pm pixmap context to initialize
+ * @param width,height pixmap size
+ * @return true if pixmap was created successfully
+ */
+bool atlas_alloc(struct pixmap* pm, size_t width, size_t height);
+
+/**
+ * Free pixel map created with atlas_alloc: return slot to the atlas.
+ * @param pm pixmap to free
+ */
+void atlas_free(struct pixmap* pm);
@@ -4,24 +4,255 @@
 
 #include "cache.h"
 
+#include "formats/qoi.h"
 #include "imglist.h"
+#include "tpool.h"
 
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
 
+/** Stripe of the packed frame: rows encoded independently. */
+struct packed_stripe {
+    size_t offset; ///< Offset of the encoded data
+    size_t size;   ///< Size of the encoded data
+};
+
+/** Packed (compressed) frame. */
+struct packed_frame {
+    size_t width;                  ///< Frame width
+    size_t height;                 ///< Frame height
+    size_t num;                    ///< Number of stripes
+    struct packed_stripe* stripes; ///< Stripes of the frame
+    uint8_t* data;                 ///< Encoded data of all stripes
+};
+
 /** Cache entry. */
 struct cache_entry {
-    struct list list; ///< Links to prev/next entry
-    char image[1];    ///< Image source (variable length)
+    struct list list;            ///< Links to prev/next entry
+    size_t size;                 ///< Size of image data in bytes
+    struct packed_frame* packed; ///< Packed frame, NULL if image is decoded
+    char image[1];               ///< Image source (variable length)
 };
 
 /** Cache queue. */
 struct cache {
     struct cache_entry* queue; ///< Cache queue
-    size_t capacity;           ///< Max length of the queue
+    size_t capacity;           ///< Max number of decoded images
+    size_t packed;             ///< Max number of packed images
+    size_t limit;              ///< Max size of image data, 0 for unlimited
+    bool accounted;            ///< Memory usage is accounted
+    enum memstat_type stat;    ///< Memory accounting category
 };
 
+/** Job of packing/unpacking frame by stripes. */
+struct packer {
+    struct pixmap* pm;           ///< Frame pixmap
+    const struct packed_frame* packed; ///< Packed frame
+    uint8_t** encoded;           ///< Encoded stripes (packing only)
+    bool alpha;                  ///< Image has alpha channel
+    bool success;                ///< Result of all tasks
+};
+
+/**
+ * Update memory accounting of the cache.
+ * @param cache context
+ */
+static void update_memstat(const struct cache* cache)
+{
+    if (cache->accounted) {
+        memstat_set(cache->stat, cache_memory(cache));
+    }
+}
+
+/**
+ * Get pixmap of the frame stripe.
+ * @param pm frame pixmap
+ * @param packed packed frame description
+ * @param index stripe index
+ * @param stripe output pixmap referencing rows of the frame
+ */
+static void get_stripe(const struct pixmap* pm,
+                       const struct packed_frame* packed, size_t index,
+                       struct pixmap* stripe)
+{
+    const size_t start = packed->height * index / packed->num;
+    const size_t end = packed->height * (index + 1) / packed->num;
+    stripe->width = pm->width;
+    stripe->height = end - start;
+    stripe->data = pm->data + start * pm->width;
+}
+
+/**
+ * Thread pool task: encode single stripe.
+ * @param index stripe index
+ * @param data pointer to the packer job
+ */
+static void pack_task(size_t index, void* data)
+{
+    struct packer* job = data;
+    struct pixmap stripe;
+    get_stripe(job->pm, job->packed, index, &stripe);
+    job->encoded[index] = encode_qoi(&stripe, job->alpha,
+                                     &job->packed->stripes[index].size);
+}
+
+/**
+ * Thread pool task: decode single stripe.
+ * @param index stripe index
+ * @param data pointer to the packer job
+ */
+static void unpack_task(size_t index, void* data)
+{
+    struct packer* job = data;
+    const struct packed_stripe* ps = &job->packed->stripes[index];
+    struct pixmap stripe;
+    get_stripe(job->pm, job->packed, index, &stripe);
+    if (!decode_qoi_pixmap(job->packed->data + ps->offset, ps->size,
+                           &stripe)) {
+        job->success = false;
+    }
+}
+
+/**
+ * Free packed frame.
+ * @param packed packed frame to free
+ */
+static void free_packed(struct packed_frame* packed)
+{
+    if (packed) {
+        free(packed->stripes);
+        free(packed->data);
+        free(packed);
+    }
+}
+
+/**
+ * Compress the first frame of the image and unload decoded frames, stripes
+ * of the frame are encoded in parallel.
+ * @param img image to pack
+ * @return packed frame or NULL if image can not be packed
+ */
+static struct packed_frame* pack(struct image* img)
+{
+    struct packer job = { .alpha = img->alpha };
+    struct packed_frame* packed;
+    size_t total = 0;
+
+    // animation and high bit depth samples can not be restored
+    if (!image_has_frames(img) || img->num_frames != 1 || img->anim ||
+        img->levels) {
+        return NULL;
+    }
+
+    packed = calloc(1, sizeof(*packed));
+    if (!packed) {
+        return NULL;
+    }
+    job.pm = &img->frames[0].pm;
+    job.packed = packed;
+    packed->width = job.pm->width;
+    packed->height = job.pm->height;
+    packed->num = tpool_tasks(packed->height);
+    packed->stripes = calloc(packed->num, sizeof(*packed->stripes));
+    job.encoded = calloc(packed->num, sizeof(*job.encoded));
+    if (!packed->stripes || !job.encoded) {
+        free(job.encoded);
+        free_packed(packed);
+        return NULL;
+    }
+
+    tpool_run(packed->num, pack_task, &job);
+
+    // join stripes into a single block
+    job.success = true;
+    for (size_t i = 0; i < packed->num; ++i) {
+        job.success &= (job.encoded[i] != NULL);
+        packed->stripes[i].offset = total;
+        total += packed->stripes[i].size;
+    }
+    if (job.success) {
+        packed->data = malloc(total);
+        if (packed->data) {
+            for (size_t i = 0; i < packed->num; ++i) {
+                memcpy(packed->data + packed->stripes[i].offset,
+                       job.encoded[i], packed->stripes[i].size);
+            }
+        }
+    }
+    for (size_t i = 0; i < packed->num; ++i) {
+        free(job.encoded[i]);
+    }
+    free(job.encoded);
+
+    if (!packed->data) {
+        free_packed(packed);
+        return NULL;
+    }
+
+    image_free(img, IMGFREE_FRAMES);
+
+    return packed;
+}
+
+/**
+ * Restore decoded frame of the image from the packed one.
+ * @param img image to unpack
+ * @param packed packed frame
+ * @return true if frame restored
+ */
+static bool unpack(struct image* img, const struct packed_frame* packed)
+{
+    struct packer job = { .packed = packed, .success = true };
+
+    image_free(img, IMGFREE_FRAMES);
+    job.pm = image_alloc_frame(img, packed->width, packed->height);
+    if (!job.pm) {
+        return false;
+    }
+
+    tpool_run(packed->num, unpack_task, &job);
+
+    if (!job.success) {
+        image_free(img, IMGFREE_FRAMES);
+    }
+
+    return job.success;
+}
+
+/**
+ * Get size of memory used by the packed image.
+ * @param img image instance
+ * @param packed packed frame
+ * @return size in bytes
+ */
+static size_t packed_size(const struct image* img,
+                          const struct packed_frame* packed)
+{
+    size_t size = image_memory(img) + sizeof(*packed) +
+        packed->num * sizeof(*packed->stripes);
+    for (size_t i = 0; i < packed->num; ++i) {
+        size += packed->stripes[i].size;
+    }
+    return size;
+}
+
+/**
+ * Remove entry from the cache and unload its image.
+ * @param cache context
+ * @param entry cache entry to remove
+ */
+static void evict(struct cache* cache, struct cache_entry* entry)
+{
+    struct image* img = imglist_find(entry->image);
+    if (img) {
+        image_free(img, IMGFREE_FRAMES);
+    }
+    free_packed(entry->packed);
+    cache->queue = list_remove(entry);
+    free(entry);
+}
+
 struct cache* cache_init(size_t capacity)
 {
     struct cache* cache = NULL;
@@ -41,6 +272,61 @@ size_t cache_capacity(const struct cache* cache)
     return cache ? cache->capacity : 0;
 }
 
+void cache_set_limit(struct cache* cache, size_t limit)
+{
+    if (cache) {
+        cache->limit = limit;
+    }
+}
+
+void cache_set_packed(struct cache* cache, size_t capacity)
+{
+    if (cache) {
+        cache->packed = capacity;
+    }
+}
+
+void cache_set_memstat(struct cache* cache, enum memstat_type type)
+{
+    if (cache) {
+        cache->accounted = true;
+        cache->stat = type;
+        update_memstat(cache);
+    }
+}
+
+size_t cache_memory(const struct cache* cache)
+{
+    size_t memory = 0;
+
+    if (cache) {
+        list_for_each(cache->queue, const struct cache_entry, it) {
+            memory += it->size;
+        }
+    }
+
+    return memory;
+}
+
+bool cache_fits(const struct cache* cache, const struct image* image)
+{
+    size_t memory;
+
+    if (!cache) {
+        return false;
+    }
+    if (!cache->limit) {
+        return true;
+    }
+
+    memory = image_memory(image);
+    list_for_each(cache->queue, const struct cache_entry, it) {
+        memory += it->size;
+    }
+
+    return memory <= cache->limit;
+}
+
 void cache_free(struct cache* cache)
 {
     if (cache) {
@@ -56,50 +342,72 @@ void cache_trim(struct cache* cache, size_t size)
             if (size) {
                 --size;
             } else {
-                struct image* img = imglist_find(it->image);
-                if (img) {
-                    image_free(img, IMGFREE_FRAMES);
-                }
-                cache->queue = list_remove(it);
-                free(it);
+                evict(cache, it);
             }
         }
+        update_memstat(cache);
     }
 }
 
 bool cache_put(struct cache* cache, struct image* image)
 {
     struct cache_entry* entry;
-    size_t size;
+    size_t num, packed, memory;
+    size_t len;
 
     if (!cache) {
         return false;
     }
 
+    // check if the image fits into the cache at all
+    memory = image_memory(image);
+    if (cache->limit && memory > cache->limit) {
+        return false;
+    }
+
     // create new entry
-    size = strlen(image->source);
-    entry = malloc(sizeof(struct cache_entry) + size);
+    len = strlen(image->source);
+    entry = malloc(sizeof(struct cache_entry) + len);
     if (!entry) {
         return false;
     }
-    memcpy(entry->image, image->source, size + 1 /* last null */);
+    entry->size = memory;
+    entry->packed = NULL;
+    memcpy(entry->image, image->source, len + 1 /* last null */);
 
-    // remove last entry if queue size exceeds capacity
-    size = 0;
+    // pack or remove the oldest entries if queue exceeds capacity or memory
+    // limit, the newest entries are at the head of the queue
+    num = 1;
+    packed = 0;
     list_for_each(cache->queue, struct cache_entry, it) {
         assert(strcmp(it->image, image->source));
-        if (++size >= cache->capacity) {
-            struct image* img = imglist_find(it->image);
-            if (img) {
-                image_free(img, IMGFREE_FRAMES);
+        if (!it->packed) {
+            struct image* img;
+            if (num < cache->capacity &&
+                (!cache->limit || memory + it->size <= cache->limit)) {
+                memory += it->size;
+                ++num;
+                continue;
+            }
+            img = cache->packed ? imglist_find(it->image) : NULL;
+            it->packed = img ? pack(img) : NULL;
+            if (!it->packed) {
+                evict(cache, it);
+                continue;
             }
-            cache->queue = list_remove(it);
-            free(it);
-            break;
+            it->size = packed_size(img, it->packed);
+        }
+        if (packed < cache->packed &&
+            (!cache->limit || memory + it->size <= cache->limit)) {
+            memory += it->size;
+            ++packed;
+        } else {
+            evict(cache, it);
         }
     }
 
     cache->queue = list_add(cache->queue, entry);
+    update_memstat(cache);
 
     return true;
 }
@@ -112,10 +420,16 @@ bool cache_out(struct cache* cache, const struct image* image)
         list_for_each(cache->queue, struct cache_entry, it) {
             found = strcmp(image->source, it->image) == 0;
             if (found) {
-                const struct image* img = imglist_find(it->image);
-                found = (img && image_has_frames(img));
+                struct image* img = imglist_find(it->image);
+                if (img && it->packed) {
+                    found = unpack(img, it->packed);
+                } else {
+                    found = (img && image_has_frames(img));
+                }
+                free_packed(it->packed);
                 cache->queue = list_remove(it);
                 free(it);
+                update_memstat(cache);
                 break;
             }
         }
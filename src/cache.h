@@ -5,6 +5,7 @@
 #pragma once
 
 #include "image.h"
+#include "memstat.h"
 
 /** Cache queue. */
 struct cache;
@@ -22,6 +23,43 @@ struct cache* cache_init(size_t capacity);
  */
 size_t cache_capacity(const struct cache* cache);
 
+/**
+ * Set limit of memory used by cached images.
+ * @param cache context
+ * @param limit max size of image data in bytes, 0 for unlimited
+ */
+void cache_set_limit(struct cache* cache, size_t limit);
+
+/**
+ * Set number of images kept compressed in memory after eviction from the
+ * decoded part of the cache: restoring them is much faster than decoding.
+ * @param cache context
+ * @param capacity max number of packed images, 0 to disable packing
+ */
+void cache_set_packed(struct cache* cache, size_t capacity);
+
+/**
+ * Enable accounting of memory used by cached images.
+ * @param cache context
+ * @param type memory category
+ */
+void cache_set_memstat(struct cache* cache, enum memstat_type type);
+
+/**
+ * Get size of memory used by cached images.
+ * @param cache context
+ * @return size of image data in bytes
+ */
+size_t cache_memory(const struct cache* cache);
+
+/**
+ * Check if image can be put to the cache without exceeding memory limit.
+ * @param cache context
+ * @param image pointer to image instance
+ * @return true if image fits into the free space of the cache
+ */
+bool cache_fits(const struct cache* cache, const struct image* image);
+
 /**
  * Free cache queue, unload all images from the cache.
  * @param cache context
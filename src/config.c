@@ -31,23 +31,43 @@ static const struct config_default defaults[] = {
     { CFG_GENERAL,      CFG_GNRL_SIGUSR1,   "reload"                 },
     { CFG_GENERAL,      CFG_GNRL_SIGUSR2,   "next_file"              },
     { CFG_GENERAL,      CFG_GNRL_APP_ID,    "swayimg"                },
+    { CFG_GENERAL,      CFG_GNRL_THREADS,   "0"                      },
+    { CFG_GENERAL,      CFG_GNRL_IMG_MEM,   "0"                      },
+    { CFG_GENERAL,      CFG_GNRL_DEC_THRD,  "0"                      },
+    { CFG_GENERAL,      CFG_GNRL_ISOLATE,   CFG_NO                   },
+    { CFG_GENERAL,      CFG_GNRL_ISO_TIME,  "10"                     },
+    { CFG_GENERAL,      CFG_GNRL_RAW_MODE,  "full"                   },
+    { CFG_GENERAL,      CFG_GNRL_FCACHE,    "0"                      },
+    { CFG_GENERAL,      CFG_GNRL_FCACHE_TM, "500"                    },
+    { CFG_GENERAL,      CFG_GNRL_TRACE,     "none"                   },
+    { CFG_GENERAL,      CFG_GNRL_SERVER,    CFG_NO                   },
 
     { CFG_VIEWER,       CFG_VIEW_WINDOW,    "#00000000"              },
     { CFG_VIEWER,       CFG_VIEW_TRANSP,    "grid"                   },
     { CFG_VIEWER,       CFG_VIEW_SCALE,     "optimal"                },
     { CFG_VIEWER,       CFG_VIEW_KEEP_ZM,   CFG_NO                   },
+    { CFG_VIEWER,       CFG_VIEW_SMOOTH,    CFG_YES                  },
     { CFG_VIEWER,       CFG_VIEW_POSITION,  "center"                 },
     { CFG_VIEWER,       CFG_VIEW_AA,        "mks13"                  },
+    { CFG_VIEWER,       CFG_VIEW_AA_DELAY,  "0"                      },
+    { CFG_VIEWER,       CFG_VIEW_COMP_SCL,  CFG_NO                   },
     { CFG_VIEWER,       CFG_VIEW_SSHOW,     CFG_NO                   },
     { CFG_VIEWER,       CFG_VIEW_SSHOW_TM,  "3"                      },
     { CFG_VIEWER,       CFG_VIEW_HISTORY,   "1"                      },
     { CFG_VIEWER,       CFG_VIEW_PRELOAD,   "1"                      },
+    { CFG_VIEWER,       CFG_VIEW_PREL_BACK, "0"                      },
+    { CFG_VIEWER,       CFG_VIEW_PREFETCH,  "0"                      },
+    { CFG_VIEWER,       CFG_VIEW_HIST_MEM,  "0"                      },
+    { CFG_VIEWER,       CFG_VIEW_HIST_PACK, "0"                      },
+    { CFG_VIEWER,       CFG_VIEW_PREL_MEM,  "0"                      },
 
     { CFG_GALLERY,      CFG_GLRY_SIZE,      "200"                    },
     { CFG_GALLERY,      CFG_GLRY_CACHE,     "100"                    },
     { CFG_GALLERY,      CFG_GLRY_PRELOAD,   CFG_NO                   },
     { CFG_GALLERY,      CFG_GLRY_PSTORE,    CFG_NO                   },
+    { CFG_GALLERY,      CFG_GLRY_PREVIEW,   "160"                    },
     { CFG_GALLERY,      CFG_GLRY_FILL,      CFG_YES                  },
+    { CFG_GALLERY,      CFG_GLRY_SMOOTH,    CFG_YES                  },
     { CFG_GALLERY,      CFG_GLRY_AA,        "mks13"                  },
     { CFG_GALLERY,      CFG_GLRY_WINDOW,    "#00000000"              },
     { CFG_GALLERY,      CFG_GLRY_BKG,       "#202020ff"              },
@@ -124,6 +144,10 @@ static const struct config_default defaults[] = {
     { CFG_KEYS_VIEWER,  "Shift+a",          "antialiasing prev"      },
     { CFG_KEYS_VIEWER,  "r",                "reload"                 },
     { CFG_KEYS_VIEWER,  "Alt+r",            "svg_rerender"           },
+    { CFG_KEYS_VIEWER,  "Ctrl+Up",          "level +5"               },
+    { CFG_KEYS_VIEWER,  "Ctrl+Down",        "level -5"               },
+    { CFG_KEYS_VIEWER,  "Ctrl+Right",       "window +5"              },
+    { CFG_KEYS_VIEWER,  "Ctrl+Left",        "window -5"              },
     { CFG_KEYS_VIEWER,  "i",                "info"                   },
     { CFG_KEYS_VIEWER,  "Shift+Delete",     RM_FILE_ACTION           },
     { CFG_KEYS_VIEWER,  "Escape",           "exit"                   },
@@ -41,21 +41,41 @@ struct config {
 #define CFG_GNRL_SIGUSR1   "sigusr1"
 #define CFG_GNRL_SIGUSR2   "sigusr2"
 #define CFG_GNRL_APP_ID    "app_id"
+#define CFG_GNRL_THREADS   "threads"
+#define CFG_GNRL_IMG_MEM   "image_limit"
+#define CFG_GNRL_DEC_THRD  "decoder_threads"
+#define CFG_GNRL_ISOLATE   "decoder_isolate"
+#define CFG_GNRL_ISO_TIME  "decoder_timeout"
+#define CFG_GNRL_RAW_MODE  "raw_mode"
+#define CFG_GNRL_FCACHE    "frame_cache"
+#define CFG_GNRL_FCACHE_TM "frame_cache_time"
+#define CFG_GNRL_TRACE     "trace"
+#define CFG_GNRL_SERVER    "server"
 #define CFG_VIEW_WINDOW    "window"
 #define CFG_VIEW_TRANSP    "transparency"
 #define CFG_VIEW_SCALE     "scale"
 #define CFG_VIEW_KEEP_ZM   "keep_zoom"
+#define CFG_VIEW_SMOOTH    "smooth"
 #define CFG_VIEW_POSITION  "position"
 #define CFG_VIEW_AA        "antialiasing"
+#define CFG_VIEW_AA_DELAY  "antialiasing_delay"
+#define CFG_VIEW_COMP_SCL  "compositor_scale"
 #define CFG_VIEW_SSHOW     "slideshow"
 #define CFG_VIEW_SSHOW_TM  "slideshow_time"
 #define CFG_VIEW_HISTORY   "history"
 #define CFG_VIEW_PRELOAD   "preload"
+#define CFG_VIEW_PREL_BACK "preload_back"
+#define CFG_VIEW_PREFETCH  "prefetch"
+#define CFG_VIEW_HIST_MEM  "history_limit"
+#define CFG_VIEW_HIST_PACK "history_packed"
+#define CFG_VIEW_PREL_MEM  "preload_limit"
 #define CFG_GLRY_SIZE      "size"
 #define CFG_GLRY_CACHE     "cache"
 #define CFG_GLRY_PRELOAD   "preload"
 #define CFG_GLRY_PSTORE    "pstore"
+#define CFG_GLRY_PREVIEW   "preview"
 #define CFG_GLRY_FILL      "fill"
+#define CFG_GLRY_SMOOTH    "smooth"
 #define CFG_GLRY_AA        "antialiasing"
 #define CFG_GLRY_WINDOW    "window"
 #define CFG_GLRY_BKG       "background"
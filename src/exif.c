@@ -4,11 +4,61 @@
 
 #include "exif.h"
 
+#include "buildcfg.h"
 #include "formats/loader.h"
 
+#ifdef HAVE_LIBJPEG
+#include "formats/jpeg.h"
+#endif
+
 #include <libexif/exif-data.h>
+#include <stdlib.h>
 #include <string.h>
 
+// EXIF header of JPEG APP1 segment
+static const uint8_t exif_header[] = { 'E', 'x', 'i', 'f', 0, 0 };
+
+// Tag of image orientation in IFD0
+#define TIFF_TAG_ORIENTATION 0x0112
+// Size of IFD entry: tag, type, count, value
+#define TIFF_ENTRY_SIZE 12
+
+/**
+ * Apply orientation value to the image.
+ * @param img target image instance
+ * @param orientation EXIF orientation value
+ */
+static void apply_orientation(struct image* img, int orientation)
+{
+    switch (orientation) {
+        case 2: // flipped back-to-front
+            image_flip_horizontal(img);
+            break;
+        case 3: // upside down
+            image_rotate(img, 180);
+            break;
+        case 4: // flipped back-to-front and upside down
+            image_flip_vertical(img);
+            break;
+        case 5: // flipped back-to-front and on its side
+            image_flip_horizontal(img);
+            image_rotate(img, 90);
+            break;
+        case 6: // on its side
+            image_rotate(img, 90);
+            break;
+        case 7: // flipped back-to-front and on its far side
+            image_flip_vertical(img);
+            image_rotate(img, 270);
+            break;
+        case 8: // on its far side
+            image_rotate(img, 270);
+            break;
+        default:
+            break;
+    }
+}
+
 /**
  * Fix orientation from EXIF data.
  * @param img target image instance
@@ -19,34 +69,97 @@ static void fix_orientation(struct image* img, ExifData* exif)
     const ExifEntry* entry = exif_data_get_entry(exif, EXIF_TAG_ORIENTATION);
     if (entry) {
         const ExifByteOrder byte_order = exif_data_get_byte_order(exif);
-        switch (exif_get_short(entry->data, byte_order)) {
-            case 2: // flipped back-to-front
-                image_flip_horizontal(img);
-                break;
-            case 3: // upside down
-                image_rotate(img, 180);
-                break;
-            case 4: // flipped back-to-front and upside down
-                image_flip_vertical(img);
-                break;
-            case 5: // flipped back-to-front and on its side
-                image_flip_horizontal(img);
-                image_rotate(img, 90);
-                break;
-            case 6: // on its side
-                image_rotate(img, 90);
-                break;
-            case 7: // flipped back-to-front and on its far side
-                image_flip_vertical(img);
-                image_rotate(img, 270);
-                break;
-            case 8: // on its far side
-                image_rotate(img, 270);
-                break;
-            default:
+        apply_orientation(img, exif_get_short(entry->data, byte_order));
+    }
+}
+
+/**
+ * Find TIFF block with EXIF data.
+ * @param data image file data (JPEG) or EXIF data
+ * @param size size of data in bytes
+ * @param tiff_size output size of the TIFF block in bytes
+ * @return pointer to the TIFF block or NULL if not found
+ */
+static const uint8_t* find_tiff(const uint8_t* data, size_t size,
+                                size_t* tiff_size)
+{
+    if (size > 4 && data[0] == 0xff && data[1] == 0xd8) {
+        // JPEG: search for APP1 segment, all of them precede the image data
+        const uint8_t* app1 = NULL;
+        size_t app1_size = 0;
+        size_t pos = 2;
+        while (!app1 && pos + 4 <= size && data[pos] == 0xff) {
+            const uint8_t marker = data[pos + 1];
+            const size_t len = ((size_t)data[pos + 2] << 8) | data[pos + 3];
+            if (marker == 0xda /* SOS */ || len < 2 || pos + 2 + len > size) {
                 break;
+            }
+            if (marker == 0xe1 /* APP1 */ && len > 2 + sizeof(exif_header) &&
+                memcmp(data + pos + 4, exif_header, sizeof(exif_header)) == 0) {
+                app1 = data + pos + 4;
+                app1_size = len - 2;
+            }
+            pos += 2 + len;
         }
+        if (!app1) {
+            return NULL;
+        }
+        data = app1;
+        size = app1_size;
+    }
+
+    if (size > sizeof(exif_header) &&
+        memcmp(data, exif_header, sizeof(exif_header)) == 0) {
+        data += sizeof(exif_header);
+        size -= sizeof(exif_header);
     }
+
+    // check TIFF header: byte order and magic number
+    if (size < 8 || !((memcmp(data, "II*\0", 4) == 0) ||
+                      (memcmp(data, "MM\0*", 4) == 0))) {
+        return NULL;
+    }
+
+    *tiff_size = size;
+    return data;
+}
+
+/**
+ * Read orientation from IFD0 of the TIFF block.
+ * @param tiff TIFF block
+ * @param size size of the block in bytes
+ * @return orientation value or 0 if not found
+ */
+static int read_orientation(const uint8_t* tiff, size_t size)
+{
+    const bool le = (tiff[0] == 'I');
+    size_t offset, num;
+
+#define TIFF_U16(p) (le ? (p)[0] | ((p)[1] << 8) : ((p)[0] << 8) | (p)[1])
+#define TIFF_U32(p)                                                     \
+    (le ? (uint32_t)TIFF_U16(p) | ((uint32_t)TIFF_U16((p) + 2) << 16) \
+        : ((uint32_t)TIFF_U16(p) << 16) | (uint32_t)TIFF_U16((p) + 2))
+
+    offset = TIFF_U32(tiff + 4);
+    if (offset + 2 > size) {
+        return 0;
+    }
+    num = TIFF_U16(tiff + offset);
+    offset += 2;
+
+    for (size_t i = 0; i < num && offset + TIFF_ENTRY_SIZE <= size; ++i) {
+        const uint8_t* entry = tiff + offset;
+        if (TIFF_U16(entry) == TIFF_TAG_ORIENTATION) {
+            // type is SHORT, the value is stored in the entry itself
+            return TIFF_U16(entry + 8);
+        }
+        offset += TIFF_ENTRY_SIZE;
+    }
+
+#undef TIFF_U16
+#undef TIFF_U32
+
+    return 0;
 }
 
 /**
@@ -162,10 +275,41 @@ static void read_location(struct image* img, ExifData* exif)
 
 void process_exif(struct image* img, const uint8_t* data, size_t size)
 {
-    ExifData* exif = exif_data_new_from_data(data, (unsigned int)size);
-    if (exif) {
-        fix_orientation(img, exif);
+    const uint8_t* tiff;
+    size_t tiff_size;
+
+    if (!data) {
+        return;
+    }
+    tiff = find_tiff(data, size, &tiff_size);
+    if (!tiff) {
+        return;
+    }
+
+    apply_orientation(img, read_orientation(tiff, tiff_size));
+
+    // keep the raw block for the deferred parsing of meta info
+    free(img->exif);
+    img->exif_size = sizeof(exif_header) + tiff_size;
+    img->exif = malloc(img->exif_size);
+    if (img->exif) {
+        memcpy(img->exif, exif_header, sizeof(exif_header));
+        memcpy(img->exif + sizeof(exif_header), tiff, tiff_size);
+    } else {
+        img->exif_size = 0;
+    }
+}
+
+void exif_meta(struct image* img)
+{
+    ExifData* exif;
+
+    if (!img->exif) {
+        return;
+    }
 
+    exif = exif_data_new_from_data(img->exif, (unsigned int)img->exif_size);
+    if (exif) {
         add_meta(img, exif, EXIF_TAG_DATE_TIME, "DateTime");
         add_meta(img, exif, EXIF_TAG_MAKE, "Camera");
         add_meta(img, exif, EXIF_TAG_MODEL, "Model");
@@ -177,4 +321,44 @@ void process_exif(struct image* img, const uint8_t* data, size_t size)
 
         exif_data_unref(exif);
     }
+
+    free(img->exif);
+    img->exif = NULL;
+    img->exif_size = 0;
+}
+
+#ifdef HAVE_LIBJPEG
+enum image_status exif_preview(struct image* img, const uint8_t* data,
+                               size_t size, size_t min_size)
+{
+    enum image_status status = imgload_unsupported;
+    ExifData* exif;
+
+    // only JPEG files store previews in EXIF
+    if (size < 2 || data[0] != 0xff || data[1] != 0xd8) {
+        return imgload_unsupported;
+    }
+
+    exif = exif_data_new_from_data(data, (unsigned int)size);
+    if (!exif) {
+        return imgload_unsupported;
+    }
+
+    if (exif->data && exif->size) {
+        status = decode_jpeg(img, exif->data, exif->size, 0);
+        if (status == imgload_success) {
+            const struct pixmap* pm = &img->frames[0].pm;
+            if (max(pm->width, pm->height) < min_size) {
+                image_free(img, IMGFREE_FRAMES);
+                status = imgload_unsupported; // too small
+            } else {
+                fix_orientation(img, exif);
+            }
+        }
+    }
+
+    exif_data_unref(exif);
+
+    return status;
 }
+#endif // HAVE_LIBJPEG
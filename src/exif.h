@@ -7,9 +7,28 @@
 #include "image.h"
 
 /**
- * Read and handle EXIF data.
+ * Handle EXIF data while decoding: fix orientation of the image and keep the
+ * raw EXIF block, meta info is parsed on demand (see `exif_meta`).
+ * @param img target image context
+ * @param data image file data (JPEG) or EXIF data
+ * @param size size of data in bytes
+ */
+void process_exif(struct image* img, const uint8_t* data, size_t size);
+
+/**
+ * Parse meta info from the EXIF block kept by `process_exif`, the block is
+ * freed afterwards.
+ * @param img target image context
+ */
+void exif_meta(struct image* img);
+
+/**
+ * Decode preview image (thumbnail) embedded into EXIF data of JPEG file.
  * @param img target image context
  * @param data image file data
  * @param size size of image data in bytes
+ * @param min_size minimal size of the preview's longest side in pixels
+ * @return loading status
  */
-void process_exif(struct image* img, const uint8_t* data, size_t size);
+enum image_status exif_preview(struct image* img, const uint8_t* data,
+                               size_t size, size_t min_size);
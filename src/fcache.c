@@ -0,0 +1,489 @@
+// SPDX-License-Identifier: MIT
+// Persistent cache of decoded frames for images that are slow to decode.
+// Copyright (C) 2025 Artem Senichev <artemsen@gmail.com>
+
+#include "fcache.h"
+
+#include "array.h"
+#include "formats/qoi.h"
+#include "fs.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Cache file header
+static const uint8_t file_magic[] = { 'S', 'W', 'I', 'M', 'G', 'F', 'C', '1' };
+// Extension of cache files
+#define FILE_EXT ".fc"
+// Max length of the cache file name: hash and extension
+#define NAME_MAX_LEN (16 + sizeof(FILE_EXT))
+
+/**
+ * Cache file header, followed by source path, format description, meta info
+ * (pairs of null-terminated key and value), raw EXIF data and QOI encoded
+ * frame.
+ */
+struct __attribute__((__packed__)) header {
+    uint8_t magic[sizeof(file_magic)]; ///< File signature
+    int64_t mtime;                     ///< Modification time of the source
+    uint64_t fsize;                    ///< Size of the source file
+    uint32_t path_len;                 ///< Length of the source path
+    uint32_t format_len;               ///< Size of format (with last null)
+    uint32_t info_len;                 ///< Size of all meta info strings
+    uint32_t info_num;                 ///< Number of meta info entries
+    uint32_t exif_len;                 ///< Size of raw EXIF data
+    uint64_t data_len;                 ///< Size of the encoded frame
+    uint8_t alpha;                     ///< Image has alpha channel
+};
+
+/** Background write job. */
+struct save_job {
+    char name[NAME_MAX_LEN]; ///< Cache file name
+    struct pixmap pm;        ///< Copy of the frame
+    bool alpha;              ///< Image has alpha channel
+    uint8_t* head;           ///< Header with all data except encoded frame
+    size_t head_len;         ///< Size of the header data
+};
+
+/** Cache file entry used for eviction. */
+struct cache_file {
+    char name[NAME_MAX_LEN]; ///< File name
+    time_t mtime;            ///< Time of the last use
+    size_t size;             ///< File size
+};
+
+/** Frame cache context. */
+struct fcache {
+    char dir[PATH_MAX]; ///< Cache directory, ends with slash
+    size_t limit;       ///< Max total size of cache files
+    double threshold;   ///< Min decoding time to save image to the cache
+    bool enabled;       ///< Cache is initialized
+
+    pthread_t writer;     ///< Background writer thread
+    bool joinable;        ///< Writer thread is not joined yet
+    atomic_bool busy;     ///< Writer thread is running
+    pthread_mutex_t lock; ///< Writer start/stop lock
+};
+
+/** Global cache context. */
+static struct fcache ctx = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/**
+ * Compose cache file name for the source (hash of the path).
+ * @param source image source
+ * @param name output buffer
+ */
+static void file_name(const char* source, char name[NAME_MAX_LEN])
+{
+    const uint64_t hash = str_hash(source, strlen(source), STR_HASH_INIT);
+    snprintf(name, NAME_MAX_LEN, "%016" PRIx64 FILE_EXT, hash);
+}
+
+/**
+ * Get full path to the cache file.
+ * @param name cache file name
+ * @param path output buffer
+ * @return false if the path is too long
+ */
+static bool file_path(const char* name, char path[PATH_MAX])
+{
+    const int len = snprintf(path, PATH_MAX, "%s%s", ctx.dir, name);
+    return len > 0 && len < PATH_MAX;
+}
+
+/**
+ * Check if the source is a regular file.
+ * @param source image source
+ * @param st output: file status
+ * @return true if the file is suitable for caching
+ */
+static bool is_file(const char* source, struct stat* st)
+{
+    return strncmp(source, LDRSRC_STDIN, LDRSRC_STDIN_LEN) != 0 &&
+        strncmp(source, LDRSRC_EXEC, LDRSRC_EXEC_LEN) != 0 &&
+        stat(source, st) == 0 && S_ISREG(st->st_mode);
+}
+
+/**
+ * Compare cache files by time of the last use.
+ */
+static int compare_mtime(const void* a, const void* b)
+{
+    const struct cache_file* fa = a;
+    const struct cache_file* fb = b;
+    return (fa->mtime > fb->mtime) - (fa->mtime < fb->mtime);
+}
+
+/**
+ * Remove the least recently used files if the cache exceeds the limit.
+ */
+static void evict(void)
+{
+    struct cache_file* files = NULL;
+    size_t num = 0;
+    size_t capacity = 0;
+    size_t total = 0;
+    struct dirent* entry;
+    DIR* dir;
+
+    dir = opendir(ctx.dir);
+    if (!dir) {
+        return;
+    }
+
+    while ((entry = readdir(dir))) {
+        const size_t len = strlen(entry->d_name);
+        struct stat st;
+        if (len >= NAME_MAX_LEN || len < sizeof(FILE_EXT) ||
+            strcmp(entry->d_name + len - sizeof(FILE_EXT) + 1, FILE_EXT) != 0 ||
+            fstatat(dirfd(dir), entry->d_name, &st, 0) != 0) {
+            continue;
+        }
+        if (num == capacity) {
+            struct cache_file* realloced;
+            capacity = capacity ? capacity * 2 : 64;
+            realloced = realloc(files, capacity * sizeof(*files));
+            if (!realloced) {
+                break;
+            }
+            files = realloced;
+        }
+        memcpy(files[num].name, entry->d_name, len + 1);
+        files[num].mtime = st.st_mtime;
+        files[num].size = st.st_size;
+        total += st.st_size;
+        ++num;
+    }
+
+    if (total > ctx.limit) {
+        qsort(files, num, sizeof(*files), compare_mtime);
+        for (size_t i = 0; i < num && total > ctx.limit; ++i) {
+            if (unlinkat(dirfd(dir), files[i].name, 0) == 0) {
+                total -= files[i].size;
+            }
+        }
+    }
+
+    closedir(dir);
+    free(files);
+}
+
+/**
+ * Background writer: encode frame and write cache file.
+ * @param data pointer to the save job
+ * @return NULL
+ */
+static void* save_thread(void* data)
+{
+    struct save_job* job = data;
+    struct header* hdr = (struct header*)job->head;
+    char path[PATH_MAX], tmp[PATH_MAX];
+    uint8_t* qoi;
+    size_t qoi_size;
+
+    qoi = encode_qoi(&job->pm, job->alpha, &qoi_size);
+    pixmap_free(&job->pm);
+
+    if (qoi && file_path(job->name, path) &&
+        snprintf(tmp, sizeof(tmp), "%s.tmp", path) < (int)sizeof(tmp)) {
+        // write to the temporary file to not expose partial data
+        const int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                            S_IRUSR | S_IWUSR);
+        if (fd != -1) {
+            bool success;
+            hdr->data_len = qoi_size;
+            success = write(fd, job->head, job->head_len) ==
+                    (ssize_t)job->head_len &&
+                write(fd, qoi, qoi_size) == (ssize_t)qoi_size;
+            close(fd);
+            if (!success || rename(tmp, path) == -1) {
+                unlink(tmp);
+            }
+        }
+        evict();
+    }
+
+    free(qoi);
+    free(job->head);
+    free(job);
+
+    atomic_store(&ctx.busy, false);
+
+    return NULL;
+}
+
+/**
+ * Serialize image description to the cache file header.
+ * @param img image to save
+ * @param st status of the source file
+ * @param size output: size of the header data
+ * @return header data, the caller must free it
+ */
+static uint8_t* create_head(const struct image* img, const struct stat* st,
+                            size_t* size)
+{
+    struct header hdr = { 0 };
+    uint8_t* head;
+    uint8_t* ptr;
+
+    memcpy(hdr.magic, file_magic, sizeof(file_magic));
+    hdr.mtime = st->st_mtim.tv_sec;
+    hdr.fsize = st->st_size;
+    hdr.path_len = strlen(img->source);
+    hdr.format_len = img->format ? strlen(img->format) + 1 : 0;
+    list_for_each(img->info, const struct image_info, it) {
+        hdr.info_len += strlen(it->key) + 1 + strlen(it->value) + 1;
+        ++hdr.info_num;
+    }
+    hdr.exif_len = img->exif_size;
+    hdr.alpha = img->alpha;
+
+    *size = sizeof(hdr) + hdr.path_len + hdr.format_len + hdr.info_len +
+        hdr.exif_len;
+    head = malloc(*size);
+    if (!head) {
+        return NULL;
+    }
+
+    ptr = head;
+    memcpy(ptr, &hdr, sizeof(hdr));
+    ptr += sizeof(hdr);
+    memcpy(ptr, img->source, hdr.path_len);
+    ptr += hdr.path_len;
+    if (hdr.format_len) {
+        memcpy(ptr, img->format, hdr.format_len);
+        ptr += hdr.format_len;
+    }
+    list_for_each(img->info, const struct image_info, it) {
+        const size_t key_len = strlen(it->key) + 1;
+        const size_t val_len = strlen(it->value) + 1;
+        memcpy(ptr, it->key, key_len);
+        ptr += key_len;
+        memcpy(ptr, it->value, val_len);
+        ptr += val_len;
+    }
+    if (hdr.exif_len) {
+        memcpy(ptr, img->exif, hdr.exif_len);
+    }
+
+    return head;
+}
+
+/**
+ * Load image from the mapped cache file.
+ * @param img image to load
+ * @param st status of the source file
+ * @param data cache file data
+ * @param size size of the file
+ * @return true if image loaded
+ */
+static bool load_file(struct image* img, const struct stat* st,
+                      const uint8_t* data, size_t size)
+{
+    const uint8_t* end = data + size;
+    const uint8_t* ptr = data + sizeof(struct header);
+    const uint8_t* exif;
+    const uint8_t* qoi;
+    const char* format = NULL;
+    struct header hdr;
+
+    if (size < sizeof(hdr)) {
+        return false;
+    }
+    memcpy(&hdr, data, sizeof(hdr));
+
+    // check the key: the file can be replaced or the hash can collide
+    if (memcmp(hdr.magic, file_magic, sizeof(file_magic)) != 0 ||
+        hdr.mtime != st->st_mtim.tv_sec || hdr.fsize != (uint64_t)st->st_size ||
+        hdr.path_len != strlen(img->source) ||
+        (size_t)(end - ptr) < hdr.path_len ||
+        memcmp(ptr, img->source, hdr.path_len) != 0) {
+        return false;
+    }
+    ptr += hdr.path_len;
+
+    if ((size_t)(end - ptr) <
+        (uint64_t)hdr.format_len + hdr.info_len + hdr.exif_len + hdr.data_len) {
+        return false;
+    }
+    if (hdr.format_len) {
+        format = fs_read_str(&ptr, ptr + hdr.format_len);
+        if (!format) {
+            return false;
+        }
+    }
+    exif = ptr + hdr.info_len;
+    qoi = exif + hdr.exif_len;
+
+    // decode frame first, meta info is added to the loaded image only
+    if (decode_qoi(img, qoi, hdr.data_len, 0) != imgload_success) {
+        image_free(img, IMGFREE_FRAMES);
+        return false;
+    }
+
+    if (format) {
+        image_set_format(img, "%s", format);
+    }
+    for (size_t i = 0; i < hdr.info_num; ++i) {
+        const char* key = fs_read_str(&ptr, exif);
+        const char* value = key ? fs_read_str(&ptr, exif) : NULL;
+        if (!value) {
+            break;
+        }
+        image_add_meta(img, key, "%s", value);
+    }
+    if (hdr.exif_len) {
+        free(img->exif);
+        img->exif = malloc(hdr.exif_len);
+        img->exif_size = img->exif ? hdr.exif_len : 0;
+        if (img->exif) {
+            memcpy(img->exif, exif, hdr.exif_len);
+        }
+    }
+
+    img->alpha = hdr.alpha;
+    img->file_size = st->st_size;
+    img->file_time = st->st_mtime;
+
+    return true;
+}
+
+bool fcache_init(const char* dir, size_t limit, size_t threshold)
+{
+    const size_t len = strlen(dir);
+    char path[PATH_MAX];
+
+    fcache_destroy();
+
+    if (len == 0 || len + 1 /* slash */ + NAME_MAX_LEN + 4 /* .tmp */ >=
+            sizeof(ctx.dir)) {
+        return false;
+    }
+
+    // create all directories of the path
+    memcpy(path, dir, len + 1);
+    if (path[len - 1] != '/') {
+        path[len] = '/';
+        path[len + 1] = 0;
+    }
+    if (!fs_mkdirs(path, S_IRWXU)) {
+        return false;
+    }
+
+    memcpy(ctx.dir, path, sizeof(path));
+    ctx.limit = limit;
+    ctx.threshold = threshold;
+    ctx.enabled = true;
+
+    return true;
+}
+
+void fcache_destroy(void)
+{
+    pthread_mutex_lock(&ctx.lock);
+    if (ctx.joinable) {
+        pthread_join(ctx.writer, NULL);
+        ctx.joinable = false;
+    }
+    ctx.enabled = false;
+    pthread_mutex_unlock(&ctx.lock);
+}
+
+bool fcache_load(struct image* img)
+{
+    char name[NAME_MAX_LEN];
+    char path[PATH_MAX];
+    struct stat st, fst;
+    bool success = false;
+    void* data;
+    int fd;
+
+    if (!ctx.enabled || !is_file(img->source, &st)) {
+        return false;
+    }
+
+    file_name(img->source, name);
+    if (!file_path(name, path)) {
+        return false;
+    }
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    if (fstat(fd, &fst) == 0 && fst.st_size > 0) {
+        data = mmap(NULL, fst.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            posix_madvise(data, fst.st_size, POSIX_MADV_SEQUENTIAL);
+            success = load_file(img, &st, data, fst.st_size);
+            munmap(data, fst.st_size);
+        }
+    }
+    if (success) {
+        futimens(fd, NULL); // mark as recently used
+    }
+    close(fd);
+
+    return success;
+}
+
+void fcache_save(const struct image* img, double decode_ms)
+{
+    const struct pixmap* pm;
+    struct save_job* job;
+    struct stat st;
+    bool started;
+
+    if (!ctx.enabled || decode_ms < ctx.threshold || img->num_frames != 1 ||
+        img->anim || img->reduced || img->file_raw || img->levels ||
+        !img->frames[0].pm.data || !is_file(img->source, &st)) {
+        return;
+    }
+
+    // only one image is written at a time, the others are skipped
+    if (atomic_exchange(&ctx.busy, true)) {
+        return;
+    }
+
+    pm = &img->frames[0].pm;
+    job = calloc(1, sizeof(*job));
+    if (!job) {
+        atomic_store(&ctx.busy, false);
+        return;
+    }
+    file_name(img->source, job->name);
+    job->alpha = img->alpha;
+    job->head = create_head(img, &st, &job->head_len);
+    if (!job->head || !pixmap_create(&job->pm, pm->width, pm->height)) {
+        free(job->head);
+        free(job);
+        atomic_store(&ctx.busy, false);
+        return;
+    }
+    memcpy(job->pm.data, pm->data, pm->width * pm->height * sizeof(argb_t));
+
+    pthread_mutex_lock(&ctx.lock);
+    if (ctx.joinable) {
+        pthread_join(ctx.writer, NULL); // already finished
+    }
+    started = pthread_create(&ctx.writer, NULL, save_thread, job) == 0;
+    ctx.joinable = started;
+    pthread_mutex_unlock(&ctx.lock);
+
+    if (!started) {
+        save_thread(job);
+    }
+}
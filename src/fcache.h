@@ -0,0 +1,36 @@
+// SPDX-License-Identifier: MIT
+// Persistent cache of decoded frames for images that are slow to decode.
+// Copyright (C) 2025 Artem Senichev <artemsen@gmail.com>
+
+#pragma once
+
+#include "image.h"
+
+/**
+ * Initialize the cache, the directory is created if it doesn't exist.
+ * @param dir path to the cache directory
+ * @param limit max total size of cached files in bytes
+ * @param threshold min decoding time (ms) of the image to put it to the cache
+ * @return true if cache is ready
+ */
+bool fcache_init(const char* dir, size_t limit, size_t threshold);
+
+/**
+ * Wait for pending writes and disable the cache.
+ */
+void fcache_destroy(void);
+
+/**
+ * Load decoded frame from the cache.
+ * @param img image to load, the source file must not be changed since save
+ * @return true if image loaded
+ */
+bool fcache_load(struct image* img);
+
+/**
+ * Save decoded frame to the cache in background. Only single frame images
+ * decoded in full quality slower than threshold are saved.
+ * @param img decoded image to save
+ * @param decode_ms decoding time of the image in milliseconds
+ */
+void fcache_save(const struct image* img, double decode_ms);
@@ -5,6 +5,13 @@
 #include "font.h"
 
 #include "array.h"
+#include "fs.h"
+#include "memstat.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <sys/stat.h>
 
 // font related
 #include <fontconfig/fontconfig.h>
@@ -17,14 +24,39 @@
 
 #define BACKGROUND_PADDING 5
 
+// number of buckets in the glyph cache hash table
+#define GLYPH_BUCKETS 128
+
+// cache of the resolved font file path (relative to the cache dir)
+#define FONT_CACHE_DIR  "/swayimg"
+#define FONT_CACHE_FILE FONT_CACHE_DIR "/font"
+
+/** Rendered glyph, cached for the current font size and scale. */
+struct glyph {
+    struct glyph* next; ///< Next glyph in the hash bucket
+    wchar_t code;       ///< Character code
+    bool valid;         ///< Glyph is available in the font face
+    size_t advance;     ///< Horizontal advance (px)
+    ssize_t left;       ///< Left bearing of the bitmap (px)
+    ssize_t top;        ///< Top bearing of the bitmap (px)
+    size_t width;       ///< Bitmap width (px)
+    size_t rows;        ///< Bitmap height (px)
+    uint8_t bitmap[];   ///< Bitmap data (width * rows)
+};
+
 /** Font context. */
 struct font {
-    FT_Library lib;    ///< Font lib instance
-    FT_Face face;      ///< Font face instance
-    size_t size;       ///< Font size in points
-    argb_t color;      ///< Font color
-    argb_t shadow;     ///< Font shadow color
-    argb_t background; ///< Font background
+    FT_Library lib;                      ///< Font lib instance
+    FT_Face face;                        ///< Font face instance
+    char* name;                          ///< Font name
+    pthread_t loader;                    ///< Font loader thread
+    bool loading;                        ///< Loader thread is running
+    size_t size;                         ///< Font size in points
+    double scale;                        ///< Font scale
+    argb_t color;                        ///< Font color
+    argb_t shadow;                       ///< Font shadow color
+    argb_t background;                   ///< Font background
+    struct glyph* glyphs[GLYPH_BUCKETS]; ///< Cache of rendered glyphs
 };
 
 /** Global font context instance. */
@@ -73,6 +105,198 @@ static bool search_font_file(const char* name, char* font_file, size_t len)
     return *font_file;
 }
 
+/**
+ * Get path to the font cache file.
+ * @param path output buffer
+ * @param len size of buffer
+ * @return false if path is unknown
+ */
+static bool cache_path(char* path, size_t len)
+{
+    return fs_envpath("XDG_CACHE_HOME", FONT_CACHE_FILE, path, len) ||
+        fs_envpath("HOME", "/.cache" FONT_CACHE_FILE, path, len);
+}
+
+/**
+ * Get path to the font file from the cache, fontconfig initialization takes
+ * significant time on systems with many fonts.
+ * @param name font name
+ * @param font_file output buffer for file path
+ * @param len size of buffer
+ * @return false if font is not cached
+ */
+static bool load_cached(const char* name, char* font_file, size_t len)
+{
+    char path[PATH_MAX];
+    char cached[PATH_MAX];
+    struct stat st;
+    size_t name_len;
+    FILE* fd;
+    bool rc = false;
+
+    if (!cache_path(path, sizeof(path))) {
+        return false;
+    }
+    fd = fopen(path, "r");
+    if (!fd) {
+        return false;
+    }
+
+    // file format: the first line is font name, the second one is its path
+    name_len = strlen(name);
+    if (fgets(cached, sizeof(cached), fd) &&
+        strncmp(cached, name, name_len) == 0 && cached[name_len] == '\n' &&
+        fgets(font_file, len, fd)) {
+        const size_t path_len = strcspn(font_file, "\n");
+        font_file[path_len] = 0;
+        // the font could be removed since the last run
+        rc = path_len && stat(font_file, &st) == 0 && S_ISREG(st.st_mode);
+    }
+
+    fclose(fd);
+
+    return rc;
+}
+
+/**
+ * Save path to the font file in the cache.
+ * @param name font name
+ * @param font_file path to the font file
+ */
+static void save_cached(const char* name, const char* font_file)
+{
+    char path[PATH_MAX];
+    char* delim;
+    FILE* fd;
+
+    if (!cache_path(path, sizeof(path))) {
+        return;
+    }
+
+    // create cache directory
+    delim = strrchr(path, '/');
+    *delim = 0;
+    if (mkdir(path, S_IRWXU) && errno != EEXIST) {
+        return;
+    }
+    *delim = '/';
+
+    fd = fopen(path, "w");
+    if (fd) {
+        fprintf(fd, "%s\n%s\n", name, font_file);
+        fclose(fd);
+    }
+}
+
+/**
+ * Font loader thread: search and open font face.
+ * @param data not used
+ * @return NULL
+ */
+static void* load_font(__attribute__((unused)) void* data)
+{
+    char font_file[PATH_MAX] = { 0 };
+
+    if (!load_cached(ctx.name, font_file, sizeof(font_file)) &&
+        search_font_file(ctx.name, font_file, sizeof(font_file))) {
+        save_cached(ctx.name, font_file);
+    }
+
+    if (!*font_file || FT_Init_FreeType(&ctx.lib) != 0 ||
+        FT_New_Face(ctx.lib, font_file, 0, &ctx.face) != 0) {
+        fprintf(stderr, "WARNING: Unable to load font %s\n", ctx.name);
+        ctx.face = NULL;
+    }
+
+    return NULL;
+}
+
+/**
+ * Wait until the font is loaded.
+ * @return false if font is not available
+ */
+static bool wait_font(void)
+{
+    if (ctx.loading) {
+        pthread_join(ctx.loader, NULL);
+        ctx.loading = false;
+        if (ctx.face) {
+            // apply the scale that could be changed while loading
+            FT_Set_Char_Size(ctx.face, ctx.size * POINT_FACTOR, 0,
+                             96 * ctx.scale, 0);
+        }
+    }
+    return ctx.face;
+}
+
+/**
+ * Free all cached glyphs.
+ */
+static void free_glyphs(void)
+{
+    for (size_t i = 0; i < GLYPH_BUCKETS; ++i) {
+        struct glyph* glyph = ctx.glyphs[i];
+        while (glyph) {
+            struct glyph* next = glyph->next;
+            memstat_free(memstat_text,
+                         sizeof(*glyph) + glyph->width * glyph->rows);
+            free(glyph);
+            glyph = next;
+        }
+        ctx.glyphs[i] = NULL;
+    }
+}
+
+/**
+ * Get rendered glyph from the cache, render it if not cached yet.
+ * @param code character code
+ * @return pointer to the glyph or NULL on errors
+ */
+static const struct glyph* get_glyph(wchar_t code)
+{
+    struct glyph** bucket = &ctx.glyphs[(size_t)code % GLYPH_BUCKETS];
+    struct glyph* glyph;
+    const FT_Bitmap* bmp = NULL;
+    size_t width = 0, rows = 0;
+
+    for (glyph = *bucket; glyph; glyph = glyph->next) {
+        if (glyph->code == code) {
+            return glyph;
+        }
+    }
+
+    if (FT_Load_Char(ctx.face, code, FT_LOAD_RENDER) == 0) {
+        bmp = &ctx.face->glyph->bitmap;
+        width = bmp->width;
+        rows = bmp->rows;
+    }
+
+    glyph = calloc(1, sizeof(*glyph) + width * rows);
+    if (!glyph) {
+        return NULL;
+    }
+    memstat_alloc(memstat_text, sizeof(*glyph) + width * rows);
+    glyph->code = code;
+    if (bmp) {
+        const FT_GlyphSlot slot = ctx.face->glyph;
+        glyph->valid = true;
+        glyph->advance = slot->advance.x / POINT_FACTOR;
+        glyph->left = slot->bitmap_left;
+        glyph->top = slot->bitmap_top;
+        glyph->width = width;
+        glyph->rows = rows;
+        for (size_t y = 0; y < rows; ++y) {
+            memcpy(&glyph->bitmap[y * width], &bmp->buffer[y * bmp->pitch],
+                   width);
+        }
+    }
+
+    glyph->next = *bucket;
+    *bucket = glyph;
+
+    return glyph;
+}
+
 /**
  * Calc size of the surface and allocate memory for the mask.
  * @param text string to print
@@ -95,11 +319,13 @@ static size_t allocate_surface(const wchar_t* text,
     while (*text) {
         if (*text == L' ') {
             width += space_size;
-        } else if (FT_Load_Char(ctx.face, *text, FT_LOAD_RENDER) == 0) {
-            const FT_GlyphSlot glyph = ctx.face->glyph;
-            width += glyph->advance.x / POINT_FACTOR;
-            if ((FT_Int)base_offset < glyph->bitmap_top) {
-                base_offset = glyph->bitmap_top;
+        } else {
+            const struct glyph* glyph = get_glyph(*text);
+            if (glyph && glyph->valid) {
+                width += glyph->advance;
+                if ((ssize_t)base_offset < glyph->top) {
+                    base_offset = glyph->top;
+                }
             }
         }
         ++text;
@@ -112,6 +338,8 @@ static size_t allocate_surface(const wchar_t* text,
         if (!data) {
             return SIZE_MAX;
         }
+        memstat_free(memstat_text, surface->width * surface->height);
+        memstat_alloc(memstat_text, data_size);
         surface->width = width;
         surface->height = height;
         surface->data = data;
@@ -123,35 +351,45 @@ static size_t allocate_surface(const wchar_t* text,
 
 void font_init(const struct config* cfg)
 {
-    char font_file[PATH_MAX] = { 0 };
-    const char* font_name;
-
-    // load font
-    font_name = config_get(cfg, CFG_FONT, CFG_FONT_NAME);
-    if (!search_font_file(font_name, font_file, sizeof(font_file)) ||
-        FT_Init_FreeType(&ctx.lib) != 0 ||
-        FT_New_Face(ctx.lib, font_file, 0, &ctx.face) != 0) {
-        fprintf(stderr, "WARNING: Unable to load font %s\n", font_name);
-        return;
-    }
-
     // set font size
     ctx.size = config_get_num(cfg, CFG_FONT, CFG_FONT_SIZE, 1, 256);
-    font_set_scale(1.0);
+    ctx.scale = 1.0;
 
     // color/background/shadow parameters
     ctx.color = config_get_color(cfg, CFG_FONT, CFG_FONT_COLOR);
     ctx.background = config_get_color(cfg, CFG_FONT, CFG_FONT_BKG);
     ctx.shadow = config_get_color(cfg, CFG_FONT, CFG_FONT_SHADOW);
+
+    // load font in background, it is not needed until the text is printed
+    ctx.name = str_dup(config_get(cfg, CFG_FONT, CFG_FONT_NAME), NULL);
+    if (ctx.name) {
+        ctx.loading =
+            pthread_create(&ctx.loader, NULL, load_font, NULL) == 0;
+        if (!ctx.loading) {
+            load_font(NULL);
+            if (ctx.face) {
+                FT_Set_Char_Size(ctx.face, ctx.size * POINT_FACTOR, 0,
+                                 96 * ctx.scale, 0);
+            }
+        }
+    }
 }
 
 void font_set_scale(double scale)
 {
-    FT_Set_Char_Size(ctx.face, ctx.size * POINT_FACTOR, 0, 96 * scale, 0);
+    ctx.scale = scale;
+    if (!ctx.loading && ctx.face) {
+        free_glyphs(); // rendered for the previous size
+        FT_Set_Char_Size(ctx.face, ctx.size * POINT_FACTOR, 0, 96 * scale, 0);
+    }
 }
 
 void font_destroy(void)
 {
+    wait_font();
+    free(ctx.name);
+    ctx.name = NULL;
+    free_glyphs();
     if (ctx.face) {
         FT_Done_Face(ctx.face);
     }
@@ -168,12 +406,11 @@ bool font_render(const char* text, struct text_surface* surface)
     wchar_t* it;
     size_t x = 0;
 
-    if (!ctx.face) {
+    if (!wait_font()) {
         return false;
     }
     if (!text || !*text) {
-        surface->width = 0;
-        surface->height = 0;
+        font_free(surface);
         return true;
     }
 
@@ -193,29 +430,28 @@ bool font_render(const char* text, struct text_surface* surface)
     // draw glyphs
     it = wide;
     while (*it) {
+        const struct glyph* glyph;
         if (*it == L' ') {
             x += space_size;
-        } else if (FT_Load_Char(ctx.face, *it, FT_LOAD_RENDER) == 0) {
-            const FT_GlyphSlot glyph = ctx.face->glyph;
-            const FT_Bitmap* bmp = &glyph->bitmap;
-            const size_t off_y = base_offset - glyph->bitmap_top;
+        } else if ((glyph = get_glyph(*it)) && glyph->valid) {
+            const size_t off_y = base_offset - glyph->top;
             size_t size;
 
             // calc line width, floating point math doesn't match bmp width
-            if (x + bmp->width < surface->width) {
-                size = bmp->width;
+            if (x + glyph->width < surface->width) {
+                size = glyph->width;
             } else {
                 size = surface->width - x;
             }
 
             // put glyph's bitmap on the surface
-            for (size_t y = 0; y < bmp->rows; ++y) {
+            for (size_t y = 0; y < glyph->rows; ++y) {
                 const size_t offset = (y + off_y) * surface->width + x;
-                uint8_t* dst = &surface->data[offset + glyph->bitmap_left];
-                memcpy(dst, &bmp->buffer[y * bmp->pitch], size);
+                uint8_t* dst = &surface->data[offset + glyph->left];
+                memcpy(dst, &glyph->bitmap[y * glyph->width], size);
             }
 
-            x += glyph->advance.x / POINT_FACTOR;
+            x += glyph->advance;
         }
         ++it;
     }
@@ -225,6 +461,42 @@ bool font_render(const char* text, struct text_surface* surface)
     return true;
 }
 
+void font_free(struct text_surface* surface)
+{
+    if (surface->data) {
+        memstat_free(memstat_text, surface->width * surface->height);
+        free(surface->data);
+        surface->data = NULL;
+    }
+    surface->width = 0;
+    surface->height = 0;
+}
+
+/**
+ * Get offset of the text shadow.
+ * @param text text surface
+ * @return shadow offset (px)
+ */
+static ssize_t shadow_offset(const struct text_surface* text)
+{
+    const ssize_t offset = text->height / 16;
+    return offset < 1 ? 1 : offset;
+}
+
+size_t font_margin(const struct text_surface* text)
+{
+    size_t margin = 0;
+
+    if (ARGB_GET_A(ctx.background)) {
+        margin = BACKGROUND_PADDING;
+    }
+    if (ARGB_GET_A(ctx.shadow)) {
+        margin = max(margin, (size_t)shadow_offset(text));
+    }
+
+    return margin;
+}
+
 void font_print(struct pixmap* wnd, ssize_t x, ssize_t y,
                 const struct text_surface* text)
 {
@@ -235,12 +507,9 @@ void font_print(struct pixmap* wnd, ssize_t x, ssize_t y,
     }
 
     if (ARGB_GET_A(ctx.shadow)) {
-        ssize_t shadow_offset = text->height / 16;
-        if (shadow_offset < 1) {
-            shadow_offset = 1;
-        }
-        pixmap_apply_mask(wnd, x + shadow_offset, y + shadow_offset, text->data,
-                          text->width, text->height, ctx.shadow);
+        const ssize_t offset = shadow_offset(text);
+        pixmap_apply_mask(wnd, x + offset, y + offset, text->data, text->width,
+                          text->height, ctx.shadow);
     }
 
     pixmap_apply_mask(wnd, x, y, text->data, text->width, text->height,
@@ -38,6 +38,19 @@ void font_destroy(void);
  */
 bool font_render(const char* text, struct text_surface* surface);
 
+/**
+ * Free text surface.
+ * @param surface text surface to free
+ */
+void font_free(struct text_surface* surface);
+
+/**
+ * Get size of the decoration (background, shadow) around the printed text.
+ * @param text text surface
+ * @return margin on each side of the text (px)
+ */
+size_t font_margin(const struct text_surface* text);
+
 /**
  * Print surface line on the window.
  * @param wnd destination window
@@ -11,57 +11,54 @@
 static const uint32_t signature = 'f' | 't' << 8 | 'y' << 16 | 'p' << 24;
 #define SIGNATURE_OFFSET 4
 
-static int decode_frame(struct image* img, avifDecoder* decoder)
+/**
+ * Convert decoded YUV image to the frame pixmap, the RGB image uses the
+ * pixmap buffer, so there is no intermediate copy.
+ * @param image decoded YUV image
+ * @param pm destination pixmap with the same size as the image
+ * @return result code
+ */
+static avifResult convert_rgb(const avifImage* image, struct pixmap* pm)
 {
     avifRGBImage rgb;
-    avifResult rc;
-    struct pixmap* pm;
-
-    rc = avifDecoderNextImage(decoder);
-    if (rc != AVIF_RESULT_OK) {
-        goto decode_fail;
-    }
 
     memset(&rgb, 0, sizeof(rgb));
-    avifRGBImageSetDefaults(&rgb, decoder->image);
+    avifRGBImageSetDefaults(&rgb, image);
 
     rgb.depth = 8;
     rgb.format = AVIF_RGB_FORMAT_BGRA;
-#if AVIF_VERSION_MAJOR > 0
-    rc =
-#endif
-        avifRGBImageAllocatePixels(&rgb);
-#if AVIF_VERSION_MAJOR > 0
-    if (rc != AVIF_RESULT_OK) {
-        goto decode_fail;
-    }
-#endif
+    rgb.pixels = (uint8_t*)pm->data;
+    rgb.rowBytes = pm->width * sizeof(argb_t);
+
+    return avifImageYUVToRGB(image, &rgb);
+}
 
-    rc = avifImageYUVToRGB(decoder->image, &rgb);
+static int decode_frame(struct image* img, avifDecoder* decoder)
+{
+    avifResult rc;
+    struct pixmap* pm;
+
+    rc = avifDecoderNextImage(decoder);
     if (rc != AVIF_RESULT_OK) {
-        goto fail_pixels;
+        return -1;
     }
 
     pm = image_alloc_frame(img, decoder->image->width, decoder->image->height);
     if (!pm) {
-        goto fail_pixels;
+        return -1;
     }
 
-    memcpy(pm->data, rgb.pixels, rgb.width * rgb.height * sizeof(argb_t));
+    rc = convert_rgb(decoder->image, pm);
+    if (rc != AVIF_RESULT_OK) {
+        return -1;
+    }
 
-    avifRGBImageFreePixels(&rgb);
     return 0;
-
-fail_pixels:
-    avifRGBImageFreePixels(&rgb);
-decode_fail:
-    return -1;
 }
 
 static int decode_frames(struct image* img, avifDecoder* decoder)
 {
     avifImageTiming timing;
-    avifRGBImage rgb = { 0 };
     avifResult rc = AVIF_RESULT_UNKNOWN_ERROR;
 
     if (!image_alloc_frames(img, decoder->imageCount)) {
@@ -74,28 +71,17 @@ static int decode_frames(struct image* img, avifDecoder* decoder)
             break;
         }
 
-        avifRGBImageSetDefaults(&rgb, decoder->image);
-        rgb.depth = 8;
-        rgb.format = AVIF_RGB_FORMAT_BGRA;
-
-#if AVIF_VERSION_MAJOR == 0
-        avifRGBImageAllocatePixels(&rgb);
-#else
-        rc = avifRGBImageAllocatePixels(&rgb);
-        if (rc != AVIF_RESULT_OK) {
+        if (!pixmap_create(&img->frames[i].pm, decoder->image->width,
+                           decoder->image->height)) {
+            rc = AVIF_RESULT_UNKNOWN_ERROR;
             break;
         }
-#endif
 
-        rc = avifImageYUVToRGB(decoder->image, &rgb);
+        rc = convert_rgb(decoder->image, &img->frames[i].pm);
         if (rc != AVIF_RESULT_OK) {
             break;
         }
 
-        if (!pixmap_create(&img->frames[i].pm, rgb.width, rgb.height)) {
-            break;
-        }
-
         rc = avifDecoderNthImageTiming(decoder, i, &timing);
         if (rc != AVIF_RESULT_OK) {
             break;
@@ -103,16 +89,6 @@ static int decode_frames(struct image* img, avifDecoder* decoder)
 
         img->frames[i].duration = (size_t)(1000.0f / (float)timing.timescale *
                                            (float)timing.durationInTimescales);
-
-        memcpy(img->frames[i].pm.data, rgb.pixels,
-               rgb.width * rgb.height * sizeof(argb_t));
-
-        avifRGBImageFreePixels(&rgb);
-        rgb.pixels = NULL;
-    }
-
-    if (rgb.pixels) {
-        avifRGBImageFreePixels(&rgb);
     }
 
     return rc;
@@ -120,7 +96,7 @@ static int decode_frames(struct image* img, avifDecoder* decoder)
 
 // AV1 loader implementation
 enum image_status decode_avif(struct image* img, const uint8_t* data,
-                              size_t size)
+                              size_t size, __attribute__((unused)) size_t hint)
 {
     avifResult rc;
     avifDecoder* decoder = NULL;
@@ -137,6 +113,7 @@ enum image_status decode_avif(struct image* img, const uint8_t* data,
     if (!decoder) {
         return imgload_fmterror;
     }
+    decoder->maxThreads = image_load_threads();
     rc = avifDecoderSetIOMemory(decoder, data, size);
     if (rc != AVIF_RESULT_OK) {
         goto fail;
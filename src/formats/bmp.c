@@ -357,7 +357,7 @@ static bool decode_rgb(struct image* img, const struct bmp_info* bmp,
 
 // BMP loader implementation
 enum image_status decode_bmp(struct image* img, const uint8_t* data,
-                             size_t size)
+                             size_t size, __attribute__((unused)) size_t hint)
 {
     const struct bmp_file* hdr;
     const struct bmp_info* bmp;
@@ -366,6 +366,7 @@ enum image_status decode_bmp(struct image* img, const uint8_t* data,
     struct bmp_palette palette;
     const uint32_t* mask_location;
     struct bmp_mask mask;
+    bool mapped;
     bool rc;
 
     hdr = (const struct bmp_file*)data;
@@ -383,10 +384,6 @@ enum image_status decode_bmp(struct image* img, const uint8_t* data,
         return imgload_fmterror;
     }
 
-    if (!image_alloc_frame(img, abs(bmp->width), abs(bmp->height))) {
-        return imgload_fmterror;
-    }
-
     color_data = (const uint8_t*)bmp + bmp->dib_size;
     color_data_sz = hdr->offset - sizeof(struct bmp_file) - bmp->dib_size;
     palette.table = color_data;
@@ -410,8 +407,23 @@ enum image_status decode_bmp(struct image* img, const uint8_t* data,
             bmp->dib_size > BITMAPINFOV2HEADER_SIZE ? mask_location[3] : 0;
     }
 
+    // 32-bit top-down bitmap with ARGB masks has the same layout as frame,
+    // so its pixels are used as is
+    mapped = bmp->compression == BI_BITFIELDS && bmp->bpp == 32 &&
+        bmp->width > 0 && bmp->height < 0 && mask.red == 0x00ff0000 &&
+        mask.green == 0x0000ff00 && mask.blue == 0x000000ff &&
+        mask.alpha == 0xff000000 &&
+        image_map_frame(img, data + hdr->offset, bmp->width, -bmp->height);
+    if (!mapped &&
+        !image_alloc_frame(img, abs(bmp->width), abs(bmp->height))) {
+        return imgload_fmterror;
+    }
+
     // decode bitmap
-    if (bmp->compression == BI_BITFIELDS || bmp->bpp == 16) {
+    if (mapped) {
+        rc = true;
+        image_set_format(img, "BMP %dbit masked", bmp->bpp);
+    } else if (bmp->compression == BI_BITFIELDS || bmp->bpp == 16) {
         rc = decode_masked(img, bmp, &mask, data + hdr->offset,
                            size - hdr->offset);
         image_set_format(img, "BMP %dbit masked", bmp->bpp);
@@ -5,6 +5,7 @@
 #include "loader.h"
 
 #include <limits.h>
+#include <stdlib.h>
 #include <string.h>
 
 // DICOM signature
@@ -18,6 +19,10 @@ static const uint8_t signature[] = { 'D', 'I', 'C', 'M' };
 #define TAG_BIT_ALLOCATED     0x00280100
 #define TAG_SMALL_PIXEL_VAL   0x00280106
 #define TAG_BIG_PIXEL_VAL     0x00280107
+#define TAG_WINDOW_CENTER     0x00281050
+#define TAG_WINDOW_WIDTH      0x00281051
+#define TAG_RESCALE_INTERCEPT 0x00281052
+#define TAG_RESCALE_SLOPE     0x00281053
 #define TAG_PIXEL_DATA        0x7fe00010
 
 // DICOM element value types
@@ -60,6 +65,10 @@ struct dicom_image {
     uint16_t height;     ///< Image height
     int16_t px_min;      ///< Min pixel value encountered in the image
     int16_t px_max;      ///< Max pixel value encountered in the image
+    double wnd_center;   ///< Window center in output units
+    double wnd_width;    ///< Window width in output units, 0 if not set
+    double intercept;    ///< Rescale intercept: output units from pixels
+    double slope;        ///< Rescale slope: output units from pixels
     const uint8_t* data; ///< Image data
     size_t data_sz;      ///< Size of data in bytes
 };
@@ -145,6 +154,21 @@ static bool next_element(struct stream* stream, struct element* element)
     return true;
 }
 
+/**
+ * Get the first value of the Decimal String element.
+ * @param element DS element
+ * @return numeric value
+ */
+static double get_decimal(const struct element* element)
+{
+    char text[32];
+    const size_t len = element->size < sizeof(text) - 1 ? element->size
+                                                        : sizeof(text) - 1;
+    memcpy(text, element->data, len);
+    text[len] = 0;
+    return strtod(text, NULL); // stops at the value delimiter ('\\')
+}
+
 /**
  * Get image description from the stream.
  * @param stream binary stream
@@ -156,6 +180,7 @@ static bool get_image(struct stream* stream, struct dicom_image* image)
     struct element el;
 
     memset(image, 0, sizeof(*image));
+    image->slope = 1.0;
 
     // collect info
     while (next_element(stream, &el)) {
@@ -174,6 +199,14 @@ static bool get_image(struct stream* stream, struct dicom_image* image)
             image->px_min = *(const int16_t*)el.data;
         } else if (el.tag == TAG_BIG_PIXEL_VAL && el.vr == VR_SS) {
             image->px_max = *(const int16_t*)el.data;
+        } else if (el.tag == TAG_WINDOW_CENTER && el.vr == VR_DS) {
+            image->wnd_center = get_decimal(&el);
+        } else if (el.tag == TAG_WINDOW_WIDTH && el.vr == VR_DS) {
+            image->wnd_width = get_decimal(&el);
+        } else if (el.tag == TAG_RESCALE_INTERCEPT && el.vr == VR_DS) {
+            image->intercept = get_decimal(&el);
+        } else if (el.tag == TAG_RESCALE_SLOPE && el.vr == VR_DS) {
+            image->slope = get_decimal(&el);
         } else if (el.tag == TAG_PIXEL_DATA && el.vr == VR_OW) {
             image->data = el.data;
             image->data_sz = el.size;
@@ -191,13 +224,12 @@ static bool get_image(struct stream* stream, struct dicom_image* image)
 
 // DICOM loader implementation
 enum image_status decode_dicom(struct image* img, const uint8_t* data,
-                               size_t size)
+                               size_t size, size_t hint)
 {
     struct dicom_image dicom;
     struct stream stream;
-    struct pixmap* pm;
+    struct image_levels* levels;
     size_t total_pixels;
-    double pixel_coeff;
 
     // check signature
     if (size < DICOM_SIGNATURE_OFFSET + sizeof(signature) ||
@@ -228,26 +260,48 @@ enum image_status decode_dicom(struct image* img, const uint8_t* data,
         }
     }
 
-    // Calculate coefficient for converting 16-bit color to 8-bit
-    if (dicom.px_max <= dicom.px_min) {
-        pixel_coeff = 1.0;
-    } else {
-        pixel_coeff = 256.0 / (dicom.px_max - dicom.px_min);
+    // allocate image buffer and the high bit depth samples
+    if (!image_alloc_frame(img, dicom.width, dicom.height)) {
+        return imgload_fmterror;
     }
-
-    // allocate image buffer
-    pm = image_alloc_frame(img, dicom.width, dicom.height);
-    if (!pm) {
+    levels = calloc(1, sizeof(*levels));
+    if (!levels) {
+        image_free(img, IMGFREE_FRAMES);
+        return imgload_fmterror;
+    }
+    img->levels = levels;
+    if (!pixmap_create(&levels->samples, dicom.width, dicom.height)) {
+        image_free(img, IMGFREE_FRAMES);
         return imgload_fmterror;
     }
 
-    // decode image
+    // keep signed samples as unsigned ones
     total_pixels = dicom.width * dicom.height;
     for (size_t i = 0; i < total_pixels; ++i) {
-        int16_t color = *((const int16_t*)dicom.data + i);
-        color -= dicom.px_min;
-        color *= pixel_coeff;
-        pm->data[i] = ARGB(0xff, color, color, color);
+        const int16_t color = *((const int16_t*)dicom.data + i);
+        levels->samples.data[i] = (uint16_t)(color - INT16_MIN);
+    }
+    levels->offset = INT16_MIN;
+    levels->min = dicom.px_min - INT16_MIN;
+    levels->max = dicom.px_max - INT16_MIN;
+
+    // render the frame with the window from the file if it is specified
+    if (dicom.wnd_width > 0 && dicom.slope != 0) {
+        const ssize_t center =
+            (dicom.wnd_center - dicom.intercept) / dicom.slope;
+        ssize_t width = dicom.wnd_width / dicom.slope;
+        if (width < 0) {
+            width = -width;
+        }
+        image_set_window(img, center, width ? width : 1);
+    } else {
+        image_set_window(img, 0, 0);
+    }
+    if (hint) {
+        // window can't be changed in reduced images (thumbnails)
+        pixmap_free(&levels->samples);
+        free(levels);
+        img->levels = NULL;
     }
 
     image_set_format(img, "DICOM");
@@ -2,8 +2,10 @@
 // EXR format decoder.
 // Copyright (C) 2023 Artem Senichev <artemsen@gmail.com>
 
+#include "../tpool.h"
 #include "loader.h"
 
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -16,6 +18,34 @@
 // EXR signature
 static const uint8_t signature[] = { 0x76, 0x2f, 0x31, 0x01 };
 
+// Size of linear to sRGB lookup table
+#define SRGB_LUT_SIZE 4096
+
+/** Worker state: each thread uses its own decoder. */
+struct exr_worker {
+    exr_decode_pipeline_t decoder; ///< EXR decoder instance
+    uint8_t* buffer;               ///< Unpacked data of the current chunk
+    exr_result_t rc;               ///< Result code
+};
+
+/** Parallel decoding job: chunks of a single band. */
+struct exr_job {
+    exr_context_t ectx;          ///< EXR context
+    struct image* img;           ///< Target image
+    const struct pixmap* pm;     ///< Current band
+    size_t band_y;               ///< First row of the band
+    size_t chunks;               ///< Number of chunks in the band
+    size_t tasks;                ///< Number of tasks (workers in use)
+    struct exr_worker* workers;  ///< Workers array
+    size_t num_workers;          ///< Number of workers
+    int32_t base_y;              ///< Data window origin (scanlined images)
+    int32_t scanlines;           ///< Scanlines per chunk (scanlined images)
+    int32_t level;               ///< Resolution level (tiled images)
+    int32_t tile_w, tile_h;      ///< Tile size (tiled images)
+    size_t tiles_x;              ///< Tiles per row (tiled images)
+    uint8_t srgb[SRGB_LUT_SIZE]; ///< Linear intensity to sRGB
+};
+
 // EXR data buffer
 struct data_buffer {
     const uint8_t* data;
@@ -83,251 +113,384 @@ static exr_result_t decode_chunk(const exr_context_t ectx,
 }
 
 /**
- * Decode pixel.
- * @param decoder EXR decoder instance
- * @param unpacked pointer to unpacked data
- * @param size max number of bytes in unpacked buffer
- * @return ARGB value of the pixel
+ * Get channel intensity.
+ * @param channel channel description
+ * @param ptr pointer to the channel data
+ * @return linear intensity
  */
-static argb_t decode_pixel(const exr_decode_pipeline_t* decoder,
-                           const uint8_t* unpacked, size_t size)
+static inline float get_intensity(const exr_coding_channel_info_t* channel,
+                                  const uint8_t* ptr)
 {
-    uint8_t a = 0xff, r = 0, g = 0, b = 0;
-
-    for (int16_t i = 0; i < decoder->channel_count; ++i) {
-        const exr_coding_channel_info_t* channel = &decoder->channels[i];
-        float intensity = 0;
-        size_t color;
-
-        // it's all a dirty hack =)
-        switch (channel->data_type) {
-            case EXR_PIXEL_UINT:
-                break; // not supported
-            case EXR_PIXEL_HALF:
-                if (size >= sizeof(uint16_t)) {
-                    // convert half to float
-                    // todo
-                    // NOLINTNEXTLINE(clang-analyzer-core.uninitialized.Assign)
-                    const uint16_t half = *(const uint16_t*)unpacked;
-                    union {
-                        uint32_t i;
-                        float f;
-                    } hf;
-                    hf.i = (half & 0x8000) << 16;
-                    hf.i |= ((half & 0x7c00) + 0x1c000) << 13;
-                    hf.i |= (half & 0x03ff) << 13;
-                    intensity = hf.f;
-                }
-                break;
-            case EXR_PIXEL_FLOAT:
-                if (size >= sizeof(float)) {
-                    // todo
-                    // NOLINTNEXTLINE(clang-analyzer-core.uninitialized.Assign)
-                    intensity = *(const float*)unpacked;
-                }
-                break;
-            default:
-                break; // not supported
-        }
-        color = intensity * 0xff;
-        if (color > 0xff) {
-            color = 0xff;
+    union {
+        uint32_t i;
+        float f;
+    } hf;
+
+    switch (channel->data_type) {
+        case EXR_PIXEL_HALF: {
+            // convert half to float
+            const uint16_t half = *(const uint16_t*)ptr;
+            hf.i = (half & 0x8000) << 16;
+            hf.i |= ((half & 0x7c00) + 0x1c000) << 13;
+            hf.i |= (half & 0x03ff) << 13;
+            return hf.f;
         }
+        case EXR_PIXEL_FLOAT:
+            memcpy(&hf.f, ptr, sizeof(hf.f));
+            return hf.f;
+        default:
+            return 0; // not supported
+    }
+}
+
+/**
+ * Convert decoded chunk to ARGB.
+ * @param job decoding job
+ * @param decoder EXR decoder with unpacked chunk
+ * @param src pointer to unpacked data
+ * @param src_stride size of unpacked line in bytes
+ * @param dst pointer to the first destination pixel
+ * @param rows,cols number of pixels to convert
+ */
+static void put_pixels(const struct exr_job* job,
+                       const exr_decode_pipeline_t* decoder,
+                       const uint8_t* src, size_t src_stride, argb_t* dst,
+                       size_t rows, size_t cols)
+{
+    const exr_coding_channel_info_t* channels = decoder->channels;
+    const int16_t num = decoder->channel_count;
+    argb_t base = ARGB_SET_A(0xff);
+    size_t bpp = 0;
+
+    if (num <= 0) {
+        return;
+    }
+
+    int8_t shift[num];
 
-        switch (*channel->channel_name) {
+    // get position of each channel in ARGB
+    for (int16_t i = 0; i < num; ++i) {
+        switch (*channels[i].channel_name) {
             case 'A':
-                a = color;
+                shift[i] = ARGB_A_SHIFT;
+                base = 0;
                 break;
             case 'R':
-                r = color;
+                shift[i] = ARGB_R_SHIFT;
                 break;
             case 'G':
-                g = color;
+                shift[i] = ARGB_G_SHIFT;
                 break;
             case 'B':
-                b = color;
+                shift[i] = ARGB_B_SHIFT;
                 break;
             default:
-                break; // not supported
+                shift[i] = -1; // not supported
+                break;
         }
+        bpp += channels[i].bytes_per_element;
+    }
 
-        unpacked += channel->bytes_per_element;
-        if (size <= (size_t)channel->bytes_per_element) {
-            break;
+    for (size_t y = 0; y < rows; ++y) {
+        const uint8_t* pixel = src + y * src_stride;
+        argb_t* dst_line = dst + y * job->pm->width;
+        for (size_t x = 0; x < cols; ++x) {
+            const uint8_t* ptr = pixel;
+            argb_t argb = base;
+            for (int16_t i = 0; i < num; ++i) {
+                if (shift[i] >= 0) {
+                    float val = get_intensity(&channels[i], ptr);
+                    uint8_t color;
+                    if (!(val > 0.0f)) {
+                        val = 0.0f; // including NaN
+                    } else if (val > 1.0f) {
+                        val = 1.0f;
+                    }
+                    if (shift[i] == ARGB_A_SHIFT) {
+                        color = val * 0xff + 0.5f;
+                    } else {
+                        color = job->srgb[(size_t)(val * (SRGB_LUT_SIZE - 1) +
+                                                   0.5f)];
+                    }
+                    argb |= (argb_t)color << shift[i];
+                }
+                ptr += channels[i].bytes_per_element;
+            }
+            dst_line[x] = argb;
+            pixel += bpp;
         }
-        size -= channel->bytes_per_element;
     }
-
-    return ARGB_SET_A(a) | ARGB_SET_R(r) | ARGB_SET_G(g) | ARGB_SET_B(b);
 }
 
 /**
- * Load scanlined EXR image.
- * @param ectx EXR context
- * @param pm destination pixmap
+ * Decode and put to the band single chunk of the job.
+ * @param job decoding job
+ * @param wrk worker state
+ * @param index chunk index in the band
  * @return result code
  */
-static exr_result_t load_scanlined(const exr_context_t ectx, struct pixmap* pm)
+static exr_result_t decode_band_chunk(struct exr_job* job,
+                                      struct exr_worker* wrk, size_t index)
 {
+    const struct pixmap* pm = job->pm;
+    exr_chunk_info_t chunk;
+    size_t x, y, rows, cols;
     exr_result_t rc;
-    int32_t scanlines;
-    uint64_t chunk_size;
-    uint8_t* buffer = NULL;
-    exr_decode_pipeline_t decoder = EXR_DECODE_PIPELINE_INITIALIZER;
-    argb_t* dst = pm->data;
-    exr_attr_box2i_t dwnd;
 
-    // temporary buffer for decoded chunk's scanlines
-    rc = exr_get_chunk_unpacked_size(ectx, 0, &chunk_size);
+    if (job->tile_w) {
+        x = (index % job->tiles_x) * job->tile_w;
+        y = job->band_y + (index / job->tiles_x) * job->tile_h;
+        rc = exr_read_tile_chunk_info(job->ectx, 0, x / job->tile_w,
+                                      y / job->tile_h, job->level, job->level,
+                                      &chunk);
+    } else {
+        x = 0;
+        y = job->band_y + index * job->scanlines;
+        rc = exr_read_scanline_chunk_info(job->ectx, 0, job->base_y + y,
+                                          &chunk);
+    }
     if (rc != EXR_ERR_SUCCESS) {
         return rc;
     }
-    buffer = malloc(chunk_size);
-    if (!buffer) {
-        return EXR_ERR_OUT_OF_MEMORY;
-    }
 
-    // get image properties
-    rc = exr_get_data_window(ectx, 0, &dwnd);
+    rc = decode_chunk(job->ectx, &chunk, &wrk->decoder, wrk->buffer);
     if (rc != EXR_ERR_SUCCESS) {
-        goto done;
-    }
-    rc = exr_get_scanlines_per_chunk(ectx, 0, &scanlines);
-    if (rc != EXR_ERR_SUCCESS) {
-        goto done;
+        return rc;
     }
 
-    // decode chunks
-    for (int32_t y = dwnd.min.y; y <= dwnd.max.y; y += scanlines) {
-        exr_chunk_info_t chunk;
-        int8_t bpp = 0;
+    // put pixels to the band
+    rows = min((size_t)chunk.height, job->band_y + pm->height - y);
+    cols = min((size_t)chunk.width, pm->width - x);
+    put_pixels(job, &wrk->decoder, wrk->buffer,
+               wrk->decoder.channels[0].user_line_stride,
+               &pm->data[(y - job->band_y) * pm->width + x], rows, cols);
 
-        rc = exr_read_scanline_chunk_info(ectx, 0, y, &chunk);
-        if (rc != EXR_ERR_SUCCESS) {
-            break;
+    return EXR_ERR_SUCCESS;
+}
+
+// Thread pool task handler: decode every n-th chunk of the band
+static void decode_task(size_t index, void* data)
+{
+    struct exr_job* job = data;
+    struct exr_worker* wrk = &job->workers[index];
+
+    for (size_t i = index; i < job->chunks && wrk->rc == EXR_ERR_SUCCESS;
+         i += job->tasks) {
+        if (image_load_cancelled(job->img)) {
+            wrk->rc = EXR_ERR_UNKNOWN;
+        } else {
+            wrk->rc = decode_band_chunk(job, wrk, i);
         }
-        rc = decode_chunk(ectx, &chunk, &decoder, buffer);
-        if (rc != EXR_ERR_SUCCESS) {
+    }
+}
+
+/**
+ * Create decoding job.
+ * @param ectx EXR context
+ * @param img target image context
+ * @return job instance or NULL on errors
+ */
+static struct exr_job* create_job(const exr_context_t ectx, struct image* img)
+{
+    const exr_decode_pipeline_t init = EXR_DECODE_PIPELINE_INITIALIZER;
+    struct exr_job* job;
+    uint64_t chunk_size;
+
+    if (exr_get_chunk_unpacked_size(ectx, 0, &chunk_size) !=
+        EXR_ERR_SUCCESS) {
+        return NULL;
+    }
+
+    job = calloc(1, sizeof(*job));
+    if (!job) {
+        return NULL;
+    }
+    job->ectx = ectx;
+    job->img = img;
+
+    // linear intensity to sRGB transfer function
+    for (size_t i = 0; i < SRGB_LUT_SIZE; ++i) {
+        const float lin = (float)i / (SRGB_LUT_SIZE - 1);
+        const float srgb = lin <= 0.0031308f
+            ? lin * 12.92f
+            : 1.055f * powf(lin, 1.0f / 2.4f) - 0.055f;
+        job->srgb[i] = srgb * 0xff + 0.5f;
+    }
+
+    // temporary buffers for decoded chunks
+    job->workers = calloc(image_load_threads(), sizeof(*job->workers));
+    if (!job->workers) {
+        free(job);
+        return NULL;
+    }
+    for (size_t i = 0; i < image_load_threads(); ++i) {
+        struct exr_worker* wrk = &job->workers[i];
+        wrk->decoder = init;
+        wrk->buffer = malloc(chunk_size);
+        if (!wrk->buffer) {
             break;
         }
+        ++job->num_workers;
+    }
+    if (job->num_workers == 0) {
+        free(job->workers);
+        free(job);
+        return NULL;
+    }
 
-        // put pixels to final image
-        for (int16_t i = 0; i < decoder.channel_count; ++i) {
-            bpp += decoder.channels[i].bytes_per_element;
-        }
-        for (size_t i = 0; i < chunk_size; i += bpp) {
-            if (dst >= pm->data + (pm->width * pm->height)) {
-                goto done;
-            }
-            *dst = decode_pixel(&decoder, buffer + i, chunk_size - i);
-            ++dst;
-        }
+    return job;
+}
+
+/**
+ * Free decoding job.
+ * @param job job instance to free
+ */
+static void free_job(struct exr_job* job)
+{
+    for (size_t i = 0; i < job->num_workers; ++i) {
+        exr_decoding_destroy(job->ectx, &job->workers[i].decoder);
+        free(job->workers[i].buffer);
     }
+    free(job->workers);
+    free(job);
+}
 
-done:
-    exr_decoding_destroy(ectx, &decoder);
-    free(buffer);
-    return rc;
+/**
+ * Decode all chunks of the band in parallel.
+ * @param job decoding job
+ * @param pm band to fill
+ * @param band_y first row of the band
+ * @param chunks number of chunks in the band
+ * @return result code
+ */
+static exr_result_t decode_band(struct exr_job* job, const struct pixmap* pm,
+                                size_t band_y, size_t chunks)
+{
+    job->pm = pm;
+    job->band_y = band_y;
+    job->chunks = chunks;
+    job->tasks = min(job->num_workers, chunks);
+
+    tpool_run(job->tasks, decode_task, job);
+
+    for (size_t i = 0; i < job->tasks; ++i) {
+        if (job->workers[i].rc != EXR_ERR_SUCCESS) {
+            return job->workers[i].rc;
+        }
+    }
+    return EXR_ERR_SUCCESS;
 }
 
 /**
- * Load tailed EXR image.
- * @param ectx EXR context
- * @param pm destination pixmap
+ * Load scanlined EXR image.
+ * @param job decoding job
  * @return result code
  */
-static exr_result_t load_tailed(const exr_context_t ectx, struct pixmap* pm)
+static exr_result_t load_scanlined(struct exr_job* job)
 {
     exr_result_t rc;
-    uint64_t chunk_size;
-    uint8_t* buffer = NULL;
-    int32_t levels_x, levels_y;
-    exr_decode_pipeline_t decoder = EXR_DECODE_PIPELINE_INITIALIZER;
+    struct image_band band = { 0 };
+    exr_attr_box2i_t dwnd;
+    size_t width, height;
 
-    // temporary buffer for decoded chunk's scanlines
-    rc = exr_get_chunk_unpacked_size(ectx, 0, &chunk_size);
+    // get image properties
+    rc = exr_get_data_window(job->ectx, 0, &dwnd);
+    if (rc != EXR_ERR_SUCCESS) {
+        return rc;
+    }
+    rc = exr_get_scanlines_per_chunk(job->ectx, 0, &job->scanlines);
     if (rc != EXR_ERR_SUCCESS) {
         return rc;
     }
-    buffer = malloc(chunk_size);
-    if (!buffer) {
+    job->base_y = dwnd.min.y;
+    width = dwnd.max.x - dwnd.min.x + 1;
+    height = dwnd.max.y - dwnd.min.y + 1;
+
+    // huge images are downscaled band by band
+    if (!image_alloc_bands(job->img, &band, width, height, job->scanlines)) {
         return EXR_ERR_OUT_OF_MEMORY;
     }
 
-    rc = exr_get_tile_levels(ectx, 0, &levels_x, &levels_y);
-    if (rc != EXR_ERR_SUCCESS) {
-        goto done;
+    // decode chunks
+    for (size_t band_y = 0; band_y < height && rc == EXR_ERR_SUCCESS;
+         band_y += band.rows) {
+        const struct pixmap* pm = image_band_get(&band, band_y);
+        const size_t chunks = (pm->height + job->scanlines - 1) /
+            job->scanlines;
+        rc = decode_band(job, pm, band_y, chunks);
+        image_band_put(&band);
     }
 
-    for (int32_t lvl_y = 0; lvl_y < levels_y; ++lvl_y) {
-        for (int32_t lvl_x = 0; lvl_x < levels_x; ++lvl_x) {
-            int32_t lvl_w, lvl_h;
-            int32_t tile_w, tile_h;
-            int tile_x, tile_y;
-            exr_chunk_info_t chunk;
-            exr_decode_pipeline_t decoder = EXR_DECODE_PIPELINE_INITIALIZER;
+    image_band_free(&band);
+    return rc;
+}
 
-            rc = exr_get_level_sizes(ectx, 0, lvl_x, lvl_y, &lvl_w, &lvl_h);
-            if (rc != EXR_ERR_SUCCESS) {
-                goto done;
-            }
-            rc = exr_get_tile_sizes(ectx, 0, lvl_x, lvl_y, &tile_w, &tile_h);
-            if (rc != EXR_ERR_SUCCESS) {
-                goto done;
-            }
+/**
+ * Load tailed EXR image: only one resolution level is decoded, mip level
+ * closest to the memory limit is used for huge images.
+ * @param job decoding job
+ * @return result code
+ */
+static exr_result_t load_tailed(struct exr_job* job)
+{
+    exr_result_t rc;
+    int32_t levels_x, levels_y;
+    int32_t lvl_w, lvl_h;
+    size_t scale;
+    struct image_band band = { 0 };
 
-            tile_y = 0;
-            for (int64_t img_y = 0; img_y < lvl_h; img_y += tile_h) {
-                tile_x = 0;
-                for (int64_t img_x = 0; img_x < lvl_w; img_x += tile_w) {
-                    int8_t bpp = 0;
+    // select resolution level: each next one is twice smaller
+    rc = exr_get_tile_levels(job->ectx, 0, &levels_x, &levels_y);
+    if (rc != EXR_ERR_SUCCESS) {
+        return rc;
+    }
+    rc = exr_get_level_sizes(job->ectx, 0, 0, 0, &lvl_w, &lvl_h);
+    if (rc != EXR_ERR_SUCCESS) {
+        return rc;
+    }
+    scale = image_load_scale(lvl_w, lvl_h);
+    while (job->level + 1 < levels_x && job->level + 1 < levels_y &&
+           (size_t)2 << job->level <= scale) {
+        ++job->level;
+    }
+    rc = exr_get_level_sizes(job->ectx, 0, job->level, job->level, &lvl_w,
+                             &lvl_h);
+    if (rc != EXR_ERR_SUCCESS) {
+        return rc;
+    }
+    rc = exr_get_tile_sizes(job->ectx, 0, job->level, job->level,
+                            &job->tile_w, &job->tile_h);
+    if (rc != EXR_ERR_SUCCESS) {
+        return rc;
+    }
+    job->tiles_x = (lvl_w + job->tile_w - 1) / job->tile_w;
 
-                    rc = exr_read_tile_chunk_info(ectx, 0, tile_x, tile_y,
-                                                  lvl_x, lvl_y, &chunk);
-                    if (rc != EXR_ERR_SUCCESS) {
-                        goto done;
-                    }
-                    rc = decode_chunk(ectx, &chunk, &decoder, buffer);
-                    if (rc != EXR_ERR_SUCCESS) {
-                        goto done;
-                    }
+    // level is downscaled further by bands if it still exceeds the limit
+    if (!image_alloc_bands(job->img, &band, lvl_w, lvl_h, job->tile_h)) {
+        return EXR_ERR_OUT_OF_MEMORY;
+    }
 
-                    // put pixels to final image
-                    for (int16_t i = 0; i < decoder.channel_count; ++i) {
-                        bpp += decoder.channels[i].bytes_per_element;
-                    }
-                    for (int32_t y = 0; y < chunk.height; ++y) {
-                        const uint8_t* src_line =
-                            &buffer[y * chunk.width * bpp];
-                        argb_t* dst_line = &pm->data[(img_y + y) * pm->width];
-                        for (int32_t x = 0; x < chunk.width; ++x) {
-                            dst_line[img_x + x] =
-                                decode_pixel(&decoder, src_line + x * bpp, 42);
-                        }
-                    }
-                    ++tile_x;
-                }
-                ++tile_y;
-            }
-        }
+    for (size_t band_y = 0; band_y < (size_t)lvl_h && rc == EXR_ERR_SUCCESS;
+         band_y += band.rows) {
+        const struct pixmap* pm = image_band_get(&band, band_y);
+        const size_t tiles_y = (pm->height + job->tile_h - 1) / job->tile_h;
+        rc = decode_band(job, pm, band_y, tiles_y * job->tiles_x);
+        image_band_put(&band);
     }
 
-done:
-    exr_decoding_destroy(ectx, &decoder);
-    free(buffer);
+    image_band_free(&band);
     return rc;
 }
 
 // EXR loader implementation
 enum image_status decode_exr(struct image* img, const uint8_t* data,
-                             size_t size)
+                             size_t size, __attribute__((unused)) size_t hint)
 {
     exr_result_t rc;
     exr_context_t exr;
     exr_context_initializer_t einit = EXR_DEFAULT_CONTEXT_INITIALIZER;
-    struct pixmap* pm;
-    exr_attr_box2i_t dwnd;
     exr_storage_t storage;
+    struct exr_job* job;
     struct data_buffer buf = {
         .data = data,
         .size = size,
@@ -348,18 +511,6 @@ enum image_status decode_exr(struct image* img, const uint8_t* data,
         return imgload_fmterror;
     }
 
-    rc = exr_get_data_window(exr, 0, &dwnd);
-    if (rc != EXR_ERR_SUCCESS) {
-        goto done;
-    }
-
-    pm = image_alloc_frame(img, dwnd.max.x - dwnd.min.x + 1,
-                           dwnd.max.y - dwnd.min.y + 1);
-    if (!pm) {
-        rc = EXR_ERR_OUT_OF_MEMORY;
-        goto done;
-    }
-
     rc = exr_get_storage(exr, 0, &storage);
     if (rc != EXR_ERR_SUCCESS) {
         goto done;
@@ -368,12 +519,18 @@ enum image_status decode_exr(struct image* img, const uint8_t* data,
     image_set_format(img, "EXR");
     img->alpha = true;
 
-    if (storage == EXR_STORAGE_SCANLINE) {
-        rc = load_scanlined(exr, pm);
-    } else if (storage == EXR_STORAGE_TILED) {
-        rc = load_tailed(exr, pm);
+    job = create_job(exr, img);
+    if (!job) {
+        rc = EXR_ERR_OUT_OF_MEMORY;
     } else {
-        rc = EXR_ERR_FEATURE_NOT_IMPLEMENTED;
+        if (storage == EXR_STORAGE_SCANLINE) {
+            rc = load_scanlined(job);
+        } else if (storage == EXR_STORAGE_TILED) {
+            rc = load_tailed(job);
+        } else {
+            rc = EXR_ERR_FEATURE_NOT_IMPLEMENTED;
+        }
+        free_job(job);
     }
 
 done:
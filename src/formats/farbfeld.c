@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: MIT
 // Farbfeld format decoder
 
+#include "../pixmap_conv.h"
 #include "loader.h"
 
 #include <arpa/inet.h>
@@ -25,12 +26,11 @@ struct __attribute__((__packed__)) farbfeld_rgba {
 };
 
 enum image_status decode_farbfeld(struct image* img, const uint8_t* data,
-                                  size_t size)
+                                  size_t size,
+                                  __attribute__((unused)) size_t hint)
 {
     const struct farbfeld_header* header = (const struct farbfeld_header*)data;
     size_t width, height, total;
-    struct farbfeld_rgba* src;
-    argb_t* dst;
 
     // check signature
     if (size < sizeof(*header) ||
@@ -49,14 +49,8 @@ enum image_status decode_farbfeld(struct image* img, const uint8_t* data,
     data += sizeof(struct farbfeld_header);
 
     // decode image
-    dst = img->frames[0].pm.data;
-    src = (struct farbfeld_rgba*)data;
     total = min(width * height, size / sizeof(struct farbfeld_rgba));
-    for (size_t i = 0; i < total; ++i) {
-        *dst = ARGB(src->a, src->r, src->g, src->b);
-        ++dst;
-        ++src;
-    }
+    pixel_conv_rgba64be(data, img->frames[0].pm.data, total);
 
     image_set_format(img, "Farbfeld");
     img->alpha = true;
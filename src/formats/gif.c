@@ -5,6 +5,7 @@
 #include "loader.h"
 
 #include <gif_lib.h>
+#include <stdlib.h>
 #include <string.h>
 
 // GIF signature
@@ -13,10 +14,23 @@ static const uint8_t signature[] = { 'G', 'I', 'F' };
 // Buffer description for GIF reader
 struct buffer {
     const uint8_t* data;
-    const size_t size;
+    size_t size;
     size_t position;
 };
 
+/** GIF animation decoder: frames are decoded sequentially on demand. */
+struct gif_anim {
+    struct image_anim base;    ///< Base animation decoder
+    GifFileType* gif;          ///< GIF reader
+    struct buffer buf;         ///< Reader buffer
+    uint8_t* data;             ///< Copy of the file data
+    GraphicsControlBlock* ctl; ///< Graphics control blocks of frames
+    struct pixmap canvas;      ///< Canvas to compose the next frame on
+    GifByteType* raster;       ///< Color indices of the current frame
+    size_t raster_size;        ///< Size of the raster buffer
+    size_t next;               ///< Index of the next frame in the stream
+};
+
 // GIF reader callback, see `InputFunc` in gif_lib.h
 static int gif_reader(GifFileType* gif, GifByteType* dst, int sz)
 {
@@ -30,44 +44,216 @@ static int gif_reader(GifFileType* gif, GifByteType* dst, int sz)
 }
 
 /**
- * Decode single GIF frame.
- * @param img image context
+ * Open GIF reader at the beginning of the stream.
+ * @param ga animation decoder
+ * @return true if completed successfully
+ */
+static bool gif_rewind(struct gif_anim* ga)
+{
+    int err;
+
+    if (ga->gif) {
+        DGifCloseFile(ga->gif, NULL);
+    }
+
+    ga->buf.position = 0;
+    ga->gif = DGifOpen(&ga->buf, gif_reader, &err);
+    ga->next = 0;
+
+    if (ga->canvas.data) {
+        memset(ga->canvas.data, 0,
+               ga->canvas.width * ga->canvas.height * sizeof(argb_t));
+    }
+
+    return ga->gif;
+}
+
+/**
+ * Read extension record.
  * @param gif gif context
- * @param index number of the frame to load
+ * @param ctl graphics control block to fill, NULL to skip the record
  * @return true if completed successfully
  */
-static bool decode_frame(struct image* img, GifFileType* gif, size_t index)
+static bool read_extension(GifFileType* gif, GraphicsControlBlock* ctl)
 {
-    const SavedImage* gif_img = &gif->SavedImages[index];
-    const GifImageDesc* desc = &gif_img->ImageDesc;
-    const ColorMapObject* color_map =
-        desc->ColorMap ? desc->ColorMap : gif->SColorMap;
-    GraphicsControlBlock ctl = { .TransparentColor = NO_TRANSPARENT_COLOR };
-    struct image_frame* frame = &img->frames[index];
+    GifByteType* ext;
+    int code;
 
-    const size_t width = (size_t)desc->Width > frame->pm.width - desc->Left
-        ? frame->pm.width - desc->Left
-        : (size_t)desc->Width;
-    const size_t height = (size_t)desc->Height > frame->pm.height - desc->Top
-        ? frame->pm.height - desc->Top
-        : (size_t)desc->Height;
+    if (DGifGetExtension(gif, &code, &ext) != GIF_OK) {
+        return false;
+    }
+    if (ctl && code == GRAPHICS_EXT_FUNC_CODE && ext && ext[0] >= 4) {
+        DGifExtensionToGCB(ext[0], ext + 1, ctl);
+    }
+    while (ext) {
+        if (DGifGetExtensionNext(gif, &ext) != GIF_OK) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Skip compressed raster of the image.
+ * @param gif gif context
+ * @return true if completed successfully
+ */
+static bool skip_raster(GifFileType* gif)
+{
+    GifByteType* block;
+    int size;
+
+    if (DGifGetCode(gif, &size, &block) != GIF_OK) {
+        return false;
+    }
+    while (block) {
+        if (DGifGetCodeNext(gif, &block) != GIF_OK) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Scan the stream to get number of frames and their graphics control blocks
+ * without decoding the raster data.
+ * @param ga animation decoder
+ * @return number of frames
+ */
+static size_t scan(struct gif_anim* ga)
+{
+    const GraphicsControlBlock def = {
+        .DisposalMode = DISPOSAL_UNSPECIFIED,
+        .TransparentColor = NO_TRANSPARENT_COLOR,
+    };
+    GraphicsControlBlock ctl = def;
+    GifRecordType type = UNDEFINED_RECORD_TYPE;
+    size_t num = 0;
+
+    while (type != TERMINATE_RECORD_TYPE &&
+           DGifGetRecordType(ga->gif, &type) == GIF_OK) {
+        if (type == EXTENSION_RECORD_TYPE) {
+            if (!read_extension(ga->gif, &ctl)) {
+                break;
+            }
+        } else if (type == IMAGE_DESC_RECORD_TYPE) {
+            GraphicsControlBlock* ctls;
+            if (DGifGetImageDesc(ga->gif) != GIF_OK ||
+                !skip_raster(ga->gif)) {
+                break; // truncated file, use complete frames only
+            }
+            ctls = realloc(ga->ctl, (num + 1) * sizeof(*ctls));
+            if (!ctls) {
+                break;
+            }
+            ga->ctl = ctls;
+            ga->ctl[num++] = ctl;
+            ctl = def;
+        }
+    }
+
+    return num;
+}
+
+/**
+ * Read the next image from the stream: descriptor and color indices.
+ * @param ga animation decoder
+ * @return true if completed successfully
+ */
+static bool read_raster(struct gif_anim* ga)
+{
+    GifFileType* gif = ga->gif;
+    GifRecordType type;
+    size_t width, height;
+
+    // skip extensions, graphics control blocks are known from the scan
+    do {
+        if (DGifGetRecordType(gif, &type) != GIF_OK ||
+            type == TERMINATE_RECORD_TYPE) {
+            return false;
+        }
+        if (type == EXTENSION_RECORD_TYPE && !read_extension(gif, NULL)) {
+            return false;
+        }
+    } while (type != IMAGE_DESC_RECORD_TYPE);
+
+    if (DGifGetImageDesc(gif) != GIF_OK) {
+        return false;
+    }
+    if (gif->Image.Width <= 0 || gif->Image.Height <= 0) {
+        return skip_raster(gif);
+    }
+    width = gif->Image.Width;
+    height = gif->Image.Height;
+
+    if (ga->raster_size < width * height) {
+        GifByteType* raster = realloc(ga->raster, width * height);
+        if (!raster) {
+            return false;
+        }
+        ga->raster = raster;
+        ga->raster_size = width * height;
+    }
+
+    if (gif->Image.Interlace) {
+        static const size_t offsets[] = { 0, 4, 2, 1 };
+        static const size_t jumps[] = { 8, 8, 4, 2 };
+        for (size_t i = 0; i < sizeof(offsets) / sizeof(offsets[0]); ++i) {
+            for (size_t y = offsets[i]; y < height; y += jumps[i]) {
+                GifByteType* line = ga->raster + y * width;
+                if (DGifGetLine(gif, line, width) != GIF_OK) {
+                    return false;
+                }
+            }
+        }
+    } else {
+        for (size_t y = 0; y < height; ++y) {
+            GifByteType* line = ga->raster + y * width;
+            if (DGifGetLine(gif, line, width) != GIF_OK) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
 
-    DGifSavedExtensionToGCB(gif, index, &ctl);
+/**
+ * Draw the last read raster.
+ * @param ga animation decoder
+ * @param transparent index of transparent color
+ * @param pm destination pixmap
+ */
+static void draw_raster(const struct gif_anim* ga, int transparent,
+                        struct pixmap* pm)
+{
+    const GifImageDesc* desc = &ga->gif->Image;
+    const ColorMapObject* color_map =
+        desc->ColorMap ? desc->ColorMap : ga->gif->SColorMap;
+    size_t width, height;
 
-    if (ctl.DisposalMode == DISPOSE_PREVIOUS && index < img->num_frames - 1) {
-        struct pixmap* next = &img->frames[index + 1].pm;
-        pixmap_copy(&frame->pm, next, 0, 0, false);
+    if (!color_map || desc->Width <= 0 || desc->Height <= 0 ||
+        desc->Left < 0 || desc->Top < 0 || (size_t)desc->Left >= pm->width ||
+        (size_t)desc->Top >= pm->height) {
+        return;
     }
 
+    width = (size_t)desc->Width > pm->width - desc->Left
+        ? pm->width - desc->Left
+        : (size_t)desc->Width;
+    height = (size_t)desc->Height > pm->height - desc->Top
+        ? pm->height - desc->Top
+        : (size_t)desc->Height;
+
     for (size_t y = 0; y < height; ++y) {
-        const uint8_t* raster = &gif_img->RasterBits[y * desc->Width];
-        argb_t* pixel = frame->pm.data + desc->Top * frame->pm.width +
-            y * frame->pm.width + desc->Left;
+        const GifByteType* raster = &ga->raster[y * desc->Width];
+        argb_t* pixel = pm->data + (desc->Top + y) * pm->width + desc->Left;
 
         for (size_t x = 0; x < width; ++x) {
             const uint8_t color = raster[x];
-            if (color != ctl.TransparentColor &&
-                color < color_map->ColorCount) {
+            if (color != transparent && color < color_map->ColorCount) {
                 const GifColorType* rgb = &color_map->Colors[color];
                 *pixel = ARGB_SET_A(0xff) | ARGB_SET_R(rgb->Red) |
                     ARGB_SET_G(rgb->Green) | ARGB_SET_B(rgb->Blue);
@@ -75,32 +261,110 @@ static bool decode_frame(struct image* img, GifFileType* gif, size_t index)
             ++pixel;
         }
     }
+}
+
+/**
+ * Decode the next frame from the stream and update the canvas according to
+ * the frame disposal mode.
+ * @param ga animation decoder
+ * @param pm destination pixmap, NULL to update the canvas only
+ * @return true if completed successfully
+ */
+static bool compose(struct gif_anim* ga, struct pixmap* pm)
+{
+    const GraphicsControlBlock* ctl = &ga->ctl[ga->next];
+    const GifImageDesc* desc;
+
+    if (!read_raster(ga)) {
+        return false;
+    }
+    desc = &ga->gif->Image;
 
-    if (ctl.DisposalMode == DISPOSE_DO_NOT && index < img->num_frames - 1) {
-        struct pixmap* next = &img->frames[index + 1].pm;
-        pixmap_copy(&frame->pm, next, 0, 0, false);
+    if (ctl->DisposalMode == DISPOSE_DO_NOT) {
+        // the next frame is drawn over the current one
+        draw_raster(ga, ctl->TransparentColor, &ga->canvas);
+        if (pm) {
+            pixmap_copy(&ga->canvas, pm, 0, 0, false);
+        }
+    } else if (pm) {
+        pixmap_copy(&ga->canvas, pm, 0, 0, false);
+        draw_raster(ga, ctl->TransparentColor, pm);
     }
 
-    if (ctl.DelayTime != 0) {
-        frame->duration = ctl.DelayTime * 10; // hundreds of second to ms
-    } else {
-        frame->duration = 100;
+    switch (ctl->DisposalMode) {
+        case DISPOSE_DO_NOT:
+        case DISPOSE_PREVIOUS:
+            // canvas already contains the state for the next frame
+            break;
+        case DISPOSE_BACKGROUND:
+            // only the area used by the frame is cleared
+            pixmap_fill(&ga->canvas, desc->Left, desc->Top, desc->Width,
+                        desc->Height, 0);
+            break;
+        default:
+            memset(ga->canvas.data, 0,
+                   ga->canvas.width * ga->canvas.height * sizeof(argb_t));
+            break;
     }
 
+    ++ga->next;
+
     return true;
 }
 
+// Animation decoder callback: decode frame
+static bool gif_decode(struct image* img, size_t index)
+{
+    struct gif_anim* ga = (struct gif_anim*)img->anim;
+    struct pixmap* pm = &img->frames[index].pm;
+
+    // frames are composed sequentially, start over to go back
+    if (index < ga->next && !gif_rewind(ga)) {
+        return false;
+    }
+    while (ga->next < index) {
+        if (!compose(ga, NULL)) {
+            goto fail;
+        }
+    }
+
+    if (!pixmap_create(pm, ga->canvas.width, ga->canvas.height)) {
+        return false;
+    }
+    if (!compose(ga, pm)) {
+        pixmap_free(pm);
+        pm->data = NULL;
+        goto fail;
+    }
+
+    return true;
+
+fail:
+    ga->next = SIZE_MAX; // stream position is unknown, rewind next time
+    return false;
+}
+
+// Animation decoder callback: free decoder
+static void gif_free(struct image_anim* anim)
+{
+    struct gif_anim* ga = (struct gif_anim*)anim;
+
+    if (ga->gif) {
+        DGifCloseFile(ga->gif, NULL);
+    }
+    pixmap_free(&ga->canvas);
+    free(ga->raster);
+    free(ga->ctl);
+    free(ga->data);
+    free(ga);
+}
+
 //  GIF loader implementation
 enum image_status decode_gif(struct image* img, const uint8_t* data,
-                             size_t size)
+                             size_t size, __attribute__((unused)) size_t hint)
 {
-    GifFileType* gif = NULL;
-    struct buffer buf = {
-        .data = data,
-        .size = size,
-        .position = 0,
-    };
-    int err;
+    struct gif_anim* ga;
+    size_t num;
 
     // check signature
     if (size < sizeof(signature) ||
@@ -108,42 +372,68 @@ enum image_status decode_gif(struct image* img, const uint8_t* data,
         return imgload_unsupported;
     }
 
-    // decode
-    gif = DGifOpen(&buf, gif_reader, &err);
-    if (!gif) {
+    ga = calloc(1, sizeof(*ga));
+    if (!ga) {
         return imgload_fmterror;
     }
-    if (DGifSlurp(gif) != GIF_OK) {
+    ga->base.decode = gif_decode;
+    ga->base.free = gif_free;
+    ga->buf.data = data;
+    ga->buf.size = size;
+
+    // get frames description without decoding
+    if (!gif_rewind(ga)) {
+        goto fail;
+    }
+    num = scan(ga);
+    if (num == 0 || !gif_rewind(ga) ||
+        !pixmap_create(&ga->canvas, ga->gif->SWidth, ga->gif->SHeight)) {
         goto fail;
     }
 
-    // allocate frame sequence
-    if (!image_alloc_frames(img, gif->ImageCount)) {
+    // allocate frame sequence, pixel data is created on demand
+    if (!image_alloc_frames(img, num)) {
         goto fail;
     }
-    for (size_t i = 0; i < img->num_frames; ++i) {
-        struct pixmap* pm = &img->frames[i].pm;
-        if (!pixmap_create(pm, gif->SWidth, gif->SHeight)) {
-            goto fail;
+    for (size_t i = 0; i < num; ++i) {
+        struct image_frame* frame = &img->frames[i];
+        frame->pm.width = ga->canvas.width;
+        frame->pm.height = ga->canvas.height;
+        if (ga->ctl[i].DelayTime != 0) {
+            // hundreds of second to ms
+            frame->duration = ga->ctl[i].DelayTime * 10;
+        } else {
+            frame->duration = 100;
         }
     }
+    img->anim = &ga->base;
 
-    // decode every frame
-    for (size_t i = 0; i < img->num_frames; ++i) {
-        if (!decode_frame(img, gif, i)) {
-            goto fail;
+    // decode the first frame only
+    if (!gif_decode(img, 0)) {
+        image_free(img, IMGFREE_FRAMES);
+        return imgload_fmterror;
+    }
+
+    if (num > 1) {
+        // keep copy of the data to decode the rest of frames
+        ga->data = malloc(size);
+        if (!ga->data) {
+            image_free(img, IMGFREE_FRAMES);
+            return imgload_fmterror;
         }
+        memcpy(ga->data, data, size);
+        ga->buf.data = ga->data;
+    } else {
+        img->anim = NULL;
+        gif_free(&ga->base);
     }
 
-    image_set_format(img, "GIF%s", gif->ImageCount > 1 ? " animation" : "");
+    image_set_format(img, "GIF%s", num > 1 ? " animation" : "");
     img->alpha = true;
 
-    DGifCloseFile(gif, NULL);
-
     return imgload_success;
 
 fail:
-    DGifCloseFile(gif, NULL);
-    image_free(img, IMGFREE_FRAMES);
+    gif_free(&ga->base);
     return imgload_fmterror;
 }
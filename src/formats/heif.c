@@ -3,12 +3,20 @@
 // Copyright (C) 2022 Artem Senichev <artemsen@gmail.com>
 
 #include "../exif.h"
+#include "../pixmap_conv.h"
 #include "buildcfg.h"
 #include "loader.h"
 
 #include <libheif/heif.h>
 #include <stdlib.h>
 
+// Limit of decoding threads is available since libheif 1.13
+#ifdef LIBHEIF_HAVE_VERSION
+#if LIBHEIF_HAVE_VERSION(1, 13, 0)
+#define HEIF_MT_DECODING
+#endif
+#endif
+
 #ifdef HAVE_LIBEXIF
 /**
  * Read Exif info.
@@ -27,8 +35,8 @@ static void read_exif(struct image* img, struct heif_image_handle* pih)
         if (data) {
             const struct heif_error err =
                 heif_image_handle_get_metadata(pih, id, data);
-            if (err.code == heif_error_Ok) {
-                process_exif(img, data + 4 /* skip offset */, sz);
+            if (err.code == heif_error_Ok && sz > 4) {
+                process_exif(img, data + 4 /* skip offset */, sz - 4);
             }
             free(data);
         }
@@ -36,12 +44,79 @@ static void read_exif(struct image* img, struct heif_image_handle* pih)
 }
 #endif // HAVE_LIBEXIF
 
+/**
+ * Select embedded thumbnail: the smallest one that is still not less than
+ * the hint, or the largest one that fits the memory limit if the primary
+ * image doesn't.
+ * @param pih primary image handle
+ * @param hint size hint in pixels, 0 for full size image
+ * @return thumbnail handle or NULL to use the primary image
+ */
+static struct heif_image_handle*
+select_thumbnail(const struct heif_image_handle* pih, size_t hint)
+{
+    struct heif_image_handle* best = NULL;
+    size_t best_size = 0;
+    heif_item_id* ids;
+    int num;
+
+    if (!hint &&
+        image_load_scale(heif_image_handle_get_width(pih),
+                         heif_image_handle_get_height(pih)) == 1) {
+        return NULL;
+    }
+
+    num = heif_image_handle_get_number_of_thumbnails(pih);
+    if (num <= 0) {
+        return NULL;
+    }
+    ids = malloc(num * sizeof(*ids));
+    if (!ids) {
+        return NULL;
+    }
+    num = heif_image_handle_get_list_of_thumbnail_IDs(pih, ids, num);
+
+    for (int i = 0; i < num; ++i) {
+        struct heif_image_handle* thumb;
+        size_t width, height, size;
+        bool preferred;
+
+        if (heif_image_handle_get_thumbnail(pih, ids[i], &thumb).code !=
+            heif_error_Ok) {
+            continue;
+        }
+        width = heif_image_handle_get_width(thumb);
+        height = heif_image_handle_get_height(thumb);
+        size = width * height;
+        if (hint) {
+            preferred = width >= hint && height >= hint &&
+                (!best || size < best_size);
+        } else {
+            preferred = image_load_scale(width, height) == 1 &&
+                (!best || size > best_size);
+        }
+        if (preferred) {
+            if (best) {
+                heif_image_handle_release(best);
+            }
+            best = thumb;
+            best_size = size;
+        } else {
+            heif_image_handle_release(thumb);
+        }
+    }
+
+    free(ids);
+    return best;
+}
+
 // HEIF/AVIF loader implementation
 enum image_status decode_heif(struct image* img, const uint8_t* data,
-                              size_t size)
+                              size_t size, size_t hint)
 {
     struct heif_context* heif = NULL;
     struct heif_image_handle* pih = NULL;
+    struct heif_image_handle* thumb = NULL;
     struct heif_image* him = NULL;
     struct heif_error err;
     const uint8_t* decoded;
@@ -57,6 +132,9 @@ enum image_status decode_heif(struct image* img, const uint8_t* data,
     if (!heif) {
         goto done;
     }
+#ifdef HEIF_MT_DECODING
+    heif_context_set_max_decoding_threads(heif, image_load_threads());
+#endif
     err = heif_context_read_from_memory(heif, data, size, NULL);
     if (err.code != heif_error_Ok) {
         goto done;
@@ -65,7 +143,11 @@ enum image_status decode_heif(struct image* img, const uint8_t* data,
     if (err.code != heif_error_Ok) {
         goto done;
     }
-    err = heif_decode_image(pih, &him, heif_colorspace_RGB,
+
+    // use embedded thumbnail if it is large enough
+    thumb = select_thumbnail(pih, hint);
+
+    err = heif_decode_image(thumb ? thumb : pih, &him, heif_colorspace_RGB,
                             heif_chroma_interleaved_RGBA, NULL);
     if (err.code != heif_error_Ok) {
         goto done;
@@ -85,10 +167,7 @@ enum image_status decode_heif(struct image* img, const uint8_t* data,
     // convert to plain image frame
     for (size_t y = 0; y < pm->height; ++y) {
         const argb_t* src = (const argb_t*)(decoded + y * stride);
-        argb_t* dst = &pm->data[y * pm->width];
-        for (size_t x = 0; x < pm->width; ++x) {
-            dst[x] = ABGR_TO_ARGB(src[x]);
-        }
+        pixel_conv_abgr(src, &pm->data[y * pm->width], pm->width);
     }
 
     img->alpha = heif_image_handle_has_alpha_channel(pih);
@@ -107,6 +186,9 @@ done:
     if (him) {
         heif_image_release(him);
     }
+    if (thumb) {
+        heif_image_handle_release(thumb);
+    }
     if (pih) {
         heif_image_handle_release(pih);
     }
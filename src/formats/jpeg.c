@@ -2,9 +2,11 @@
 // JPEG format decoder.
 // Copyright (C) 2020 Artem Senichev <artemsen@gmail.com>
 
+#include "jpeg.h"
+
 #include "../exif.h"
+#include "../pixmap_conv.h"
 #include "buildcfg.h"
-#include "loader.h"
 
 #include <setjmp.h>
 #include <stdio.h>
@@ -29,19 +31,97 @@ static void jpg_error_exit(j_common_ptr jpg)
     longjmp(err->setjmp, 1);
 }
 
-// JPEG loader implementation
-enum image_status decode_jpeg(struct image* img, const uint8_t* data,
-                              size_t size)
+/** JPEG source manager: reads data from the stream. */
+struct jpg_stream_source {
+    struct jpeg_source_mgr mgr;  ///< Base source manager
+    struct image_stream* stream; ///< Input stream
+    uint8_t buffer[64 * 1024];   ///< Buffer for the stream data
+};
+
+// Source manager callback: nothing to init
+static void stream_init(__attribute__((unused)) j_decompress_ptr jpg) { }
+
+// Source manager callback: read next part of data from the stream
+static boolean stream_fill(j_decompress_ptr jpg)
+{
+    struct jpg_stream_source* src = (struct jpg_stream_source*)jpg->src;
+    size_t size =
+        image_stream_read(src->stream, src->buffer, sizeof(src->buffer));
+
+    if (size == 0) {
+        // insert fake EOI marker to finish truncated image
+        src->buffer[0] = 0xff;
+        src->buffer[1] = JPEG_EOI;
+        size = 2;
+    }
+
+    src->mgr.next_input_byte = src->buffer;
+    src->mgr.bytes_in_buffer = size;
+
+    return TRUE;
+}
+
+// Source manager callback: skip data
+static void stream_skip(j_decompress_ptr jpg, long num)
+{
+    struct jpeg_source_mgr* src = jpg->src;
+
+    if (num <= 0) {
+        return;
+    }
+    while (num > (long)src->bytes_in_buffer) {
+        num -= src->bytes_in_buffer;
+        stream_fill(jpg);
+    }
+    src->next_input_byte += num;
+    src->bytes_in_buffer -= num;
+}
+
+// Source manager callback: nothing to free
+static void stream_term(__attribute__((unused)) j_decompress_ptr jpg) { }
+
+/**
+ * Read all scanlines of the current output pass.
+ * @param jpg decompressor instance
+ * @param pm destination pixmap
+ */
+static void read_lines(struct jpeg_decompress_struct* jpg, struct pixmap* pm)
+{
+    while (jpg->output_scanline < jpg->output_height) {
+        uint8_t* line = (uint8_t*)&pm->data[jpg->output_scanline * pm->width];
+        jpeg_read_scanlines(jpg, &line, 1);
+
+        // convert grayscale to argb
+        if (jpg->out_color_components == 1) {
+            pixel_conv_gray(line, (argb_t*)line, jpg->output_width);
+        }
+
+#ifndef LIBJPEG_TURBO_VERSION
+        // convert rgb to argb
+        if (jpg->out_color_components == 3) {
+            pixel_conv_rgb(line, (argb_t*)line, jpg->output_width);
+        }
+#endif // LIBJPEG_TURBO_VERSION
+    }
+}
+
+/**
+ * Decode JPEG image.
+ * @param img image context
+ * @param data raw image data, NULL to read from the stream
+ * @param size size of image data in bytes
+ * @param stream input stream, used if data is NULL
+ * @param hint size hint for downscaled decoding
+ * @return loader status
+ */
+static enum image_status decode(struct image* img, const uint8_t* data,
+                                size_t size, struct image_stream* stream,
+                                size_t hint)
 {
     struct pixmap* pm;
     struct jpeg_decompress_struct jpg;
     struct jpg_error_manager err;
-
-    // check signature
-    if (size < sizeof(signature) ||
-        memcmp(data, signature, sizeof(signature))) {
-        return imgload_unsupported;
-    }
+    bool progressive;
 
     jpg.err = jpeg_std_error(&err.mgr);
     err.mgr.error_exit = jpg_error_exit;
@@ -52,8 +132,41 @@ enum image_status decode_jpeg(struct image* img, const uint8_t* data,
     }
 
     jpeg_create_decompress(&jpg);
-    jpeg_mem_src(&jpg, data, size);
+    if (data) {
+        jpeg_mem_src(&jpg, data, size);
+    } else {
+        // allocated in the decoder pool, freed with decoder
+        struct jpg_stream_source* src = (*jpg.mem->alloc_small)(
+            (j_common_ptr)&jpg, JPOOL_PERMANENT, sizeof(*src));
+        src->mgr.init_source = stream_init;
+        src->mgr.fill_input_buffer = stream_fill;
+        src->mgr.skip_input_data = stream_skip;
+        src->mgr.resync_to_restart = jpeg_resync_to_restart;
+        src->mgr.term_source = stream_term;
+        src->mgr.bytes_in_buffer = 0;
+        src->mgr.next_input_byte = NULL;
+        src->stream = stream;
+        jpg.src = &src->mgr;
+#ifdef HAVE_LIBEXIF
+        jpeg_save_markers(&jpg, JPEG_APP0 + 1, 0xffff);
+#endif
+    }
     jpeg_read_header(&jpg, TRUE);
+
+    // use DCT scaling (1/2, 1/4, 1/8) if the reduced image is enough
+    if (hint) {
+        const size_t side = min(jpg.image_width, jpg.image_height);
+        jpg.scale_num = 1;
+        jpg.scale_denom = 1;
+        while (jpg.scale_denom < 8 && side / (jpg.scale_denom * 2) >= hint) {
+            jpg.scale_denom *= 2;
+        }
+    }
+
+    // multi-scan decoding is slower, use it only if someone is waiting
+    progressive = img->progress && jpeg_has_multiple_scans(&jpg);
+    jpg.buffered_image = progressive;
+
     jpeg_start_decompress(&jpg);
 #ifdef LIBJPEG_TURBO_VERSION
     jpg.out_color_space = JCS_EXT_BGRA;
@@ -65,41 +178,68 @@ enum image_status decode_jpeg(struct image* img, const uint8_t* data,
         return imgload_fmterror;
     }
 
-    while (jpg.output_scanline < jpg.output_height) {
-        uint8_t* line = (uint8_t*)&pm->data[jpg.output_scanline * pm->width];
-        jpeg_read_scanlines(&jpg, &line, 1);
-
-        // convert grayscale to argb
-        if (jpg.out_color_components == 1) {
-            uint32_t* pixel = (uint32_t*)line;
-            for (int x = jpg.output_width - 1; x >= 0; --x) {
-                const uint8_t src = *(line + x);
-                pixel[x] = ((argb_t)0xff << 24) | (argb_t)src << 16 |
-                    (argb_t)src << 8 | src;
-            }
+    if (progressive) {
+        // show the first scan as soon as it is decoded, then skip the
+        // intermediate passes and output the complete image
+        jpeg_start_output(&jpg, jpg.input_scan_number);
+        read_lines(&jpg, pm);
+        jpeg_finish_output(&jpg);
+        image_load_progress(img);
+        while (!jpeg_input_complete(&jpg)) {
+            jpeg_consume_input(&jpg);
         }
+        jpeg_start_output(&jpg, jpg.input_scan_number);
+        read_lines(&jpg, pm);
+        jpeg_finish_output(&jpg);
+    } else {
+        read_lines(&jpg, pm);
+    }
 
-#ifndef LIBJPEG_TURBO_VERSION
-        // convert rgb to argb
-        if (jpg.out_color_components == 3) {
-            uint32_t* pixel = (uint32_t*)line;
-            for (int x = jpg.output_width - 1; x >= 0; --x) {
-                const uint8_t* src = line + x * 3;
-                pixel[x] = ((argb_t)0xff << 24) | (argb_t)src[0] << 16 |
-                    (argb_t)src[1] << 8 | src[2];
+    image_set_format(img, "JPEG %dbit", jpg.out_color_components * 8);
+
+#ifdef HAVE_LIBEXIF
+    if (data) {
+        process_exif(img, data, size);
+    } else {
+        // markers are freed by jpeg_finish_decompress
+        for (jpeg_saved_marker_ptr mk = jpg.marker_list; mk; mk = mk->next) {
+            if (mk->marker == JPEG_APP0 + 1 && mk->data_length > 6 &&
+                memcmp(mk->data, "Exif\0\0", 6) == 0) {
+                process_exif(img, mk->data, mk->data_length);
+                break;
             }
         }
-#endif // LIBJPEG_TURBO_VERSION
     }
-
-    image_set_format(img, "JPEG %dbit", jpg.out_color_components * 8);
+#endif
 
     jpeg_finish_decompress(&jpg);
     jpeg_destroy_decompress(&jpg);
 
-#ifdef HAVE_LIBEXIF
-    process_exif(img, data, size);
-#endif
-
     return imgload_success;
 }
+
+// JPEG loader implementation
+enum image_status decode_jpeg(struct image* img, const uint8_t* data,
+                              size_t size, size_t hint)
+{
+    // check signature
+    if (size < sizeof(signature) ||
+        memcmp(data, signature, sizeof(signature))) {
+        return imgload_unsupported;
+    }
+
+    return decode(img, data, size, NULL, hint);
+}
+
+// JPEG incremental loader implementation
+enum image_status decode_jpeg_stream(struct image* img,
+                                     struct image_stream* stream, size_t hint)
+{
+    // check signature
+    if (stream->head_size < sizeof(signature) ||
+        memcmp(stream->head, signature, sizeof(signature))) {
+        return imgload_unsupported;
+    }
+
+    return decode(img, NULL, 0, stream, hint);
+}
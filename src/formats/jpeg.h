@@ -0,0 +1,15 @@
+// SPDX-License-Identifier: MIT
+// JPEG format decoder.
+// Copyright (C) 2025 Artem Senichev <artemsen@gmail.com>
+
+#pragma once
+
+#include "loader.h"
+
+// JPEG decoder implementation
+enum image_status decode_jpeg(struct image* img, const uint8_t* data,
+                              size_t size, size_t hint);
+
+// JPEG incremental decoder implementation
+enum image_status decode_jpeg_stream(struct image* img,
+                                     struct image_stream* stream, size_t hint);
@@ -2,14 +2,72 @@
 // JPEG XL format decoder.
 // Copyright (C) 2021 Artem Senichev <artemsen@gmail.com>
 
+#include "../pixmap_conv.h"
+#include "../tpool.h"
 #include "loader.h"
 
 #include <jxl/decode.h>
+#include <jxl/version.h>
 #include <stdlib.h>
+#include <string.h>
+
+// Progressive decoding events are available since libjxl 0.9
+#if JPEGXL_NUMERIC_VERSION >= JPEGXL_COMPUTE_NUMERIC_VERSION(0, 9, 0)
+#define JXL_PROGRESSIVE
+#endif
+
+/** Parallel job of libjxl executed by the thread pool. */
+struct jxl_job {
+    void* opaque;                ///< libjxl data passed to the function
+    JxlParallelRunFunction func; ///< Function to call for each value
+    uint32_t start;              ///< First value of the range
+    uint32_t end;                ///< End of the range (not included)
+    size_t threads;              ///< Number of threads (tasks)
+};
+
+// Thread pool task handler: process every n-th value of the range
+static void jxl_task(size_t index, void* data)
+{
+    const struct jxl_job* job = data;
+    for (uint32_t i = job->start + index; i < job->end; i += job->threads) {
+        job->func(job->opaque, i, index);
+    }
+}
+
+// Parallel runner of libjxl backed by the thread pool, see JxlParallelRunner
+static JxlParallelRetCode
+jxl_runner(__attribute__((unused)) void* runner_opaque, void* jpegxl_opaque,
+           JxlParallelRunInit init, JxlParallelRunFunction func,
+           uint32_t start_range, uint32_t end_range)
+{
+    struct jxl_job job = {
+        .opaque = jpegxl_opaque,
+        .func = func,
+        .start = start_range,
+        .end = end_range,
+        .threads = image_load_threads(),
+    };
+    JxlParallelRetCode rc;
+
+    if (job.threads > end_range - start_range) {
+        job.threads = end_range - start_range;
+    }
+    if (job.threads == 0) {
+        job.threads = 1;
+    }
+
+    // task index is used as thread id, it is unique among running tasks
+    rc = init(jpegxl_opaque, job.threads);
+    if (rc == 0) {
+        tpool_run(job.threads, jxl_task, &job);
+    }
+
+    return rc;
+}
 
 // JPEG XL loader implementation
 enum image_status decode_jxl(struct image* img, const uint8_t* data,
-                             size_t size)
+                             size_t size, __attribute__((unused)) size_t hint)
 {
     JxlDecoder* jxl;
     JxlBasicInfo info = { 0 };
@@ -17,6 +75,7 @@ enum image_status decode_jxl(struct image* img, const uint8_t* data,
     size_t buffer_sz;
     struct image_frame* frames;
     size_t frame_num = 0;
+    int events;
 
     const JxlPixelFormat jxl_format = { .num_channels = 4, // ARBG
                                         .data_type = JXL_TYPE_UINT8,
@@ -41,10 +100,23 @@ enum image_status decode_jxl(struct image* img, const uint8_t* data,
     if (status != JXL_DEC_SUCCESS) {
         goto fail;
     }
+    if (image_load_threads() > 1) {
+        status = JxlDecoderSetParallelRunner(jxl, jxl_runner, NULL);
+        if (status != JXL_DEC_SUCCESS) {
+            goto fail;
+        }
+    }
 
     // process decoding
-    status = JxlDecoderSubscribeEvents(
-        jxl, JXL_DEC_BASIC_INFO | JXL_DEC_FRAME | JXL_DEC_FULL_IMAGE);
+    events = JXL_DEC_BASIC_INFO | JXL_DEC_FRAME | JXL_DEC_FULL_IMAGE;
+#ifdef JXL_PROGRESSIVE
+    if (img->progress) {
+        // notify once the DC (1:8) approximation is available
+        events |= JXL_DEC_FRAME_PROGRESSION;
+        JxlDecoderSetProgressiveDetail(jxl, kDC);
+    }
+#endif
+    status = JxlDecoderSubscribeEvents(jxl, events);
     if (status != JXL_DEC_SUCCESS) {
         goto fail;
     }
@@ -62,14 +134,25 @@ enum image_status decode_jxl(struct image* img, const uint8_t* data,
                     goto fail;
                 }
                 break;
+#ifdef JXL_PROGRESSIVE
+            case JXL_DEC_FRAME_PROGRESSION:
+                // animation frames are shown only when complete
+                if (frame_num == 0 && !info.have_animation &&
+                    JxlDecoderFlushImage(jxl) == JXL_DEC_SUCCESS) {
+                    struct pixmap* pm = &img->frames[0].pm;
+                    // output buffer is fully rewritten by the next pass
+                    pixel_conv_abgr(pm->data, pm->data,
+                                    pm->width * pm->height);
+                    image_load_progress(img);
+                }
+                break;
+#endif
             case JXL_DEC_FULL_IMAGE:
                 // convert ABGR -> ARGB
-                for (size_t i = 0; i < img->frames[frame_num].pm.width *
-                         img->frames[frame_num].pm.height;
-                     ++i) {
-                    img->frames[frame_num].pm.data[i] =
-                        ABGR_TO_ARGB(img->frames[frame_num].pm.data[i]);
-                }
+                pixel_conv_abgr(img->frames[frame_num].pm.data,
+                                img->frames[frame_num].pm.data,
+                                img->frames[frame_num].pm.width *
+                                    img->frames[frame_num].pm.height);
                 frame_num = img->num_frames;
                 break;
             case JXL_DEC_FRAME:
@@ -79,6 +162,7 @@ enum image_status decode_jxl(struct image* img, const uint8_t* data,
                     goto fail;
                 }
                 img->frames = frames;
+                memset(&img->frames[frame_num], 0, sizeof(*img->frames));
                 if (!pixmap_create(&img->frames[frame_num].pm, info.xsize,
                                    info.ysize)) {
                     goto fail;
@@ -2,29 +2,65 @@
 // Image loader.
 // Copyright (C) 2025 Artem Senichev <artemsen@gmail.com>
 
+// pipe2() and syscall() are used by isolated decoding
+#define _GNU_SOURCE
+
 #include "loader.h"
 
 #include "../array.h"
+#include "../exif.h"
+#include "../fcache.h"
+#include "../fs.h"
+#include "../memstat.h"
 #include "../shellcmd.h"
+#include "../tpool.h"
+#include "../trace.h"
 #include "buildcfg.h"
 
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
+// Size of the stream head used to detect image format
+#define STREAM_HEAD_SIZE 256
+// Initial size of the stream buffer
+#define STREAM_BUFFER_SIZE (256 * 1024)
+// Max size of file to read ahead entirely before decoding
+#define WILLNEED_MAX_SIZE (64 * 1024 * 1024)
+// Min size of frame that references file data instead of copying it
+#define MAP_FRAME_MIN_SIZE (16 * 1024 * 1024)
+// Interval of checking isolated decoder state (cancellation, timeout) in ms
+#define ISOLATE_POLL_MS 100
+// Initial capacity of the interned directory names table (power of 2)
+#define DIR_NAMES_MIN 64
+
 // Construct function name of loader
 #define LOADER_FUNCTION(name) decode_##name
 // Declaration of loader function
-#define LOADER_DECLARE(name)                                    \
-    enum image_status LOADER_FUNCTION(name)(struct image * img, \
-                                            const uint8_t* data, size_t size)
+#define LOADER_DECLARE(name)                                              \
+    enum image_status LOADER_FUNCTION(name)(                              \
+        struct image * img, const uint8_t* data, size_t size, size_t hint)
+
+// Construct function name of incremental loader
+#define STREAM_FUNCTION(name) decode_##name##_stream
+// Declaration of incremental loader function
+#define STREAM_DECLARE(name)                                              \
+    enum image_status STREAM_FUNCTION(name)(                              \
+        struct image * img, struct image_stream * stream, size_t hint)
 
 // declaration of loaders
 LOADER_DECLARE(bmp);
@@ -47,12 +83,14 @@ LOADER_DECLARE(avif);
 #endif
 #ifdef HAVE_LIBJPEG
 LOADER_DECLARE(jpeg);
+STREAM_DECLARE(jpeg);
 #endif
 #ifdef HAVE_LIBJXL
 LOADER_DECLARE(jxl);
 #endif
 #ifdef HAVE_LIBPNG
 LOADER_DECLARE(png);
+STREAM_DECLARE(png);
 #endif
 #ifdef HAVE_LIBRSVG
 LOADER_DECLARE(svg);
@@ -70,54 +108,176 @@ LOADER_DECLARE(raw);
 LOADER_DECLARE(webp);
 #endif
 
+/** Format signature (magic bytes). */
+struct signature {
+    size_t offset;     ///< Offset of the signature in the file data
+    size_t size;       ///< Size of the signature in bytes, 0 if not used
+    const char* magic; ///< Signature bytes
+};
+
+/** Decoder description. */
+struct decoder {
+    const char* name;        ///< Decoder name used in traces
+    image_decoder decode;    ///< Decoder function
+    struct signature sig[2]; ///< Signatures, empty if format has no one
+};
+
+// Decoder description: name and function
+#define DECODER(name) "decode_" #name, &LOADER_FUNCTION(name)
+// Signature description: offset and magic bytes as string literal
+#define SIGNATURE(offset, magic) { offset, sizeof(magic) - 1, magic }
+
 // clang-format off
 // list of available decoders
-static const image_decoder decoders[] = {
+static const struct decoder decoders[] = {
 #ifdef HAVE_LIBJPEG
-    &LOADER_FUNCTION(jpeg),
+    { DECODER(jpeg),     { SIGNATURE(0, "\xff\xd8") } },
 #endif
 #ifdef HAVE_LIBPNG
-    &LOADER_FUNCTION(png),
+    { DECODER(png),      { SIGNATURE(0, "\x89PNG\r\n\x1a\n") } },
 #endif
 #ifdef HAVE_LIBGIF
-    &LOADER_FUNCTION(gif),
+    { DECODER(gif),      { SIGNATURE(0, "GIF") } },
 #endif
-    &LOADER_FUNCTION(bmp),
-    &LOADER_FUNCTION(pnm),
-    &LOADER_FUNCTION(dicom),
-    &LOADER_FUNCTION(qoi),
-    &LOADER_FUNCTION(farbfeld),
+    { DECODER(bmp),      { SIGNATURE(0, "BM") } },
+    { DECODER(pnm),      { SIGNATURE(0, "P") } },
+    { DECODER(dicom),    { SIGNATURE(128, "DICM") } },
+    { DECODER(qoi),      { SIGNATURE(0, "qoif") } },
+    { DECODER(farbfeld), { SIGNATURE(0, "farbfeld") } },
 #ifdef HAVE_LIBWEBP
-    &LOADER_FUNCTION(webp),
+    { DECODER(webp),     { SIGNATURE(0, "RIFF") } },
 #endif
 #ifdef HAVE_LIBHEIF
-    &LOADER_FUNCTION(heif),
+    { DECODER(heif),     { SIGNATURE(4, "ftyp") } },
 #endif
 #ifdef HAVE_LIBAVIF
-    &LOADER_FUNCTION(avif),
+    { DECODER(avif),     { SIGNATURE(4, "ftyp") } },
 #endif
 #ifdef HAVE_LIBRSVG
-    &LOADER_FUNCTION(svg),
+    { DECODER(svg),      { { 0 } } },
 #endif
 #ifdef HAVE_LIBJXL
-    &LOADER_FUNCTION(jxl),
+    { DECODER(jxl),      { SIGNATURE(0, "\xff\x0a"),
+                           SIGNATURE(0, "\0\0\0\x0cJXL ") } },
 #endif
 #ifdef HAVE_LIBEXR
-    &LOADER_FUNCTION(exr),
+    { DECODER(exr),      { SIGNATURE(0, "\x76\x2f\x31\x01") } },
 #endif
 #ifdef HAVE_LIBRAW
-    &LOADER_FUNCTION(raw),
+    { DECODER(raw),      { { 0 } } },
 #endif
 #ifdef HAVE_LIBTIFF
-    &LOADER_FUNCTION(tiff),
+    { DECODER(tiff),     { SIGNATURE(0, "II*\0"),
+                           SIGNATURE(0, "MM\0*") } },
 #endif
 #ifdef HAVE_LIBSIXEL
-    &LOADER_FUNCTION(sixel),
+    { DECODER(sixel),    { SIGNATURE(0, "\x1b") } },
 #endif
-    &LOADER_FUNCTION(tga) // should be the last one
+    { DECODER(tga),      { { 0 } } }, // should be the last one
 };
 // clang-format on
 
+// decoder of preview images embedded into the image file
+#if defined(HAVE_LIBEXIF) && defined(HAVE_LIBJPEG)
+static const image_decoder preview_decoder = exif_preview;
+#else
+static const image_decoder preview_decoder = NULL;
+#endif
+
+// max size of single frame data in bytes, 0 for unlimited
+static size_t frame_limit;
+// max number of threads used by decoder, 0 for all threads of the pool
+static size_t decoder_threads;
+// isolated decoding: images are decoded in a child process
+static bool isolate;
+// max time of isolated decoding in seconds, 0 for unlimited
+static size_t isolate_timeout;
+// decoding mode of RAW images
+static enum raw_mode raw_mode = raw_full;
+
+/** File being decoded, its pixels can be mapped to the frame. */
+struct source_file {
+    const uint8_t* data; ///< Mapped file data
+    size_t size;         ///< Size of the file
+    int fd;              ///< File descriptor
+};
+
+/** Interned names of parent directories, shared by all images. */
+static struct dir_names {
+    char** table;         ///< Hash table of names (open addressing)
+    size_t size;          ///< Capacity of the table, power of 2
+    size_t num;           ///< Number of names in the table
+    pthread_mutex_t lock; ///< Table lock, images are loaded in parallel
+} dir_names = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+/** Header of the image decoded by child process. */
+struct isolate_header {
+    int32_t status;    ///< Loader status
+    uint8_t alpha;     ///< Image has alpha channel
+    uint8_t reduced;   ///< Image is decoded in reduced quality
+    size_t num_frames; ///< Number of frames
+    size_t format;     ///< Size of format description (with last null)
+    size_t info;       ///< Number of meta info entries
+    size_t exif;       ///< Size of raw EXIF data
+    size_t raw_size;   ///< Size of raw file data
+    size_t file_size;  ///< Size of the image file
+    time_t file_time;  ///< File modification time
+};
+
+/** Header of the frame decoded by child process, followed by pixels. */
+struct isolate_frame {
+    size_t width;    ///< Frame width
+    size_t height;   ///< Frame height
+    size_t duration; ///< Frame duration in milliseconds
+};
+
+/**
+ * Check if the data can be decoded by the decoder.
+ * @param decoder decoder description
+ * @param data raw image data
+ * @param size size of image data in bytes
+ * @return false if data doesn't have any of the decoder's signatures
+ */
+static bool check_signature(const struct decoder* decoder, const uint8_t* data,
+                            size_t size)
+{
+    bool has_sig = false;
+
+    for (size_t i = 0; i < ARRAY_SIZE(decoder->sig); ++i) {
+        const struct signature* sig = &decoder->sig[i];
+        if (sig->size) {
+            has_sig = true;
+            if (sig->offset + sig->size <= size &&
+                memcmp(data + sig->offset, sig->magic, sig->size) == 0) {
+                return true;
+            }
+        }
+    }
+
+    return !has_sig; // probe formats without signature
+}
+
+/**
+ * Get incremental decoder for the format.
+ * @param decode regular decoder of the format
+ * @return incremental decoder or NULL if format doesn't support it
+ */
+static image_stream_decoder
+get_stream_decoder(__attribute__((unused)) image_decoder decode)
+{
+#ifdef HAVE_LIBJPEG
+    if (decode == &LOADER_FUNCTION(jpeg)) {
+        return &STREAM_FUNCTION(jpeg);
+    }
+#endif
+#ifdef HAVE_LIBPNG
+    if (decode == &LOADER_FUNCTION(png)) {
+        return &STREAM_FUNCTION(png);
+    }
+#endif
+    return NULL;
+}
+
 const char* image_formats(void)
 {
     const char* formats = "bmp, pnm, farbfeld, tga, dicom"
@@ -169,27 +329,24 @@ const char* image_formats(void)
  * @param img destination image
  * @param data raw image data
  * @param size size of image data in bytes
+ * @param hint size hint for decoders, 0 for full size image
  * @return loader status
  */
 static enum image_status load_from_memory(struct image* img,
-                                          const uint8_t* data, size_t size)
+                                          const uint8_t* data, size_t size,
+                                          size_t hint)
 {
     enum image_status status = imgload_unsupported;
     size_t i;
 
+    // signatures are checked by decoders too, here they allow to skip
+    // creating heavy decoder contexts for the data of another format
     for (i = 0; i < ARRAY_SIZE(decoders) && status == imgload_unsupported;
          ++i) {
-        status = decoders[i](img, data, size);
-    }
-
-    if (status == imgload_success) {
-        uint8_t* dest = malloc(size);
-        if (dest) {
-            memcpy(dest, data, size);
-            img->file_raw = dest;
-        } else {
-            status = imgload_ioerror;
-            img->file_raw = NULL;
+        if (check_signature(&decoders[i], data, size)) {
+            struct trace_span span = trace_begin(decoders[i].name);
+            status = decoders[i].decode(img, data, size, hint);
+            trace_end(&span);
         }
     }
 
@@ -202,12 +359,16 @@ static enum image_status load_from_memory(struct image* img,
  * Load image from file.
  * @param img destination image
  * @param file path to the file to load
+ * @param decode function to decode the file data
+ * @param hint size hint for decoders, 0 for full size image
  * @return loader status
  */
-static enum image_status load_from_file(struct image* img, const char* file)
+static enum image_status load_from_file(struct image* img, const char* file,
+                                        image_decoder decode, size_t hint)
 {
     enum image_status status = imgload_ioerror;
     void* data = MAP_FAILED;
+    struct source_file mapped;
     struct stat st;
     int fd;
 
@@ -227,8 +388,19 @@ static enum image_status load_from_file(struct image* img, const char* file)
         return imgload_ioerror;
     }
 
+    // request the whole file at once instead of faulting it in page by page,
+    // most decoders read the data sequentially
+    posix_madvise(data, st.st_size,
+                  st.st_size <= WILLNEED_MAX_SIZE ? POSIX_MADV_WILLNEED
+                                                  : POSIX_MADV_SEQUENTIAL);
+
     // load from mapped memory
-    status = load_from_memory(img, data, st.st_size);
+    mapped.data = data;
+    mapped.size = st.st_size;
+    mapped.fd = fd;
+    img->mapped = &mapped;
+    status = decode(img, data, st.st_size, hint);
+    img->mapped = NULL;
 
     munmap(data, st.st_size);
     close(fd);
@@ -236,44 +408,223 @@ static enum image_status load_from_file(struct image* img, const char* file)
     return status;
 }
 
+/** Buffer for the data read from stream. */
+struct stream_buffer {
+    uint8_t* data;   ///< Buffer data
+    size_t size;     ///< Number of bytes in the buffer
+    size_t capacity; ///< Size of allocated buffer
+    bool heap;       ///< Buffer is allocated on the heap, mapped otherwise
+    int fd;          ///< Shared memory file backing the mapped buffer
+};
+
 /**
- * Load image from stream file (stdin).
+ * Create anonymous shared memory file.
+ * @return file descriptor or -1 on errors
+ */
+static int create_shm(void)
+{
+    static size_t counter = 0;
+    char path[64];
+    int fd;
+
+    // images can be loaded concurrently, so the name is regenerated if it is
+    // already taken
+    do {
+        snprintf(path, sizeof(path), "/" APP_NAME "_img_%x_%zx", getpid(),
+                 ++counter);
+        fd = shm_open(path, O_RDWR | O_CREAT | O_EXCL, 0600);
+    } while (fd == -1 && errno == EEXIST);
+    if (fd != -1) {
+        shm_unlink(path);
+    }
+
+    return fd;
+}
+
+/**
+ * Double the capacity of the stream buffer. The heap buffer is moved to the
+ * shared memory file once, then the file is extended and remapped, so the
+ * data is not copied on each growth.
+ * @param buf stream buffer
+ * @return false on errors
+ */
+static bool grow_buffer(struct stream_buffer* buf)
+{
+    const size_t capacity = buf->capacity * 2;
+    uint8_t* data;
+
+    if (buf->fd == -1) {
+        buf->fd = create_shm();
+        if (buf->fd == -1) {
+            // fallback to the heap
+            data = realloc(buf->data, capacity);
+            if (!data) {
+                return false;
+            }
+            buf->data = data;
+            buf->capacity = capacity;
+            buf->heap = true;
+            return true;
+        }
+    }
+
+    if (ftruncate(buf->fd, capacity) == -1) {
+        return false;
+    }
+    data = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, buf->fd, 0);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    if (buf->heap) {
+        memcpy(data, buf->data, buf->size);
+        free(buf->data);
+        buf->heap = false;
+    } else {
+        munmap(buf->data, buf->capacity);
+    }
+    buf->data = data;
+    buf->capacity = capacity;
+
+    return true;
+}
+
+/**
+ * Free the stream buffer.
+ * @param buf stream buffer
+ */
+static void free_buffer(struct stream_buffer* buf)
+{
+    if (buf->heap) {
+        free(buf->data);
+    } else {
+        munmap(buf->data, buf->capacity);
+    }
+    if (buf->fd != -1) {
+        close(buf->fd);
+    }
+}
+
+/**
+ * Read data from file descriptor, blocks until the buffer is filled.
+ * @param fd file descriptor for read
+ * @param buf output buffer
+ * @param size number of bytes to read
+ * @return number of bytes read (less than size at the end of file), -1 on
+ *         errors
+ */
+static ssize_t read_data(int fd, uint8_t* buf, size_t size)
+{
+    size_t total = 0;
+
+    while (total < size) {
+        const ssize_t rc = read(fd, buf + total, size - total);
+        if (rc == 0) {
+            break;
+        }
+        if (rc == -1) {
+            if (errno == EAGAIN || errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        total += rc;
+    }
+
+    return total;
+}
+
+/**
+ * Load image from stream file (stdin, pipe).
  * @param img destination image
  * @param fd file descriptor for read
+ * @param hint size hint for decoders, 0 for full size image
  * @return loader status
  */
-static enum image_status load_from_stream(struct image* img, int fd)
+static enum image_status load_from_stream(struct image* img, int fd,
+                                          size_t hint)
 {
     enum image_status status = imgload_ioerror;
-    uint8_t* data = NULL;
-    size_t size = 0;
-    size_t capacity = 0;
+    image_stream_decoder decode_stream = NULL;
+    struct stream_buffer buf = {
+        .capacity = STREAM_BUFFER_SIZE,
+        .heap = true,
+        .fd = -1,
+    };
+    struct stat st;
+    ssize_t rc;
+    int avail;
 
-    while (true) {
-        ssize_t rc;
+    // allocate buffer up front if the size is known
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        buf.capacity = st.st_size + 1; // extra byte to detect end of file
+    } else if (ioctl(fd, FIONREAD, &avail) == 0 &&
+               (size_t)avail > buf.capacity) {
+        buf.capacity = avail;
+    }
+    buf.data = malloc(buf.capacity);
+    if (!buf.data) {
+        return imgload_ioerror;
+    }
 
-        if (size == capacity) {
-            const size_t new_capacity = capacity + 256 * 1024;
-            uint8_t* new_buf = realloc(data, new_capacity);
-            if (!new_buf) {
+    // read the head of the stream to detect image format
+    rc = read_data(fd, buf.data, min(buf.capacity, STREAM_HEAD_SIZE));
+    if (rc == -1) {
+        free_buffer(&buf);
+        return imgload_ioerror;
+    }
+    buf.size = rc;
+    if (buf.size == STREAM_HEAD_SIZE) {
+        for (size_t i = 0; i < ARRAY_SIZE(decoders); ++i) {
+            if (check_signature(&decoders[i], buf.data, buf.size)) {
+                decode_stream = get_stream_decoder(decoders[i].decode);
                 break;
             }
-            data = new_buf;
-            capacity = new_capacity;
         }
+    }
 
-        rc = read(fd, data + size, capacity - size);
-        if (rc == 0) {
-            status = load_from_memory(img, data, size);
-            break;
+    if (decode_stream) {
+        // decode while the rest of data is being read, the data is kept in
+        // the buffer to retry with the whole image on errors
+        struct image_stream stream = {
+            .fd = fd,
+            .head = buf.data,
+            .head_size = buf.size,
+            .buffer = &buf,
+        };
+        struct trace_span span = trace_begin("decode_stream");
+        status = decode_stream(img, &stream, hint);
+        trace_end(&span);
+        if (status == imgload_success) {
+            // drain the rest of data to not break the writer (SIGPIPE)
+            size_t total = buf.size;
+            while ((rc = read_data(fd, buf.data, buf.capacity)) > 0) {
+                total += rc;
+            }
+            img->file_size = total;
+            free_buffer(&buf);
+            return status;
         }
-        if (rc == -1 && errno != EAGAIN) {
-            break;
+        // fallback to the memory decoders
+        image_free(img, IMGFREE_FRAMES);
+        status = imgload_ioerror;
+    }
+
+    if (buf.size) {
+        // read the rest of the stream, buffer grows geometrically
+        while (buf.size < buf.capacity || grow_buffer(&buf)) {
+            rc = read_data(fd, buf.data + buf.size, buf.capacity - buf.size);
+            if (rc == -1) {
+                break;
+            }
+            buf.size += rc;
+            if (buf.size < buf.capacity) {
+                status = load_from_memory(img, buf.data, buf.size, hint);
+                break;
+            }
         }
-        size += rc;
     }
 
-    free(data);
+    free_buffer(&buf);
     return status;
 }
 
@@ -281,78 +632,621 @@ static enum image_status load_from_stream(struct image* img, int fd)
  * Load image from stdout printed by external command.
  * @param img destination image
  * @param cmd execution command to get stdout data
+ * @param hint size hint for decoders, 0 for full size image
  * @return loader status
  */
-static enum image_status load_from_exec(struct image* img, const char* cmd)
+static enum image_status load_from_exec(struct image* img, const char* cmd,
+                                        size_t hint)
 {
-    uint8_t* data = NULL;
-    size_t data_sz = 0;
     enum image_status status;
-    int rc;
+    pid_t pid;
+    int fd;
+
+    fd = shellcmd_start(cmd, &pid);
+    if (fd == -1) {
+        return imgload_ioerror;
+    }
 
-    rc = shellcmd_exec(cmd, &data, &data_sz);
+    status = load_from_stream(img, fd, hint);
 
-    if (rc == 0 && data) {
-        status = load_from_memory(img, data, data_sz);
-    } else {
+    if (shellcmd_finish(fd, pid) != 0) {
+        // command failed, its output is not an image
+        if (status == imgload_success) {
+            image_free(img, IMGFREE_FRAMES);
+        }
         status = imgload_ioerror;
     }
 
-    free(data);
-
     return status;
 }
 
+/**
+ * Get interned copy of the directory name.
+ * Names are never freed: there are few of them comparing to images.
+ * @param name directory name (not null-terminated)
+ * @param len length of the name
+ * @return pointer to the shared name or NULL on errors
+ */
+static const char* intern_dir(const char* name, size_t len)
+{
+    const char* interned = NULL;
+    size_t idx;
+
+    pthread_mutex_lock(&dir_names.lock);
+
+    // grow the table to keep load factor under 1/2
+    if (dir_names.num * 2 >= dir_names.size) {
+        const size_t size =
+            dir_names.size ? dir_names.size * 2 : DIR_NAMES_MIN;
+        char** table = calloc(size, sizeof(*table));
+        if (!table) {
+            goto done;
+        }
+        for (size_t i = 0; i < dir_names.size; ++i) {
+            char* it = dir_names.table[i];
+            if (it) {
+                idx = str_hash(it, strlen(it), STR_HASH_INIT) & (size - 1);
+                while (table[idx]) {
+                    idx = (idx + 1) & (size - 1);
+                }
+                table[idx] = it;
+            }
+        }
+        free(dir_names.table);
+        dir_names.table = table;
+        dir_names.size = size;
+    }
+
+    idx = str_hash(name, len, STR_HASH_INIT) & (dir_names.size - 1);
+    while (dir_names.table[idx]) {
+        const char* it = dir_names.table[idx];
+        if (strncmp(it, name, len) == 0 && it[len] == 0) {
+            interned = it;
+            goto done;
+        }
+        idx = (idx + 1) & (dir_names.size - 1);
+    }
+
+    // add new name
+    dir_names.table[idx] = strndup(name, len);
+    if (dir_names.table[idx]) {
+        interned = dir_names.table[idx];
+        ++dir_names.num;
+    }
+
+done:
+    pthread_mutex_unlock(&dir_names.lock);
+    return interned;
+}
+
+/**
+ * Set name and parent directory of the loaded image.
+ * @param img image context
+ */
+static void set_names(struct image* img)
+{
+    if (strcmp(img->source, LDRSRC_STDIN) == 0 ||
+        strncmp(img->source, LDRSRC_EXEC, LDRSRC_EXEC_LEN) == 0) {
+        img->name = img->source;
+        img->parent_dir = "";
+    } else {
+        // set name
+        if (!img->name) {
+            size_t pos = strlen(img->source) - 1;
+            while (pos && img->source[--pos] != '/') { }
+            img->name = img->source + pos + (img->source[pos] == '/' ? 1 : 0);
+        }
+        // set parent dir
+        if (!img->parent_dir) {
+            size_t pos = strlen(img->source) - 1;
+            while (pos && img->source[--pos] != '/') { }
+            if (pos == 0) {
+                img->parent_dir = "";
+            } else {
+                const size_t end = pos;
+                while (pos && img->source[--pos] != '/') { }
+                if (img->source[pos] == '/') {
+                    ++pos;
+                }
+                img->parent_dir = intern_dir(img->source + pos, end - pos);
+            }
+        }
+    }
+}
+
 enum image_status image_load(struct image* img)
 {
+    return image_load_sized(img, 0);
+}
+
+/**
+ * Load image in the current process.
+ * @param img image context
+ * @param hint size hint for decoders, 0 for full size image
+ * @return loader status
+ */
+static enum image_status load_image(struct image* img, size_t hint)
+{
+    if (strcmp(img->source, LDRSRC_STDIN) == 0) {
+        return load_from_stream(img, STDIN_FILENO, hint);
+    }
+    if (strncmp(img->source, LDRSRC_EXEC, LDRSRC_EXEC_LEN) == 0) {
+        return load_from_exec(img, img->source + LDRSRC_EXEC_LEN, hint);
+    }
+    return load_from_file(img, img->source, load_from_memory, hint);
+}
+
+/**
+ * Child process of isolated decoding: load image and write it to the file.
+ * @param img image context
+ * @param hint size hint for decoders, 0 for full size image
+ * @param fd output file descriptor
+ * @return false on errors
+ */
+static bool isolated_child(struct image* img, size_t hint, int fd)
+{
+    struct isolate_header hdr = { 0 };
+    bool rc;
+
+    // handlers and flags of the parent are not valid here, threads of the
+    // pool are not inherited
+    img->progress = NULL;
+    img->cancel = NULL;
+    decoder_threads = 1;
+
+    hdr.status = load_image(img, hint);
+    if (hdr.status == imgload_success) {
+        // lazy frames can not be transferred, decode all of them
+        for (size_t i = 0; img->anim && i < img->num_frames; ++i) {
+            if (!img->frames[i].pm.data && !img->anim->decode(img, i)) {
+                hdr.num_frames = i;
+                break;
+            }
+            hdr.num_frames = i + 1;
+        }
+        if (!img->anim) {
+            hdr.num_frames = img->num_frames;
+        }
+        hdr.alpha = img->alpha;
+        hdr.reduced = img->reduced;
+        hdr.format = img->format ? strlen(img->format) + 1 : 0;
+        hdr.info = img->info ? list_size(&img->info->list) : 0;
+        hdr.exif = img->exif_size;
+        hdr.raw_size = img->file_raw ? img->file_size : 0;
+        hdr.file_size = img->file_size;
+        hdr.file_time = img->file_time;
+    }
+
+    rc = fs_write(fd, &hdr, sizeof(hdr));
+    for (size_t i = 0; rc && i < hdr.num_frames; ++i) {
+        const struct image_frame* frame = &img->frames[i];
+        const struct isolate_frame fhdr = {
+            .width = frame->pm.width,
+            .height = frame->pm.height,
+            .duration = frame->duration,
+        };
+        rc = fs_write(fd, &fhdr, sizeof(fhdr)) &&
+            fs_write(fd, frame->pm.data,
+                      fhdr.width * fhdr.height * sizeof(argb_t));
+    }
+    if (rc && hdr.format) {
+        rc = fs_write(fd, img->format, hdr.format);
+    }
+    list_for_each(img->info, const struct image_info, it) {
+        if (rc) {
+            rc = fs_write(fd, it->key, strlen(it->key) + 1) &&
+                fs_write(fd, it->value, strlen(it->value) + 1);
+        }
+    }
+    if (rc && hdr.exif) {
+        rc = fs_write(fd, img->exif, hdr.exif);
+    }
+    if (rc && hdr.raw_size) {
+        rc = fs_write(fd, img->file_raw, hdr.raw_size);
+    }
+
+    return rc;
+}
+
+/**
+ * Read image decoded by the child process.
+ * @param img image context
+ * @param data data written by the child process
+ * @param size size of data in bytes
+ * @return loader status
+ */
+static enum image_status isolated_read(struct image* img, const uint8_t* data,
+                                       size_t size)
+{
+    const uint8_t* end = data + size;
+    const uint8_t* ptr = data + sizeof(struct isolate_header);
+    struct isolate_header hdr;
+
+    if (size < sizeof(hdr)) {
+        return imgload_fmterror;
+    }
+    memcpy(&hdr, data, sizeof(hdr));
+    if (hdr.status != imgload_success) {
+        return hdr.status;
+    }
+    if (!hdr.num_frames || !image_alloc_frames(img, hdr.num_frames)) {
+        return imgload_fmterror;
+    }
+
+    for (size_t i = 0; i < hdr.num_frames; ++i) {
+        struct image_frame* frame = &img->frames[i];
+        struct isolate_frame fhdr;
+        size_t pixels;
+
+        if ((size_t)(end - ptr) < sizeof(fhdr)) {
+            goto fail;
+        }
+        memcpy(&fhdr, ptr, sizeof(fhdr));
+        ptr += sizeof(fhdr);
+        pixels = fhdr.width * fhdr.height * sizeof(argb_t);
+        if ((size_t)(end - ptr) < pixels ||
+            !pixmap_create(&frame->pm, fhdr.width, fhdr.height)) {
+            goto fail;
+        }
+        memcpy(frame->pm.data, ptr, pixels);
+        frame->duration = fhdr.duration;
+        ptr += pixels;
+    }
+
+    if (hdr.format) {
+        const char* format = fs_read_str(&ptr, end);
+        if (!format) {
+            goto fail;
+        }
+        image_set_format(img, "%s", format);
+    }
+    for (size_t i = 0; i < hdr.info; ++i) {
+        const char* key = fs_read_str(&ptr, end);
+        const char* value = key ? fs_read_str(&ptr, end) : NULL;
+        if (!value) {
+            goto fail;
+        }
+        image_add_meta(img, key, "%s", value);
+    }
+    if (hdr.exif) {
+        if ((size_t)(end - ptr) < hdr.exif) {
+            goto fail;
+        }
+        free(img->exif);
+        img->exif = malloc(hdr.exif);
+        if (img->exif) {
+            memcpy(img->exif, ptr, hdr.exif);
+            img->exif_size = hdr.exif;
+        }
+        ptr += hdr.exif;
+    }
+    if (hdr.raw_size) {
+        if ((size_t)(end - ptr) < hdr.raw_size) {
+            goto fail;
+        }
+        if (img->file_raw) {
+            memstat_free(memstat_raw, img->file_size);
+            free(img->file_raw);
+        }
+        img->file_raw = malloc(hdr.raw_size);
+        if (img->file_raw) {
+            memcpy(img->file_raw, ptr, hdr.raw_size);
+            memstat_alloc(memstat_raw, hdr.raw_size);
+        }
+    }
+
+    img->alpha = hdr.alpha;
+    img->reduced = hdr.reduced;
+    img->file_size = hdr.file_size;
+    img->file_time = hdr.file_time;
+
+    return imgload_success;
+
+fail:
+    image_free(img, IMGFREE_FRAMES);
+    return imgload_fmterror;
+}
+
+/**
+ * Wait for the child process, kill it on timeout or cancellation.
+ * @param img image context
+ * @param pid child process id
+ * @param fd read end of the pipe closed by the child on exit
+ * @return true if the child process exited normally
+ */
+static bool isolated_wait(const struct image* img, pid_t pid, int fd)
+{
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    struct timespec start, now;
+    bool killed = false;
+    bool exited = false;
+    int status = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // poll with a short timeout: cancellation and the timeout are checked
+    // between polls, the child can exit without closing the pipe if it
+    // was inherited by someone else
+    while (poll(&pfd, 1, ISOLATE_POLL_MS) != 1 || !(pfd.revents & POLLHUP)) {
+        if (waitpid(pid, &status, WNOHANG) == pid) {
+            exited = true;
+            break;
+        }
+        if (image_load_cancelled(img)) {
+            killed = true;
+            break;
+        }
+        if (isolate_timeout) {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            if ((size_t)(now.tv_sec - start.tv_sec) >= isolate_timeout) {
+                fprintf(stderr, "Decoding timeout for %s\n", img->source);
+                killed = true;
+                break;
+            }
+        }
+    }
+
+    if (killed) {
+        kill(pid, SIGKILL);
+    }
+    // the child has closed the pipe on exit or has been killed
+    while (!exited && waitpid(pid, &status, 0) == -1 && errno == EINTR) { }
+
+    if (!killed && WIFSIGNALED(status)) {
+        fprintf(stderr, "Decoder crashed on %s: signal %d\n", img->source,
+                WTERMSIG(status));
+    }
+
+    return !killed && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/**
+ * Close descriptors in the range.
+ * @param first first descriptor to close
+ * @param last last descriptor to close
+ */
+static void close_fd_range(unsigned int first, unsigned int last)
+{
+    long max;
+
+    if (first > last) {
+        return;
+    }
+#ifdef SYS_close_range
+    if (syscall(SYS_close_range, first, last, 0) == 0) {
+        return;
+    }
+#endif
+    max = sysconf(_SC_OPEN_MAX);
+    for (unsigned int fd = first; fd <= last && (long)fd < max; ++fd) {
+        close(fd);
+    }
+}
+
+/**
+ * Close all descriptors except stdio and the specified ones.
+ * @param keep1,keep2 descriptors to keep open
+ */
+static void close_fds(int keep1, int keep2)
+{
+    const unsigned int lo = keep1 < keep2 ? keep1 : keep2;
+    const unsigned int hi = keep1 < keep2 ? keep2 : keep1;
+
+    close_fd_range(STDERR_FILENO + 1, lo - 1);
+    close_fd_range(lo + 1, hi - 1);
+    close_fd_range(hi + 1, ~0U);
+}
+
+/**
+ * Load image in the child process: crashes and hangs of decoders don't
+ * affect the main process.
+ * @param img image context
+ * @param hint size hint for decoders, 0 for full size image
+ * @return loader status
+ */
+static enum image_status load_isolated(struct image* img, size_t hint)
+{
+    enum image_status status = imgload_fmterror;
+    int pipe_fd[2];
+    struct stat st;
+    int fd;
+    pid_t pid;
+
+    // shared file for the decoded image
+    fd = create_shm();
+    if (fd == -1) {
+        return load_image(img, hint);
+    }
+
+    // don't pass the pipe to programs executed by the child (exec source)
+    if (pipe2(pipe_fd, O_CLOEXEC) == -1) {
+        close(fd);
+        return load_image(img, hint);
+    }
+
+    // The process is multithreaded, so the child inherits only the calling
+    // thread and locks (e.g. malloc arenas) that could be held by other
+    // threads at the moment of fork. Decoders can't avoid memory allocation,
+    // so a child stuck on such a lock is handled as a hang: killed on timeout.
+    pid = fork();
+    if (pid == -1) {
+        close(pipe_fd[0]);
+        close(pipe_fd[1]);
+        close(fd);
+        return load_image(img, hint);
+    }
+    if (pid == 0) {
+        // child process: keep only stdio, the output file and the pipe,
+        // descriptors of the parent (including pipes of other children)
+        // must not outlive it
+        close_fds(fd, pipe_fd[1]);
+        _exit(isolated_child(img, hint, fd) ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    close(pipe_fd[1]);
+    if (isolated_wait(img, pid, pipe_fd[0]) && fstat(fd, &st) == 0 &&
+        st.st_size > 0) {
+        void* data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (data != MAP_FAILED) {
+            status = isolated_read(img, data, st.st_size);
+            munmap(data, st.st_size);
+        }
+    }
+    close(pipe_fd[0]);
+    close(fd);
+
+    return status;
+}
+
+void image_prefetch(const char* source)
+{
+    int fd;
+
+    if (strcmp(source, LDRSRC_STDIN) == 0 ||
+        strncmp(source, LDRSRC_EXEC, LDRSRC_EXEC_LEN) == 0) {
+        return;
+    }
+
+    fd = open(source, O_RDONLY | O_NONBLOCK);
+    if (fd != -1) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+        close(fd);
+    }
+}
+
+void image_set_isolation(bool enable, size_t timeout)
+{
+    isolate = enable;
+    isolate_timeout = timeout;
+}
+
+enum image_status image_load_sized(struct image* img, size_t hint)
+{
+    TRACE_SCOPE("image_load");
     enum image_status status;
+    struct timespec start, end;
 
     image_free(img, IMGFREE_FRAMES | IMGFREE_THUMB);
+    img->reduced = false;
 
-    // decode image
-    if (strcmp(img->source, LDRSRC_STDIN) == 0) {
-        status = load_from_stream(img, STDIN_FILENO);
-    } else if (strncmp(img->source, LDRSRC_EXEC, LDRSRC_EXEC_LEN) == 0) {
-        status = load_from_exec(img, img->source + LDRSRC_EXEC_LEN);
-    } else {
-        status = load_from_file(img, img->source);
+    // full size image decoded earlier
+    if (hint == 0 && fcache_load(img)) {
+        set_names(img);
+        return imgload_success;
     }
 
+    // decode image
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    status = isolate ? load_isolated(img, hint) : load_image(img, hint);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
     if (status == imgload_success) {
-        // set name and parent dir
-        if (strcmp(img->source, LDRSRC_STDIN) == 0 ||
-            strncmp(img->source, LDRSRC_EXEC, LDRSRC_EXEC_LEN) == 0) {
-            img->name = img->source;
-            str_dup("", &img->parent_dir);
-        } else {
-            // set name
-            if (!img->name) {
-                size_t pos = strlen(img->source) - 1;
-                while (pos && img->source[--pos] != '/') { }
-                img->name =
-                    img->source + pos + (img->source[pos] == '/' ? 1 : 0);
-            }
-            // set parent dir
-            if (!img->parent_dir) {
-                size_t pos = strlen(img->source) - 1;
-                while (pos && img->source[--pos] != '/') { }
-                if (pos == 0) {
-                    str_dup("", &img->parent_dir);
-                } else {
-                    const size_t end = pos;
-                    while (pos && img->source[--pos] != '/') { }
-                    if (img->source[pos] == '/') {
-                        ++pos;
-                    }
-                    str_append(img->source + pos, end - pos, &img->parent_dir);
-                }
-            }
+        set_names(img);
+        if (hint == 0) {
+            fcache_save(img, (end.tv_sec - start.tv_sec) * 1000.0 +
+                             (end.tv_nsec - start.tv_nsec) / 1000000.0);
         }
     }
 
     return status;
 }
 
+void image_set_limit(size_t limit)
+{
+    frame_limit = limit;
+}
+
+void image_set_threads(size_t num)
+{
+    decoder_threads = num;
+}
+
+void image_set_raw_mode(enum raw_mode mode)
+{
+    raw_mode = mode;
+}
+
+enum image_status image_load_preview(struct image* img, size_t size)
+{
+    TRACE_SCOPE("image_load_preview");
+    enum image_status status;
+
+    if (!preview_decoder || strcmp(img->source, LDRSRC_STDIN) == 0 ||
+        strncmp(img->source, LDRSRC_EXEC, LDRSRC_EXEC_LEN) == 0) {
+        return imgload_unsupported;
+    }
+
+    image_free(img, IMGFREE_FRAMES | IMGFREE_THUMB);
+
+    status = load_from_file(img, img->source, preview_decoder, size);
+    if (status == imgload_success) {
+        set_names(img);
+    }
+
+    return status;
+}
+
+void image_load_meta(struct image* img)
+{
+#ifdef HAVE_LIBEXIF
+    exif_meta(img);
+#else
+    (void)img;
+#endif
+}
+
+size_t image_stream_read(struct image_stream* stream, uint8_t* buf,
+                         size_t size)
+{
+    struct stream_buffer* sb = stream->buffer;
+    size_t total;
+
+    // read new data to the stream buffer, then pass it to the decoder
+    while (sb->size < stream->position + size) {
+        ssize_t rc;
+        if (sb->size == sb->capacity && !grow_buffer(sb)) {
+            break;
+        }
+        rc = read_data(stream->fd, sb->data + sb->size,
+                       min(sb->capacity, stream->position + size) - sb->size);
+        if (rc <= 0) {
+            break;
+        }
+        sb->size += rc;
+    }
+    stream->head = sb->data; // buffer can be remapped on growth
+
+    total = sb->size > stream->position ? sb->size - stream->position : 0;
+    total = min(total, size);
+    memcpy(buf, sb->data + stream->position, total);
+    stream->position += total;
+
+    return total;
+}
+
+bool image_load_cancelled(const struct image* img)
+{
+    return img->cancel && *img->cancel;
+}
+
+size_t image_load_threads(void)
+{
+    const size_t pool = tpool_threads();
+    return decoder_threads && decoder_threads < pool ? decoder_threads : pool;
+}
+
+enum raw_mode image_load_raw_mode(const struct image* img)
+{
+    return img->full ? raw_full : raw_mode;
+}
+
+void image_load_progress(const struct image* img)
+{
+    if (img->progress) {
+        img->progress(img);
+    }
+}
+
 void image_set_format(struct image* img, const char* fmt, ...)
 {
     va_list args;
@@ -367,7 +1261,7 @@ void image_set_format(struct image* img, const char* fmt, ...)
         return;
     }
     ++len; // last null
-    buffer = realloc(img->format, len);
+    buffer = image_arena_alloc(img, len);
     if (!buffer) {
         return;
     }
@@ -395,12 +1289,13 @@ void image_add_meta(struct image* img, const char* key, const char* fmt, ...)
 
     // allocate new entry
     len += sizeof(struct image_info) + key_len + 1 /* last null of value */;
-    entry = calloc(1, len);
+    entry = image_arena_alloc(img, len);
     if (!entry) {
         return;
     }
 
     // fill entry
+    memset(entry, 0, sizeof(*entry));
     entry->key = (char*)entry + sizeof(struct image_info);
     memcpy(entry->key, key, key_len);
     entry->value = entry->key + key_len;
@@ -426,6 +1321,35 @@ struct pixmap* image_alloc_frame(struct image* img, size_t width, size_t height)
     return pm;
 }
 
+struct pixmap* image_map_frame(struct image* img, const uint8_t* pixels,
+                               size_t width, size_t height)
+{
+    const struct source_file* file = img->mapped;
+    const size_t size = width * height * sizeof(argb_t);
+    struct pixmap* pm = NULL;
+    size_t offset;
+
+    // only large frames are worth mapping: the file can be modified while
+    // the image is displayed
+    if (!file || size < MAP_FRAME_MIN_SIZE || pixels < file->data) {
+        return NULL;
+    }
+    offset = pixels - file->data;
+    if (offset + size > file->size) {
+        return NULL;
+    }
+
+    if (image_alloc_frames(img, 1)) {
+        pm = &img->frames[0].pm;
+        if (!pixmap_map(pm, file->fd, offset, width, height)) {
+            image_free(img, IMGFREE_FRAMES);
+            pm = NULL;
+        }
+    }
+
+    return pm;
+}
+
 bool image_alloc_frames(struct image* img, size_t num)
 {
     struct image_frame* frames;
@@ -440,3 +1364,123 @@ bool image_alloc_frames(struct image* img, size_t num)
 
     return frames;
 }
+
+size_t image_load_scale(size_t width, size_t height)
+{
+    const size_t max_side = max(width, height);
+    size_t scale = 1;
+
+    // get the minimal downscale factor to fit into the memory limit
+    while (frame_limit && scale < max_side &&
+           ((width + scale - 1) / scale) * ((height + scale - 1) / scale) *
+                   sizeof(argb_t) >
+               frame_limit) {
+        ++scale;
+    }
+
+    return scale;
+}
+
+struct pixmap* image_alloc_bands(struct image* img, struct image_band* band,
+                                 size_t width, size_t height, size_t rows)
+{
+    const size_t scale = image_load_scale(width, height);
+    size_t a, b;
+
+    memset(band, 0, sizeof(*band));
+
+    band->frame = image_alloc_frame(img, (width + scale - 1) / scale,
+                                    (height + scale - 1) / scale);
+    if (!band->frame) {
+        return NULL;
+    }
+
+    band->height = height;
+    band->scale = scale;
+    band->pm.width = width;
+
+    if (!rows || rows > height) {
+        rows = height;
+    }
+    if (scale == 1) {
+        // decode directly into the frame
+        band->rows = rows;
+        return band->frame;
+    }
+
+    // number of rows must be a multiple of the scale factor too
+    a = rows;
+    b = scale;
+    while (b) {
+        const size_t r = a % b;
+        a = b;
+        b = r;
+    }
+    band->rows = min(rows / a * scale, (height + scale - 1) / scale * scale);
+
+    band->pm.data = malloc(width * band->rows * sizeof(argb_t));
+    if (!band->pm.data) {
+        image_free(img, IMGFREE_FRAMES);
+        band->frame = NULL;
+        return NULL;
+    }
+
+    image_add_meta(img, "Downscaled", "1:%zu", scale);
+
+    return band->frame;
+}
+
+struct pixmap* image_band_get(struct image_band* band, size_t y)
+{
+    band->y = y;
+    band->pm.height = min(band->rows, band->height - y);
+    if (band->scale == 1) {
+        band->pm.data = &band->frame->data[y * band->frame->width];
+    }
+    return &band->pm;
+}
+
+void image_band_put(struct image_band* band)
+{
+    const struct pixmap* src = &band->pm;
+    struct pixmap* dst = band->frame;
+    const size_t scale = band->scale;
+
+    if (scale == 1) {
+        return; // already in the frame
+    }
+
+    // box filter: average of scale*scale source pixels
+    for (size_t y = 0; y < src->height; y += scale) {
+        const size_t rows = min(scale, src->height - y);
+        argb_t* dst_line = &dst->data[((band->y + y) / scale) * dst->width];
+
+        for (size_t x = 0; x < dst->width; ++x) {
+            const size_t src_x = x * scale;
+            const size_t cols = min(scale, src->width - src_x);
+            const size_t num = rows * cols;
+            size_t a = 0, r = 0, g = 0, b = 0;
+
+            for (size_t sy = 0; sy < rows; ++sy) {
+                const argb_t* pixel =
+                    &src->data[(y + sy) * src->width + src_x];
+                for (size_t sx = 0; sx < cols; ++sx) {
+                    a += ARGB_GET_A(pixel[sx]);
+                    r += ARGB_GET_R(pixel[sx]);
+                    g += ARGB_GET_G(pixel[sx]);
+                    b += ARGB_GET_B(pixel[sx]);
+                }
+            }
+
+            dst_line[x] = ARGB(a / num, r / num, g / num, b / num);
+        }
+    }
+}
+
+void image_band_free(struct image_band* band)
+{
+    if (band->scale > 1) {
+        free(band->pm.data);
+    }
+    band->pm.data = NULL;
+}
@@ -11,10 +11,77 @@
  * @param img target image instance
  * @param data raw image data
  * @param size size of image data in bytes
+ * @param hint size hint in pixels: the decoder may produce a downscaled image
+ *             (e.g. to create thumbnail), if both its width and height are
+ *             not less than the hint; 0 to decode full size image
  * @return loader status
  */
 typedef enum image_status (*image_decoder)(struct image* img,
-                                           const uint8_t* data, size_t size);
+                                           const uint8_t* data, size_t size,
+                                           size_t hint);
+
+struct stream_buffer;
+
+/** Input stream for incremental decoders. */
+struct image_stream {
+    int fd;              ///< Source file descriptor
+    const uint8_t* head; ///< Data already read from the stream (signature)
+    size_t head_size;    ///< Size of the head data
+    size_t position;     ///< Number of bytes consumed by decoder
+    struct stream_buffer* buffer; ///< All data read from the stream
+};
+
+/**
+ * Incremental loader function prototype: decode image while its data is
+ * being read from the stream (pipe).
+ * @param img target image instance
+ * @param stream input stream
+ * @param hint size hint in pixels, see image_decoder
+ * @return loader status
+ */
+typedef enum image_status (*image_stream_decoder)(struct image* img,
+                                                  struct image_stream* stream,
+                                                  size_t hint);
+
+/**
+ * Read data from the stream, blocks until the buffer is filled.
+ * @param stream input stream
+ * @param buf output buffer
+ * @param size number of bytes to read
+ * @return number of bytes read, less than size at the end of stream
+ */
+size_t image_stream_read(struct image_stream* stream, uint8_t* buf,
+                         size_t size);
+
+/**
+ * Check if loading of the image was cancelled, long running decoders should
+ * check it periodically and stop decoding.
+ * @param img image context
+ * @return true if decoding should be stopped
+ */
+bool image_load_cancelled(const struct image* img);
+
+/**
+ * Get number of threads that the decoder can use to load single image.
+ * Decoders with own threading should limit it to this number.
+ * @return number of threads, at least 1
+ */
+size_t image_load_threads(void);
+
+/**
+ * Get decoding mode of RAW images for the image being loaded.
+ * @param img image context
+ * @return decoding mode
+ */
+enum raw_mode image_load_raw_mode(const struct image* img);
+
+/**
+ * Notify about progressive decoding: the first frame contains a coarse
+ * approximation of the image. Decoders should check `img->progress` before
+ * switching to a slower multi-pass decoding.
+ * @param img image context
+ */
+void image_load_progress(const struct image* img);
 
 /**
  * Set image format description.
@@ -42,6 +109,69 @@ void image_add_meta(struct image* img, const char* key, const char* fmt, ...)
 struct pixmap* image_alloc_frame(struct image* img, size_t width,
                                  size_t height);
 
+/**
+ * Create single frame that references pixels of the source file directly,
+ * without decoding. Pixels must be in ARGB format, top-down rows without
+ * padding. Only large frames of images loaded from regular files are mapped.
+ * @param img image context
+ * @param pixels pointer to the first pixel in the image data
+ * @param width,height frame size in px
+ * @return pointer to the pixmap associated with the frame, or NULL if the
+ *         frame can't be mapped and should be decoded as usual
+ */
+struct pixmap* image_map_frame(struct image* img, const uint8_t* pixels,
+                               size_t width, size_t height);
+
+/**
+ * Get downscale factor required to fit the frame into the memory limit.
+ * @param width,height full size of the image in px
+ * @return downscale factor, 1 if the image fits the limit
+ */
+size_t image_load_scale(size_t width, size_t height);
+
+/** Band of the image rows: frames exceeding the memory limit are decoded by
+ *  bands of full size rows, which are downscaled to the frame. */
+struct image_band {
+    struct pixmap pm;     ///< Band pixels: rows of the full size image
+    struct pixmap* frame; ///< Destination frame
+    size_t height;        ///< Height of the full size image
+    size_t rows;          ///< Max number of rows in the band
+    size_t scale;         ///< Downscale factor, 1 for full size frame
+    size_t y;             ///< Full size image row of the band start
+};
+
+/**
+ * Create single frame decoded by bands, the frame is downscaled if the full
+ * size image exceeds the memory limit (see `image_set_limit`).
+ * @param img image context
+ * @param band band description to initialize
+ * @param width,height full size of the image in px
+ * @param rows preferred number of rows in a band (e.g. strip height)
+ * @return pointer to the pixmap associated with the frame, or NULL on errors
+ */
+struct pixmap* image_alloc_bands(struct image* img, struct image_band* band,
+                                 size_t width, size_t height, size_t rows);
+
+/**
+ * Get the band to decode rows into.
+ * @param band image band
+ * @param y full size image row of the band start, multiple of `band->rows`
+ * @return band pixmap to fill
+ */
+struct pixmap* image_band_get(struct image_band* band, size_t y);
+
+/**
+ * Put decoded band to the frame.
+ * @param band image band
+ */
+void image_band_put(struct image_band* band);
+
+/**
+ * Free band resources.
+ * @param band image band
+ */
+void image_band_free(struct image_band* band);
+
 /**
  * Create list of empty frames.
  * @param img image context
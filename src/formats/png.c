@@ -9,6 +9,9 @@
 #include <stdlib.h>
 #include <string.h>
 
+// Number of rows decoded at once by non-interlaced decoder
+#define BAND_ROWS 64
+
 // PNG memory reader
 struct mem_reader {
     const uint8_t* data;
@@ -28,6 +31,15 @@ static void png_reader(png_structp png, png_bytep buffer, size_t size)
     }
 }
 
+// PNG stream reader callback, see `png_rw_ptr` in png.h
+static void png_stream_reader(png_structp png, png_bytep buffer, size_t size)
+{
+    struct image_stream* stream = (struct image_stream*)png_get_io_ptr(png);
+    if (!stream || image_stream_read(stream, buffer, size) != size) {
+        png_error(png, "No data in PNG stream");
+    }
+}
+
 /**
  * Bind pixmap with PNG line-reading decoder.
  * @param pm pixmap to bind
@@ -47,16 +59,19 @@ static png_bytep* bind_pixmap(const struct pixmap* pm)
 }
 
 /**
- * Decode single framed image.
+ * Decode interlaced image, the coarse approximation is shown after each
+ * of the interlacing passes if progressive decoding is requested.
  * @param img image context
  * @param png png decoder
  * @param info png image info
  * @return false if decode failed
  */
-static bool decode_single(struct image* img, png_struct* png, png_info* info)
+static bool decode_interlaced(struct image* img, png_struct* png,
+                              png_info* info)
 {
     const uint32_t width = png_get_image_width(png, info);
     const uint32_t height = png_get_image_height(png, info);
+    const int passes = png_set_interlace_handling(png);
     struct pixmap* pm = image_alloc_frame(img, width, height);
     png_bytep* bind;
 
@@ -74,9 +89,79 @@ static bool decode_single(struct image* img, png_struct* png, png_info* info)
         return false;
     }
 
-    png_read_image(png, bind);
+    if (img->progress) {
+        // "rectangle" mode: pixels of each pass are replicated to fill the
+        // whole image, so it can be displayed before decoding is completed
+        for (int pass = 0; pass < passes; ++pass) {
+            if (image_load_cancelled(img)) {
+                free(bind);
+                return false;
+            }
+            png_read_rows(png, NULL, bind, height);
+            if (pass + 1 < passes) {
+                image_load_progress(img);
+            }
+        }
+    } else {
+        png_read_image(png, bind);
+    }
+
+    free(bind);
+
+    return true;
+}
+
+/**
+ * Decode single framed image: rows are read by bands, so huge images are
+ * downscaled on the fly.
+ * @param img image context
+ * @param png png decoder
+ * @param info png image info
+ * @return false if decode failed
+ */
+static bool decode_single(struct image* img, png_struct* png, png_info* info)
+{
+    const uint32_t width = png_get_image_width(png, info);
+    const uint32_t height = png_get_image_height(png, info);
+    struct image_band band;
+    png_bytep* bind;
+
+    if (png_get_interlace_type(png, info) != PNG_INTERLACE_NONE) {
+        return decode_interlaced(img, png, info);
+    }
+
+    if (!image_alloc_bands(img, &band, width, height, BAND_ROWS)) {
+        return false;
+    }
+
+    bind = malloc(band.rows * sizeof(*bind));
+    if (!bind) {
+        image_band_free(&band);
+        return false;
+    }
+
+    if (setjmp(png_jmpbuf(png))) {
+        free(bind);
+        image_band_free(&band);
+        return false;
+    }
+
+    for (size_t y = 0; y < height; y += band.rows) {
+        const struct pixmap* pm = image_band_get(&band, y);
+        if (image_load_cancelled(img)) {
+            free(bind);
+            image_band_free(&band);
+            return false;
+        }
+        for (size_t i = 0; i < pm->height; ++i) {
+            bind[i] = (png_bytep)&pm->data[i * pm->width];
+        }
+        png_read_rows(png, bind, NULL, pm->height);
+        image_band_put(&band);
+    }
 
     free(bind);
+    image_band_free(&band);
 
     return true;
 }
@@ -226,26 +311,21 @@ static bool decode_multiple(struct image* img, png_struct* png, png_info* info)
 }
 #endif // PNG_APNG_SUPPORTED
 
-// PNG loader implementation
-enum image_status decode_png(struct image* img, const uint8_t* data,
-                             size_t size)
+/**
+ * Decode PNG image.
+ * @param img image context
+ * @param io reader context
+ * @param read_fn reader callback
+ * @return loader status
+ */
+static enum image_status decode(struct image* img, void* io,
+                                png_rw_ptr read_fn)
 {
     png_struct* png = NULL;
     png_info* info = NULL;
     png_byte color_type, bit_depth;
     bool rc;
 
-    struct mem_reader reader = {
-        .data = data,
-        .size = size,
-        .position = 0,
-    };
-
-    // check signature
-    if (png_sig_cmp(data, 0, size) != 0) {
-        return imgload_unsupported;
-    }
-
     // create decoder
     png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
     if (!png) {
@@ -264,7 +344,7 @@ enum image_status decode_png(struct image* img, const uint8_t* data,
     }
 
     // get general image info
-    png_set_read_fn(png, &reader, &png_reader);
+    png_set_read_fn(png, io, read_fn);
     png_read_info(png, info);
     color_type = png_get_color_type(png, info);
     bit_depth = png_get_bit_depth(png, info);
@@ -332,6 +412,37 @@ enum image_status decode_png(struct image* img, const uint8_t* data,
     return rc ? imgload_success : imgload_fmterror;
 }
 
+// PNG loader implementation
+enum image_status decode_png(struct image* img, const uint8_t* data,
+                             size_t size, __attribute__((unused)) size_t hint)
+{
+    struct mem_reader reader = {
+        .data = data,
+        .size = size,
+        .position = 0,
+    };
+
+    // check signature
+    if (png_sig_cmp(data, 0, size) != 0) {
+        return imgload_unsupported;
+    }
+
+    return decode(img, &reader, &png_reader);
+}
+
+// PNG incremental loader implementation
+enum image_status decode_png_stream(struct image* img,
+                                    struct image_stream* stream,
+                                    __attribute__((unused)) size_t hint)
+{
+    // check signature
+    if (png_sig_cmp(stream->head, 0, stream->head_size) != 0) {
+        return imgload_unsupported;
+    }
+
+    return decode(img, stream, &png_stream_reader);
+}
+
 bool export_png(const struct pixmap* pm, const struct image_info* info,
                 const char* path)
 {
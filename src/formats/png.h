@@ -8,7 +8,11 @@
 
 // PNG decoder implementation
 enum image_status decode_png(struct image* img, const uint8_t* data,
-                             size_t size);
+                             size_t size, size_t hint);
+
+// PNG incremental decoder implementation
+enum image_status decode_png_stream(struct image* img,
+                                    struct image_stream* stream, size_t hint);
 
 /**
  * Export pixel map to PNG file.
@@ -221,7 +221,7 @@ static int decode_raw(struct pixmap* pm, struct pnm_iter* it,
 }
 
 enum image_status decode_pnm(struct image* img, const uint8_t* data,
-                             size_t size)
+                             size_t size, __attribute__((unused)) size_t hint)
 {
     struct pnm_iter it;
     bool plain;
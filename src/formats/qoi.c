@@ -1,10 +1,11 @@
 // SPDX-License-Identifier: MIT
-// QOI format decoder.
+// QOI format encoder/decoder.
 // Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
 
-#include "loader.h"
+#include "qoi.h"
 
 #include <arpa/inet.h>
+#include <stdlib.h>
 #include <string.h>
 
 // Chunk tags
@@ -24,8 +25,13 @@
 #define QOI_CLRMAP_INDEX(r, g, b, a) \
     ((r * 3 + g * 5 + b * 7 + a * 11) % QOI_CLRMAP_SIZE)
 
+// Max length of run chunk
+#define QOI_RUN_MAX 62
+
 // QOI signature
 static const uint8_t signature[] = { 'q', 'o', 'i', 'f' };
+// End of stream marker
+static const uint8_t end_marker[] = { 0, 0, 0, 0, 0, 0, 0, 1 };
 
 // QOI file header
 struct __attribute__((__packed__)) qoi_header {
@@ -36,35 +42,21 @@ struct __attribute__((__packed__)) qoi_header {
     uint8_t colorspace; // 0 = sRGB with linear alpha, 1 = all channels linear
 };
 
-// QOI loader implementation
-enum image_status decode_qoi(struct image* img, const uint8_t* data,
-                             size_t size)
+/**
+ * Decode QOI stream to the pixmap.
+ * @param data QOI data (header is not checked)
+ * @param size size of data in bytes
+ * @param pm destination pixmap with the size of the image
+ * @return false if the stream is broken
+ */
+static bool decode_pixels(const uint8_t* data, size_t size, struct pixmap* pm)
 {
-    const struct qoi_header* qoi = (const struct qoi_header*)data;
     argb_t color_map[QOI_CLRMAP_SIZE];
-    struct pixmap* pm;
     uint8_t a, r, g, b;
     size_t total_pixels;
     size_t rlen;
     size_t pos;
 
-    // check signature
-    if (size < sizeof(*qoi) ||
-        memcmp(qoi->magic, signature, sizeof(signature))) {
-        return imgload_unsupported;
-    }
-    // check format
-    if (qoi->width == 0 || qoi->height == 0 || qoi->channels < 3 ||
-        qoi->channels > 4) {
-        return imgload_fmterror;
-    }
-
-    // allocate image buffer
-    pm = image_alloc_frame(img, htonl(qoi->width), htonl(qoi->height));
-    if (!pm) {
-        return imgload_fmterror;
-    }
-
     // initialize decoder state
     r = 0;
     g = 0;
@@ -88,14 +80,14 @@ enum image_status decode_qoi(struct image* img, const uint8_t* data,
 
             if (tag == QOI_OP_RGB) {
                 if (pos + 3 >= size) {
-                    goto fail;
+                    return false;
                 }
                 r = data[pos++];
                 g = data[pos++];
                 b = data[pos++];
             } else if (tag == QOI_OP_RGBA) {
                 if (pos + 4 >= size) {
-                    goto fail;
+                    return false;
                 }
                 r = data[pos++];
                 g = data[pos++];
@@ -115,7 +107,7 @@ enum image_status decode_qoi(struct image* img, const uint8_t* data,
                 uint8_t diff;
                 int8_t diff_green;
                 if (pos + 1 >= size) {
-                    goto fail;
+                    return false;
                 }
                 diff = data[pos++];
                 diff_green = (int8_t)(tag & 0x3f) - 32;
@@ -130,11 +122,153 @@ enum image_status decode_qoi(struct image* img, const uint8_t* data,
         pm->data[i] = ARGB(a, r, g, b);
     }
 
+    return true;
+}
+
+/**
+ * Check QOI header.
+ * @param data QOI data
+ * @param size size of data in bytes
+ * @return image status
+ */
+static enum image_status check_header(const uint8_t* data, size_t size)
+{
+    const struct qoi_header* qoi = (const struct qoi_header*)data;
+
+    // check signature
+    if (size < sizeof(*qoi) ||
+        memcmp(qoi->magic, signature, sizeof(signature))) {
+        return imgload_unsupported;
+    }
+    // check format
+    if (qoi->width == 0 || qoi->height == 0 || qoi->channels < 3 ||
+        qoi->channels > 4) {
+        return imgload_fmterror;
+    }
+
+    return imgload_success;
+}
+
+// QOI loader implementation
+enum image_status decode_qoi(struct image* img, const uint8_t* data,
+                             size_t size, __attribute__((unused)) size_t hint)
+{
+    const struct qoi_header* qoi = (const struct qoi_header*)data;
+    const enum image_status status = check_header(data, size);
+    struct pixmap* pm;
+
+    if (status != imgload_success) {
+        return status;
+    }
+
+    // allocate image buffer
+    pm = image_alloc_frame(img, htonl(qoi->width), htonl(qoi->height));
+    if (!pm) {
+        return imgload_fmterror;
+    }
+
+    if (!decode_pixels(data, size, pm)) {
+        image_free(img, IMGFREE_FRAMES);
+        return imgload_fmterror;
+    }
+
     image_set_format(img, "QOI %dbpp", qoi->channels * 8);
     img->alpha = (qoi->channels == 4);
     return imgload_success;
+}
+
+bool decode_qoi_pixmap(const uint8_t* data, size_t size, struct pixmap* pm)
+{
+    const struct qoi_header* qoi = (const struct qoi_header*)data;
+    return check_header(data, size) == imgload_success &&
+        htonl(qoi->width) == pm->width && htonl(qoi->height) == pm->height &&
+        decode_pixels(data, size, pm);
+}
+
+uint8_t* encode_qoi(const struct pixmap* pm, bool alpha, size_t* size)
+{
+    const size_t total_pixels = pm->width * pm->height;
+    struct qoi_header* qoi;
+    argb_t color_map[QOI_CLRMAP_SIZE];
+    argb_t prev = ARGB(0xff, 0, 0, 0);
+    uint8_t* data;
+    size_t rlen = 0;
+    size_t pos;
+
+    // worst case: RGBA chunk for each pixel
+    data = malloc(sizeof(*qoi) + total_pixels * 5 + sizeof(end_marker));
+    if (!data) {
+        return NULL;
+    }
+
+    qoi = (struct qoi_header*)data;
+    memcpy(qoi->magic, signature, sizeof(signature));
+    qoi->width = htonl(pm->width);
+    qoi->height = htonl(pm->height);
+    qoi->channels = alpha ? 4 : 3;
+    qoi->colorspace = 0;
+    pos = sizeof(*qoi);
+
+    memset(color_map, 0, sizeof(color_map));
+
+    for (size_t i = 0; i < total_pixels; ++i) {
+        const argb_t clr = pm->data[i];
+        const uint8_t a = ARGB_GET_A(clr);
+        const uint8_t r = ARGB_GET_R(clr);
+        const uint8_t g = ARGB_GET_G(clr);
+        const uint8_t b = ARGB_GET_B(clr);
+        size_t index;
+
+        if (clr == prev) {
+            if (++rlen == QOI_RUN_MAX || i == total_pixels - 1) {
+                data[pos++] = QOI_OP_RUN | (rlen - 1);
+                rlen = 0;
+            }
+            continue;
+        }
+        if (rlen) {
+            data[pos++] = QOI_OP_RUN | (rlen - 1);
+            rlen = 0;
+        }
+
+        index = QOI_CLRMAP_INDEX(r, g, b, a);
+        if (color_map[index] == clr) {
+            data[pos++] = QOI_OP_INDEX | index;
+        } else if (a != ARGB_GET_A(prev)) {
+            data[pos++] = QOI_OP_RGBA;
+            data[pos++] = r;
+            data[pos++] = g;
+            data[pos++] = b;
+            data[pos++] = a;
+        } else {
+            const int8_t dr = r - ARGB_GET_R(prev);
+            const int8_t dg = g - ARGB_GET_G(prev);
+            const int8_t db = b - ARGB_GET_B(prev);
+            const int8_t dr_dg = dr - dg;
+            const int8_t db_dg = db - dg;
+            if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 &&
+                db <= 1) {
+                data[pos++] =
+                    QOI_OP_DIFF | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2);
+            } else if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 &&
+                       db_dg >= -8 && db_dg <= 7) {
+                data[pos++] = QOI_OP_LUMA | (dg + 32);
+                data[pos++] = (dr_dg + 8) << 4 | (db_dg + 8);
+            } else {
+                data[pos++] = QOI_OP_RGB;
+                data[pos++] = r;
+                data[pos++] = g;
+                data[pos++] = b;
+            }
+        }
+
+        color_map[index] = clr;
+        prev = clr;
+    }
+
+    memcpy(data + pos, end_marker, sizeof(end_marker));
+    pos += sizeof(end_marker);
 
-fail:
-    image_free(img, IMGFREE_FRAMES);
-    return imgload_fmterror;
+    *size = pos;
+    return data;
 }
@@ -0,0 +1,29 @@
+// SPDX-License-Identifier: MIT
+// QOI format encoder/decoder.
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+#pragma once
+
+#include "loader.h"
+
+// QOI decoder implementation
+enum image_status decode_qoi(struct image* img, const uint8_t* data,
+                             size_t size, size_t hint);
+
+/**
+ * Decode QOI data to the existing pixel map of the same size.
+ * @param data QOI data
+ * @param size size of data in bytes
+ * @param pm destination pixel map
+ * @return false if data is not QOI, size mismatch or the stream is broken
+ */
+bool decode_qoi_pixmap(const uint8_t* data, size_t size, struct pixmap* pm);
+
+/**
+ * Encode pixel map to QOI format.
+ * @param pm source pixel map
+ * @param alpha flag to mark image as having alpha channel (RGBA)
+ * @param size output: size of encoded data in bytes
+ * @return pointer to the encoded data (caller must free it), NULL on errors
+ */
+uint8_t* encode_qoi(const struct pixmap* pm, bool alpha, size_t* size);
@@ -1,8 +1,13 @@
 // SPDX-License-Identifier: MIT
 // Raw format decoder.
 
+#include "buildcfg.h"
 #include "loader.h"
 
+#ifdef HAVE_LIBJPEG
+#include "jpeg.h"
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -11,13 +16,111 @@
 #include <libraw.h>
 #pragma GCC diagnostic pop
 
+/**
+ * Progress handler: cancel processing if loading was cancelled.
+ * @param data image context
+ * @return non-zero to cancel processing
+ */
+static int on_progress(void* data,
+                       __attribute__((unused)) enum LibRaw_progress stage,
+                       __attribute__((unused)) int iteration,
+                       __attribute__((unused)) int expected)
+{
+    return image_load_cancelled(data) ? 1 : 0;
+}
+
+/**
+ * Create image frame from decoded bitmap.
+ * @param img image context
+ * @param bmp decoded bitmap
+ * @return false on errors
+ */
+static bool put_bitmap(struct image* img, const libraw_processed_image_t* bmp)
+{
+    size_t pos, end;
+
+    if (bmp->type != LIBRAW_IMAGE_BITMAP || bmp->colors != 3 ||
+        bmp->bits != 8) {
+        return false;
+    }
+
+    if (!image_alloc_frame(img, bmp->width, bmp->height)) {
+        return false;
+    }
+
+    pos = 0;
+    end = bmp->width * bmp->height;
+    while (pos < end) {
+        const uint8_t* src = &bmp->data[pos * 3];
+        argb_t* dst = &img->frames[0].pm.data[pos];
+        *dst = ARGB(0xff, src[0], src[1], src[2]);
+        ++pos;
+    }
+
+    return true;
+}
+
+/**
+ * Load embedded thumbnail instead of processing raw data.
+ * @param img image context
+ * @param decoder raw decoder instance
+ * @param hint minimal size of the image
+ * @return false if thumbnail doesn't exist, is too small, or on errors
+ */
+static bool decode_thumb(struct image* img, libraw_data_t* decoder,
+                         size_t hint)
+{
+    libraw_processed_image_t* thumb;
+    bool rc = false;
+
+    if (libraw_unpack_thumb(decoder) != LIBRAW_SUCCESS ||
+        decoder->thumbnail.twidth < hint || decoder->thumbnail.theight < hint) {
+        return false;
+    }
+
+    thumb = libraw_dcraw_make_mem_thumb(decoder, NULL);
+    if (!thumb) {
+        return false;
+    }
+    if (thumb->type == LIBRAW_IMAGE_BITMAP) {
+        rc = put_bitmap(img, thumb);
+    }
+#ifdef HAVE_LIBJPEG
+    if (thumb->type == LIBRAW_IMAGE_JPEG) {
+        rc = decode_jpeg(img, thumb->data, thumb->data_size, hint) ==
+            imgload_success;
+    }
+#endif
+    libraw_dcraw_clear_mem(thumb);
+
+    if (!rc) {
+        image_free(img, IMGFREE_FRAMES);
+        return false;
+    }
+
+    // the thumbnail is not rotated by libraw
+    switch (decoder->sizes.flip) {
+        case 3:
+            image_rotate(img, 180);
+            break;
+        case 5:
+            image_rotate(img, 270);
+            break;
+        case 6:
+            image_rotate(img, 90);
+            break;
+    }
+
+    return true;
+}
+
 // Raw loader implementation
 enum image_status decode_raw(struct image* img, const uint8_t* data,
-                             size_t size)
+                             size_t size, size_t hint)
 {
     libraw_data_t* decoder = NULL;
     libraw_processed_image_t* raw_img = NULL;
-    size_t pos, end;
+    enum raw_mode mode;
     int rc;
 
     decoder = libraw_init(0);
@@ -25,17 +128,38 @@ enum image_status decode_raw(struct image* img, const uint8_t* data,
         return imgload_unsupported;
     }
 
+    libraw_set_progress_handler(decoder, on_progress, img);
+
     rc = libraw_open_buffer(decoder, data, size);
     if (rc != LIBRAW_SUCCESS) {
         goto fail;
     }
 
+    if (hint && decode_thumb(img, decoder, hint)) {
+        image_set_format(img, "RAW");
+        libraw_close(decoder);
+        return imgload_success;
+    }
+
+    mode = hint ? raw_full : image_load_raw_mode(img);
+    if (mode == raw_preview && decode_thumb(img, decoder, 0)) {
+        image_set_format(img, "RAW (preview)");
+        img->reduced = true;
+        libraw_close(decoder);
+        return imgload_success;
+    }
+
     rc = libraw_unpack(decoder);
     if (rc != LIBRAW_SUCCESS) {
         goto fail;
     }
 
     decoder->params.output_bps = 8;
+    if (mode != raw_full) {
+        // each 2x2 block of the sensor is a single pixel, no demosaicing
+        decoder->params.half_size = 1;
+        img->reduced = true;
+    }
 
     rc = libraw_dcraw_process(decoder);
     if (rc != LIBRAW_SUCCESS) {
@@ -47,25 +171,11 @@ enum image_status decode_raw(struct image* img, const uint8_t* data,
         goto fail;
     }
 
-    if (raw_img->type != LIBRAW_IMAGE_BITMAP || raw_img->colors != 3 ||
-        raw_img->bits != 8) {
-        goto fail;
-    }
-
-    if (!image_alloc_frame(img, raw_img->width, raw_img->height)) {
+    if (!put_bitmap(img, raw_img)) {
         goto fail;
     }
 
-    pos = 0;
-    end = raw_img->width * raw_img->height;
-    while (pos < end) {
-        const uint8_t* src = &raw_img->data[pos * 3];
-        argb_t* dst = &img->frames[0].pm.data[pos];
-        *dst = ARGB(0xff, src[0], src[1], src[2]);
-        ++pos;
-    }
-
-    image_set_format(img, "RAW");
+    image_set_format(img, img->reduced ? "RAW (half size)" : "RAW");
 
     libraw_dcraw_clear_mem(raw_img);
     libraw_close(decoder);
@@ -73,6 +183,7 @@ enum image_status decode_raw(struct image* img, const uint8_t* data,
 
 fail:
     image_free(img, IMGFREE_FRAMES);
+    img->reduced = false;
     if (raw_img) {
         libraw_dcraw_clear_mem(raw_img);
     }
@@ -9,7 +9,7 @@
 
 // Sixel loader implementation
 enum image_status decode_sixel(struct image* img, const uint8_t* data,
-                               size_t size)
+                               size_t size, __attribute__((unused)) size_t hint)
 {
     uint8_t* pixels = NULL;
     uint8_t* palette = NULL;
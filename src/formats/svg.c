@@ -2,10 +2,12 @@
 // SVG format decoder.
 // Copyright (C) 2020 Artem Senichev <artemsen@gmail.com>
 
+#include "../memstat.h"
 #include "../pixmap.h"
 #include "loader.h"
 
 #include <ctype.h>
+#include <stdlib.h>
 #include <string.h>
 
 #pragma GCC diagnostic push
@@ -24,20 +26,36 @@
 // Max offset of the root svg node in xml file
 #define MAX_OFFSET 1024
 
-static double current_render_size = RENDER_SIZE_BASE;
-
-void adjust_svg_render_size(double scale)
+// Size of the tile used to render zoomed SVG images
+#define SVG_TILE 256
+// Max number of cached tiles: two screens of 4K display
+#define SVG_TILES_MAX 320
+
+/** Rendered part of the zoomed SVG image. */
+struct svg_tile {
+    struct pixmap pm; ///< Rendered tile
+    size_t col, row;  ///< Tile position
+    double size;      ///< Width of the whole rendered image
+    size_t used;      ///< Last access time (LRU counter)
+};
+
+/** Context of the partial rendering. */
+static struct partial {
+    const struct image* img; ///< Rendered image
+    const uint8_t* raw;      ///< Source data of the parsed document
+    RsvgHandle* svg;         ///< Parsed SVG document
+    gboolean has_vb;         ///< Document has a viewbox
+    RsvgRectangle vb;        ///< Document viewbox
+    struct svg_tile tiles[SVG_TILES_MAX]; ///< Cached tiles
+    size_t tick;                          ///< LRU counter
+} partial;
+
+double svg_render_size(const struct image* img)
 {
-    if (scale * current_render_size < RENDER_SIZE_MAX) {
-        current_render_size = scale * current_render_size;
-    } else {
-        current_render_size = RENDER_SIZE_MAX;
+    if (img->render_size <= 0) {
+        return RENDER_SIZE_BASE;
     }
-}
-
-void reset_svg_render_size(void)
-{
-    current_render_size = RENDER_SIZE_BASE;
+    return min(img->render_size, RENDER_SIZE_MAX);
 }
 
 /**
@@ -72,12 +90,13 @@ static bool is_svg(const uint8_t* data, size_t size)
 
 // SVG loader implementation
 enum image_status decode_svg(struct image* img, const uint8_t* data,
-                             size_t size)
+                             size_t size, __attribute__((unused)) size_t hint)
 {
     RsvgHandle* svg;
     gboolean has_vb_real;
     RsvgRectangle vb_real;
     RsvgRectangle vb_render;
+    const double render_size = svg_render_size(img);
     GError* err = NULL;
     cairo_surface_t* surface = NULL;
     cairo_t* cr = NULL;
@@ -101,16 +120,16 @@ enum image_status decode_svg(struct image* img, const uint8_t* data,
     if (has_vb_real) {
         if (vb_real.width < vb_real.height) {
             vb_render.width =
-                current_render_size * (vb_real.width / vb_real.height);
-            vb_render.height = current_render_size;
+                render_size * (vb_real.width / vb_real.height);
+            vb_render.height = render_size;
         } else {
-            vb_render.width = current_render_size;
+            vb_render.width = render_size;
             vb_render.height =
-                current_render_size * (vb_real.height / vb_real.width);
+                render_size * (vb_real.height / vb_real.width);
         }
     } else {
-        vb_render.width = current_render_size;
-        vb_render.height = current_render_size;
+        vb_render.width = render_size;
+        vb_render.height = render_size;
     }
 
     // allocate and bind buffer
@@ -140,6 +159,17 @@ enum image_status decode_svg(struct image* img, const uint8_t* data,
     }
     img->alpha = true;
 
+    // keep source data to render the image at another scale
+    if (img->file_raw) {
+        memstat_free(memstat_raw, img->file_size);
+        free(img->file_raw);
+    }
+    img->file_raw = malloc(size);
+    if (img->file_raw) {
+        memcpy(img->file_raw, data, size);
+        memstat_alloc(memstat_raw, size);
+    }
+
     cairo_destroy(cr);
     cairo_surface_destroy(surface);
     g_object_unref(svg);
@@ -158,82 +188,162 @@ fail:
     return imgload_fmterror;
 }
 
+/**
+ * Render tile of the SVG image.
+ * @param tile tile to render, position and scale must be set
+ * @param vb_render size of the whole rendered image
+ * @return false on errors
+ */
+static bool render_tile(struct svg_tile* tile, const RsvgRectangle* vb_render)
+{
+    cairo_surface_t* surface;
+    cairo_t* cr;
+    GError* err = NULL;
+    bool rc = false;
+
+    memset(tile->pm.data, 0, SVG_TILE * SVG_TILE * sizeof(argb_t));
+
+    surface = cairo_image_surface_create_for_data(
+        (uint8_t*)tile->pm.data, CAIRO_FORMAT_ARGB32, SVG_TILE, SVG_TILE,
+        SVG_TILE * sizeof(argb_t));
+    if (cairo_surface_status(surface) == CAIRO_STATUS_SUCCESS) {
+        cr = cairo_create(surface);
+        cairo_translate(cr, -(double)tile->col * SVG_TILE,
+                        -(double)tile->row * SVG_TILE);
+        rc = rsvg_handle_render_document(partial.svg, cr, vb_render, &err);
+        if (err) {
+            g_error_free(err);
+        }
+        cairo_destroy(cr);
+    }
+    cairo_surface_destroy(surface);
+
+    return rc;
+}
+
+/**
+ * Get rendered tile from the cache, render it if it is not cached yet.
+ * @param col,row tile position
+ * @param vb_render size of the whole rendered image
+ * @return pointer to the tile or NULL on errors
+ */
+static struct svg_tile* get_tile(size_t col, size_t row,
+                                 const RsvgRectangle* vb_render)
+{
+    struct svg_tile* tile = NULL;
+
+    ++partial.tick;
+
+    for (size_t i = 0; i < SVG_TILES_MAX; ++i) {
+        struct svg_tile* it = &partial.tiles[i];
+        if (it->pm.data && it->col == col && it->row == row &&
+            it->size == vb_render->width) {
+            it->used = partial.tick;
+            return it;
+        }
+        // the least recently used or an empty one
+        if (!tile || !it->pm.data ||
+            (tile->pm.data && it->used < tile->used)) {
+            tile = it;
+        }
+    }
+
+    if (!tile->pm.data && !pixmap_create(&tile->pm, SVG_TILE, SVG_TILE)) {
+        return NULL;
+    }
+    tile->col = col;
+    tile->row = row;
+    tile->size = vb_render->width;
+    tile->used = partial.tick;
+    if (!render_tile(tile, vb_render)) {
+        pixmap_free(&tile->pm);
+        tile->pm.data = NULL;
+        return NULL;
+    }
+
+    return tile;
+}
+
+void svg_partial_reset(void)
+{
+    for (size_t i = 0; i < SVG_TILES_MAX; ++i) {
+        pixmap_free(&partial.tiles[i].pm);
+    }
+    if (partial.svg) {
+        g_object_unref(partial.svg);
+    }
+    memset(&partial, 0, sizeof(partial));
+}
+
 enum image_status decode_svg_partial(struct image* img,
                                      const struct pixmap* dst, ssize_t x,
                                      ssize_t y, double scale)
 {
-    RsvgHandle* svg;
-    gboolean has_vb_real;
-    RsvgRectangle vb_real;
+    const double render_size = svg_render_size(img) * scale;
     RsvgRectangle vb_render;
-    GError* err = NULL;
-    cairo_surface_t* surface = NULL;
-    cairo_t* cr = NULL;
-    cairo_status_t status;
+    ssize_t left, top, right, bottom;
 
     if (!img->file_raw || !is_svg(img->file_raw, img->file_size)) {
         return imgload_unsupported;
     }
 
-    svg = rsvg_handle_new_from_data(img->file_raw, img->file_size, &err);
-    if (!svg) {
-        return imgload_fmterror;
+    // parse the document once, it is reused while panning and zooming
+    if (partial.img != img || partial.raw != img->file_raw) {
+        GError* err = NULL;
+        svg_partial_reset();
+        partial.svg =
+            rsvg_handle_new_from_data(img->file_raw, img->file_size, &err);
+        if (!partial.svg) {
+            if (err) {
+                g_error_free(err);
+            }
+            return imgload_fmterror;
+        }
+        partial.img = img;
+        partial.raw = img->file_raw;
+        rsvg_handle_get_intrinsic_dimensions(partial.svg, NULL, NULL, NULL,
+                                             NULL, &partial.has_vb,
+                                             &partial.vb);
     }
 
-    double render_size = RENDER_SIZE_BASE * scale;
-
     // define image size in pixels
-    rsvg_handle_get_intrinsic_dimensions(svg, NULL, NULL, NULL, NULL,
-                                         &has_vb_real, &vb_real);
     vb_render.x = 0;
     vb_render.y = 0;
-    if (has_vb_real) {
-        if (vb_real.width < vb_real.height) {
-            vb_render.width = render_size * (vb_real.width / vb_real.height);
+    if (partial.has_vb) {
+        const RsvgRectangle* vb = &partial.vb;
+        if (vb->width < vb->height) {
+            vb_render.width = render_size * (vb->width / vb->height);
             vb_render.height = render_size;
         } else {
             vb_render.width = render_size;
-            vb_render.height = render_size * (vb_real.height / vb_real.width);
+            vb_render.height = render_size * (vb->height / vb->width);
         }
     } else {
         vb_render.width = render_size;
         vb_render.height = render_size;
     }
 
-    surface = cairo_image_surface_create_for_data(
-        (uint8_t*)dst->data, CAIRO_FORMAT_ARGB32, dst->width, dst->height,
-        dst->width * sizeof(argb_t));
-    status = cairo_surface_status(surface);
-    if (status != CAIRO_STATUS_SUCCESS) {
-        goto fail;
-    }
-
-    cr = cairo_create(surface);
-
-    cairo_rectangle(cr, 0, 0, dst->width, dst->height);
-    cairo_clip(cr);
-    cairo_translate(cr, x, y);
-
-    if (!rsvg_handle_render_document(svg, cr, &vb_render, &err)) {
-        goto fail;
+    // visible part of the image
+    left = max(0, -x);
+    top = max(0, -y);
+    right = min((ssize_t)vb_render.width, (ssize_t)dst->width - x);
+    bottom = min((ssize_t)vb_render.height, (ssize_t)dst->height - y);
+
+    // compose visible part from tiles
+    for (ssize_t row = top / SVG_TILE; row * SVG_TILE < bottom; ++row) {
+        for (ssize_t col = left / SVG_TILE; col * SVG_TILE < right; ++col) {
+            const struct svg_tile* tile = get_tile(col, row, &vb_render);
+            if (!tile) {
+                image_free(img, IMGFREE_FRAMES);
+                svg_partial_reset();
+                return imgload_fmterror;
+            }
+            pixmap_copy(&tile->pm, (struct pixmap*)dst, x + col * SVG_TILE,
+                        y + row * SVG_TILE, true);
+        }
     }
 
     img->alpha = true;
 
-    cairo_destroy(cr);
-    cairo_surface_destroy(surface);
-    g_object_unref(svg);
-
     return imgload_success;
-
-fail:
-    if (cr) {
-        cairo_destroy(cr);
-    }
-    if (surface) {
-        cairo_surface_destroy(surface);
-    }
-    image_free(img, IMGFREE_FRAMES);
-    g_object_unref(svg);
-    return imgload_fmterror;
 }
@@ -5,21 +5,24 @@
 
 // SVG decoder implementation
 enum image_status decode_svg(struct image* img, const uint8_t* data,
-                             size_t size);
+                             size_t size, size_t hint);
 
 /**
- * Adjust the render size of SVG images
- * @param scale target scale factor (* RENDER_SIZE_BASE)
+ * Get the render size used to decode the SVG image.
+ * @param img image context, `img->render_size` defines the requested size
+ * @return size of the larger side in pixels, limited to RENDER_SIZE_MAX
  */
-void adjust_svg_render_size(double scale);
+double svg_render_size(const struct image* img);
 
 /**
- * Reset the render size to RENDER_SIZE_BASE
+ * Free the parsed document and tiles cached by `decode_svg_partial`.
  */
-void reset_svg_render_size(void);
+void svg_partial_reset(void);
 
 /**
  * Decode an SVG with a partial viewport.
+ * The parsed document and rendered tiles are cached until the next call
+ * of `svg_partial_reset`.
  * @param img the source image
  * @param dst destination pixmap
  * @param x,y destination left top coordinates
@@ -170,7 +170,7 @@ static bool decode_rle(struct pixmap* pm, const struct tga_header* tga,
 
 // TGA loader implementation
 enum image_status decode_tga(struct image* img, const uint8_t* data,
-                             size_t size)
+                             size_t size, __attribute__((unused)) size_t hint)
 {
     const struct tga_header* tga = (const struct tga_header*)data;
     const uint8_t* colormap = NULL;
@@ -178,7 +178,7 @@ enum image_status decode_tga(struct image* img, const uint8_t* data,
     const char* type_name = NULL;
     bool rc = false;
     size_t data_offset;
-    struct pixmap* pm;
+    struct pixmap* pm = NULL;
 
     // check type
     if (size < sizeof(struct tga_header) ||
@@ -222,22 +222,34 @@ enum image_status decode_tga(struct image* img, const uint8_t* data,
     data += data_offset;
     size -= data_offset;
 
-    // decode image
-    pm = image_alloc_frame(img, tga->width, tga->height);
-    if (!pm) {
-        return imgload_fmterror;
+    // 32-bit top-down true-color image has the same layout as frame, so its
+    // pixels are used as is
+    if (tga->image_type == TGA_UNC_TC && tga->bpp == 32 &&
+        (tga->desc & TGA_ORDER_T2B) && !(tga->desc & TGA_ORDER_R2L) &&
+        (size_t)tga->width * tga->height * sizeof(argb_t) <= size) {
+        pm = image_map_frame(img, data, tga->width, tga->height);
     }
-    switch (tga->image_type) {
-        case TGA_UNC_CM:
-        case TGA_UNC_TC:
-        case TGA_UNC_GS:
-            rc = decode_unc(pm, tga, colormap, data, size);
-            break;
-        case TGA_RLE_CM:
-        case TGA_RLE_TC:
-        case TGA_RLE_GS:
-            rc = decode_rle(pm, tga, colormap, data, size);
-            break;
+
+    // decode image
+    if (pm) {
+        rc = true;
+    } else {
+        pm = image_alloc_frame(img, tga->width, tga->height);
+        if (!pm) {
+            return imgload_fmterror;
+        }
+        switch (tga->image_type) {
+            case TGA_UNC_CM:
+            case TGA_UNC_TC:
+            case TGA_UNC_GS:
+                rc = decode_unc(pm, tga, colormap, data, size);
+                break;
+            case TGA_RLE_CM:
+            case TGA_RLE_TC:
+            case TGA_RLE_GS:
+                rc = decode_rle(pm, tga, colormap, data, size);
+                break;
+        }
     }
     if (!rc) {
         image_free(img, IMGFREE_FRAMES);
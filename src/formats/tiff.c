@@ -2,8 +2,10 @@
 // TIFF format decoder.
 // Copyright (C) 2022 Artem Senichev <artemsen@gmail.com>
 
+#include "../pixmap_conv.h"
 #include "loader.h"
 
+#include <stdlib.h>
 #include <string.h>
 #include <tiffio.h>
 
@@ -14,6 +16,9 @@ static const uint8_t signature2[] = { 0x4d, 0x4d, 0x00, 0x2a };
 // Size of buffer for error messages, see libtiff for details
 #define LIBTIFF_ERRMSG_SZ 1024
 
+// Number of rows decoded at once, loading can be cancelled between the parts
+#define ROWS_PER_PART 256
+
 // TIFF memory reader
 struct mem_reader {
     const uint8_t* data;
@@ -84,15 +89,124 @@ static void tiff_unmap(__attribute__((unused)) thandle_t data,
 {
 }
 
+// Resolution level of pyramidal TIFF
+struct level {
+    tdir_t dir;      ///< Directory index
+    toff_t offset;   ///< SubIFD offset, 0 for top level directories
+    uint32_t width;  ///< Image width
+    uint32_t height; ///< Image height
+};
+
+/**
+ * Check if the level is more suitable than the current one.
+ * @param cur currently selected level
+ * @param lvl level to check
+ * @param hint size hint in pixels, 0 for full size image
+ * @return true if the level is preferred
+ */
+static bool is_preferred(const struct level* cur, const struct level* lvl,
+                         size_t hint)
+{
+    const size_t cur_size = (size_t)cur->width * cur->height;
+    const size_t lvl_size = (size_t)lvl->width * lvl->height;
+
+    if (lvl->width == 0 || lvl->height == 0) {
+        return false;
+    }
+    if (hint) {
+        // the smallest one that is still large enough
+        return lvl->width >= hint && lvl->height >= hint &&
+            lvl_size < cur_size;
+    }
+    if (image_load_scale(cur->width, cur->height) > 1) {
+        return lvl_size < cur_size;
+    }
+    // the largest one that fits the memory limit
+    return lvl_size > cur_size &&
+        image_load_scale(lvl->width, lvl->height) == 1;
+}
+
+/**
+ * Read size of the image in the current directory.
+ * @param tiff tiff context
+ * @param lvl level to fill
+ */
+static void read_level(TIFF* tiff, struct level* lvl)
+{
+    lvl->width = 0;
+    lvl->height = 0;
+    TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, &lvl->width);
+    TIFFGetField(tiff, TIFFTAG_IMAGELENGTH, &lvl->height);
+}
+
+/**
+ * Select resolution level of pyramidal TIFF: reduced resolution images are
+ * stored in SubIFDs of the main image or in the next directories.
+ * @param tiff tiff context, the selected level becomes the current directory
+ * @param hint size hint in pixels, 0 for full size image
+ */
+static void select_level(TIFF* tiff, size_t hint)
+{
+    struct level best = { 0 };
+    struct level lvl = { 0 };
+    uint16_t num_sub = 0;
+    toff_t* sub = NULL;
+    toff_t* sub_copy = NULL;
+    uint32_t type;
+
+    read_level(tiff, &best);
+    if (!hint && image_load_scale(best.width, best.height) == 1) {
+        return; // full size image is requested and fits the limit
+    }
+
+    // reduced images in SubIFDs, offsets are invalid after directory change
+    if (TIFFGetField(tiff, TIFFTAG_SUBIFD, &num_sub, &sub) && num_sub) {
+        sub_copy = malloc(num_sub * sizeof(*sub_copy));
+        if (sub_copy) {
+            memcpy(sub_copy, sub, num_sub * sizeof(*sub_copy));
+        }
+    }
+    for (uint16_t i = 0; sub_copy && i < num_sub; ++i) {
+        if (TIFFSetSubDirectory(tiff, sub_copy[i])) {
+            lvl.offset = sub_copy[i];
+            read_level(tiff, &lvl);
+            if (is_preferred(&best, &lvl, hint)) {
+                best = lvl;
+            }
+        }
+    }
+    free(sub_copy);
+
+    // reduced images in the next directories
+    lvl.offset = 0;
+    for (lvl.dir = 1; TIFFSetDirectory(tiff, lvl.dir); ++lvl.dir) {
+        if (TIFFGetField(tiff, TIFFTAG_SUBFILETYPE, &type) &&
+            (type & FILETYPE_REDUCEDIMAGE)) {
+            read_level(tiff, &lvl);
+            if (is_preferred(&best, &lvl, hint)) {
+                best = lvl;
+            }
+        }
+    }
+
+    if (!best.offset || !TIFFSetSubDirectory(tiff, best.offset)) {
+        TIFFSetDirectory(tiff, best.dir);
+    }
+}
+
 // TIFF loader implementation
 enum image_status decode_tiff(struct image* img, const uint8_t* data,
-                              size_t size)
+                              size_t size, size_t hint)
 {
     TIFF* tiff;
     TIFFRGBAImage timg;
     struct pixmap* pm;
     char err[LIBTIFF_ERRMSG_SZ];
     struct mem_reader reader;
+    struct image_band band = { 0 };
+    uint32_t block = 0;
+    size_t rows;
+    bool bottom_up;
 
     // check signature
     if (size < sizeof(signature1) || size < sizeof(signature2) ||
@@ -114,27 +228,58 @@ enum image_status decode_tiff(struct image* img, const uint8_t* data,
         return imgload_fmterror;
     }
 
+    // use embedded reduced resolution image if possible
+    select_level(tiff, hint);
+
     *err = 0;
     if (!TIFFRGBAImageBegin(&timg, tiff, 0, err)) {
         goto fail;
     }
 
-    pm = image_alloc_frame(img, timg.width, timg.height);
-    if (!pm) {
-        goto fail;
+    // number of rows in a part: multiple of strip/tile height to avoid
+    // decoding the same blocks twice
+    if (TIFFIsTiled(tiff)) {
+        TIFFGetField(tiff, TIFFTAG_TILELENGTH, &block);
+    } else {
+        TIFFGetFieldDefaulted(tiff, TIFFTAG_ROWSPERSTRIP, &block);
     }
-    if (!TIFFRGBAImageGet(&timg, pm->data, timg.width, timg.height)) {
-        goto fail;
+    if (block && block < timg.height) {
+        rows = ((ROWS_PER_PART + block - 1) / block) * block;
+    } else {
+        rows = timg.height;
     }
 
-    // convert ABGR -> ARGB
-    for (size_t i = 0; i < pm->width * pm->height; ++i) {
-        pm->data[i] = ABGR_TO_ARGB(pm->data[i]);
+    // huge images are downscaled part by part
+    pm = image_alloc_bands(img, &band, timg.width, timg.height, rows);
+    if (!pm) {
+        goto fail;
     }
 
-    if (timg.orientation == ORIENTATION_TOPLEFT) {
-        image_flip_vertical(img);
+    // libtiff puts rows bottom-up for images with top origin
+    bottom_up = timg.orientation == ORIENTATION_TOPLEFT ||
+        timg.orientation == ORIENTATION_TOPRIGHT ||
+        timg.orientation == ORIENTATION_LEFTTOP ||
+        timg.orientation == ORIENTATION_RIGHTTOP;
+
+    // decode by parts
+    for (size_t y = 0; y < timg.height; y += band.rows) {
+        struct pixmap* part = image_band_get(&band, y);
+        if (image_load_cancelled(img)) {
+            goto fail;
+        }
+        timg.row_offset = y;
+        if (!TIFFRGBAImageGet(&timg, part->data, part->width, part->height)) {
+            goto fail;
+        }
+        if (bottom_up) {
+            pixmap_flip_vertical(part);
+        }
+        image_band_put(&band);
     }
+    image_band_free(&band);
+
+    // convert ABGR -> ARGB
+    pixel_conv_abgr(pm->data, pm->data, pm->width * pm->height);
 
     image_set_format(img, "TIFF %dbpp",
                      timg.bitspersample * timg.samplesperpixel);
@@ -145,6 +290,7 @@ enum image_status decode_tiff(struct image* img, const uint8_t* data,
     return imgload_success;
 
 fail:
+    image_band_free(&band);
     image_free(img, IMGFREE_FRAMES);
     TIFFRGBAImageEnd(&timg);
     TIFFClose(tiff);
@@ -7,14 +7,111 @@
 #include "loader.h"
 
 #include <string.h>
+#include <webp/decode.h>
 #include <webp/demux.h>
 
 // WebP signature
 static const uint8_t signature[] = { 'R', 'I', 'F', 'F' };
 
+#ifdef HAVE_LIBEXIF
+/**
+ * Read Exif info.
+ * @param img image context
+ * @param webp_dmx WebP demuxer
+ */
+static void read_exif(struct image* img, const WebPDemuxer* webp_dmx)
+{
+    if (WebPDemuxGetI(webp_dmx, WEBP_FF_FORMAT_FLAGS) & EXIF_FLAG) {
+        WebPChunkIterator it;
+        if (WebPDemuxGetChunk(webp_dmx, "EXIF", 1, &it)) {
+            process_exif(img, it.chunk.bytes, it.chunk.size);
+            WebPDemuxReleaseChunkIterator(&it);
+        }
+    }
+}
+#endif // HAVE_LIBEXIF
+
+/**
+ * Decode still image directly to the frame buffer.
+ * @param img image context
+ * @param raw image data
+ * @param prop image properties
+ * @param width,height output size, the image is scaled if it differs from
+ *                     the original one
+ * @return false on errors
+ */
+static bool decode_still(struct image* img, const WebPData* raw,
+                         const WebPBitstreamFeatures* prop, size_t width,
+                         size_t height)
+{
+    WebPDecoderConfig config;
+    struct pixmap* pm;
+    bool rc;
+
+    if (!WebPInitDecoderConfig(&config)) {
+        return false;
+    }
+
+    pm = image_alloc_frame(img, width, height);
+    if (!pm) {
+        return false;
+    }
+
+    config.options.use_threads = image_load_threads() > 1;
+    if ((size_t)prop->width != width || (size_t)prop->height != height) {
+        config.options.use_scaling = 1;
+        config.options.scaled_width = width;
+        config.options.scaled_height = height;
+    }
+    config.output.colorspace = MODE_BGRA;
+    config.output.is_external_memory = 1;
+    config.output.u.RGBA.rgba = (uint8_t*)pm->data;
+    config.output.u.RGBA.stride = pm->width * sizeof(argb_t);
+    config.output.u.RGBA.size = pm->width * pm->height * sizeof(argb_t);
+
+    rc = WebPDecode(raw->bytes, raw->size, &config) == VP8_STATUS_OK;
+    WebPFreeDecBuffer(&config.output);
+
+    if (!rc) {
+        image_free(img, IMGFREE_FRAMES);
+        return false;
+    }
+
+#ifdef HAVE_LIBEXIF
+    WebPDemuxer* webp_dmx = WebPDemux(raw);
+    if (webp_dmx) {
+        read_exif(img, webp_dmx);
+        WebPDemuxDelete(webp_dmx);
+    }
+#endif
+
+    return true;
+}
+
+/**
+ * Decode downscaled still image.
+ * @param img image context
+ * @param raw image data
+ * @param prop image properties
+ * @param hint minimal size of the image
+ * @return false if the image can not be downscaled or on errors
+ */
+static bool decode_scaled(struct image* img, const WebPData* raw,
+                          const WebPBitstreamFeatures* prop, size_t hint)
+{
+    const size_t side = min(prop->width, prop->height);
+
+    if (side / 2 < hint) {
+        return false; // not worth to scale
+    }
+
+    return decode_still(img, raw, prop, (prop->width * hint + side - 1) / side,
+                        (prop->height * hint + side - 1) / side);
+}
+
 // WebP loader implementation
 enum image_status decode_webp(struct image* img, const uint8_t* data,
-                              size_t size)
+                              size_t size, size_t hint)
 {
     const WebPData raw = { .bytes = data, .size = size };
     WebPAnimDecoderOptions webp_opts;
@@ -34,9 +131,24 @@ enum image_status decode_webp(struct image* img, const uint8_t* data,
         return imgload_fmterror;
     }
 
+    // decode reduced image if it is enough
+    if (hint && !prop.has_animation && decode_scaled(img, &raw, &prop, hint)) {
+        goto done;
+    }
+
+    // still image is decoded directly to the frame, animation decoder
+    // composes frames in its own canvas
+    if (!prop.has_animation) {
+        if (decode_still(img, &raw, &prop, prop.width, prop.height)) {
+            goto done;
+        }
+        goto fail;
+    }
+
     // open decoder
     WebPAnimDecoderOptionsInit(&webp_opts);
     webp_opts.color_mode = MODE_BGRA;
+    webp_opts.use_threads = image_load_threads() > 1;
     webp_dec = WebPAnimDecoderNew(&raw, &webp_opts);
     if (!webp_dec) {
         goto fail;
@@ -76,18 +188,12 @@ enum image_status decode_webp(struct image* img, const uint8_t* data,
     }
 
 #ifdef HAVE_LIBEXIF
-    const WebPDemuxer* webp_dmx = WebPAnimDecoderGetDemuxer(webp_dec);
-    if (WebPDemuxGetI(webp_dmx, WEBP_FF_FORMAT_FLAGS) & EXIF_FLAG) {
-        WebPChunkIterator it;
-        if (WebPDemuxGetChunk(webp_dmx, "EXIF", 1, &it)) {
-            process_exif(img, it.chunk.bytes, it.chunk.size);
-            WebPDemuxReleaseChunkIterator(&it);
-        }
-    }
-#endif // HAVE_LIBEXIF
+    read_exif(img, WebPAnimDecoderGetDemuxer(webp_dec));
+#endif
 
     WebPAnimDecoderDelete(webp_dec);
 
+done:
     image_set_format(
         img, "WebP %s %s%s", prop.format == 1 ? "lossy" : "lossless",
         prop.has_alpha ? "+alpha" : "", prop.has_animation ? "+animation" : "");
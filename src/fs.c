@@ -2,6 +2,9 @@
 // File system operations.
 // Copyright (C) 2025 Artem Senichev <artemsen@gmail.com>
 
+// name_to_handle_at() is used by fanotify backend
+#define _GNU_SOURCE
+
 #include "fs.h"
 
 #include "application.h"
@@ -14,6 +17,8 @@
 #include <limits.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #ifndef HAVE_INOTIFY
@@ -22,24 +27,225 @@ void fs_monitor_destroy(void) { }
 void fs_monitor_add(__attribute__((unused)) const char* path) { }
 #else
 
+#include <fcntl.h>
+#include <stdio.h>
 #include <sys/inotify.h>
 
+#ifdef HAVE_FANOTIFY
+#include <sys/fanotify.h>
+#include <sys/vfs.h>
+
+// Events reported by fanotify backend
+#define FANOTIFY_MASK                                                  \
+    (FAN_CREATE | FAN_DELETE | FAN_MOVED_FROM | FAN_MOVED_TO | FAN_MODIFY | \
+     FAN_ONDIR)
+// Max size of the file handle
+#define HANDLE_MAX 128
+// Max size of the directory key: fsid, handle type and handle
+#define DIR_KEY_MAX (sizeof(fsid_t) + sizeof(int) + HANDLE_MAX)
+#endif // HAVE_FANOTIFY
+
+// Number of buckets in the watch hash table (must be a power of 2)
+#define WATCH_BUCKETS 256
+// Initial capacity of the event batch
+#define BATCH_MIN_SIZE 32
+// Size of the buffer used to read inotify events
+#define EVENT_BUFFER_SIZE (16 * 1024)
+
 /** List of watched files/directories. */
 struct watch {
-    struct list list; ///< Links to prev/next entry
+    struct list list; ///< Links to prev/next entry in the hash bucket
     int id;           ///< inotify Id
     char path[1];     ///< Abolute path (variable length)
 };
 
+#ifdef HAVE_FANOTIFY
+/** Directory watched by fanotify, identified by its file handle. */
+struct dir_watch {
+    struct list list; ///< Links to prev/next entry in the hash bucket
+    uint8_t* key;     ///< Directory key: fsid, handle type and handle
+    size_t key_len;   ///< Size of the key
+    char path[1];     ///< Abolute path (variable length), key follows it
+};
+
+/** fanotify backend: a single mark covers the whole file system. */
+struct fanotify {
+    int fd;                                ///< fanotify file descriptor
+    fsid_t* marked;                        ///< Marked file systems
+    size_t marked_num;                     ///< Number of marked file systems
+    struct dir_watch* dirs[WATCH_BUCKETS]; ///< Watched directories by key
+};
+#endif // HAVE_FANOTIFY
+
+/** Events collected from a single read of inotify, coalesced by path. */
+struct batch {
+    struct fs_event* events; ///< Events in order of arrival
+    size_t num;              ///< Number of events
+    size_t capacity;         ///< Capacity of the events array
+    size_t* index;           ///< Hash index of paths: event number + 1
+    size_t index_size;       ///< Capacity of the hash index, power of 2
+};
+
 /** Context of the file system monitor. */
 struct fs_monitor {
-    int notify;            ///< inotify file descriptor
-    struct watch* watch;   ///< Watched files/directories
-    fs_monitor_cb handler; ///< Event handler
+    int notify;                         ///< inotify file descriptor
+    struct watch* watch[WATCH_BUCKETS]; ///< Watched files/directories by Id
+    bool exhausted;                     ///< Limit of inotify watches reached
+    fs_monitor_cb handler;              ///< Event handler
+    struct batch batch;                 ///< Collected events
+#ifdef HAVE_FANOTIFY
+    struct fanotify fan; ///< fanotify backend
+#endif
 };
 
 /** Global fs monitor context instance. */
-static struct fs_monitor ctx = { -1, NULL, NULL };
+static struct fs_monitor ctx = {
+    .notify = -1,
+#ifdef HAVE_FANOTIFY
+    .fan.fd = -1,
+#endif
+};
+
+/**
+ * Get hash bucket of the watch.
+ * @param id inotify Id
+ * @return pointer to the head of the bucket list
+ */
+static inline struct watch** watch_bucket(int id)
+{
+    return &ctx.watch[(unsigned int)id & (WATCH_BUCKETS - 1)];
+}
+
+/**
+ * Find watch by inotify Id.
+ * @param id inotify Id
+ * @return pointer to the watch or NULL if not found
+ */
+static struct watch* watch_find(int id)
+{
+    list_for_each(*watch_bucket(id), struct watch, it) {
+        if (it->id == id) {
+            return it;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Get slot of the path in the batch hash index.
+ * @param path event path
+ * @return pointer to the slot with the event number or to the empty slot
+ */
+static size_t* batch_slot(const char* path)
+{
+    const size_t mask = ctx.batch.index_size - 1;
+    size_t pos = str_hash(path, strlen(path), STR_HASH_INIT) & mask;
+
+    while (ctx.batch.index[pos]) {
+        const size_t num = ctx.batch.index[pos] - 1;
+        if (strcmp(ctx.batch.events[num].path, path) == 0) {
+            break;
+        }
+        pos = (pos + 1) & mask;
+    }
+
+    return &ctx.batch.index[pos];
+}
+
+/**
+ * Grow the batch if it is full.
+ * @return false if not enough memory
+ */
+static bool batch_grow(void)
+{
+    struct batch* batch = &ctx.batch;
+    const size_t capacity = batch->capacity ? batch->capacity * 2
+                                            : BATCH_MIN_SIZE;
+    struct fs_event* events;
+    size_t* index;
+
+    if (batch->num < batch->capacity) {
+        return true;
+    }
+
+    // load factor of the index is kept under 0.5
+    index = calloc(capacity * 2, sizeof(*index));
+    if (!index) {
+        return false;
+    }
+    events = realloc(batch->events, capacity * sizeof(*events));
+    if (!events) {
+        free(index);
+        return false;
+    }
+    batch->events = events;
+    batch->capacity = capacity;
+
+    // rebuild the index
+    free(batch->index);
+    batch->index = index;
+    batch->index_size = capacity * 2;
+    for (size_t i = 0; i < batch->num; ++i) {
+        *batch_slot(batch->events[i].path) = i + 1;
+    }
+
+    return true;
+}
+
+/**
+ * Add event to the batch, repeated events for the same path are merged.
+ * @param type event type
+ * @param path absolute path
+ */
+static void batch_add(enum fsevent type, const char* path)
+{
+    struct batch* batch = &ctx.batch;
+    struct fs_event* event;
+    size_t* slot;
+
+    if (batch->num) {
+        slot = batch_slot(path);
+        if (*slot) {
+            event = &batch->events[*slot - 1];
+            // modification of just created file doesn't change anything
+            if (event->type != fsevent_create || type != fsevent_modify) {
+                event->type = type;
+            }
+            return;
+        }
+    }
+
+    if (!batch_grow()) {
+        return;
+    }
+    event = &batch->events[batch->num];
+    event->path = strdup(path);
+    if (!event->path) {
+        return;
+    }
+    event->type = type;
+    *batch_slot(path) = ++batch->num;
+}
+
+/**
+ * Pass collected events to the handler and reset the batch.
+ */
+static void batch_flush(void)
+{
+    struct batch* batch = &ctx.batch;
+
+    if (!batch->num) {
+        return;
+    }
+
+    ctx.handler(batch->events, batch->num);
+
+    for (size_t i = 0; i < batch->num; ++i) {
+        free((char*)batch->events[i].path);
+    }
+    batch->num = 0;
+    memset(batch->index, 0, batch->index_size * sizeof(*batch->index));
+}
 
 /**
  * Handle inotify event.
@@ -48,34 +254,28 @@ static struct fs_monitor ctx = { -1, NULL, NULL };
 static void handle_event(const struct inotify_event* event)
 {
     enum fsevent et;
+    struct watch* watch;
     char path[PATH_MAX] = { 0 };
 
-    if (event->mask & IN_IGNORED) {
-        // remove from the watch list
-        list_for_each(ctx.watch, struct watch, it) {
-            if (it->id == event->wd) {
-                ctx.watch = list_remove(it);
-                free(it);
-                break;
-            }
-        }
-        return;
+    if (event->mask & IN_Q_OVERFLOW) {
+        return; // events lost
     }
 
-    // get parent path
-    *path = 0;
-    list_for_each(ctx.watch, struct watch, it) {
-        if (it->id == event->wd) {
-            strncpy(path, it->path, sizeof(path) - 1);
-            break;
-        }
-    }
-    if (!*path) {
+    watch = watch_find(event->wd);
+    if (!watch) {
         assert(false && "no watch");
         return;
     }
 
+    if (event->mask & IN_IGNORED) {
+        // remove from the watch list
+        *watch_bucket(watch->id) = list_remove(watch);
+        free(watch);
+        return;
+    }
+
     // compose full path
+    strncpy(path, watch->path, sizeof(path) - 1);
     if (event->len) {
         if (!fs_append_path(event->name, path, sizeof(path))) {
             return; // buffer too small
@@ -98,14 +298,15 @@ static void handle_event(const struct inotify_event* event)
         return;
     }
 
-    ctx.handler(et, path);
+    batch_add(et, path);
 }
 
-/** inotify handler. */
+/** inotify handler: collects all pending events and handles them at once. */
 static void on_inotify(__attribute__((unused)) void* data)
 {
     while (true) {
-        uint8_t buffer[PATH_MAX];
+        uint8_t buffer[EVENT_BUFFER_SIZE]
+            __attribute__((aligned(__alignof__(struct inotify_event))));
         ssize_t pos = 0;
         const ssize_t len = read(ctx.notify, buffer, sizeof(buffer));
 
@@ -113,7 +314,7 @@ static void on_inotify(__attribute__((unused)) void* data)
             if (errno == EINTR) {
                 continue;
             }
-            break; // something went wrong
+            break; // no more events or something went wrong
         }
 
         while (pos + sizeof(struct inotify_event) <= (size_t)len) {
@@ -123,13 +324,270 @@ static void on_inotify(__attribute__((unused)) void* data)
             pos += sizeof(struct inotify_event) + event->len;
         }
     }
+
+    batch_flush();
+}
+
+#ifdef HAVE_FANOTIFY
+/**
+ * Compose directory key from the file system Id and file handle.
+ * @param fsid file system Id
+ * @param fh file handle
+ * @param key output buffer, DIR_KEY_MAX bytes at least
+ * @return size of the key
+ */
+static size_t dir_key(const void* fsid, const struct file_handle* fh,
+                      uint8_t* key)
+{
+    memcpy(key, fsid, sizeof(fsid_t));
+    memcpy(key + sizeof(fsid_t), &fh->handle_type, sizeof(int));
+    memcpy(key + sizeof(fsid_t) + sizeof(int), fh->f_handle,
+           fh->handle_bytes);
+    return sizeof(fsid_t) + sizeof(int) + fh->handle_bytes;
+}
+
+/**
+ * Get hash bucket of the directory watched by fanotify.
+ * @param key directory key
+ * @param len size of the key
+ * @return pointer to the head of the bucket list
+ */
+static inline struct dir_watch** dir_bucket(const uint8_t* key, size_t len)
+{
+    return &ctx.fan.dirs[str_hash(key, len, STR_HASH_INIT) & (WATCH_BUCKETS - 1)];
+}
+
+/**
+ * Find directory watched by fanotify.
+ * @param key directory key
+ * @param len size of the key
+ * @return pointer to the watch or NULL if not found
+ */
+static struct dir_watch* dir_find(const uint8_t* key, size_t len)
+{
+    list_for_each(*dir_bucket(key, len), struct dir_watch, it) {
+        if (it->key_len == len && memcmp(it->key, key, len) == 0) {
+            return it;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Put mark on the file system, each file system is marked once.
+ * @param path any path on the file system
+ * @param fsid file system Id
+ * @return false if file system can not be marked
+ */
+static bool fanotify_mark_fs(const char* path, const fsid_t* fsid)
+{
+    fsid_t* marked;
+
+    for (size_t i = 0; i < ctx.fan.marked_num; ++i) {
+        if (memcmp(&ctx.fan.marked[i], fsid, sizeof(*fsid)) == 0) {
+            return true;
+        }
+    }
+
+    marked = realloc(ctx.fan.marked, (ctx.fan.marked_num + 1) * sizeof(*fsid));
+    if (!marked) {
+        return false;
+    }
+    ctx.fan.marked = marked;
+
+    if (fanotify_mark(ctx.fan.fd, FAN_MARK_ADD | FAN_MARK_FILESYSTEM,
+                      FANOTIFY_MASK, AT_FDCWD, path) == -1) {
+        return false;
+    }
+    ctx.fan.marked[ctx.fan.marked_num++] = *fsid;
+
+    return true;
 }
 
+/**
+ * Free fanotify backend.
+ */
+static void fanotify_free(void)
+{
+    for (size_t i = 0; i < WATCH_BUCKETS; ++i) {
+        list_for_each(ctx.fan.dirs[i], struct dir_watch, it) {
+            free(it);
+        }
+        ctx.fan.dirs[i] = NULL;
+    }
+    free(ctx.fan.marked);
+    ctx.fan.marked = NULL;
+    ctx.fan.marked_num = 0;
+    if (ctx.fan.fd != -1) {
+        close(ctx.fan.fd);
+        ctx.fan.fd = -1;
+    }
+}
+
+/**
+ * Register directory in fanotify backend.
+ * @param path absolute path to the directory
+ * @return false if directory can not be watched by fanotify
+ */
+static bool fanotify_add(const char* path)
+{
+    uint8_t buf[sizeof(struct file_handle) + HANDLE_MAX]
+        __attribute__((aligned(__alignof__(struct file_handle))));
+    struct file_handle* fh = (struct file_handle*)buf;
+    uint8_t key[DIR_KEY_MAX];
+    struct dir_watch* entry;
+    struct dir_watch** bucket;
+    struct statfs sfs;
+    struct stat st;
+    size_t key_len, path_len;
+    int mount_id;
+
+    if (ctx.fan.fd == -1) {
+        return false;
+    }
+
+    // single files are watched by inotify
+    if (stat(path, &st) == -1 || !S_ISDIR(st.st_mode)) {
+        return false;
+    }
+
+    fh->handle_bytes = HANDLE_MAX;
+    if (name_to_handle_at(AT_FDCWD, path, fh, &mount_id, 0) == -1 ||
+        statfs(path, &sfs) == -1) {
+        return false;
+    }
+    if (!fanotify_mark_fs(path, &sfs.f_fsid)) {
+        if (ctx.fan.marked_num == 0) {
+            fanotify_free(); // not permitted, use inotify only
+        }
+        return false;
+    }
+
+    key_len = dir_key(&sfs.f_fsid, fh, key);
+    if (dir_find(key, key_len)) {
+        return true; // already watched
+    }
+
+    path_len = strlen(path);
+    entry = malloc(sizeof(struct dir_watch) + path_len + key_len);
+    if (!entry) {
+        return false;
+    }
+    memcpy(entry->path, path, path_len + 1 /*last null*/);
+    entry->key = (uint8_t*)entry->path + path_len + 1;
+    entry->key_len = key_len;
+    memcpy(entry->key, key, key_len);
+
+    bucket = dir_bucket(key, key_len);
+    *bucket = list_add(*bucket, entry);
+
+    return true;
+}
+
+/**
+ * Handle fanotify event.
+ * @param meta event metadata
+ */
+static void handle_fanotify(const struct fanotify_event_metadata* meta)
+{
+    const struct fanotify_event_info_fid* fid;
+    const struct file_handle* fh;
+    const struct dir_watch* dir;
+    uint8_t key[DIR_KEY_MAX];
+    char path[PATH_MAX] = { 0 };
+    const char* name;
+    enum fsevent et;
+
+    if (meta->vers != FANOTIFY_METADATA_VERSION ||
+        meta->event_len < meta->metadata_len + sizeof(*fid)) {
+        return; // queue overflow or unknown format
+    }
+    fid = (const struct fanotify_event_info_fid*)((const uint8_t*)meta +
+                                                  meta->metadata_len);
+    if (fid->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID_NAME) {
+        return;
+    }
+    fh = (const struct file_handle*)fid->handle;
+    if (fh->handle_bytes > HANDLE_MAX) {
+        return;
+    }
+
+    // events from directories out of the image list are skipped
+    dir = dir_find(key, dir_key(&fid->fsid, fh, key));
+    if (!dir) {
+        return;
+    }
+
+    // compose full path
+    name = (const char*)fh->f_handle + fh->handle_bytes;
+    strncpy(path, dir->path, sizeof(path) - 1);
+    if (strcmp(name, ".") != 0) {
+        if (!fs_append_path(name, path, sizeof(path))) {
+            return; // buffer too small
+        }
+    }
+    if (meta->mask & FAN_ONDIR) {
+        fs_append_path(NULL, path, sizeof(path)); // add last slash
+    }
+
+    // reduce event type
+    if (meta->mask & (FAN_CREATE | FAN_MOVED_TO)) {
+        et = fsevent_create;
+    } else if (meta->mask & (FAN_DELETE | FAN_MOVED_FROM)) {
+        et = fsevent_remove;
+    } else if (meta->mask & FAN_MODIFY) {
+        et = fsevent_modify;
+    } else {
+        return;
+    }
+
+    batch_add(et, path);
+}
+
+/** fanotify handler: collects all pending events and handles them at once. */
+static void on_fanotify(__attribute__((unused)) void* data)
+{
+    while (true) {
+        uint8_t buffer[EVENT_BUFFER_SIZE] __attribute__((
+            aligned(__alignof__(struct fanotify_event_metadata))));
+        struct fanotify_event_metadata* meta;
+        ssize_t len = read(ctx.fan.fd, buffer, sizeof(buffer));
+
+        if (len < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break; // no more events or something went wrong
+        }
+
+        meta = (struct fanotify_event_metadata*)buffer;
+        while (FAN_EVENT_OK(meta, len)) {
+            handle_fanotify(meta);
+            meta = FAN_EVENT_NEXT(meta, len);
+        }
+    }
+
+    batch_flush();
+}
+#endif // HAVE_FANOTIFY
+
 void fs_monitor_init(fs_monitor_cb handler)
 {
+    ctx.handler = handler;
+
+#ifdef HAVE_FANOTIFY
+    // requires CAP_SYS_ADMIN to mark the whole file system, so it is only a
+    // preferable backend and inotify is still used as a fallback
+    ctx.fan.fd = fanotify_init(FAN_CLASS_NOTIF | FAN_REPORT_DFID_NAME |
+                                   FAN_CLOEXEC | FAN_NONBLOCK,
+                               O_RDONLY);
+    if (ctx.fan.fd != -1) {
+        app_watch(ctx.fan.fd, on_fanotify, NULL);
+    }
+#endif // HAVE_FANOTIFY
+
     ctx.notify = inotify_init1(IN_NONBLOCK);
     if (ctx.notify != -1) {
-        ctx.handler = handler;
         app_watch(ctx.notify, on_inotify, NULL);
     }
 }
@@ -137,23 +595,44 @@ void fs_monitor_init(fs_monitor_cb handler)
 void fs_monitor_destroy(void)
 {
     if (ctx.notify != -1) {
-        list_for_each(ctx.watch, struct watch, it) {
-            inotify_rm_watch(ctx.notify, it->id);
-            free(it);
+        for (size_t i = 0; i < WATCH_BUCKETS; ++i) {
+            list_for_each(ctx.watch[i], struct watch, it) {
+                inotify_rm_watch(ctx.notify, it->id);
+                free(it);
+            }
+            ctx.watch[i] = NULL;
         }
-        ctx.watch = NULL;
         close(ctx.notify);
         ctx.notify = -1;
     }
+    ctx.exhausted = false;
+
+#ifdef HAVE_FANOTIFY
+    fanotify_free();
+#endif
+
+    for (size_t i = 0; i < ctx.batch.num; ++i) {
+        free((char*)ctx.batch.events[i].path);
+    }
+    free(ctx.batch.events);
+    free(ctx.batch.index);
+    memset(&ctx.batch, 0, sizeof(ctx.batch));
 }
 
 void fs_monitor_add(const char* path)
 {
     struct watch* entry;
+    struct watch** bucket;
     size_t len;
     int id;
 
-    if (ctx.notify == -1) {
+#ifdef HAVE_FANOTIFY
+    if (fanotify_add(path)) {
+        return;
+    }
+#endif
+
+    if (ctx.notify == -1 || ctx.exhausted) {
         return; // not available
     }
 
@@ -162,20 +641,31 @@ void fs_monitor_add(const char* path)
                            IN_MODIFY | IN_CREATE | IN_DELETE | IN_MOVE |
                                IN_DELETE_SELF | IN_MOVE_SELF);
     if (id == -1) {
+        if (errno == ENOSPC) {
+            // don't waste time on the rest of directories
+            ctx.exhausted = true;
+            fprintf(stderr,
+                    "Limit of inotify watches reached, "
+                    "file system monitor is incomplete\n");
+        }
         return;
     }
+    if (watch_find(id)) {
+        return; // already watched (the same inode)
+    }
 
     // allocate entry
     len = strlen(path);
     entry = malloc(sizeof(struct watch) + len);
     if (!entry) {
-        inotify_rm_watch(id, ctx.notify);
+        inotify_rm_watch(ctx.notify, id);
         return;
     }
     entry->id = id;
     memcpy(entry->path, path, len + 1 /*last null*/);
 
-    ctx.watch = list_add(ctx.watch, entry);
+    bucket = watch_bucket(id);
+    *bucket = list_add(*bucket, entry);
 }
 
 #endif // HAVE_INOTIFY
@@ -311,3 +801,66 @@ size_t fs_envpath(const char* env_name, const char* postfix, char* path,
 
     return len;
 }
+
+bool fs_mkdirs(const char* path, mode_t mode)
+{
+    const size_t len = strlen(path);
+    char dir[PATH_MAX];
+    char* delim;
+
+    if (len >= sizeof(dir)) {
+        return false;
+    }
+    memcpy(dir, path, len + 1);
+
+    delim = dir;
+    while ((delim = strchr(delim + 1, '/'))) {
+        *delim = '\0';
+        if (mkdir(dir, mode) && errno != EEXIST) {
+            return false;
+        }
+        *delim = '/';
+    }
+
+    return true;
+}
+
+bool fs_write(int fd, const void* data, size_t size)
+{
+    const uint8_t* ptr = data;
+    bool sock = true;
+
+    while (size) {
+        ssize_t rc;
+        if (sock) {
+            rc = send(fd, ptr, size, MSG_NOSIGNAL);
+            if (rc == -1 && errno == ENOTSOCK) {
+                sock = false;
+                continue;
+            }
+        } else {
+            rc = write(fd, ptr, size);
+        }
+        if (rc == -1 && errno == EINTR) {
+            continue;
+        }
+        if (rc <= 0) {
+            return false;
+        }
+        ptr += rc;
+        size -= rc;
+    }
+
+    return true;
+}
+
+const char* fs_read_str(const uint8_t** ptr, const uint8_t* end)
+{
+    const char* str = (const char*)*ptr;
+    const uint8_t* nul = memchr(*ptr, 0, end - *ptr);
+    if (!nul) {
+        return NULL;
+    }
+    *ptr = nul + 1;
+    return str;
+}
@@ -4,7 +4,10 @@
 
 #pragma once
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
 
 /** File system event types. */
 enum fsevent {
@@ -13,12 +16,19 @@ enum fsevent {
     fsevent_remove,
 };
 
+/** File system event. */
+struct fs_event {
+    enum fsevent type; ///< Event type
+    const char* path;  ///< Absolute path, ends with "/" if it is a directory
+};
+
 /**
- * File system event handler.
- * @param event event type
- * @param path absolute path, ends with "/" if it is a directory
+ * File system event handler, called once for all pending events.
+ * Events for the same path are merged, so each path occurs once.
+ * @param events array of events in order of arrival
+ * @param num number of events in the array
  */
-typedef void (*fs_monitor_cb)(enum fsevent type, const char* path);
+typedef void (*fs_monitor_cb)(const struct fs_event* events, size_t num);
 
 /**
  * Initialize global file system monitor context.
@@ -65,3 +75,31 @@ size_t fs_abspath(const char* relative, char* path, size_t path_max);
  */
 size_t fs_envpath(const char* env_name, const char* postfix, char* path,
                   size_t path_max);
+
+/**
+ * Create all directories of the path ("mkdir -p"): the last component is
+ * created only if the path ends with "/", so for a file path only its
+ * parent directories are created.
+ * @param path path to create
+ * @param mode permissions of the created directories
+ * @return true if directories exist
+ */
+bool fs_mkdirs(const char* path, mode_t mode);
+
+/**
+ * Write whole buffer to the file or socket, interrupted writes are resumed.
+ * Writing to the socket closed by the peer doesn't raise SIGPIPE.
+ * @param fd file descriptor
+ * @param data data to write
+ * @param size size of data in bytes
+ * @return true if all data were written
+ */
+bool fs_write(int fd, const void* data, size_t size);
+
+/**
+ * Read and check the next null-terminated string from the buffer.
+ * @param ptr pointer to the current position, moved to the next string
+ * @param end end of the buffer
+ * @return pointer to the string or NULL if buffer is too small
+ */
+const char* fs_read_str(const uint8_t** ptr, const uint8_t* end);
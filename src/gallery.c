@@ -6,23 +6,112 @@
 
 #include "application.h"
 #include "array.h"
+#include "atlas.h"
+#include "buildcfg.h"
 #include "fs.h"
 #include "imglist.h"
 #include "info.h"
 #include "layout.h"
+#include "loadsvc.h"
+#include "memstat.h"
+#include "predict.h"
+#include "pstore.h"
+#include "tpool.h"
+#include "trace.h"
 #include "ui.h"
 
+#ifdef HAVE_LIBPNG
+#include "xdgthumb.h"
+#endif
+
 #include <assert.h>
-#include <errno.h>
 #include <limits.h>
+#include <math.h>
 #include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/stat.h>
+#include <time.h>
+
+// Thumbnail storage file (relative to the cache directory)
+#define PSTORE_FILE "/swayimg/thumbnails"
 
 // Scale for selected thumbnail
 #define THUMB_SELECTED_SCALE 1.15f
 
+// Number of composited rows cached in addition to the visible ones
+#define STRIP_SPARE 2
+
+// smooth scrolling: time constant of settling rows into place (ms)
+#define SCROLL_TAU 50.0
+// kinetic scrolling: time constant of velocity decay (ms)
+#define SCROLL_KINETIC_TAU 300.0
+// kinetic scrolling: min velocity to keep moving (pixels per ms)
+#define SCROLL_KINETIC_MIN 0.05
+// kinetic scrolling: max pause between the last drag and release (ms)
+#define SCROLL_KINETIC_HOLD 50.0
+// max time step of the scrolling, longer pauses are not animated (ms)
+#define SCROLL_STEP_MAX 100.0
+
+/** Persistent storage of thumbnails. */
+enum pstore_mode {
+    pstore_none, ///< Disabled
+    pstore_db,   ///< Private database file
+    pstore_xdg,  ///< Shared cache (freedesktop.org thumbnail specification)
+};
+
+// Names of persistent storage modes
+static const char* pstore_names[] = {
+    [pstore_none] = CFG_NO,
+    [pstore_db] = CFG_YES,
+    [pstore_xdg] = "xdg",
+};
+
+/** Thumbnail state in the last drawn frame, used to find damaged tiles. */
+struct drawn_thumb {
+    const struct image* img; ///< Image instance
+    const argb_t* thumb;     ///< Thumbnail data
+    size_t x;                ///< Tile position
+    ssize_t y;               ///< Tile position
+    bool selected;           ///< Tile is selected
+};
+
+/** Row of thumbnails composited into a strip, reused while it is visible. */
+struct row_strip {
+    struct pixmap pm;          ///< Strip: window width x thumbnail size
+    struct drawn_thumb* tiles; ///< Thumbnails composited into the strip
+    size_t num;                ///< Number of thumbnails in the strip
+    size_t stamp;              ///< Number of the frame where strip was used
+};
+
+/** Smooth and kinetic scrolling. */
+struct scroll {
+    bool active;          ///< Animation in progress
+    bool drag;            ///< Drag in progress
+    bool kinetic;         ///< Kinetic scrolling in progress
+    double velocity;      ///< Scrolling velocity (pixels per ms)
+    double rest;          ///< Fractional part of the scrolling distance
+    struct timespec move; ///< Time of the last drag event
+    struct timespec last; ///< Time of the last animation step
+};
+
+/** Pre-rendered enlarged tile of the selected thumbnail. */
+struct selected_tile {
+    const struct image* img; ///< Image instance
+    const argb_t* thumb;     ///< Thumbnail data used to render the tile
+    struct pixmap pm;        ///< Rendered tile
+};
+
+/** Thumbnail loader job, each image is loaded by a separate task. */
+struct loader_job {
+    struct image* list;   ///< Head of the image list to load
+    struct image** queue; ///< Images to load, ordered by priority
+    bool* previews;       ///< Flags: thumbnail is created from preview
+    size_t num;           ///< Number of images in the queue
+    bool cancel;          ///< Cancellation flag, set under imglist lock
+};
+
 /** Gallery context. */
 struct gallery {
     size_t cache; ///< Max number of thumbnails in cache
@@ -30,7 +119,8 @@ struct gallery {
 
     enum aa_mode thumb_aa; ///< Anti-aliasing mode
     bool thumb_fill;       ///< Scale mode (fill/fit)
-    bool thumb_pstore;     ///< Use persistent storage for thumbnails
+    enum pstore_mode thumb_pstore; ///< Persistent storage for thumbnails
+    size_t thumb_preview;  ///< Min size of embedded preview, 0 to disable
 
     argb_t clr_window;     ///< Window background
     argb_t clr_background; ///< Tile background
@@ -38,248 +128,460 @@ struct gallery {
     argb_t clr_border;     ///< Selected tile border
     argb_t clr_shadow;     ///< Selected tile shadow
 
-    struct layout layout; ///< Thumbnail layout
+    struct layout layout;   ///< Thumbnail layout
+    struct predict predict; ///< Direction and speed of navigation
+
+    pthread_t loader_tid;             ///< Thumbnail loader thread id
+    pthread_mutex_t loader_lock;      ///< Loader job lock
+    pthread_cond_t loader_wakeup;     ///< New job notification
+    struct loader_job* loader_next;   ///< Pending job
+    struct loader_job* loader_active; ///< Job in progress
+    bool loader_started;              ///< Loader thread is started
+    bool loader_stop;                 ///< Stop flag for loader thread
+    atomic_size_t loader_queue;       ///< Number of thumbnails to load
+
+    struct selected_tile selected; ///< Cached tile of the selected thumbnail
 
-    pthread_t loader_tid; ///< Thumbnail loader thread id
-    bool loader_active;   ///< Preload in progress flag
+    struct drawn_thumb* drawn; ///< Thumbnails shown in the last frame
+    size_t drawn_num;          ///< Number of thumbnails in the last frame
+    bool damage_all;           ///< Entire window must be redrawn
+
+    struct row_strip* strips; ///< Cache of composited rows
+    size_t strips_num;        ///< Number of strips in cache
+    size_t frame;             ///< Number of the current frame
+
+    struct scroll scroll; ///< Smooth and kinetic scrolling
 };
 
 /** Global gallery context. */
-static struct gallery ctx;
+static struct gallery ctx = {
+    .loader_lock = PTHREAD_MUTEX_INITIALIZER,
+    .loader_wakeup = PTHREAD_COND_INITIALIZER,
+};
 
 /**
- * Get path for the thumbnail on persistent storage.
- * @param source original image source
- * @param path output buffer
- * @param path_max size of the buffer
- * @return length of the result path without last null
+ * Remove non-visible thumbnails to save memory.
+ * @param all remove even visible thumbnails
  */
-static size_t pstore_path(const char* source, char* path, size_t path_max)
+static void clear_thumbnails(bool all)
 {
-    char postfix[16];
-    int append_len;
-    size_t len;
+    imglist_lock();
 
-    if (strcmp(source, LDRSRC_STDIN) == 0 ||
-        strncmp(source, LDRSRC_EXEC, LDRSRC_EXEC_LEN) == 0) {
-        return 0;
+    if (all) {
+        struct image* img = imglist_first();
+        ctx.selected.img = NULL;
+        while (img) {
+            image_free(img, IMGFREE_THUMB);
+            img = imglist_next(img);
+        }
+    } else if (ctx.cache) {
+        layout_update(&ctx.layout);
+        layout_clear(&ctx.layout, ctx.cache);
     }
 
-    // get directory to store thumbnails
-    len = fs_envpath("XDG_CACHE_HOME", "/swayimg", path, path_max);
-    if (!len) {
-        len = fs_envpath("HOME", "/.cache/swayimg", path, path_max);
+    imglist_unlock();
+}
+
+/**
+ * Load thumbnail from persistent storage.
+ * @param img image for loading thumbnail
+ * @return true if thumbnail loaded
+ */
+static bool load_stored(struct image* img)
+{
+    switch (ctx.thumb_pstore) {
+        case pstore_db:
+            return pstore_load(img);
+#ifdef HAVE_LIBPNG
+        case pstore_xdg:
+            return xdgthumb_load(img, ctx.layout.thumb_size, ctx.thumb_fill,
+                                 ctx.thumb_aa);
+#endif
+        default:
+            break;
     }
-    if (!len) {
-        return 0;
+    return false;
+}
+
+/**
+ * Save thumbnail to persistent storage.
+ * @param img image with loaded frames and created thumbnail
+ */
+static void save_stored(struct image* img)
+{
+    switch (ctx.thumb_pstore) {
+        case pstore_db:
+            pstore_save(img);
+            break;
+#ifdef HAVE_LIBPNG
+        case pstore_xdg:
+            xdgthumb_save(img, ctx.layout.thumb_size, ctx.thumb_aa);
+            break;
+#endif
+        default:
+            break;
     }
+}
 
-    // append file name
-    append_len = fs_append_path(source, path, path_max);
-    if (!append_len) {
-        return 0;
+/**
+ * Load image and create full quality thumbnail.
+ * @param img image to load
+ * @return true if thumbnail created
+ */
+static bool create_thumbnail(struct image* img)
+{
+    if (image_load_sized(img, ctx.layout.thumb_size) != imgload_success) {
+        return false;
     }
-    len += append_len;
 
-    // append postfix
-    append_len = snprintf(postfix, sizeof(postfix), ".%04x%d%d",
-                          (uint16_t)ctx.layout.thumb_size,
-                          ctx.thumb_fill ? 1 : 0, ctx.thumb_aa);
-    if (append_len <= 0 || len + append_len + 1 >= path_max) {
-        return 0;
+    if (image_thumb_create(img, ctx.layout.thumb_size, ctx.thumb_fill,
+                           ctx.thumb_aa) &&
+        ctx.thumb_pstore != pstore_none) {
+        // save to thumbnail to persistent storage
+        const size_t width = img->frames[0].pm.width;
+        const size_t height = img->frames[0].pm.height;
+        if (width > ctx.layout.thumb_size && height > ctx.layout.thumb_size) {
+            save_stored(img);
+        }
     }
-    memcpy(path + len, postfix, append_len + 1);
-    len += append_len;
+    image_free(img, IMGFREE_FRAMES); // not needed anymore
 
-    return len;
+    return image_has_thumb(img);
 }
 
 /**
- * Save thumbnail on persistent storage.
- * @param img image with thumbnail to save
+ * Create thumbnail from the preview embedded into the image file.
+ * @param img image to load
+ * @return true if thumbnail created
  */
-void pstore_save(const struct image* img)
+static bool create_preview(struct image* img)
 {
-    char path[PATH_MAX];
-    char* delim;
+    if (!ctx.thumb_preview ||
+        image_load_preview(img, ctx.thumb_preview) != imgload_success) {
+        return false;
+    }
+
+    image_thumb_create(img, ctx.layout.thumb_size, ctx.thumb_fill,
+                       ctx.thumb_aa);
+    image_free(img, IMGFREE_FRAMES);
 
-    if (!image_has_thumb(img)) {
+    return image_has_thumb(img);
+}
+
+/**
+ * Thumbnail loader task: load thumbnail and put it to the image list.
+ * @param index index of the image in the loader queue
+ * @param data loader job
+ */
+static void load_task(size_t index, void* data)
+{
+    TRACE_SCOPE("gallery_load_thumb");
+    struct loader_job* job = data;
+    struct image* img = job->queue[index];
+    struct image* origin;
+    bool preview = false;
+    bool from_frame = false;
+    bool published = false;
+    bool cancel;
+    bool own;
+
+    --ctx.loader_queue;
+
+    // wait for the image being decoded by viewer's preloader
+    own = loadsvc_begin(img->source, false);
+
+    // check if thumbnail is already loaded
+    imglist_lock();
+    if (job->cancel) {
+        imglist_unlock();
+        if (own) {
+            loadsvc_end(img->source, false, false);
+        }
         return;
     }
+    origin = imglist_find(img->source);
+    if (origin) {
+        if (image_has_thumb(origin)) {
+            origin = NULL; // already loaded
+        } else {
+            // frames decoded by viewer, only copy them under the lock
+            from_frame =
+                image_thumb_copy(img, origin, ctx.layout.thumb_size);
+        }
+    }
+    imglist_unlock();
 
-    if (!pstore_path(img->source, path, sizeof(path))) {
+    if (!origin) {
+        if (own) {
+            loadsvc_end(img->source, false, true);
+        }
         return;
     }
 
-    // create path
-    delim = path;
-    while (true) {
-        delim = strchr(delim + 1, '/');
-        if (!delim) {
-            break;
+    if (from_frame) {
+        image_thumb_create(img, ctx.layout.thumb_size, ctx.thumb_fill,
+                           ctx.thumb_aa);
+        image_free(img, IMGFREE_FRAMES);
+    }
+
+    // load thumbnail, use embedded preview first to show something
+    // quickly, the full quality thumbnail is loaded after all previews
+    if (!image_has_thumb(img) && !load_stored(img)) {
+        preview = create_preview(img);
+        if (!preview) {
+            create_thumbnail(img);
         }
-        *delim = '\0';
-        if (mkdir(path, S_IRWXU | S_IRWXG) && errno != EEXIST) {
-            return;
+    }
+
+    // put thumbnail to image list
+    imglist_lock();
+    cancel = job->cancel;
+    origin = cancel ? NULL : imglist_find(img->source);
+    if (origin) {
+        if (image_has_thumb(img)) {
+            image_update(origin, img);
+            job->previews[index] = preview;
+            published = true;
+        } else {
+            imglist_remove(origin); // failed to load
         }
-        *delim = '/';
     }
+    imglist_unlock();
 
-    image_thumb_save(img, path);
+    if (own) {
+        loadsvc_end(img->source, false, published);
+    }
+    if (!cancel) {
+        app_redraw();
+    }
 }
 
 /**
- * Load thumbnail from persistent storage.
- * @param img image for loading thumbnail
- * @return true if thumbnail loaded
+ * Thumbnail refine task: replace thumbnail created from preview with the
+ * full quality one.
+ * @param index index of the image in the loader queue
+ * @param data loader job
  */
-bool pstore_load(struct image* img)
+static void refine_task(size_t index, void* data)
 {
-    char path[PATH_MAX];
-    struct stat st_image;
-    struct stat st_thumb;
+    TRACE_SCOPE("gallery_refine_thumb");
+    struct loader_job* job = data;
+    struct image* img = job->queue[index];
+    struct image* origin;
 
-    if (!pstore_path(img->source, path, sizeof(path))) {
-        return false;
+    if (!job->previews[index] || job->cancel || !create_thumbnail(img)) {
+        return; // keep preview
     }
 
-    // check modification time
-    if (stat(img->source, &st_image) == -1 || stat(path, &st_thumb) == -1 ||
-        st_image.st_mtim.tv_sec > st_thumb.st_mtim.tv_sec) {
-        return false;
+    imglist_lock();
+    if (job->cancel) {
+        imglist_unlock();
+        return;
     }
+    origin = imglist_find(img->source);
+    if (origin) {
+        image_free(origin, IMGFREE_THUMB);
+        image_update(origin, img);
+    }
+    imglist_unlock();
 
-    return image_thumb_load(img, path);
+    app_redraw();
 }
 
 /**
- * Remove non-visible thumbnails to save memory.
- * @param all remove even visible thumbnails
+ * Create thumbnail loader job.
+ * @param list head of image list to load
+ * @return pointer to the job or NULL on errors
  */
-static void clear_thumbnails(bool all)
+static struct loader_job* loader_job_create(struct image* list)
 {
-    imglist_lock();
+    struct loader_job* job;
+    size_t index = 0;
 
-    if (all) {
-        struct image* img = imglist_first();
-        while (img) {
-            image_free(img, IMGFREE_THUMB);
-            img = imglist_next(img);
-        }
-    } else if (ctx.cache) {
-        layout_update(&ctx.layout);
-        layout_clear(&ctx.layout, ctx.cache);
+    job = calloc(1, sizeof(*job));
+    if (!job) {
+        return NULL;
     }
 
-    imglist_unlock();
+    job->list = list;
+    job->num = list_size(&list->list);
+    job->queue = malloc(job->num * sizeof(*job->queue));
+    job->previews = calloc(job->num, sizeof(*job->previews));
+    if (!job->queue || !job->previews) {
+        free(job->queue);
+        free(job->previews);
+        free(job);
+        return NULL;
+    }
+
+    list_for_each(list, struct image, it) {
+        it->cancel = &job->cancel; // allow decoders to stop
+        job->queue[index++] = it;
+    }
+
+    return job;
 }
 
 /**
- * Thumbnail loader thread.
+ * Free thumbnail loader job.
+ * @param job pointer to the job to free
  */
-static void* loader_thread(void* data)
+static void loader_job_free(struct loader_job* job)
 {
-    struct image* queue = data;
+    if (job) {
+        list_for_each(job->list, struct image, it) {
+            image_free(it, IMGFREE_ALL);
+        }
+        free(job->queue);
+        free(job->previews);
+        free(job);
+    }
+}
 
-    list_for_each(queue, struct image, it) {
-        struct image* origin;
+/**
+ * Thumbnail loader thread: persistent, waits for jobs, each job is processed
+ * by thread pool workers.
+ */
+static void* loader_thread(__attribute__((unused)) void* data)
+{
+    pthread_mutex_lock(&ctx.loader_lock);
 
-        // check if thumbnail is already loaded
-        imglist_lock();
-        if (!ctx.loader_active) {
-            imglist_unlock();
-            break;
-        }
-        origin = imglist_find(it->source);
-        if (origin) {
-            if (image_has_thumb(origin)) {
-                origin = NULL; // already loaded
-            }
-            if (image_thumb_create(origin, ctx.layout.thumb_size,
-                                   ctx.thumb_fill, ctx.thumb_aa)) {
-                app_redraw();
-                origin = NULL; // loaded from frame data
-            }
-        }
-        imglist_unlock();
+    while (!ctx.loader_stop) {
+        struct loader_job* job = ctx.loader_next;
+        struct trace_span span;
+        bool cancel;
 
-        if (!origin) {
+        if (!job) {
+            pthread_cond_wait(&ctx.loader_wakeup, &ctx.loader_lock);
             continue;
         }
-
-        // load thumbnail
-        if (!ctx.thumb_pstore || !pstore_load(it)) {
-            if (image_load(it) == imgload_success) {
-                if (image_thumb_create(it, ctx.layout.thumb_size,
-                                       ctx.thumb_fill, ctx.thumb_aa) &&
-                    ctx.thumb_pstore) {
-                    // save to thumbnail to persistent storage
-                    const size_t width = it->frames[0].pm.width;
-                    const size_t height = it->frames[0].pm.height;
-                    if (width > ctx.layout.thumb_size &&
-                        height > ctx.layout.thumb_size) {
-                        pstore_save(it);
-                    }
-                }
-                image_free(it, IMGFREE_FRAMES); // not needed anymore
-            }
+        ctx.loader_next = NULL;
+        ctx.loader_active = job;
+        pthread_mutex_unlock(&ctx.loader_lock);
+
+        span = trace_begin("gallery_loader");
+        ctx.loader_queue = job->num;
+        tpool_run(job->num, load_task, job);
+        if (ctx.thumb_preview) {
+            tpool_run(job->num, refine_task, job);
         }
+        trace_end(&span);
 
-        // put thumbnail to image list
         imglist_lock();
-        if (!ctx.loader_active) {
-            imglist_unlock();
-            break;
-        }
-        origin = imglist_find(it->source);
-        if (origin) {
-            if (image_has_thumb(it)) {
-                image_update(origin, it);
-            } else {
-                imglist_remove(origin); // failed to load
-            }
-        }
+        cancel = job->cancel;
         imglist_unlock();
+        if (!cancel) {
+            clear_thumbnails(false);
+        }
 
-        app_redraw();
+        pthread_mutex_lock(&ctx.loader_lock);
+        ctx.loader_active = NULL;
+        loader_job_free(job);
     }
 
-    // free the queue
-    list_for_each(queue, struct image, it) {
-        image_free(it, IMGFREE_ALL);
-    }
-    if (ctx.loader_active) {
-        clear_thumbnails(false);
-    }
+    pthread_mutex_unlock(&ctx.loader_lock);
 
-    ctx.loader_active = false;
     return NULL;
 }
 
 /**
- * Start thumbnail loader thread.
- * @param queue head of image list to load
+ * Replace the thumbnail loader job: the current job is cancelled without
+ * waiting, the new one is started as soon as the loader is free.
+ * @param queue head of image list to load, NULL to stop loading
  */
 static void loader_restart(struct image* queue)
 {
+    struct loader_job* job = NULL;
+
+    if (queue) {
+        job = loader_job_create(queue);
+        if (!job) {
+            list_for_each(queue, struct image, it) {
+                image_free(it, IMGFREE_ALL);
+            }
+        }
+    }
+
+    imglist_lock();
+    pthread_mutex_lock(&ctx.loader_lock);
+
     if (ctx.loader_active) {
-        ctx.loader_active = false;
-        pthread_join(ctx.loader_tid, NULL);
+        ctx.loader_active->cancel = true;
     }
-    if (queue) {
-        ctx.loader_active = true;
-        pthread_create(&ctx.loader_tid, NULL, loader_thread, queue);
+    loader_job_free(ctx.loader_next);
+    ctx.loader_next = job;
+
+    if (job && !ctx.loader_started) {
+        ctx.loader_started =
+            pthread_create(&ctx.loader_tid, NULL, loader_thread, NULL) == 0;
+    }
+    pthread_cond_signal(&ctx.loader_wakeup);
+
+    pthread_mutex_unlock(&ctx.loader_lock);
+    imglist_unlock();
+}
+
+/**
+ * Check if thumbnail loader has a job that is not cancelled.
+ * @return true if loader is busy
+ */
+static bool loader_busy(void)
+{
+    bool busy;
+
+    pthread_mutex_lock(&ctx.loader_lock);
+    busy = ctx.loader_next ||
+        (ctx.loader_active && !ctx.loader_active->cancel);
+    pthread_mutex_unlock(&ctx.loader_lock);
+
+    return busy;
+}
+
+/**
+ * Stop thumbnail loader thread.
+ */
+static void loader_destroy(void)
+{
+    loader_restart(NULL);
+
+    pthread_mutex_lock(&ctx.loader_lock);
+    ctx.loader_stop = true;
+    pthread_cond_signal(&ctx.loader_wakeup);
+    pthread_mutex_unlock(&ctx.loader_lock);
+
+    if (ctx.loader_started) {
+        pthread_join(ctx.loader_tid, NULL);
+        ctx.loader_started = false;
     }
 }
 
+/**
+ * Create queue of thumbnails to load, must be called with the list locked.
+ * Invisible thumbnails are preloaded mostly in the direction of navigation.
+ * @return queue head, NULL if all thumbnails are loaded
+ */
+static struct image* load_queue(void)
+{
+    size_t ahead = ctx.cache - ctx.cache / 2;
+    size_t behind = ctx.cache / 2;
+
+    predict_split(&ctx.predict, &ahead, &behind);
+
+    return predict_direction(&ctx.predict) < 0
+        ? layout_ldqueue(&ctx.layout, behind, ahead)
+        : layout_ldqueue(&ctx.layout, ahead, behind);
+}
+
 /**
  * Select next file.
  * @param direction next image position in list
+ * @param repeat number of steps
  * @return true if next image was selected
  */
-static bool select_next(enum action_type direction)
+static bool select_next(enum action_type direction, size_t repeat)
 {
     bool rc = false;
+    const struct image* prev;
     struct image* load = NULL;
     enum layout_dir dir;
 
@@ -316,9 +618,18 @@ static bool select_next(enum action_type direction)
     }
 
     imglist_lock();
-    rc = layout_select(&ctx.layout, dir);
+    prev = ctx.layout.current;
+    while (repeat-- && layout_select(&ctx.layout, dir)) {
+        rc = true;
+    }
     if (rc) {
-        load = layout_ldqueue(&ctx.layout, ctx.cache);
+        if (dir == layout_first || dir == layout_last) {
+            predict_reset(&ctx.predict);
+        } else {
+            predict_move(&ctx.predict,
+                         imglist_distance(prev, ctx.layout.current));
+        }
+        load = load_queue();
     }
     imglist_unlock();
 
@@ -353,86 +664,332 @@ static void skip_current(bool remove)
     }
 }
 
+/** Free cache of composited rows. */
+static void free_strips(void)
+{
+    for (size_t i = 0; i < ctx.strips_num; ++i) {
+        pixmap_free(&ctx.strips[i].pm);
+        free(ctx.strips[i].tiles);
+    }
+    free(ctx.strips);
+    ctx.strips = NULL;
+    ctx.strips_num = 0;
+}
+
 /** Reload. */
 static void reload(void)
 {
     loader_restart(NULL);
     clear_thumbnails(true);
+    free_strips();
+    ctx.damage_all = true;
     app_redraw();
 }
 
 /**
- * Draw thumbnail.
+ * Get area of the selected thumbnail tile.
  * @param window destination window
- * @param thumb thumbnail description
+ * @param lth thumbnail description
+ * @param x,y,size output tile position and size
+ */
+static void selected_area(const struct pixmap* window,
+                          const struct layout_thumb* lth, ssize_t* x,
+                          ssize_t* y, size_t* size)
+{
+    const size_t thumb_size = THUMB_SELECTED_SCALE * ctx.layout.thumb_size;
+    const ssize_t thumb_offset = (thumb_size - ctx.layout.thumb_size) / 2;
+
+    *x = max(0, (ssize_t)lth->x - thumb_offset);
+    // don't leave the window, but follow the row scrolled out of it
+    *y = max(min(0, lth->y), lth->y - thumb_offset);
+    if (*x + thumb_size >= window->width) {
+        *x = window->width - thumb_size;
+    }
+    *size = thumb_size;
+}
+
+/**
+ * Get enlarged tile of the selected thumbnail, the tile is rendered only
+ * when the selection or the thumbnail is changed.
+ * @param img selected image with thumbnail
+ * @param size size of the selected tile
+ * @return pointer to the tile or NULL on errors
  */
-static void draw_thumbnail(struct pixmap* window,
-                           const struct layout_thumb* lth)
+static const struct pixmap* selected_tile(const struct image* img, size_t size)
+{
+    const struct pixmap* thumb = &img->thumbnail;
+    struct pixmap* tile = &ctx.selected.pm;
+    size_t thumb_w, thumb_h;
+
+    if (ctx.selected.img == img && ctx.selected.thumb == thumb->data &&
+        tile->width == size) {
+        return tile;
+    }
+
+    if (tile->width != size || !tile->data) {
+        pixmap_free(tile);
+        tile->data = NULL;
+        tile->width = 0;
+        if (!pixmap_create(tile, size, size)) {
+            ctx.selected.img = NULL;
+            return NULL;
+        }
+    }
+
+    pixmap_fill(tile, 0, 0, size, size, ctx.clr_select);
+    thumb_w = thumb->width * THUMB_SELECTED_SCALE;
+    thumb_h = thumb->height * THUMB_SELECTED_SCALE;
+    pixmap_scale(ctx.thumb_aa, thumb, tile, size / 2 - thumb_w / 2,
+                 size / 2 - thumb_h / 2, THUMB_SELECTED_SCALE, img->alpha);
+
+    ctx.selected.img = img;
+    ctx.selected.thumb = thumb->data;
+
+    return tile;
+}
+
+/**
+ * Draw non-selected thumbnail tile.
+ * @param dst destination pixmap
+ * @param lth thumbnail description
+ * @param y vertical position of the tile on the destination pixmap
+ */
+static void draw_tile(struct pixmap* dst, const struct layout_thumb* lth,
+                      ssize_t y)
 {
     const struct pixmap* pm =
         image_has_thumb(lth->img) ? &lth->img->thumbnail : NULL;
     ssize_t x = lth->x;
-    ssize_t y = lth->y;
 
-    if (lth != layout_current(&ctx.layout)) {
-        pixmap_fill(window, x, y, ctx.layout.thumb_size, ctx.layout.thumb_size,
+    // background is not visible under opaque thumbnail of the tile size
+    if (!pm || lth->img->alpha || pm->width != ctx.layout.thumb_size ||
+        pm->height != ctx.layout.thumb_size) {
+        pixmap_fill(dst, x, y, ctx.layout.thumb_size, ctx.layout.thumb_size,
                     ctx.clr_background);
-        if (pm) {
-            x += ctx.layout.thumb_size / 2 - pm->width / 2;
-            y += ctx.layout.thumb_size / 2 - pm->height / 2;
-            pixmap_copy(pm, window, x, y, lth->img->alpha);
-        }
+    }
+    if (pm) {
+        x += ctx.layout.thumb_size / 2 - pm->width / 2;
+        y += ctx.layout.thumb_size / 2 - pm->height / 2;
+        pixmap_copy(pm, dst, x, y, lth->img->alpha);
+    }
+}
+
+/**
+ * Draw currently selected thumbnail.
+ * @param window destination window
+ * @param lth thumbnail description
+ */
+static void draw_selected(struct pixmap* window,
+                          const struct layout_thumb* lth)
+{
+    const struct pixmap* pm =
+        image_has_thumb(lth->img) ? &lth->img->thumbnail : NULL;
+    const struct pixmap* tile;
+    ssize_t x, y;
+    size_t thumb_size;
+
+    selected_area(window, lth, &x, &y, &thumb_size);
+
+    // enlarged thumbnail is rendered once, then just copied
+    tile = pm ? selected_tile(lth->img, thumb_size) : NULL;
+    if (tile) {
+        pixmap_copy(tile, window, x, y, false);
     } else {
-        // currently selected item
-        const size_t thumb_size = THUMB_SELECTED_SCALE * ctx.layout.thumb_size;
-        const ssize_t thumb_offset = (thumb_size - ctx.layout.thumb_size) / 2;
+        pixmap_fill(window, x, y, thumb_size, thumb_size, ctx.clr_select);
+    }
 
-        x = max(0, x - thumb_offset);
-        y = max(0, y - thumb_offset);
-        if (x + thumb_size >= window->width) {
-            x = window->width - thumb_size;
+    // shadow
+    if (ARGB_GET_A(ctx.clr_shadow)) {
+        const argb_t base = ctx.clr_shadow & 0x00ffffff;
+        const uint8_t alpha = ARGB_GET_A(ctx.clr_shadow);
+        const size_t width =
+            max(1, (double)thumb_size / 15.0 * ((double)alpha / 255.0));
+        const size_t alpha_step = alpha / width;
+
+        for (size_t i = 0; i < width; ++i) {
+            const ssize_t lx = i + x + thumb_size;
+            const ssize_t ly = y + width;
+            const size_t lh = thumb_size - (width - i);
+            const argb_t color = base | ARGB_SET_A(alpha - i * alpha_step);
+            pixmap_vline(window, lx, ly, lh, color);
         }
+        for (size_t i = 0; i < width; ++i) {
+            const ssize_t lx = x + width;
+            const ssize_t ly = y + thumb_size + i;
+            const size_t lw = thumb_size - (width - i) + 1;
+            const argb_t color = base | ARGB_SET_A(alpha - i * alpha_step);
+            pixmap_hline(window, lx, ly, lw, color);
+        }
+    }
 
-        pixmap_fill(window, x, y, thumb_size, thumb_size, ctx.clr_select);
+    // border
+    if (ARGB_GET_A(ctx.clr_border)) {
+        pixmap_rect(window, x, y, thumb_size, thumb_size, ctx.clr_border);
+    }
+}
 
-        if (pm) {
-            const size_t thumb_w = pm->width * THUMB_SELECTED_SCALE;
-            const size_t thumb_h = pm->height * THUMB_SELECTED_SCALE;
-            const ssize_t tx = x + thumb_size / 2 - thumb_w / 2;
-            const ssize_t ty = y + thumb_size / 2 - thumb_h / 2;
-            pixmap_scale(ctx.thumb_aa, pm, window, tx, ty, THUMB_SELECTED_SCALE,
-                         lth->img->alpha);
-        }
-
-        // shadow
-        if (ARGB_GET_A(ctx.clr_shadow)) {
-            const argb_t base = ctx.clr_shadow & 0x00ffffff;
-            const uint8_t alpha = ARGB_GET_A(ctx.clr_shadow);
-            const size_t width =
-                max(1, (double)thumb_size / 15.0 * ((double)alpha / 255.0));
-            const size_t alpha_step = alpha / width;
-
-            for (size_t i = 0; i < width; ++i) {
-                const ssize_t lx = i + x + thumb_size;
-                const ssize_t ly = y + width;
-                const size_t lh = thumb_size - (width - i);
-                const argb_t color = base | ARGB_SET_A(alpha - i * alpha_step);
-                pixmap_vline(window, lx, ly, lh, color);
-            }
-            for (size_t i = 0; i < width; ++i) {
-                const ssize_t lx = x + width;
-                const ssize_t ly = y + thumb_size + i;
-                const size_t lw = thumb_size - (width - i) + 1;
-                const argb_t color = base | ARGB_SET_A(alpha - i * alpha_step);
-                pixmap_hline(window, lx, ly, lw, color);
+/**
+ * Mark tile as damaged.
+ * @param window destination window
+ * @param lth thumbnail description
+ * @param selected flag to use area of the selected tile
+ */
+static void damage_thumbnail(const struct pixmap* window,
+                             const struct layout_thumb* lth, bool selected)
+{
+    if (selected) {
+        ssize_t x, y;
+        size_t size;
+        selected_area(window, lth, &x, &y, &size);
+        // shadow is drawn outside the tile
+        ui_damage(x, y, size + size / 15 + 2, size + size / 15 + 2);
+    } else {
+        ui_damage(lth->x, lth->y, ctx.layout.thumb_size,
+                  ctx.layout.thumb_size);
+    }
+}
+
+/**
+ * Compare thumbnails with the previous frame and report damaged tiles.
+ * @param window destination window
+ */
+static void damage_thumbnails(const struct pixmap* window)
+{
+    const struct layout_thumb* current = layout_current(&ctx.layout);
+    struct drawn_thumb* drawn = ctx.drawn;
+    bool full = ctx.damage_all || ctx.drawn_num != ctx.layout.thumb_total;
+
+    // layout must be the same, otherwise the entire window is damaged
+    for (size_t i = 0; !full && i < ctx.layout.thumb_total; ++i) {
+        const struct layout_thumb* lth = &ctx.layout.thumbs[i];
+        full = drawn[i].img != lth->img || drawn[i].x != lth->x ||
+            drawn[i].y != lth->y;
+    }
+
+    if (!full) {
+        ui_damage_partial();
+        for (size_t i = 0; i < ctx.layout.thumb_total; ++i) {
+            const struct layout_thumb* lth = &ctx.layout.thumbs[i];
+            const bool selected = (lth == current);
+            if (drawn[i].selected != selected ||
+                drawn[i].thumb != lth->img->thumbnail.data) {
+                damage_thumbnail(window, lth, drawn[i].selected);
+                damage_thumbnail(window, lth, selected);
             }
         }
+    }
+
+    // save current state
+    if (ctx.drawn_num != ctx.layout.thumb_total) {
+        drawn = realloc(ctx.drawn, ctx.layout.thumb_total * sizeof(*drawn));
+        if (!drawn) {
+            free(ctx.drawn);
+            ctx.drawn = NULL;
+            ctx.drawn_num = 0;
+            ctx.damage_all = true;
+            return;
+        }
+        ctx.drawn = drawn;
+        ctx.drawn_num = ctx.layout.thumb_total;
+    }
+    for (size_t i = 0; i < ctx.layout.thumb_total; ++i) {
+        const struct layout_thumb* lth = &ctx.layout.thumbs[i];
+        drawn[i].img = lth->img;
+        drawn[i].thumb = lth->img->thumbnail.data;
+        drawn[i].x = lth->x;
+        drawn[i].y = lth->y;
+        drawn[i].selected = (lth == current);
+    }
+    ctx.damage_all = false;
+}
+
+/**
+ * Check if the strip contains the row of thumbnails.
+ * @param strip row strip to check
+ * @param row first thumbnail of the row
+ * @param num number of thumbnails in the row
+ * @param width width of the window
+ * @return true if the strip can be reused
+ */
+static bool strip_match(const struct row_strip* strip,
+                        const struct layout_thumb* row, size_t num,
+                        size_t width)
+{
+    if (strip->num != num || strip->pm.width != width ||
+        strip->pm.height != ctx.layout.thumb_size) {
+        return false;
+    }
+    for (size_t i = 0; i < num; ++i) {
+        const struct drawn_thumb* tile = &strip->tiles[i];
+        if (tile->img != row[i].img || tile->x != row[i].x ||
+            tile->thumb != row[i].img->thumbnail.data) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Get strip with composited row of thumbnails: the strip is taken from
+ * cache, only rows that were not visible before or with changed thumbnails
+ * are composited.
+ * @param row first thumbnail of the row
+ * @param num number of thumbnails in the row
+ * @param width width of the window
+ * @return pointer to the strip or NULL on errors
+ */
+static const struct pixmap* strip_get(const struct layout_thumb* row,
+                                      size_t num, size_t width)
+{
+    struct row_strip* strip = NULL;
+    struct drawn_thumb* tiles;
+
+    for (size_t i = 0; i < ctx.strips_num; ++i) {
+        if (strip_match(&ctx.strips[i], row, num, width)) {
+            ctx.strips[i].stamp = ctx.frame;
+            return &ctx.strips[i].pm;
+        }
+    }
 
-        // border
-        if (ARGB_GET_A(ctx.clr_border)) {
-            pixmap_rect(window, x, y, thumb_size, thumb_size, ctx.clr_border);
+    // reuse the least recently used strip
+    for (size_t i = 0; i < ctx.strips_num; ++i) {
+        if (!strip || ctx.strips[i].stamp < strip->stamp) {
+            strip = &ctx.strips[i];
         }
     }
+    if (!strip || strip->stamp == ctx.frame) {
+        return NULL; // all strips are in use
+    }
+
+    strip->num = 0;
+    if (strip->pm.width != width || strip->pm.height != ctx.layout.thumb_size) {
+        pixmap_free(&strip->pm);
+        strip->pm.data = NULL;
+        strip->pm.width = 0;
+        if (!pixmap_create(&strip->pm, width, ctx.layout.thumb_size)) {
+            return NULL;
+        }
+    }
+    tiles = realloc(strip->tiles, num * sizeof(*tiles));
+    if (!tiles) {
+        return NULL;
+    }
+    strip->tiles = tiles;
+
+    pixmap_fill(&strip->pm, 0, 0, width, ctx.layout.thumb_size,
+                ctx.clr_window);
+    for (size_t i = 0; i < num; ++i) {
+        draw_tile(&strip->pm, &row[i], 0);
+        tiles[i].img = row[i].img;
+        tiles[i].thumb = row[i].img->thumbnail.data;
+        tiles[i].x = row[i].x;
+        tiles[i].y = 0;
+        tiles[i].selected = false;
+    }
+    strip->num = num;
+    strip->stamp = ctx.frame;
+
+    return &strip->pm;
 }
 
 /**
@@ -441,25 +998,56 @@ static void draw_thumbnail(struct pixmap* window,
  */
 static void draw_thumbnails(struct pixmap* window)
 {
+    const size_t columns = ctx.layout.columns;
     struct image* load = NULL;
     bool all_loaded = true;
+    size_t rows;
 
     imglist_lock();
     layout_update(&ctx.layout);
+    damage_thumbnails(window);
+
+    // grow cache of strips to hold all visible rows
+    rows = (ctx.layout.thumb_total + columns - 1) / columns + STRIP_SPARE;
+    if (rows > ctx.strips_num) {
+        struct row_strip* strips =
+            realloc(ctx.strips, rows * sizeof(*ctx.strips));
+        if (strips) {
+            memset(&strips[ctx.strips_num], 0,
+                   (rows - ctx.strips_num) * sizeof(*strips));
+            ctx.strips = strips;
+            ctx.strips_num = rows;
+        }
+    }
+    ++ctx.frame;
 
-    // draw all exclude the currently selected
-    for (size_t i = 0; i < ctx.layout.thumb_total; ++i) {
-        const struct layout_thumb* thumb = &ctx.layout.thumbs[i];
-        all_loaded &= image_has_thumb(thumb->img);
-        if (thumb != layout_current(&ctx.layout)) {
-            draw_thumbnail(window, thumb);
+    // draw rows, the selected tile is drawn over its row
+    for (size_t i = 0; i < ctx.layout.thumb_total; i += columns) {
+        const struct layout_thumb* row = &ctx.layout.thumbs[i];
+        const size_t num = min(columns, ctx.layout.thumb_total - i);
+        const struct pixmap* strip;
+
+        for (size_t j = 0; j < num; ++j) {
+            all_loaded &= image_has_thumb(row[j].img);
+        }
+        if (row->y + (ssize_t)ctx.layout.thumb_size <= 0 ||
+            row->y >= (ssize_t)window->height) {
+            continue; // scrolled out of the window
+        }
+
+        strip = strip_get(row, num, window->width);
+        if (strip) {
+            pixmap_copy(strip, window, 0, row->y, false);
+        } else {
+            for (size_t j = 0; j < num; ++j) {
+                draw_tile(window, &row[j], row[j].y);
+            }
         }
     }
-    // draw only currently selected
-    draw_thumbnail(window, layout_current(&ctx.layout));
+    draw_selected(window, layout_current(&ctx.layout));
 
-    if (!all_loaded && !ctx.loader_active) {
-        load = layout_ldqueue(&ctx.layout, ctx.cache);
+    if (!all_loaded && !loader_busy()) {
+        load = load_queue();
     }
 
     imglist_unlock();
@@ -469,11 +1057,111 @@ static void draw_thumbnails(struct pixmap* window)
     }
 }
 
+/**
+ * Get time elapsed since the start point.
+ * @param start start point
+ * @return elapsed time in milliseconds
+ */
+static double elapsed_ms(const struct timespec* start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000.0 +
+        (now.tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+/**
+ * Scroll the view.
+ * @param delta scroll distance in pixels, positive to scroll down
+ * @return true if the view was changed
+ */
+static bool scroll_view(ssize_t delta)
+{
+    const struct image* prev = ctx.layout.current;
+    struct image* load = NULL;
+    bool changed;
+
+    imglist_lock();
+    changed = layout_scroll(&ctx.layout, delta);
+    if (ctx.layout.current != prev) {
+        predict_move(&ctx.predict, imglist_distance(prev, ctx.layout.current));
+        load = load_queue();
+    }
+    imglist_unlock();
+
+    if (ctx.layout.current != prev) {
+        if (load) {
+            loader_restart(load);
+        }
+        info_reset(ctx.layout.current);
+    }
+    if (changed) {
+        app_redraw();
+    }
+
+    return changed;
+}
+
+/**
+ * Move scrolling one step: settle rows into place or keep scrolling after
+ * mouse drag, called before each redraw, the next step is requested as a
+ * redraw too, so the animation is paced by the compositor's frames.
+ */
+static void scroll_step(void)
+{
+    double dt;
+
+    if (ctx.scroll.drag ||
+        (!ctx.scroll.kinetic && ctx.layout.scroll == 0)) {
+        ctx.scroll.active = false;
+        return;
+    }
+
+    dt = ctx.scroll.active ? elapsed_ms(&ctx.scroll.last) : 0;
+    clock_gettime(CLOCK_MONOTONIC, &ctx.scroll.last);
+    ctx.scroll.active = true;
+    if (dt > SCROLL_STEP_MAX) {
+        dt = SCROLL_STEP_MAX;
+    }
+
+    if (ctx.scroll.kinetic) {
+        ssize_t delta;
+        ctx.scroll.rest += ctx.scroll.velocity * dt;
+        delta = ctx.scroll.rest;
+        ctx.scroll.rest -= delta;
+        ctx.scroll.velocity *= exp(-dt / SCROLL_KINETIC_TAU);
+        if ((delta && !scroll_view(-delta)) ||
+            fabs(ctx.scroll.velocity) < SCROLL_KINETIC_MIN) {
+            ctx.scroll.kinetic = false; // stopped or hit the edge
+        }
+    } else if (ctx.layout.smooth) {
+        const double scroll = ctx.layout.scroll * exp(-dt / SCROLL_TAU);
+        ctx.layout.scroll = labs(lround(scroll)) <= 1 ? 0 : lround(scroll);
+    } else {
+        ctx.layout.scroll = 0;
+    }
+
+    app_redraw(); // next step or the final position
+}
+
 /** Mode handler: window redraw. */
 static void on_redraw(struct pixmap* window)
 {
+    scroll_step();
     pixmap_fill(window, 0, 0, window->width, window->height, ctx.clr_window);
     draw_thumbnails(window);
+    if (info_has_field(info_memory)) {
+        info_update(info_memory, "%.02f MiB",
+                    (double)atlas_memory() / (1024 * 1024));
+    }
+    if (info_has_field(info_memstat)) {
+        char summary[256];
+        memstat_summary(summary, sizeof(summary));
+        info_update(info_memstat, "%s", summary);
+    }
+    if (info_has_field(info_queue)) {
+        info_update(info_queue, "%zu", (size_t)ctx.loader_queue);
+    }
     info_print(window);
 }
 
@@ -482,13 +1170,56 @@ static void on_resize(void)
 {
     loader_restart(NULL);
 
+    ctx.scroll.kinetic = false;
+
     imglist_lock();
+    ctx.layout.scroll = 0;
     layout_resize(&ctx.layout, ui_get_width(), ui_get_height());
     imglist_unlock();
+
+    ctx.damage_all = true;
+}
+
+/** Mode handler: mouse drag. */
+static void on_drag(__attribute__((unused)) int dx, int dy)
+{
+    struct timespec now;
+    double dt;
+
+    ctx.scroll.drag = true;
+    ctx.scroll.kinetic = false;
+
+    // estimate scrolling velocity for kinetic scrolling after release
+    dt = elapsed_ms(&ctx.scroll.move);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    ctx.scroll.move = now;
+    if (dt > 0 && dt < SCROLL_STEP_MAX) {
+        ctx.scroll.velocity = (ctx.scroll.velocity + dy / dt) / 2;
+    } else {
+        ctx.scroll.velocity = 0;
+    }
+
+    scroll_view(-dy);
+}
+
+/** Mode handler: end of mouse drag. */
+static void on_drop(void)
+{
+    ctx.scroll.drag = false;
+
+    // keep scrolling if the pointer was still moving at release
+    if (ctx.layout.smooth &&
+        elapsed_ms(&ctx.scroll.move) < SCROLL_KINETIC_HOLD &&
+        fabs(ctx.scroll.velocity) >= SCROLL_KINETIC_MIN) {
+        ctx.scroll.kinetic = true;
+        ctx.scroll.rest = 0;
+    }
+
+    app_redraw(); // settle rows into place
 }
 
 /** Mode handler: apply action. */
-static void on_action(const struct action* action)
+static void on_action(const struct action* action, size_t repeat)
 {
     switch (action->type) {
         case action_antialiasing:
@@ -507,7 +1238,7 @@ static void on_action(const struct action* action)
         case action_step_down:
         case action_page_up:
         case action_page_down:
-            select_next(action->type);
+            select_next(action->type, repeat);
             break;
         case action_skip_file:
             imglist_lock();
@@ -539,6 +1270,7 @@ static void on_imglist(const struct image* image, enum fsevent event)
             }
             break;
     }
+    ctx.damage_all = true;
     app_redraw();
 }
 
@@ -555,6 +1287,7 @@ static void on_activate(struct image* image)
 
     ctx.layout.current = image;
     layout_resize(&ctx.layout, ui_get_width(), ui_get_height());
+    ctx.damage_all = true;
 
     if (!image_has_thumb(image)) {
         image_thumb_create(image, ctx.layout.thumb_size, ctx.thumb_fill,
@@ -577,13 +1310,40 @@ void gallery_init(const struct config* cfg, struct mode_handlers* handlers)
 {
     const size_t ts = config_get_num(cfg, CFG_GALLERY, CFG_GLRY_SIZE, 1, 4096);
     layout_init(&ctx.layout, ts);
+    ctx.layout.smooth = config_get_bool(cfg, CFG_GALLERY, CFG_GLRY_SMOOTH);
+    atlas_init(ts, ts);
 
     ctx.cache = config_get_num(cfg, CFG_GALLERY, CFG_GLRY_CACHE, 0, SSIZE_MAX);
     ctx.preload = config_get_bool(cfg, CFG_GALLERY, CFG_GLRY_PRELOAD);
 
     ctx.thumb_aa = aa_init(cfg, CFG_GALLERY, CFG_GLRY_AA);
     ctx.thumb_fill = config_get_bool(cfg, CFG_GALLERY, CFG_GLRY_FILL);
-    ctx.thumb_pstore = config_get_bool(cfg, CFG_GALLERY, CFG_GLRY_PSTORE);
+    ctx.thumb_pstore = config_get_oneof(cfg, CFG_GALLERY, CFG_GLRY_PSTORE,
+                                        pstore_names, ARRAY_SIZE(pstore_names));
+    ctx.thumb_preview =
+        config_get_num(cfg, CFG_GALLERY, CFG_GLRY_PREVIEW, 0, 4096);
+
+    if (ctx.thumb_pstore == pstore_db) {
+        // thumbnail parameters are part of the key in the storage
+        const uint32_t params = (uint32_t)ctx.layout.thumb_size << 8 |
+            (ctx.thumb_fill ? 1 : 0) << 4 | ctx.thumb_aa;
+        char path[PATH_MAX];
+        if (!fs_envpath("XDG_CACHE_HOME", PSTORE_FILE, path, sizeof(path)) &&
+            !fs_envpath("HOME", "/.cache" PSTORE_FILE, path, sizeof(path))) {
+            ctx.thumb_pstore = pstore_none;
+        } else if (!pstore_open(path, params)) {
+            ctx.thumb_pstore = pstore_none;
+        }
+    } else if (ctx.thumb_pstore == pstore_xdg) {
+#ifdef HAVE_LIBPNG
+        if (!xdgthumb_init()) {
+            ctx.thumb_pstore = pstore_none;
+        }
+#else
+        fprintf(stderr, "WARNING: XDG thumbnails require PNG support\n");
+        ctx.thumb_pstore = pstore_none;
+#endif
+    }
 
     ctx.clr_window = config_get_color(cfg, CFG_GALLERY, CFG_GLRY_WINDOW);
     ctx.clr_background = config_get_color(cfg, CFG_GALLERY, CFG_GLRY_BKG);
@@ -594,13 +1354,91 @@ void gallery_init(const struct config* cfg, struct mode_handlers* handlers)
     handlers->action = on_action;
     handlers->redraw = on_redraw;
     handlers->resize = on_resize;
+    handlers->drag = on_drag;
+    handlers->drop = on_drop;
     handlers->imglist = on_imglist;
     handlers->current = on_current;
     handlers->activate = on_activate;
     handlers->deactivate = on_deactivate;
 }
 
+/** Batch job: generate thumbnails for the whole image list. */
+struct generate_job {
+    struct image** queue; ///< Images to process
+    atomic_size_t stored; ///< Number of thumbnails already in the storage
+    atomic_size_t failed; ///< Number of failed images
+};
+
+/**
+ * Thumbnail generator task: create thumbnail and save it to the storage.
+ * @param index index of the image in the queue
+ * @param data generator job
+ */
+static void generate_task(size_t index, void* data)
+{
+    TRACE_SCOPE("gallery_generate_thumb");
+    struct generate_job* job = data;
+    struct image* img = job->queue[index];
+
+    if (load_stored(img)) {
+        ++job->stored;
+    } else if (!create_thumbnail(img)) {
+        fprintf(stderr, "%s: Unable to create thumbnail\n", img->source);
+        ++job->failed;
+    }
+
+    image_free(img, IMGFREE_ALL);
+}
+
+bool gallery_generate(void)
+{
+    struct generate_job job = { 0 };
+    struct image* img;
+    size_t num = 0;
+
+    if (ctx.thumb_pstore == pstore_none) {
+        fprintf(stderr, "Thumbnail storage is disabled, see gallery.pstore\n");
+        return false;
+    }
+
+    // copy sources to process the list without locking
+    imglist_lock();
+    job.queue = calloc(imglist_size(), sizeof(*job.queue));
+    if (job.queue) {
+        img = imglist_first();
+        while (img) {
+            job.queue[num] = image_create(img->source);
+            if (job.queue[num]) {
+                ++num;
+            }
+            img = imglist_next(img);
+        }
+    }
+    imglist_unlock();
+
+    if (!job.queue) {
+        return false;
+    }
+
+    tpool_run(num, generate_task, &job); // tasks free the images
+    free(job.queue);
+
+    printf("Thumbnails: %zu total, %zu created, %zu up to date, %zu failed\n",
+           num, num - job.stored - job.failed, (size_t)job.stored,
+           (size_t)job.failed);
+
+    return job.failed == 0;
+}
+
 void gallery_destroy(void)
 {
-    loader_restart(NULL);
+    loader_destroy();
+    clear_thumbnails(true); // return all slots to the atlas
+    atlas_destroy();
+    pixmap_free(&ctx.selected.pm);
+    free_strips();
+    if (ctx.thumb_pstore == pstore_db) {
+        pstore_close();
+    }
+    free(ctx.drawn);
 }
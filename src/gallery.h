@@ -18,3 +18,10 @@ void gallery_init(const struct config* cfg, struct mode_handlers* handlers);
  * Destroy global gallery context.
  */
 void gallery_destroy(void);
+
+/**
+ * Generate thumbnails for all images in the image list and save them to the
+ * persistent storage, the work is spread over the thread pool.
+ * @return true if all thumbnails are generated
+ */
+bool gallery_generate(void);
@@ -5,51 +5,185 @@
 #include "image.h"
 
 #include "array.h"
-#include "buildcfg.h"
-
-#ifdef HAVE_LIBPNG
-#include "formats/png.h"
-#endif // HAVE_LIBPNG
+#include "atlas.h"
+#include "formats/loader.h"
+#include "memstat.h"
+#include "tpool.h"
 
 #include <assert.h>
+#include <pthread.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 
+// Number of lazily decoded frames kept in memory after the requested one
+#define ANIM_AHEAD 2
+
+// Number of possible values of high bit depth samples
+#define LEVELS_NUM 65536
+
+// Size of the meta data arena block, enough for format and common EXIF tags
+#define ARENA_BLOCK_SIZE 1024
+
+// Spare arena block of the current thread, reused by the next image instead
+// of allocating new one: meta info is created for each loaded image
+static pthread_key_t arena_spare;
+static pthread_once_t arena_once = PTHREAD_ONCE_INIT;
+
+/** Create key of the spare arena block, called once. */
+static void create_arena_key(void)
+{
+    pthread_key_create(&arena_spare, free);
+}
+
 struct image* image_create(const char* source)
 {
-    struct image* img;
-    const size_t len = strlen(source) + 1 /* last null */;
+    struct image* img = malloc(image_alloc_size(source));
 
-    img = calloc(1, sizeof(struct image) + len);
     if (img) {
-        img->source = (char*)img + sizeof(struct image);
-        memcpy(img->source, source, len);
+        image_create_in(img, source);
+        img->placed = false;
     }
 
     return img;
 }
 
+size_t image_alloc_size(const char* source)
+{
+    return sizeof(struct image) + strlen(source) + 1 /* last null */;
+}
+
+struct image* image_create_in(void* buffer, const char* source)
+{
+    struct image* img = buffer;
+
+    memset(img, 0, sizeof(*img));
+    img->source = (char*)img + sizeof(struct image);
+    strcpy(img->source, source);
+    img->placed = true;
+
+    return img;
+}
+
+void* image_arena_alloc(struct image* img, size_t size)
+{
+    const size_t align = offsetof(
+        struct {
+            char c;
+            union {
+                long double d;
+                void* p;
+                long long l;
+            } u;
+        },
+        u);
+    struct image_arena* block = img->arena;
+    struct image_arena* spare = NULL;
+    void* ptr;
+
+    size = (size + align - 1) & ~(align - 1);
+
+    if (!block || block->used + size > block->size) {
+        if (size <= ARENA_BLOCK_SIZE) {
+            pthread_once(&arena_once, create_arena_key);
+            spare = pthread_getspecific(arena_spare);
+        }
+        if (spare) {
+            block = spare;
+            pthread_setspecific(arena_spare, NULL);
+        } else {
+            const size_t data_size =
+                size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+            block = malloc(sizeof(*block) + data_size);
+            if (!block) {
+                return NULL;
+            }
+            block->size = data_size;
+        }
+        block->used = 0;
+        block->next = img->arena;
+        img->arena = block;
+    }
+
+    ptr = block->data + block->used;
+    block->used += size;
+
+    return ptr;
+}
+
+/**
+ * Release all blocks of the meta data arena.
+ * @param img image context
+ */
+static void free_arena(struct image* img)
+{
+    if (img->arena) {
+        pthread_once(&arena_once, create_arena_key);
+    }
+
+    while (img->arena) {
+        struct image_arena* next = img->arena->next;
+        if (img->arena->size == ARENA_BLOCK_SIZE &&
+            !pthread_getspecific(arena_spare)) {
+            pthread_setspecific(arena_spare, img->arena);
+        } else {
+            free(img->arena);
+        }
+        img->arena = next;
+    }
+}
+
 void image_update(struct image* img, struct image* from)
 {
+    bool meta_moved = false;
+
     assert(strcmp(from->source, img->source) == 0);
 
     if (image_has_frames(from) && !image_has_frames(img)) {
         img->num_frames = from->num_frames;
         img->frames = from->frames;
+        img->anim = from->anim;
+        img->levels = from->levels;
+        img->render_size = from->render_size;
         from->num_frames = 0;
         from->frames = NULL;
+        from->anim = NULL;
+        from->levels = NULL;
     }
     if (image_has_thumb(from) && !image_has_thumb(img)) {
         img->thumbnail = from->thumbnail;
         from->thumbnail.data = NULL;
     }
-    if (from->info && !img->info) {
+    if (!img->info && !img->exif) {
+        // meta info and its deferred part are moved together
         img->info = from->info;
+        img->exif = from->exif;
+        img->exif_size = from->exif_size;
         from->info = NULL;
+        from->exif = NULL;
+        from->exif_size = 0;
+        meta_moved = true;
     }
     if (from->format && !img->format) {
         img->format = from->format;
         from->format = NULL;
+        meta_moved = true;
+    }
+    if (meta_moved && from->arena) {
+        // take the storage of moved strings, the rest is dropped
+        struct image_arena* last = from->arena;
+        while (last->next) {
+            last = last->next;
+        }
+        last->next = img->arena;
+        img->arena = from->arena;
+        from->arena = NULL;
+        from->format = NULL;
+        from->info = NULL;
+    }
+    if (from->file_raw && !img->file_raw) {
+        img->file_raw = from->file_raw;
+        from->file_raw = NULL;
     }
     if (from->parent_dir && !img->parent_dir) {
         img->parent_dir = from->parent_dir;
@@ -63,6 +197,20 @@ void image_update(struct image* img, struct image* from)
     img->alpha = from->alpha;
 }
 
+/**
+ * Free mipmap levels of the frame.
+ * @param frame image frame
+ */
+static void free_mipmap(struct image_frame* frame)
+{
+    for (size_t i = 0; i < frame->num_mips; ++i) {
+        pixmap_free(&frame->mips[i]);
+    }
+    free(frame->mips);
+    frame->mips = NULL;
+    frame->num_mips = 0;
+}
+
 void image_free(struct image* img, size_t dt)
 {
     assert(img);
@@ -71,38 +219,51 @@ void image_free(struct image* img, size_t dt)
         // free frames
         for (size_t i = 0; i < img->num_frames; ++i) {
             pixmap_free(&img->frames[i].pm);
+            free_mipmap(&img->frames[i]);
         }
         free(img->frames);
         img->frames = NULL;
         img->num_frames = 0;
+        img->render_size = 0;
+        if (img->anim) {
+            img->anim->free(img->anim);
+            img->anim = NULL;
+        }
+        if (img->levels) {
+            pixmap_free(&img->levels->samples);
+            free(img->levels);
+            img->levels = NULL;
+        }
     }
 
     if ((dt & IMGFREE_THUMB) && image_has_thumb(img)) {
         // free thumbnail
-        pixmap_free(&img->thumbnail);
+        atlas_free(&img->thumbnail);
         img->thumbnail.data = NULL;
     }
 
     if ((dt == IMGFREE_ALL) ||
         (!image_has_frames(img) && !image_has_thumb(img))) {
         // free descriptions
-        free(img->parent_dir);
-        img->parent_dir = NULL;
-        free(img->format);
+        img->parent_dir = NULL; // interned, not owned
         img->format = NULL;
 
         // free meta data
-        list_for_each(img->info, struct image_info, it) {
-            free(it);
-        }
         img->info = NULL;
+        free_arena(img);
+        free(img->exif);
+        img->exif = NULL;
+        img->exif_size = 0;
 
         // free raw image data
-        free(img->file_raw);
-        img->file_raw = NULL;
+        if (img->file_raw) {
+            memstat_free(memstat_raw, img->file_size);
+            free(img->file_raw);
+            img->file_raw = NULL;
+        }
     }
 
-    if (dt == IMGFREE_ALL) {
+    if (dt == IMGFREE_ALL && !img->placed) {
         free(img);
     }
 }
@@ -117,26 +278,260 @@ bool image_has_thumb(const struct image* img)
     return img && img->thumbnail.data;
 }
 
-void image_flip_vertical(struct image* img)
+size_t image_memory(const struct image* img)
 {
+    size_t size = 0;
+
     for (size_t i = 0; i < img->num_frames; ++i) {
-        pixmap_flip_vertical(&img->frames[i].pm);
+        const struct image_frame* frame = &img->frames[i];
+        if (frame->pm.data) {
+            size += frame->pm.width * frame->pm.height;
+        }
+        for (size_t j = 0; j < frame->num_mips; ++j) {
+            size += frame->mips[j].width * frame->mips[j].height;
+        }
     }
+    size += img->thumbnail.width * img->thumbnail.height;
+    if (img->levels) {
+        size += img->levels->samples.width * img->levels->samples.height;
+    }
+    size *= sizeof(argb_t);
+
+    if (img->file_raw) {
+        size += img->file_size;
+    }
+
+    return size;
 }
 
-void image_flip_horizontal(struct image* img)
+/**
+ * Compose orientation state with the next transformation.
+ * @param rotate,flip current state: horizontal flip followed by rotation
+ * @param hflip,angle transformation to add
+ */
+static inline void add_transform(size_t* rotate, bool* flip, bool hflip,
+                                 size_t angle)
+{
+    // flip reverses the direction of the previous rotation
+    *rotate = ((hflip ? 360 - *rotate : *rotate) + angle) % 360;
+    *flip ^= hflip;
+}
+
+/**
+ * Apply pending transformation to the decoded frame.
+ * @param frame image frame
+ */
+static void apply_transform(struct image_frame* frame)
+{
+    if (frame->flip || frame->rotate) {
+        pixmap_transform(&frame->pm, frame->flip, frame->rotate);
+        free_mipmap(frame);
+        frame->flip = false;
+        frame->rotate = 0;
+    }
+}
+
+/**
+ * Flip and rotate the image: the first frame is transformed immediately,
+ * the rest of decoded frames are transformed on load.
+ * @param img image context
+ * @param hflip flag to flip horizontally before rotation
+ * @param angle rotation angle
+ */
+static void transform(struct image* img, bool hflip, size_t angle)
 {
     for (size_t i = 0; i < img->num_frames; ++i) {
-        pixmap_flip_horizontal(&img->frames[i].pm);
+        struct image_frame* frame = &img->frames[i];
+        if (frame->pm.data) {
+            add_transform(&frame->rotate, &frame->flip, hflip, angle);
+            if (i == 0) {
+                apply_transform(frame);
+            }
+        } else if (angle == 90 || angle == 270) {
+            const size_t width = frame->pm.width;
+            frame->pm.width = frame->pm.height;
+            frame->pm.height = width;
+        }
+    }
+    if (img->anim) {
+        add_transform(&img->anim->rotate, &img->anim->flip, hflip, angle);
+    }
+    if (img->levels) {
+        // samples follow the first frame
+        pixmap_transform(&img->levels->samples, hflip, angle);
+    }
+}
+
+bool image_frame_load(struct image* img, size_t index)
+{
+    struct image_frame* frame = &img->frames[index];
+    struct image_anim* anim = img->anim;
+
+    if (frame->pm.data) {
+        apply_transform(frame);
+        return true;
+    }
+    if (!anim) {
+        return false;
+    }
+
+    // unload frames out of the window: the first one, the previous (it is
+    // probably displayed now) and a few next are kept
+    for (size_t i = 1; i < img->num_frames; ++i) {
+        struct image_frame* it = &img->frames[i];
+        if (it->pm.data && (i + 1 < index || i > index + ANIM_AHEAD)) {
+            pixmap_free(&it->pm);
+            it->pm.data = NULL;
+            free_mipmap(it);
+            // the decoder applies the full transformation to new frames
+            it->flip = false;
+            it->rotate = 0;
+        }
     }
+
+    if (!anim->decode(img, index)) {
+        return false;
+    }
+
+    // apply transformations made before the frame was decoded
+    pixmap_transform(&frame->pm, anim->flip, anim->rotate);
+
+    return true;
+}
+
+void image_flip_vertical(struct image* img)
+{
+    // vertical flip is a horizontal one followed by rotation on 180
+    transform(img, true, 180);
+}
+
+void image_flip_horizontal(struct image* img)
+{
+    transform(img, true, 0);
 }
 
 void image_rotate(struct image* img, size_t angle)
 {
     assert(angle == 90 || angle == 180 || angle == 270);
-    for (size_t i = 0; i < img->num_frames; ++i) {
-        pixmap_rotate(&img->frames[i].pm, angle);
+    transform(img, false, angle);
+}
+
+/** Window rendering job: map samples to the frame through lookup table. */
+struct window_job {
+    const struct pixmap* samples; ///< High bit depth samples
+    struct pixmap* pm;            ///< Destination frame
+    const argb_t* lut;            ///< Gray levels for each sample value
+    size_t tasks;                 ///< Number of tasks in the job
+};
+
+/** Thread pool handler: render a band of the frame rows. */
+static void window_task(size_t index, void* data)
+{
+    const struct window_job* job = data;
+    const size_t width = job->pm->width;
+    const size_t low = job->pm->height * index / job->tasks;
+    const size_t high = job->pm->height * (index + 1) / job->tasks;
+    const argb_t* src = &job->samples->data[low * width];
+    argb_t* dst = &job->pm->data[low * width];
+    const argb_t* end = &job->pm->data[high * width];
+
+    while (dst < end) {
+        *dst++ = job->lut[*src++ & (LEVELS_NUM - 1)];
+    }
+}
+
+bool image_set_window(struct image* img, ssize_t center, ssize_t width)
+{
+    struct image_levels* levels = img->levels;
+    struct window_job job;
+    argb_t* lut;
+    ssize_t low;
+
+    if (!levels || !image_has_frames(img) || !img->frames[0].pm.data) {
+        return false;
     }
+
+    if (width <= 0) {
+        // default window covers the full range of the samples
+        width = levels->max - levels->min + 1;
+        center = levels->min + width / 2;
+    } else {
+        center -= levels->offset;
+    }
+    if (width > LEVELS_NUM) {
+        width = LEVELS_NUM;
+    }
+    if (center < 0) {
+        center = 0;
+    } else if (center >= LEVELS_NUM) {
+        center = LEVELS_NUM - 1;
+    }
+
+    lut = malloc(LEVELS_NUM * sizeof(*lut));
+    if (!lut) {
+        return false;
+    }
+    low = center - width / 2;
+    for (ssize_t i = 0; i < LEVELS_NUM; ++i) {
+        uint8_t gray;
+        if (i <= low) {
+            gray = 0;
+        } else if (i >= low + width) {
+            gray = 0xff;
+        } else {
+            gray = ((i - low) * 0xff) / width;
+        }
+        lut[i] = ARGB(0xff, gray, gray, gray);
+    }
+
+    job.samples = &levels->samples;
+    job.pm = &img->frames[0].pm;
+    job.lut = lut;
+    job.tasks = tpool_tasks(job.pm->height);
+    tpool_run(job.tasks, window_task, &job);
+
+    free(lut);
+    free_mipmap(&img->frames[0]);
+
+    levels->center = center;
+    levels->width = width;
+
+    return true;
+}
+
+const struct pixmap* image_mipmap(struct image* img, size_t index,
+                                  double* scale)
+{
+    struct image_frame* frame = &img->frames[index];
+    size_t level = 0;
+
+    // each level halves the size, the rest is scaled by the caller
+    while (*scale <= 0.5) {
+        if (level == frame->num_mips) {
+            // create the next level
+            const struct pixmap* last =
+                level ? &frame->mips[level - 1] : &frame->pm;
+            struct pixmap* mips;
+            if (last->width < 2 || last->height < 2) {
+                break;
+            }
+            mips = realloc(frame->mips, (level + 1) * sizeof(*frame->mips));
+            if (!mips) {
+                break;
+            }
+            frame->mips = mips;
+            // the array could be moved by realloc
+            last = level ? &frame->mips[level - 1] : &frame->pm;
+            if (!pixmap_scale_half(last, &frame->mips[level], img->alpha)) {
+                break;
+            }
+            ++frame->num_mips;
+        }
+        ++level;
+        *scale *= 2;
+    }
+
+    return level ? &frame->mips[level - 1] : &frame->pm;
 }
 
 bool image_thumb_create(struct image* img, size_t size, bool fill,
@@ -171,40 +566,64 @@ bool image_thumb_create(struct image* img, size_t size, bool fill,
         offset_y = 0;
     }
 
-    if (pixmap_create(&img->thumbnail, thumb_width, thumb_height)) {
-        pixmap_scale(aa_mode, full, &img->thumbnail, offset_x, offset_y, scale,
-                     img->alpha);
+    if (atlas_alloc(&img->thumbnail, thumb_width, thumb_height)) {
+        double src_scale = scale;
+        if (aa_mode != aa_nearest) {
+            full = image_mipmap(img, 0, &src_scale);
+        }
+        pixmap_scale(aa_mode, full, &img->thumbnail, offset_x, offset_y,
+                     src_scale, img->alpha);
     }
 
     return img->thumbnail.data;
 }
 
-bool image_thumb_load(struct image* img, const char* path)
+bool image_thumb_frame(struct image* img)
 {
-    assert(!img->thumbnail.data);
+    const struct pixmap* thumb = &img->thumbnail;
+    struct pixmap* pm;
 
-    struct image* thumb = image_create(path);
-    if (!thumb) {
+    assert(!image_has_frames(img));
+
+    if (!image_has_thumb(img)) {
         return false;
     }
-    if (image_load(thumb) == imgload_success) {
-        img->alpha = thumb->alpha;
-        img->thumbnail = thumb->frames[0].pm;
-        thumb->frames[0].pm.data = NULL;
+
+    pm = image_alloc_frame(img, thumb->width, thumb->height);
+    if (pm) {
+        pixmap_copy(thumb, pm, 0, 0, false);
     }
-    image_free(thumb, IMGFREE_ALL);
 
-    return image_has_thumb(img);
+    return pm;
 }
 
-bool image_thumb_save(const struct image* img, const char* path)
+bool image_thumb_copy(struct image* img, const struct image* src, size_t size)
 {
-#ifdef HAVE_LIBPNG
-    assert(img->thumbnail.data);
-    return export_png(&img->thumbnail, img->info, path);
-#else
-    (void)img;
-    (void)path;
-    return false;
-#endif // HAVE_LIBPNG
+    const struct image_frame* frame;
+    const struct pixmap* full;
+    struct pixmap* pm;
+
+    assert(!image_has_frames(img));
+
+    if (!image_has_frames(src)) {
+        return false;
+    }
+
+    frame = &src->frames[0];
+    full = &frame->pm;
+    for (size_t i = 0; i < frame->num_mips; ++i) {
+        const struct pixmap* mip = &frame->mips[i];
+        if (mip->width < size || mip->height < size) {
+            break;
+        }
+        full = mip;
+    }
+
+    pm = image_alloc_frame(img, full->width, full->height);
+    if (pm) {
+        pixmap_copy(full, pm, 0, 0, false);
+        img->alpha = src->alpha;
+    }
+
+    return pm;
 }
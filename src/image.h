@@ -17,8 +17,25 @@
 
 /** Image frame. */
 struct image_frame {
-    struct pixmap pm; ///< Frame data
-    size_t duration;  ///< Frame duration in milliseconds (animation)
+    struct pixmap pm;    ///< Frame data
+    size_t duration;     ///< Frame duration in milliseconds (animation)
+    struct pixmap* mips; ///< Mipmap levels, each one is half of the previous
+    size_t num_mips;     ///< Number of created mipmap levels
+    size_t rotate;       ///< Pending rotation, applied on frame load
+    bool flip;           ///< Pending horizontal flip, applied before rotation
+};
+
+/**
+ * High bit depth samples of monochrome image (e.g. DICOM): the first frame
+ * is rendered from them through the window, the range of sample values
+ * mapped to gray levels, so the window can be changed without reloading.
+ */
+struct image_levels {
+    struct pixmap samples; ///< Samples, lower 16 bits of each pixel
+    ssize_t offset;        ///< Original value of zero sample
+    size_t min, max;       ///< Range of sample values in the image
+    size_t center;         ///< Window center (level)
+    size_t width;          ///< Window width
 };
 
 /** Image meta info. */
@@ -28,27 +45,93 @@ struct image_info {
     char* value;      ///< Meta value
 };
 
+/**
+ * Memory block of the meta data arena: format description and meta info
+ * entries are packed one after another and released at once.
+ */
+struct image_arena {
+    struct image_arena* next; ///< Next (previously allocated) block
+    size_t used;              ///< Size of used space
+    size_t size;              ///< Size of the data buffer
+    uint8_t data[];           ///< Arena data
+};
+
+struct image;
+struct source_file;
+
+/**
+ * Progressive decoding handler: called by decoders when a coarse
+ * approximation of the image is ready in the first frame.
+ * @param img image context
+ */
+typedef void (*image_progress)(const struct image* img);
+
+/**
+ * On-demand decoder of animation frames, decoder specific data follows
+ * this header. Frames without pixel data are decoded when requested.
+ */
+struct image_anim {
+    /**
+     * Decode frame: create `img->frames[index].pm` at the original size.
+     * @param img image context
+     * @param index frame index
+     * @return true if frame was decoded
+     */
+    bool (*decode)(struct image* img, size_t index);
+
+    /**
+     * Free decoder.
+     * @param anim decoder instance
+     */
+    void (*free)(struct image_anim* anim);
+
+    size_t rotate; ///< Rotation angle applied to decoded frames
+    bool flip;     ///< Horizontal flip applied before rotation
+};
+
 /** Image context. */
 struct image {
     struct list list; ///< Links to prev/next entry in the image list
 
     char* source;      ///< Image source (e.g. path to the image file)
-    uint8_t* file_raw; ///< Raw image file data
+    uint8_t* file_raw; ///< Raw file data (kept for SVG re-rendering)
     size_t file_size;  ///< Size of the image file
     time_t file_time;  ///< File modification time
 
     size_t index;     ///< Index of the image
     const char* name; ///< Name of the image file
-    char* parent_dir; ///< Parent directory name
+    const char* parent_dir; ///< Parent directory name (interned, not freed)
 
-    char* format;            ///< Format description
-    struct image_info* info; ///< Image meta info
-    bool alpha;              ///< Image has alpha channel
+    char* format;              ///< Format description
+    struct image_info* info;   ///< Image meta info
+    struct image_arena* arena; ///< Storage of format and meta info
+    uint8_t* exif;             ///< Raw EXIF data, parsed on demand
+    size_t exif_size;          ///< Size of raw EXIF data
+    bool alpha;                ///< Image has alpha channel
+    bool reduced;              ///< Decoded in reduced quality (RAW preview)
+    bool placed;               ///< Instance is placed in the external buffer
 
-    struct image_frame* frames; ///< Image frames
-    size_t num_frames;          ///< Total number of frames
+    struct image_frame* frames;  ///< Image frames
+    size_t num_frames;           ///< Total number of frames
+    struct image_anim* anim;     ///< Frame decoder, NULL if all frames loaded
+    struct image_levels* levels; ///< High bit depth samples, can be NULL
 
     struct pixmap thumbnail; ///< Image thumbnail
+
+    const bool* cancel;      ///< Loading cancellation flag, can be NULL
+    image_progress progress; ///< Progressive decoding handler, can be NULL
+    bool full;               ///< Don't use reduced quality decoding
+    double render_size;      ///< Render size of vector images, 0 for default
+
+    /** Source file being decoded, its pixels can be mapped, can be NULL. */
+    const struct source_file* mapped;
+};
+
+/** Decoding mode of RAW images. */
+enum raw_mode {
+    raw_full,    ///< Full size demosaicing
+    raw_half,    ///< Half size demosaicing, 4 times fewer pixels
+    raw_preview, ///< Embedded preview, half size if there is no one
 };
 
 /** Image loading status. */
@@ -77,6 +160,22 @@ const char* image_formats(void);
  */
 struct image* image_create(const char* source);
 
+/**
+ * Get size of the buffer for the image instance (see `image_create_in`).
+ * @param source image source
+ * @return size of the buffer in bytes
+ */
+size_t image_alloc_size(const char* source);
+
+/**
+ * Create empty image instance in the preallocated buffer, the instance
+ * itself is not freed by `image_free`, only its data.
+ * @param buffer buffer with size returned by `image_alloc_size`
+ * @param source image source
+ * @return image context
+ */
+struct image* image_create_in(void* buffer, const char* source);
+
 /**
  * Load image from specified source.
  * @param img image context
@@ -84,6 +183,74 @@ struct image* image_create(const char* source);
  */
 enum image_status image_load(struct image* img);
 
+/**
+ * Load image from specified source, the image can be downscaled by decoder
+ * to save time and memory (e.g. for thumbnails).
+ * @param img image context
+ * @param hint minimal size of the image in pixels, 0 to load full size image
+ * @return loading status
+ */
+enum image_status image_load_sized(struct image* img, size_t hint);
+
+/**
+ * Set limit of memory used by single decoded frame: for larger images
+ * decoders use embedded reduced resolution images (TIFF, HEIF) or downscale
+ * images while loading them by parts (TIFF, EXR).
+ * @param limit max size of frame data in bytes, 0 for unlimited
+ */
+void image_set_limit(size_t limit);
+
+/**
+ * Set decoding mode of RAW images: reduced modes are much faster, the image
+ * is marked as `reduced` and can be reloaded in full quality (see `full`).
+ * @param mode decoding mode
+ */
+void image_set_raw_mode(enum raw_mode mode);
+
+/**
+ * Set max number of threads used by decoders to load single image.
+ * @param num number of threads, 0 to use all threads of the pool
+ */
+void image_set_threads(size_t num);
+
+/**
+ * Enable decoding images in a child process: crashes and hangs of decoders
+ * don't affect the application.
+ * @param enable true to enable isolated decoding
+ * @param timeout max decoding time in seconds, 0 for unlimited
+ */
+void image_set_isolation(bool enable, size_t timeout);
+
+/**
+ * Start reading the image file in background (readahead to the page cache),
+ * so the following loading doesn't wait for the storage.
+ * @param source image source
+ */
+void image_prefetch(const char* source);
+
+/**
+ * Load preview image embedded into the image file (e.g. EXIF thumbnail).
+ * @param img image context
+ * @param size minimal size of the preview's longest side in pixels
+ * @return loading status, imgload_unsupported if there is no suitable preview
+ */
+enum image_status image_load_preview(struct image* img, size_t size);
+
+/**
+ * Load meta info deferred by decoder (e.g. EXIF tags).
+ * @param img image context
+ */
+void image_load_meta(struct image* img);
+
+/**
+ * Allocate memory in the meta data arena of the image, the memory is
+ * released together with meta info by `image_free`.
+ * @param img image context
+ * @param size number of bytes to allocate
+ * @return pointer to the allocated memory or NULL if not enough memory
+ */
+void* image_arena_alloc(struct image* img, size_t size);
+
 /**
  * Update image data (move) from another instance.
  * @param img target image instance
@@ -112,6 +279,23 @@ bool image_has_frames(const struct image* img);
  */
 bool image_has_thumb(const struct image* img);
 
+/**
+ * Get size of memory used by image data (frames, thumbnail and raw data).
+ * @param img image context
+ * @return size of allocated image data in bytes
+ */
+size_t image_memory(const struct image* img);
+
+/**
+ * Get frame pixel data, decode the frame if it is not loaded yet. Only a few
+ * frames of the lazily decoded animation are kept in memory. Flips and
+ * rotations made since the frame was loaded are applied here.
+ * @param img image context
+ * @param index frame index
+ * @return true if the frame is ready
+ */
+bool image_frame_load(struct image* img, size_t index);
+
 /**
  * Flip image vertically.
  * @param img image context
@@ -131,6 +315,27 @@ void image_flip_horizontal(struct image* img);
  */
 void image_rotate(struct image* img, size_t angle);
 
+/**
+ * Set window of the high bit depth image and render the first frame.
+ * @param img image context
+ * @param center window center, sample value
+ * @param width window width, 0 to reset window to the default one
+ * @return false if the image has no high bit depth samples
+ */
+bool image_set_window(struct image* img, ssize_t center, ssize_t width);
+
+/**
+ * Get the frame pixmap to use as a source for downscaling: the smallest
+ * mipmap level that is still not smaller than the scaled frame. Missing
+ * levels are created on demand.
+ * @param img image context
+ * @param index frame index
+ * @param scale frame scale factor, in/out: converted to the level scale
+ * @return pixmap of the mipmap level or the frame itself
+ */
+const struct pixmap* image_mipmap(struct image* img, size_t index,
+                                  double* scale);
+
 /**
  * Create thumbnail.
  * @param img image context
@@ -143,17 +348,20 @@ bool image_thumb_create(struct image* img, size_t size, bool fill,
                         enum aa_mode aa_mode);
 
 /**
- * Load thumbnail from specified file.
- * @param img image context
- * @param path path to the thumbnail file to load
- * @return true if thumbnail loaded
+ * Create the first frame from the thumbnail, used as a placeholder while
+ * the image is being decoded.
+ * @param img image context with thumbnail and without frames
+ * @return true if frame created
  */
-bool image_thumb_load(struct image* img, const char* path);
+bool image_thumb_frame(struct image* img);
 
 /**
- * Save thumbnail to specified file.
- * @param img image context
- * @param path path to the thumbnail file
- * @return true if thumbnail saved
+ * Copy the first frame of another image to create thumbnail from the copy
+ * without holding the source. The smallest already built mipmap level that
+ * is not less than the thumbnail is copied instead of the full size frame.
+ * @param img destination image context without frames
+ * @param src source image context
+ * @param size thumbnail size in pixels
+ * @return true if frame copied
  */
-bool image_thumb_save(const struct image* img, const char* path);
+bool image_thumb_copy(struct image* img, const struct image* src, size_t size);
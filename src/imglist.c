@@ -8,17 +8,35 @@
 #include "array.h"
 #include "buildcfg.h"
 #include "fs.h"
+#include "tpool.h"
+#include "trace.h"
 
 #include <assert.h>
 #include <ctype.h>
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
 #include <pthread.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
+
+// Initial capacity of the hash index (must be a power of 2)
+#define HASH_MIN_SIZE 64
+
+// Min number of directory entries processed by a single thread pool task
+#define SCAN_TASK_ENTRIES 32
+
+// Size of the memory block used to allocate list entries
+#define ENTRY_BLOCK_SIZE (64 * 1024)
+
+// Size of the list file part parsed by a single thread pool task
+#define LIST_TASK_SIZE (64 * 1024)
 
 /** Order of file list. */
 enum list_order {
@@ -42,12 +60,83 @@ static const char* order_names[] = {
 };
 // clang-format on
 
+/** Directory entry being scanned. */
+struct scan_entry {
+    size_t name;    ///< Offset of the file name in the names buffer
+    struct stat st; ///< File status
+    bool valid;     ///< File status is valid
+};
+
+/** Directory scan job. */
+struct scan_job {
+    int dir_fd;                 ///< Directory file descriptor
+    char* names;                ///< Buffer with file names
+    size_t names_len;           ///< Size of used space in the names buffer
+    struct scan_entry* entries; ///< Directory entries
+    size_t num;                 ///< Number of entries
+    size_t tasks;               ///< Number of thread pool tasks
+};
+
+/** Type of the source read from the list file. */
+enum list_type {
+    list_special, ///< Special source (exec or stdin)
+    list_fs,      ///< File system entry (file or directory)
+    list_error,   ///< Unable to get status
+    list_abspath, ///< Unable to get absolute path
+};
+
+/** Source read from the list file. */
+struct list_entry {
+    size_t name;         ///< Offset of the source in the names buffer
+    struct stat st;      ///< File status
+    enum list_type type; ///< Source type
+    int error;           ///< Error code (errno) if status is not available
+};
+
+/** Part of the list file parsed by a single thread pool task. */
+struct list_part {
+    size_t start;               ///< Offset of the first byte to parse
+    size_t end;                 ///< Offset of the last byte to parse
+    char* names;                ///< Buffer with sources (absolute paths)
+    size_t names_len;           ///< Size of used space in the names buffer
+    size_t names_size;          ///< Size of the names buffer
+    struct list_entry* entries; ///< Parsed sources
+    size_t num;                 ///< Number of parsed sources
+    size_t size;                ///< Capacity of the entries array
+    bool oom;                   ///< Not enough memory to parse all lines
+};
+
+/** List file parse job. */
+struct list_job {
+    const char* data;        ///< List file data
+    size_t size;             ///< Size of the list file data
+    struct list_part* parts; ///< Parts of the current batch
+};
+
+/** Memory block with list entries. */
+struct entry_block {
+    struct entry_block* next; ///< Next (previously allocated) block
+    size_t used;              ///< Size of used space
+    size_t size;              ///< Size of the data buffer
+    uint8_t data[];           ///< Entries data
+};
+
 /** Context of the image list. */
 struct image_list {
     struct image* images; ///< Image list
     size_t size;          ///< Size of image list
+    struct image** array; ///< Entries ordered by index for random access
+    size_t array_size;    ///< Capacity of the array
+    bool array_valid;     ///< Array is in sync with the list
+    bool bulk;            ///< Bulk load: add unordered, sort at once later
     pthread_mutex_t lock; ///< List lock
 
+    struct image** hash; ///< Hash index of sources (open addressing)
+    size_t hash_size;    ///< Capacity of the hash index, power of 2
+    size_t hash_num;     ///< Number of entries in the hash index
+
+    struct entry_block* blocks; ///< Memory blocks with entries, last first
+
     enum list_order order; ///< File list order
     bool reverse;          ///< Reverse order flag
     bool loop;             ///< File list loop mode
@@ -59,6 +148,182 @@ struct image_list {
 /** Global image list instance. */
 static struct image_list ctx;
 
+/**
+ * Allocate new list entry in the memory block.
+ * Entries are packed one after another instead of separate heap chunks,
+ * the memory is released at once on list destroy.
+ * @param source image source
+ * @return created image instance or NULL on errors
+ */
+static struct image* alloc_entry(const char* source)
+{
+    const size_t align = offsetof(
+        struct {
+            char c;
+            struct image i;
+        },
+        i);
+    const size_t size = (image_alloc_size(source) + align - 1) & ~(align - 1);
+    struct entry_block* block = ctx.blocks;
+
+    if (!block || block->used + size > block->size) {
+        const size_t data_size =
+            size > ENTRY_BLOCK_SIZE ? size : ENTRY_BLOCK_SIZE;
+        block = malloc(sizeof(*block) + data_size);
+        if (!block) {
+            return NULL;
+        }
+        block->next = ctx.blocks;
+        block->used = 0;
+        block->size = data_size;
+        ctx.blocks = block;
+    }
+
+    void* ptr = block->data + block->used;
+    block->used += size;
+
+    return image_create_in(ptr, source);
+}
+
+/**
+ * Compute hash of the image source.
+ * @param source image source
+ * @return hash value
+ */
+static inline size_t hash_source(const char* source)
+{
+    return str_hash(source, strlen(source), STR_HASH_INIT);
+}
+
+/**
+ * Get hash index slot for the image source.
+ * @param source image source
+ * @return pointer to the slot with the image or to the empty slot
+ */
+static struct image** hash_slot(const char* source)
+{
+    const size_t mask = ctx.hash_size - 1;
+    size_t pos = hash_source(source) & mask;
+
+    while (ctx.hash[pos] && strcmp(ctx.hash[pos]->source, source) != 0) {
+        pos = (pos + 1) & mask;
+    }
+
+    return &ctx.hash[pos];
+}
+
+/**
+ * Put image to the hash index.
+ * @param img image entry to add
+ * @return false if not enough memory
+ */
+static bool hash_put(struct image* img)
+{
+    // keep load factor under 0.5
+    if ((ctx.hash_num + 1) * 2 > ctx.hash_size) {
+        const size_t size = ctx.hash_size ? ctx.hash_size * 2 : HASH_MIN_SIZE;
+        struct image** hash = calloc(size, sizeof(*hash));
+        struct image** old = ctx.hash;
+        const size_t old_size = ctx.hash_size;
+        if (!hash) {
+            return false;
+        }
+        ctx.hash = hash;
+        ctx.hash_size = size;
+        for (size_t i = 0; i < old_size; ++i) {
+            if (old[i]) {
+                *hash_slot(old[i]->source) = old[i];
+            }
+        }
+        free(old);
+    }
+
+    *hash_slot(img->source) = img;
+    ++ctx.hash_num;
+
+    return true;
+}
+
+/**
+ * Remove image from the hash index.
+ * @param img image entry to remove
+ */
+static void hash_remove(const struct image* img)
+{
+    const size_t mask = ctx.hash_size - 1;
+    size_t pos, next;
+
+    if (!ctx.hash) {
+        return;
+    }
+
+    pos = hash_slot(img->source) - ctx.hash;
+    if (ctx.hash[pos] != img) {
+        return;
+    }
+
+    // shift back the next entries of the same cluster to fill the gap
+    next = pos;
+    while (true) {
+        size_t home;
+        next = (next + 1) & mask;
+        if (!ctx.hash[next]) {
+            break;
+        }
+        home = hash_source(ctx.hash[next]->source) & mask;
+        // move if home slot is not in the cyclic range (pos, next]
+        if (pos <= next ? (home <= pos || home > next)
+                        : (home <= pos && home > next)) {
+            ctx.hash[pos] = ctx.hash[next];
+            pos = next;
+        }
+    }
+
+    ctx.hash[pos] = NULL;
+    --ctx.hash_num;
+}
+
+/**
+ * Compare two entries according to sort order.
+ * @param img,it entries to compare
+ * @return negative value if `img` goes before `it` (ignoring reverse flag)
+ */
+static ssize_t compare_entries(const struct image* img, const struct image* it)
+{
+    ssize_t cmp = 0;
+
+    switch (ctx.order) {
+        case order_alpha:
+            cmp = strcoll(img->source, it->source);
+            break;
+        case order_numeric: {
+            const char* a = img->source;
+            const char* b = it->source;
+            while (cmp == 0 && *a && *b) {
+                if (isdigit(*a) && isdigit(*b)) {
+                    cmp = strtoull(a, (char**)&a, 10) -
+                        strtoull(b, (char**)&b, 10);
+                } else {
+                    cmp = *a - *b;
+                    ++a;
+                    ++b;
+                }
+            }
+        } break;
+        case order_mtime:
+            cmp = it->file_time - img->file_time;
+            break;
+        case order_size:
+            cmp = it->file_size - img->file_size;
+            break;
+        case order_none:
+        case order_random:
+            break;
+    }
+
+    return cmp;
+}
+
 /**
  * Search the right place to insert new entry according to sort order.
  * @param img new image entry to insert
@@ -80,36 +345,7 @@ static struct image* ordered_position(const struct image* img)
         }
     } else {
         list_for_each(ctx.images, struct image, it) {
-            ssize_t cmp = 0;
-            switch (ctx.order) {
-                case order_alpha:
-                    cmp = strcoll(img->source, it->source);
-                    break;
-                case order_numeric: {
-                    const char* a = img->source;
-                    const char* b = it->source;
-                    while (cmp == 0 && *a && *b) {
-                        if (isdigit(*a) && isdigit(*b)) {
-                            cmp = strtoull(a, (char**)&a, 10) -
-                                strtoull(b, (char**)&b, 10);
-                        } else {
-                            cmp = *a - *b;
-                            ++a;
-                            ++b;
-                        }
-                    }
-                } break;
-                case order_mtime:
-                    cmp = it->file_time - img->file_time;
-                    break;
-                case order_size:
-                    cmp = it->file_size - img->file_size;
-                    break;
-                case order_none:
-                case order_random:
-                    assert(false && "unreachable code");
-                    break;
-            }
+            const ssize_t cmp = compare_entries(img, it);
             if ((ctx.reverse && cmp > 0) || (!ctx.reverse && cmp < 0)) {
                 pos = it;
                 break;
@@ -120,6 +356,92 @@ static struct image* ordered_position(const struct image* img)
     return pos;
 }
 
+/**
+ * Compare entries for qsort.
+ * @param a,b pointers to image entries
+ * @return comparison result
+ */
+static int compare_qsort(const void* a, const void* b)
+{
+    const struct image* img_a = *(const struct image* const*)a;
+    const struct image* img_b = *(const struct image* const*)b;
+    ssize_t cmp = compare_entries(img_a, img_b);
+
+    if (ctx.reverse) {
+        cmp = -cmp;
+    }
+    if (cmp == 0) {
+        // keep the order of addition for equal entries
+        cmp = (ssize_t)img_a->index - (ssize_t)img_b->index;
+    }
+
+    return cmp < 0 ? -1 : (cmp > 0 ? 1 : 0);
+}
+
+/**
+ * Sort the entire list, used to finish bulk loading.
+ */
+static void sort_entries(void)
+{
+    const size_t num = list_size((struct list*)ctx.images);
+    struct image** entries;
+    size_t i = 0;
+
+    if (num < 2) {
+        return;
+    }
+
+    entries = malloc(num * sizeof(*entries));
+    if (!entries) {
+        fprintf(stderr, "Not enough memory to sort image list\n");
+        return;
+    }
+    list_for_each(ctx.images, struct image, it) {
+        entries[i++] = it;
+    }
+
+    if (ctx.order == order_random) {
+        for (i = num - 1; i > 0; --i) {
+            const size_t j = rand() % (i + 1);
+            struct image* tmp = entries[i];
+            entries[i] = entries[j];
+            entries[j] = tmp;
+        }
+    } else {
+        qsort(entries, num, sizeof(*entries), compare_qsort);
+    }
+
+    // relink the list
+    for (i = 0; i < num; ++i) {
+        entries[i]->list.prev = i ? &entries[i - 1]->list : NULL;
+        entries[i]->list.next = i + 1 < num ? &entries[i + 1]->list : NULL;
+    }
+    ctx.images = entries[0];
+
+    free(entries);
+}
+
+/**
+ * Get the first entry of the directory, the list must be sorted.
+ * @param img any entry from the directory
+ * @param dir absolute path to the directory
+ * @return the first image entry in the directory
+ */
+static struct image* first_in_dir(struct image* img, const char* dir)
+{
+    const size_t dir_len = strlen(dir);
+
+    list_for_each_back(list_prev(img), struct image, it) {
+        if (strncmp(dir, it->source, dir_len) == 0) {
+            img = it;
+        } else {
+            break;
+        }
+    }
+
+    return img;
+}
+
 /**
  * Add new entry to the list.
  * @param source image data source to add
@@ -138,17 +460,27 @@ static struct image* add_entry(const char* source, const struct stat* st)
     }
 
     // create new entry
-    entry = image_create(source);
+    entry = alloc_entry(source);
     if (!entry) {
         return NULL;
     }
+    if (!hash_put(entry)) {
+        image_free(entry, IMGFREE_ALL);
+        return NULL;
+    }
     if (st) {
         entry->file_size = st->st_size;
         entry->file_time = st->st_mtime;
     }
     entry->index = ++ctx.size;
+    ctx.array_valid = false; // until reindex
 
     // add entry to the list
+    if (ctx.bulk) {
+        // will be sorted later, addition order is restored by index
+        ctx.images = list_add(ctx.images, entry);
+        return entry;
+    }
     pos = ordered_position(entry);
     if (pos) {
         ctx.images = list_insert(pos, entry);
@@ -159,6 +491,79 @@ static struct image* add_entry(const char* source, const struct stat* st)
     return entry;
 }
 
+/**
+ * Thread pool task: get status of directory entries.
+ * @param index task index
+ * @param data pointer to the scan job
+ */
+static void scan_task(size_t index, void* data)
+{
+    const struct scan_job* job = data;
+    const size_t start = job->num * index / job->tasks;
+    const size_t end = job->num * (index + 1) / job->tasks;
+
+    for (size_t i = start; i < end; ++i) {
+        struct scan_entry* entry = &job->entries[i];
+        const char* name = job->names + entry->name;
+        entry->valid = (fstatat(job->dir_fd, name, &entry->st, 0) == 0);
+    }
+}
+
+/**
+ * Read directory entries and get their status.
+ * @param dir_handle directory to read
+ * @param job scan job to fill
+ * @return false if not enough memory
+ */
+static bool scan_dir(DIR* dir_handle, struct scan_job* job)
+{
+    size_t names_size = 0;
+    size_t entries_size = 0;
+    struct dirent* dir_entry;
+
+    // read names, status is requested later for all entries at once
+    while ((dir_entry = readdir(dir_handle))) {
+        const char* name = dir_entry->d_name;
+        const size_t len = strlen(name) + 1 /* last null */;
+
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+            continue; // skip link to self/parent
+        }
+
+        if (job->names_len + len > names_size) {
+            const size_t size = (names_size + len) * 2;
+            char* names = realloc(job->names, size);
+            if (!names) {
+                return false;
+            }
+            job->names = names;
+            names_size = size;
+        }
+        if (job->num == entries_size) {
+            const size_t size = entries_size ? entries_size * 2 : 64;
+            struct scan_entry* entries =
+                realloc(job->entries, size * sizeof(*entries));
+            if (!entries) {
+                return false;
+            }
+            job->entries = entries;
+            entries_size = size;
+        }
+
+        job->entries[job->num++].name = job->names_len;
+        memcpy(job->names + job->names_len, name, len);
+        job->names_len += len;
+    }
+
+    // get status of all entries in parallel, it is the longest part of
+    // scanning, especially on network file systems
+    job->dir_fd = dirfd(dir_handle);
+    job->tasks = tpool_tasks(job->num / SCAN_TASK_ENTRIES + 1);
+    tpool_run(job->tasks, scan_task, job);
+
+    return true;
+}
+
 /**
  * Add files from the directory to the list.
  * @param dir absolute path to the directory
@@ -166,57 +571,64 @@ static struct image* add_entry(const char* source, const struct stat* st)
  */
 static struct image* add_dir(const char* dir)
 {
+    TRACE_SCOPE("imglist_scan_dir");
+    const size_t dir_len = strlen(dir);
     struct image* img = NULL;
-    struct dirent* dir_entry;
+    struct scan_job job;
+    char path[PATH_MAX];
     DIR* dir_handle;
 
+    if (dir_len >= sizeof(path)) {
+        return NULL;
+    }
+
     dir_handle = opendir(dir);
     if (!dir_handle) {
         return NULL;
     }
 
-    while ((dir_entry = readdir(dir_handle))) {
-        char path[PATH_MAX] = { 0 };
-        const char* name = dir_entry->d_name;
-        struct stat st;
+    memset(&job, 0, sizeof(job));
+    if (!scan_dir(dir_handle, &job)) {
+        fprintf(stderr, "Not enough memory to read directory %s\n", dir);
+        job.num = 0;
+    }
+    closedir(dir_handle);
 
-        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
-            continue; // skip link to self/parent
+    // the directory part of the path is the same for all entries
+    memcpy(path, dir, dir_len + 1);
+
+    for (size_t i = 0; i < job.num; ++i) {
+        const struct scan_entry* entry = &job.entries[i];
+
+        if (!entry->valid) {
+            continue;
         }
         // compose full path
-        strncpy(path, dir, sizeof(path) - 1);
-        if (!fs_append_path(name, path, sizeof(path))) {
+        path[dir_len] = 0;
+        if (!fs_append_path(job.names + entry->name, path, sizeof(path))) {
             continue; // buffer too small
         }
 
-        if (stat(path, &st) == 0) {
-            if (S_ISDIR(st.st_mode)) {
-                if (ctx.recursive) {
-                    fs_append_path(NULL, path, sizeof(path)); // append slash
-                    img = add_dir(path);
-                }
-            } else if (S_ISREG(st.st_mode)) {
-                img = add_entry(path, &st);
+        if (S_ISDIR(entry->st.st_mode)) {
+            if (ctx.recursive) {
+                fs_append_path(NULL, path, sizeof(path)); // append slash
+                img = add_dir(path);
             }
+        } else if (S_ISREG(entry->st.st_mode)) {
+            img = add_entry(path, &entry->st);
         }
     }
 
+    free(job.entries);
+    free(job.names);
+
     // get the first image in the directory
-    if (img) {
-        const size_t dir_len = strlen(dir);
-        list_for_each_back(list_prev(img), struct image, it) {
-            if (strncmp(dir, it->source, dir_len) == 0) {
-                img = it;
-            } else {
-                break;
-            }
-        }
+    if (img && !ctx.bulk) {
+        img = first_in_dir(img, dir);
     }
 
     fs_monitor_add(dir);
 
-    closedir(dir_handle);
-
     return img;
 }
 
@@ -251,8 +663,15 @@ static struct image* add_source(const char* source)
 
     // add directory to the list
     if (S_ISDIR(st.st_mode)) {
+        struct image* img;
         fs_append_path(NULL, fspath, sizeof(fspath)); // append slash
-        return add_dir(fspath);
+        img = add_dir(fspath);
+        if (img && ctx.bulk) {
+            // the first image in the directory is known only after sorting
+            sort_entries();
+            img = first_in_dir(img, fspath);
+        }
+        return img;
     }
 
     // add file to the list
@@ -322,98 +741,459 @@ static struct image* load_sources(const char* const* sources, size_t num)
 }
 
 /**
- * Construct image list by loading text lists.
- * @param files array of list files
- * @param num number of sources in the array
- * @return first image instance to show or NULL if list is empty
+ * Read list file: regular files are mapped to memory, other (e.g. pipes)
+ * are read to the heap buffer.
+ * @param file path to the list file
+ * @param size out: size of the data
+ * @param mapped out: flag to indicate that data is mapped (must be unmapped)
+ * @return pointer to the list data or NULL on errors
  */
-static struct image* load_fromfile(const char* const* files, size_t num)
+static char* read_list(const char* file, size_t* size, bool* mapped)
 {
-    ctx.all_files = false; // not applicable in this mode
+    char* data = NULL;
+    size_t capacity = 0;
+    size_t len = 0;
+    struct stat st;
+    int fd;
 
-    for (size_t i = 0; i < num; ++i) {
-        char* line = NULL;
-        size_t line_sz = 0;
+    fd = open(file, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return NULL;
+    }
+
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            posix_madvise(data, st.st_size, POSIX_MADV_SEQUENTIAL);
+            close(fd);
+            *size = st.st_size;
+            *mapped = true;
+            return data;
+        }
+        data = NULL;
+    }
+
+    // read the stream
+    while (true) {
         ssize_t rd;
-        FILE* fd;
+        if (len == capacity) {
+            char* buf;
+            capacity = capacity ? capacity * 2 : LIST_TASK_SIZE;
+            buf = realloc(data, capacity);
+            if (!buf) {
+                free(data);
+                data = NULL;
+                errno = ENOMEM;
+                break;
+            }
+            data = buf;
+        }
+        rd = read(fd, data + len, capacity - len);
+        if (rd == -1 && errno == EINTR) {
+            continue;
+        }
+        if (rd == -1) {
+            free(data);
+            data = NULL;
+            break;
+        }
+        if (rd == 0) {
+            *size = len;
+            *mapped = false;
+            break;
+        }
+        len += rd;
+    }
+
+    close(fd);
+
+    return data;
+}
+
+/**
+ * Put source to the parsed part of the list.
+ * @param part list part to update
+ * @param source source to put
+ * @param len length of the source
+ * @return pointer to the new entry or NULL if not enough memory
+ */
+static struct list_entry* put_list_entry(struct list_part* part,
+                                         const char* source, size_t len)
+{
+    struct list_entry* entry;
+
+    if (part->names_len + len + 1 > part->names_size) {
+        const size_t size = (part->names_size + len + 1) * 2;
+        char* names = realloc(part->names, size);
+        if (!names) {
+            return NULL;
+        }
+        part->names = names;
+        part->names_size = size;
+    }
+    if (part->num == part->size) {
+        const size_t size = part->size ? part->size * 2 : 64;
+        struct list_entry* entries =
+            realloc(part->entries, size * sizeof(*entries));
+        if (!entries) {
+            return NULL;
+        }
+        part->entries = entries;
+        part->size = size;
+    }
+
+    entry = &part->entries[part->num++];
+    entry->name = part->names_len;
+    memcpy(part->names + part->names_len, source, len);
+    part->names[part->names_len + len] = 0;
+    part->names_len += len + 1;
+
+    return entry;
+}
+
+/**
+ * Thread pool task: split part of the list file into lines and get status
+ * of the sources.
+ * @param index task index
+ * @param data pointer to the list job
+ */
+static void list_task(size_t index, void* data)
+{
+    const struct list_job* job = data;
+    struct list_part* part = &job->parts[index];
+    size_t pos = part->start;
+
+    // the line belongs to the part where it starts
+    if (pos > 0 && job->data[pos - 1] != '\n') {
+        const char* eol = memchr(job->data + pos, '\n', job->size - pos);
+        pos = eol ? (size_t)(eol - job->data) + 1 : job->size;
+    }
 
-        fd = fopen(files[i], "r");
-        if (!fd) {
-            const int rc = errno;
-            fprintf(stderr, "Unable to open list file %s: [%i] %s\n", files[i],
-                    rc, strerror(rc));
+    while (pos < part->end) {
+        const char* line = job->data + pos;
+        const char* eol = memchr(line, '\n', job->size - pos);
+        size_t len = eol ? (size_t)(eol - line) : job->size - pos;
+        char source[PATH_MAX];
+        char fspath[PATH_MAX];
+        struct stat st = { 0 };
+        struct list_entry* entry;
+        enum list_type type;
+        int error = 0;
+
+        pos += len + 1;
+
+        while (len && line[len - 1] == '\r') {
+            --len;
+        }
+        if (len == 0) {
             continue;
         }
 
-        while ((rd = getline(&line, &line_sz, fd)) > 0) {
-            while (rd && (line[rd - 1] == '\r' || line[rd - 1] == '\n')) {
-                line[--rd] = 0;
+        // get status of the source
+        if (len >= sizeof(source)) {
+            type = list_error;
+            error = ENAMETOOLONG;
+        } else {
+            memcpy(source, line, len);
+            source[len] = 0;
+            if (strncmp(source, LDRSRC_STDIN, LDRSRC_STDIN_LEN) == 0 ||
+                strncmp(source, LDRSRC_EXEC, LDRSRC_EXEC_LEN) == 0) {
+                type = list_special;
+            } else if (stat(source, &st) != 0) {
+                type = list_error;
+                error = errno;
+            } else if (fs_abspath(source, fspath, sizeof(fspath))) {
+                type = list_fs;
+                line = fspath;
+                len = strlen(fspath);
+            } else {
+                type = list_abspath;
             }
-            if (*line) {
-                add_source(line);
+        }
+
+        entry = put_list_entry(part, line, len);
+        if (!entry) {
+            part->oom = true;
+            break;
+        }
+        entry->type = type;
+        entry->error = error;
+        entry->st = st;
+    }
+}
+
+/**
+ * Add sources from the parsed part of the list file.
+ * @param part parsed part of the list
+ * @return the first added image instance or NULL if nothing was added
+ */
+static struct image* add_list_part(const struct list_part* part)
+{
+    struct image* img = NULL;
+
+    for (size_t i = 0; i < part->num; ++i) {
+        const struct list_entry* entry = &part->entries[i];
+        const char* source = part->names + entry->name;
+        struct image* added = NULL;
+
+        switch (entry->type) {
+            case list_special:
+                added = add_entry(source, NULL);
+                break;
+            case list_error:
+                fprintf(stderr, "Ignore file %s: [%i] %s\n", source,
+                        entry->error, strerror(entry->error));
+                break;
+            case list_abspath:
+                fprintf(stderr, "Ignore file %s: unknown absolute path\n",
+                        source);
+                break;
+            case list_fs:
+                if (S_ISDIR(entry->st.st_mode)) {
+                    char path[PATH_MAX];
+                    strncpy(path, source, sizeof(path) - 1);
+                    path[sizeof(path) - 1] = 0;
+                    fs_append_path(NULL, path, sizeof(path)); // append slash
+                    added = add_dir(path);
+                } else if (S_ISREG(entry->st.st_mode)) {
+                    added = add_entry(source, &entry->st);
+                    if (added) {
+                        fs_monitor_add(added->source);
+                    }
+                } else {
+                    fprintf(stderr, "Ignore special file %s\n", source);
+                }
+                break;
+        }
+
+        if (!img && added) {
+            img = added;
+        }
+    }
+
+    return img;
+}
+
+/**
+ * Load sources from the list file.
+ * The file is processed in batches: each batch is split into parts parsed
+ * in parallel (including file status requests, which is the longest
+ * operation), then the sources are added to the list in the original order.
+ * @param file path to the list file
+ * @return the first added image instance or NULL if nothing was added
+ */
+static struct image* load_list(const char* file)
+{
+    TRACE_SCOPE("imglist_load_list");
+    struct image* img = NULL;
+    struct list_job job = { 0 };
+    size_t tasks, pos;
+    bool mapped = false;
+    char* data;
+
+    data = read_list(file, &job.size, &mapped);
+    if (!data) {
+        const int rc = errno;
+        fprintf(stderr, "Unable to open list file %s: [%i] %s\n", file, rc,
+                strerror(rc));
+        return NULL;
+    }
+    job.data = data;
+
+    tasks = tpool_tasks(job.size / LIST_TASK_SIZE + 1);
+    job.parts = calloc(tasks, sizeof(*job.parts));
+    if (!job.parts) {
+        fprintf(stderr, "Not enough memory to load list file %s\n", file);
+        tasks = 0;
+    }
+
+    for (pos = 0; tasks && pos < job.size;) {
+        const size_t batch = tasks * LIST_TASK_SIZE;
+        const size_t end = job.size - pos > batch ? pos + batch : job.size;
+        bool oom = false;
+
+        for (size_t i = 0; i < tasks; ++i) {
+            struct list_part* part = &job.parts[i];
+            part->start = pos + (end - pos) * i / tasks;
+            part->end = pos + (end - pos) * (i + 1) / tasks;
+            part->names_len = 0;
+            part->num = 0;
+        }
+        tpool_run(tasks, list_task, &job);
+
+        for (size_t i = 0; i < tasks; ++i) {
+            struct image* added = add_list_part(&job.parts[i]);
+            if (!img && added) {
+                img = added;
             }
+            oom |= job.parts[i].oom;
+        }
+        if (oom) {
+            fprintf(stderr, "Not enough memory to load list file %s\n", file);
+            break;
         }
 
-        free(line);
-        fclose(fd);
+        pos = end;
+    }
+
+    for (size_t i = 0; i < tasks; ++i) {
+        free(job.parts[i].names);
+        free(job.parts[i].entries);
+    }
+    free(job.parts);
+
+    if (mapped) {
+        munmap(data, job.size);
+    } else {
+        free(data);
+    }
+
+    return img;
+}
+
+/**
+ * Construct image list by loading text lists.
+ * @param files array of list files
+ * @param num number of sources in the array
+ * @return the first added image instance or NULL if nothing was added
+ */
+static struct image* load_fromfile(const char* const* files, size_t num)
+{
+    struct image* img = NULL;
+
+    ctx.all_files = false; // not applicable in this mode
+
+    for (size_t i = 0; i < num; ++i) {
+        struct image* added = load_list(files[i]);
+        if (!img && added) {
+            img = added;
+        }
+    }
+
+    return img;
+}
+
+/**
+ * Renumber entries of the image list.
+ * @param start first entry to renumber, all subsequent entries are renumbered
+ * @param index index of the start entry
+ */
+static void renumber(struct image* start, size_t index)
+{
+    ctx.size = index - 1;
+    list_for_each(start, struct image, it) {
+        it->index = ++ctx.size;
+        if (ctx.array) {
+            ctx.array[ctx.size - 1] = it;
+        }
     }
+}
 
-    return imglist_first();
+/**
+ * Check if the entry is registered in the index array.
+ * @param img image entry to check
+ * @return true if the array can be used to access neighbors of the entry
+ */
+static bool in_array(const struct image* img)
+{
+    return ctx.array_valid && img->index > 0 && img->index <= ctx.size &&
+        ctx.array[img->index - 1] == img;
 }
 
 /** Reindex the image list. */
 static void reindex(void)
 {
-    ctx.size = 0;
-    list_for_each(ctx.images, struct image, it) {
-        it->index = ++ctx.size;
+    // ctx.size counts added entries, so it is never less than list length
+    if (ctx.size > ctx.array_size) {
+        size_t size = ctx.array_size ? ctx.array_size : 64;
+        struct image** array;
+        while (size < ctx.size) {
+            size *= 2;
+        }
+        array = realloc(ctx.array, size * sizeof(*array));
+        if (array) {
+            ctx.array = array;
+            ctx.array_size = size;
+        } else {
+            // fallback to list traversal
+            free(ctx.array);
+            ctx.array = NULL;
+            ctx.array_size = 0;
+        }
     }
+
+    renumber(ctx.images, 1);
+    ctx.array_valid = (ctx.array != NULL);
 }
 
-/** File system event handler. */
-static void on_fsevent(enum fsevent type, const char* path)
+/**
+ * Remove entry from the list and free it, the entries are not renumbered.
+ * @param img image entry to remove
+ */
+static void remove_entry(struct image* img)
+{
+    hash_remove(img);
+    ctx.images = list_remove(img);
+    image_free(img, IMGFREE_ALL);
+}
+
+/**
+ * Add entry created in the file system.
+ * @param path absolute path, ends with "/" if it is a directory
+ * @return the added image entry or NULL if nothing was added
+ */
+static struct image* add_created(const char* path)
 {
     const size_t path_len = strlen(path);
-    const bool is_dir = (path[path_len - 1] == '/'); // ends with '/'
+    struct stat st;
+
+    if (path[path_len - 1] == '/') {
+        return ctx.recursive ? add_dir(path) : NULL;
+    }
+    if (stat(path, &st) == 0 && S_ISREG(st.st_mode)) {
+        return add_entry(path, &st);
+    }
+    return NULL;
+}
+
+/** File system event handler. */
+static void on_fsevent(const struct fs_event* events, size_t num)
+{
+    bool created = false;
 
     imglist_lock();
 
-    switch (type) {
-        case fsevent_create:
-            if (is_dir) {
-                if (ctx.recursive) {
-                    const struct image* img = add_dir(path);
-                    if (img) {
-                        app_on_imglist(img, type);
-                    }
-                }
-            } else {
-                struct stat st;
-                if (stat(path, &st) == 0 && S_ISREG(st.st_mode)) {
-                    const struct image* img = add_entry(path, &st);
-                    if (img) {
-                        app_on_imglist(img, type);
-                    }
-                }
-            }
-            break;
-        case fsevent_remove:
-            if (!is_dir) {
-                struct image* img = imglist_find(path);
-                if (img) {
-                    app_on_imglist(img, type);
-                    imglist_remove(img);
-                }
-            }
-            break;
-        case fsevent_modify:
-            if (!is_dir) {
-                const struct image* img = imglist_find(path);
+    // handle existing entries first, while the list is still sorted
+    for (size_t i = 0; i < num; ++i) {
+        struct image* img = imglist_find(events[i].path);
+        if (!img) {
+            created |= (events[i].type == fsevent_create);
+        } else if (events[i].type == fsevent_remove) {
+            app_on_imglist(img, fsevent_remove);
+            remove_entry(img);
+            ctx.array_valid = false; // until reindex
+        } else {
+            // created entry already exists if the file was replaced
+            app_on_imglist(img, fsevent_modify);
+        }
+    }
+
+    // add new entries at once, random order doesn't need sorting
+    if (created) {
+        ctx.bulk = (ctx.order != order_random);
+        for (size_t i = 0; i < num; ++i) {
+            if (events[i].type == fsevent_create &&
+                !imglist_find(events[i].path)) {
+                const struct image* img = add_created(events[i].path);
                 if (img) {
-                    app_on_imglist(img, type);
+                    app_on_imglist(img, fsevent_create);
                 }
             }
-            break;
+        }
+        if (ctx.bulk) {
+            sort_entries();
+            ctx.bulk = false;
+        }
     }
 
     reindex();
@@ -495,6 +1275,22 @@ void imglist_destroy(void)
     ctx.images = NULL;
     ctx.size = 0;
 
+    while (ctx.blocks) {
+        struct entry_block* next = ctx.blocks->next;
+        free(ctx.blocks);
+        ctx.blocks = next;
+    }
+
+    free(ctx.array);
+    ctx.array = NULL;
+    ctx.array_size = 0;
+    ctx.array_valid = false;
+
+    free(ctx.hash);
+    ctx.hash = NULL;
+    ctx.hash_size = 0;
+    ctx.hash_num = 0;
+
     pthread_mutex_destroy(&ctx.lock);
 }
 
@@ -519,36 +1315,82 @@ bool imglist_is_locked(void)
 
 struct image* imglist_load(const char* const* sources, size_t num)
 {
+    TRACE_SCOPE("imglist_load");
     struct image* img;
 
     assert(ctx.size == 0 && "already loaded");
 
+    // add all entries unordered and sort them at once
+    ctx.bulk = true;
     if (ctx.from_file) {
+        load_fromfile(sources, num);
+        sort_entries();
+        img = imglist_first();
+    } else {
+        img = load_sources(sources, num);
+        sort_entries();
+    }
+    ctx.bulk = false;
+
+    reindex();
+
+    return img;
+}
+
+struct image* imglist_add(const char* const* sources, size_t num,
+                          bool recursive, bool from_file)
+{
+    TRACE_SCOPE("imglist_add");
+    const bool all_files = ctx.all_files;
+    bool list_recursive;
+    struct image* img;
+
+    imglist_lock();
+
+    // options of the request are applied to its sources only
+    list_recursive = ctx.recursive;
+    ctx.recursive = recursive;
+
+    // new entries are sorted at once, random order doesn't need sorting
+    ctx.bulk = (ctx.order != order_random);
+    if (from_file) {
         img = load_fromfile(sources, num);
     } else {
         img = load_sources(sources, num);
     }
+    if (ctx.bulk) {
+        sort_entries();
+        ctx.bulk = false;
+    }
+    ctx.all_files = all_files; // can be reset by the loaders
+    ctx.recursive = list_recursive;
 
     reindex();
 
+    imglist_unlock();
+
     return img;
 }
 
 void imglist_remove(struct image* img)
 {
-    ctx.images = list_remove(img);
-    image_free(img, IMGFREE_ALL);
-    reindex();
+    struct image* next = list_next(img);
+    const size_t index = img->index;
+    const bool indexed = in_array(img);
+
+    remove_entry(img);
+
+    if (indexed) {
+        // only subsequent entries need to be renumbered
+        renumber(next, index);
+    } else {
+        reindex();
+    }
 }
 
 struct image* imglist_find(const char* source)
 {
-    list_for_each(ctx.images, struct image, it) {
-        if (strcmp(source, it->source) == 0) {
-            return it;
-        }
-    }
-    return NULL;
+    return ctx.hash ? *hash_slot(source) : NULL;
 }
 
 size_t imglist_size(void)
@@ -622,6 +1464,10 @@ struct image* imglist_rand(struct image* img)
 {
     size_t offset = 1 + rand() % (ctx.size - 1);
 
+    if (in_array(img)) {
+        return ctx.array[(img->index - 1 + offset) % ctx.size];
+    }
+
     while (offset--) {
         img = list_next(img);
         if (!img) {
@@ -636,6 +1482,14 @@ struct image* imglist_jump(struct image* img, ssize_t distance)
 {
     struct image* target = NULL;
 
+    if (in_array(img)) {
+        const ssize_t index = (ssize_t)img->index - 1 + distance;
+        if (index >= 0 && index < (ssize_t)ctx.size) {
+            target = ctx.array[index];
+        }
+        return target;
+    }
+
     if (distance > 0) {
         list_for_each(img, struct image, it) {
             if (distance-- == 0) {
@@ -661,6 +1515,10 @@ ssize_t imglist_distance(const struct image* start, const struct image* end)
 {
     ssize_t distance = 0;
 
+    if (in_array(start) && in_array(end)) {
+        return (ssize_t)end->index - (ssize_t)start->index;
+    }
+
     if (start->index <= end->index) {
         list_for_each(start, const struct image, it) {
             if (it == end) {
@@ -41,6 +41,17 @@ bool imglist_is_locked(void);
  */
 struct image* imglist_load(const char* const* sources, size_t num);
 
+/**
+ * Add sources to the already loaded image list, existing entries are kept.
+ * @param sources array of sources
+ * @param num number of sources in the array
+ * @param recursive read directories recursively
+ * @param from_file interpret sources as text lists of image files
+ * @return first added (or already existing) image instance or NULL on errors
+ */
+struct image* imglist_add(const char* const* sources, size_t num,
+                          bool recursive, bool from_file);
+
 /**
  * Remove image source to the list.
  * @param img image instance to remove
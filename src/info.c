@@ -9,6 +9,7 @@
 #include "font.h"
 #include "imglist.h"
 #include "keybind.h"
+#include "trace.h"
 #include "ui.h"
 
 #include <stdarg.h>
@@ -49,6 +50,13 @@ static const char* field_names[] = {
     [info_index] = "index",
     [info_scale] = "scale",
     [info_status] = "status",
+    [info_decode_time] = "decodetime",
+    [info_render_time] = "rendertime",
+    [info_frame_time] = "frametime",
+    [info_cache_hits] = "cachehits",
+    [info_memory] = "memory",
+    [info_memstat] = "memstat",
+    [info_queue] = "queue",
 };
 #define FIELDS_NUM ARRAY_SIZE(field_names)
 
@@ -95,6 +103,24 @@ struct block_scheme {
     size_t fields_num;           ///< Size of array
 };
 
+/** Area of the window covered by text block. */
+struct text_area {
+    ssize_t x, y;
+    size_t width, height;
+};
+
+/** Text surface placed on the window. */
+struct text_pos {
+    const struct text_surface* text;
+    ssize_t x, y;
+};
+
+/** Pre-composited text block. */
+struct overlay {
+    struct pixmap pm; ///< Block pixels with premultiplied alpha
+    ssize_t x, y;     ///< Position on the window
+};
+
 /** Info timeout description. */
 struct info_timeout {
     int fd;         ///< Timer FD
@@ -116,7 +142,18 @@ struct info_context {
     size_t exif_num;           ///< Number of lines in EXIF data
 
     struct keyval fields[FIELDS_NUM];                    ///< Info data
+    bool used[FIELDS_NUM];                               ///< Fields in use
     struct block_scheme scheme[MODES_NUM][POSITION_NUM]; ///< Info scheme
+
+    struct text_area areas[POSITION_NUM + 1]; ///< Text blocks on the window
+    size_t areas_num;                         ///< Number of text blocks
+
+    struct overlay overlays[POSITION_NUM + 1]; ///< Pre-composited blocks
+    size_t overlays_num;                       ///< Number of blocks
+    size_t overlay_width;  ///< Window width used for the overlay layout
+    size_t overlay_height; ///< Window height used for the overlay layout
+    bool overlay_viewer;   ///< Overlay built in viewer mode
+    bool dirty;            ///< Overlay must be rebuilt
 };
 
 /** Global info context. */
@@ -130,6 +167,7 @@ static void on_timeout(void* data)
 
     timeout->active = false;
     timerfd_settime(timeout->fd, 0, &ts, NULL);
+    ctx.dirty = true;
     app_redraw();
 }
 
@@ -157,6 +195,7 @@ static void timeout_init(struct info_timeout* timeout)
 static void timeout_reset(struct info_timeout* timeout)
 {
     timeout->active = true;
+    ctx.dirty = true;
     if (timeout->fd != -1) {
         struct itimerspec ts = { .it_value.tv_sec = timeout->timeout };
         timerfd_settime(timeout->fd, 0, &ts, NULL);
@@ -175,10 +214,98 @@ static void timeout_close(struct info_timeout* timeout)
 }
 
 /**
- * Print centered text block.
+ * Register text block printed on the window, the area is reported as damaged
+ * in the current and the next frames.
+ * @param x,y,width,height text block area
+ */
+static void add_area(ssize_t x, ssize_t y, size_t width, size_t height)
+{
+    if (ctx.areas_num < ARRAY_SIZE(ctx.areas)) {
+        struct text_area* area = &ctx.areas[ctx.areas_num++];
+        area->x = x;
+        area->y = y;
+        area->width = width;
+        area->height = height;
+    }
+    ui_damage(x, y, width, height);
+}
+
+/**
+ * Free pre-composited text blocks.
+ */
+static void free_overlay(void)
+{
+    for (size_t i = 0; i < ctx.overlays_num; ++i) {
+        pixmap_free(&ctx.overlays[i].pm);
+    }
+    ctx.overlays_num = 0;
+}
+
+/**
+ * Compose text block: blend all its texts into a single pixmap.
+ * @param texts array of texts with their positions on the window
+ * @param num number of texts in array
+ */
+static void compose_block(const struct text_pos* texts, size_t num)
+{
+    struct overlay* ovl;
+    ssize_t left = 0, top = 0, right = 0, bottom = 0;
+    bool empty = true;
+
+    if (ctx.overlays_num >= ARRAY_SIZE(ctx.overlays)) {
+        return;
+    }
+
+    // get block area including text decoration
+    for (size_t i = 0; i < num; ++i) {
+        const struct text_surface* text = texts[i].text;
+        const ssize_t margin = font_margin(text);
+        const ssize_t x0 = texts[i].x - margin;
+        const ssize_t y0 = texts[i].y - margin;
+        const ssize_t x1 = texts[i].x + (ssize_t)text->width + margin;
+        const ssize_t y1 = texts[i].y + (ssize_t)text->height + margin;
+        if (!text->data) {
+            continue;
+        }
+        if (empty) {
+            left = x0;
+            top = y0;
+            right = x1;
+            bottom = y1;
+            empty = false;
+        } else {
+            left = min(left, x0);
+            top = min(top, y0);
+            right = max(right, x1);
+            bottom = max(bottom, y1);
+        }
+    }
+    if (empty || right <= left || bottom <= top) {
+        return;
+    }
+
+    ovl = &ctx.overlays[ctx.overlays_num];
+    if (!pixmap_create(&ovl->pm, right - left, bottom - top)) {
+        return;
+    }
+    ovl->x = left;
+    ovl->y = top;
+    ++ctx.overlays_num;
+
+    for (size_t i = 0; i < num; ++i) {
+        if (texts[i].text->data) {
+            font_print(&ovl->pm, texts[i].x - left, texts[i].y - top,
+                       texts[i].text);
+        }
+    }
+    pixmap_premultiply(&ovl->pm);
+}
+
+/**
+ * Compose centered help text block.
  * @param wnd destination window
  */
-static void print_help(struct pixmap* window)
+static void compose_help(const struct pixmap* window)
 {
     const size_t line_height = ctx.help[0].height;
     const size_t row_max = (window->height - TEXT_PADDING * 2) / line_height;
@@ -190,6 +317,13 @@ static void print_help(struct pixmap* window)
     size_t total_width = 0;
     size_t top = 0;
     size_t left = 0;
+    struct text_pos* texts;
+    size_t texts_num = 0;
+
+    texts = malloc(ctx.help_num * sizeof(*texts));
+    if (!texts) {
+        return;
+    }
 
     // calculate total width
     for (size_t col = 0; col < columns; ++col) {
@@ -224,7 +358,10 @@ static void print_help(struct pixmap* window)
             if (index >= ctx.help_num) {
                 break;
             }
-            font_print(window, left, y, &ctx.help[index]);
+            texts[texts_num].text = &ctx.help[index];
+            texts[texts_num].x = left;
+            texts[texts_num].y = y;
+            ++texts_num;
             if (col_width < ctx.help[index].width) {
                 col_width = ctx.help[index].width;
             }
@@ -232,20 +369,29 @@ static void print_help(struct pixmap* window)
         }
         left += col_width + col_space;
     }
+
+    compose_block(texts, texts_num);
+    free(texts);
 }
 
 /**
- * Print info block with key/value text.
+ * Compose info block with key/value text.
  * @param wnd destination window
  * @param pos block position
  * @param lines array of key/value lines to print
  * @param lines_num total number of lines
  */
-static void print_keyval(struct pixmap* wnd, enum block_position pos,
-                         const struct keyval* lines, size_t lines_num)
+static void compose_keyval(const struct pixmap* wnd, enum block_position pos,
+                           const struct keyval* lines, size_t lines_num)
 {
     size_t max_key_width = 0;
     const size_t height = lines[0].value.height;
+    struct text_pos texts[MAX_LINES * 2];
+    size_t texts_num = 0;
+
+    if (lines_num > MAX_LINES) {
+        lines_num = MAX_LINES;
+    }
 
     // calc max width of keys, used if block on the left side
     for (size_t i = 0; i < lines_num; ++i) {
@@ -255,7 +401,7 @@ static void print_keyval(struct pixmap* wnd, enum block_position pos,
     }
     max_key_width += height / 2;
 
-    // draw info block
+    // layout info block
     for (size_t i = 0; i < lines_num; ++i) {
         const struct text_surface* key = &lines[i].key;
         const struct text_surface* value = &lines[i].value;
@@ -304,9 +450,99 @@ static void print_keyval(struct pixmap* wnd, enum block_position pos,
         }
 
         if (key->data) {
-            font_print(wnd, x_key, y, key);
+            texts[texts_num].text = key;
+            texts[texts_num].x = x_key;
+            texts[texts_num].y = y;
+            ++texts_num;
+        }
+        texts[texts_num].text = value;
+        texts[texts_num].x = x_val;
+        texts[texts_num].y = y;
+        ++texts_num;
+    }
+
+    compose_block(texts, texts_num);
+}
+
+/**
+ * Rebuild pre-composited overlay for the current state.
+ * @param window destination window
+ */
+static void compose_overlay(const struct pixmap* window)
+{
+    free_overlay();
+
+    if (info_help_active()) {
+        compose_help(window);
+    }
+
+    if (ctx.mode == mode_off || !ctx.info.active) {
+        // print only status
+        if (ctx.fields[info_status].value.width && ctx.status.active) {
+            const size_t btype = app_is_viewer() ? mode_viewer : mode_gallery;
+            for (size_t i = 0; i < POSITION_NUM; ++i) {
+                const struct block_scheme* block = &ctx.scheme[btype][i];
+                for (size_t j = 0; j < block->fields_num; ++j) {
+                    const struct field_scheme* field = &block->fields[j];
+                    if (field->type == info_status) {
+                        struct keyval status = ctx.fields[info_status];
+                        if (!field->title) {
+                            memset(&status.key, 0, sizeof(status.key));
+                        }
+                        compose_keyval(window, i, &status, 1);
+                        break;
+                    }
+                }
+            }
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < POSITION_NUM; ++i) {
+        struct keyval lines[MAX_LINES] = { 0 };
+        const struct block_scheme* block = &ctx.scheme[ctx.mode][i];
+        size_t lnum = 0;
+
+        for (size_t j = 0; j < block->fields_num; ++j) {
+            const struct field_scheme* field = &block->fields[j];
+            const struct keyval* origin = &ctx.fields[field->type];
+
+            switch (field->type) {
+                case info_exif:
+                    for (size_t n = 0; n < ctx.exif_num; ++n) {
+                        if (lnum < ARRAY_SIZE(lines)) {
+                            if (field->title) {
+                                lines[lnum].key = ctx.exif_lines[n].key;
+                            }
+                            lines[lnum++].value = ctx.exif_lines[n].value;
+                        }
+                    }
+                    break;
+                case info_status:
+                    if (origin->value.width && ctx.status.active) {
+                        if (field->title) {
+                            lines[lnum].key = origin->key;
+                        }
+                        lines[lnum++].value = origin->value;
+                    }
+                    break;
+                default:
+                    if (origin->value.width) {
+                        if (field->title) {
+                            lines[lnum].key = origin->key;
+                        }
+                        lines[lnum++].value = origin->value;
+                    }
+                    break;
+            }
+            if (lnum >= ARRAY_SIZE(lines)) {
+                break;
+            }
+        }
+
+        if (lnum) {
+            compose_keyval(window, i, lines, lnum);
         }
-        font_print(wnd, x_val, y, value);
     }
 }
 
@@ -322,8 +558,8 @@ static void import_meta(const struct image* image)
 
     // free previous lines
     for (size_t i = 0; i < ctx.exif_num; ++i) {
-        free(ctx.exif_lines[i].key.data);
-        free(ctx.exif_lines[i].value.data);
+        font_free(&ctx.exif_lines[i].key);
+        font_free(&ctx.exif_lines[i].value);
     }
     ctx.exif_num = 0;
 
@@ -441,6 +677,9 @@ void info_init(const struct config* cfg)
                 format = config_get_default(section, position);
                 parse_scheme(format, &ctx.scheme[i][j]);
             }
+            for (size_t k = 0; k < ctx.scheme[i][j].fields_num; ++k) {
+                ctx.used[ctx.scheme[i][j].fields[k].type] = true;
+            }
         }
     }
 
@@ -469,6 +708,14 @@ void info_reinit(void)
     font_render("Index:", &ctx.fields[info_index].key);
     font_render("Scale:", &ctx.fields[info_scale].key);
     font_render("Status:", &ctx.fields[info_status].key);
+    font_render("Decode time:", &ctx.fields[info_decode_time].key);
+    font_render("Render time:", &ctx.fields[info_render_time].key);
+    font_render("Frame time:", &ctx.fields[info_frame_time].key);
+    font_render("Cache hits:", &ctx.fields[info_cache_hits].key);
+    font_render("Memory:", &ctx.fields[info_memory].key);
+    font_render("Allocations:", &ctx.fields[info_memstat].key);
+    font_render("Queue:", &ctx.fields[info_queue].key);
+    ctx.dirty = true;
 }
 
 void info_destroy(void)
@@ -476,9 +723,11 @@ void info_destroy(void)
     timeout_close(&ctx.info);
     timeout_close(&ctx.status);
 
+    free_overlay();
+
     for (size_t i = 0; i < ctx.exif_num; ++i) {
-        free(ctx.exif_lines[i].key.data);
-        free(ctx.exif_lines[i].value.data);
+        font_free(&ctx.exif_lines[i].key);
+        font_free(&ctx.exif_lines[i].value);
     }
 
     for (size_t i = 0; i < MODES_NUM; ++i) {
@@ -488,12 +737,12 @@ void info_destroy(void)
     }
 
     for (size_t i = 0; i < FIELDS_NUM; ++i) {
-        free(ctx.fields[i].key.data);
-        free(ctx.fields[i].value.data);
+        font_free(&ctx.fields[i].key);
+        font_free(&ctx.fields[i].value);
     }
 
     for (size_t i = 0; i < ctx.help_num; i++) {
-        free(ctx.help[i].data);
+        font_free(&ctx.help[i]);
     }
     free(ctx.help);
 }
@@ -520,9 +769,11 @@ void info_switch(const char* mode)
 
 void info_switch_help(void)
 {
+    ctx.dirty = true;
+
     if (ctx.help) {
         for (size_t i = 0; i < ctx.help_num; i++) {
-            free(ctx.help[i].data);
+            font_free(&ctx.help[i]);
         }
         free(ctx.help);
         ctx.help = NULL;
@@ -563,7 +814,12 @@ bool info_enabled(void)
     return (ctx.mode != mode_off);
 }
 
-void info_reset(const struct image* image)
+bool info_has_field(enum info_field field)
+{
+    return ctx.used[field];
+}
+
+void info_reset(struct image* image)
 {
     const size_t mib = 1024 * 1024;
     const char unit = image->file_size >= mib ? 'M' : 'K';
@@ -582,14 +838,16 @@ void info_reset(const struct image* image)
         info_update(info_image_size, "%zux%zu", image->frames[0].pm.width,
                     image->frames[0].pm.height);
     } else {
-        ctx.fields[info_image_size].value.width = 0;
-        ctx.fields[info_image_size].value.height = 0;
+        font_free(&ctx.fields[info_image_size].value);
     }
 
     if (list_size) {
         info_update(info_index, "%zu of %zu", image->index, list_size);
     }
 
+    if (ctx.used[info_exif]) {
+        image_load_meta(image); // parse only when it is displayed
+    }
     import_meta(image);
 
     info_update(info_frame, NULL);
@@ -605,6 +863,12 @@ void info_update(enum info_field field, const char* fmt, ...)
     int len;
     char* text;
 
+    if (!ctx.used[field]) {
+        return; // not displayed
+    }
+
+    ctx.dirty = true;
+
     if (!fmt) {
         free(surface->data);
         memset(surface, 0, sizeof(*surface));
@@ -637,76 +901,29 @@ void info_update(enum info_field field, const char* fmt, ...)
 
 void info_print(struct pixmap* window)
 {
-    if (info_help_active()) {
-        print_help(window);
-    }
-
-    if (ctx.mode == mode_off || !ctx.info.active) {
-        // print only status
-        if (ctx.fields[info_status].value.width && ctx.status.active) {
-            const size_t btype = app_is_viewer() ? mode_viewer : mode_gallery;
-            for (size_t i = 0; i < POSITION_NUM; ++i) {
-                const struct block_scheme* block = &ctx.scheme[btype][i];
-                for (size_t j = 0; j < block->fields_num; ++j) {
-                    const struct field_scheme* field = &block->fields[j];
-                    if (field->type == info_status) {
-                        struct keyval status = ctx.fields[info_status];
-                        if (!field->title) {
-                            memset(&status.key, 0, sizeof(status.key));
-                        }
-                        print_keyval(window, i, &status, 1);
-                        break;
-                    }
-                }
-            }
-        }
-        return;
-    }
-
-    for (size_t i = 0; i < POSITION_NUM; ++i) {
-        struct keyval lines[MAX_LINES] = { 0 };
-        const struct block_scheme* block = &ctx.scheme[ctx.mode][i];
-        size_t lnum = 0;
-
-        for (size_t j = 0; j < block->fields_num; ++j) {
-            const struct field_scheme* field = &block->fields[j];
-            const struct keyval* origin = &ctx.fields[field->type];
-
-            switch (field->type) {
-                case info_exif:
-                    for (size_t n = 0; n < ctx.exif_num; ++n) {
-                        if (lnum < ARRAY_SIZE(lines)) {
-                            if (field->title) {
-                                lines[lnum].key = ctx.exif_lines[n].key;
-                            }
-                            lines[lnum++].value = ctx.exif_lines[n].value;
-                        }
-                    }
-                    break;
-                case info_status:
-                    if (origin->value.width && ctx.status.active) {
-                        if (field->title) {
-                            lines[lnum].key = origin->key;
-                        }
-                        lines[lnum++].value = origin->value;
-                    }
-                    break;
-                default:
-                    if (origin->value.width) {
-                        if (field->title) {
-                            lines[lnum].key = origin->key;
-                        }
-                        lines[lnum++].value = origin->value;
-                    }
-                    break;
-            }
-            if (lnum >= ARRAY_SIZE(lines)) {
-                break;
-            }
-        }
-
-        if (lnum) {
-            print_keyval(window, i, lines, lnum);
-        }
+    TRACE_SCOPE("info_print");
+    const bool viewer = app_is_viewer();
+
+    // text printed in the previous frame is erased
+    for (size_t i = 0; i < ctx.areas_num; ++i) {
+        const struct text_area* area = &ctx.areas[i];
+        ui_damage(area->x, area->y, area->width, area->height);
+    }
+    ctx.areas_num = 0;
+
+    // text blocks are composed only if something has changed
+    if (ctx.dirty || ctx.overlay_width != window->width ||
+        ctx.overlay_height != window->height || ctx.overlay_viewer != viewer) {
+        compose_overlay(window);
+        ctx.overlay_width = window->width;
+        ctx.overlay_height = window->height;
+        ctx.overlay_viewer = viewer;
+        ctx.dirty = false;
+    }
+
+    for (size_t i = 0; i < ctx.overlays_num; ++i) {
+        const struct overlay* ovl = &ctx.overlays[i];
+        pixmap_over(&ovl->pm, window, ovl->x, ovl->y);
+        add_area(ovl->x, ovl->y, ovl->pm.width, ovl->pm.height);
     }
 }
@@ -20,6 +20,13 @@ enum info_field {
     info_index,
     info_scale,
     info_status,
+    info_decode_time,
+    info_render_time,
+    info_frame_time,
+    info_cache_hits,
+    info_memory,
+    info_memstat,
+    info_queue,
 };
 
 /**
@@ -61,11 +68,19 @@ bool info_help_active(void);
  */
 bool info_enabled(void);
 
+/**
+ * Check if the field is displayed in any of info schemes, used to skip
+ * collecting data for performance fields that are not shown.
+ * @param field info field id
+ * @return true if field is in use
+ */
+bool info_has_field(enum info_field field);
+
 /**
  * Compose info data from image.
  * @param image image instance
  */
-void info_reset(const struct image* image);
+void info_reset(struct image* image);
 
 /**
  * Update info text.
@@ -77,6 +77,40 @@ static struct image* rearrange(struct layout* lo, size_t* visible)
     return first;
 }
 
+/**
+ * Get index of the top visible row (not counting rows exposed by scroll).
+ * @param lo pointer to the thumbnail layout
+ * @return index of the row in the image list
+ */
+static ssize_t top_row(const struct layout* lo)
+{
+    const ssize_t distance = imglist_distance(imglist_first(), lo->current);
+    return distance / lo->columns - lo->current_row;
+}
+
+/**
+ * Compensate movement of the top row with scroll offset, so the view stays
+ * in place and then can be smoothly scrolled to the new position.
+ * @param lo pointer to the thumbnail layout
+ * @param prev_top index of the top row before movement
+ * @return shift of the top row
+ */
+static ssize_t keep_view(struct layout* lo, ssize_t prev_top)
+{
+    const ssize_t row_height = lo->thumb_size + lo->padding;
+    const ssize_t shift = top_row(lo) - prev_top;
+
+    if (shift) {
+        lo->scroll += shift * row_height;
+        if (labs(lo->scroll) >= (ssize_t)lo->rows * row_height) {
+            lo->scroll = 0; // too far, just jump
+        }
+        layout_update(lo);
+    }
+
+    return shift;
+}
+
 void layout_init(struct layout* lo, size_t thumb_size)
 {
     memset(lo, 0, sizeof(*lo));
@@ -97,11 +131,27 @@ void layout_update(struct layout* lo)
 {
     assert(imglist_is_locked());
 
+    const ssize_t row_height = lo->thumb_size + lo->padding;
     size_t total;
     struct image* img;
 
     img = rearrange(lo, &total);
 
+    // add rows exposed by scroll
+    lo->above = 0;
+    if (lo->scroll > 0) {
+        const size_t top = imglist_distance(imglist_first(), img) / lo->columns;
+        const size_t rows = (lo->scroll + row_height - 1) / row_height;
+        lo->above = min(top, rows);
+        img = imglist_jump(img, -(ssize_t)(lo->above * lo->columns));
+        total += lo->above * lo->columns;
+    } else if (lo->scroll < 0) {
+        const size_t below = (-lo->scroll + row_height - 1) / row_height;
+        const struct image* last = imglist_jump(img, total - 1);
+        const size_t rest = imglist_distance(last, imglist_last());
+        total += min(rest, below * lo->columns);
+    }
+
     // realloc thumbnails map
     if (total > lo->thumb_total) {
         struct layout_thumb* thumbs;
@@ -119,13 +169,13 @@ void layout_update(struct layout* lo)
         const size_t col = i % lo->columns;
         const size_t row = i / lo->columns;
         thumb->x = col * lo->thumb_size + lo->padding * (col + 1);
-        thumb->y = row * lo->thumb_size + lo->padding * (row + 1);
+        thumb->y = ((ssize_t)row - (ssize_t)lo->above) * row_height +
+            lo->padding + lo->scroll;
         thumb->img = img;
         img = imglist_next(img);
     }
 
-    assert(lo->current ==
-           lo->thumbs[lo->current_row * lo->columns + lo->current_col].img);
+    assert(lo->current == layout_current(lo)->img);
 }
 
 void layout_resize(struct layout* lo, size_t width, size_t height)
@@ -146,6 +196,7 @@ bool layout_select(struct layout* lo, enum layout_dir dir)
 {
     assert(imglist_is_locked());
 
+    const ssize_t top = top_row(lo);
     ssize_t col = lo->current_col;
     ssize_t row = lo->current_row;
     struct image* next = NULL;
@@ -204,25 +255,73 @@ bool layout_select(struct layout* lo, enum layout_dir dir)
             lo->current_row = row;
         }
         lo->current = next;
+        if (!lo->smooth) {
+            lo->scroll = 0; // align to rows
+        }
         layout_update(lo);
+        if (lo->smooth) {
+            keep_view(lo, top);
+        }
     }
 
     return next;
 }
 
+bool layout_scroll(struct layout* lo, ssize_t delta)
+{
+    assert(imglist_is_locked());
+
+    const ssize_t row_height = lo->thumb_size + lo->padding;
+    const ssize_t prev_scroll = lo->scroll;
+    const struct image* prev_current = lo->current;
+
+    lo->scroll -= delta;
+
+    // move selection to the next row together with the view
+    while (lo->scroll < -row_height / 2 || lo->scroll > row_height / 2) {
+        const ssize_t step = (ssize_t)lo->columns * (lo->scroll < 0 ? 1 : -1);
+        const ssize_t top = top_row(lo);
+        struct image* next = imglist_jump(lo->current, step);
+        if (!next) {
+            break;
+        }
+        lo->current = next;
+        layout_update(lo);
+        if (!keep_view(lo, top)) {
+            break; // view is at the edge of the list
+        }
+    }
+
+    // nothing to show beyond the first and the last rows
+    if ((lo->scroll > 0 && top_row(lo) == 0) ||
+        (lo->scroll < 0 &&
+         !imglist_jump(lo->current, (lo->rows - lo->current_row) *
+                                            lo->columns -
+                                        lo->current_col))) {
+        lo->scroll = 0;
+    }
+
+    layout_update(lo);
+
+    return lo->scroll != prev_scroll || lo->current != prev_current;
+}
+
 struct layout_thumb* layout_current(struct layout* lo)
 {
-    const size_t idx = lo->current_row * lo->columns + lo->current_col;
+    const size_t idx =
+        (lo->above + lo->current_row) * lo->columns + lo->current_col;
     assert(idx < lo->thumb_total && lo->thumbs[idx].img);
     assert(lo->thumbs[idx].img == lo->current);
     return &lo->thumbs[idx];
 }
 
-struct image* layout_ldqueue(struct layout* lo, size_t preload)
+struct image* layout_ldqueue(struct layout* lo, size_t fwd_preload,
+                             size_t back_preload)
 {
     assert(imglist_is_locked());
 
     struct image* queue = NULL;
+    struct image* invisible = NULL;
     struct image* first = lo->thumbs[0].img;
     struct image* last = lo->thumbs[lo->thumb_total - 1].img;
     struct image* fwd = layout_current(lo)->img;
@@ -243,7 +342,12 @@ struct image* layout_ldqueue(struct layout* lo, size_t preload)
         assert(next);
 
         if (!image_has_thumb(next)) {
-            queue = list_append(queue, image_create(next->source));
+            struct image* img = image_create(next->source);
+            if (forward ? fwd_visible : back_visible) {
+                queue = list_append(queue, img);
+            } else {
+                invisible = list_append(invisible, img);
+            }
         }
 
         if (forward && fwd) {
@@ -252,8 +356,8 @@ struct image* layout_ldqueue(struct layout* lo, size_t preload)
             }
             fwd = imglist_next(fwd);
             if (fwd && !fwd_visible) {
-                if (preload) {
-                    --preload;
+                if (fwd_preload) {
+                    --fwd_preload;
                 } else {
                     fwd = NULL;
                 }
@@ -263,9 +367,9 @@ struct image* layout_ldqueue(struct layout* lo, size_t preload)
                 back_visible = (back != first);
             }
             back = imglist_prev(back);
-            if (back && !fwd_visible) {
-                if (preload) {
-                    --preload;
+            if (back && !back_visible) {
+                if (back_preload) {
+                    --back_preload;
                 } else {
                     back = NULL;
                 }
@@ -275,6 +379,11 @@ struct image* layout_ldqueue(struct layout* lo, size_t preload)
         forward = !forward;
     }
 
+    // put invisible images to the end of the queue
+    list_for_each(invisible, struct image, it) {
+        queue = list_append(queue, it);
+    }
+
     return queue;
 }
 
@@ -10,7 +10,7 @@
 struct layout_thumb {
     struct image* img;
     size_t x;
-    size_t y;
+    ssize_t y; ///< Can be negative for the row scrolled out of the window
 };
 
 /** Thumbnail layout scheme. */
@@ -23,6 +23,10 @@ struct layout {
     size_t current_col;    ///< Currently selected column
     size_t current_row;    ///< Currently selected row
 
+    ssize_t scroll; ///< Vertical offset of thumbnails in pixels
+    size_t above;   ///< Number of rows above the top one exposed by scroll
+    bool smooth;    ///< Keep the view in place when selection moves rows
+
     size_t thumb_size;           ///< Size of thumbnail (in pixels)
     size_t thumb_total;          ///< Total number of showed thumbnails
     struct layout_thumb* thumbs; ///< Visible thumbnails array
@@ -74,6 +78,15 @@ void layout_resize(struct layout* lo, size_t width, size_t height);
  */
 bool layout_select(struct layout* lo, enum layout_dir dir);
 
+/**
+ * Scroll layout by pixels, the selection follows the view as soon as it is
+ * scrolled by more than half a row.
+ * @param lo pointer to the thumbnail layout
+ * @param delta scroll distance in pixels, positive to scroll down
+ * @return true if the view or selection was changed
+ */
+bool layout_scroll(struct layout* lo, ssize_t delta);
+
 /**
  * Get currently selected thumbnail from layout.
  * @param lo pointer to the thumbnail layout
@@ -82,12 +95,15 @@ bool layout_select(struct layout* lo, enum layout_dir dir);
 struct layout_thumb* layout_current(struct layout* lo);
 
 /**
- * Create loading queue: ordered list of images to load.
+ * Create loading queue: ordered list of images to load, visible images first,
+ * then invisible ones, both are ordered by distance from the current image.
  * @param lo pointer to the thumbnail layout
- * @param preload number of invisible images to add to queue
+ * @param fwd_preload number of invisible images after the visible ones
+ * @param back_preload number of invisible images before the visible ones
  * @return pointer to the list head, caller should free the list
  */
-struct image* layout_ldqueue(struct layout* lo, size_t preload);
+struct image* layout_ldqueue(struct layout* lo, size_t fwd_preload,
+                             size_t back_preload);
 
 /**
  * Clear thumbnails.
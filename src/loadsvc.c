@@ -0,0 +1,119 @@
+// SPDX-License-Identifier: MIT
+// Image loading service: deduplication of images decoded at the same time.
+// Copyright (C) 2025 Artem Senichev <artemsen@gmail.com>
+
+#include "loadsvc.h"
+
+#include "list.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Image being decoded. */
+struct loadsvc_job {
+    struct list list;    ///< Links to prev/next entry
+    pthread_cond_t done; ///< Completion notification of this job
+    size_t waiters;      ///< Number of loaders waiting for completion
+    bool full;           ///< Full size frames are decoded
+    bool complete;       ///< Decoding is complete
+    bool published;      ///< Result was put to the image list
+    char source[1];      ///< Image source (variable length)
+};
+
+/** Loading service context. */
+struct loadsvc {
+    struct loadsvc_job* jobs; ///< Images being decoded
+    pthread_mutex_t lock;     ///< Lock of the job list only
+};
+
+static struct loadsvc ctx = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/**
+ * Search for active job, must be called with the service locked.
+ * @param source image source
+ * @param full true to search for full size decoding only
+ * @return pointer to the job or NULL if not found
+ */
+static struct loadsvc_job* find_job(const char* source, bool full)
+{
+    list_for_each(ctx.jobs, struct loadsvc_job, it) {
+        if (!it->complete && (it->full || !full) &&
+            strcmp(it->source, source) == 0) {
+            return it;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Remove job if nobody needs it, must be called with the service locked.
+ * @param job job to release
+ */
+static void release_job(struct loadsvc_job* job)
+{
+    if (job->complete && job->waiters == 0) {
+        ctx.jobs = list_remove(job);
+        pthread_cond_destroy(&job->done);
+        free(job);
+    }
+}
+
+bool loadsvc_begin(const char* source, bool full)
+{
+    const size_t len = strlen(source);
+    struct loadsvc_job* job;
+
+    pthread_mutex_lock(&ctx.lock);
+
+    // wait for the same image being decoded by another loader
+    while ((job = find_job(source, full))) {
+        bool published;
+        ++job->waiters;
+        while (!job->complete) {
+            pthread_cond_wait(&job->done, &ctx.lock);
+        }
+        --job->waiters;
+        published = job->published;
+        release_job(job);
+        if (published) {
+            pthread_mutex_unlock(&ctx.lock);
+            return false;
+        }
+    }
+
+    // register new job, the caller decodes the image even if there is not
+    // enough memory to register it
+    job = calloc(1, sizeof(*job) + len);
+    if (job) {
+        pthread_cond_init(&job->done, NULL);
+        job->full = full;
+        memcpy(job->source, source, len + 1);
+        ctx.jobs = list_add(ctx.jobs, job);
+    }
+
+    pthread_mutex_unlock(&ctx.lock);
+
+    return true;
+}
+
+void loadsvc_end(const char* source, bool full, bool published)
+{
+    pthread_mutex_lock(&ctx.lock);
+
+    // there can be only one full and one thumbnail job for the same source
+    list_for_each(ctx.jobs, struct loadsvc_job, it) {
+        if (!it->complete && it->full == full &&
+            strcmp(it->source, source) == 0) {
+            it->complete = true;
+            it->published = published;
+            pthread_cond_broadcast(&it->done);
+            release_job(it);
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&ctx.lock);
+}
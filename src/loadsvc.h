@@ -0,0 +1,31 @@
+// SPDX-License-Identifier: MIT
+// Image loading service: deduplication of images decoded at the same time.
+// Copyright (C) 2025 Artem Senichev <artemsen@gmail.com>
+
+#pragma once
+
+#include <stdbool.h>
+
+/**
+ * Start loading the image source by background loader (viewer preloader,
+ * opener or gallery thumbnail loader). If the same source is being decoded
+ * by another loader, the call waits for its completion.
+ * A full size decoding is shared with requests for thumbnails, thumbnail
+ * decoding is not shared with requests for full size frames.
+ * The function must not be called with the image list locked.
+ * @param source image source
+ * @param full true if full size frames are required, false if thumbnail is
+ *             enough
+ * @return true if the caller must decode the image and then call
+ *         `loadsvc_end`, false if the image was decoded by another loader
+ *         and its result was put to the image list entry
+ */
+bool loadsvc_begin(const char* source, bool full);
+
+/**
+ * Finish loading started by `loadsvc_begin` and wake up waiting loaders.
+ * @param source image source
+ * @param full the same value as passed to `loadsvc_begin`
+ * @param published true if decoded data was put to the image list entry
+ */
+void loadsvc_end(const char* source, bool full, bool published);
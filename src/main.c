@@ -7,6 +7,8 @@
 #include "buildcfg.h"
 #include "config.h"
 #include "image.h"
+#include "server.h"
+#include "trace.h"
 
 #include <getopt.h>
 #include <locale.h>
@@ -38,6 +40,7 @@ static const struct cmdarg arguments[] = {
     { 'f', "fullscreen", NULL,    "show image in full screen mode" },
     { 'a', "class",      "NAME",  "set window class/app_id" },
     { 'c', "config",     "S.K=V", "set configuration parameter: section.key=value" },
+    { 'T', "thumbnails", NULL,    "generate gallery thumbnails and exit" },
     { 'v', "version",    NULL,    "print version info and exit" },
     { 'h', "help",       NULL,    "print this help and exit" },
 };
@@ -81,9 +84,13 @@ static void print_version(void)
  * Parse command line arguments.
  * @param argc number of arguments to parse
  * @param argv arguments array
+ * @param cfg config instance
+ * @param thumbs pointer to the thumbnail generation mode flag
+ * @param window pointer to the flag of specified window options
  * @return index of the first non option argument
  */
-static int parse_cmdargs(int argc, char* argv[], struct config* cfg)
+static int parse_cmdargs(int argc, char* argv[], struct config* cfg,
+                         bool* thumbs, bool* window)
 {
     struct option options[1 + ARRAY_SIZE(arguments)];
     char short_opts[ARRAY_SIZE(arguments) * 2];
@@ -109,6 +116,10 @@ static int parse_cmdargs(int argc, char* argv[], struct config* cfg)
 
     // parse arguments
     while ((opt = getopt_long(argc, argv, short_opts, options, NULL)) != -1) {
+        // all options except list ones are applied to the new window only
+        if (opt != 'r' && opt != 'F' && opt != 'T') {
+            *window = true;
+        }
         switch (opt) {
             case 'g':
                 config_set(cfg, CFG_GENERAL, CFG_GNRL_MODE, CFG_MODE_GALLERY);
@@ -147,6 +158,9 @@ static int parse_cmdargs(int argc, char* argv[], struct config* cfg)
                     exit(EXIT_FAILURE);
                 }
                 break;
+            case 'T':
+                *thumbs = true;
+                break;
             case 'v':
                 print_version();
                 exit(EXIT_SUCCESS);
@@ -169,17 +183,39 @@ static int parse_cmdargs(int argc, char* argv[], struct config* cfg)
 int main(int argc, char* argv[])
 {
     bool rc;
+    bool thumbs = false;
+    bool window = false;
     struct config* cfg;
+    struct trace_span span;
     int argn;
 
     setlocale(LC_ALL, "");
 
     cfg = config_load();
-    argn = parse_cmdargs(argc, argv, cfg);
+    argn = parse_cmdargs(argc, argv, cfg, &thumbs, &window);
+
+    // pass sources to the running instance to skip initialization
+    if (!thumbs && config_get_bool(cfg, CFG_GENERAL, CFG_GNRL_SERVER) &&
+        server_send((const char**)&argv[argn], argc - argn, cfg, window,
+                    &rc)) {
+        config_free(cfg);
+        return rc ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
     srand(getpid());
 
+    trace_init(cfg);
+
+    if (thumbs) {
+        rc = app_thumbnails(cfg, (const char**)&argv[argn], argc - argn);
+        config_free(cfg);
+        trace_destroy();
+        return rc ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    span = trace_begin("app_init");
     rc = app_init(cfg, (const char**)&argv[argn], argc - argn);
+    trace_end(&span);
     config_free(cfg);
 
     if (rc) {
@@ -187,5 +223,7 @@ int main(int argc, char* argv[])
         app_destroy();
     }
 
+    trace_destroy();
+
     return rc ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -0,0 +1,112 @@
+// SPDX-License-Identifier: MIT
+// Memory accounting: live and peak size of allocations by category.
+// Copyright (C) 2025 Artem Senichev <artemsen@gmail.com>
+
+#include "memstat.h"
+
+#include <stdatomic.h>
+
+// Bytes in MiB
+#define MIB (1024.0 * 1024.0)
+
+/** Counters of the memory category. */
+struct counter {
+    atomic_size_t live; ///< Currently used memory in bytes
+    atomic_size_t peak; ///< Max used memory in bytes
+};
+
+static struct counter counters[MEMSTAT_NUM];
+
+/** Category names. */
+static const char* names[] = {
+    [memstat_pixmap] = "pixmap",
+    [memstat_pool] = "pool",
+    [memstat_thumb] = "thumb",
+    [memstat_raw] = "raw",
+    [memstat_scaler] = "scaler",
+    [memstat_text] = "text",
+    [memstat_history] = "history",
+    [memstat_preload] = "preload",
+};
+
+/**
+ * Raise peak value of the counter.
+ * @param cnt counter to update
+ * @param live current live value
+ */
+static void update_peak(struct counter* cnt, size_t live)
+{
+    size_t peak = atomic_load(&cnt->peak);
+    while (peak < live &&
+           !atomic_compare_exchange_weak(&cnt->peak, &peak, live)) { }
+}
+
+void memstat_alloc(enum memstat_type type, size_t size)
+{
+    struct counter* cnt = &counters[type];
+    update_peak(cnt, atomic_fetch_add(&cnt->live, size) + size);
+}
+
+void memstat_free(enum memstat_type type, size_t size)
+{
+    struct counter* cnt = &counters[type];
+    size_t live = atomic_load(&cnt->live);
+    size_t next;
+
+    // don't wrap around on unbalanced calls
+    do {
+        next = live > size ? live - size : 0;
+    } while (!atomic_compare_exchange_weak(&cnt->live, &live, next));
+}
+
+void memstat_set(enum memstat_type type, size_t size)
+{
+    struct counter* cnt = &counters[type];
+    atomic_store(&cnt->live, size);
+    update_peak(cnt, size);
+}
+
+size_t memstat_live(enum memstat_type type)
+{
+    return atomic_load(&counters[type].live);
+}
+
+size_t memstat_peak(enum memstat_type type)
+{
+    return atomic_load(&counters[type].peak);
+}
+
+const char* memstat_name(enum memstat_type type)
+{
+    return names[type];
+}
+
+void memstat_summary(char* buf, size_t size)
+{
+    size_t pos = 0;
+
+    buf[0] = 0;
+
+    for (size_t i = 0; i < MEMSTAT_NUM && pos < size; ++i) {
+        const size_t peak = memstat_peak(i);
+        if (peak) {
+            const int len =
+                snprintf(buf + pos, size - pos, "%s%s %.01f/%.01f",
+                         pos ? ", " : "", names[i], memstat_live(i) / MIB,
+                         peak / MIB);
+            if (len < 0) {
+                break;
+            }
+            pos += len;
+        }
+    }
+}
+
+void memstat_dump(FILE* out)
+{
+    fprintf(out, "Memory usage (MiB):\n");
+    for (size_t i = 0; i < MEMSTAT_NUM; ++i) {
+        fprintf(out, "  %-8s live %9.02f, peak %9.02f\n", names[i],
+                memstat_live(i) / MIB, memstat_peak(i) / MIB);
+    }
+}
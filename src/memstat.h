@@ -0,0 +1,79 @@
+// SPDX-License-Identifier: MIT
+// Memory accounting: live and peak size of allocations by category.
+// Copyright (C) 2025 Artem Senichev <artemsen@gmail.com>
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/** Categories of accounted memory. */
+enum memstat_type {
+    memstat_pixmap,  ///< Pixel buffers: frames, scaled images, etc
+    memstat_pool,    ///< Free pixel buffers kept in the pool for reuse
+    memstat_thumb,   ///< Thumbnail atlas slabs
+    memstat_raw,     ///< Raw file data kept by images (e.g. SVG)
+    memstat_scaler,  ///< Intermediate buffers and kernels of the scaler
+    memstat_text,    ///< Rendered text surfaces and glyph cache
+    memstat_history, ///< Images in the history cache of the viewer
+    memstat_preload, ///< Images in the preload cache of the viewer
+};
+
+// Number of memory categories
+#define MEMSTAT_NUM (memstat_preload + 1)
+
+/**
+ * Account allocated memory.
+ * @param type memory category
+ * @param size size of allocated block in bytes
+ */
+void memstat_alloc(enum memstat_type type, size_t size);
+
+/**
+ * Account freed memory.
+ * @param type memory category
+ * @param size size of freed block in bytes
+ */
+void memstat_free(enum memstat_type type, size_t size);
+
+/**
+ * Set the current size of the category (e.g. total size of a cache).
+ * @param type memory category
+ * @param size current size in bytes
+ */
+void memstat_set(enum memstat_type type, size_t size);
+
+/**
+ * Get size of memory currently used by the category.
+ * @param type memory category
+ * @return size in bytes
+ */
+size_t memstat_live(enum memstat_type type);
+
+/**
+ * Get max size of memory used by the category since start.
+ * @param type memory category
+ * @return size in bytes
+ */
+size_t memstat_peak(enum memstat_type type);
+
+/**
+ * Get name of the category.
+ * @param type memory category
+ * @return category name
+ */
+const char* memstat_name(enum memstat_type type);
+
+/**
+ * Compose short summary of used categories: "name live/peak" in MiB.
+ * @param buf output buffer
+ * @param size size of the buffer
+ */
+void memstat_summary(char* buf, size_t size);
+
+/**
+ * Print statistics of all categories, one per line.
+ * @param out output stream
+ */
+void memstat_dump(FILE* out);
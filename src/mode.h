@@ -21,8 +21,9 @@ struct mode_handlers {
     /**
      * Apply action.
      * @param action action to apply
+     * @param repeat number of repetitions (merged consecutive actions)
      */
-    void (*action)(const struct action* action);
+    void (*action)(const struct action* action, size_t repeat);
 
     /**
      * Redraw window.
@@ -41,6 +42,11 @@ struct mode_handlers {
      */
     void (*drag)(int dx, int dy);
 
+    /**
+     * End of mouse drag operation (button released).
+     */
+    void (*drop)(void);
+
     /**
      * Image list uptade handler.
      * @param image updated image instance
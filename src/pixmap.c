@@ -5,14 +5,392 @@
 #include "pixmap.h"
 
 #include "array.h"
+#include "memstat.h"
 #include "pixmap_ablend.h"
+#include "tpool.h"
 
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Min size of buffer handled by the pool, smaller ones are allocated on heap
+#define POOL_MIN_SIZE (1024 * 1024)
+// Max number of free buffers kept in the pool
+#define POOL_BUFFERS 4
+// Max total size of free buffers kept in the pool
+#define POOL_MAX_SIZE (512 * 1024 * 1024)
+// Alignment of large buffers, allows transparent huge pages to back them
+#define POOL_ALIGN (2 * 1024 * 1024)
+// Max number of pixel buffers mapped from files at the same time
+#define MAPPED_MAX 64
+
+// Number of pixels blended at once by functions with a color source
+#define BLEND_CHUNK 256
+
+// Size of the square tile used to transpose pixmap on rotation
+#define ROTATE_TILE 64
+// Minimal number of pixels processed by a single task of transformation
+#define TASK_MIN_PIXELS (256 * 1024)
+
+/** Free buffer in the pool. */
+struct pool_buffer {
+    void* data;  ///< Buffer data
+    size_t size; ///< Size of the buffer in bytes
+};
+
+/** Pool of recently freed large buffers: images of the same size (e.g. from
+ *  a camera) reuse buffers without mapping and zeroing new memory pages. */
+struct pool {
+    struct pool_buffer buffers[POOL_BUFFERS]; ///< Free buffers, oldest first
+    size_t num;                               ///< Number of free buffers
+    size_t total;                             ///< Total size of free buffers
+    pthread_mutex_t lock;                     ///< Pool access lock
+};
+
+static struct pool pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/** Pixel buffer mapped from file. */
+struct mapped_buffer {
+    const argb_t* data; ///< Pixel data
+    void* base;         ///< Start of the mapping (page aligned)
+    size_t size;        ///< Size of the mapping in bytes
+};
+
+/** Pixel buffers mapped from files, they are unmapped instead of freeing. */
+struct mapped {
+    struct mapped_buffer buffers[MAPPED_MAX]; ///< Mapped buffers
+    size_t num;                               ///< Number of mapped buffers
+    pthread_mutex_t lock;                     ///< Access lock
+};
+
+static struct mapped mapped = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/**
+ * Unmap pixel buffer if it was mapped from file.
+ * @param data pixel buffer
+ * @return false if the buffer is not mapped
+ */
+static bool mapped_free(const argb_t* data)
+{
+    struct mapped_buffer buf = { 0 };
+
+    pthread_mutex_lock(&mapped.lock);
+    for (size_t i = 0; i < mapped.num; ++i) {
+        if (mapped.buffers[i].data == data) {
+            buf = mapped.buffers[i];
+            mapped.buffers[i] = mapped.buffers[--mapped.num];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&mapped.lock);
+
+    if (buf.base) {
+        munmap(buf.base, buf.size);
+    }
+
+    return buf.base;
+}
+
+/**
+ * Take the most suitable buffer from the pool.
+ * @param size required size in bytes
+ * @return buffer or NULL if there is no suitable free buffer
+ */
+static void* pool_take(size_t size)
+{
+    void* data = NULL;
+    size_t best = POOL_BUFFERS;
+
+    pthread_mutex_lock(&pool.lock);
+
+    // the smallest buffer that fits, but not more than 1/8 larger
+    for (size_t i = 0; i < pool.num; ++i) {
+        const size_t bsz = pool.buffers[i].size;
+        if (bsz >= size && bsz - size <= size / 8 &&
+            (best == POOL_BUFFERS || bsz < pool.buffers[best].size)) {
+            best = i;
+        }
+    }
+    if (best != POOL_BUFFERS) {
+        data = pool.buffers[best].data;
+        pool.total -= pool.buffers[best].size;
+        --pool.num;
+        memmove(&pool.buffers[best], &pool.buffers[best + 1],
+                (pool.num - best) * sizeof(*pool.buffers));
+        memstat_set(memstat_pool, pool.total);
+    }
+
+    pthread_mutex_unlock(&pool.lock);
+
+    return data;
+}
+
+/**
+ * Put the buffer to the pool, the oldest buffers are freed to fit the limits.
+ * @param data buffer to put
+ * @param size size of the buffer in bytes
+ */
+static void pool_put(void* data, size_t size)
+{
+    void* evicted[POOL_BUFFERS];
+    size_t num_evicted = 0;
+
+    if (size > POOL_MAX_SIZE) {
+        free(data);
+        return;
+    }
+
+    pthread_mutex_lock(&pool.lock);
+
+    while (pool.num &&
+           (pool.num == POOL_BUFFERS || pool.total + size > POOL_MAX_SIZE)) {
+        evicted[num_evicted++] = pool.buffers[0].data;
+        pool.total -= pool.buffers[0].size;
+        --pool.num;
+        memmove(&pool.buffers[0], &pool.buffers[1],
+                pool.num * sizeof(*pool.buffers));
+    }
+    pool.buffers[pool.num].data = data;
+    pool.buffers[pool.num].size = size;
+    pool.total += size;
+    ++pool.num;
+    memstat_set(memstat_pool, pool.total);
+
+    pthread_mutex_unlock(&pool.lock);
+
+    // release memory outside the lock
+    for (size_t i = 0; i < num_evicted; ++i) {
+        free(evicted[i]);
+    }
+}
+
+/**
+ * Allocate pixel buffer.
+ * @param size size of the buffer in bytes
+ * @param zero true to clear the buffer
+ * @return pointer to the buffer or NULL on errors
+ */
+static argb_t* buffer_alloc(size_t size, bool zero)
+{
+    void* data;
+
+    if (size < POOL_MIN_SIZE) {
+        data = zero ? calloc(1, size) : malloc(size);
+    } else if ((data = pool_take(size))) {
+        if (zero) {
+            memset(data, 0, size);
+        }
+    } else if (posix_memalign(&data, POOL_ALIGN, size) != 0) {
+        data = NULL;
+    } else if (zero) {
+        memset(data, 0, size);
+    }
+
+    if (data) {
+        memstat_alloc(memstat_pixmap, size);
+    }
+
+    return data;
+}
+
+/**
+ * Free pixel buffer.
+ * @param data buffer to free
+ * @param size size of the buffer in bytes
+ */
+static void buffer_free(argb_t* data, size_t size)
+{
+    if (data) {
+        memstat_free(memstat_pixmap, size);
+    }
+    if (data && size >= POOL_MIN_SIZE) {
+        if (!mapped_free(data)) {
+            pool_put(data, size);
+        }
+    } else {
+        free(data);
+    }
+}
+
+/** Transformation (flip/rotation) job for the thread pool. */
+struct transform {
+    struct pixmap* pm; ///< Source pixmap
+    argb_t* dst;       ///< Destination buffer (transposition only)
+    size_t angle;      ///< Rotation angle, 0 for horizontal flip
+    bool rev_rows;     ///< Transposition: reverse order of rows
+    bool rev_cols;     ///< Transposition: reverse order of columns
+    size_t units;      ///< Number of units (rows, row pairs or tile rows)
+    size_t tasks;      ///< Number of tasks
+};
+
+/**
+ * Swap two lines of pixels reversing their order: a[i] <-> b[num - i - 1].
+ * @param a,b lines to swap, must not overlap
+ * @param num number of pixels in each line
+ */
+static void reverse_swap(argb_t* a, argb_t* b, size_t num)
+{
+    size_t i = 0;
+
+#ifdef __SSE2__
+    for (; i + 4 <= num; i += 4) {
+        argb_t* pb = &b[num - i - 4];
+        const __m128i va = _mm_loadu_si128((const __m128i*)&a[i]);
+        const __m128i vb = _mm_loadu_si128((const __m128i*)pb);
+        _mm_storeu_si128((__m128i*)&a[i],
+                         _mm_shuffle_epi32(vb, _MM_SHUFFLE(0, 1, 2, 3)));
+        _mm_storeu_si128((__m128i*)pb,
+                         _mm_shuffle_epi32(va, _MM_SHUFFLE(0, 1, 2, 3)));
+    }
+#endif
+
+    for (; i < num; ++i) {
+        const argb_t swap = a[i];
+        a[i] = b[num - i - 1];
+        b[num - i - 1] = swap;
+    }
+}
+
+/**
+ * Get position of the transposed pixel in destination buffer.
+ * @param job transformation job
+ * @param x,y pixel coordinates on the source pixmap
+ * @return offset in destination buffer
+ */
+static inline size_t transpose_pos(const struct transform* job, size_t x,
+                                   size_t y)
+{
+    const size_t dst_width = job->pm->height;
+    const size_t dst_height = job->pm->width;
+    const size_t row = job->rev_rows ? dst_height - x - 1 : x;
+    const size_t col = job->rev_cols ? dst_width - y - 1 : y;
+    return row * dst_width + col;
+}
+
+/**
+ * Transpose square tile of the source pixmap: rotation on 90/270 degrees,
+ * optionally combined with horizontal flip.
+ * @param job transformation job
+ * @param x0,y0,x1,y1 tile coordinates on the source pixmap
+ */
+static void transpose_tile(const struct transform* job, size_t x0, size_t y0,
+                           size_t x1, size_t y1)
+{
+    const struct pixmap* pm = job->pm;
+    argb_t* dst = job->dst;
+    size_t y = y0;
+
+#ifdef __SSE2__
+    // transpose 4x4 blocks in registers
+    for (; y + 4 <= y1; y += 4) {
+        const argb_t* src = &pm->data[y * pm->width];
+        const size_t col = job->rev_cols ? pm->height - y - 4 : y;
+        size_t x = x0;
+        for (; x + 4 <= x1; x += 4) {
+            const __m128i r0 = _mm_loadu_si128((const __m128i*)&src[x]);
+            const __m128i r1 =
+                _mm_loadu_si128((const __m128i*)&src[x + pm->width]);
+            const __m128i r2 =
+                _mm_loadu_si128((const __m128i*)&src[x + pm->width * 2]);
+            const __m128i r3 =
+                _mm_loadu_si128((const __m128i*)&src[x + pm->width * 3]);
+            const __m128i t0 = _mm_unpacklo_epi32(r0, r1);
+            const __m128i t1 = _mm_unpacklo_epi32(r2, r3);
+            const __m128i t2 = _mm_unpackhi_epi32(r0, r1);
+            const __m128i t3 = _mm_unpackhi_epi32(r2, r3);
+            // source columns become destination rows
+            __m128i cols[] = {
+                _mm_unpacklo_epi64(t0, t1),
+                _mm_unpackhi_epi64(t0, t1),
+                _mm_unpacklo_epi64(t2, t3),
+                _mm_unpackhi_epi64(t2, t3),
+            };
+            for (size_t i = 0; i < 4; ++i) {
+                const size_t row =
+                    job->rev_rows ? pm->width - x - i - 1 : x + i;
+                if (job->rev_cols) {
+                    cols[i] =
+                        _mm_shuffle_epi32(cols[i], _MM_SHUFFLE(0, 1, 2, 3));
+                }
+                _mm_storeu_si128((__m128i*)&dst[row * pm->height + col],
+                                 cols[i]);
+            }
+        }
+        // the rest of rows
+        for (; x < x1; ++x) {
+            for (size_t i = 0; i < 4; ++i) {
+                dst[transpose_pos(job, x, y + i)] = src[x + pm->width * i];
+            }
+        }
+    }
+#endif
+
+    for (; y < y1; ++y) {
+        const argb_t* src = &pm->data[y * pm->width];
+        for (size_t x = x0; x < x1; ++x) {
+            dst[transpose_pos(job, x, y)] = src[x];
+        }
+    }
+}
+
+/** Thread pool handler: transform a band of the pixmap. */
+static void transform_task(size_t index, void* data)
+{
+    const struct transform* job = data;
+    struct pixmap* pm = job->pm;
+    const size_t low = job->units * index / job->tasks;
+    const size_t high = job->units * (index + 1) / job->tasks;
+
+    for (size_t i = low; i < high; ++i) {
+        if (job->angle == 0) {
+            // horizontal flip of a single row
+            argb_t* line = &pm->data[i * pm->width];
+            const size_t half = pm->width / 2;
+            reverse_swap(line, line + pm->width - half, half);
+        } else if (job->angle == 180) {
+            // swap of reversed rows from the top and the bottom
+            argb_t* top = &pm->data[i * pm->width];
+            argb_t* bottom = &pm->data[(pm->height - i - 1) * pm->width];
+            reverse_swap(top, bottom, pm->width);
+        } else {
+            // row of tiles
+            const size_t y0 = i * ROTATE_TILE;
+            const size_t y1 = min(y0 + ROTATE_TILE, pm->height);
+            for (size_t x0 = 0; x0 < pm->width; x0 += ROTATE_TILE) {
+                const size_t x1 = min(x0 + ROTATE_TILE, pm->width);
+                transpose_tile(job, x0, y0, x1, y1);
+            }
+        }
+    }
+}
+
+/**
+ * Execute transformation job.
+ * @param job transformation job to execute
+ * @param pixels number of pixels processed by the job
+ */
+static void transform(struct transform* job, size_t pixels)
+{
+    if (job->units == 0) {
+        return;
+    }
+    job->tasks = tpool_tasks(min(job->units, pixels / TASK_MIN_PIXELS));
+    tpool_run(job->tasks, transform_task, job);
+}
 
 bool pixmap_create(struct pixmap* pm, size_t width, size_t height)
 {
-    argb_t* data = calloc(1, height * width * sizeof(argb_t));
+    argb_t* data = buffer_alloc(height * width * sizeof(argb_t), true);
     if (data) {
         pm->width = width;
         pm->height = height;
@@ -21,9 +399,52 @@ bool pixmap_create(struct pixmap* pm, size_t width, size_t height)
     return data;
 }
 
+bool pixmap_map(struct pixmap* pm, int fd, size_t offset, size_t width,
+                size_t height)
+{
+    const size_t page = sysconf(_SC_PAGESIZE);
+    const size_t shift = offset % page;
+    const size_t size = shift + width * height * sizeof(argb_t);
+    struct mapped_buffer buf;
+
+    if (offset % sizeof(argb_t) ||
+        width * height * sizeof(argb_t) < POOL_MIN_SIZE) {
+        return false; // misaligned pixels or too small to bother
+    }
+
+    // private mapping: transformations write to own copy of the pages
+    buf.base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd,
+                    offset - shift);
+    if (buf.base == MAP_FAILED) {
+        return false;
+    }
+    buf.data = (const argb_t*)((uint8_t*)buf.base + shift);
+    buf.size = size;
+
+    pthread_mutex_lock(&mapped.lock);
+    if (mapped.num < MAPPED_MAX) {
+        mapped.buffers[mapped.num++] = buf;
+    } else {
+        buf.data = NULL;
+    }
+    pthread_mutex_unlock(&mapped.lock);
+
+    if (!buf.data) {
+        munmap(buf.base, buf.size);
+        return false;
+    }
+
+    pm->width = width;
+    pm->height = height;
+    pm->data = (argb_t*)buf.data;
+    memstat_alloc(memstat_pixmap, width * height * sizeof(argb_t));
+
+    return true;
+}
+
 void pixmap_free(struct pixmap* pm)
 {
-    free(pm->data);
+    buffer_free(pm->data, pm->width * pm->height * sizeof(argb_t));
 }
 
 void pixmap_fill(struct pixmap* pm, ssize_t x, ssize_t y, size_t width,
@@ -81,11 +502,21 @@ void pixmap_blend(struct pixmap* pm, ssize_t x, ssize_t y, size_t width,
     const ssize_t top = max(0, y);
     const ssize_t right = min((ssize_t)pm->width, x + (ssize_t)width);
     const ssize_t bottom = min((ssize_t)pm->height, y + (ssize_t)height);
+    argb_t colors[BLEND_CHUNK];
+
+    if (right <= left || bottom <= top) {
+        return;
+    }
+
+    for (size_t i = 0; i < BLEND_CHUNK; ++i) {
+        colors[i] = color;
+    }
 
     for (y = top; y < bottom; ++y) {
         argb_t* line = &pm->data[y * pm->width];
-        for (x = left; x < right; ++x) {
-            alpha_blend(color, &line[x]);
+        for (x = left; x < right; x += BLEND_CHUNK) {
+            const size_t num = min(BLEND_CHUNK, right - x);
+            alpha_blend_line(colors, &line[x], num);
         }
     }
 }
@@ -125,6 +556,31 @@ void pixmap_rect(struct pixmap* pm, ssize_t x, ssize_t y, size_t width,
     pixmap_vline(pm, x + width - 1, y + 1, height - 1, color);
 }
 
+/**
+ * Compose grid line: the first period is put pixel by pixel, then the line
+ * is extended by copying already composed part.
+ * @param line pointer to the line
+ * @param width line width in pixels
+ * @param tail_sz size of a single tail
+ * @param shift flag to start with the second color
+ * @param color1,color2 grid colors
+ */
+static void grid_line(argb_t* line, size_t width, size_t tail_sz, bool shift,
+                      argb_t color1, argb_t color2)
+{
+    const size_t period = min(width, tail_sz * 2);
+    size_t done;
+
+    for (size_t x = 0; x < period; ++x) {
+        line[x] = (x >= tail_sz) ^ shift ? color1 : color2;
+    }
+
+    // composed part is always a multiple of period
+    for (done = period; done < width; done *= 2) {
+        memcpy(&line[done], line, min(done, width - done) * sizeof(argb_t));
+    }
+}
+
 void pixmap_grid(struct pixmap* pm, ssize_t x, ssize_t y, size_t width,
                  size_t height, size_t tail_sz, argb_t color1, argb_t color2)
 {
@@ -136,25 +592,27 @@ void pixmap_grid(struct pixmap* pm, ssize_t x, ssize_t y, size_t width,
     const ssize_t grid_height = bottom - top;
 
     const size_t template_sz = grid_width * sizeof(argb_t);
-    argb_t* templates[] = { &pm->data[top * pm->width + left],
-                            &pm->data[(top + tail_sz) * pm->width + left] };
+    const argb_t* templates[2];
 
     if (right < 0 || bottom < 0 || grid_width <= 0 || grid_height <= 0) {
         return;
     }
 
+    // compose template lines: the first lines of the first two tail rows
+    for (size_t i = 0; i < 2; ++i) {
+        argb_t* line = &pm->data[(top + tail_sz * i) * pm->width + left];
+        templates[i] = line;
+        if ((ssize_t)(tail_sz * i) < grid_height) {
+            grid_line(line, grid_width, tail_sz, i, color1, color2);
+        }
+    }
+
+    // put template lines
     for (y = 0; y < grid_height; ++y) {
         const size_t shift = (y / tail_sz) % 2;
         argb_t* line = &pm->data[(y + top) * pm->width + left];
-        if (line != templates[0] && line != templates[1]) {
-            // put template line
+        if (line != templates[shift]) {
             memcpy(line, templates[shift], template_sz);
-        } else {
-            // compose template line
-            for (x = 0; x < grid_width; ++x) {
-                const size_t tail = x / tail_sz;
-                line[x] = (tail % 2) ^ shift ? color1 : color2;
-            }
         }
     }
 }
@@ -171,19 +629,22 @@ void pixmap_apply_mask(struct pixmap* pm, ssize_t x, ssize_t y,
     const ssize_t delta_x = left - x;
     const ssize_t delta_y = top - y;
 
+    const uint8_t alpha_color = ARGB_GET_A(color);
+    argb_t colors[BLEND_CHUNK];
+
     for (ssize_t dst_y = top; dst_y < bottom; ++dst_y) {
         const size_t src_y = dst_y - top + delta_y;
         const uint8_t* mask_line = &mask[src_y * width + delta_x];
         argb_t* dst_line = &pm->data[dst_y * pm->width + left];
 
-        for (x = 0; x < dst_width; ++x) {
-            const uint8_t alpha_mask = mask_line[x];
-            if (alpha_mask != 0) {
-                const uint8_t alpha_color = ARGB_GET_A(color);
-                const uint8_t alpha = (alpha_mask * alpha_color) / 255;
-                const argb_t clr = ARGB_SET_A(alpha) | (color & 0x00ffffff);
-                alpha_blend(clr, &dst_line[x]);
+        for (x = 0; x < dst_width; x += BLEND_CHUNK) {
+            const size_t num = min(BLEND_CHUNK, dst_width - x);
+            // convert mask to the line of colors
+            for (size_t i = 0; i < num; ++i) {
+                const uint8_t alpha = (mask_line[x + i] * alpha_color) / 255;
+                colors[i] = ARGB_SET_A(alpha) | (color & 0x00ffffff);
             }
+            alpha_blend_line(colors, &dst_line[x], num);
         }
     }
 }
@@ -200,21 +661,70 @@ void pixmap_copy(const struct pixmap* src, struct pixmap* dst, ssize_t x,
     const ssize_t delta_y = top - y;
     const size_t line_sz = dst_width * sizeof(argb_t);
 
+    if (dst_width <= 0) {
+        return;
+    }
+
     for (ssize_t dst_y = top; dst_y < bottom; ++dst_y) {
         const size_t src_y = dst_y - top + delta_y;
         const argb_t* src_line = &src->data[src_y * src->width + delta_x];
         argb_t* dst_line = &dst->data[dst_y * dst->width + left];
 
         if (alpha) {
-            for (x = 0; x < dst_width; ++x) {
-                alpha_blend(src_line[x], &dst_line[x]);
-            }
+            alpha_blend_line(src_line, dst_line, dst_width);
         } else {
             memcpy(dst_line, src_line, line_sz);
         }
     }
 }
 
+void pixmap_premultiply(struct pixmap* pm)
+{
+    const size_t total = pm->width * pm->height;
+
+    for (size_t i = 0; i < total; ++i) {
+        const argb_t color = pm->data[i];
+        const uint32_t alpha = ARGB_GET_A(color);
+        if (alpha != 255) {
+            pm->data[i] = ARGB(alpha, ARGB_GET_R(color) * alpha / 255,
+                               ARGB_GET_G(color) * alpha / 255,
+                               ARGB_GET_B(color) * alpha / 255);
+        }
+    }
+}
+
+void pixmap_over(const struct pixmap* src, struct pixmap* dst, ssize_t x,
+                 ssize_t y)
+{
+    const ssize_t left = max(0, x);
+    const ssize_t top = max(0, y);
+    const ssize_t right = min((ssize_t)dst->width, x + (ssize_t)src->width);
+    const ssize_t bottom = min((ssize_t)dst->height, y + (ssize_t)src->height);
+    const ssize_t dst_width = right - left;
+    const ssize_t delta_x = left - x;
+    const ssize_t delta_y = top - y;
+
+    for (ssize_t dst_y = top; dst_y < bottom; ++dst_y) {
+        const size_t src_y = dst_y - top + delta_y;
+        const argb_t* src_line = &src->data[src_y * src->width + delta_x];
+        argb_t* dst_line = &dst->data[dst_y * dst->width + left];
+
+        // dst = src + dst * (1 - src_alpha): two channels per multiplication
+        // with rounded division by 255, no branches to let the compiler
+        // vectorize the loop
+        for (x = 0; x < dst_width; ++x) {
+            const argb_t fg = src_line[x];
+            const argb_t bg = dst_line[x];
+            const uint32_t inv = 255 - ARGB_GET_A(fg);
+            uint32_t rb = (bg & 0x00ff00ff) * inv + 0x00800080;
+            uint32_t ag = ((bg >> 8) & 0x00ff00ff) * inv + 0x00800080;
+            rb = ((rb + ((rb >> 8) & 0x00ff00ff)) >> 8) & 0x00ff00ff;
+            ag = (ag + ((ag >> 8) & 0x00ff00ff)) & 0xff00ff00;
+            dst_line[x] = fg + (rb | ag);
+        }
+    }
+}
+
 void pixmap_flip_vertical(struct pixmap* pm)
 {
     void* buffer;
@@ -235,50 +745,61 @@ void pixmap_flip_vertical(struct pixmap* pm)
 
 void pixmap_flip_horizontal(struct pixmap* pm)
 {
-    for (size_t y = 0; y < pm->height; ++y) {
-        argb_t* line = &pm->data[y * pm->width];
-        for (size_t x = 0; x < pm->width / 2; ++x) {
-            argb_t* left = &line[x];
-            argb_t* right = &line[pm->width - x - 1];
-            const argb_t swap = *left;
-            *left = *right;
-            *right = swap;
-        }
-    }
+    struct transform job = {
+        .pm = pm,
+        .angle = 0,
+        .units = pm->height,
+    };
+    transform(&job, pm->width * pm->height);
 }
 
 void pixmap_rotate(struct pixmap* pm, size_t angle)
+{
+    pixmap_transform(pm, false, angle);
+}
+
+void pixmap_transform(struct pixmap* pm, bool flip, size_t angle)
 {
     const size_t pixels = pm->width * pm->height;
+    struct transform job = {
+        .pm = pm,
+        .angle = angle,
+    };
+
+    if (pixels == 0) {
+        return;
+    }
 
-    if (angle == 180) {
-        for (size_t i = 0; i < pixels / 2; ++i) {
-            argb_t* color1 = &pm->data[i];
-            argb_t* color2 = &pm->data[pixels - i - 1];
-            const argb_t swap = *color1;
-            *color1 = *color2;
-            *color2 = swap;
+    if (angle == 0) {
+        if (flip) {
+            pixmap_flip_horizontal(pm);
+        }
+    } else if (angle == 180) {
+        if (flip) {
+            pixmap_flip_vertical(pm);
+            return;
+        }
+        job.units = pm->height / 2;
+        transform(&job, pixels);
+        if (pm->height % 2) {
+            // middle row
+            argb_t* line = &pm->data[(pm->height / 2) * pm->width];
+            const size_t half = pm->width / 2;
+            reverse_swap(line, line + pm->width - half, half);
         }
     } else if (angle == 90 || angle == 270) {
-        argb_t* data = malloc(pm->height * pm->width * sizeof(*data));
-        if (data) {
-            const size_t width = pm->height;
-            const size_t height = pm->width;
-            for (size_t y = 0; y < pm->height; ++y) {
-                for (size_t x = 0; x < pm->width; ++x) {
-                    size_t pos;
-                    if (angle == 90) {
-                        pos = x * width + (width - y - 1);
-                    } else {
-                        pos = (height - x - 1) * width + y;
-                    }
-                    data[pos] = pm->data[y * pm->width + x];
-                }
-            }
-            free(pm->data);
-            pm->width = width;
-            pm->height = height;
-            pm->data = data;
+        job.dst = buffer_alloc(pixels * sizeof(argb_t), false);
+        if (job.dst) {
+            // clockwise rotation reverses columns, counterclockwise - rows,
+            // the flip before rotation reverses rows
+            job.rev_cols = (angle == 90);
+            job.rev_rows = (angle == 270) != flip;
+            job.units = (pm->height + ROTATE_TILE - 1) / ROTATE_TILE;
+            transform(&job, pixels);
+            buffer_free(pm->data, pixels * sizeof(argb_t));
+            pm->data = job.dst;
+            pm->width = pm->height;
+            pm->height = pixels / pm->width;
         }
     }
 }
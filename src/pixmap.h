@@ -54,6 +54,21 @@ struct pixmap {
  */
 bool pixmap_create(struct pixmap* pm, size_t width, size_t height);
 
+/**
+ * Create pixmap referencing pixels of the file without copying them. The file
+ * is mapped privately: pages are read on access and changes are not written
+ * back. Such pixmap is freed with `pixmap_free` as usual. Small pixmaps
+ * (less than 1 MiB) are not mapped.
+ * @param pm pixmap context to create
+ * @param fd file descriptor
+ * @param offset offset of the first pixel in the file, must be aligned to the
+ *               pixel size
+ * @param width,height pixmap size, rows must follow without padding
+ * @return true pixmap was mapped
+ */
+bool pixmap_map(struct pixmap* pm, int fd, size_t offset, size_t width,
+                size_t height);
+
 /**
  * Free pixmap created with `pixmap_create`.
  * @param pm pixmap context to free
@@ -154,6 +169,21 @@ void pixmap_apply_mask(struct pixmap* pm, ssize_t x, ssize_t y,
 void pixmap_copy(const struct pixmap* src, struct pixmap* dst, ssize_t x,
                  ssize_t y, bool alpha);
 
+/**
+ * Convert pixmap from straight to premultiplied alpha.
+ * @param pm pixmap to convert
+ */
+void pixmap_premultiply(struct pixmap* pm);
+
+/**
+ * Put pixmap with premultiplied alpha over the destination pixmap.
+ * @param src source pixmap, premultiplied alpha
+ * @param dst destination pixmap
+ * @param x,y destination left top coordinates
+ */
+void pixmap_over(const struct pixmap* src, struct pixmap* dst, ssize_t x,
+                 ssize_t y);
+
 /**
  * Flip pixmap vertically.
  * @param pm pixmap context
@@ -172,3 +202,11 @@ void pixmap_flip_horizontal(struct pixmap* pm);
  * @param angle rotation angle (only 90, 180, or 270)
  */
 void pixmap_rotate(struct pixmap* pm, size_t angle);
+
+/**
+ * Flip pixmap horizontally and then rotate it, in a single pass.
+ * @param pm pixmap context
+ * @param flip flag to flip horizontally before rotation
+ * @param angle rotation angle (0, 90, 180, or 270)
+ */
+void pixmap_transform(struct pixmap* pm, bool flip, size_t angle);
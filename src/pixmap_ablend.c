@@ -0,0 +1,178 @@
+// SPDX-License-Identifier: MIT
+// Alpha blending.
+// Copyright (C) 2025 Artem Senichev <artemsen@gmail.com>
+
+#include "pixmap_ablend.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ABLEND_SIMD_X86
+#include <immintrin.h>
+#endif
+
+/** Instruction set used for blending. */
+static enum scale_simd simd_level = simd_auto;
+
+#ifdef ABLEND_SIMD_X86
+// Vectorized versions use the same formula as `alpha_blend`, but in single
+// precision floating point math instead of integer division per channel; the
+// result can differ by 1 due to rounding. Groups of pixels with fully opaque
+// or fully transparent top pixels are copied or skipped without any math.
+
+/**
+ * Blend single pixel (float channels B, G, R, A).
+ * @param top,bottom source pixels
+ * @return blended pixel, undefined if both alpha channels are zero
+ */
+__attribute__((target("sse4.1"))) static inline __m128
+blend_pixel_sse41(__m128 top, __m128 bottom)
+{
+    const __m128 f255 = _mm_set1_ps(255.0f);
+    const __m128 a1 = _mm_shuffle_ps(top, top, _MM_SHUFFLE(3, 3, 3, 3));
+    const __m128 a2 = _mm_shuffle_ps(bottom, bottom, _MM_SHUFFLE(3, 3, 3, 3));
+    const __m128 c1 = _mm_mul_ps(a1, f255);
+    const __m128 c2 = _mm_mul_ps(_mm_sub_ps(f255, a1), a2);
+    const __m128 alpha = _mm_add_ps(c1, c2);
+    const __m128 color = _mm_div_ps(
+        _mm_add_ps(_mm_mul_ps(top, c1), _mm_mul_ps(bottom, c2)), alpha);
+    return _mm_blend_ps(color, _mm_div_ps(alpha, f255), 8);
+}
+
+/** SSE4.1 version of `alpha_blend_line`. */
+__attribute__((target("sse4.1"))) static void
+blend_line_sse41(const argb_t* src, argb_t* dst, size_t num)
+{
+    const __m128i opaque_alpha = _mm_set1_epi32(255);
+    size_t i = 0;
+
+    for (; i + 4 <= num; i += 4) {
+        const __m128i top = _mm_loadu_si128((const __m128i*)&src[i]);
+        const __m128i alpha = _mm_srli_epi32(top, 24);
+        const __m128i opaque = _mm_cmpeq_epi32(alpha, opaque_alpha);
+        const __m128i transp = _mm_cmpeq_epi32(alpha, _mm_setzero_si128());
+        __m128i bottom, px[4], res;
+
+        if (_mm_movemask_ps(_mm_castsi128_ps(opaque)) == 0xf) {
+            _mm_storeu_si128((__m128i*)&dst[i], top);
+            continue;
+        }
+        if (_mm_movemask_ps(_mm_castsi128_ps(transp)) == 0xf) {
+            continue;
+        }
+
+        bottom = _mm_loadu_si128((const __m128i*)&dst[i]);
+        for (size_t p = 0; p < 4; ++p) {
+            const __m128i t1 = _mm_cvtsi32_si128(src[i + p]);
+            const __m128i b1 = _mm_cvtsi32_si128(dst[i + p]);
+            const __m128 t = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(t1));
+            const __m128 b = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(b1));
+            px[p] = _mm_cvttps_epi32(blend_pixel_sse41(t, b));
+        }
+        res = _mm_packus_epi16(_mm_packus_epi32(px[0], px[1]),
+                               _mm_packus_epi32(px[2], px[3]));
+
+        // keep exact values for the opaque and transparent top pixels
+        res = _mm_blendv_epi8(res, top, opaque);
+        res = _mm_blendv_epi8(res, bottom, transp);
+        _mm_storeu_si128((__m128i*)&dst[i], res);
+    }
+
+    for (; i < num; ++i) {
+        alpha_blend(src[i], &dst[i]);
+    }
+}
+
+/**
+ * Blend two pixels (float channels B, G, R, A in each lane).
+ * @param top,bottom source pixels
+ * @return blended pixels, undefined if both alpha channels are zero
+ */
+__attribute__((target("avx2"))) static inline __m256
+blend_pixel_avx2(__m256 top, __m256 bottom)
+{
+    const __m256 f255 = _mm256_set1_ps(255.0f);
+    const __m256 a1 = _mm256_shuffle_ps(top, top, _MM_SHUFFLE(3, 3, 3, 3));
+    const __m256 a2 =
+        _mm256_shuffle_ps(bottom, bottom, _MM_SHUFFLE(3, 3, 3, 3));
+    const __m256 c1 = _mm256_mul_ps(a1, f255);
+    const __m256 c2 = _mm256_mul_ps(_mm256_sub_ps(f255, a1), a2);
+    const __m256 alpha = _mm256_add_ps(c1, c2);
+    const __m256 color = _mm256_div_ps(
+        _mm256_add_ps(_mm256_mul_ps(top, c1), _mm256_mul_ps(bottom, c2)),
+        alpha);
+    return _mm256_blend_ps(color, _mm256_div_ps(alpha, f255), 0x88);
+}
+
+/** AVX2 version of `alpha_blend_line`. */
+__attribute__((target("avx2"))) static void
+blend_line_avx2(const argb_t* src, argb_t* dst, size_t num)
+{
+    const __m256i opaque_alpha = _mm256_set1_epi32(255);
+    // restore pixel order after per-lane packing
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    size_t i = 0;
+
+    for (; i + 8 <= num; i += 8) {
+        const __m256i top = _mm256_loadu_si256((const __m256i*)&src[i]);
+        const __m256i alpha = _mm256_srli_epi32(top, 24);
+        const __m256i opaque = _mm256_cmpeq_epi32(alpha, opaque_alpha);
+        const __m256i transp =
+            _mm256_cmpeq_epi32(alpha, _mm256_setzero_si256());
+        __m256i bottom, px[4], res;
+
+        if (_mm256_movemask_ps(_mm256_castsi256_ps(opaque)) == 0xff) {
+            _mm256_storeu_si256((__m256i*)&dst[i], top);
+            continue;
+        }
+        if (_mm256_movemask_ps(_mm256_castsi256_ps(transp)) == 0xff) {
+            continue;
+        }
+
+        bottom = _mm256_loadu_si256((const __m256i*)&dst[i]);
+        for (size_t p = 0; p < 4; ++p) {
+            // two pixels per register
+            const __m128i t2 = _mm_loadl_epi64((const __m128i*)&src[i + p * 2]);
+            const __m128i b2 = _mm_loadl_epi64((const __m128i*)&dst[i + p * 2]);
+            const __m256 t = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(t2));
+            const __m256 b = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(b2));
+            px[p] = _mm256_cvttps_epi32(blend_pixel_avx2(t, b));
+        }
+        res = _mm256_packus_epi16(_mm256_packus_epi32(px[0], px[1]),
+                                  _mm256_packus_epi32(px[2], px[3]));
+        res = _mm256_permutevar8x32_epi32(res, order);
+
+        // keep exact values for the opaque and transparent top pixels
+        res = _mm256_blendv_epi8(res, top, opaque);
+        res = _mm256_blendv_epi8(res, bottom, transp);
+        _mm256_storeu_si256((__m256i*)&dst[i], res);
+    }
+
+    blend_line_sse41(src + i, dst + i, num - i);
+}
+#endif // ABLEND_SIMD_X86
+
+void alpha_blend_line(const argb_t* src, argb_t* dst, size_t num)
+{
+    if (simd_level == simd_auto) {
+        pixmap_scale_simd(simd_auto);
+    }
+
+#ifdef ABLEND_SIMD_X86
+    if (simd_level == simd_avx2) {
+        blend_line_avx2(src, dst, num);
+        return;
+    }
+    if (simd_level == simd_sse41) {
+        blend_line_sse41(src, dst, num);
+        return;
+    }
+#endif // ABLEND_SIMD_X86
+
+    for (size_t i = 0; i < num; ++i) {
+        alpha_blend(src[i], &dst[i]);
+    }
+}
+
+void alpha_blend_simd(enum scale_simd simd)
+{
+    simd_level = simd;
+}
@@ -5,6 +5,7 @@
 #pragma once
 
 #include "pixmap.h"
+#include "pixmap_scale.h"
 
 /**
  * Alpha blending.
@@ -32,3 +33,17 @@ static inline void alpha_blend(argb_t src, argb_t* dst)
                     (ARGB_GET_B(src) * c1 + ARGB_GET_B(dp) * c2) / alpha);
     }
 }
+
+/**
+ * Alpha blending of pixel line.
+ * @param src top pixels
+ * @param dst bottom pixels
+ * @param num number of pixels to blend
+ */
+void alpha_blend_line(const argb_t* src, argb_t* dst, size_t num);
+
+/**
+ * Set instruction set used for blending, called by `pixmap_scale_simd`.
+ * @param simd instruction set supported by CPU
+ */
+void alpha_blend_simd(enum scale_simd simd);
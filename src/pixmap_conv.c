@@ -0,0 +1,183 @@
+// SPDX-License-Identifier: MIT
+// Conversion of decoded pixel lines to ARGB.
+// Copyright (C) 2025 Artem Senichev <artemsen@gmail.com>
+
+#include "pixmap_conv.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CONV_SIMD_X86
+#include <immintrin.h>
+#endif
+
+/** Instruction set used for conversion. */
+static enum scale_simd simd_level = simd_auto;
+
+/**
+ * Check if vectorized versions can be used.
+ * @return true if SSE4.1 is available
+ */
+static inline bool use_simd(void)
+{
+    if (simd_level == simd_auto) {
+        pixmap_scale_simd(simd_auto);
+    }
+    return simd_level == simd_sse41 || simd_level == simd_avx2;
+}
+
+#ifdef CONV_SIMD_X86
+// Conversion is memory bound, so AVX2 level uses the same 128-bit code.
+// Expanding conversions (gray and RGB) walk the line from end to start: the
+// destination of each block is never before its source, which allows
+// conversion in place.
+
+/** SSE4.1 version of `pixel_conv_gray`, returns number of unconverted. */
+__attribute__((target("sse4.1"))) static size_t
+conv_gray_sse41(const uint8_t* src, argb_t* dst, size_t num)
+{
+    const __m128i alpha = _mm_set1_epi8((char)0xff);
+
+    while (num >= 16) {
+        num -= 16;
+        const __m128i gray = _mm_loadu_si128((const __m128i*)&src[num]);
+        const __m128i gg_lo = _mm_unpacklo_epi8(gray, gray);
+        const __m128i gg_hi = _mm_unpackhi_epi8(gray, gray);
+        const __m128i ga_lo = _mm_unpacklo_epi8(gray, alpha);
+        const __m128i ga_hi = _mm_unpackhi_epi8(gray, alpha);
+        __m128i* out = (__m128i*)&dst[num];
+        _mm_storeu_si128(out + 0, _mm_unpacklo_epi16(gg_lo, ga_lo));
+        _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(gg_lo, ga_lo));
+        _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(gg_hi, ga_hi));
+        _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(gg_hi, ga_hi));
+    }
+
+    return num;
+}
+
+/** SSE4.1 version of `pixel_conv_rgb`, returns number of unconverted. */
+__attribute__((target("sse4.1"))) static size_t
+conv_rgb_sse41(const uint8_t* src, argb_t* dst, size_t num)
+{
+    const __m128i shuffle =
+        _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+    const __m128i alpha = _mm_set1_epi32((int)ARGB_SET_A(0xff));
+
+    // each block of 4 pixels reads 16 bytes, so the last two pixels are
+    // converted first to stay within the source
+    for (size_t i = 0; i < 2 && num; ++i) {
+        const uint8_t* rgb = &src[--num * 3];
+        dst[num] = ARGB(0xff, rgb[0], rgb[1], rgb[2]);
+    }
+
+    while (num >= 4) {
+        num -= 4;
+        const __m128i rgb = _mm_loadu_si128((const __m128i*)&src[num * 3]);
+        const __m128i argb = _mm_shuffle_epi8(rgb, shuffle);
+        _mm_storeu_si128((__m128i*)&dst[num], _mm_or_si128(argb, alpha));
+    }
+
+    return num;
+}
+
+/** SSE4.1 version of `pixel_conv_abgr`, returns number of converted. */
+__attribute__((target("sse4.1"))) static size_t
+conv_abgr_sse41(const argb_t* src, argb_t* dst, size_t num)
+{
+    const __m128i shuffle =
+        _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    size_t i = 0;
+
+    for (; i + 4 <= num; i += 4) {
+        const __m128i abgr = _mm_loadu_si128((const __m128i*)&src[i]);
+        _mm_storeu_si128((__m128i*)&dst[i], _mm_shuffle_epi8(abgr, shuffle));
+    }
+
+    return i;
+}
+
+/** SSE4.1 version of `pixel_conv_rgba64be`, returns number of converted. */
+__attribute__((target("sse4.1"))) static size_t
+conv_rgba64be_sse41(const uint8_t* src, argb_t* dst, size_t num)
+{
+    // high bytes of B, G, R, A for two pixels in each half
+    const __m128i shuffle_lo = _mm_setr_epi8(4, 2, 0, 6, 12, 10, 8, 14, -1,
+                                             -1, -1, -1, -1, -1, -1, -1);
+    const __m128i shuffle_hi = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1,
+                                             4, 2, 0, 6, 12, 10, 8, 14);
+    size_t i = 0;
+
+    for (; i + 4 <= num; i += 4) {
+        const __m128i* in = (const __m128i*)&src[i * 8];
+        const __m128i px01 = _mm_loadu_si128(in);
+        const __m128i px23 = _mm_loadu_si128(in + 1);
+        const __m128i argb = _mm_or_si128(_mm_shuffle_epi8(px01, shuffle_lo),
+                                          _mm_shuffle_epi8(px23, shuffle_hi));
+        _mm_storeu_si128((__m128i*)&dst[i], argb);
+    }
+
+    return i;
+}
+#endif // CONV_SIMD_X86
+
+void pixel_conv_gray(const uint8_t* src, argb_t* dst, size_t num)
+{
+#ifdef CONV_SIMD_X86
+    if (use_simd()) {
+        num = conv_gray_sse41(src, dst, num);
+    }
+#endif
+
+    while (num--) {
+        const uint8_t gray = src[num];
+        dst[num] = ARGB(0xff, gray, gray, gray);
+    }
+}
+
+void pixel_conv_rgb(const uint8_t* src, argb_t* dst, size_t num)
+{
+#ifdef CONV_SIMD_X86
+    if (use_simd()) {
+        num = conv_rgb_sse41(src, dst, num);
+    }
+#endif
+
+    while (num--) {
+        const uint8_t* rgb = &src[num * 3];
+        dst[num] = ARGB(0xff, rgb[0], rgb[1], rgb[2]);
+    }
+}
+
+void pixel_conv_abgr(const argb_t* src, argb_t* dst, size_t num)
+{
+    size_t i = 0;
+
+#ifdef CONV_SIMD_X86
+    if (use_simd()) {
+        i = conv_abgr_sse41(src, dst, num);
+    }
+#endif
+
+    for (; i < num; ++i) {
+        dst[i] = ABGR_TO_ARGB(src[i]);
+    }
+}
+
+void pixel_conv_rgba64be(const uint8_t* src, argb_t* dst, size_t num)
+{
+    size_t i = 0;
+
+#ifdef CONV_SIMD_X86
+    if (use_simd()) {
+        i = conv_rgba64be_sse41(src, dst, num);
+    }
+#endif
+
+    for (; i < num; ++i) {
+        const uint8_t* rgba = &src[i * 8];
+        dst[i] = ARGB(rgba[6], rgba[0], rgba[2], rgba[4]);
+    }
+}
+
+void pixel_conv_simd(enum scale_simd simd)
+{
+    simd_level = simd;
+}
@@ -0,0 +1,50 @@
+// SPDX-License-Identifier: MIT
+// Conversion of decoded pixel lines to ARGB.
+// Copyright (C) 2025 Artem Senichev <artemsen@gmail.com>
+
+#pragma once
+
+#include "pixmap.h"
+#include "pixmap_scale.h"
+
+/**
+ * Convert 8-bit grayscale pixels to ARGB.
+ * Conversion in place is allowed: source can start at the destination.
+ * @param src source pixels, one byte per pixel
+ * @param dst destination pixels
+ * @param num number of pixels to convert
+ */
+void pixel_conv_gray(const uint8_t* src, argb_t* dst, size_t num);
+
+/**
+ * Convert 24-bit RGB pixels to ARGB.
+ * Conversion in place is allowed: source can start at the destination.
+ * @param src source pixels, bytes R, G, B
+ * @param dst destination pixels
+ * @param num number of pixels to convert
+ */
+void pixel_conv_rgb(const uint8_t* src, argb_t* dst, size_t num);
+
+/**
+ * Convert ABGR pixels (bytes R, G, B, A) to ARGB.
+ * Conversion in place is allowed.
+ * @param src source pixels
+ * @param dst destination pixels
+ * @param num number of pixels to convert
+ */
+void pixel_conv_abgr(const argb_t* src, argb_t* dst, size_t num);
+
+/**
+ * Convert 64-bit big-endian RGBA pixels to ARGB, the least significant byte
+ * of each channel is dropped.
+ * @param src source pixels, 16-bit big-endian R, G, B, A
+ * @param dst destination pixels
+ * @param num number of pixels to convert
+ */
+void pixel_conv_rgba64be(const uint8_t* src, argb_t* dst, size_t num);
+
+/**
+ * Set instruction set used for conversion, called by `pixmap_scale_simd`.
+ * @param simd instruction set supported by CPU
+ */
+void pixel_conv_simd(enum scale_simd simd);
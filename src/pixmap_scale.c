@@ -5,21 +5,33 @@
 #include "pixmap_scale.h"
 
 #include "array.h"
+#include "memstat.h"
 #include "pixmap_ablend.h"
+#include "pixmap_conv.h"
+#include "tpool.h"
+#include "trace.h"
 
 #include <math.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <unistd.h>
-
-#ifdef __FreeBSD__
-#include <sys/sysctl.h>
-#endif
 
 #define clamp(a, low, high) (min((high), max((a), (low))))
 
+// Minimal number of pixels processed by a single task in the thread pool
+#define TASK_MIN_PIXELS 16384
+
+// Height of the intermediate image tile: the horizontal pass produces up to
+// TILE_ROWS new rows (plus the vertical kernel size) at once, so the vertical
+// pass reads data that is still in the CPU cache
+#define TILE_ROWS 32
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCALE_SIMD_X86
+#include <immintrin.h>
+#endif
+
 // Except for nearest-neighbor, scaling is done via 1D convolution kernels, in
 // which each output is the weighted sum of a set of inputs. Weights are
 // stored contiguously in fixed point to limit memory consumption and improve
@@ -40,14 +52,46 @@ struct output {
     size_t index; ///< Index of first weight in weights array
 };
 
-/** A 1D convolution kernel. */
-struct kernel {
-    size_t start_out;       ///< First output
+/** Weights of a 1D convolution kernel for a range of outputs. */
+struct kernel_weights {
+    enum aa_mode scaler;    ///< Scale filter
+    size_t nin;             ///< Number of inputs (source size)
+    double scale;           ///< Scale factor
+    size_t first;           ///< First output (without destination offset)
     size_t n_out;           ///< Number of outputs
-    size_t start_in;        ///< First input
-    size_t n_in;            ///< Number of inputs
+    size_t max_n;           ///< Max number of inputs per output
     struct output* outputs; ///< Outputs
     int16_t* weights;       ///< Weights
+    size_t refs;            ///< Number of kernels using these weights
+    size_t last_use;        ///< Last usage stamp (for LRU)
+    bool cached;            ///< Weights are owned by the cache
+    size_t memory;          ///< Size of weights and outputs in bytes
+};
+
+/** A 1D convolution kernel. */
+struct kernel {
+    size_t start_out;             ///< First output
+    size_t n_out;                 ///< Number of outputs
+    size_t start_in;              ///< First input
+    size_t n_in;                  ///< Number of inputs
+    size_t max_n;                 ///< Max number of inputs per output
+    const struct output* outputs; ///< Outputs
+    const int16_t* weights;       ///< Weights
+    struct kernel_weights* cache; ///< Source of outputs and weights
+};
+
+// Number of kernels in cache: horizontal and vertical kernels for the viewer,
+// the gallery and a few more to survive switching between them
+#define KERNEL_CACHE_SIZE 8
+
+/** Cache of kernel weights. */
+struct kernel_cache {
+    struct kernel_weights* slots[KERNEL_CACHE_SIZE]; ///< Cached weights
+    size_t stamp;                                    ///< Usage counter
+    pthread_mutex_t lock;                            ///< Cache lock
+};
+static struct kernel_cache kcache = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
 };
 
 /** Window function type. */
@@ -59,52 +103,65 @@ struct bounds {
     ssize_t last;
 };
 
-/** Values shared by all threads in a nearest-neighbor scale. */
-struct task_nn_shared {
+/** Nearest-neighbor scale job, each task handles a band of rows. */
+struct task_nn {
     const struct pixmap* src; ///< Source pixmap
     struct pixmap* dst;       ///< Destination pixmap
     size_t x_low;             ///< x start (left)
     size_t x_high;            ///< x end (right)
+    size_t y_low;             ///< y start (top)
+    size_t y_high;            ///< y end (bottom)
     size_t num;               ///< Numerator in fixed-point
     uint8_t den_bits;         ///< Amount to shift for denominator
     ssize_t x;                ///< x offset in destination
     ssize_t y;                ///< y offset in destination
     bool alpha;               ///< Use alpha channel?
+    size_t tasks;             ///< Total number of tasks (row bands)
+};
+
+// Intermediate image with premultiplied alpha: 16 bits per channel
+#define PREMUL_CHANNELS 4
+#define PREMUL_B        0
+#define PREMUL_G        1
+#define PREMUL_R        2
+#define PREMUL_A        3
+#define PREMUL_MAX      (255 * 255)
+#define PREMUL_ROUND    (1 << (FIXED_BITS - 1))
+
+/** Intermediate image with premultiplied alpha. */
+struct premul {
+    size_t width;   ///< Width (px)
+    size_t height;  ///< Height (px)
+    uint16_t* data; ///< Pixel data (PREMUL_CHANNELS values per pixel)
 };
 
-/** Per-thread information for a nearest-neighbor scale. */
-struct task_nn_priv {
-    struct task_nn_shared* shared; ///< Shared information
-    size_t y_low;                  ///< Start row
-    size_t y_high;                 ///< One beyond end row
-    pthread_t id;                  ///< Thread id
+/** Tile of the intermediate image (result of the horizontal pass). */
+struct tile {
+    struct pixmap pm;   ///< Pixels (opaque images)
+    struct premul pmul; ///< Premultiplied pixels (images with alpha)
+    size_t memory;      ///< Size of allocated pixels in bytes
+};
+
+/** Half-size downscale job, each task handles a band of rows. */
+struct task_half {
+    const struct pixmap* src; ///< Source pixmap
+    struct pixmap* dst;       ///< Destination pixmap
+    bool alpha;               ///< Use alpha channel?
+    size_t tasks;             ///< Total number of tasks (row bands)
 };
 
-/** Values shared by all threads in all other scales. */
-struct task_sc_shared {
+/** Convolution scale job, each task handles a band of rows. */
+struct task_sc {
     const struct pixmap* src; ///< Source pixmap
-    struct pixmap in;         ///< Intermediate pixmap
     struct pixmap* dst;       ///< Destination pixmap
     struct kernel hk;         ///< Horizontal kernel
     struct kernel vk;         ///< Vertical kernel
-    size_t yoff;              ///< y offset (for horizontal kernel)
-    size_t xoff;              ///< x offset (for vertical kernel)
     bool alpha;               ///< Use alpha channel?
-    size_t threads;           ///< Total number of threads
-    size_t sync;              ///< Number of threads done with horizontal pass
-    pthread_mutex_t m;        ///< Mutex to protect sync
-    pthread_cond_t cv;        ///< CV for the same
+    size_t tasks;             ///< Total number of tasks (row bands)
 };
 
-/** Per-thread information for all other scales. */
-struct task_sc_priv {
-    struct task_sc_shared* shared; ///< Shared information
-    size_t hy_low;                 ///< Start row for horizontal pass
-    size_t hy_high;                ///< One beyond end row for horizontal pass
-    size_t vy_low;                 ///< Start row for vertical pass
-    size_t vy_high;                ///< One beyond end row for vertical pass
-    pthread_t id;                  ///< Thread id
-};
+/** Currently used instruction set. */
+static enum scale_simd simd_level = simd_auto;
 
 // clang-format off
 /** Names of supported anti-aliasing modes. */
@@ -188,20 +245,71 @@ static double get_weight(size_t in, size_t out, double scale, double window,
     return x > window ? 0.0 : wnd_fn(x);
 }
 
-// Build a new fixed point kernel from its mathematical description
-static void new_kernel(struct kernel* kernel, size_t nin, size_t nout,
-                       ssize_t offset, double scale, double window,
-                       window_fn wnd_fn)
+static double box(__attribute__((unused)) double x)
+{
+    return 1.0;
+}
+
+static double lin(double x)
+{
+    return 1.0 - x;
+}
+
+static double cub(double x)
+{
+    if (x <= 1.0) {
+        return 3.0 / 2.0 * x * x * x - 5.0 / 2.0 * x * x + 1.0;
+    }
+    return -1.0 / 2.0 * x * x * x + 5.0 / 2.0 * x * x - 4.0 * x + 2.0;
+}
+
+static double mks13(double x)
+{
+    if (x <= 0.5) {
+        return 17.0 / 16.0 - 7.0 / 4.0 * x * x;
+    }
+    if (x <= 1.5) {
+        return x * x - 11.0 / 4.0 * x + 7.0 / 4.0;
+    }
+    return -1.0 / 8.0 * x * x + 5.0 / 8.0 * x - 25.0 / 32.0;
+}
+
+// Build fixed point weights for a range of virtual outputs from the kernel
+// mathematical description; virtual output is an output position relative to
+// the scaled image (i.e. without destination offset), so the same weights are
+// valid for any offset
+static struct kernel_weights* new_weights(enum aa_mode scaler, size_t nin,
+                                          double scale, size_t first,
+                                          size_t n_out)
 {
     // Store weights locally first, for normalization and zero detection
     double* weights;
     int16_t* int_weights;
+    struct kernel_weights* kw;
+    double window = 0;
+    window_fn wnd_fn = NULL;
 
-    // Output bounds
-    const size_t start = max(0, offset);
-    const size_t end = min(nout, (size_t)(offset + nin * scale));
-    kernel->start_out = start;
-    kernel->n_out = end - start;
+    switch (scaler) {
+        case aa_nearest:
+            // We shouldn't ever get here
+            return NULL;
+        case aa_box:
+            window = 0.5;
+            wnd_fn = box;
+            break;
+        case aa_bilinear:
+            window = 1.0;
+            wnd_fn = lin;
+            break;
+        case aa_bicubic:
+            window = 2.0;
+            wnd_fn = cub;
+            break;
+        case aa_mks13:
+            window = 2.5;
+            wnd_fn = mks13;
+            break;
+    }
 
     // Estimate space needed for weights
     struct bounds bounds;
@@ -211,259 +319,969 @@ static void new_kernel(struct kernel* kernel, size_t nin, size_t nout,
     // certainly suffices
     const size_t n_per = bounds.last - bounds.first + 3;
 
-    // The estimation overallocates, but kernels are only live for a short time
+    kw = calloc(1, sizeof(*kw));
+    if (!kw) {
+        return NULL;
+    }
+    kw->scaler = scaler;
+    kw->nin = nin;
+    kw->scale = scale;
+    kw->first = first;
+    kw->n_out = n_out;
+
+    // The estimation overallocates, but the waste is small
     weights = malloc(n_per * sizeof(*weights));
     int_weights = malloc(n_per * sizeof(*int_weights));
-    kernel->weights = malloc(n_per * kernel->n_out * sizeof(*kernel->weights));
-    kernel->outputs = malloc(kernel->n_out * sizeof(*kernel->outputs));
+    kw->weights = malloc(n_per * n_out * sizeof(*kw->weights));
+    kw->outputs = malloc(n_out * sizeof(*kw->outputs));
+    if (!weights || !int_weights || !kw->weights || !kw->outputs) {
+        free(weights);
+        free(int_weights);
+        free(kw->weights);
+        free(kw->outputs);
+        free(kw);
+        return NULL;
+    }
+    kw->memory = n_per * n_out * sizeof(*kw->weights) +
+        n_out * sizeof(*kw->outputs);
+    memstat_alloc(memstat_scaler, kw->memory);
 
-    // Track min and max input across all outputs
-    size_t min_in = SIZE_MAX;
-    size_t max_in = 0;
     size_t index = 0;
-    for (size_t out = start; out < end; ++out) {
+    for (size_t out = first; out < first + n_out; ++out) {
         double sum, norm;
         size_t tfirst, tlast;
         int16_t isum;
 
         // Input bounds for this output
-        struct output* output = &kernel->outputs[out - start];
-        get_bounds(out - offset, scale, window, &bounds);
-        const size_t first = max(0, bounds.first);
-        const size_t last = min(nin - 1, (size_t)bounds.last);
+        struct output* output = &kw->outputs[out - first];
+        get_bounds(out, scale, window, &bounds);
+        const size_t first_in = max(0, bounds.first);
+        const size_t last_in = min(nin - 1, (size_t)bounds.last);
 
         sum = 0;
-        for (size_t in = first; in <= last; ++in) {
-            double w = get_weight(in, out - offset, scale, window, wnd_fn);
-            weights[in - first] = w;
+        for (size_t in = first_in; in <= last_in; ++in) {
+            double w = get_weight(in, out, scale, window, wnd_fn);
+            weights[in - first_in] = w;
             sum += w;
         }
         norm = 1.0 / sum;
         isum = 0;
-        for (size_t in = first; in <= last; ++in) {
-            int16_t iw = round(weights[in - first] * norm * (1 << FIXED_BITS));
-            int_weights[in - first] = iw;
+        for (size_t in = first_in; in <= last_in; ++in) {
+            int16_t iw =
+                round(weights[in - first_in] * norm * (1 << FIXED_BITS));
+            int_weights[in - first_in] = iw;
             isum += iw;
         }
-        int_weights[(last - first) / 2] += (1 << FIXED_BITS) - isum;
+        int_weights[(last_in - first_in) / 2] += (1 << FIXED_BITS) - isum;
 
         // Ignore leading or trailing zeros
-        for (tfirst = first; tfirst < last && int_weights[tfirst - first] == 0;
+        for (tfirst = first_in;
+             tfirst < last_in && int_weights[tfirst - first_in] == 0;
              ++tfirst) { }
-        for (tlast = last; tlast > tfirst && int_weights[tlast - first] == 0;
-             --tlast) { }
-
-        if (tfirst < min_in) {
-            min_in = tfirst;
-        }
-        if (tlast > max_in) {
-            max_in = tlast;
-        }
+        for (tlast = last_in;
+             tlast > tfirst && int_weights[tlast - first_in] == 0; --tlast) { }
 
         output->n = tlast - tfirst + 1;
         output->first = tfirst;
+        if (output->n > kw->max_n) {
+            kw->max_n = output->n;
+        }
         output->index = index;
-        memcpy(&kernel->weights[index], &int_weights[tfirst - first],
-               output->n * sizeof(*kernel->weights));
+        memcpy(&kw->weights[index], &int_weights[tfirst - first_in],
+               output->n * sizeof(*kw->weights));
         index += output->n;
     }
 
+    free(weights);
+    free(int_weights);
+
+    return kw;
+}
+
+// Free kernel weights
+static void free_weights(struct kernel_weights* kw)
+{
+    memstat_free(memstat_scaler, kw->memory);
+    free(kw->outputs);
+    free(kw->weights);
+    free(kw);
+}
+
+// Get weights from cache or build new ones, the result must be released with
+// put_weights
+static struct kernel_weights* get_weights(enum aa_mode scaler, size_t nin,
+                                          double scale, size_t first,
+                                          size_t n_out)
+{
+    struct kernel_weights* kw = NULL;
+    size_t cache_first, cache_n, cache_max;
+    ssize_t slot = -1;
+
+    pthread_mutex_lock(&kcache.lock);
+    for (size_t i = 0; i < KERNEL_CACHE_SIZE; ++i) {
+        struct kernel_weights* it = kcache.slots[i];
+        if (it && it->scaler == scaler && it->nin == nin &&
+            it->scale == scale && it->first <= first &&
+            it->first + it->n_out >= first + n_out) {
+            kw = it;
+            ++kw->refs;
+            kw->last_use = ++kcache.stamp;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&kcache.lock);
+
+    if (kw) {
+        return kw;
+    }
+
+    // build weights for a wider range than requested, so the image can be
+    // moved a bit without rebuilding the kernel
+    cache_max = nin * scale;
+    cache_first = first > n_out / 2 ? first - n_out / 2 : 0;
+    cache_n = min(cache_max, first + n_out + n_out / 2) - cache_first;
+    if (cache_n < n_out || cache_first + cache_n < first + n_out) {
+        cache_first = first;
+        cache_n = n_out;
+    }
+    kw = new_weights(scaler, nin, scale, cache_first, cache_n);
+    if (!kw) {
+        return NULL;
+    }
+
+    // put weights into cache, replacing the least recently used entry
+    pthread_mutex_lock(&kcache.lock);
+    for (size_t i = 0; i < KERNEL_CACHE_SIZE; ++i) {
+        const struct kernel_weights* it = kcache.slots[i];
+        if (!it) {
+            slot = i;
+            break;
+        }
+        if (it->refs == 0 &&
+            (slot < 0 || it->last_use < kcache.slots[slot]->last_use)) {
+            slot = i;
+        }
+    }
+    if (slot >= 0) {
+        if (kcache.slots[slot]) {
+            free_weights(kcache.slots[slot]);
+        }
+        kcache.slots[slot] = kw;
+        kw->cached = true;
+    }
+    kw->refs = 1;
+    kw->last_use = ++kcache.stamp;
+    pthread_mutex_unlock(&kcache.lock);
+
+    return kw;
+}
+
+// Release weights obtained by get_weights
+static void put_weights(struct kernel_weights* kw)
+{
+    bool release;
+
+    pthread_mutex_lock(&kcache.lock);
+    --kw->refs;
+    release = !kw->cached;
+    pthread_mutex_unlock(&kcache.lock);
+
+    if (release) {
+        free_weights(kw);
+    }
+}
+
+// Create a kernel for scaling between given source and destination sizes,
+// weights are shared with the cache
+static bool new_named_kernel(enum aa_mode scaler, struct kernel* kernel,
+                             size_t in, size_t out, ssize_t offset,
+                             double scale)
+{
+    // Output bounds
+    const size_t start = max(0, offset);
+    const size_t end = min(out, (size_t)(offset + in * scale));
+    struct kernel_weights* kw;
+    size_t min_in = SIZE_MAX;
+    size_t max_in = 0;
+
+    kernel->start_out = start;
+    kernel->n_out = end - start;
+
+    kw = get_weights(scaler, in, scale, start - offset, kernel->n_out);
+    if (!kw) {
+        return false;
+    }
+    kernel->cache = kw;
+    kernel->max_n = kw->max_n;
+    kernel->weights = kw->weights;
+    kernel->outputs = &kw->outputs[start - offset - kw->first];
+
+    // Track min and max input across all outputs
+    for (size_t i = 0; i < kernel->n_out; ++i) {
+        const struct output* output = &kernel->outputs[i];
+        if (output->first < min_in) {
+            min_in = output->first;
+        }
+        if (output->first + output->n - 1 > max_in) {
+            max_in = output->first + output->n - 1;
+        }
+    }
     kernel->start_in = min_in;
     kernel->n_in = max_in - min_in + 1;
 
-    free(weights);
-    free(int_weights);
+    return true;
 }
 
 static void free_kernel(struct kernel* kernel)
 {
-    free(kernel->outputs);
-    free(kernel->weights);
+    if (kernel->cache) {
+        put_weights(kernel->cache);
+        kernel->cache = NULL;
+    }
 }
 
-static double box(__attribute__((unused)) double x)
+// Store sums of alpha weighted channels as premultiplied 16-bit values, the
+// alpha channel is scaled to 0-65025 (255*255) to keep colors (color*alpha)
+// in the same range
+static inline void premul_store(int64_t a, int64_t r, int64_t g, int64_t b,
+                                uint16_t* dst)
 {
-    return 1.0;
+    const int64_t pa =
+        clamp((a * 255 + PREMUL_ROUND) >> FIXED_BITS, 0, PREMUL_MAX);
+    dst[PREMUL_A] = pa;
+    dst[PREMUL_R] = clamp((r + PREMUL_ROUND) >> FIXED_BITS, 0, pa);
+    dst[PREMUL_G] = clamp((g + PREMUL_ROUND) >> FIXED_BITS, 0, pa);
+    dst[PREMUL_B] = clamp((b + PREMUL_ROUND) >> FIXED_BITS, 0, pa);
 }
 
-static double lin(double x)
+// Convert sums of premultiplied channels back to the straight alpha color
+static inline argb_t premul_load(int64_t a, int64_t r, int64_t g, int64_t b)
 {
-    return 1.0 - x;
+    const int64_t div = (int64_t)255 << FIXED_BITS;
+    const int64_t half = a / 2;
+    return ARGB(clamp((a + div / 2) / div, 0, 255),
+                clamp((r * 255 + half) / a, 0, 255),
+                clamp((g * 255 + half) / a, 0, 255),
+                clamp((b * 255 + half) / a, 0, 255));
 }
 
-static double cub(double x)
+// Apply a horizontal kernel; the output is a tile of the intermediate image,
+// its rows are the source rows starting from yoff
+static void apply_hk_generic(const struct pixmap* src, struct pixmap* dst,
+                             const struct kernel* kernel, size_t y_low,
+                             size_t y_high, size_t yoff)
 {
-    if (x <= 1.0) {
-        return 3.0 / 2.0 * x * x * x - 5.0 / 2.0 * x * x + 1.0;
+    for (size_t y = y_low; y < y_high; ++y) {
+        argb_t* dst_line = &dst->data[y * dst->width];
+        for (size_t x = 0; x < dst->width; ++x) {
+            const struct output* output = &kernel->outputs[x];
+            int64_t r = 0;
+            int64_t g = 0;
+            int64_t b = 0;
+            for (size_t i = 0; i < output->n; ++i) {
+                const argb_t c =
+                    src->data[(y + yoff) * src->width + output->first + i];
+                const int64_t w = (int64_t)kernel->weights[output->index + i];
+                r += ARGB_GET_R(c) * w;
+                g += ARGB_GET_G(c) * w;
+                b += ARGB_GET_B(c) * w;
+            }
+            const uint8_t ur = clamp(r >> FIXED_BITS, 0, 255);
+            const uint8_t ug = clamp(g >> FIXED_BITS, 0, 255);
+            const uint8_t ub = clamp(b >> FIXED_BITS, 0, 255);
+            dst_line[x] = ARGB(0xff, ur, ug, ub);
+        }
     }
-    return -1.0 / 2.0 * x * x * x + 5.0 / 2.0 * x * x - 4.0 * x + 2.0;
 }
 
-static double mks13(double x)
+// Same as apply_hk_generic, but for images with alpha channel: the output is
+// stored with premultiplied alpha, so there is no division in this pass and
+// the vertical pass gets 16-bit precision of the intermediate values
+static void apply_hk_premul_generic(const struct pixmap* src,
+                                    struct premul* dst,
+                                    const struct kernel* kernel, size_t y_low,
+                                    size_t y_high, size_t yoff)
 {
-    if (x <= 0.5) {
-        return 17.0 / 16.0 - 7.0 / 4.0 * x * x;
+    for (size_t y = y_low; y < y_high; ++y) {
+        uint16_t* dst_line = &dst->data[y * dst->width * PREMUL_CHANNELS];
+        for (size_t x = 0; x < dst->width; ++x) {
+            const struct output* output = &kernel->outputs[x];
+            int64_t a = 0;
+            int64_t r = 0;
+            int64_t g = 0;
+            int64_t b = 0;
+            for (size_t i = 0; i < output->n; ++i) {
+                const argb_t c =
+                    src->data[(y + yoff) * src->width + output->first + i];
+                const int64_t wa =
+                    (int64_t)ARGB_GET_A(c) * kernel->weights[output->index + i];
+                a += wa;
+                r += ARGB_GET_R(c) * wa;
+                g += ARGB_GET_G(c) * wa;
+                b += ARGB_GET_B(c) * wa;
+            }
+            premul_store(a, r, g, b, &dst_line[x * PREMUL_CHANNELS]);
+        }
     }
-    if (x <= 1.5) {
-        return x * x - 11.0 / 4.0 * x + 7.0 / 4.0;
+}
+
+// Apply a vertical kernel; the input is a tile of the intermediate image, which
+// first row is the source row yoff - xoff indicates where the tile should go
+// in the destination
+static void apply_vk_generic(const struct pixmap* src, struct pixmap* dst,
+                             const struct kernel* kernel, size_t y_low,
+                             size_t y_high, size_t xoff, size_t yoff)
+{
+    for (size_t y = y_low; y < y_high; ++y) {
+        argb_t* dst_line = &dst->data[(y + kernel->start_out) * dst->width];
+        for (size_t x = 0; x < src->width; ++x) {
+            const struct output* output = &kernel->outputs[y];
+            int64_t r = 0;
+            int64_t g = 0;
+            int64_t b = 0;
+            for (size_t i = 0; i < output->n; ++i) {
+                const argb_t c =
+                    src->data[(output->first + i - yoff) * src->width + x];
+                const int64_t w = (int64_t)kernel->weights[output->index + i];
+                r += ARGB_GET_R(c) * w;
+                g += ARGB_GET_G(c) * w;
+                b += ARGB_GET_B(c) * w;
+            }
+            const uint8_t ur = clamp(r >> FIXED_BITS, 0, 255);
+            const uint8_t ug = clamp(g >> FIXED_BITS, 0, 255);
+            const uint8_t ub = clamp(b >> FIXED_BITS, 0, 255);
+            dst_line[x + xoff] = ARGB(0xff, ur, ug, ub);
+        }
     }
-    return -1.0 / 8.0 * x * x + 5.0 / 8.0 * x - 25.0 / 32.0;
 }
 
-static void new_named_kernel(enum aa_mode scaler, struct kernel* kernel,
-                             size_t in, size_t out, ssize_t offset,
-                             double scale)
+// Same as apply_vk_generic, but for premultiplied input, the result is
+// converted back to straight alpha and blended with the destination
+static void apply_vk_premul_generic(const struct premul* src,
+                                    struct pixmap* dst,
+                                    const struct kernel* kernel, size_t y_low,
+                                    size_t y_high, size_t xoff, size_t yoff)
 {
-    switch (scaler) {
-        case aa_nearest:
-            // We shouldn't ever get here
-            break;
-        case aa_box:
-            new_kernel(kernel, in, out, offset, scale, 0.5, box);
-            break;
-        case aa_bilinear:
-            new_kernel(kernel, in, out, offset, scale, 1.0, lin);
-            break;
-        case aa_bicubic:
-            new_kernel(kernel, in, out, offset, scale, 2.0, cub);
-            break;
-        case aa_mks13:
-            new_kernel(kernel, in, out, offset, scale, 2.5, mks13);
-            break;
+    for (size_t y = y_low; y < y_high; ++y) {
+        argb_t* dst_line = &dst->data[(y + kernel->start_out) * dst->width];
+        for (size_t x = 0; x < src->width; ++x) {
+            const struct output* output = &kernel->outputs[y];
+            int64_t a = 0;
+            int64_t r = 0;
+            int64_t g = 0;
+            int64_t b = 0;
+            for (size_t i = 0; i < output->n; ++i) {
+                const uint16_t* c =
+                    &src->data[((output->first + i - yoff) * src->width + x) *
+                               PREMUL_CHANNELS];
+                const int64_t w = (int64_t)kernel->weights[output->index + i];
+                a += c[PREMUL_A] * w;
+                r += c[PREMUL_R] * w;
+                g += c[PREMUL_G] * w;
+                b += c[PREMUL_B] * w;
+            }
+            if (a > 0) {
+                alpha_blend(premul_load(a, r, g, b), &dst_line[x + xoff]);
+            }
+        }
+    }
+}
+
+#ifdef SCALE_SIMD_X86
+// Vectorized versions of the passes produce exactly the same result as the
+// generic ones. Sums are accumulated in 32-bit integers: the absolute sum of
+// fixed point weights is slightly more than 1 << FIXED_BITS, so the sums of
+// products of 16-bit values and weights fit into the 32-bit range unless the
+// kernel has too many inputs per output (huge downscales), such kernels are
+// handled by the generic code. Division by alpha is done in double precision,
+// which gives an exact integer quotient for such values.
+
+// Max number of inputs per output supported by vectorized code
+#define SIMD_MAX_TAPS 2048
+
+/** Pack two weights into a pair of 16-bit integers for madd. */
+static inline int32_t weight_pair(int16_t w0, int16_t w1)
+{
+    return (int32_t)((uint32_t)(uint16_t)w0 | ((uint32_t)(uint16_t)w1 << 16));
+}
+
+/** Convert sums of 4 pixels (BGRA, 32-bit) to opaque pixels. */
+__attribute__((target("sse4.1"))) static inline __m128i
+pack_opaque_sse41(__m128i s0, __m128i s1, __m128i s2, __m128i s3)
+{
+    const __m128i opaque = _mm_set1_epi32((int)ARGB_SET_A(0xff));
+    s0 = _mm_srai_epi32(s0, FIXED_BITS);
+    s1 = _mm_srai_epi32(s1, FIXED_BITS);
+    s2 = _mm_srai_epi32(s2, FIXED_BITS);
+    s3 = _mm_srai_epi32(s3, FIXED_BITS);
+    // saturation is the same as clamp to 0..255
+    s0 = _mm_packs_epi32(s0, s1);
+    s2 = _mm_packs_epi32(s2, s3);
+    return _mm_or_si128(_mm_packus_epi16(s0, s2), opaque);
+}
+
+/** Store alpha weighted sums (BGRA, 32-bit) as premultiplied pixel. */
+__attribute__((target("sse4.1"))) static inline void
+premul_store_sse41(__m128i sum, uint16_t* dst)
+{
+    __m128i pm = _mm_mullo_epi32(sum, _mm_setr_epi32(1, 1, 1, 255));
+    pm = _mm_srai_epi32(_mm_add_epi32(pm, _mm_set1_epi32(PREMUL_ROUND)),
+                        FIXED_BITS);
+    pm = _mm_max_epi32(pm, _mm_setzero_si128());
+    pm = _mm_min_epi32(pm, _mm_set1_epi32(PREMUL_MAX));
+    pm = _mm_min_epi32(pm, _mm_shuffle_epi32(pm, 0xff));
+    _mm_storel_epi64((__m128i*)dst, _mm_packus_epi32(pm, pm));
+}
+
+/** Convert sums of premultiplied pixel (BGRA, 32-bit) to straight alpha. */
+__attribute__((target("sse4.1"))) static inline argb_t
+premul_load_sse41(__m128i sum)
+{
+    const int64_t a = _mm_extract_epi32(sum, 3);
+    const int64_t div = (int64_t)255 << FIXED_BITS;
+    __m128d den, half, lo, hi;
+    __m128i q;
+
+    if (a <= 0) {
+        return 0;
+    }
+
+    // (color * 255 + alpha / 2) / alpha
+    den = _mm_set1_pd((double)a);
+    half = _mm_set1_pd((double)(a / 2));
+    lo = _mm_mul_pd(_mm_cvtepi32_pd(sum), _mm_set1_pd(255.0));
+    lo = _mm_div_pd(_mm_add_pd(lo, half), den);
+    hi = _mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(sum, 8)),
+                    _mm_set1_pd(255.0));
+    hi = _mm_div_pd(_mm_add_pd(hi, half), den);
+    // limit to the integer range, the result is clamped to 0-255 anyway
+    lo = _mm_min_pd(_mm_max_pd(lo, _mm_set1_pd(-1.0)), _mm_set1_pd(256.0));
+    hi = _mm_min_pd(_mm_max_pd(hi, _mm_set1_pd(-1.0)), _mm_set1_pd(256.0));
+    q = _mm_unpacklo_epi64(_mm_cvttpd_epi32(lo), _mm_cvttpd_epi32(hi));
+    q = _mm_packs_epi32(q, q);
+    q = _mm_packus_epi16(q, q);
+
+    return ((argb_t)_mm_cvtsi128_si32(q) & 0x00ffffff) |
+        ARGB_SET_A(clamp((a + div / 2) / div, 0, 255));
+}
+
+/** Get sums of BGRA channels for a single output of horizontal kernel. */
+__attribute__((target("sse4.1"))) static inline __m128i
+sum_hk_sse41(const argb_t* src, const int16_t* weights, size_t n)
+{
+    const __m128i shuffle =
+        _mm_setr_epi8(0, 4, 1, 5, 2, 6, 3, 7, 8, 12, 9, 13, 10, 14, 11, 15);
+    __m128i sum = _mm_setzero_si128();
+    size_t i = 0;
+
+    // two inputs per iteration: B0 B1 G0 G1 R0 R1 A0 A1 * w0 w1
+    for (; i + 1 < n; i += 2) {
+        __m128i px = _mm_loadl_epi64((const __m128i*)&src[i]);
+        px = _mm_cvtepu8_epi16(_mm_shuffle_epi8(px, shuffle));
+        const __m128i w =
+            _mm_set1_epi32(weight_pair(weights[i], weights[i + 1]));
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(px, w));
+    }
+    if (i < n) {
+        __m128i px = _mm_cvtsi32_si128((int)src[i]);
+        px = _mm_cvtepu8_epi16(_mm_shuffle_epi8(px, shuffle));
+        const __m128i w = _mm_set1_epi32(weight_pair(weights[i], 0));
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(px, w));
+    }
+
+    return sum;
+}
+
+/** Get alpha weighted sums for a single output of horizontal kernel. */
+__attribute__((target("sse4.1"))) static inline __m128i
+sum_hk_alpha_sse41(const argb_t* src, const int16_t* weights, size_t n)
+{
+    const __m128i one = _mm_set1_epi32(1);
+    __m128i sum = _mm_setzero_si128();
+
+    for (size_t i = 0; i < n; ++i) {
+        __m128i px = _mm_cvtepu8_epi32(_mm_cvtsi32_si128((int)src[i]));
+        const __m128i wa = _mm_mullo_epi32(_mm_shuffle_epi32(px, 0xff),
+                                           _mm_set1_epi32(weights[i]));
+        // replace alpha with 1 to get sum of alpha*weight in the same lane
+        px = _mm_blend_epi16(px, one, 0xc0);
+        sum = _mm_add_epi32(sum, _mm_mullo_epi32(px, wa));
+    }
+
+    return sum;
+}
+
+/** Get sums of premultiplied pixels column (BGRA, 32-bit). */
+__attribute__((target("sse4.1"))) static inline __m128i
+sum_vk_premul_sse41(const uint16_t* src, size_t stride,
+                    const int16_t* weights, size_t n)
+{
+    __m128i sum = _mm_setzero_si128();
+    for (size_t i = 0; i < n; ++i) {
+        const __m128i px = _mm_cvtepu16_epi32(
+            _mm_loadl_epi64((const __m128i*)&src[i * stride]));
+        sum = _mm_add_epi32(sum,
+                            _mm_mullo_epi32(px, _mm_set1_epi32(weights[i])));
+    }
+    return sum;
+}
+
+__attribute__((target("sse4.1"))) static void
+apply_hk_sse41(const struct pixmap* src, struct pixmap* dst,
+               const struct kernel* kernel, size_t y_low, size_t y_high,
+               size_t yoff)
+{
+    for (size_t y = y_low; y < y_high; ++y) {
+        const argb_t* src_line = &src->data[(y + yoff) * src->width];
+        argb_t* dst_line = &dst->data[y * dst->width];
+        for (size_t x = 0; x < dst->width; ++x) {
+            const struct output* output = &kernel->outputs[x];
+            const __m128i sum =
+                sum_hk_sse41(&src_line[output->first],
+                             &kernel->weights[output->index], output->n);
+            const __m128i px = pack_opaque_sse41(sum, sum, sum, sum);
+            dst_line[x] = _mm_cvtsi128_si32(px);
+        }
+    }
+}
+
+__attribute__((target("sse4.1"))) static void
+apply_hk_premul_sse41(const struct pixmap* src, struct premul* dst,
+                      const struct kernel* kernel, size_t y_low,
+                      size_t y_high, size_t yoff)
+{
+    for (size_t y = y_low; y < y_high; ++y) {
+        const argb_t* src_line = &src->data[(y + yoff) * src->width];
+        uint16_t* dst_line = &dst->data[y * dst->width * PREMUL_CHANNELS];
+        for (size_t x = 0; x < dst->width; ++x) {
+            const struct output* output = &kernel->outputs[x];
+            const __m128i sum =
+                sum_hk_alpha_sse41(&src_line[output->first],
+                                   &kernel->weights[output->index], output->n);
+            premul_store_sse41(sum, &dst_line[x * PREMUL_CHANNELS]);
+        }
+    }
+}
+
+__attribute__((target("sse4.1"))) static void
+apply_vk_sse41(const struct pixmap* src, struct pixmap* dst,
+               const struct kernel* kernel, size_t y_low, size_t y_high,
+               size_t xoff, size_t yoff)
+{
+    const size_t stride = src->width;
+    const __m128i zero = _mm_setzero_si128();
+
+    for (size_t y = y_low; y < y_high; ++y) {
+        const struct output* output = &kernel->outputs[y];
+        const argb_t* col = &src->data[(output->first - yoff) * stride];
+        const int16_t* weights = &kernel->weights[output->index];
+        const size_t n = output->n;
+        argb_t* dst_line =
+            &dst->data[(y + kernel->start_out) * dst->width + xoff];
+        size_t x = 0;
+
+        // 4 pixels per iteration, two inputs (rows) at once
+        for (; x + 4 <= src->width; x += 4) {
+            __m128i s0 = zero, s1 = zero, s2 = zero, s3 = zero;
+            for (size_t i = 0; i < n; i += 2) {
+                const __m128i r0 =
+                    _mm_loadu_si128((const __m128i*)&col[i * stride + x]);
+                const __m128i r1 = i + 1 < n
+                    ? _mm_loadu_si128(
+                          (const __m128i*)&col[(i + 1) * stride + x])
+                    : zero;
+                const int16_t w1 = i + 1 < n ? weights[i + 1] : 0;
+                const __m128i w = _mm_set1_epi32(weight_pair(weights[i], w1));
+                const __m128i lo = _mm_unpacklo_epi8(r0, r1);
+                const __m128i hi = _mm_unpackhi_epi8(r0, r1);
+                s0 = _mm_add_epi32(s0,
+                                   _mm_madd_epi16(_mm_cvtepu8_epi16(lo), w));
+                s1 = _mm_add_epi32(
+                    s1, _mm_madd_epi16(
+                            _mm_cvtepu8_epi16(_mm_srli_si128(lo, 8)), w));
+                s2 = _mm_add_epi32(s2,
+                                   _mm_madd_epi16(_mm_cvtepu8_epi16(hi), w));
+                s3 = _mm_add_epi32(
+                    s3, _mm_madd_epi16(
+                            _mm_cvtepu8_epi16(_mm_srli_si128(hi, 8)), w));
+            }
+            _mm_storeu_si128((__m128i*)&dst_line[x],
+                             pack_opaque_sse41(s0, s1, s2, s3));
+        }
+
+        // rest of the line
+        for (; x < src->width; ++x) {
+            __m128i sum = zero;
+            for (size_t i = 0; i < n; ++i) {
+                const __m128i px = _mm_cvtepu8_epi32(
+                    _mm_cvtsi32_si128((int)col[i * stride + x]));
+                sum = _mm_add_epi32(
+                    sum, _mm_mullo_epi32(px, _mm_set1_epi32(weights[i])));
+            }
+            dst_line[x] =
+                _mm_cvtsi128_si32(pack_opaque_sse41(sum, sum, sum, sum));
+        }
+    }
+}
+
+__attribute__((target("sse4.1"))) static void
+apply_vk_premul_sse41(const struct premul* src, struct pixmap* dst,
+                      const struct kernel* kernel, size_t y_low,
+                      size_t y_high, size_t xoff, size_t yoff)
+{
+    const size_t stride = src->width * PREMUL_CHANNELS;
+    const __m128i zero = _mm_setzero_si128();
+
+    for (size_t y = y_low; y < y_high; ++y) {
+        const struct output* output = &kernel->outputs[y];
+        const uint16_t* col = &src->data[(output->first - yoff) * stride];
+        const int16_t* weights = &kernel->weights[output->index];
+        const size_t n = output->n;
+        argb_t* dst_line =
+            &dst->data[(y + kernel->start_out) * dst->width + xoff];
+        size_t x = 0;
+
+        // 4 pixels per iteration
+        for (; x + 4 <= src->width; x += 4) {
+            const uint16_t* in = &col[x * PREMUL_CHANNELS];
+            __m128i s0 = zero, s1 = zero, s2 = zero, s3 = zero;
+            for (size_t i = 0; i < n; ++i) {
+                const __m128i w = _mm_set1_epi32(weights[i]);
+                const __m128i p01 =
+                    _mm_loadu_si128((const __m128i*)&in[i * stride]);
+                const __m128i p23 =
+                    _mm_loadu_si128((const __m128i*)&in[i * stride + 8]);
+                s0 = _mm_add_epi32(
+                    s0, _mm_mullo_epi32(_mm_cvtepu16_epi32(p01), w));
+                s1 = _mm_add_epi32(
+                    s1, _mm_mullo_epi32(
+                            _mm_cvtepu16_epi32(_mm_srli_si128(p01, 8)), w));
+                s2 = _mm_add_epi32(
+                    s2, _mm_mullo_epi32(_mm_cvtepu16_epi32(p23), w));
+                s3 = _mm_add_epi32(
+                    s3, _mm_mullo_epi32(
+                            _mm_cvtepu16_epi32(_mm_srli_si128(p23, 8)), w));
+            }
+            alpha_blend(premul_load_sse41(s0), &dst_line[x]);
+            alpha_blend(premul_load_sse41(s1), &dst_line[x + 1]);
+            alpha_blend(premul_load_sse41(s2), &dst_line[x + 2]);
+            alpha_blend(premul_load_sse41(s3), &dst_line[x + 3]);
+        }
+
+        // rest of the line
+        for (; x < src->width; ++x) {
+            const __m128i sum = sum_vk_premul_sse41(
+                &col[x * PREMUL_CHANNELS], stride, weights, n);
+            alpha_blend(premul_load_sse41(sum), &dst_line[x]);
+        }
+    }
+}
+
+/** Get sums of BGRA channels for a single output of horizontal kernel. */
+__attribute__((target("avx2"))) static inline __m128i
+sum_hk_avx2(const argb_t* src, const int16_t* weights, size_t n)
+{
+    const __m128i shuffle =
+        _mm_setr_epi8(0, 4, 1, 5, 2, 6, 3, 7, 8, 12, 9, 13, 10, 14, 11, 15);
+    __m256i sum = _mm256_setzero_si256();
+    __m128i sum128;
+    size_t i = 0;
+
+    // four inputs per iteration, two in each 128-bit lane
+    for (; i + 3 < n; i += 4) {
+        const __m128i px = _mm_shuffle_epi8(
+            _mm_loadu_si128((const __m128i*)&src[i]), shuffle);
+        const int32_t w01 = weight_pair(weights[i], weights[i + 1]);
+        const int32_t w23 = weight_pair(weights[i + 2], weights[i + 3]);
+        const __m256i w =
+            _mm256_setr_epi32(w01, w01, w01, w01, w23, w23, w23, w23);
+        sum = _mm256_add_epi32(sum,
+                               _mm256_madd_epi16(_mm256_cvtepu8_epi16(px), w));
     }
+
+    sum128 = _mm_add_epi32(_mm256_castsi256_si128(sum),
+                           _mm256_extracti128_si256(sum, 1));
+    if (i < n) {
+        sum128 = _mm_add_epi32(sum128,
+                               sum_hk_sse41(&src[i], &weights[i], n - i));
+    }
+
+    return sum128;
 }
 
-// Apply a horizontal kernel; the output pixmap is assumed to be only as tall as
-// needed by the vertical pass - yoff indicates where it begins in the source
-static void apply_hk(const struct pixmap* src, struct pixmap* dst,
+/** Get alpha weighted sums for a single output of horizontal kernel. */
+__attribute__((target("avx2"))) static inline __m128i
+sum_hk_alpha_avx2(const argb_t* src, const int16_t* weights, size_t n)
+{
+    const __m256i one = _mm256_set1_epi32(1);
+    __m256i sum = _mm256_setzero_si256();
+    __m128i sum128;
+    size_t i = 0;
+
+    // two inputs per iteration, one in each 128-bit lane
+    for (; i + 1 < n; i += 2) {
+        __m256i px =
+            _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)&src[i]));
+        const __m256i w =
+            _mm256_setr_epi32(weights[i], weights[i], weights[i], weights[i],
+                              weights[i + 1], weights[i + 1], weights[i + 1],
+                              weights[i + 1]);
+        const __m256i wa =
+            _mm256_mullo_epi32(_mm256_shuffle_epi32(px, 0xff), w);
+        px = _mm256_blend_epi32(px, one, 0x88);
+        sum = _mm256_add_epi32(sum, _mm256_mullo_epi32(px, wa));
+    }
+
+    sum128 = _mm_add_epi32(_mm256_castsi256_si128(sum),
+                           _mm256_extracti128_si256(sum, 1));
+    if (i < n) {
+        sum128 = _mm_add_epi32(sum128,
+                               sum_hk_alpha_sse41(&src[i], &weights[i], 1));
+    }
+
+    return sum128;
+}
+
+__attribute__((target("avx2"))) static void
+apply_hk_avx2(const struct pixmap* src, struct pixmap* dst,
+              const struct kernel* kernel, size_t y_low, size_t y_high,
+              size_t yoff)
+{
+    for (size_t y = y_low; y < y_high; ++y) {
+        const argb_t* src_line = &src->data[(y + yoff) * src->width];
+        argb_t* dst_line = &dst->data[y * dst->width];
+        for (size_t x = 0; x < dst->width; ++x) {
+            const struct output* output = &kernel->outputs[x];
+            const __m128i sum =
+                sum_hk_avx2(&src_line[output->first],
+                            &kernel->weights[output->index], output->n);
+            const __m128i px = pack_opaque_sse41(sum, sum, sum, sum);
+            dst_line[x] = _mm_cvtsi128_si32(px);
+        }
+    }
+}
+
+__attribute__((target("avx2"))) static void
+apply_hk_premul_avx2(const struct pixmap* src, struct premul* dst,
                      const struct kernel* kernel, size_t y_low, size_t y_high,
-                     size_t yoff, bool alpha)
+                     size_t yoff)
 {
-    if (alpha) {
-        // Although this duplicates some code (the loop over y and x), doing the
-        // check for alpha outside gave better performance (likely due to fewer
-        // instructions in the loop body or fewer branch mispredictions)
-        for (size_t y = y_low; y < y_high; ++y) {
-            argb_t* dst_line = &dst->data[y * dst->width];
-            for (size_t x = 0; x < dst->width; ++x) {
-                const struct output* output = &kernel->outputs[x];
-                int64_t a = 0;
-                int64_t r = 0;
-                int64_t g = 0;
-                int64_t b = 0;
-                for (size_t i = 0; i < output->n; ++i) {
-                    const argb_t c =
-                        src->data[(y + yoff) * src->width + output->first + i];
-                    const int64_t wa = (int64_t)ARGB_GET_A(c) *
-                        kernel->weights[output->index + i];
-                    a += wa;
-                    r += ARGB_GET_R(c) * wa;
-                    g += ARGB_GET_G(c) * wa;
-                    b += ARGB_GET_B(c) * wa;
-                }
-                // XXX if we want more accuracy (without sacrificing speed), we
-                // could save more than 8 bits between the passes
-                const uint8_t ua = clamp(a >> FIXED_BITS, 0, 255);
-                if (a == 0) {
-                    a = (1 << FIXED_BITS);
-                }
-                // TODO irrespective of the above, saving the intermediate with
-                // premultiplied alpha would almost certainly improve
-                // performance
-                const uint8_t ur = clamp(r / a, 0, 255);
-                const uint8_t ug = clamp(g / a, 0, 255);
-                const uint8_t ub = clamp(b / a, 0, 255);
-                alpha_blend(ARGB(ua, ur, ug, ub), &dst_line[x]);
+    for (size_t y = y_low; y < y_high; ++y) {
+        const argb_t* src_line = &src->data[(y + yoff) * src->width];
+        uint16_t* dst_line = &dst->data[y * dst->width * PREMUL_CHANNELS];
+        for (size_t x = 0; x < dst->width; ++x) {
+            const struct output* output = &kernel->outputs[x];
+            const __m128i sum =
+                sum_hk_alpha_avx2(&src_line[output->first],
+                                  &kernel->weights[output->index], output->n);
+            premul_store_sse41(sum, &dst_line[x * PREMUL_CHANNELS]);
+        }
+    }
+}
+
+__attribute__((target("avx2"))) static void
+apply_vk_avx2(const struct pixmap* src, struct pixmap* dst,
+              const struct kernel* kernel, size_t y_low, size_t y_high,
+              size_t xoff, size_t yoff)
+{
+    const size_t stride = src->width;
+    const __m256i zero = _mm256_setzero_si256();
+
+    for (size_t y = y_low; y < y_high; ++y) {
+        const struct output* output = &kernel->outputs[y];
+        const argb_t* col = &src->data[(output->first - yoff) * stride];
+        const int16_t* weights = &kernel->weights[output->index];
+        const size_t n = output->n;
+        argb_t* dst_line =
+            &dst->data[(y + kernel->start_out) * dst->width + xoff];
+        size_t x = 0;
+
+        // 8 pixels per iteration, two inputs (rows) at once
+        for (; x + 8 <= src->width; x += 8) {
+            __m256i s01 = zero, s23 = zero, s45 = zero, s67 = zero;
+            for (size_t i = 0; i < n; i += 2) {
+                const __m256i r0 =
+                    _mm256_loadu_si256((const __m256i*)&col[i * stride + x]);
+                const __m256i r1 = i + 1 < n
+                    ? _mm256_loadu_si256(
+                          (const __m256i*)&col[(i + 1) * stride + x])
+                    : zero;
+                const int16_t w1 = i + 1 < n ? weights[i + 1] : 0;
+                const __m256i w =
+                    _mm256_set1_epi32(weight_pair(weights[i], w1));
+                // interleave inside 128-bit lanes: pixels 0,1 and 4,5
+                const __m256i lo = _mm256_unpacklo_epi8(r0, r1);
+                // pixels 2,3 and 6,7
+                const __m256i hi = _mm256_unpackhi_epi8(r0, r1);
+                s01 = _mm256_add_epi32(
+                    s01, _mm256_madd_epi16(
+                             _mm256_cvtepu8_epi16(_mm256_castsi256_si128(lo)),
+                             w));
+                s45 = _mm256_add_epi32(
+                    s45,
+                    _mm256_madd_epi16(
+                        _mm256_cvtepu8_epi16(_mm256_extracti128_si256(lo, 1)),
+                        w));
+                s23 = _mm256_add_epi32(
+                    s23, _mm256_madd_epi16(
+                             _mm256_cvtepu8_epi16(_mm256_castsi256_si128(hi)),
+                             w));
+                s67 = _mm256_add_epi32(
+                    s67,
+                    _mm256_madd_epi16(
+                        _mm256_cvtepu8_epi16(_mm256_extracti128_si256(hi, 1)),
+                        w));
             }
+            _mm_storeu_si128(
+                (__m128i*)&dst_line[x],
+                pack_opaque_sse41(_mm256_castsi256_si128(s01),
+                                  _mm256_extracti128_si256(s01, 1),
+                                  _mm256_castsi256_si128(s23),
+                                  _mm256_extracti128_si256(s23, 1)));
+            _mm_storeu_si128(
+                (__m128i*)&dst_line[x + 4],
+                pack_opaque_sse41(_mm256_castsi256_si128(s45),
+                                  _mm256_extracti128_si256(s45, 1),
+                                  _mm256_castsi256_si128(s67),
+                                  _mm256_extracti128_si256(s67, 1)));
         }
-    } else {
-        for (size_t y = y_low; y < y_high; ++y) {
-            argb_t* dst_line = &dst->data[y * dst->width];
-            for (size_t x = 0; x < dst->width; ++x) {
-                const struct output* output = &kernel->outputs[x];
-                int64_t r = 0;
-                int64_t g = 0;
-                int64_t b = 0;
-                for (size_t i = 0; i < output->n; ++i) {
-                    const argb_t c =
-                        src->data[(y + yoff) * src->width + output->first + i];
-                    const int64_t w =
-                        (int64_t)kernel->weights[output->index + i];
-                    r += ARGB_GET_R(c) * w;
-                    g += ARGB_GET_G(c) * w;
-                    b += ARGB_GET_B(c) * w;
-                }
-                const uint8_t ur = clamp(r >> FIXED_BITS, 0, 255);
-                const uint8_t ug = clamp(g >> FIXED_BITS, 0, 255);
-                const uint8_t ub = clamp(b >> FIXED_BITS, 0, 255);
-                dst_line[x] = ARGB(0xff, ur, ug, ub);
+
+        // rest of the line
+        for (; x < src->width; ++x) {
+            __m128i sum = _mm_setzero_si128();
+            for (size_t i = 0; i < n; ++i) {
+                const __m128i px = _mm_cvtepu8_epi32(
+                    _mm_cvtsi32_si128((int)col[i * stride + x]));
+                sum = _mm_add_epi32(
+                    sum, _mm_mullo_epi32(px, _mm_set1_epi32(weights[i])));
             }
+            dst_line[x] =
+                _mm_cvtsi128_si32(pack_opaque_sse41(sum, sum, sum, sum));
         }
     }
 }
 
-// Apply a vertical kernel; the input pixmap is assumed to be only as tall as
-// needed - xoff indicates where it should go in the destination
-static void apply_vk(const struct pixmap* src, struct pixmap* dst,
+__attribute__((target("avx2"))) static void
+apply_vk_premul_avx2(const struct premul* src, struct pixmap* dst,
                      const struct kernel* kernel, size_t y_low, size_t y_high,
-                     size_t xoff, bool alpha)
+                     size_t xoff, size_t yoff)
 {
-    if (alpha) {
-        for (size_t y = y_low; y < y_high; ++y) {
-            argb_t* dst_line = &dst->data[(y + kernel->start_out) * dst->width];
-            for (size_t x = 0; x < src->width; ++x) {
-                const struct output* output = &kernel->outputs[y];
-                int64_t a = 0;
-                int64_t r = 0;
-                int64_t g = 0;
-                int64_t b = 0;
-                for (size_t i = 0; i < output->n; ++i) {
-                    const argb_t c =
-                        src->data[(output->first + i - kernel->start_in) *
-                                      src->width +
-                                  x];
-                    const int64_t wa = (int64_t)ARGB_GET_A(c) *
-                        kernel->weights[output->index + i];
-                    a += wa;
-                    r += ARGB_GET_R(c) * wa;
-                    g += ARGB_GET_G(c) * wa;
-                    b += ARGB_GET_B(c) * wa;
-                }
-                const uint8_t ua = clamp(a >> FIXED_BITS, 0, 255);
-                if (a == 0) {
-                    a = (1 << FIXED_BITS);
+    const size_t stride = src->width * PREMUL_CHANNELS;
+    const __m256i zero = _mm256_setzero_si256();
+
+    for (size_t y = y_low; y < y_high; ++y) {
+        const struct output* output = &kernel->outputs[y];
+        const uint16_t* col = &src->data[(output->first - yoff) * stride];
+        const int16_t* weights = &kernel->weights[output->index];
+        const size_t n = output->n;
+        argb_t* dst_line =
+            &dst->data[(y + kernel->start_out) * dst->width + xoff];
+        size_t x = 0;
+
+        // 8 pixels per iteration, two pixels in each register
+        for (; x + 8 <= src->width; x += 8) {
+            const uint16_t* in = &col[x * PREMUL_CHANNELS];
+            __m256i sum[4] = { zero, zero, zero, zero };
+            for (size_t i = 0; i < n; ++i) {
+                const __m256i w = _mm256_set1_epi32(weights[i]);
+                for (size_t j = 0; j < 4; ++j) {
+                    const __m128i px = _mm_loadu_si128(
+                        (const __m128i*)&in[i * stride + j * 8]);
+                    sum[j] = _mm256_add_epi32(
+                        sum[j],
+                        _mm256_mullo_epi32(_mm256_cvtepu16_epi32(px), w));
                 }
-                const uint8_t ur = clamp(r / a, 0, 255);
-                const uint8_t ug = clamp(g / a, 0, 255);
-                const uint8_t ub = clamp(b / a, 0, 255);
-                alpha_blend(ARGB(ua, ur, ug, ub), &dst_line[x + xoff]);
+            }
+            for (size_t j = 0; j < 4; ++j) {
+                alpha_blend(
+                    premul_load_sse41(_mm256_castsi256_si128(sum[j])),
+                    &dst_line[x + j * 2]);
+                alpha_blend(
+                    premul_load_sse41(_mm256_extracti128_si256(sum[j], 1)),
+                    &dst_line[x + j * 2 + 1]);
             }
         }
+
+        // rest of the line
+        for (; x < src->width; ++x) {
+            const __m128i sum = sum_vk_premul_sse41(
+                &col[x * PREMUL_CHANNELS], stride, weights, n);
+            alpha_blend(premul_load_sse41(sum), &dst_line[x]);
+        }
+    }
+}
+#endif // SCALE_SIMD_X86
+
+// Apply a horizontal kernel with the best available implementation
+static void apply_hk(const struct task_sc* task, struct tile* tile,
+                     size_t y_low, size_t y_high, size_t yoff)
+{
+    const struct kernel* kernel = &task->hk;
+
+#ifdef SCALE_SIMD_X86
+    if (kernel->max_n <= SIMD_MAX_TAPS && simd_level == simd_avx2) {
+        if (task->alpha) {
+            apply_hk_premul_avx2(task->src, &tile->pmul, kernel, y_low, y_high,
+                                 yoff);
+        } else {
+            apply_hk_avx2(task->src, &tile->pm, kernel, y_low, y_high, yoff);
+        }
+        return;
+    }
+    if (kernel->max_n <= SIMD_MAX_TAPS && simd_level == simd_sse41) {
+        if (task->alpha) {
+            apply_hk_premul_sse41(task->src, &tile->pmul, kernel, y_low,
+                                  y_high, yoff);
+        } else {
+            apply_hk_sse41(task->src, &tile->pm, kernel, y_low, y_high, yoff);
+        }
+        return;
+    }
+#endif // SCALE_SIMD_X86
+
+    if (task->alpha) {
+        apply_hk_premul_generic(task->src, &tile->pmul, kernel, y_low,
+                                y_high, yoff);
     } else {
-        for (size_t y = y_low; y < y_high; ++y) {
-            argb_t* dst_line = &dst->data[(y + kernel->start_out) * dst->width];
-            for (size_t x = 0; x < src->width; ++x) {
-                const struct output* output = &kernel->outputs[y];
-                int64_t r = 0;
-                int64_t g = 0;
-                int64_t b = 0;
-                for (size_t i = 0; i < output->n; ++i) {
-                    const argb_t c =
-                        src->data[(output->first + i - kernel->start_in) *
-                                      src->width +
-                                  x];
-                    const int64_t w =
-                        (int64_t)kernel->weights[output->index + i];
-                    r += ARGB_GET_R(c) * w;
-                    g += ARGB_GET_G(c) * w;
-                    b += ARGB_GET_B(c) * w;
-                }
-                const uint8_t ur = clamp(r >> FIXED_BITS, 0, 255);
-                const uint8_t ug = clamp(g >> FIXED_BITS, 0, 255);
-                const uint8_t ub = clamp(b >> FIXED_BITS, 0, 255);
-                dst_line[x + xoff] = ARGB(0xff, ur, ug, ub);
-            }
+        apply_hk_generic(task->src, &tile->pm, kernel, y_low, y_high, yoff);
+    }
+}
+
+// Apply a vertical kernel with the best available implementation
+static void apply_vk(const struct task_sc* task, const struct tile* tile,
+                     size_t y_low, size_t y_high, size_t xoff, size_t yoff)
+{
+    const struct kernel* kernel = &task->vk;
+
+#ifdef SCALE_SIMD_X86
+    if (kernel->max_n <= SIMD_MAX_TAPS && simd_level == simd_avx2) {
+        if (task->alpha) {
+            apply_vk_premul_avx2(&tile->pmul, task->dst, kernel, y_low, y_high,
+                                 xoff, yoff);
+        } else {
+            apply_vk_avx2(&tile->pm, task->dst, kernel, y_low, y_high, xoff,
+                          yoff);
         }
+        return;
+    }
+    if (kernel->max_n <= SIMD_MAX_TAPS && simd_level == simd_sse41) {
+        if (task->alpha) {
+            apply_vk_premul_sse41(&tile->pmul, task->dst, kernel, y_low,
+                                  y_high, xoff, yoff);
+        } else {
+            apply_vk_sse41(&tile->pm, task->dst, kernel, y_low, y_high, xoff,
+                           yoff);
+        }
+        return;
+    }
+#endif // SCALE_SIMD_X86
+
+    if (task->alpha) {
+        apply_vk_premul_generic(&tile->pmul, task->dst, kernel, y_low, y_high,
+                                xoff, yoff);
+    } else {
+        apply_vk_generic(&tile->pm, task->dst, kernel, y_low, y_high, xoff,
+                         yoff);
     }
 }
 
@@ -490,51 +1308,234 @@ static void scale_nearest(const struct pixmap* src, struct pixmap* dst,
     }
 }
 
-static void* nn_task(void* arg)
+/**
+ * Get number of row bands to split the job into.
+ * @param width,height size of the processed area
+ * @return number of tasks
+ */
+static size_t split_rows(size_t width, size_t height)
 {
-    // Each thread simply handles a consecutive block of rows
-    struct task_nn_priv* priv = arg;
-    struct task_nn_shared* shared = priv->shared;
-    scale_nearest(shared->src, shared->dst, priv->y_low, priv->y_high,
-                  shared->x_low, shared->x_high, shared->num, shared->den_bits,
-                  shared->x, shared->y, shared->alpha);
-    return NULL;
+    const size_t units = min(height, width * height / TASK_MIN_PIXELS);
+    return tpool_tasks(units);
+}
+
+/**
+ * Get range of rows for the task.
+ * @param index task index
+ * @param tasks total number of tasks
+ * @param low,high range of the whole job, in/out
+ */
+static inline void band_rows(size_t index, size_t tasks, size_t* low,
+                             size_t* high)
+{
+    const size_t total = *high - *low;
+    const size_t start = *low;
+    *low = start + total * index / tasks;
+    *high = start + total * (index + 1) / tasks;
+}
+
+/** Thread pool handler: nearest-neighbor scale of a band of rows. */
+static void nn_task(size_t index, void* data)
+{
+    const struct task_nn* task = data;
+    size_t y_low = task->y_low;
+    size_t y_high = task->y_high;
+
+    band_rows(index, task->tasks, &y_low, &y_high);
+    scale_nearest(task->src, task->dst, y_low, y_high, task->x_low,
+                  task->x_high, task->num, task->den_bits, task->x, task->y,
+                  task->alpha);
+}
+
+/**
+ * Allocate tile of the intermediate image, the content is not initialized.
+ * @param tile tile to initialize
+ * @param width,height size of the tile
+ * @param alpha true to use premultiplied format
+ * @return false if allocation failed
+ */
+static bool tile_create(struct tile* tile, size_t width, size_t height,
+                        bool alpha)
+{
+    memset(tile, 0, sizeof(*tile));
+    if (alpha) {
+        tile->pmul.width = width;
+        tile->pmul.height = height;
+        tile->memory =
+            width * height * PREMUL_CHANNELS * sizeof(*tile->pmul.data);
+        tile->pmul.data = malloc(tile->memory);
+    } else {
+        tile->pm.width = width;
+        tile->pm.height = height;
+        tile->memory = width * height * sizeof(*tile->pm.data);
+        tile->pm.data = malloc(tile->memory);
+    }
+    if (!tile->pm.data && !tile->pmul.data) {
+        return false;
+    }
+    memstat_alloc(memstat_scaler, tile->memory);
+    return true;
 }
 
-static void* sc_task(void* arg)
+/**
+ * Free tile of the intermediate image.
+ * @param tile tile to free
+ */
+static void tile_free(struct tile* tile)
 {
-    // Each thread first handles a consecutive block of rows for the horizontal
-    // scale, synchronizes with the others, then handles a consecutive block of
-    // rows for the vertical scale
-    struct task_sc_priv* priv = arg;
-    struct task_sc_shared* shared = priv->shared;
+    if (tile->pm.data || tile->pmul.data) {
+        memstat_free(memstat_scaler, tile->memory);
+    }
+    free(tile->pm.data);
+    free(tile->pmul.data);
+}
 
-    apply_hk(shared->src, &shared->in, &shared->hk, priv->hy_low, priv->hy_high,
-             shared->yoff, shared->alpha);
+/**
+ * Remove rows from the top of the tile.
+ * @param tile tile to modify
+ * @param skip number of rows to remove
+ * @param rows total number of valid rows in the tile
+ */
+static void tile_shift(struct tile* tile, size_t skip, size_t rows)
+{
+    if (tile->pmul.data) {
+        const size_t stride = tile->pmul.width * PREMUL_CHANNELS;
+        memmove(tile->pmul.data, &tile->pmul.data[skip * stride],
+                (rows - skip) * stride * sizeof(*tile->pmul.data));
+    } else {
+        const size_t stride = tile->pm.width;
+        memmove(tile->pm.data, &tile->pm.data[skip * stride],
+                (rows - skip) * stride * sizeof(*tile->pm.data));
+    }
+}
 
-    pthread_mutex_lock(&shared->m);
-    ++shared->sync;
-    pthread_cond_broadcast(&shared->cv);
-    while (shared->sync != shared->threads) {
-        pthread_cond_wait(&shared->cv, &shared->m);
+/**
+ * Thread pool handler: both passes for a band of rows. The band is processed
+ * from top to bottom by parts, the tile holds only the source rows used by
+ * the current part, so the rows shared with the previous part are moved
+ * instead of being computed again.
+ */
+static void sc_task(size_t index, void* data)
+{
+    const struct task_sc* task = data;
+    const size_t capacity = TILE_ROWS + task->vk.max_n;
+    size_t y_low = 0;
+    size_t y_high = task->vk.n_out;
+    size_t first = 0; // source row of the first tile row
+    size_t rows = 0;  // number of computed rows in the tile
+    struct tile tile;
+
+    if (!tile_create(&tile, task->hk.n_out, capacity, task->alpha)) {
+        return;
     }
-    pthread_mutex_unlock(&shared->m);
 
-    apply_vk(&shared->in, shared->dst, &shared->vk, priv->vy_low, priv->vy_high,
-             shared->xoff, shared->alpha);
+    band_rows(index, task->tasks, &y_low, &y_high);
+
+    while (y_low < y_high) {
+        size_t in_first = SIZE_MAX;
+        size_t in_last = 0;
+        size_t y_end = y_low;
+
+        // get range of output rows which inputs fit into the tile
+        while (y_end < y_high) {
+            const struct output* output = &task->vk.outputs[y_end];
+            const size_t low = min(in_first, output->first);
+            const size_t high = max(in_last, output->first + output->n - 1);
+            if (y_end != y_low && high - low >= capacity) {
+                break;
+            }
+            in_first = low;
+            in_last = high;
+            ++y_end;
+        }
 
-    return NULL;
+        // drop rows which are not used anymore
+        if (in_first < first || in_first >= first + rows) {
+            rows = 0;
+        } else if (in_first > first) {
+            tile_shift(&tile, in_first - first, rows);
+            rows -= in_first - first;
+        }
+        first = in_first;
+
+        // horizontal pass for new rows
+        if (in_last - first + 1 > rows) {
+            apply_hk(task, &tile, rows, in_last - first + 1, first);
+            rows = in_last - first + 1;
+        }
+
+        apply_vk(task, &tile, y_low, y_end, task->hk.start_out, first);
+
+        y_low = y_end;
+    }
+
+    tile_free(&tile);
 }
 
-static void pixmap_scale_nn(size_t threads, const struct pixmap* src,
-                            struct pixmap* dst, ssize_t x, ssize_t y,
-                            double scale, bool alpha)
+/** Thread pool handler: half-size downscale of a band of rows. */
+static void half_task(size_t index, void* data)
+{
+    const struct task_half* task = data;
+    const struct pixmap* src = task->src;
+    struct pixmap* dst = task->dst;
+    size_t y_low = 0;
+    size_t y_high = dst->height;
+
+    band_rows(index, task->tasks, &y_low, &y_high);
+
+    for (size_t y = y_low; y < y_high; ++y) {
+        // the last row/column of odd sized source is used twice
+        const argb_t* line0 = &src->data[y * 2 * src->width];
+        const argb_t* line1 =
+            y * 2 + 1 < src->height ? line0 + src->width : line0;
+        argb_t* dst_line = &dst->data[y * dst->width];
+
+        for (size_t x = 0; x < dst->width; ++x) {
+            const size_t x0 = x * 2;
+            const size_t x1 = x0 + 1 < src->width ? x0 + 1 : x0;
+            const argb_t px[] = { line0[x0], line0[x1], line1[x0],
+                                  line1[x1] };
+            uint32_t a = 0, r = 0, g = 0, b = 0;
+
+            if (task->alpha) {
+                // weight colors by alpha to avoid dark fringes
+                for (size_t i = 0; i < ARRAY_SIZE(px); ++i) {
+                    const uint32_t pa = ARGB_GET_A(px[i]);
+                    a += pa;
+                    r += ARGB_GET_R(px[i]) * pa;
+                    g += ARGB_GET_G(px[i]) * pa;
+                    b += ARGB_GET_B(px[i]) * pa;
+                }
+                if (a) {
+                    r = (r + a / 2) / a;
+                    g = (g + a / 2) / a;
+                    b = (b + a / 2) / a;
+                }
+                a = (a + 2) / 4;
+            } else {
+                for (size_t i = 0; i < ARRAY_SIZE(px); ++i) {
+                    r += ARGB_GET_R(px[i]);
+                    g += ARGB_GET_G(px[i]);
+                    b += ARGB_GET_B(px[i]);
+                }
+                a = 0xff;
+                r = (r + 2) / 4;
+                g = (g + 2) / 4;
+                b = (b + 2) / 4;
+            }
+
+            dst_line[x] = ARGB(a, r, g, b);
+        }
+    }
+}
+
+static void pixmap_scale_nn(const struct pixmap* src, struct pixmap* dst,
+                            ssize_t x, ssize_t y, double scale, bool alpha)
 {
     const size_t left = max(0, x);
     const size_t top = max(0, y);
     const size_t right = min(dst->width, (size_t)(x + scale * src->width));
     const size_t bottom = min(dst->height, (size_t)(y + scale * src->height));
-    const size_t len = (bottom - top) / (threads + 1);
 
     // Use fixed-point for efficiency (floating-point division becomes an
     // addition and a shift, since it's used in a loop anyway). The choices
@@ -544,107 +1545,116 @@ static void pixmap_scale_nn(size_t threads, const struct pixmap* src,
     const uint8_t den_bits = scale > 1.0 ? 32 : 25;
     const size_t num = (1.0 / scale) * (1UL << den_bits);
 
-    struct task_nn_shared task_shared = {
+    struct task_nn task = {
         .src = src,
         .dst = dst,
         .x_low = left,
         .x_high = right,
+        .y_low = top,
+        .y_high = bottom,
         .num = num,
         .den_bits = den_bits,
         .x = x,
         .y = y,
         .alpha = alpha,
+        .tasks = split_rows(right - left, bottom - top),
     };
 
-    struct task_nn_priv* task_priv = NULL;
-    if (threads) {
-        task_priv = malloc(threads * sizeof(*task_priv));
-    }
-    size_t row = top;
-    for (size_t i = 0; i < threads; ++i) {
-        task_priv[i].shared = &task_shared;
-        task_priv[i].y_low = row;
-        row += len;
-        task_priv[i].y_high = row;
-        pthread_create(&task_priv[i].id, NULL, nn_task, &task_priv[i]);
-    }
-    struct task_nn_priv task_first = {
-        .shared = &task_shared,
-        .y_low = row,
-        .y_high = bottom,
-    };
-
-    nn_task(&task_first);
+    tpool_run(task.tasks, nn_task, &task);
+}
 
-    for (size_t i = 0; i < threads; ++i) {
-        pthread_join(task_priv[i].id, NULL);
+static void pixmap_scale_aa(enum aa_mode scaler, const struct pixmap* src,
+                            struct pixmap* dst, ssize_t x, ssize_t y,
+                            double scale, bool alpha)
+{
+    struct task_sc task = {
+        .src = src,
+        .dst = dst,
+        .alpha = alpha,
+    };
+    if (!new_named_kernel(scaler, &task.hk, src->width, dst->width, x,
+                          scale) ||
+        !new_named_kernel(scaler, &task.vk, src->height, dst->height, y,
+                          scale)) {
+        free_kernel(&task.hk);
+        return;
     }
 
-    free(task_priv);
+    task.tasks = split_rows(task.hk.n_out, task.vk.n_out);
+    tpool_run(task.tasks, sc_task, &task);
+
+    free_kernel(&task.hk);
+    free_kernel(&task.vk);
 }
 
-static void pixmap_scale_aa(enum aa_mode scaler, size_t threads,
-                            const struct pixmap* src, struct pixmap* dst,
-                            ssize_t x, ssize_t y, double scale, bool alpha)
+bool pixmap_scale_half(const struct pixmap* src, struct pixmap* dst,
+                       bool alpha)
 {
-    struct task_sc_shared task_shared = {
+    struct task_half task = {
         .src = src,
         .dst = dst,
         .alpha = alpha,
-        .threads = threads + 1,
-        .sync = 0,
-        .m = PTHREAD_MUTEX_INITIALIZER,
-        .cv = PTHREAD_COND_INITIALIZER,
-    };
-    new_named_kernel(scaler, &task_shared.hk, src->width, dst->width, x, scale);
-    new_named_kernel(scaler, &task_shared.vk, src->height, dst->height, y,
-                     scale);
-    pixmap_create(&task_shared.in, task_shared.hk.n_out, task_shared.vk.n_in);
-    task_shared.yoff = task_shared.vk.start_in;
-    task_shared.xoff = task_shared.hk.start_out;
-
-    struct task_sc_priv* task_priv = NULL;
-    if (threads) {
-        task_priv = malloc(threads * sizeof(*task_priv));
-    }
-    const size_t hlen = task_shared.vk.n_in / (threads + 1);
-    const size_t vlen = task_shared.vk.n_out / (threads + 1);
-    size_t hrow = 0;
-    size_t vrow = 0;
-    for (size_t i = 0; i < threads; ++i) {
-        task_priv[i].shared = &task_shared;
-        task_priv[i].hy_low = hrow;
-        task_priv[i].vy_low = vrow;
-        hrow += hlen;
-        vrow += vlen;
-        task_priv[i].hy_high = hrow;
-        task_priv[i].vy_high = vrow;
-        pthread_create(&task_priv[i].id, NULL, sc_task, &task_priv[i]);
-    }
-    struct task_sc_priv task_first = {
-        .shared = &task_shared,
-        .hy_low = hrow,
-        .vy_low = vrow,
-        .hy_high = task_shared.vk.n_in,
-        .vy_high = task_shared.vk.n_out,
     };
 
-    sc_task(&task_first);
+    if (!pixmap_create(dst, (src->width + 1) / 2, (src->height + 1) / 2)) {
+        return false;
+    }
+
+    task.tasks = split_rows(dst->width, dst->height);
+    tpool_run(task.tasks, half_task, &task);
+
+    return true;
+}
+
+bool pixmap_scale_simd(enum scale_simd simd)
+{
+    bool supported = false;
+
+    switch (simd) {
+        case simd_auto:
+#ifdef SCALE_SIMD_X86
+            if (__builtin_cpu_supports("avx2")) {
+                simd = simd_avx2;
+            } else if (__builtin_cpu_supports("sse4.1")) {
+                simd = simd_sse41;
+            } else {
+                simd = simd_none;
+            }
+#else
+            simd = simd_none;
+#endif // SCALE_SIMD_X86
+            supported = true;
+            break;
+        case simd_none:
+            supported = true;
+            break;
+        case simd_sse41:
+#ifdef SCALE_SIMD_X86
+            supported = __builtin_cpu_supports("sse4.1");
+#endif
+            break;
+        case simd_avx2:
+#ifdef SCALE_SIMD_X86
+            supported = __builtin_cpu_supports("avx2");
+#endif
+            break;
+    }
 
-    for (size_t i = 0; i < threads; ++i) {
-        pthread_join(task_priv[i].id, NULL);
+    if (supported) {
+        simd_level = simd;
+        alpha_blend_simd(simd);
+        pixel_conv_simd(simd);
     }
 
-    free(task_priv);
-    free_kernel(&task_shared.hk);
-    free_kernel(&task_shared.vk);
-    pixmap_free(&task_shared.in);
+    return supported;
 }
 
 void pixmap_scale(enum aa_mode scaler, const struct pixmap* src,
                   struct pixmap* dst, ssize_t x, ssize_t y, double scale,
                   bool alpha)
 {
+    TRACE_SCOPE("pixmap_scale");
+
     // get size of rendered area
     const ssize_t width =
         min((ssize_t)dst->width, (ssize_t)(x + scale * src->width)) - max(0, x);
@@ -656,26 +1666,13 @@ void pixmap_scale(enum aa_mode scaler, const struct pixmap* src,
         return; // out of destination
     }
 
-    // get number of active CPUs
-    static size_t cpu_num = 0;
-    if (cpu_num == 0) {
-        int32_t cpus = 0;
-#ifdef __FreeBSD__
-        size_t cpus_len = sizeof(cpus);
-        sysctlbyname("hw.ncpu", &cpus, &cpus_len, NULL, 0);
-#else
-        cpus = sysconf(_SC_NPROCESSORS_ONLN);
-#endif
-        cpu_num = cpus > 0 ? cpus : 1;
+    if (simd_level == simd_auto) {
+        pixmap_scale_simd(simd_auto);
     }
 
-    // get number of background rendering threads: 1 thread per 100,000 px
-    const size_t max_threads = width * height / 100000;
-    const size_t bthreads = clamp(cpu_num - 1, 0, max_threads);
-
     if (scaler == aa_nearest) {
-        pixmap_scale_nn(bthreads, src, dst, x, y, scale, alpha);
+        pixmap_scale_nn(src, dst, x, y, scale, alpha);
     } else {
-        pixmap_scale_aa(scaler, bthreads, src, dst, x, y, scale, alpha);
+        pixmap_scale_aa(scaler, src, dst, x, y, scale, alpha);
     }
 }
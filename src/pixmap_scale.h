@@ -16,6 +16,14 @@ enum aa_mode {
     aa_mks13,    ///< Magic Kernel with 2013 Sharp approximation
 };
 
+/** Scaler implementations (instruction set extensions). */
+enum scale_simd {
+    simd_auto,  ///< Use the best instruction set supported by CPU
+    simd_none,  ///< Generic C code
+    simd_sse41, ///< x86 SSE4.1
+    simd_avx2,  ///< x86 AVX2
+};
+
 /**
  * Get anti-aliasing mode from config.
  * @param cfg config instance
@@ -51,3 +59,20 @@ const char* aa_name(enum aa_mode aa);
 void pixmap_scale(enum aa_mode scaler, const struct pixmap* src,
                   struct pixmap* dst, ssize_t x, ssize_t y, double scale,
                   bool alpha);
+
+/**
+ * Downscale pixmap by half with a 2x2 box filter (used to build mipmaps).
+ * @param src source pixmap
+ * @param dst destination pixmap to create, odd sizes are rounded up
+ * @param alpha flag to use alpha channel (ignore otherwise)
+ * @return false if allocation failed
+ */
+bool pixmap_scale_half(const struct pixmap* src, struct pixmap* dst,
+                       bool alpha);
+
+/**
+ * Set scaler implementation, the best one is used by default.
+ * @param simd instruction set to use
+ * @return false if instruction set is not supported by CPU
+ */
+bool pixmap_scale_simd(enum scale_simd simd);
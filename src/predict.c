@@ -0,0 +1,83 @@
+// SPDX-License-Identifier: MIT
+// Navigation predictor: direction and speed of recent movements.
+// Copyright (C) 2025 Artem Senichev <artemsen@gmail.com>
+
+#include "predict.h"
+
+#include <math.h>
+#include <time.h>
+
+// Pause (ms) that starts a new series of movements
+#define IDLE_TIME 1000.0
+// Min interval between movements (ms), shorter ones are merged by the OS
+#define MIN_INTERVAL 10.0
+// Weight of the last movement in the smoothed speed
+#define SMOOTHING 0.5
+// Speed (images per second) at which the whole budget goes ahead
+#define FAST_SPEED 8.0
+// Speed (images per second) at which the user is flying past images
+#define FLY_SPEED 5.0
+
+void predict_reset(struct predict* pr)
+{
+    pr->speed = 0;
+    pr->last = 0;
+}
+
+void predict_move(struct predict* pr, ssize_t distance)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    predict_move_at(pr, distance, ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0);
+}
+
+void predict_move_at(struct predict* pr, ssize_t distance, double now)
+{
+    if (distance == 0) {
+        return;
+    }
+
+    if (pr->last == 0 || now - pr->last > IDLE_TIME) {
+        // first movement of the series: direction is known, speed is not
+        pr->speed = distance > 0 ? 1 : -1;
+    } else {
+        const double interval = fmax(now - pr->last, MIN_INTERVAL);
+        const double speed = distance * 1000.0 / interval;
+        if ((speed > 0) != (pr->speed > 0)) {
+            pr->speed = 0; // direction changed
+        }
+        pr->speed += SMOOTHING * (speed - pr->speed);
+    }
+
+    pr->last = now;
+}
+
+ssize_t predict_direction(const struct predict* pr)
+{
+    if (pr->speed > 0) {
+        return 1;
+    }
+    if (pr->speed < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+void predict_split(const struct predict* pr, size_t* ahead, size_t* behind)
+{
+    const double confidence = fmin(fabs(pr->speed) / FAST_SPEED, 1.0);
+    size_t moved = *behind * confidence;
+
+    if (moved && moved == *behind) {
+        --moved; // the user can step back once
+    }
+
+    *behind -= moved;
+    *ahead += moved;
+}
+
+size_t predict_skip(const struct predict* pr, double decode_ms)
+{
+    const double speed = fabs(pr->speed);
+    return speed < FLY_SPEED ? 0 : speed * decode_ms / 1000.0;
+}
@@ -0,0 +1,61 @@
+// SPDX-License-Identifier: MIT
+// Navigation predictor: direction and speed of recent movements.
+// Copyright (C) 2025 Artem Senichev <artemsen@gmail.com>
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/** Navigation predictor. */
+struct predict {
+    double speed; ///< Smoothed speed in images per second, negative backward
+    double last;  ///< Time of the last movement in milliseconds, 0 if none
+};
+
+/**
+ * Forget previous movements (e.g. after jump to the first image).
+ * @param pr predictor instance
+ */
+void predict_reset(struct predict* pr);
+
+/**
+ * Register movement through the image list.
+ * @param pr predictor instance
+ * @param distance number of images passed, negative for backward movement
+ */
+void predict_move(struct predict* pr, ssize_t distance);
+
+/**
+ * Register movement through the image list at the specified time.
+ * @param pr predictor instance
+ * @param distance number of images passed, negative for backward movement
+ * @param now monotonic time of the movement in milliseconds
+ */
+void predict_move_at(struct predict* pr, ssize_t distance, double now);
+
+/**
+ * Get direction of the movement.
+ * @param pr predictor instance
+ * @return 1 for forward, -1 for backward, 0 if unknown
+ */
+ssize_t predict_direction(const struct predict* pr);
+
+/**
+ * Move part of the preload budget from behind to ahead of the current image
+ * in proportion to the speed, the nearest image behind is always kept.
+ * @param pr predictor instance
+ * @param ahead,behind in/out: number of images to preload in the direction
+ *        of travel and in the opposite one
+ */
+void predict_split(const struct predict* pr, size_t* ahead, size_t* behind);
+
+/**
+ * Get number of the nearest images ahead the user will likely pass before
+ * they are decoded.
+ * @param pr predictor instance
+ * @param decode_ms expected decoding time of single image in milliseconds
+ * @return number of images to skip
+ */
+size_t predict_skip(const struct predict* pr, double decode_ms);
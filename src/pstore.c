@@ -0,0 +1,567 @@
+// SPDX-License-Identifier: MIT
+// Persistent storage for thumbnails: single packed database file.
+// Copyright (C) 2025 Artem Senichev <artemsen@gmail.com>
+
+#include "pstore.h"
+
+#include "array.h"
+#include "atlas.h"
+#include "formats/qoi.h"
+#include "fs.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Initial capacity of the index (must be a power of 2)
+#define INDEX_MIN_SIZE 256
+
+// Storage file header
+static const uint8_t file_magic[] = { 'S', 'W', 'I', 'M', 'G', 'T', 'H', '2' };
+// Record signature
+#define RECORD_MAGIC 0x52474d49 // "IMGR"
+// Max number of attempts to open the file replaced by another instance
+#define OPEN_ATTEMPTS 3
+
+/** Record header, followed by source path and QOI encoded thumbnail. */
+struct __attribute__((__packed__)) record {
+    uint32_t magic;    ///< Record signature
+    uint32_t params;   ///< Thumbnail parameters
+    int64_t mtime;     ///< Modification time of the source file
+    uint64_t fsize;    ///< Size of the source file
+    uint32_t path_len; ///< Length of the source path
+    uint32_t data_len; ///< Size of the encoded thumbnail
+    uint32_t checksum; ///< Checksum of the path and thumbnail data
+    uint16_t width;    ///< Thumbnail width
+    uint16_t height;   ///< Thumbnail height
+    uint32_t alpha;    ///< Thumbnail has alpha channel
+};
+
+/** Index entry: location of the latest record for the key. */
+struct index_entry {
+    size_t hash;   ///< Hash of the key (source path and parameters)
+    size_t offset; ///< Offset of the record in the file, 0 for empty slot
+};
+
+/** Thumbnail storage context. */
+struct pstore {
+    char* path; ///< Path to the storage file
+    int fd;     ///< Storage file descriptor
+
+    const uint8_t* map; ///< Memory mapped file content at the open time
+    size_t map_size;    ///< Size of mapped data
+    size_t end;         ///< Current end of the file, position to append
+    size_t stale;       ///< Total size of replaced (stale) records
+
+    uint32_t params; ///< Current thumbnail parameters
+
+    struct index_entry* index; ///< Index of records (open addressing)
+    size_t index_size;         ///< Capacity of the index, power of 2
+    size_t index_num;          ///< Number of entries in the index
+
+    pthread_mutex_t lock; ///< Storage access lock
+};
+
+/** Global storage context. */
+static struct pstore ctx = {
+    .fd = -1,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/**
+ * Compute hash of the record key.
+ * @param path source path
+ * @param len length of the path
+ * @param params thumbnail parameters
+ * @return hash value
+ */
+static size_t key_hash(const char* path, size_t len, uint32_t params)
+{
+    return str_hash(&params, sizeof(params),
+                    str_hash(path, len, STR_HASH_INIT));
+}
+
+/**
+ * Compute checksum of the record payload (source path and thumbnail data).
+ * @param rec record header followed by the payload
+ * @return checksum value
+ */
+static inline uint32_t record_checksum(const struct record* rec)
+{
+    return str_hash(rec + 1, rec->path_len + rec->data_len, STR_HASH_INIT);
+}
+
+/**
+ * Get full size of the record.
+ * @param rec record header
+ * @return size of the record in bytes
+ */
+static inline size_t record_size(const struct record* rec)
+{
+    return sizeof(*rec) + rec->path_len + rec->data_len;
+}
+
+/**
+ * Get record from the storage file.
+ * @param offset offset of the record in the file
+ * @param buffer output: allocated buffer for unmapped record, caller must free
+ * @return pointer to the record or NULL on errors
+ */
+static const struct record* get_record(size_t offset, uint8_t** buffer)
+{
+    struct record hdr;
+    size_t size;
+
+    *buffer = NULL;
+
+    // records existed on open are accessible directly from mapped memory
+    if (offset + sizeof(hdr) <= ctx.map_size) {
+        const struct record* rec = (const struct record*)(ctx.map + offset);
+        if (offset + record_size(rec) <= ctx.map_size) {
+            return rec;
+        }
+    }
+
+    if (pread(ctx.fd, &hdr, sizeof(hdr), offset) != (ssize_t)sizeof(hdr)) {
+        return NULL;
+    }
+    size = record_size(&hdr);
+    *buffer = malloc(size);
+    if (!*buffer) {
+        return NULL;
+    }
+    if (pread(ctx.fd, *buffer, size, offset) != (ssize_t)size) {
+        free(*buffer);
+        *buffer = NULL;
+        return NULL;
+    }
+
+    return (const struct record*)*buffer;
+}
+
+/**
+ * Check if the record matches the key.
+ * @param offset offset of the record in the file
+ * @param path source path
+ * @param len length of the path
+ * @param params thumbnail parameters
+ * @return true if record has the same key
+ */
+static bool record_match(size_t offset, const char* path, size_t len,
+                         uint32_t params)
+{
+    uint8_t* buffer;
+    const struct record* rec = get_record(offset, &buffer);
+    const bool match = rec && rec->params == params && rec->path_len == len &&
+        memcmp(rec + 1, path, len) == 0;
+    free(buffer);
+    return match;
+}
+
+/**
+ * Get index slot for the key.
+ * @param hash hash of the key
+ * @param path source path
+ * @param len length of the path
+ * @param params thumbnail parameters
+ * @return pointer to the slot with the record or to the empty slot
+ */
+static struct index_entry* index_slot(size_t hash, const char* path,
+                                      size_t len, uint32_t params)
+{
+    const size_t mask = ctx.index_size - 1;
+    size_t pos = hash & mask;
+
+    while (ctx.index[pos].offset &&
+           (ctx.index[pos].hash != hash ||
+            !record_match(ctx.index[pos].offset, path, len, params))) {
+        pos = (pos + 1) & mask;
+    }
+
+    return &ctx.index[pos];
+}
+
+/**
+ * Put record to the index, the previous record with the same key is replaced.
+ * @param offset offset of the record in the file
+ * @param rec record header
+ * @param path source path
+ * @return false if not enough memory
+ */
+static bool index_put(size_t offset, const struct record* rec,
+                      const char* path)
+{
+    const size_t hash = key_hash(path, rec->path_len, rec->params);
+    struct index_entry* entry;
+
+    // keep load factor under 0.5
+    if ((ctx.index_num + 1) * 2 > ctx.index_size) {
+        const size_t size =
+            ctx.index_size ? ctx.index_size * 2 : INDEX_MIN_SIZE;
+        struct index_entry* index = calloc(size, sizeof(*index));
+        struct index_entry* old = ctx.index;
+        const size_t old_size = ctx.index_size;
+        if (!index) {
+            return false;
+        }
+        ctx.index = index;
+        ctx.index_size = size;
+        for (size_t i = 0; i < old_size; ++i) {
+            if (old[i].offset) {
+                size_t pos = old[i].hash & (size - 1);
+                while (index[pos].offset) {
+                    pos = (pos + 1) & (size - 1);
+                }
+                index[pos] = old[i];
+            }
+        }
+        free(old);
+    }
+
+    entry = index_slot(hash, path, rec->path_len, rec->params);
+    if (entry->offset) {
+        uint8_t* buffer;
+        const struct record* prev = get_record(entry->offset, &buffer);
+        if (prev) {
+            ctx.stale += record_size(prev);
+        }
+        free(buffer);
+    } else {
+        ++ctx.index_num;
+    }
+    entry->hash = hash;
+    entry->offset = offset;
+
+    return true;
+}
+
+/**
+ * Load records from the storage file to the index.
+ * @param size size of the file
+ * @return size of valid data, the rest of the file is broken
+ */
+static size_t load_index(size_t size)
+{
+    size_t offset = sizeof(file_magic);
+
+    while (offset + sizeof(struct record) <= size) {
+        const struct record* rec = (const struct record*)(ctx.map + offset);
+        if (rec->magic != RECORD_MAGIC || rec->path_len == 0 ||
+            rec->path_len >= PATH_MAX || record_size(rec) > size - offset ||
+            rec->checksum != record_checksum(rec)) {
+            break; // interrupted write or corrupted data
+        }
+        if (!index_put(offset, rec, (const char*)(rec + 1))) {
+            break;
+        }
+        offset += record_size(rec);
+    }
+
+    return offset;
+}
+
+/**
+ * Check if the opened file is still the storage file, another instance
+ * could replace it on compaction.
+ * @return true if the file descriptor refers to the storage file
+ */
+static bool is_current(void)
+{
+    struct stat st_path, st_fd;
+    return stat(ctx.path, &st_path) == 0 && fstat(ctx.fd, &st_fd) == 0 &&
+        st_path.st_dev == st_fd.st_dev && st_path.st_ino == st_fd.st_ino;
+}
+
+/**
+ * Map the storage file and load its index, file must be locked.
+ * @return false if file can not be used
+ */
+static bool load_file(void)
+{
+    uint8_t magic[sizeof(file_magic)];
+    struct stat st;
+    size_t size;
+
+    if (fstat(ctx.fd, &st) == -1) {
+        return false;
+    }
+    size = st.st_size;
+
+    // recreate the file if it has unknown format
+    if (size < sizeof(file_magic) ||
+        pread(ctx.fd, magic, sizeof(magic), 0) != (ssize_t)sizeof(magic) ||
+        memcmp(magic, file_magic, sizeof(file_magic)) != 0) {
+        if (ftruncate(ctx.fd, 0) == -1 ||
+            pwrite(ctx.fd, file_magic, sizeof(file_magic), 0) !=
+                (ssize_t)sizeof(file_magic)) {
+            return false;
+        }
+        size = sizeof(file_magic);
+    }
+
+    if (size > sizeof(file_magic)) {
+        void* map = mmap(NULL, size, PROT_READ, MAP_SHARED, ctx.fd, 0);
+        if (map != MAP_FAILED) {
+            ctx.map = map;
+            ctx.map_size = size;
+        }
+    }
+
+    ctx.end = ctx.map ? load_index(size) : sizeof(file_magic);
+    if (ctx.end != size && ftruncate(ctx.fd, ctx.end) == -1) {
+        return false;
+    }
+    if (ctx.map_size > ctx.end) {
+        ctx.map_size = ctx.end; // broken tail is cut off
+    }
+
+    return true;
+}
+
+/**
+ * Unmap the storage file and reset the index.
+ */
+static void unload_file(void)
+{
+    if (ctx.map) {
+        munmap((void*)ctx.map, ctx.map_size);
+        ctx.map = NULL;
+        ctx.map_size = 0;
+    }
+    free(ctx.index);
+    ctx.index = NULL;
+    ctx.index_size = 0;
+    ctx.index_num = 0;
+    ctx.end = 0;
+    ctx.stale = 0;
+}
+
+/**
+ * Rewrite storage file with actual records only.
+ * The file is shared between instances, so compaction is skipped if some
+ * other instance is working with it, and the index is reloaded from the file
+ * before rewriting to keep records appended by others.
+ */
+static void compact(void)
+{
+    const size_t len = strlen(ctx.path);
+    char tmp[PATH_MAX];
+    bool success;
+    int fd;
+
+    if (len + 5 >= sizeof(tmp) || flock(ctx.fd, LOCK_EX | LOCK_NB) == -1) {
+        return;
+    }
+    if (!is_current()) {
+        flock(ctx.fd, LOCK_UN);
+        return;
+    }
+
+    unload_file();
+    if (!load_file() || ctx.stale * 4 <= ctx.end) {
+        flock(ctx.fd, LOCK_UN);
+        return;
+    }
+
+    memcpy(tmp, ctx.path, len);
+    memcpy(tmp + len, ".tmp", 5);
+
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+        flock(ctx.fd, LOCK_UN);
+        return;
+    }
+
+    success = write(fd, file_magic, sizeof(file_magic)) ==
+        (ssize_t)sizeof(file_magic);
+    for (size_t i = 0; success && i < ctx.index_size; ++i) {
+        if (ctx.index[i].offset) {
+            uint8_t* buffer;
+            const struct record* rec = get_record(ctx.index[i].offset, &buffer);
+            const size_t size = rec ? record_size(rec) : 0;
+            success = rec && write(fd, rec, size) == (ssize_t)size;
+            free(buffer);
+        }
+    }
+
+    close(fd);
+
+    // replace the file while it is locked: writers check that their
+    // descriptor still refers to the storage file after taking the lock
+    if (!success || rename(tmp, ctx.path) == -1) {
+        unlink(tmp);
+    }
+
+    flock(ctx.fd, LOCK_UN);
+}
+
+bool pstore_open(const char* path, uint32_t params)
+{
+    const size_t len = strlen(path) + 1;
+
+    pstore_close();
+
+    if (!fs_mkdirs(path, S_IRWXU | S_IRWXG)) {
+        return false;
+    }
+    ctx.path = malloc(len);
+    if (!ctx.path) {
+        return false;
+    }
+    memcpy(ctx.path, path, len);
+    ctx.params = params;
+
+    for (size_t i = 0; i < OPEN_ATTEMPTS; ++i) {
+        bool success;
+
+        ctx.fd = open(path, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+        if (ctx.fd == -1 || flock(ctx.fd, LOCK_EX) == -1) {
+            break;
+        }
+        if (!is_current()) {
+            // replaced by another instance between open and lock
+            close(ctx.fd);
+            ctx.fd = -1;
+            continue;
+        }
+        success = load_file();
+        flock(ctx.fd, LOCK_UN);
+        if (success) {
+            return true;
+        }
+        break;
+    }
+
+    pstore_close();
+    return false;
+}
+
+void pstore_close(void)
+{
+    if (ctx.fd != -1) {
+        // compact the file if more than 1/4 of it is occupied by stale data
+        if (ctx.stale && ctx.stale * 4 > ctx.end) {
+            compact();
+        }
+        close(ctx.fd);
+        ctx.fd = -1;
+    }
+
+    unload_file();
+    free(ctx.path);
+    ctx.path = NULL;
+}
+
+bool pstore_load(struct image* img)
+{
+    const size_t len = strlen(img->source);
+    const size_t hash = key_hash(img->source, len, ctx.params);
+    const struct record* rec = NULL;
+    uint8_t* buffer = NULL;
+    struct stat st;
+
+    if (ctx.fd == -1 || stat(img->source, &st) == -1) {
+        return false;
+    }
+
+    pthread_mutex_lock(&ctx.lock);
+    if (ctx.index) {
+        const struct index_entry* entry =
+            index_slot(hash, img->source, len, ctx.params);
+        if (entry->offset) {
+            rec = get_record(entry->offset, &buffer);
+        }
+    }
+    pthread_mutex_unlock(&ctx.lock);
+
+    // mapped data is not changed until the storage is closed,
+    // thumbnail is decoded directly to its place in the atlas
+    if (rec && rec->mtime == st.st_mtim.tv_sec &&
+        rec->fsize == (uint64_t)st.st_size &&
+        atlas_alloc(&img->thumbnail, rec->width, rec->height)) {
+        const uint8_t* data = (const uint8_t*)(rec + 1) + rec->path_len;
+        if (decode_qoi_pixmap(data, rec->data_len, &img->thumbnail)) {
+            img->alpha = rec->alpha;
+        } else {
+            atlas_free(&img->thumbnail);
+        }
+    }
+    free(buffer);
+
+    return image_has_thumb(img);
+}
+
+bool pstore_save(const struct image* img)
+{
+    const size_t len = strlen(img->source);
+    struct record* rec;
+    uint8_t* qoi;
+    size_t qoi_size;
+    size_t size;
+    struct stat st;
+    bool success = false;
+
+    if (ctx.fd == -1 || !image_has_thumb(img) || len >= PATH_MAX ||
+        img->thumbnail.width > UINT16_MAX ||
+        img->thumbnail.height > UINT16_MAX ||
+        stat(img->source, &st) == -1 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+
+    qoi = encode_qoi(&img->thumbnail, img->alpha, &qoi_size);
+    if (!qoi) {
+        return false;
+    }
+
+    size = sizeof(*rec) + len + qoi_size;
+    rec = malloc(size);
+    if (!rec) {
+        free(qoi);
+        return false;
+    }
+    rec->magic = RECORD_MAGIC;
+    rec->params = ctx.params;
+    rec->mtime = st.st_mtim.tv_sec;
+    rec->fsize = st.st_size;
+    rec->path_len = len;
+    rec->data_len = qoi_size;
+    rec->width = img->thumbnail.width;
+    rec->height = img->thumbnail.height;
+    rec->alpha = img->alpha;
+    memcpy(rec + 1, img->source, len);
+    memcpy((uint8_t*)(rec + 1) + len, qoi, qoi_size);
+    rec->checksum = record_checksum(rec);
+    free(qoi);
+
+    // append record to the end of file, other instances can append too
+    pthread_mutex_lock(&ctx.lock);
+    if (flock(ctx.fd, LOCK_EX) == 0) {
+        if (is_current()) {
+            const off_t end = lseek(ctx.fd, 0, SEEK_END);
+            if (end != -1) {
+                success = pwrite(ctx.fd, rec, size, end) == (ssize_t)size;
+                if (success) {
+                    success = index_put(end, rec, img->source);
+                    ctx.end = end + size;
+                } else if (ftruncate(ctx.fd, end) == -1) {
+                    // partially written record stays in the file,
+                    // it will be cut off with all next ones on open
+                }
+            }
+        }
+        flock(ctx.fd, LOCK_UN);
+    }
+    pthread_mutex_unlock(&ctx.lock);
+
+    free(rec);
+
+    return success;
+}
@@ -0,0 +1,34 @@
+// SPDX-License-Identifier: MIT
+// Persistent storage for thumbnails: single packed database file.
+// Copyright (C) 2025 Artem Senichev <artemsen@gmail.com>
+
+#pragma once
+
+#include "image.h"
+
+/**
+ * Open thumbnail storage, the file is created if it doesn't exist.
+ * @param path path to the storage file
+ * @param params thumbnail parameters (size, scale and aa modes), part of key
+ * @return true if storage opened
+ */
+bool pstore_open(const char* path, uint32_t params);
+
+/**
+ * Close thumbnail storage, compact the file if it has too many stale records.
+ */
+void pstore_close(void);
+
+/**
+ * Load thumbnail from the storage.
+ * @param img image for loading thumbnail
+ * @return true if thumbnail loaded
+ */
+bool pstore_load(struct image* img);
+
+/**
+ * Save thumbnail to the storage.
+ * @param img image with thumbnail to save
+ * @return true if thumbnail saved
+ */
+bool pstore_save(const struct image* img);
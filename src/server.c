@@ -0,0 +1,381 @@
+// SPDX-License-Identifier: MIT
+// Resident mode: open images in the already running instance.
+// Copyright (C) 2025 Artem Senichev <artemsen@gmail.com>
+
+#include "server.h"
+
+#include "application.h"
+#include "buildcfg.h"
+#include "fs.h"
+#include "image.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Max size of the request
+#define MAX_REQUEST (1024 * 1024)
+// Timeout for receiving the whole request (seconds)
+#define READ_TIMEOUT 1
+// Timeout for waiting the reply, includes loading the first image (seconds)
+#define REPLY_TIMEOUT 10
+
+// Reply codes
+#define REPLY_FAIL    '0'
+#define REPLY_SUCCESS '1'
+
+// Request options, the request starts with a string of them followed by
+// the list of null-terminated sources
+#define OPT_RECURSIVE 'r'
+#define OPT_FROMFILE  'F'
+
+/** Server context. */
+struct server {
+    struct sockaddr_un addr; ///< Control socket address
+    int fd;                  ///< Listening socket descriptor
+    bool active;             ///< Server is listening
+};
+
+/** Connected client. */
+struct client {
+    int fd;          ///< Client socket descriptor
+    int timer;       ///< Timer to limit the request time
+    char* data;      ///< Request data
+    size_t size;     ///< Number of received bytes
+    size_t capacity; ///< Size of the request buffer
+};
+
+static struct server ctx;
+
+/**
+ * Compose control socket address.
+ * The socket is bound to the Wayland display, so each session has its own.
+ * @param addr output address
+ * @return true if address is valid
+ */
+static bool socket_addr(struct sockaddr_un* addr)
+{
+    const char* runtime = getenv("XDG_RUNTIME_DIR");
+    const char* display = getenv("WAYLAND_DISPLAY");
+    int len;
+
+    if (!runtime || !*runtime) {
+        return false;
+    }
+    if (!display || !*display || strchr(display, '/')) {
+        display = "wayland-0";
+    }
+
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    len = snprintf(addr->sun_path, sizeof(addr->sun_path), "%s/%s-%s.sock",
+                   runtime, APP_NAME, display);
+
+    return len > 0 && (size_t)len < sizeof(addr->sun_path);
+}
+
+/**
+ * Set socket timeout for both reading and writing.
+ * @param fd socket descriptor
+ * @param seconds timeout in seconds
+ */
+static void set_timeout(int fd, time_t seconds)
+{
+    const struct timeval tv = { .tv_sec = seconds };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+/**
+ * Free client context and close its descriptors.
+ * @param cl client context
+ */
+static void client_free(struct client* cl)
+{
+    app_unwatch(cl->fd);
+    close(cl->fd);
+    if (cl->timer != -1) {
+        app_unwatch(cl->timer);
+        close(cl->timer);
+    }
+    free(cl->data);
+    free(cl);
+}
+
+/**
+ * Handle complete request from the client.
+ * @param cl client context
+ */
+static void handle_request(struct client* cl)
+{
+    char reply = REPLY_FAIL;
+    const char** sources = NULL;
+    const char* opts = cl->data;
+    size_t num = 0;
+
+    if (cl->size == 0) {
+        return; // connection check, e.g. by another instance on start
+    }
+    if (cl->data[cl->size - 1] != 0) {
+        fprintf(stderr, "Invalid request from client\n");
+        return;
+    }
+
+    // split request to the options and the list of sources
+    for (size_t i = 0; i < cl->size; ++i) {
+        num += (cl->data[i] == 0);
+    }
+    --num; // options
+    sources = malloc(num * sizeof(*sources));
+    if (num && sources) {
+        const char* ptr = opts + strlen(opts) + 1;
+        for (size_t i = 0; i < num; ++i) {
+            sources[i] = ptr;
+            ptr += strlen(ptr) + 1;
+        }
+        if (app_open(sources, num, strchr(opts, OPT_RECURSIVE) != NULL,
+                     strchr(opts, OPT_FROMFILE) != NULL)) {
+            reply = REPLY_SUCCESS;
+        }
+    }
+    free(sources);
+
+    fs_write(cl->fd, &reply, sizeof(reply));
+}
+
+/** Client socket handler: read the next part of the request. */
+static void on_client_data(void* data)
+{
+    struct client* cl = data;
+
+    while (true) {
+        ssize_t rcv;
+        if (cl->size == cl->capacity) {
+            const size_t capacity = cl->capacity ? cl->capacity * 2 : PATH_MAX;
+            char* buf = capacity <= MAX_REQUEST ? realloc(cl->data, capacity)
+                                                : NULL;
+            if (!buf) {
+                fprintf(stderr, "Request from client is too big\n");
+                client_free(cl);
+                return;
+            }
+            cl->data = buf;
+            cl->capacity = capacity;
+        }
+        rcv = recv(cl->fd, cl->data + cl->size, cl->capacity - cl->size, 0);
+        if (rcv == 0) {
+            // end of request
+            handle_request(cl);
+            client_free(cl);
+            return;
+        }
+        if (rcv == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                client_free(cl);
+            }
+            return; // wait for the rest of data
+        }
+        cl->size += rcv;
+    }
+}
+
+/** Client timer handler: request was not received in time. */
+static void on_client_timeout(void* data)
+{
+    fprintf(stderr, "Request timeout\n");
+    client_free(data);
+}
+
+/** Control socket handler: accept new client. */
+static void on_connect(__attribute__((unused)) void* data)
+{
+    const struct itimerspec ts = { .it_value.tv_sec = READ_TIMEOUT };
+    struct client* cl;
+    int fd;
+
+    fd = accept(ctx.fd, NULL, NULL);
+    if (fd == -1) {
+        return;
+    }
+
+    // the request is assembled in the main loop, it must not be blocked
+    // by slow clients
+    cl = calloc(1, sizeof(*cl));
+    if (!cl || fcntl(fd, F_SETFD, FD_CLOEXEC) == -1 ||
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) == -1) {
+        free(cl);
+        close(fd);
+        return;
+    }
+    cl->fd = fd;
+    cl->timer = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (cl->timer == -1 || timerfd_settime(cl->timer, 0, &ts, NULL) == -1) {
+        client_free(cl);
+        return;
+    }
+
+    app_watch(cl->fd, on_client_data, cl);
+    app_watch(cl->timer, on_client_timeout, cl);
+}
+
+/**
+ * Connect to the control socket.
+ * @param addr socket address
+ * @return connected socket descriptor or -1 if there is no server
+ */
+static int connect_server(const struct sockaddr_un* addr)
+{
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd != -1 &&
+        connect(fd, (const struct sockaddr*)addr, sizeof(*addr)) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool server_send(const char* const* sources, size_t num,
+                 const struct config* cfg, bool window_opts, bool* success)
+{
+    struct sockaddr_un addr;
+    char reply = REPLY_FAIL;
+    char opts[3] = { 0 };
+    size_t opts_len = 0;
+    bool rc;
+    int fd;
+
+    if (!socket_addr(&addr)) {
+        return false;
+    }
+
+    // stdin can't be passed to another process
+    for (size_t i = 0; i < num; ++i) {
+        if (strcmp(sources[i], "-") == 0 ||
+            strncmp(sources[i], LDRSRC_STDIN, LDRSRC_STDIN_LEN) == 0) {
+            return false;
+        }
+    }
+
+    fd = connect_server(&addr);
+    if (fd == -1) {
+        return false;
+    }
+
+    // only list options are applied to the sources by the running instance
+    if (window_opts) {
+        fprintf(stderr, "Options of the new window are not supported by "
+                        "running instance, only -r and -F are allowed\n");
+        close(fd);
+        *success = false;
+        return true;
+    }
+    if (config_get_bool(cfg, CFG_LIST, CFG_LIST_RECURSIVE)) {
+        opts[opts_len++] = OPT_RECURSIVE;
+    }
+    if (config_get_bool(cfg, CFG_LIST, CFG_LIST_FROMFILE)) {
+        opts[opts_len++] = OPT_FROMFILE;
+    }
+
+    set_timeout(fd, REPLY_TIMEOUT);
+    rc = fs_write(fd, opts, opts_len + 1);
+
+    // send sources with absolute paths, the server has its own working dir
+    for (size_t i = 0; rc && i < (num ? num : 1); ++i) {
+        const char* src = num ? sources[i] : ".";
+        char path[PATH_MAX];
+        if (strncmp(src, LDRSRC_EXEC, LDRSRC_EXEC_LEN) != 0) {
+            if (!fs_abspath(src, path, sizeof(path))) {
+                fprintf(stderr, "Ignore file %s: unknown absolute path\n", src);
+                continue;
+            }
+            src = path;
+        }
+        rc = fs_write(fd, src, strlen(src) + 1);
+    }
+    shutdown(fd, SHUT_WR);
+
+    // wait for result of opening
+    if (rc) {
+        ssize_t rcv;
+        do {
+            rcv = recv(fd, &reply, sizeof(reply), 0);
+        } while (rcv == -1 && errno == EINTR);
+        rc = (rcv == sizeof(reply));
+    }
+    close(fd);
+
+    if (!rc) {
+        fprintf(stderr, "No response from running instance\n");
+    } else if (reply != REPLY_SUCCESS) {
+        fprintf(stderr, "Running instance failed to open images\n");
+    }
+
+    *success = (reply == REPLY_SUCCESS);
+
+    return true;
+}
+
+void server_init(void)
+{
+    bool bound;
+
+    if (!socket_addr(&ctx.addr)) {
+        fprintf(stderr, "Server mode is not available: no XDG_RUNTIME_DIR\n");
+        return;
+    }
+
+    ctx.fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (ctx.fd == -1) {
+        const int ec = errno;
+        fprintf(stderr, "Failed to create control socket: [%i] %s\n", ec,
+                strerror(ec));
+        return;
+    }
+
+    bound = bind(ctx.fd, (struct sockaddr*)&ctx.addr, sizeof(ctx.addr)) == 0;
+    if (!bound && errno == EADDRINUSE) {
+        const int client = connect_server(&ctx.addr);
+        if (client == -1) {
+            // remove stale socket left by crashed instance
+            unlink(ctx.addr.sun_path);
+            bound = bind(ctx.fd, (struct sockaddr*)&ctx.addr,
+                         sizeof(ctx.addr)) == 0;
+        } else {
+            close(client); // another instance is already running
+            errno = EADDRINUSE;
+        }
+    }
+    if (!bound || listen(ctx.fd, SOMAXCONN) == -1) {
+        const int ec = errno;
+        fprintf(stderr, "Failed to listen control socket %s: [%i] %s\n",
+                ctx.addr.sun_path, ec, strerror(ec));
+        if (bound) {
+            unlink(ctx.addr.sun_path);
+        }
+        close(ctx.fd);
+        return;
+    }
+
+    ctx.active = true;
+    app_watch(ctx.fd, on_connect, NULL);
+}
+
+void server_destroy(void)
+{
+    // the socket itself is closed by application with other watched fds
+    if (ctx.active) {
+        unlink(ctx.addr.sun_path);
+        ctx.active = false;
+    }
+}
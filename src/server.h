@@ -0,0 +1,35 @@
+// SPDX-License-Identifier: MIT
+// Resident mode: open images in the already running instance.
+// Copyright (C) 2025 Artem Senichev <artemsen@gmail.com>
+
+#pragma once
+
+#include "config.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Pass sources to the running instance (client side).
+ * List options (recursive, from file) are passed with the request, the
+ * request is rejected if options of the new window are specified.
+ * @param sources list of sources
+ * @param num number of sources in the list
+ * @param cfg configuration of the client
+ * @param window_opts options of the new window are specified
+ * @param success out: result of opening sources by the running instance
+ * @return true if the request was handled by the running instance, false if
+ *         there is no one and the sources must be opened locally
+ */
+bool server_send(const char* const* sources, size_t num,
+                 const struct config* cfg, bool window_opts, bool* success);
+
+/**
+ * Start listening for requests from other instances (server side).
+ */
+void server_init(void);
+
+/**
+ * Stop listening and remove the control socket.
+ */
+void server_destroy(void);
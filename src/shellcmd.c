@@ -24,11 +24,22 @@ static int read_stdout(int fd, uint8_t** out, size_t* sz)
 {
     int rc = 0;
     ssize_t read_sz;
-    uint8_t buf[4096];
+    size_t capacity = 0;
     uint8_t* tmp;
 
     while (!rc) {
-        read_sz = read(fd, buf, sizeof(buf));
+        // grow buffer geometrically
+        if (*sz == capacity) {
+            capacity = capacity ? capacity * 2 : 4096;
+            tmp = realloc(*out, capacity);
+            if (!tmp) {
+                rc = ENOMEM;
+                break;
+            }
+            *out = tmp;
+        }
+
+        read_sz = read(fd, *out + *sz, capacity - *sz);
         if (read_sz == 0) {
             break;
         }
@@ -41,18 +52,10 @@ static int read_stdout(int fd, uint8_t** out, size_t* sz)
             }
         }
 
-        tmp = realloc(*out, *sz + read_sz);
-        if (!tmp) {
-            rc = ENOMEM;
-            break;
-        }
-        memcpy(tmp + *sz, buf, read_sz);
-
         *sz += read_sz;
-        *out = tmp;
     }
 
-    if (rc && *sz) {
+    if (rc || !*sz) {
         free(*out);
         *out = NULL;
         *sz = 0;
@@ -97,32 +100,51 @@ static int execute(const char* cmd, int in_fd, int out_fd)
 
 int shellcmd_exec(const char* cmd, uint8_t** out, size_t* sz)
 {
-    int rc;
-    int pfd[2];
     pid_t pid;
+    const int fd = shellcmd_start(cmd, &pid);
 
-    if (pipe(pfd) == -1) {
+    if (fd == -1) {
         return errno;
     }
 
-    pid = fork();
-    if (pid == -1) {
-        rc = errno;
+    read_stdout(fd, out, sz);
+
+    return shellcmd_finish(fd, pid);
+}
+
+int shellcmd_start(const char* cmd, pid_t* pid)
+{
+    int pfd[2];
+
+    if (pipe(pfd) == -1) {
+        return -1;
+    }
+
+    *pid = fork();
+    if (*pid == -1) {
+        const int rc = errno;
         close(pfd[0]);
         close(pfd[1]);
-        return rc;
+        errno = rc;
+        return -1;
     }
 
-    if (pid == 0) {
+    if (*pid == 0) {
         // child process
-        rc = execute(cmd, pfd[0], pfd[1]);
-        exit(rc);
+        exit(execute(cmd, pfd[0], pfd[1]));
     }
 
     // parent process handling
     close(pfd[1]);
-    read_stdout(pfd[0], out, sz);
-    close(pfd[0]);
+
+    return pfd[0];
+}
+
+int shellcmd_finish(int fd, pid_t pid)
+{
+    int rc;
+
+    close(fd);
 
     if (waitpid(pid, &rc, 0) == -1) {
         return errno;
@@ -6,6 +6,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <sys/types.h>
 
 /**
  * Execute command in shell.
@@ -16,6 +17,23 @@
  */
 int shellcmd_exec(const char* cmd, uint8_t** out, size_t* sz);
 
+/**
+ * Start command in shell, its stdout is available for reading while the
+ * command is running.
+ * @param cmd command to execute
+ * @param pid output: child process id
+ * @return file descriptor to read stdout or -1 on errors
+ */
+int shellcmd_start(const char* cmd, pid_t* pid);
+
+/**
+ * Close stdout of the command started by shellcmd_start and wait for exit.
+ * @param fd stdout file descriptor
+ * @param pid child process id
+ * @return subprocess exit code
+ */
+int shellcmd_finish(int fd, pid_t pid);
+
 /**
  * Construct command from expression and execute it in shell.
  * @param expr command expression
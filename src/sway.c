@@ -17,7 +17,7 @@
 static const uint8_t ipc_magic[] = { 'i', '3', '-', 'i', 'p', 'c' };
 
 /** IPC message types (used only) */
-enum ipc_msg_type { IPC_COMMAND = 0, IPC_GET_WORKSPACES = 1, IPC_GET_TREE = 4 };
+enum ipc_msg_type { IPC_COMMAND = 0, IPC_GET_TREE = 4 };
 
 /** IPC header */
 struct __attribute__((__packed__)) ipc_header {
@@ -199,48 +199,38 @@ static bool read_rect(json_object* node, const char* name, struct wndrect* rect)
 }
 
 /**
- * Get currently focused workspace.
- * @param node parent JSON node
- * @return pointer to focused workspace node or NULL if not found
+ * Check if the node has specified type.
+ * @param node JSON node
+ * @param type expected node type
+ * @return true if node has the specified type
  */
-static struct json_object* current_workspace(json_object* node)
+static bool is_type(json_object* node, const char* type)
 {
-    int idx = json_object_array_length(node);
-    while (--idx >= 0) {
-        struct json_object* focused;
-        struct json_object* wks = json_object_array_get_idx(node, idx);
-        if (json_object_object_get_ex(wks, "focused", &focused) &&
-            json_object_get_boolean(focused)) {
-            return wks;
-        }
-    }
-    return NULL;
+    struct json_object* val;
+    return json_object_object_get_ex(node, "type", &val) &&
+        strcmp(json_object_get_string(val), type) == 0;
 }
 
 /**
- * Get currently focused window node.
+ * Get child node by its id.
  * @param node parent JSON node
- * @return pointer to focused window node or NULL if not found
+ * @param id identifier of the child node
+ * @return pointer to the child node or NULL if not found
  */
-static struct json_object* current_window(json_object* node)
+static struct json_object* child_node(json_object* node, int64_t id)
 {
     static const char* nnames[] = { "nodes", "floating_nodes" };
 
-    struct json_object* focused;
-    if (json_object_object_get_ex(node, "focused", &focused) &&
-        json_object_get_boolean(focused)) {
-        return node;
-    }
-
     for (size_t i = 0; i < sizeof(nnames) / sizeof(nnames[0]); ++i) {
         struct json_object* nodes;
         if (json_object_object_get_ex(node, nnames[i], &nodes)) {
-            int idx = json_object_array_length(nodes);
-            while (--idx >= 0) {
+            const int num = json_object_array_length(nodes);
+            for (int idx = 0; idx < num; ++idx) {
                 struct json_object* sub = json_object_array_get_idx(nodes, idx);
-                struct json_object* focus = current_window(sub);
-                if (focus) {
-                    return focus;
+                struct json_object* val;
+                if (json_object_object_get_ex(sub, "id", &val) &&
+                    json_object_get_int64(val) == id) {
+                    return sub;
                 }
             }
         }
@@ -249,6 +239,39 @@ static struct json_object* current_window(json_object* node)
     return NULL;
 }
 
+/**
+ * Get currently focused window node.
+ * The focus list of each node starts with the id of the focused child, so
+ * only the path from the root to the focused window is visited.
+ * @param node root JSON node
+ * @param wks pointer to store the workspace node of the focused window
+ * @return pointer to focused window node or NULL if not found
+ */
+static struct json_object* current_window(json_object* node,
+                                          json_object** wks)
+{
+    while (node) {
+        struct json_object* val;
+
+        if (is_type(node, "workspace")) {
+            *wks = node;
+        }
+        if (json_object_object_get_ex(node, "focused", &val) &&
+            json_object_get_boolean(val)) {
+            return node;
+        }
+
+        if (!json_object_object_get_ex(node, "focus", &val) ||
+            json_object_array_length(val) == 0) {
+            break;
+        }
+        val = json_object_array_get_idx(val, 0);
+        node = child_node(node, json_object_get_int64(val));
+    }
+
+    return NULL;
+}
+
 int sway_connect(void)
 {
     struct sockaddr_un sa;
@@ -301,12 +324,14 @@ bool sway_current(int ipc, struct wndrect* wnd, int* border, bool* fullscreen)
 {
     bool rc = false;
 
-    // get currently focused window
+    // get currently focused window, the tree contains its workspace too,
+    // so no other requests are needed
     json_object* tree = ipc_message(ipc, IPC_GET_TREE, NULL);
     if (!tree) {
         return false;
     }
-    json_object* cur_wnd = current_window(tree);
+    json_object* cur_wks = NULL;
+    json_object* cur_wnd = current_window(tree, &cur_wks);
     if (!cur_wnd || !read_rect(cur_wnd, "window_rect", wnd)) {
         goto done;
     }
@@ -320,11 +345,6 @@ bool sway_current(int ipc, struct wndrect* wnd, int* border, bool* fullscreen)
     }
 
     // if we are not in the full screen mode - calculate client area offset
-    json_object* workspaces = ipc_message(ipc, IPC_GET_WORKSPACES, NULL);
-    if (!workspaces) {
-        goto done;
-    }
-    json_object* cur_wks = current_workspace(workspaces);
     if (cur_wks) {
         struct wndrect workspace;
         struct wndrect global;
@@ -336,7 +356,6 @@ bool sway_current(int ipc, struct wndrect* wnd, int* border, bool* fullscreen)
             wnd->y += global.y - workspace.y;
         }
     }
-    json_object_put(workspaces);
 
 done:
     json_object_put(tree);
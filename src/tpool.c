@@ -0,0 +1,238 @@
+// SPDX-License-Identifier: MIT
+// Thread pool: persistent background workers for parallel jobs.
+// Copyright (C) 2025 Artem Senichev <artemsen@gmail.com>
+
+#include "tpool.h"
+
+#include "list.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __FreeBSD__
+#include <sys/sysctl.h>
+#endif
+
+// Max number of threads
+#define MAX_THREADS 256
+
+// Number of tasks per thread: split the job into more parts than threads, so
+// the workers that finished first can take the rest of the job
+#define TASKS_PER_THREAD 4
+
+/** Job description. */
+struct tpool_job {
+    struct list list;        ///< Links to prev/next entry in the job queue
+    tpool_task handler;      ///< Task handler
+    void* data;              ///< User data for the handler
+    size_t total;            ///< Total number of tasks
+    size_t next;             ///< Index of the next task to start
+    size_t done;             ///< Number of completed tasks
+    pthread_cond_t complete; ///< Job completion notification
+};
+
+/** Thread pool context. */
+struct tpool {
+    pthread_t* workers;     ///< Background worker threads
+    size_t workers_num;     ///< Number of background workers
+    struct tpool_job* jobs; ///< Queue of jobs with non-started tasks
+    pthread_mutex_t lock;   ///< Job queue lock
+    pthread_cond_t wakeup;  ///< New job notification
+    bool stop;              ///< Stop flag for workers
+};
+
+/** Global thread pool context. */
+static struct tpool ctx = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wakeup = PTHREAD_COND_INITIALIZER,
+};
+
+/**
+ * Get number of active CPUs.
+ * @return number of CPUs
+ */
+static size_t cpu_count(void)
+{
+    int32_t cpus = 0;
+#ifdef __FreeBSD__
+    size_t cpus_len = sizeof(cpus);
+    sysctlbyname("hw.ncpu", &cpus, &cpus_len, NULL, 0);
+#else
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    return cpus > 0 ? cpus : 1;
+}
+
+/**
+ * Take the next task from the job, must be called with the queue locked.
+ * @param job job to take the task from
+ * @return task index
+ */
+static size_t take_task(struct tpool_job* job)
+{
+    const size_t index = job->next++;
+    if (job->next == job->total) {
+        // all tasks started, nothing to take from this job anymore
+        ctx.jobs = list_remove(job);
+    }
+    return index;
+}
+
+/**
+ * Execute the task and mark it as completed, must be called with the queue
+ * locked, the lock is released during task execution.
+ * @param job job to process
+ * @param index task index
+ */
+static void exec_task(struct tpool_job* job, size_t index)
+{
+    pthread_mutex_unlock(&ctx.lock);
+    job->handler(index, job->data);
+    pthread_mutex_lock(&ctx.lock);
+
+    if (++job->done == job->total) {
+        pthread_cond_signal(&job->complete);
+    }
+}
+
+/**
+ * Background worker thread.
+ */
+static void* worker_thread(__attribute__((unused)) void* data)
+{
+    pthread_mutex_lock(&ctx.lock);
+
+    while (!ctx.stop) {
+        if (ctx.jobs) {
+            struct tpool_job* job = ctx.jobs;
+            exec_task(job, take_task(job));
+        } else {
+            pthread_cond_wait(&ctx.wakeup, &ctx.lock);
+        }
+    }
+
+    pthread_mutex_unlock(&ctx.lock);
+
+    return NULL;
+}
+
+void tpool_init(const struct config* cfg)
+{
+    tpool_start(config_get_num(cfg, CFG_GENERAL, CFG_GNRL_THREADS, 0,
+                               MAX_THREADS));
+}
+
+void tpool_destroy(void)
+{
+    pthread_mutex_lock(&ctx.lock);
+    ctx.stop = true;
+    pthread_cond_broadcast(&ctx.wakeup);
+    pthread_mutex_unlock(&ctx.lock);
+
+    for (size_t i = 0; i < ctx.workers_num; ++i) {
+        pthread_join(ctx.workers[i], NULL);
+    }
+
+    free(ctx.workers);
+    ctx.workers = NULL;
+    ctx.workers_num = 0;
+    ctx.stop = false;
+}
+
+void tpool_start(size_t num)
+{
+    size_t workers;
+
+    tpool_destroy();
+
+    if (num == 0) {
+        num = cpu_count();
+    }
+    if (num > MAX_THREADS) {
+        num = MAX_THREADS;
+    }
+
+    // the caller thread is also used for processing, so the pool has one
+    // worker less than requested
+    workers = num - 1;
+    if (workers == 0) {
+        return;
+    }
+
+    ctx.workers = malloc(workers * sizeof(*ctx.workers));
+    if (!ctx.workers) {
+        return;
+    }
+    for (size_t i = 0; i < workers; ++i) {
+        const int rc =
+            pthread_create(&ctx.workers[i], NULL, worker_thread, NULL);
+        if (rc != 0) {
+            fprintf(stderr, "Unable to create worker thread: %s\n",
+                    strerror(rc));
+            break;
+        }
+        ++ctx.workers_num;
+    }
+}
+
+size_t tpool_threads(void)
+{
+    return ctx.workers_num + 1;
+}
+
+size_t tpool_tasks(size_t units)
+{
+    size_t tasks = tpool_threads();
+    if (tasks > 1) {
+        tasks *= TASKS_PER_THREAD;
+    }
+    if (tasks > units) {
+        tasks = units;
+    }
+    return tasks ? tasks : 1;
+}
+
+void tpool_run(size_t total, tpool_task handler, void* data)
+{
+    struct tpool_job job;
+
+    if (total == 0) {
+        return;
+    }
+
+    if (ctx.workers_num == 0 || total == 1) {
+        // nothing to parallelize
+        for (size_t i = 0; i < total; ++i) {
+            handler(i, data);
+        }
+        return;
+    }
+
+    memset(&job, 0, sizeof(job));
+    job.handler = handler;
+    job.data = data;
+    job.total = total;
+    pthread_cond_init(&job.complete, NULL);
+
+    pthread_mutex_lock(&ctx.lock);
+
+    ctx.jobs = list_append(ctx.jobs, &job);
+    pthread_cond_broadcast(&ctx.wakeup);
+
+    // process own job until all tasks are taken
+    while (job.next < job.total) {
+        exec_task(&job, take_task(&job));
+    }
+
+    // wait for tasks that are still being processed by workers
+    while (job.done != job.total) {
+        pthread_cond_wait(&job.complete, &ctx.lock);
+    }
+
+    pthread_mutex_unlock(&ctx.lock);
+
+    pthread_cond_destroy(&job.complete);
+}
@@ -0,0 +1,54 @@
+// SPDX-License-Identifier: MIT
+// Thread pool: persistent background workers for parallel jobs.
+// Copyright (C) 2025 Artem Senichev <artemsen@gmail.com>
+
+#pragma once
+
+#include "config.h"
+
+/**
+ * Task handler: process a single part of the job.
+ * @param index index of the task to process (0 to total-1)
+ * @param data user defined job data
+ */
+typedef void (*tpool_task)(size_t index, void* data);
+
+/**
+ * Initialize global thread pool, start background workers.
+ * @param cfg config instance
+ */
+void tpool_init(const struct config* cfg);
+
+/**
+ * Stop background workers and destroy global thread pool.
+ */
+void tpool_destroy(void);
+
+/**
+ * Start background workers.
+ * @param num number of workers, 0 to use all available CPUs
+ */
+void tpool_start(size_t num);
+
+/**
+ * Get number of threads handling a job (background workers and the caller).
+ * @return total number of threads, at least 1
+ */
+size_t tpool_threads(void);
+
+/**
+ * Get recommended number of tasks to split a job into.
+ * @param units number of work units (e.g. rows) in the job
+ * @return number of tasks, at least 1, no more than number of units
+ */
+size_t tpool_tasks(size_t units);
+
+/**
+ * Execute the job: call the handler for each task index, the caller thread
+ * participates in processing, so the function works without background
+ * workers too. The function returns when all tasks are completed.
+ * @param total total number of tasks in the job
+ * @param handler task handler
+ * @param data user defined job data passed to the handler
+ */
+void tpool_run(size_t total, tpool_task handler, void* data);
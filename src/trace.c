@@ -0,0 +1,183 @@
+// SPDX-License-Identifier: MIT
+// Tracing: time spans of operations written in Chrome trace format.
+// Copyright (C) 2025 Artem Senichev <artemsen@gmail.com>
+
+#include "trace.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/** Tracer context. */
+struct trace {
+    FILE* fd;             ///< Output file
+    bool active;          ///< Tracing is enabled
+    bool first;           ///< No events were written yet
+    bool atfork;          ///< Fork handlers are registered
+    uint64_t origin;      ///< Start time in microseconds
+    pthread_mutex_t lock; ///< Output file lock
+    atomic_size_t tids;   ///< Last assigned thread id
+    pthread_key_t tid;    ///< Thread id in the trace, assigned on first event
+    pthread_once_t once;  ///< Thread id key initialization
+};
+
+static struct trace ctx = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .once = PTHREAD_ONCE_INIT,
+};
+
+/**
+ * Get current monotonic time.
+ * @return time in microseconds
+ */
+static uint64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/** Fork handlers: output file lock can be held by another thread. */
+static void fork_prepare(void)
+{
+    pthread_mutex_lock(&ctx.lock);
+}
+static void fork_parent(void)
+{
+    pthread_mutex_unlock(&ctx.lock);
+}
+static void fork_child(void)
+{
+    // child doesn't trace: its buffered output would duplicate the parent's
+    ctx.active = false;
+    pthread_mutex_unlock(&ctx.lock);
+}
+
+void trace_init(const struct config* cfg)
+{
+    const char* path;
+
+    path = getenv(TRACE_ENV);
+    if (!path || !*path) {
+        path = config_get(cfg, CFG_GENERAL, CFG_GNRL_TRACE);
+        if (strcmp(path, "none") == 0) {
+            return;
+        }
+    }
+
+    ctx.fd = fopen(path, "w");
+    if (!ctx.fd) {
+        fprintf(stderr, "WARNING: Unable to create trace file %s\n", path);
+        return;
+    }
+
+    if (!ctx.atfork) {
+        ctx.atfork =
+            pthread_atfork(fork_prepare, fork_parent, fork_child) == 0;
+    }
+
+    fprintf(ctx.fd, "{\"traceEvents\":[");
+    ctx.first = true;
+    ctx.origin = now_us();
+    ctx.active = true;
+}
+
+void trace_destroy(void)
+{
+    if (ctx.fd) {
+        pthread_mutex_lock(&ctx.lock);
+        ctx.active = false;
+        fprintf(ctx.fd, "\n]}\n");
+        fclose(ctx.fd);
+        ctx.fd = NULL;
+        pthread_mutex_unlock(&ctx.lock);
+    }
+}
+
+struct trace_span trace_begin(const char* name)
+{
+    struct trace_span span = { 0 };
+    if (ctx.active) {
+        span.name = name;
+        span.start = now_us();
+    }
+    return span;
+}
+
+/** Create key of the thread id, called once. */
+static void create_tid_key(void)
+{
+    pthread_key_create(&ctx.tid, NULL);
+}
+
+/**
+ * Get id of the current thread in the trace.
+ * @return thread id
+ */
+static size_t get_thread_id(void)
+{
+    size_t thread_id;
+
+    pthread_once(&ctx.once, create_tid_key);
+
+    thread_id = (size_t)(uintptr_t)pthread_getspecific(ctx.tid);
+    if (!thread_id) {
+        thread_id = ++ctx.tids;
+        pthread_setspecific(ctx.tid, (void*)(uintptr_t)thread_id);
+    }
+    return thread_id;
+}
+
+void trace_end(struct trace_span* span)
+{
+    uint64_t end;
+    size_t tid;
+
+    if (!span->name) {
+        return;
+    }
+
+    end = now_us();
+    tid = get_thread_id();
+
+    pthread_mutex_lock(&ctx.lock);
+    if (ctx.active) {
+        fprintf(ctx.fd,
+                "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%zu,"
+                "\"ts\":%llu,\"dur\":%llu}",
+                ctx.first ? "" : ",", span->name, (int)getpid(), tid,
+                (unsigned long long)(span->start - ctx.origin),
+                (unsigned long long)(end - span->start));
+        ctx.first = false;
+    }
+    pthread_mutex_unlock(&ctx.lock);
+}
+
+void trace_counter(const char* name, size_t value)
+{
+    uint64_t now;
+    size_t tid;
+
+    if (!ctx.active) {
+        return;
+    }
+
+    now = now_us();
+    tid = get_thread_id();
+
+    pthread_mutex_lock(&ctx.lock);
+    if (ctx.active) {
+        fprintf(ctx.fd,
+                "%s\n{\"name\":\"%s\",\"ph\":\"C\",\"pid\":%d,\"tid\":%zu,"
+                "\"ts\":%llu,\"args\":{\"value\":%zu}}",
+                ctx.first ? "" : ",", name, (int)getpid(), tid,
+                (unsigned long long)(now - ctx.origin), value);
+        ctx.first = false;
+    }
+    pthread_mutex_unlock(&ctx.lock);
+}
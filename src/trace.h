@@ -0,0 +1,54 @@
+// SPDX-License-Identifier: MIT
+// Tracing: time spans of operations written in Chrome trace format.
+// Copyright (C) 2025 Artem Senichev <artemsen@gmail.com>
+
+#pragma once
+
+#include "config.h"
+
+// Environment variable with path to the trace file, overrides config
+#define TRACE_ENV "SWAYIMG_TRACE"
+
+/** Trace span: time interval of the traced operation. */
+struct trace_span {
+    const char* name; ///< Span name, NULL if tracing is disabled
+    uint64_t start;   ///< Start time in microseconds
+};
+
+// Trace the current scope: span ends when the variable goes out of scope
+#define TRACE_SCOPE_VAR(name, line)                               \
+    struct trace_span __attribute__((cleanup(trace_end)))         \
+    trace_span_##line = trace_begin(name)
+#define TRACE_SCOPE_LINE(name, line) TRACE_SCOPE_VAR(name, line)
+#define TRACE_SCOPE(name)            TRACE_SCOPE_LINE(name, __LINE__)
+
+/**
+ * Initialize tracing, open output file if tracing is enabled.
+ * @param cfg config instance
+ */
+void trace_init(const struct config* cfg);
+
+/**
+ * Stop tracing and close output file.
+ */
+void trace_destroy(void);
+
+/**
+ * Begin the trace span.
+ * @param name span name, must be a string literal
+ * @return span description
+ */
+struct trace_span trace_begin(const char* name);
+
+/**
+ * End the trace span and write it to the output file.
+ * @param span span description
+ */
+void trace_end(struct trace_span* span);
+
+/**
+ * Write counter value to the trace.
+ * @param name counter name, must be a string literal
+ * @param value counter value
+ */
+void trace_counter(const char* name, size_t value);
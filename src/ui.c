@@ -9,6 +9,7 @@
 #include "buildcfg.h"
 #include "font.h"
 #include "info.h"
+#include "trace.h"
 #include "wndbuf.h"
 
 // autogenerated wayland headers
@@ -43,6 +44,21 @@
 // Fractional scale denominator
 #define FRACTION_SCALE_DEN 120
 
+// Number of window buffers: two are enough if the compositor releases buffers
+// in time, the third one is created on demand when both are still in use
+#define WNDBUF_MIN 2
+#define WNDBUF_MAX 3
+
+// Max number of damaged regions per frame, the entire window is damaged if
+// there are more
+#define DAMAGE_MAX 32
+
+/** Damaged region of the window. */
+struct damage {
+    ssize_t x, y;
+    size_t width, height;
+};
+
 /** UI context */
 struct ui {
     // wayland objects
@@ -51,6 +67,7 @@ struct ui {
         struct wl_registry* registry;
         struct wl_shm* shm;
         struct wl_compositor* compositor;
+        struct wl_subcompositor* subcompositor;
         struct wl_seat* seat;
         struct wl_keyboard* keyboard;
         struct wl_pointer* pointer;
@@ -73,14 +90,31 @@ struct ui {
 
     // window buffers
     struct wnd {
-        struct wl_buffer* buffer0;
-        struct wl_buffer* buffer1;
-        struct wl_buffer* current;
+        struct wndbuf_pool* pool;              ///< Shared memory of buffers
+        struct wl_buffer* buffers[WNDBUF_MAX]; ///< Buffer pool
+        size_t buffers_num;                    ///< Number of buffers in pool
+        struct wl_buffer* current;             ///< Currently drawn buffer
+        struct wl_callback* frame;             ///< Pending frame callback
+        bool deferred;                         ///< Redraw was postponed
         size_t width;
         size_t height;
         size_t scale;
+        struct damage damage[DAMAGE_MAX]; ///< Damaged regions of the frame
+        size_t damage_num;                ///< Number of damaged regions
+        bool damage_full;                 ///< Entire window is damaged
+        bool recreated;                   ///< Buffers were recreated
     } wnd;
 
+    // image layer scaled by the compositor
+    struct img {
+        struct wl_surface* surface;       ///< Image surface under the window
+        struct wl_subsurface* subsurface; ///< Subsurface role of the surface
+        struct wp_viewport* viewport;     ///< Crop and scale of the image
+        struct wl_buffer* buffer;         ///< Buffer with image pixels
+        struct wl_buffer* retired;        ///< Replaced buffer, can be in use
+        bool attached;                    ///< Buffer is attached to surface
+    } img;
+
     // cross-desktop
     struct xdg {
         bool initialized;
@@ -114,6 +148,9 @@ struct ui {
     // fullscreen mode
     bool fullscreen;
 
+    // offscreen window used instead of Wayland surface in headless mode
+    struct pixmap headless;
+
     // flag to cancel event queue
     bool event_handled;
 };
@@ -135,29 +172,166 @@ static inline void set_timespec(struct timespec* ts, uint32_t ms)
     ts->tv_nsec = (ms % 1000) * 1000000;
 }
 
+/**
+ * Restart postponed redraw if the window is ready for the next frame.
+ */
+static void resume_redraw(void)
+{
+    if (ctx.wnd.deferred && !ctx.wnd.frame) {
+        ctx.wnd.deferred = false;
+        app_redraw();
+    }
+}
+
+/**
+ * Buffer release handler: a free buffer may be awaited by postponed redraw.
+ */
+static void on_buffer_release(__attribute__((unused)) struct wl_buffer* buf)
+{
+    resume_redraw();
+}
+
+/**
+ * Free all window buffers.
+ */
+static void free_buffers(void)
+{
+    for (size_t i = 0; i < ctx.wnd.buffers_num; ++i) {
+        wndbuf_free(ctx.wnd.buffers[i]);
+    }
+    ctx.wnd.buffers_num = 0;
+    ctx.wnd.current = NULL;
+}
+
+/**
+ * Add new buffer to the pool.
+ * @return pointer to the new buffer or NULL on errors
+ */
+static struct wl_buffer* add_buffer(void)
+{
+    struct wl_buffer* buffer;
+
+    if (ctx.wnd.buffers_num >= WNDBUF_MAX) {
+        return NULL;
+    }
+
+    if (!ctx.wnd.pool) {
+        ctx.wnd.pool = wndbuf_pool_create(ctx.wl.shm);
+        if (!ctx.wnd.pool) {
+            return NULL;
+        }
+    }
+
+    buffer = wndbuf_pool_get(ctx.wnd.pool, ui_get_width(), ui_get_height(),
+                             on_buffer_release);
+    if (buffer) {
+        ctx.wnd.buffers[ctx.wnd.buffers_num++] = buffer;
+    }
+
+    return buffer;
+}
+
 /**
  * Recreate window buffers.
  * @return true if operation completed successfully
  */
 static bool recreate_buffers(void)
 {
-    const size_t width = ui_get_width();
-    const size_t height = ui_get_height();
+    free_buffers();
+    for (size_t i = 0; i < WNDBUF_MIN; ++i) {
+        if (!add_buffer()) {
+            free_buffers();
+            return false;
+        }
+    }
+    ctx.wnd.current = ctx.wnd.buffers[0];
+    ctx.wnd.recreated = true;
 
-    // recreate buffers
-    ctx.wnd.current = NULL;
-    wndbuf_free(ctx.wnd.buffer0);
-    wndbuf_free(ctx.wnd.buffer1);
-    ctx.wnd.buffer0 = wndbuf_create(ctx.wl.shm, width, height);
-    ctx.wnd.buffer1 = wndbuf_create(ctx.wl.shm, width, height);
-    if (!ctx.wnd.buffer0 || !ctx.wnd.buffer1) {
+    return true;
+}
+
+/**
+ * Image buffer release handler: free the replaced buffer.
+ * @param buffer released wayland buffer
+ */
+static void on_image_release(struct wl_buffer* buffer)
+{
+    if (buffer == ctx.img.retired) {
+        wndbuf_free(buffer);
+        ctx.img.retired = NULL;
+    }
+}
+
+/**
+ * Detach image buffer and free it when the compositor releases it.
+ */
+static void retire_image(void)
+{
+    if (ctx.img.attached) {
+        wl_surface_attach(ctx.img.surface, NULL, 0, 0);
+        wl_surface_commit(ctx.img.surface);
+        ctx.img.attached = false;
+    }
+    if (ctx.img.buffer) {
+        wndbuf_free(ctx.img.retired);
+        if (wndbuf_busy(ctx.img.buffer)) {
+            ctx.img.retired = ctx.img.buffer;
+        } else {
+            wndbuf_free(ctx.img.buffer);
+            ctx.img.retired = NULL;
+        }
+        ctx.img.buffer = NULL;
+    }
+}
+
+/**
+ * Create image layer: subsurface under the window surface.
+ * @return true if the layer is available
+ */
+static bool create_image_layer(void)
+{
+    struct wl_region* region;
+
+    if (ctx.img.surface) {
+        return true;
+    }
+    if (!ctx.wl.subcompositor || !ctx.wp.viewporter || !ctx.wl.surface) {
+        return false;
+    }
+
+    ctx.img.surface = wl_compositor_create_surface(ctx.wl.compositor);
+    if (!ctx.img.surface) {
         return false;
     }
-    ctx.wnd.current = ctx.wnd.buffer0;
+    ctx.img.subsurface = wl_subcompositor_get_subsurface(
+        ctx.wl.subcompositor, ctx.img.surface, ctx.wl.surface);
+    wl_subsurface_place_below(ctx.img.subsurface, ctx.wl.surface);
+    ctx.img.viewport =
+        wp_viewporter_get_viewport(ctx.wp.viewporter, ctx.img.surface);
+
+    // all input events go to the window surface
+    region = wl_compositor_create_region(ctx.wl.compositor);
+    wl_surface_set_input_region(ctx.img.surface, region);
+    wl_region_destroy(region);
 
     return true;
 }
 
+/**
+ * Free image layer.
+ */
+static void free_image_layer(void)
+{
+    if (ctx.img.surface) {
+        wp_viewport_destroy(ctx.img.viewport);
+        wl_subsurface_destroy(ctx.img.subsurface);
+        wl_surface_destroy(ctx.img.surface);
+    }
+    wndbuf_free(ctx.img.buffer);
+    wndbuf_free(ctx.img.retired);
+    memset(&ctx.img, 0, sizeof(ctx.img));
+}
+
 // suppress unused parameter warnings
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wunused-parameter"
@@ -233,12 +407,13 @@ static void on_keyboard_key(void* data, struct wl_keyboard* wl_keyboard,
     if (state == WL_KEYBOARD_KEY_STATE_RELEASED) {
         // stop key repeat timer
         timerfd_settime(ctx.repeat.fd, 0, &ts, NULL);
+        app_on_key_release();
     } else if (state == WL_KEYBOARD_KEY_STATE_PRESSED && ctx.xkb.state) {
         xkb_keysym_t keysym;
         key += 8;
         keysym = xkb_state_key_get_one_sym(ctx.xkb.state, key);
         if (keysym != XKB_KEY_NoSymbol) {
-            app_on_keyboard(keysym, keybind_mods(ctx.xkb.state));
+            app_on_keyboard(keysym, keybind_mods(ctx.xkb.state), 0);
             // handle key repeat
             if (ctx.repeat.rate &&
                 xkb_keymap_key_repeats(ctx.xkb.keymap, key)) {
@@ -308,6 +483,9 @@ static void on_pointer_button(void* data, struct wl_pointer* wl_pointer,
     const bool pressed = (state == WL_POINTER_BUTTON_STATE_PRESSED);
 
     if (button == BTN_LEFT) {
+        if (ctx.mouse.active && !pressed) {
+            app_on_drop();
+        }
         ctx.mouse.active = pressed;
         set_pointer_shape(wl_pointer, pressed);
     }
@@ -336,7 +514,7 @@ static void on_pointer_button(void* data, struct wl_pointer* wl_pointer,
                 break;
         }
         if (key != XKB_KEY_NoSymbol) {
-            app_on_keyboard(key, keybind_mods(ctx.xkb.state));
+            app_on_keyboard(key, keybind_mods(ctx.xkb.state), 0);
         }
     }
 }
@@ -352,7 +530,7 @@ static void on_pointer_axis(void* data, struct wl_pointer* wl_pointer,
         key = value > 0 ? VKEY_SCROLL_DOWN : VKEY_SCROLL_UP;
     }
 
-    app_on_keyboard(key, keybind_mods(ctx.xkb.state));
+    app_on_keyboard(key, keybind_mods(ctx.xkb.state), 0);
 }
 
 static const struct wl_keyboard_listener keyboard_listener = {
@@ -401,6 +579,21 @@ static const struct wl_seat_listener seat_listener = {
     .name = on_seat_name,
 };
 
+/*******************************************************************************
+ * Surface frame handlers
+ ******************************************************************************/
+static void on_frame_done(void* data, struct wl_callback* callback,
+                          uint32_t time)
+{
+    wl_callback_destroy(callback);
+    ctx.wnd.frame = NULL;
+    resume_redraw();
+}
+
+static const struct wl_callback_listener frame_listener = {
+    .done = on_frame_done,
+};
+
 /*******************************************************************************
  * XDG handlers
  ******************************************************************************/
@@ -412,6 +605,7 @@ static void on_xdg_surface_configure(void* data, struct xdg_surface* surface,
     if (ctx.xdg.initialized) {
         app_redraw();
     } else {
+        wndbuf_acquire(ctx.wnd.current);
         wl_surface_attach(ctx.wl.surface, ctx.wnd.current, 0, 0);
         wl_surface_commit(ctx.wl.surface);
     }
@@ -504,6 +698,12 @@ static void on_registry_global(void* data, struct wl_registry* registry,
             wl_registry_bind(registry, name, &wl_compositor_interface,
                              WL_SURFACE_DAMAGE_BUFFER_SINCE_VERSION);
 
+    } else if (strcmp(interface, wl_subcompositor_interface.name) == 0) {
+        // subsurfaces (image layer)
+        ctx.wl.subcompositor = wl_registry_bind(
+            registry, name, &wl_subcompositor_interface,
+            WL_SUBCOMPOSITOR_GET_SUBSURFACE_SINCE_VERSION);
+
     } else if (strcmp(interface, wl_shm_interface.name) == 0) {
         // wayland shared memory
         ctx.wl.shm = wl_registry_bind(registry, name, &wl_shm_interface,
@@ -574,8 +774,10 @@ static void on_key_repeat(__attribute__((unused)) void* data)
 {
     uint64_t repeats;
     const ssize_t sz = sizeof(repeats);
-    if (read(ctx.repeat.fd, &repeats, sz) == sz) {
-        app_on_keyboard(ctx.repeat.key, keybind_mods(ctx.xkb.state));
+    if (read(ctx.repeat.fd, &repeats, sz) == sz && repeats) {
+        // timer expirations missed while busy are merged into one event
+        app_on_keyboard(ctx.repeat.key, keybind_mods(ctx.xkb.state),
+                        repeats);
     }
 }
 
@@ -671,8 +873,31 @@ bool ui_init(const char* app_id, size_t width, size_t height, bool decor)
     return true;
 }
 
+bool ui_init_headless(size_t width, size_t height)
+{
+    if (width < WINDOW_MIN || height < WINDOW_MIN || width > WINDOW_MAX ||
+        height > WINDOW_MAX) {
+        width = WINDOW_DEFAULT_WIDTH;
+        height = WINDOW_DEFAULT_HEIGHT;
+    }
+    ctx.wnd.width = width;
+    ctx.wnd.height = height;
+
+    if (!pixmap_create(&ctx.headless, width, height)) {
+        fprintf(stderr, "Failed to create offscreen window\n");
+        return false;
+    }
+
+    return true;
+}
+
 void ui_destroy(void)
 {
+    pixmap_free(&ctx.headless);
+    memset(&ctx.headless, 0, sizeof(ctx.headless));
+
+    free_image_layer();
+
     // free protocols
     if (ctx.wp.scale_manager) {
         if (ctx.wp.scale) {
@@ -728,8 +953,11 @@ void ui_destroy(void)
     }
 
     // window buffers
-    wndbuf_free(ctx.wnd.buffer0);
-    wndbuf_free(ctx.wnd.buffer1);
+    if (ctx.wnd.frame) {
+        wl_callback_destroy(ctx.wnd.frame);
+    }
+    free_buffers();
+    wndbuf_pool_free(ctx.wnd.pool);
 
     // base wayland
     if (ctx.wl.seat) {
@@ -750,6 +978,9 @@ void ui_destroy(void)
     if (ctx.wl.surface) {
         wl_surface_destroy(ctx.wl.surface);
     }
+    if (ctx.wl.subcompositor) {
+        wl_subcompositor_destroy(ctx.wl.subcompositor);
+    }
     if (ctx.wl.compositor) {
         wl_compositor_destroy(ctx.wl.compositor);
     }
@@ -765,6 +996,10 @@ void ui_event_prepare(void)
 {
     ctx.event_handled = false;
 
+    if (!ctx.wl.display) {
+        return; // headless
+    }
+
     while (wl_display_prepare_read(ctx.wl.display) != 0) {
         wl_display_dispatch_pending(ctx.wl.display);
     }
@@ -774,40 +1009,227 @@ void ui_event_prepare(void)
 
 void ui_event_done(void)
 {
-    if (!ctx.event_handled) {
+    if (!ctx.event_handled && ctx.wl.display) {
         wl_display_cancel_read(ctx.wl.display);
     }
 }
 
 struct pixmap* ui_draw_begin(void)
 {
+    struct wl_buffer* next = NULL;
+
+    if (ctx.headless.data) {
+        ctx.wnd.damage_full = true;
+        ctx.wnd.damage_num = 0;
+        return &ctx.headless;
+    }
+
     if (!ctx.wnd.current) {
         return NULL; // not yet initialized
     }
 
-    // switch buffers
-    if (ctx.wnd.current == ctx.wnd.buffer0) {
-        ctx.wnd.current = ctx.wnd.buffer1;
-    } else {
-        ctx.wnd.current = ctx.wnd.buffer0;
+    // the compositor hasn't shown the previous frame yet, the new one would
+    // be dropped, so postpone redraw until the frame callback
+    if (ctx.wnd.frame) {
+        ctx.wnd.deferred = true;
+        return NULL;
     }
 
+    // get the buffer released by the compositor
+    for (size_t i = 0; i < ctx.wnd.buffers_num; ++i) {
+        if (!wndbuf_busy(ctx.wnd.buffers[i])) {
+            next = ctx.wnd.buffers[i];
+            break;
+        }
+    }
+    if (!next) {
+        next = add_buffer();
+        if (!next) {
+            // wait for buffer release
+            ctx.wnd.deferred = true;
+            return NULL;
+        }
+    }
+
+    ctx.wnd.current = next;
+
+    ctx.wnd.damage_full = true;
+    ctx.wnd.damage_num = 0;
+
     return wndbuf_pixmap(ctx.wnd.current);
 }
 
 void ui_draw_commit(void)
 {
-    const struct pixmap* pm = wndbuf_pixmap(ctx.wnd.current);
+    TRACE_SCOPE("ui_draw_commit");
+    const struct pixmap* pm;
+
+    if (ctx.headless.data) {
+        return; // offscreen window is ready to use
+    }
 
+    pm = wndbuf_pixmap(ctx.wnd.current);
+    wndbuf_acquire(ctx.wnd.current);
     wl_surface_attach(ctx.wl.surface, ctx.wnd.current, 0, 0);
-    wl_surface_damage_buffer(ctx.wl.surface, 0, 0, pm->width, pm->height);
+
+    if (ctx.wnd.damage_full || ctx.wnd.recreated) {
+        wl_surface_damage_buffer(ctx.wl.surface, 0, 0, pm->width, pm->height);
+        ctx.wnd.recreated = false;
+    } else {
+        for (size_t i = 0; i < ctx.wnd.damage_num; ++i) {
+            const struct damage* dmg = &ctx.wnd.damage[i];
+            wl_surface_damage_buffer(ctx.wl.surface, dmg->x, dmg->y,
+                                     dmg->width, dmg->height);
+        }
+    }
+
+    ctx.wnd.frame = wl_surface_frame(ctx.wl.surface);
+    wl_callback_add_listener(ctx.wnd.frame, &frame_listener, NULL);
+
     wl_surface_commit(ctx.wl.surface);
 }
 
+void ui_flush(void)
+{
+    if (ctx.wl.display) {
+        wl_display_flush(ctx.wl.display);
+    }
+}
+
+void ui_damage_partial(void)
+{
+    ctx.wnd.damage_full = false;
+}
+
+void ui_damage(ssize_t x, ssize_t y, size_t width, size_t height)
+{
+    const struct pixmap* pm;
+    struct damage* dmg;
+    ssize_t right, bottom;
+
+    if (ctx.wnd.damage_full || !ctx.wnd.current) {
+        return;
+    }
+
+    // clip to window
+    pm = wndbuf_pixmap(ctx.wnd.current);
+    right = min((ssize_t)pm->width, x + (ssize_t)width);
+    bottom = min((ssize_t)pm->height, y + (ssize_t)height);
+    x = max(0, x);
+    y = max(0, y);
+    if (right <= x || bottom <= y) {
+        return;
+    }
+
+    if (ctx.wnd.damage_num == DAMAGE_MAX) {
+        ctx.wnd.damage_full = true;
+        return;
+    }
+
+    dmg = &ctx.wnd.damage[ctx.wnd.damage_num++];
+    dmg->x = x;
+    dmg->y = y;
+    dmg->width = right - x;
+    dmg->height = bottom - y;
+}
+
+bool ui_set_image(const struct pixmap* pm)
+{
+    struct wl_buffer* buffer;
+
+    if (!pm) {
+        retire_image();
+        return true;
+    }
+    if (ctx.headless.data) {
+        return false; // no compositor to scale the image
+    }
+
+    if (!create_image_layer()) {
+        return false;
+    }
+
+    buffer = wndbuf_create(ctx.wl.shm, pm->width, pm->height,
+                           on_image_release);
+    if (!buffer) {
+        return false;
+    }
+    memcpy(wndbuf_pixmap(buffer)->data, pm->data,
+           pm->width * pm->height * sizeof(argb_t));
+
+    retire_image();
+    ctx.img.buffer = buffer;
+
+    return true;
+}
+
+void ui_place_image(ssize_t x, ssize_t y, size_t width, size_t height)
+{
+    const double scale = (double)ctx.wnd.scale / FRACTION_SCALE_DEN;
+    const struct pixmap* pm;
+    ssize_t left, top, right, bottom;
+    ssize_t pos_x, pos_y, dst_w, dst_h;
+    double src_x, src_y, src_w, src_h;
+
+    if (!ctx.img.buffer) {
+        return;
+    }
+
+    // visible part of the image
+    left = max(0, x);
+    top = max(0, y);
+    right = min((ssize_t)ui_get_width(), x + (ssize_t)width);
+    bottom = min((ssize_t)ui_get_height(), y + (ssize_t)height);
+    if (right <= left || bottom <= top) {
+        if (ctx.img.attached) {
+            wl_surface_attach(ctx.img.surface, NULL, 0, 0);
+            wl_surface_commit(ctx.img.surface);
+            ctx.img.attached = false;
+        }
+        return;
+    }
+
+    // crop the visible part from the image (buffer coordinates)
+    pm = wndbuf_pixmap(ctx.img.buffer);
+    src_x = (double)(left - x) * pm->width / width;
+    src_y = (double)(top - y) * pm->height / height;
+    src_w = (double)(right - left) * pm->width / width;
+    src_h = (double)(bottom - top) * pm->height / height;
+    src_w = min(src_w, pm->width - src_x);
+    src_h = min(src_h, pm->height - src_y);
+    wp_viewport_set_source(ctx.img.viewport, wl_fixed_from_double(src_x),
+                           wl_fixed_from_double(src_y),
+                           wl_fixed_from_double(src_w),
+                           wl_fixed_from_double(src_h));
+
+    // scale it to the destination (surface coordinates)
+    pos_x = left / scale + 0.5;
+    pos_y = top / scale + 0.5;
+    dst_w = max(1, (ssize_t)(right / scale + 0.5) - pos_x);
+    dst_h = max(1, (ssize_t)(bottom / scale + 0.5) - pos_y);
+    wl_subsurface_set_position(ctx.img.subsurface, pos_x, pos_y);
+    wp_viewport_set_destination(ctx.img.viewport, dst_w, dst_h);
+
+    if (!ctx.img.attached) {
+        wndbuf_acquire(ctx.img.buffer);
+        wl_surface_attach(ctx.img.surface, ctx.img.buffer, 0, 0);
+        wl_surface_damage_buffer(ctx.img.surface, 0, 0, pm->width,
+                                 pm->height);
+        ctx.img.attached = true;
+    }
+
+    // applied atomically with the next commit of the window surface
+    wl_surface_commit(ctx.img.surface);
+}
+
 void ui_set_title(const char* name)
 {
     char* title = NULL;
 
+    if (!ctx.xdg.toplevel) {
+        return; // headless
+    }
+
     str_append(APP_NAME ": ", 0, &title);
     str_append(name, 0, &title);
 
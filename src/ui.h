@@ -20,6 +20,14 @@ void ui_create(void);
  */
 bool ui_init(const char* app_id, size_t width, size_t height, bool decor);
 
+/**
+ * Initialize headless UI: the window is an offscreen pixmap, no compositor
+ * is required (batch processing, performance tests).
+ * @param width,height window size in pixels
+ * @return true if window created
+ */
+bool ui_init_headless(size_t width, size_t height);
+
 /**
  * Destroy global UI context.
  */
@@ -46,6 +54,45 @@ struct pixmap* ui_draw_begin(void);
  */
 void ui_draw_commit(void);
 
+/**
+ * Send pending requests to the compositor, used to show something while
+ * the main thread is busy and doesn't return to the event loop.
+ */
+void ui_flush(void);
+
+/**
+ * Limit damage of the frame being drawn to the regions added with
+ * `ui_damage`, by default the entire window is damaged.
+ * Must be called between `ui_draw_begin` and `ui_draw_commit`.
+ */
+void ui_damage_partial(void);
+
+/**
+ * Add damaged region (changed since the previous frame) of the frame being
+ * drawn, ignored if the entire window is damaged.
+ * @param x,y top left corner of the region
+ * @param width,height region size
+ */
+void ui_damage(ssize_t x, ssize_t y, size_t width, size_t height);
+
+/**
+ * Set image to be scaled by the compositor under the window content.
+ * The pixels are copied to the compositor, so the image must be set again
+ * only if it is changed.
+ * @param pm image pixmap, NULL to remove the image
+ * @return false if scaling by the compositor is not supported
+ */
+bool ui_set_image(const struct pixmap* pm);
+
+/**
+ * Place the image scaled by the compositor on the window.
+ * Must be called between `ui_draw_begin` and `ui_draw_commit`, the window
+ * content over the image must be transparent.
+ * @param x,y top left corner of the image in window pixels
+ * @param width,height scaled image size in window pixels
+ */
+void ui_place_image(ssize_t x, ssize_t y, size_t width, size_t height);
+
 /**
  * Set window title.
  * @param name file name of the current image
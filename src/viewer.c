@@ -10,7 +10,12 @@
 #include "cache.h"
 #include "imglist.h"
 #include "info.h"
+#include "loadsvc.h"
+#include "memstat.h"
 #include "pixmap_scale.h"
+#include "predict.h"
+#include "tpool.h"
+#include "trace.h"
 #include "ui.h"
 
 #ifdef HAVE_LIBPNG
@@ -21,12 +26,16 @@
 #endif
 
 #include <assert.h>
+#include <ctype.h>
+#include <errno.h>
 #include <math.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/eventfd.h>
 #include <sys/timerfd.h>
+#include <time.h>
 #include <unistd.h>
 
 // Background grid parameters
@@ -40,6 +49,37 @@
 #define MIN_SCALE 10    // pixels
 #define MAX_SCALE 100.0 // factor
 
+// Max memory limit for history/preload caches (MiB)
+#define MEMORY_LIMIT_MAX (1024 * 1024)
+
+// max size of the cached scaled image in window sizes
+#define SCALED_MAX_WINDOWS 4
+
+// max memory used by the cache of scaled animation frames (bytes)
+#define ANIM_SCALED_MAX (256 * 1024 * 1024)
+
+// max width/height of the image scaled by the compositor (texture size)
+#define LAYER_MAX_SIZE 8192
+
+// decoding time statistics: max number of file types and type name length
+#define DECODE_TYPES_MAX 16
+#define DECODE_TYPE_LEN  8
+
+// slideshow: the next image is loaded in advance with this margin added to
+// the expected decoding time (ms)
+#define SLIDESHOW_MARGIN 200
+
+// smooth motion: time constant of approaching the target zoom (ms)
+#define MOTION_ZOOM_TAU 40.0
+// kinetic panning: time constant of velocity decay (ms)
+#define MOTION_PAN_TAU 300.0
+// kinetic panning: min velocity to keep moving (pixels per ms)
+#define MOTION_PAN_MIN 0.05
+// kinetic panning: max pause between the last drag and release (ms)
+#define MOTION_PAN_HOLD 50.0
+// max time step of the motion, longer pauses are not animated (ms)
+#define MOTION_STEP_MAX 100.0
+
 /** Scaling operations. */
 enum fixed_scale {
     scale_fit_optimal, ///< Fit to window, but not more than 100%
@@ -89,14 +129,62 @@ static const char* position_names[] = {
 };
 // clang-format on
 
+/** Scaled image cache: avoids rescaling on panning. */
+struct scaled {
+    struct pixmap pm;          ///< Scaled frame, empty if not cached
+    const struct image* image; ///< Source image
+    size_t frame;              ///< Source frame index
+    double scale;              ///< Scale factor
+    enum aa_mode aa;           ///< Anti-aliasing mode used for scaling
+    bool layer;                ///< Frame is scaled by the compositor
+};
+
+/** Animation frames scaled to the current scale. */
+struct anim_scaled {
+    struct pixmap* frames;     ///< Scaled frames, empty if not cached yet
+    size_t num;                ///< Number of frames
+    size_t memory;             ///< Size of the cached frames in bytes
+    const struct image* image; ///< Source image
+    double scale;              ///< Scale factor
+    enum aa_mode aa;           ///< Anti-aliasing mode used for scaling
+
+    pthread_t tid;      ///< Background scaler thread id
+    bool active;        ///< Background scaler is running
+    size_t ahead;       ///< Index of the frame scaled in background
+    struct pixmap src;  ///< Private copy of the source frame (mipmap level)
+    struct pixmap dst;  ///< Frame scaled in background
+    double src_scale;   ///< Scale factor relative to the source copy
+    bool alpha;         ///< Source frame has alpha channel
+};
+
+/** Smooth zoom and kinetic panning, stepped once per rendered frame. */
+struct motion {
+    bool enable;          ///< Smooth motion enabled
+    bool zoom;            ///< Zoom animation in progress
+    double scale;         ///< Target scale
+    double center_x;      ///< Fixed point of zoom (image coordinates)
+    double center_y;      ///< Fixed point of zoom (image coordinates)
+    bool kinetic;         ///< Kinetic panning in progress
+    double vx, vy;        ///< Panning velocity (pixels per ms)
+    struct timespec drag; ///< Time of the last drag event
+    struct timespec last; ///< Time of the last motion step
+};
+
 /** Viewer context. */
 struct viewer {
     struct image* current; ///< Currently shown image
-
-    struct cache* history; ///< Recently viewed images
-    struct cache* preload; ///< Preloaded images
-    pthread_t preload_tid; ///< Preload thread id
-    bool preload_active;   ///< Preload in progress flag
+    bool placeholder;      ///< Current frame is thumbnail, decoding is pending
+
+    struct cache* history;  ///< Recently viewed images
+    struct cache* preload;  ///< Preloaded images
+    pthread_t preload_tid;  ///< Preload thread id
+    bool preload_active;    ///< Preload in progress flag
+    size_t preload_ahead;   ///< Number of images to preload ahead
+    size_t preload_back;    ///< Number of images to preload behind
+    size_t prefetch;        ///< Number of files to read ahead after preloaded
+    bool backward;          ///< Direction of the last navigation
+    struct predict predict; ///< Direction and speed of navigation
+    char* rand_next;        ///< Next random image source, NULL if not used
 
     ssize_t img_x, img_y; ///< Top left corner of the image
     ssize_t img_w, img_h; ///< Image width and height
@@ -105,98 +193,447 @@ struct viewer {
     argb_t image_bkg;     ///< Image background mode/color
     argb_t window_bkg;    ///< Window background mode/color
     enum aa_mode aa_mode; ///< Anti-aliasing mode
+    size_t aa_delay;      ///< Delay before anti-aliasing (ms)
+    int aa_fd;            ///< Anti-aliasing delay timer
+    bool aa_pending;      ///< Anti-aliasing is postponed, use nearest
+    bool compositor;      ///< Let the compositor scale the image
 
     enum fixed_scale scale_init; ///< Initial scale
     bool keep_zoom;              ///< Keep absolute zoom across images
     enum position position;      ///< Initial position
     double scale;                ///< Current scale factor of the image
+    struct scaled scaled;        ///< Cache of the scaled image
+    struct anim_scaled anim;     ///< Cache of the scaled animation frames
+    struct motion motion;        ///< Smooth zoom and kinetic panning
 
     bool animation_enable; ///< Animation enable/disable
     int animation_fd;      ///< Animation timer
+    struct timespec animation_due; ///< Time to switch to the next frame
+    size_t animation_dropped;      ///< Number of frames skipped to keep up
 
     bool slideshow_enable; ///< Slideshow enable/disable
     int slideshow_fd;      ///< Slideshow timer
     size_t slideshow_time; ///< Slideshow image display time (seconds)
+    struct timespec slideshow_due; ///< Time to switch to the next image
+    bool slideshow_early;  ///< Timer is set to start loading the next image
+
+    char* target; ///< Source of the image being opened in background
+    bool forward; ///< Preferred direction after skipping the target
+
+    size_t cache_hits;   ///< Number of opened images found in caches
+    size_t cache_misses; ///< Number of opened images that required decoding
+};
+
+/** Background opener: loads the image selected by navigation. */
+struct opener {
+    pthread_t tid;          ///< Worker thread id
+    bool active;            ///< Worker thread is running
+    pthread_mutex_t lock;   ///< Request/result access lock
+    pthread_cond_t wakeup;  ///< New request notification
+    int notify;             ///< Event fd to notify the main thread
+    char* request;          ///< Source of the image to load, NULL if none
+    bool cancel;            ///< Cancellation flag for the current decoding
+    struct image* result;   ///< Loaded image (copy of the list entry)
+    enum image_status rc;   ///< Loading status of the result
+    double decode_time;     ///< Decoding time of the result in milliseconds
+    struct pixmap preview;  ///< Coarse preview of the image being loaded
+};
+
+/** Background re-render of the current SVG image at a new size. */
+struct rerender {
+    pthread_t tid;        ///< Worker thread id
+    struct image* image;  ///< Image being rendered, NULL if worker is idle
+    enum image_status rc; ///< Rendering status
+    bool pending;         ///< Re-render is postponed until zoom settles
+    int notify;           ///< Event fd to notify the main thread
+};
+
+/** Measured decoding time per file type, used to schedule slideshow. */
+struct decode_stats {
+    pthread_mutex_t lock; ///< Access lock, updated by background loaders
+    struct decode_time {
+        char type[DECODE_TYPE_LEN]; ///< File extension in lower case
+        double ms;                  ///< Average decoding time
+    } types[DECODE_TYPES_MAX];      ///< Statistics per file type
+    size_t num;                     ///< Number of used entries
+    double any;                     ///< Average decoding time of any type
+};
+
+/** Slideshow prefetch: the next image is loaded in advance to meet the
+ * slideshow deadline. */
+struct prefetch {
+    pthread_t tid;        ///< Worker thread id
+    bool active;          ///< Worker thread was started and must be joined
+    bool cancel;          ///< Cancellation flag for the decoding
+    struct image* image;  ///< Loaded copy of the next image
+    bool success;         ///< Loading status of the image
+    bool prescale;        ///< Pre-scale the first frame
+    enum fixed_scale sc;  ///< Scale type of the pre-scaled frame
+    size_t wnd_width;     ///< Window width to pre-scale the first frame
+    size_t wnd_height;    ///< Window height to pre-scale the first frame
+    enum aa_mode aa;      ///< Anti-aliasing mode to pre-scale
+    double scale;         ///< Scale of the pre-scaled frame
+    struct pixmap scaled; ///< Pre-scaled first frame, empty if not scaled
 };
 
 /** Global viewer context. */
 static struct viewer ctx;
 
+/** Global decoding time statistics. */
+static struct decode_stats stats = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/** Global slideshow prefetch context. */
+static struct prefetch prefetch;
+
+/** Global opener context. */
+static struct opener opener = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wakeup = PTHREAD_COND_INITIALIZER,
+    .notify = -1,
+};
+
+/** Global re-render context. */
+static struct rerender rerender = {
+    .notify = -1,
+};
+
 /**
- * Preloader thread.
+ * Get time elapsed since the start point.
+ * @param start start point
+ * @return elapsed time in milliseconds
  */
-static void* preloader_thread(__attribute__((unused)) void* data)
+static double elapsed_ms(const struct timespec* start)
 {
-    struct image* current = ctx.current;
-    size_t counter = 0;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000.0 +
+        (now.tv_nsec - start->tv_nsec) / 1000000.0;
+}
 
-    while (ctx.preload_active && counter < cache_capacity(ctx.preload)) {
-        struct image* next;
-        struct image* origin;
-        enum image_status status;
+/**
+ * Move time point forward.
+ * @param ts time point to adjust
+ * @param ms number of milliseconds to add
+ */
+static void time_add(struct timespec* ts, size_t ms)
+{
+    ts->tv_sec += ms / 1000;
+    ts->tv_nsec += (ms % 1000) * 1000000;
+    if (ts->tv_nsec >= 1000000000) {
+        ++ts->tv_sec;
+        ts->tv_nsec -= 1000000000;
+    }
+}
 
-        imglist_lock();
+/**
+ * Get file type of the image source used for decoding time statistics.
+ * @param source image source
+ * @param type destination buffer for the lower case file extension
+ */
+static void decode_type(const char* source, char type[DECODE_TYPE_LEN])
+{
+    const char* ext = strrchr(source, '.');
+    size_t i = 0;
+
+    if (ext && !strchr(ext, '/')) {
+        ++ext;
+        while (ext[i] && i < DECODE_TYPE_LEN - 1) {
+            type[i] = tolower((unsigned char)ext[i]);
+            ++i;
+        }
+    }
+    type[i] = 0;
+}
+
+/**
+ * Put measured decoding time to the statistics.
+ * @param source source of the decoded image
+ * @param ms decoding time in milliseconds
+ */
+static void decode_stats_put(const char* source, double ms)
+{
+    char type[DECODE_TYPE_LEN];
+    struct decode_time* entry = NULL;
+
+    decode_type(source, type);
+
+    pthread_mutex_lock(&stats.lock);
 
-        if (current != ctx.current) {
-            current = ctx.current;
-            counter = 0;
+    for (size_t i = 0; i < stats.num; ++i) {
+        if (strcmp(stats.types[i].type, type) == 0) {
+            entry = &stats.types[i];
+            break;
+        }
+    }
+    if (!entry) {
+        // add new type or replace the last one if the table is full
+        if (stats.num < ARRAY_SIZE(stats.types)) {
+            ++stats.num;
         }
+        entry = &stats.types[stats.num - 1];
+        strcpy(entry->type, type);
+        entry->ms = ms;
+    }
 
-        // get next image
-        next = imglist_jump(ctx.current, counter + 1);
-        if (!next) {
-            // last image in the list
-            imglist_unlock();
-            cache_trim(ctx.preload, counter);
+    // exponential moving average
+    entry->ms = entry->ms * 0.75 + ms * 0.25;
+    stats.any = stats.any ? stats.any * 0.75 + ms * 0.25 : ms;
+
+    pthread_mutex_unlock(&stats.lock);
+}
+
+/**
+ * Get expected decoding time of the image.
+ * @param source image source
+ * @return decoding time in milliseconds
+ */
+static double decode_stats_get(const char* source)
+{
+    char type[DECODE_TYPE_LEN];
+    double ms;
+
+    decode_type(source, type);
+
+    pthread_mutex_lock(&stats.lock);
+    ms = stats.any;
+    for (size_t i = 0; i < stats.num; ++i) {
+        if (strcmp(stats.types[i].type, type) == 0) {
+            ms = stats.types[i].ms;
             break;
         }
+    }
+    pthread_mutex_unlock(&stats.lock);
 
-        // get existing image form history/preload cache
-        if (cache_out(ctx.preload, next) || cache_out(ctx.history, next)) {
-            cache_put(ctx.preload, next);
-            imglist_unlock();
-            ++counter;
-            continue;
+    return ms;
+}
+
+/**
+ * Get the longest expected decoding time of all file types.
+ * @return decoding time in milliseconds
+ */
+static double decode_stats_max(void)
+{
+    double ms;
+
+    pthread_mutex_lock(&stats.lock);
+    ms = stats.any;
+    for (size_t i = 0; i < stats.num; ++i) {
+        if (ms < stats.types[i].ms) {
+            ms = stats.types[i].ms;
         }
+    }
+    pthread_mutex_unlock(&stats.lock);
 
-        // create copy to unlock the list
-        next = image_create(next->source);
-        imglist_unlock();
-        if (!next) {
-            break; // not enough memory
+    return ms;
+}
+
+/** Preloader batch: images loaded in parallel by the thread pool. */
+struct preload_batch {
+    const struct image* current; ///< Current image at the batch start
+    struct image** images;       ///< Copies of the images to load
+    size_t total;                ///< Number of images in the batch
+    char** prefetch;             ///< Sources of the files to read ahead
+    size_t prefetch_num;         ///< Number of files to read ahead
+    size_t cached;               ///< Number of images put to the cache
+    bool stop;                   ///< Stop flag, set if memory limit reached
+};
+
+/**
+ * Add image to the preloader batch, must be called with the list locked.
+ * @param batch preloader batch
+ * @param img image entry to preload, can be NULL
+ */
+static void preload_add(struct preload_batch* batch, struct image* img)
+{
+    if (!img || img == ctx.current) {
+        return;
+    }
+
+    // get existing image form history/preload cache
+    if (cache_out(ctx.preload, img) || cache_out(ctx.history, img)) {
+        cache_put(ctx.preload, img);
+        ++batch->cached;
+        return;
+    }
+
+    // skip duplicates (e.g. random image is a neighbor)
+    for (size_t i = 0; i < batch->total; ++i) {
+        if (strcmp(batch->images[i]->source, img->source) == 0) {
+            return;
         }
+    }
 
-        // load next image
-        status = image_load(next);
+    // create copy to load it without the list lock
+    img = image_create(img->source);
+    if (img) {
+        batch->images[batch->total++] = img;
+    }
+}
 
-        imglist_lock();
+/**
+ * Preloader task: load one image of the batch.
+ * @param index index of the image in the batch
+ * @param data preloader batch
+ */
+static void preload_task(size_t index, void* data)
+{
+    TRACE_SCOPE("preload");
+    struct preload_batch* batch = data;
+    struct image* img = batch->images[index];
+    enum image_status status = imgload_unsupported;
+    struct image* origin;
+    bool published = false;
+    bool skip;
+
+    // don't start loading if the user has moved to another image
+    imglist_lock();
+    skip = batch->stop || !ctx.preload_active || batch->current != ctx.current;
+    imglist_unlock();
 
-        origin = imglist_find(next->source);
-        if (!origin || image_has_frames(origin)) {
-            image_free(next, IMGFREE_ALL);
-            imglist_unlock();
-            continue; // already skipped or loaded by main thread
+    // the same image can be opened by the main thread at the same time
+    if (!skip && loadsvc_begin(img->source, true)) {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        status = image_load(img);
+        if (status == imgload_success) {
+            decode_stats_put(img->source, elapsed_ms(&start));
         }
+    } else {
+        skip = true;
+    }
 
-        if (status != imgload_success) {
-            imglist_remove(origin);
+    imglist_lock();
+
+    origin = imglist_find(img->source);
+    if (skip || !origin || image_has_frames(origin)) {
+        // cancelled, already skipped or loaded by another loader
+    } else if (status != imgload_success) {
+        imglist_remove(origin);
+    } else if (batch->stop || !cache_fits(ctx.preload, img)) {
+        // memory limit reached, don't evict the nearest images
+        batch->stop = true;
+    } else {
+        // replace existing image data
+        image_update(origin, img);
+        if (cache_put(ctx.preload, origin)) {
+            ++batch->cached;
+            published = true;
         } else {
-            // replace existing image data
-            image_update(origin, next);
-            if (!cache_put(ctx.preload, origin)) {
-                // not enough memory
-                image_free(origin, IMGFREE_FRAMES);
-                image_free(next, IMGFREE_ALL);
+            // not enough memory
+            image_free(origin, IMGFREE_FRAMES);
+            batch->stop = true;
+        }
+    }
+
+    imglist_unlock();
+
+    if (!skip) {
+        loadsvc_end(img->source, true, published);
+    }
+
+    image_free(img, IMGFREE_ALL);
+}
+
+/**
+ * Preloader thread: loads the images around the current one, the nearest
+ * images in the direction of navigation go first.
+ */
+static void* preloader_thread(__attribute__((unused)) void* data)
+{
+    const size_t capacity = cache_capacity(ctx.preload);
+    struct preload_batch batch = { 0 };
+
+    batch.images = malloc(capacity * sizeof(*batch.images));
+    batch.prefetch = calloc(ctx.prefetch + 1, sizeof(*batch.prefetch));
+
+    while (batch.images && batch.prefetch && ctx.preload_active) {
+        const ssize_t dir = ctx.backward ? -1 : 1;
+        size_t ahead = ctx.preload_ahead;
+        size_t back = ctx.preload_back;
+        size_t skip;
+        bool complete;
+
+        imglist_lock();
+
+        batch.current = ctx.current;
+        batch.total = 0;
+        batch.cached = 0;
+        batch.stop = false;
+
+        // extend the window in the direction of fast browsing, the nearest
+        // images the user will pass before decoding is complete go last
+        predict_split(&ctx.predict, &ahead, &back);
+        skip = predict_skip(&ctx.predict, decode_stats_max());
+        if (skip >= ahead) {
+            skip = ahead ? ahead - 1 : 0;
+        }
+
+        if (ctx.rand_next) {
+            preload_add(&batch, imglist_find(ctx.rand_next));
+        }
+        for (size_t i = 1; i + skip <= ahead || i <= back; ++i) {
+            if (i + skip <= ahead && batch.total < capacity) {
+                preload_add(&batch,
+                            imglist_jump(ctx.current, dir * (i + skip)));
+            }
+            if (i <= back && batch.total < capacity) {
+                preload_add(&batch, imglist_jump(ctx.current, -dir * i));
+            }
+        }
+        for (size_t i = 1; i <= skip && batch.total < capacity; ++i) {
+            preload_add(&batch, imglist_jump(ctx.current, dir * i));
+        }
+
+        // files following the preload window in the direction of navigation
+        batch.prefetch_num = 0;
+        for (size_t i = 1; i <= ctx.prefetch; ++i) {
+            const struct image* img =
+                imglist_jump(ctx.current, dir * (ahead + i));
+            if (!img) {
                 break;
             }
-            ++counter;
+            str_dup(img->source, &batch.prefetch[batch.prefetch_num++]);
+        }
+
+        imglist_unlock();
+
+        // start reading all files at once, decoders wait for the data less
+        for (size_t i = 0; i < batch.total; ++i) {
+            image_prefetch(batch.images[i]->source);
+        }
+        if (batch.total) {
+            tpool_run(batch.total, preload_task, &batch);
+        }
+        for (size_t i = 0; i < batch.prefetch_num; ++i) {
+            if (batch.prefetch[i]) {
+                image_prefetch(batch.prefetch[i]);
+            }
         }
 
-        image_free(next, IMGFREE_ALL);
+        imglist_lock();
+        complete = (batch.current == ctx.current);
+        if (complete && !batch.stop) {
+            // unload images out of the preload window
+            cache_trim(ctx.preload, batch.cached);
+        }
         imglist_unlock();
+
+        if (complete) {
+            break;
+        }
     }
 
+    if (batch.prefetch) {
+        for (size_t i = 0; i < ctx.prefetch; ++i) {
+            free(batch.prefetch[i]);
+        }
+        free(batch.prefetch);
+    }
+    free(batch.images);
     ctx.preload_active = false;
+
     return NULL;
 }
 
@@ -222,6 +659,37 @@ static void preloader_stop(void)
     }
 }
 
+/**
+ * Postpone anti-aliasing: the image is drawn with the nearest-neighbor method
+ * until there are no zoom or move operations during the configured delay.
+ */
+static void postpone_aa(void)
+{
+    struct itimerspec ts = { 0 };
+
+    if (ctx.aa_delay == 0 || ctx.aa_fd == -1 || ctx.aa_mode == aa_nearest) {
+        return;
+    }
+
+    ts.it_value.tv_sec = ctx.aa_delay / 1000;
+    ts.it_value.tv_nsec = (ctx.aa_delay % 1000) * 1000000;
+    timerfd_settime(ctx.aa_fd, 0, &ts, NULL);
+
+    ctx.aa_pending = true;
+}
+
+/**
+ * Cancel postponed anti-aliasing.
+ */
+static void cancel_aa(void)
+{
+    if (ctx.aa_pending) {
+        struct itimerspec ts = { 0 };
+        timerfd_settime(ctx.aa_fd, 0, &ts, NULL);
+        ctx.aa_pending = false;
+    }
+}
+
 /**
  * Fix up image position.
  * @param force flag to force update position
@@ -339,18 +807,98 @@ static void fixup_position(bool force)
     }
 }
 
+/**
+ * Stop smooth zoom and kinetic panning.
+ * @param finish true to jump to the target zoom, false to stay where it is
+ */
+static void motion_stop(bool finish)
+{
+    if (ctx.motion.zoom && finish) {
+        const double wnd_half_w = (double)ui_get_width() / 2;
+        const double wnd_half_h = (double)ui_get_height() / 2;
+        ctx.scale = ctx.motion.scale;
+        ctx.img_x = wnd_half_w - ctx.motion.center_x * ctx.scale;
+        ctx.img_y = wnd_half_h - ctx.motion.center_y * ctx.scale;
+        fixup_position(false);
+        info_update(info_scale, "%.0f%%", ctx.scale * 100);
+    }
+    ctx.motion.zoom = false;
+    ctx.motion.kinetic = false;
+}
+
+/**
+ * Move zoom and panning one step closer to the target, called before each
+ * redraw: the next step is requested as a redraw too, so the compositor's
+ * frame callbacks pace the motion, at most one step per displayed frame.
+ */
+static void motion_step(void)
+{
+    struct timespec now;
+    double dt;
+
+    if (!ctx.motion.zoom && !ctx.motion.kinetic) {
+        return;
+    }
+
+    dt = elapsed_ms(&ctx.motion.last);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    ctx.motion.last = now;
+    if (dt > MOTION_STEP_MAX) {
+        dt = MOTION_STEP_MAX;
+    }
+
+    if (ctx.motion.zoom) {
+        const double wnd_half_w = (double)ui_get_width() / 2;
+        const double wnd_half_h = (double)ui_get_height() / 2;
+        const double k = 1.0 - exp(-dt / MOTION_ZOOM_TAU);
+        ctx.scale += (ctx.motion.scale - ctx.scale) * k;
+        if (fabs(ctx.motion.scale - ctx.scale) < ctx.motion.scale / 1000) {
+            ctx.scale = ctx.motion.scale;
+            ctx.motion.zoom = false;
+        }
+        ctx.img_x = wnd_half_w - ctx.motion.center_x * ctx.scale;
+        ctx.img_y = wnd_half_h - ctx.motion.center_y * ctx.scale;
+        fixup_position(false);
+        info_update(info_scale, "%.0f%%", ctx.scale * 100);
+    }
+
+    if (ctx.motion.kinetic) {
+        const ssize_t old_x = ctx.img_x;
+        const ssize_t old_y = ctx.img_y;
+        const double decay = exp(-dt / MOTION_PAN_TAU);
+        ctx.img_x += ctx.motion.vx * dt;
+        ctx.img_y += ctx.motion.vy * dt;
+        fixup_position(false);
+        ctx.motion.vx *= decay;
+        ctx.motion.vy *= decay;
+        if ((ctx.img_x == old_x && ctx.img_y == old_y) ||
+            hypot(ctx.motion.vx, ctx.motion.vy) < MOTION_PAN_MIN) {
+            ctx.motion.kinetic = false; // stopped or hit the edge
+        }
+    }
+
+    postpone_aa();
+    if (ctx.motion.zoom || ctx.motion.kinetic) {
+        app_redraw(); // next step
+    }
+}
+
 /**
  * Move image (viewport).
  * @param horizontal axis along which to move (false for vertical)
  * @param positive direction (increase/decrease)
  * @param params optional move step in percents
+ * @param repeat number of steps
  */
-static void move_image(bool horizontal, bool positive, const char* params)
+static void move_image(bool horizontal, bool positive, const char* params,
+                       size_t repeat)
 {
     const ssize_t old_x = ctx.img_x;
     const ssize_t old_y = ctx.img_y;
     ssize_t step = 10; // in %
 
+    motion_stop(true);
+
     if (params) {
         ssize_t val;
         if (str_to_num(params, 0, &val, 0) && val > 0 && val <= 1000) {
@@ -360,6 +908,7 @@ static void move_image(bool horizontal, bool positive, const char* params)
         }
     }
 
+    step *= repeat;
     if (!positive) {
         step = -step;
     }
@@ -373,99 +922,314 @@ static void move_image(bool horizontal, bool positive, const char* params)
     fixup_position(false);
 
     if (ctx.img_x != old_x || ctx.img_y != old_y) {
+        postpone_aa();
         app_redraw();
     }
 }
 
 /**
- * Rotate image 90 degrees.
- * @param clockwise rotation direction
+ * Background scaler thread: scale the next animation frame.
+ * @param data animation cache
+ * @return NULL
  */
-static void rotate_image(bool clockwise)
+static void* anim_scaler_thread(void* data)
 {
-    const struct pixmap* pm = &ctx.current->frames[ctx.frame].pm;
-    const ssize_t diff = (ssize_t)pm->width - pm->height;
-    const ssize_t shift = (ctx.scale * diff) / 2;
+    TRACE_SCOPE("anim_prescale");
+    struct anim_scaled* cache = data;
 
-    image_rotate(ctx.current, clockwise ? 90 : 270);
-    ctx.img_x += shift;
-    ctx.img_y -= shift;
-    fixup_position(false);
+    // the source is a private copy: the frame itself can be unloaded or
+    // transformed by the main thread meanwhile
+    pixmap_scale(cache->aa, &cache->src, &cache->dst, 0, 0, cache->src_scale,
+                 cache->alpha);
 
-    app_redraw();
+    return NULL;
 }
 
 /**
- * Set fixed scale for the image.
- * @param sc scale to set
+ * Wait for the background scaler and put its result to the cache.
  */
-static void set_scale(enum fixed_scale sc)
+static void anim_scaler_join(void)
 {
-    const struct pixmap* pm = &ctx.current->frames[ctx.frame].pm;
-    const size_t wnd_width = ui_get_width();
-    const size_t wnd_height = ui_get_height();
-    const float scale_w = 1.0 / ((float)pm->width / wnd_width);
-    const float scale_h = 1.0 / ((float)pm->height / wnd_height);
-
-    switch (sc) {
-        case scale_fit_optimal:
-            ctx.scale = min(scale_w, scale_h);
-            if (ctx.scale > 1.0) {
-                ctx.scale = 1.0;
-            }
-            break;
-        case scale_fit_window:
-            ctx.scale = min(scale_w, scale_h);
-            break;
-        case scale_fit_width:
-            ctx.scale = scale_w;
-            break;
-        case scale_fit_height:
-            ctx.scale = scale_h;
-            break;
-        case scale_fill_window:
-            ctx.scale = max(scale_w, scale_h);
-            break;
-        case scale_real_size:
-            ctx.scale = 1.0; // 100 %
-            break;
+    struct anim_scaled* cache = &ctx.anim;
+
+    if (cache->active) {
+        pthread_join(cache->tid, NULL);
+        cache->active = false;
+        cache->frames[cache->ahead] = cache->dst;
+        memset(&cache->dst, 0, sizeof(cache->dst));
+        pixmap_free(&cache->src);
+        memset(&cache->src, 0, sizeof(cache->src));
     }
-
-    fixup_position(true);
-    info_update(info_scale, "%.0f%%", ctx.scale * 100);
 }
 
 /**
- * Switch scale to one of fixed value.
- * @param params fixed scale to set
+ * Drop the cached scaled animation frames.
  */
-static void scale_image(const char* params)
+static void anim_scaled_reset(void)
 {
-    if (params && *params) {
-        ssize_t fixed_scale = str_index(scale_names, params, 0);
+    struct anim_scaled* cache = &ctx.anim;
 
-        if (fixed_scale >= 0) {
-            ctx.scale_init = fixed_scale;
-        } else {
-            fprintf(stderr, "Invalid scale operation: \"%s\"\n", params);
-            return;
-        }
-    } else {
-        // toggle to the next scale
-        ctx.scale_init++;
-        if (ctx.scale_init >= ARRAY_SIZE(scale_names)) {
-            ctx.scale_init = 0;
-        }
+    anim_scaler_join();
+
+    for (size_t i = 0; i < cache->num; ++i) {
+        pixmap_free(&cache->frames[i]);
     }
+    free(cache->frames);
 
-    info_update(info_status, "Scale %s", scale_names[ctx.scale_init]);
-    set_scale(ctx.scale_init);
-    app_redraw();
+    memset(cache, 0, sizeof(*cache));
 }
 
 /**
- * Zoom in/out.
- * @param params zoom operation
+ * Check if the current animation frame can be cached at the current scale.
+ * @param width,height size of the scaled frame
+ * @return true if frame can be cached
+ */
+static bool anim_scaled_init(size_t width, size_t height)
+{
+    struct anim_scaled* cache = &ctx.anim;
+
+    // don't cache intermediate scales of the zoom animation
+    if (ctx.aa_pending || ctx.motion.zoom || ctx.scale == 1.0 || width == 0 ||
+        height == 0 ||
+        width * height >
+            SCALED_MAX_WINDOWS * ui_get_width() * ui_get_height()) {
+        return false;
+    }
+
+    if (cache->image != ctx.current || cache->scale != ctx.scale ||
+        cache->aa != ctx.aa_mode) {
+        anim_scaled_reset();
+        cache->frames =
+            calloc(ctx.current->num_frames, sizeof(*cache->frames));
+        if (!cache->frames) {
+            return false;
+        }
+        cache->num = ctx.current->num_frames;
+        cache->image = ctx.current;
+        cache->scale = ctx.scale;
+        cache->aa = ctx.aa_mode;
+    }
+
+    return true;
+}
+
+/**
+ * Get animation frame scaled to the current scale, scale it if it is not
+ * cached yet.
+ * @param index frame index
+ * @return pointer to the scaled pixmap or NULL if it can not be cached
+ */
+static const struct pixmap* anim_scaled_get(size_t index)
+{
+    struct anim_scaled* cache = &ctx.anim;
+    const struct pixmap* pm = &ctx.current->frames[index].pm;
+    const size_t width = ctx.scale * pm->width;
+    const size_t height = ctx.scale * pm->height;
+    const size_t size = width * height * sizeof(argb_t);
+    struct pixmap* scaled;
+    double scale = ctx.scale;
+
+    if (!anim_scaled_init(width, height)) {
+        return NULL;
+    }
+    if (cache->active && cache->ahead == index) {
+        anim_scaler_join();
+    }
+
+    scaled = &cache->frames[index];
+    if (scaled->data) {
+        return scaled;
+    }
+
+    if (cache->memory + size > ANIM_SCALED_MAX ||
+        !pixmap_create(scaled, width, height)) {
+        return NULL;
+    }
+    cache->memory += size;
+    if (ctx.aa_mode != aa_nearest) {
+        // downscale from the nearest mipmap level
+        pm = image_mipmap(ctx.current, index, &scale);
+    }
+    pixmap_scale(ctx.aa_mode, pm, scaled, 0, 0, scale, ctx.current->alpha);
+
+    return scaled;
+}
+
+/**
+ * Scale animation frame in background to have it ready when it is shown.
+ * @param index frame index
+ */
+static void anim_scaled_ahead(size_t index)
+{
+    struct anim_scaled* cache = &ctx.anim;
+    const struct pixmap* pm = &ctx.current->frames[index].pm;
+    const size_t width = ctx.scale * pm->width;
+    const size_t height = ctx.scale * pm->height;
+    const size_t size = width * height * sizeof(argb_t);
+    double scale = ctx.scale;
+
+    if (!pm->data || !anim_scaled_init(width, height)) {
+        return;
+    }
+
+    anim_scaler_join(); // previous one
+    if (cache->frames[index].data || cache->memory + size > ANIM_SCALED_MAX) {
+        return;
+    }
+
+    if (ctx.aa_mode != aa_nearest) {
+        // downscale from the nearest mipmap level
+        pm = image_mipmap(ctx.current, index, &scale);
+    }
+    if (!pixmap_create(&cache->src, pm->width, pm->height)) {
+        return;
+    }
+    if (!pixmap_create(&cache->dst, width, height)) {
+        pixmap_free(&cache->src);
+        memset(&cache->src, 0, sizeof(cache->src));
+        return;
+    }
+    pixmap_copy(pm, &cache->src, 0, 0, false);
+
+    cache->ahead = index;
+    cache->src_scale = scale;
+    cache->alpha = ctx.current->alpha;
+    cache->memory += size;
+    cache->active =
+        pthread_create(&cache->tid, NULL, anim_scaler_thread, cache) == 0;
+    if (!cache->active) {
+        pixmap_free(&cache->src);
+        pixmap_free(&cache->dst);
+        memset(&cache->src, 0, sizeof(cache->src));
+        memset(&cache->dst, 0, sizeof(cache->dst));
+        cache->memory -= size;
+    }
+}
+
+/**
+ * Drop the cached scaled image, must be called on any change of the pixels.
+ */
+static void scaled_reset(void)
+{
+    if (ctx.scaled.layer) {
+        ui_set_image(NULL);
+    }
+    pixmap_free(&ctx.scaled.pm);
+    memset(&ctx.scaled, 0, sizeof(ctx.scaled));
+    anim_scaled_reset();
+#ifdef HAVE_LIBRSVG
+    svg_partial_reset();
+#endif
+}
+
+/**
+ * Rotate image 90 degrees.
+ * @param clockwise rotation direction
+ */
+static void rotate_image(bool clockwise)
+{
+    const struct pixmap* pm = &ctx.current->frames[ctx.frame].pm;
+    const ssize_t diff = (ssize_t)pm->width - pm->height;
+    const ssize_t shift = (ctx.scale * diff) / 2;
+
+    motion_stop(true);
+    image_rotate(ctx.current, clockwise ? 90 : 270);
+    image_frame_load(ctx.current, ctx.frame);
+    scaled_reset();
+    ctx.img_x += shift;
+    ctx.img_y -= shift;
+    fixup_position(false);
+
+    app_redraw();
+}
+
+/**
+ * Calculate fixed scale for the image.
+ * @param sc fixed scale type
+ * @param pm image frame
+ * @param wnd_width,wnd_height window size
+ * @return scale factor
+ */
+static double calc_scale(enum fixed_scale sc, const struct pixmap* pm,
+                         size_t wnd_width, size_t wnd_height)
+{
+    const float scale_w = 1.0 / ((float)pm->width / wnd_width);
+    const float scale_h = 1.0 / ((float)pm->height / wnd_height);
+    double scale = 1.0;
+
+    switch (sc) {
+        case scale_fit_optimal:
+            scale = min(scale_w, scale_h);
+            if (scale > 1.0) {
+                scale = 1.0;
+            }
+            break;
+        case scale_fit_window:
+            scale = min(scale_w, scale_h);
+            break;
+        case scale_fit_width:
+            scale = scale_w;
+            break;
+        case scale_fit_height:
+            scale = scale_h;
+            break;
+        case scale_fill_window:
+            scale = max(scale_w, scale_h);
+            break;
+        case scale_real_size:
+            scale = 1.0; // 100 %
+            break;
+    }
+
+    return scale;
+}
+
+/**
+ * Set fixed scale for the image.
+ * @param sc scale to set
+ */
+static void set_scale(enum fixed_scale sc)
+{
+    motion_stop(false);
+
+    ctx.scale = calc_scale(sc, &ctx.current->frames[ctx.frame].pm,
+                           ui_get_width(), ui_get_height());
+
+    fixup_position(true);
+    info_update(info_scale, "%.0f%%", ctx.scale * 100);
+}
+
+/**
+ * Switch scale to one of fixed value.
+ * @param params fixed scale to set
+ */
+static void scale_image(const char* params)
+{
+    if (params && *params) {
+        ssize_t fixed_scale = str_index(scale_names, params, 0);
+
+        if (fixed_scale >= 0) {
+            ctx.scale_init = fixed_scale;
+        } else {
+            fprintf(stderr, "Invalid scale operation: \"%s\"\n", params);
+            return;
+        }
+    } else {
+        // toggle to the next scale
+        ctx.scale_init++;
+        if (ctx.scale_init >= ARRAY_SIZE(scale_names)) {
+            ctx.scale_init = 0;
+        }
+    }
+
+    info_update(info_status, "Scale %s", scale_names[ctx.scale_init]);
+    set_scale(ctx.scale_init);
+    app_redraw();
+}
+
+/**
+ * Zoom in/out.
+ * @param params zoom operation
  */
 static void zoom_image(const char* params)
 {
@@ -482,33 +1246,42 @@ static void zoom_image(const char* params)
         set_scale(fixed_scale);
     } else if (str_to_num(params, 0, &percent, 0) && percent != 0 &&
                percent > -1000 && percent < 1000) {
-        // zoom in %
+        // zoom in %, starting from the target of the zoom in progress
         const double wnd_half_w = (double)ui_get_width() / 2;
         const double wnd_half_h = (double)ui_get_height() / 2;
-        const float step = (ctx.scale / 100) * percent;
-        const double center_x = wnd_half_w / ctx.scale - ctx.img_x / ctx.scale;
-        const double center_y = wnd_half_h / ctx.scale - ctx.img_y / ctx.scale;
+        double scale = ctx.motion.zoom ? ctx.motion.scale : ctx.scale;
+        const float step = (scale / 100) * percent;
 
         if (percent > 0) {
-            ctx.scale += step;
-            if (ctx.scale > MAX_SCALE) {
-                ctx.scale = MAX_SCALE;
+            scale += step;
+            if (scale > MAX_SCALE) {
+                scale = MAX_SCALE;
             }
         } else {
             const struct pixmap* pm = &ctx.current->frames[ctx.frame].pm;
             const float scale_w = (float)MIN_SCALE / pm->width;
             const float scale_h = (float)MIN_SCALE / pm->height;
             const float scale_min = max(scale_w, scale_h);
-            ctx.scale += step;
-            if (ctx.scale < scale_min) {
-                ctx.scale = scale_min;
+            scale += step;
+            if (scale < scale_min) {
+                scale = scale_min;
             }
         }
 
-        // restore center
-        ctx.img_x = wnd_half_w - center_x * ctx.scale;
-        ctx.img_y = wnd_half_h - center_y * ctx.scale;
-        fixup_position(false);
+        // keep the window center on the same point of the image
+        if (!ctx.motion.zoom) {
+            ctx.motion.center_x = (wnd_half_w - ctx.img_x) / ctx.scale;
+            ctx.motion.center_y = (wnd_half_h - ctx.img_y) / ctx.scale;
+        }
+        ctx.motion.kinetic = false;
+        ctx.motion.scale = scale;
+        ctx.motion.zoom = true;
+        if (ctx.motion.enable) {
+            clock_gettime(CLOCK_MONOTONIC, &ctx.motion.last);
+        } else {
+            motion_stop(true);
+        }
+        postpone_aa();
     } else {
         fprintf(stderr, "Invalid zoom operation: \"%s\"\n", params);
     }
@@ -517,6 +1290,53 @@ static void zoom_image(const char* params)
     app_redraw();
 }
 
+/**
+ * Change window of high bit depth image (e.g. DICOM).
+ * @param center true to move window center (level), false to change width
+ * @param params step in percents of the sample range, empty to reset window
+ */
+static void change_window(bool center, const char* params)
+{
+    const struct image_levels* levels = ctx.current->levels;
+    ssize_t percent = 0;
+    bool rc;
+
+    if (!levels) {
+        info_update(info_status, "No high bit depth data in the image");
+        app_redraw();
+        return;
+    }
+
+    if (!params || !*params) {
+        rc = image_set_window(ctx.current, 0, 0);
+    } else if (str_to_num(params, 0, &percent, 0) && percent != 0 &&
+               percent > -100 && percent < 100) {
+        const ssize_t range = levels->max - levels->min + 1;
+        ssize_t pos = levels->center + levels->offset;
+        ssize_t width = levels->width;
+        ssize_t step = (range * percent) / 100;
+        if (step == 0) {
+            step = percent > 0 ? 1 : -1;
+        }
+        if (center) {
+            pos += step;
+        } else {
+            width = max(1, width + step);
+        }
+        rc = image_set_window(ctx.current, pos, width);
+    } else {
+        fprintf(stderr, "Invalid window operation: \"%s\"\n", params);
+        return;
+    }
+
+    if (rc) {
+        info_update(info_status, "Window: level %zd, width %zu",
+                    (ssize_t)levels->center + levels->offset, levels->width);
+        scaled_reset();
+    }
+    app_redraw();
+}
+
 /**
  * Toggle zoom keeping mode.
  */
@@ -529,6 +1349,7 @@ static void toggle_keep_zoom(void)
 
 /**
  * Start/stop animation if image supports it.
+ * The frame clock starts from now, the current frame is shown in full.
  * @param enable state to set
  */
 static void animation_ctl(bool enable)
@@ -539,13 +1360,125 @@ static void animation_ctl(bool enable)
         const size_t duration = ctx.current->frames[ctx.frame].duration;
         enable = (ctx.current->num_frames > 1 && duration);
         if (enable) {
-            ts.it_value.tv_sec = duration / 1000;
-            ts.it_value.tv_nsec = (duration % 1000) * 1000000;
+            clock_gettime(CLOCK_MONOTONIC, &ctx.animation_due);
+            time_add(&ctx.animation_due, duration);
+            ts.it_value = ctx.animation_due;
         }
     }
 
     ctx.animation_enable = enable;
-    timerfd_settime(ctx.animation_fd, 0, &ts, NULL);
+    ctx.animation_dropped = 0;
+    timerfd_settime(ctx.animation_fd, TFD_TIMER_ABSTIME, &ts, NULL);
+}
+
+/**
+ * Slideshow prefetch thread: load the next image and pre-scale its first
+ * frame in the same way as get_scaled() does.
+ * @return NULL
+ */
+static void* prefetch_thread(__attribute__((unused)) void* data)
+{
+    TRACE_SCOPE("slideshow_prefetch");
+    struct image* img = prefetch.image;
+    struct timespec start;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    img->cancel = &prefetch.cancel;
+    prefetch.success = (image_load(img) == imgload_success);
+    img->cancel = NULL;
+    if (!prefetch.success) {
+        return NULL;
+    }
+    decode_stats_put(img->source, elapsed_ms(&start));
+
+    if (prefetch.prescale && img->num_frames == 1) {
+        const struct pixmap* pm = &img->frames[0].pm;
+        double scale = calc_scale(prefetch.sc, pm, prefetch.wnd_width,
+                                  prefetch.wnd_height);
+        const size_t width = scale * pm->width;
+        const size_t height = scale * pm->height;
+        if (scale != 1.0 && width && height &&
+            width * height <= SCALED_MAX_WINDOWS * prefetch.wnd_width *
+                    prefetch.wnd_height &&
+            pixmap_create(&prefetch.scaled, width, height)) {
+            prefetch.scale = scale;
+            if (prefetch.aa != aa_nearest) {
+                // downscale from the nearest mipmap level
+                pm = image_mipmap(img, 0, &scale);
+            }
+            pixmap_scale(prefetch.aa, pm, &prefetch.scaled, 0, 0, scale,
+                         img->alpha);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Start loading the next slideshow image in background.
+ * @param img image to load
+ */
+static void prefetch_start(const struct image* img)
+{
+    prefetch.image = image_create(img->source);
+    if (!prefetch.image) {
+        return;
+    }
+
+    prefetch.cancel = false;
+    prefetch.success = false;
+    prefetch.prescale = !ctx.keep_zoom;
+    prefetch.sc = ctx.scale_init;
+    prefetch.wnd_width = ui_get_width();
+    prefetch.wnd_height = ui_get_height();
+    prefetch.aa = ctx.aa_mode;
+    prefetch.scale = 0;
+
+    prefetch.active =
+        pthread_create(&prefetch.tid, NULL, prefetch_thread, NULL) == 0;
+    if (!prefetch.active) {
+        image_free(prefetch.image, IMGFREE_ALL);
+        prefetch.image = NULL;
+    }
+}
+
+/**
+ * Stop slideshow prefetch and free its data.
+ */
+static void prefetch_stop(void)
+{
+    if (prefetch.active) {
+        prefetch.cancel = true;
+        pthread_join(prefetch.tid, NULL);
+        prefetch.active = false;
+    }
+    if (prefetch.image) {
+        image_free(prefetch.image, IMGFREE_ALL);
+        prefetch.image = NULL;
+    }
+    pixmap_free(&prefetch.scaled);
+    memset(&prefetch.scaled, 0, sizeof(prefetch.scaled));
+}
+
+/**
+ * Set slideshow timer relative to the time of switching to the next image.
+ * @param before time before switching in milliseconds, 0 for the switch
+ */
+static void slideshow_timer(double before)
+{
+    struct itimerspec ts = { 0 };
+    int64_t ns;
+
+    if (before > ctx.slideshow_time * 1000.0) {
+        before = ctx.slideshow_time * 1000.0;
+    }
+    ns = (int64_t)ctx.slideshow_due.tv_sec * 1000000000 +
+        ctx.slideshow_due.tv_nsec - (int64_t)(before * 1000000);
+    ts.it_value.tv_sec = ns / 1000000000;
+    ts.it_value.tv_nsec = ns % 1000000000;
+
+    ctx.slideshow_early = (before > 0);
+    timerfd_settime(ctx.slideshow_fd, TFD_TIMER_ABSTIME, &ts, NULL);
 }
 
 /**
@@ -554,14 +1487,19 @@ static void animation_ctl(bool enable)
  */
 static void slideshow_ctl(bool enable)
 {
-    struct itimerspec ts = { 0 };
-
     ctx.slideshow_enable = enable;
+
     if (enable) {
-        ts.it_value.tv_sec = ctx.slideshow_time;
+        clock_gettime(CLOCK_MONOTONIC, &ctx.slideshow_due);
+        ctx.slideshow_due.tv_sec += ctx.slideshow_time;
+        // check the next image early enough to load the slowest file type
+        slideshow_timer(decode_stats_max() + SLIDESHOW_MARGIN);
+    } else {
+        struct itimerspec ts = { 0 };
+        ctx.slideshow_early = false;
+        timerfd_settime(ctx.slideshow_fd, 0, &ts, NULL);
+        prefetch_stop();
     }
-
-    timerfd_settime(ctx.slideshow_fd, 0, &ts, NULL);
 }
 
 /**
@@ -569,7 +1507,10 @@ static void slideshow_ctl(bool enable)
  */
 static void reset_state(void)
 {
+    motion_stop(false);
     ctx.frame = 0;
+    cancel_aa();
+    scaled_reset();
 
     if (!ctx.keep_zoom || ctx.scale == 0) {
         set_scale(ctx.scale_init);
@@ -597,25 +1538,342 @@ static void reset_state(void)
 }
 
 /**
- * Load image and set it as the current.
+ * Show coarse approximation of the image while decoding is still in progress.
+ * @param pm preview pixmap
+ */
+static void show_preview(const struct pixmap* pm)
+{
+    struct pixmap* wnd = ui_draw_begin();
+    ssize_t x, y;
+    size_t width, height;
+    double scale;
+
+    if (!wnd) {
+        return; // previous frame not shown yet
+    }
+
+    // fit into the window but never enlarge (optimal scale)
+    scale = min((double)wnd->width / pm->width,
+                (double)wnd->height / pm->height);
+    if (scale > 1.0) {
+        scale = 1.0;
+    }
+    width = scale * pm->width;
+    height = scale * pm->height;
+    x = wnd->width / 2 - width / 2;
+    y = wnd->height / 2 - height / 2;
+
+    pixmap_inverse_fill(wnd, x, y, width, height, ctx.window_bkg);
+    pixmap_scale(aa_nearest, pm, wnd, x, y, scale, false);
+
+    ui_draw_commit();
+    ui_flush();
+}
+
+/**
+ * Progressive decoding handler for images loaded in the main thread.
+ * @param img image being loaded
+ */
+static void on_progress(const struct image* img)
+{
+    show_preview(&img->frames[0].pm);
+}
+
+/**
+ * Update performance fields of the info overlay: cache hits and memory.
+ */
+static void update_stats(void)
+{
+    if (info_has_field(info_cache_hits)) {
+        const size_t total = ctx.cache_hits + ctx.cache_misses;
+        info_update(info_cache_hits, "%zu%% (%zu of %zu)",
+                    total ? ctx.cache_hits * 100 / total : 0, ctx.cache_hits,
+                    total);
+    }
+    if (info_has_field(info_memory)) {
+        const size_t memory = cache_memory(ctx.history) +
+            cache_memory(ctx.preload) + image_memory(ctx.current) +
+            ctx.anim.memory;
+        info_update(info_memory, "%.02f MiB",
+                    (double)memory / (1024 * 1024));
+    }
+    if (info_has_field(info_memstat)) {
+        char summary[256];
+        memstat_summary(summary, sizeof(summary));
+        info_update(info_memstat, "%s", summary);
+    }
+}
+
+/**
+ * Load image in the main thread with preview of progressive images.
+ * @param img image to load
+ * @return loader status
+ */
+static enum image_status load_image(struct image* img)
+{
+    enum image_status status;
+    struct timespec start;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    img->progress = on_progress;
+    status = image_load(img);
+    img->progress = NULL;
+
+    if (status == imgload_success) {
+        const double ms = elapsed_ms(&start);
+        info_update(info_decode_time, "%.1f ms", ms);
+        decode_stats_put(img->source, ms);
+    }
+
+    return status;
+}
+
+#ifdef HAVE_LIBRSVG
+/**
+ * Re-render thread: decodes the copy of the current image at a new size.
+ * @param data image to render
+ */
+static void* rerender_thread(void* data)
+{
+    const uint64_t value = 1;
+    ssize_t len;
+
+    rerender.rc = image_load(data);
+
+    do {
+        len = write(rerender.notify, &value, sizeof(value));
+    } while (len == -1 && errno == EINTR);
+
+    return NULL;
+}
+#endif // HAVE_LIBRSVG
+
+/**
+ * Stop background re-render and drop its result.
+ */
+static void rerender_cancel(void)
+{
+    rerender.pending = false;
+    if (rerender.image) {
+        pthread_join(rerender.tid, NULL);
+        image_free(rerender.image, IMGFREE_ALL);
+        rerender.image = NULL;
+    }
+}
+
+/**
+ * Set image as the current one, the image must be loaded.
+ * @param img image to set
+ */
+static void set_current(struct image* img)
+{
+    if (img != ctx.current) {
+        rerender_cancel();
+    }
+    if (ctx.placeholder) {
+        // thumbnail is not a decoded image, don't keep it in history
+        ctx.placeholder = false;
+        ctx.scale = 0; // don't keep zoom of the placeholder
+        if (img != ctx.current) {
+            image_free(ctx.current, IMGFREE_FRAMES);
+        }
+    } else if (img != ctx.current && !cache_put(ctx.history, ctx.current)) {
+        image_free(ctx.current, IMGFREE_FRAMES);
+    }
+    ctx.current = img;
+    preloader_start();
+    reset_state();
+}
+
+/**
+ * Notify the main thread about opener state change.
+ */
+static void opener_notify(void)
+{
+    const uint64_t value = 1;
+    ssize_t len;
+
+    do {
+        len = write(opener.notify, &value, sizeof(value));
+    } while (len == -1 && errno == EINTR);
+}
+
+/**
+ * Progressive decoding handler for images loaded by the opener thread.
+ * @param img image being loaded
+ */
+static void opener_progress(const struct image* img)
+{
+    const struct pixmap* pm = &img->frames[0].pm;
+
+    pthread_mutex_lock(&opener.lock);
+    if (!opener.request) { // not superseded by a newer request
+        pixmap_free(&opener.preview);
+        if (pixmap_create(&opener.preview, pm->width, pm->height)) {
+            pixmap_copy(pm, &opener.preview, 0, 0, false);
+            opener_notify();
+        }
+    }
+    pthread_mutex_unlock(&opener.lock);
+}
+
+/**
+ * Opener thread: loads the most recently requested image.
+ */
+static void* opener_thread(__attribute__((unused)) void* data)
+{
+    pthread_mutex_lock(&opener.lock);
+
+    while (opener.active) {
+        struct image* img;
+        enum image_status status = imgload_ioerror;
+        struct timespec start = { 0 };
+
+        if (!opener.request) {
+            pthread_cond_wait(&opener.wakeup, &opener.lock);
+            continue;
+        }
+
+        // load copy of the image, the list entry can be removed meanwhile
+        img = image_create(opener.request);
+        free(opener.request);
+        opener.request = NULL;
+        opener.cancel = false;
+        pthread_mutex_unlock(&opener.lock);
+
+        if (img && !loadsvc_begin(img->source, true)) {
+            // decoded by preloader, frames are already in the list entry
+            status = imgload_success;
+        } else if (img) {
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            img->cancel = &opener.cancel;
+            img->progress = opener_progress;
+            status = image_load(img);
+            img->cancel = NULL;
+            img->progress = NULL;
+            // result is put to the list entry later by the main thread
+            loadsvc_end(img->source, true, false);
+        }
+
+        pthread_mutex_lock(&opener.lock);
+        if (img && !opener.request) {
+            if (opener.result) {
+                image_free(opener.result, IMGFREE_ALL);
+            }
+            opener.result = img;
+            opener.rc = status;
+            opener.decode_time = elapsed_ms(&start);
+            opener_notify();
+            if (status == imgload_success) {
+                decode_stats_put(img->source, opener.decode_time);
+            }
+        } else if (img) {
+            image_free(img, IMGFREE_ALL); // superseded by a newer request
+        }
+    }
+
+    pthread_mutex_unlock(&opener.lock);
+
+    return NULL;
+}
+
+/**
+ * Cancel background opening of the image.
+ */
+static void opener_cancel(void)
+{
+    free(ctx.target);
+    ctx.target = NULL;
+
+    pthread_mutex_lock(&opener.lock);
+    free(opener.request);
+    opener.request = NULL;
+    opener.cancel = true;
+    if (opener.result) {
+        image_free(opener.result, IMGFREE_ALL);
+        opener.result = NULL;
+    }
+    pthread_mutex_unlock(&opener.lock);
+}
+
+/**
+ * Start loading the image in background, the newer request replaces the
+ * previous one and cancels its decoding.
+ * @param img image to open
+ * @param forward preferred direction after skipping file
+ */
+static void opener_request(const struct image* img, bool forward)
+{
+    opener_cancel();
+
+    if (opener.notify == -1) {
+        return; // eventfd is not available
+    }
+
+    ctx.target = strdup(img->source);
+    if (!ctx.target) {
+        return;
+    }
+    ctx.forward = forward;
+
+    pthread_mutex_lock(&opener.lock);
+    opener.request = strdup(img->source);
+    pixmap_free(&opener.preview);
+    memset(&opener.preview, 0, sizeof(opener.preview));
+    if (!opener.active) {
+        opener.active =
+            pthread_create(&opener.tid, NULL, opener_thread, NULL) == 0;
+    }
+    pthread_cond_signal(&opener.wakeup);
+    pthread_mutex_unlock(&opener.lock);
+}
+
+/**
+ * Stop opener thread.
+ */
+static void opener_stop(void)
+{
+    bool active;
+
+    opener_cancel();
+
+    pthread_mutex_lock(&opener.lock);
+    active = opener.active;
+    opener.active = false;
+    pthread_cond_signal(&opener.wakeup);
+    pthread_mutex_unlock(&opener.lock);
+
+    if (active) {
+        pthread_join(opener.tid, NULL);
+    }
+
+    opener_cancel(); // free the last result
+    pixmap_free(&opener.preview);
+    memset(&opener.preview, 0, sizeof(opener.preview));
+}
+
+/**
+ * Load image and set it as the current, the image is loaded in the main
+ * thread.
  * @param img image to open
  * @param forward preferred direction after skipping file
  * @return pointer to `ctx.current` or NULL if image list is empty
  */
-static struct image* open_image(struct image* img, bool forward)
+static struct image* open_image_sync(struct image* img, bool forward)
 {
-#ifdef HAVE_LIBRSVG
-    reset_svg_render_size();
-#endif // HAVE_LIBRSVG
+    opener_cancel();
 
     while (img) {
         struct image* next;
 
         // get file form history/preload cache
         if (cache_out(ctx.preload, img) || cache_out(ctx.history, img)) {
+            ++ctx.cache_hits;
             break;
         }
-        if (image_load(img) == imgload_success) {
+        ++ctx.cache_misses;
+        if (load_image(img) == imgload_success) {
             break;
         }
 
@@ -630,29 +1888,199 @@ static struct image* open_image(struct image* img, bool forward)
     }
 
     if (img) {
-        if (!cache_put(ctx.history, ctx.current)) {
-            image_free(ctx.current, IMGFREE_FRAMES);
+        set_current(img);
+    }
+
+    return img;
+}
+
+/**
+ * Skip current image file.
+ * @param remove flag to remove current image from the image list
+ * @return true if next image opened
+ */
+static bool skip_current(bool remove)
+{
+    struct image* curr = ctx.current;
+    struct image* next;
+
+    next = imglist_next_file(ctx.current);
+    next = open_image_sync(next, true);
+    if (!next) {
+        next = imglist_prev_file(ctx.current);
+        next = open_image_sync(next, false);
+    }
+
+    if (!next) {
+        fprintf(stderr, "No more images to view, exit\n");
+        app_exit(0);
+    } else if (remove) {
+        imglist_remove(curr);
+    }
+
+    return next;
+}
+
+/**
+ * Open image: set it as the current if it is already loaded, otherwise
+ * start loading in background and keep showing the current image until
+ * the new one is ready.
+ * @param img image to open
+ * @param forward preferred direction after skipping file
+ * @return false if there is nothing to open
+ */
+static bool open_image(struct image* img, bool forward)
+{
+    if (!img) {
+        return false;
+    }
+
+    if (img == ctx.current && image_has_frames(img)) {
+        opener_cancel();
+        set_current(img);
+    } else if (cache_out(ctx.preload, img) || cache_out(ctx.history, img)) {
+        ++ctx.cache_hits;
+        opener_cancel();
+        set_current(img);
+    } else if (opener.notify != -1) {
+        ++ctx.cache_misses;
+        opener_request(img, forward);
+    } else {
+        return open_image_sync(img, forward);
+    }
+
+    return true;
+}
+
+/** Opener notification handler: apply result of background loading. */
+static void on_opened(__attribute__((unused)) void* data)
+{
+    struct image* img;
+    struct image* origin;
+    struct pixmap preview;
+    enum image_status status;
+    double decode_time;
+    uint64_t value;
+    ssize_t len;
+
+    do {
+        len = read(opener.notify, &value, sizeof(value));
+    } while (len == -1 && errno == EINTR);
+
+    pthread_mutex_lock(&opener.lock);
+    img = opener.result;
+    status = opener.rc;
+    decode_time = opener.decode_time;
+    opener.result = NULL;
+    preview = opener.preview;
+    memset(&opener.preview, 0, sizeof(opener.preview));
+    pthread_mutex_unlock(&opener.lock);
+
+    if (preview.data) {
+        if (!img && ctx.target) {
+            show_preview(&preview);
+        }
+        pixmap_free(&preview);
+    }
+
+    if (!img) {
+        return;
+    }
+    if (!ctx.target || strcmp(ctx.target, img->source) != 0) {
+        image_free(img, IMGFREE_ALL); // outdated
+        return;
+    }
+
+    imglist_lock();
+
+    origin = imglist_find(img->source);
+    if (!origin) {
+        opener_cancel(); // removed from the list while loading
+    } else if (status == imgload_success && !image_has_frames(img) &&
+               !image_has_frames(origin)) {
+        // decoded by preloader, but already evicted from its cache
+        opener_request(origin, ctx.forward);
+    } else if (status == imgload_success) {
+        cache_out(ctx.preload, origin);
+        cache_out(ctx.history, origin);
+        if (image_has_frames(img)) {
+            if (origin == ctx.current && ctx.placeholder) {
+                image_free(origin, IMGFREE_FRAMES); // replace thumbnail
+            }
+            image_update(origin, img);
+            info_update(info_decode_time, "%.1f ms", decode_time);
+        }
+        opener_cancel();
+        set_current(origin);
+    } else if (origin == ctx.current && ctx.placeholder) {
+        opener_cancel();
+        skip_current(true);
+    } else {
+        // skip and jump to the nearest entry
+        struct image* next = ctx.forward ? imglist_next_file(origin)
+                                         : imglist_prev_file(origin);
+        if (next == ctx.current || origin == ctx.current) {
+            opener_cancel();
+        } else {
+            imglist_remove(origin);
+            if (!open_image(next, ctx.forward)) {
+                opener_cancel();
+            }
+        }
+    }
+
+    imglist_unlock();
+
+    image_free(img, IMGFREE_ALL);
+}
+
+/**
+ * Walk through the image list without loading images.
+ * @param base start position
+ * @param step function to get the next position
+ * @param count number of steps
+ * @return image at the final position or NULL if there is no next image
+ */
+static struct image* walk_imglist(struct image* base,
+                                  struct image* (*step)(struct image*),
+                                  size_t count)
+{
+    struct image* next = NULL;
+
+    while (count--) {
+        struct image* img = step(base);
+        if (!img || img == base) {
+            break;
         }
-        ctx.current = img;
-        preloader_start();
-        reset_state();
+        next = base = img;
     }
 
-    return img;
+    return next;
 }
 
 /**
  * Switch to the next image.
  * @param direction next image position
+ * @param count number of files to skip for prev/next file direction
  * @return true if next image was loaded
  */
-static bool next_image(enum action_type direction)
+static bool next_image(enum action_type direction, size_t count)
 {
+    struct image* base = NULL;
     struct image* next;
     bool forward = false; // preferred direction after skipping file
+    bool rc;
 
     imglist_lock();
 
+    // navigate from the image being opened, if any
+    if (ctx.target) {
+        base = imglist_find(ctx.target);
+    }
+    if (!base) {
+        base = ctx.current;
+    }
+
     switch (direction) {
         case action_first_file:
             next = imglist_first();
@@ -662,21 +2090,25 @@ static bool next_image(enum action_type direction)
             next = imglist_last();
             break;
         case action_prev_dir:
-            next = imglist_prev_dir(ctx.current);
+            next = imglist_prev_dir(base);
             break;
         case action_next_dir:
-            next = imglist_next_dir(ctx.current);
+            next = imglist_next_dir(base);
             forward = true;
             break;
         case action_prev_file:
-            next = imglist_prev_file(ctx.current);
+            next = walk_imglist(base, imglist_prev_file, count);
             break;
         case action_next_file:
-            next = imglist_next_file(ctx.current);
+            next = walk_imglist(base, imglist_next_file, count);
             forward = true;
             break;
         case action_rand_file:
-            next = imglist_rand(ctx.current);
+            // use the image chosen (and preloaded) in the previous step
+            next = ctx.rand_next ? imglist_find(ctx.rand_next) : NULL;
+            if (!next || next == base) {
+                next = imglist_size() > 1 ? imglist_rand(base) : NULL;
+            }
             forward = true;
             break;
         default:
@@ -684,11 +2116,60 @@ static bool next_image(enum action_type direction)
             break;
     }
 
-    next = open_image(next, forward);
+    // choose the next random image in advance to preload it
+    free(ctx.rand_next);
+    ctx.rand_next = NULL;
+    if (direction == action_rand_file && next && imglist_size() > 2) {
+        ctx.rand_next = strdup(imglist_rand(next)->source);
+    }
+
+    // follow the pace of browsing to preload where the user is going
+    if (direction == action_prev_file || direction == action_next_file) {
+        predict_move(&ctx.predict, forward ? (ssize_t)count : -(ssize_t)count);
+    } else {
+        predict_reset(&ctx.predict);
+    }
+
+    ctx.backward = !forward;
+    rc = open_image(next, forward);
 
     imglist_unlock();
 
-    return next;
+    return rc;
+}
+
+/**
+ * Switch to the specified frame.
+ * @param index index of the frame to show
+ * @return false if frame can not be decoded
+ */
+static bool switch_frame(size_t index)
+{
+    if (index == ctx.frame) {
+        return true;
+    }
+
+    if (!image_frame_load(ctx.current, index)) {
+        info_update(info_status, "Unable to decode frame %zu", index + 1);
+        animation_ctl(false);
+        app_redraw();
+        return false;
+    }
+
+    ctx.frame = index;
+    if (ctx.animation_dropped) {
+        info_update(info_frame, "%zu of %zu (%zu dropped)", ctx.frame + 1,
+                    ctx.current->num_frames, ctx.animation_dropped);
+    } else {
+        info_update(info_frame, "%zu of %zu", ctx.frame + 1,
+                    ctx.current->num_frames);
+    }
+    info_update(info_image_size, "%zux%zu",
+                ctx.current->frames[ctx.frame].pm.width,
+                ctx.current->frames[ctx.frame].pm.height);
+    app_redraw();
+
+    return true;
 }
 
 /**
@@ -709,55 +2190,267 @@ static void next_frame(bool forward)
         }
     }
 
-    if (index != ctx.frame) {
-        ctx.frame = index;
-        info_update(info_frame, "%zu of %zu", ctx.frame + 1,
-                    ctx.current->num_frames);
-        info_update(info_image_size, "%zux%zu",
-                    ctx.current->frames[ctx.frame].pm.width,
-                    ctx.current->frames[ctx.frame].pm.height);
+    switch_frame(index);
+}
+
+#ifdef HAVE_LIBRSVG
+/**
+ * Replace the raster of the current image with the re-rendered one.
+ * @param img re-rendered copy of the current image
+ * @param status rendering status
+ */
+static void rerender_apply(struct image* img, enum image_status status)
+{
+    struct image* curr = ctx.current;
+    const size_t width = curr->frames[0].pm.width;
+
+    if (status != imgload_success) {
+        info_update(info_status, "Unable to rerender SVG");
+        app_redraw();
+        return;
+    }
+
+    image_free(curr, IMGFREE_FRAMES);
+    image_update(curr, img);
+
+    // keep the visible size of the image, zoom can be changed meanwhile
+    ctx.frame = 0;
+    ctx.scale *= (double)width / curr->frames[0].pm.width;
+    ctx.img_w = curr->frames[0].pm.width;
+    ctx.img_h = curr->frames[0].pm.height;
+    scaled_reset();
+    fixup_position(false);
+
+    info_reset(curr);
+    info_update(info_status, "SVG rerendered");
+    info_update(info_scale, "%.0f%%", ctx.scale * 100);
+    app_redraw();
+}
+
+/**
+ * Start re-rendering of the current SVG image at the current scale, the old
+ * raster is shown until the new one is ready.
+ */
+static void rerender_start(void)
+{
+    struct image* img;
+
+    if (rerender.image) {
+        rerender.pending = true; // restart when the current one is ready
+        return;
+    }
+    rerender.pending = false;
+
+    img = image_create(ctx.current->source);
+    if (!img) {
+        return;
+    }
+    img->render_size = svg_render_size(ctx.current) * ctx.scale;
+
+    if (rerender.notify == -1) {
+        rerender_apply(img, image_load(img)); // eventfd is not available
+        image_free(img, IMGFREE_ALL);
+    } else if (pthread_create(&rerender.tid, NULL, rerender_thread, img)) {
+        image_free(img, IMGFREE_ALL);
+    } else {
+        rerender.image = img;
+        info_update(info_status, "Rendering SVG...");
         app_redraw();
     }
 }
 
-/** Animation timer event handler. */
+/** Re-render notification handler: apply result of background rendering. */
+static void on_rerendered(__attribute__((unused)) void* data)
+{
+    struct image* img = rerender.image;
+    uint64_t value;
+    ssize_t len;
+
+    do {
+        len = read(rerender.notify, &value, sizeof(value));
+    } while (len == -1 && errno == EINTR);
+
+    if (!img) {
+        return; // cancelled
+    }
+    pthread_join(rerender.tid, NULL);
+    rerender.image = NULL;
+
+    imglist_lock();
+    rerender_apply(img, rerender.rc);
+    if (rerender.pending && !ctx.aa_pending) {
+        rerender_start();
+    }
+    imglist_unlock();
+
+    image_free(img, IMGFREE_ALL);
+}
+#endif // HAVE_LIBRSVG
+
+/**
+ * Animation timer event handler.
+ * Frames are scheduled on absolute deadlines, so time spent on rendering
+ * doesn't slow down the playback. If rendering falls behind, the frames
+ * whose display time has already passed are skipped.
+ */
 static void on_animation_timer(__attribute__((unused)) void* data)
 {
-    next_frame(true);
-    animation_ctl(true);
+    const size_t num = ctx.current->num_frames;
+    struct itimerspec ts = { 0 };
+    size_t index = (ctx.frame + 1) % num;
+    size_t skipped = 0;
+    size_t dropped = 0;
+    double late;
+
+    if (!ctx.animation_enable) {
+        return;
+    }
+
+    // skip frames that should already have been replaced by the next ones
+    late = elapsed_ms(&ctx.animation_due);
+    while (late >= ctx.current->frames[index].duration) {
+        const size_t duration = ctx.current->frames[index].duration;
+        if (++skipped >= num) {
+            // too far behind (system was suspended?), restart the clock
+            clock_gettime(CLOCK_MONOTONIC, &ctx.animation_due);
+            dropped = 0;
+            break;
+        }
+        if (duration) {
+            ++dropped; // frames without duration are never shown anyway
+        }
+        late -= duration;
+        time_add(&ctx.animation_due, duration);
+        index = (index + 1) % num;
+    }
+
+    if (dropped) {
+        trace_counter("frames_dropped", dropped);
+        ctx.animation_dropped += dropped;
+    }
+
+    if (!switch_frame(index)) {
+        return;
+    }
+
+    // schedule the next frame relative to the deadline of the current one
+    time_add(&ctx.animation_due, ctx.current->frames[ctx.frame].duration);
+    ts.it_value = ctx.animation_due;
+    timerfd_settime(ctx.animation_fd, TFD_TIMER_ABSTIME, &ts, NULL);
+
+    // decode and scale the next frame in advance, while the current one
+    // is shown
+    if (image_frame_load(ctx.current, (ctx.frame + 1) % num)) {
+        anim_scaled_ahead((ctx.frame + 1) % num);
+    }
 }
 
-/** Slideshow timer event handler. */
-static void on_slideshow_timer(__attribute__((unused)) void* data)
+/** Anti-aliasing delay timer event handler. */
+static void on_aa_timer(__attribute__((unused)) void* data)
 {
-    slideshow_ctl(next_image(action_next_file));
+    cancel_aa();
+#ifdef HAVE_LIBRSVG
+    if (rerender.pending) {
+        imglist_lock();
+        rerender_start(); // zoom settled
+        imglist_unlock();
+    }
+#endif // HAVE_LIBRSVG
+    app_redraw();
 }
 
 /**
- * Skip current image file.
- * @param remove flag to remove current image from the image list
- * @return true if next image opened
+ * Start loading the next slideshow image if it is not preloaded yet and the
+ * expected decoding time doesn't leave room for waiting.
  */
-static bool skip_current(bool remove)
+static void slideshow_prefetch(void)
 {
-    struct image* curr = ctx.current;
+    const double remain = -elapsed_ms(&ctx.slideshow_due);
     struct image* next;
 
+    imglist_lock();
+
     next = imglist_next_file(ctx.current);
-    next = open_image(next, true);
-    if (!next) {
-        next = imglist_prev_file(ctx.current);
-        next = open_image(next, false);
+    if (next && next != ctx.current && !image_has_frames(next) &&
+        (!prefetch.image ||
+         strcmp(prefetch.image->source, next->source) != 0)) {
+        const double lead =
+            decode_stats_get(next->source) + SLIDESHOW_MARGIN;
+        if (remain > lead) {
+            imglist_unlock();
+            slideshow_timer(lead); // too early, check again later
+            return;
+        }
+        prefetch_stop();
+        prefetch_start(next);
     }
 
-    if (!next) {
-        fprintf(stderr, "No more images to view, exit\n");
-        app_exit(0);
-    } else if (remove) {
-        imglist_remove(curr);
+    imglist_unlock();
+
+    slideshow_timer(0);
+}
+
+/**
+ * Switch to the next slideshow image loaded by the prefetch.
+ * @return false if there is no suitable prefetched image
+ */
+static bool slideshow_switch(void)
+{
+    struct image* next;
+    bool rc = false;
+
+    if (!prefetch.image) {
+        return false;
+    }
+    if (prefetch.active) {
+        // wait for the rest of decoding, it's still faster than restart
+        pthread_join(prefetch.tid, NULL);
+        prefetch.active = false;
     }
 
-    return next;
+    imglist_lock();
+
+    next = imglist_next_file(ctx.current);
+    if (prefetch.success && next && next != ctx.current &&
+        strcmp(next->source, prefetch.image->source) == 0) {
+        cache_out(ctx.preload, next);
+        cache_out(ctx.history, next);
+        if (!image_has_frames(next)) {
+            image_update(next, prefetch.image);
+        }
+        opener_cancel();
+        ctx.backward = false;
+        set_current(next);
+
+        // use pre-scaled frame, so the first redraw is just a copy
+        if (prefetch.scaled.data && ctx.scale == prefetch.scale &&
+            ctx.aa_mode == prefetch.aa && ctx.current->num_frames == 1) {
+            scaled_reset();
+            ctx.scaled.pm = prefetch.scaled;
+            ctx.scaled.image = ctx.current;
+            ctx.scaled.frame = 0;
+            ctx.scaled.scale = ctx.scale;
+            ctx.scaled.aa = ctx.aa_mode;
+            memset(&prefetch.scaled, 0, sizeof(prefetch.scaled));
+        }
+        rc = true;
+    }
+
+    imglist_unlock();
+
+    prefetch_stop();
+
+    return rc;
+}
+
+/** Slideshow timer event handler. */
+static void on_slideshow_timer(__attribute__((unused)) void* data)
+{
+    if (ctx.slideshow_early) {
+        slideshow_prefetch();
+    } else if (!slideshow_switch()) {
+        slideshow_ctl(next_image(action_next_file, 1));
+    }
 }
 
 /**
@@ -765,7 +2458,12 @@ static bool skip_current(bool remove)
  */
 static void reload_current(void)
 {
-    if (image_load(ctx.current) == imgload_success) {
+    if (ctx.placeholder) {
+        opener_cancel();
+        image_free(ctx.current, IMGFREE_FRAMES);
+        ctx.placeholder = false;
+    }
+    if (load_image(ctx.current) == imgload_success) {
         info_update(info_status, "Image reloaded");
         reset_state();
     } else {
@@ -775,40 +2473,151 @@ static void reload_current(void)
 }
 
 /**
- * Rerender SVG at current ctx.scale.
+ * Reload image decoded in reduced quality if it is zoomed in over 100%.
  */
-static void rerender_svg(void)
+static void upgrade_quality(void)
 {
-#ifdef HAVE_LIBRSVG
-    if (strcmp(ctx.current->format, "SVG") == 0) {
-        adjust_svg_render_size(ctx.scale);
+    struct image* img = ctx.current;
+    const size_t width = img->frames[0].pm.width;
+    enum image_status status;
 
-        if (image_load(ctx.current) == imgload_success) {
-            info_update(info_status, "SVG rerendered");
-
-            ctx.img_w = ctx.current->frames[0].pm.width;
-            ctx.img_h = ctx.current->frames[0].pm.height;
-            ctx.scale = 1;
+    if (!img->reduced || ctx.scale <= 1.0) {
+        return;
+    }
 
-            info_reset(ctx.current);
-            info_update(info_scale, "%.0f%%", ctx.scale * 100);
+    info_update(info_status, "Loading full quality image...");
+    img->full = true;
+    status = load_image(img);
+    img->full = false;
+    if (status != imgload_success) {
+        info_update(info_status, "Unable to reload file, open next one");
+        skip_current(true);
+        return;
+    }
 
-            fixup_position(true);
+    // keep the visible size of the image
+    ctx.frame = 0;
+    ctx.scale *= (double)width / img->frames[0].pm.width;
+    ctx.img_w = img->frames[0].pm.width;
+    ctx.img_h = img->frames[0].pm.height;
+    scaled_reset();
+    fixup_position(false);
 
-            app_redraw();
-        } else {
-            info_update(info_status, "Unable to reload file, open next one");
-            skip_current(true);
-        }
+    info_reset(img);
+    info_update(info_scale, "%.0f%%", ctx.scale * 100);
+}
 
-    } else {
+/**
+ * Rerender SVG at current ctx.scale, rendering is started in background when
+ * zoom settles.
+ */
+static void rerender_svg(void)
+{
+#ifdef HAVE_LIBRSVG
+    if (!ctx.current->format || strcmp(ctx.current->format, "SVG") != 0) {
         info_update(info_status, "Error: can only rerender SVGs");
+    } else if (ctx.aa_pending) {
+        rerender.pending = true; // started by anti-aliasing timer
+    } else {
+        rerender_start();
     }
 #else
     info_update(info_status, "Error: SVG rerender is not supported");
 #endif // HAVE_LIBRSVG
 }
 
+/**
+ * Get current frame scaled to the current scale from the cache.
+ * @param wnd pixel map of target window, limits the cache size
+ * @param width,height size of the scaled frame
+ * @return pointer to the scaled pixmap or NULL if it is not cached
+ */
+static const struct pixmap* get_scaled(const struct pixmap* wnd, size_t width,
+                                       size_t height)
+{
+    struct scaled* cache = &ctx.scaled;
+    const struct pixmap* pm = &ctx.current->frames[ctx.frame].pm;
+    double scale = ctx.scale;
+
+    if (cache->image == ctx.current && cache->frame == ctx.frame &&
+        cache->scale == ctx.scale && cache->aa == ctx.aa_mode) {
+        return &cache->pm;
+    }
+
+    if (ctx.current->num_frames > 1) {
+        // animation frames are reused on every loop
+        return anim_scaled_get(ctx.frame);
+    }
+
+    // scale the whole frame only if it is going to be reused on panning
+    if (ctx.aa_pending || width == 0 ||
+        height == 0 ||
+        width * height > SCALED_MAX_WINDOWS * wnd->width * wnd->height) {
+        return NULL;
+    }
+
+    scaled_reset();
+    if (!pixmap_create(&cache->pm, width, height)) {
+        return NULL;
+    }
+    if (ctx.aa_mode != aa_nearest) {
+        // downscale from the nearest mipmap level
+        pm = image_mipmap(ctx.current, ctx.frame, &scale);
+    }
+    pixmap_scale(ctx.aa_mode, pm, &cache->pm, 0, 0, scale,
+                 ctx.current->alpha);
+
+    cache->image = ctx.current;
+    cache->frame = ctx.frame;
+    cache->scale = ctx.scale;
+    cache->aa = ctx.aa_mode;
+
+    return &cache->pm;
+}
+
+/**
+ * Draw current frame scaled by the compositor.
+ * @param wnd pixel map of target window
+ * @param width,height size of the scaled frame
+ * @return false if the frame must be scaled by the viewer
+ */
+static bool draw_layer(struct pixmap* wnd, size_t width, size_t height)
+{
+    struct scaled* cache = &ctx.scaled;
+    const struct pixmap* pm = &ctx.current->frames[ctx.frame].pm;
+
+    // compositors use bilinear filter at best, so fall back to our own
+    // scaler if the higher quality is required, the native size is shown
+    // as is with any filter
+    if (!ctx.compositor || ctx.current->alpha ||
+        ctx.current->num_frames > 1 || pm->width > LAYER_MAX_SIZE ||
+        pm->height > LAYER_MAX_SIZE ||
+        (!ctx.aa_pending && ctx.aa_mode > aa_bilinear && ctx.scale != 1.0)) {
+        if (cache->layer) {
+            scaled_reset();
+        }
+        return false;
+    }
+
+    if (!cache->layer || cache->image != ctx.current ||
+        cache->frame != ctx.frame) {
+        scaled_reset();
+        if (!ui_set_image(pm)) {
+            ctx.compositor = false; // not supported
+            return false;
+        }
+        cache->layer = true;
+        cache->image = ctx.current;
+        cache->frame = ctx.frame;
+    }
+
+    // make the window transparent over the image
+    pixmap_fill(wnd, ctx.img_x, ctx.img_y, width, height, 0);
+    ui_place_image(ctx.img_x, ctx.img_y, width, height);
+
+    return true;
+}
+
 /**
  * Draw image.
  * @param wnd pixel map of target window
@@ -823,6 +2632,10 @@ static void draw_image(struct pixmap* wnd)
     pixmap_inverse_fill(wnd, ctx.img_x, ctx.img_y, width, height,
                         ctx.window_bkg);
 
+    if (draw_layer(wnd, width, height)) {
+        return;
+    }
+
     // clear image background
     if (ctx.current->alpha) {
         if (ctx.image_bkg == GRID_BKGID) {
@@ -839,7 +2652,7 @@ static void draw_image(struct pixmap* wnd)
         pixmap_copy(pm, wnd, ctx.img_x, ctx.img_y, ctx.current->alpha);
     } else {
 #ifdef HAVE_LIBRSVG
-        if (strcmp(ctx.current->format, "SVG") == 0) {
+        if (ctx.current->format && strcmp(ctx.current->format, "SVG") == 0) {
 
             enum image_status status = decode_svg_partial(
                 ctx.current, wnd, ctx.img_x, ctx.img_y, ctx.scale);
@@ -849,7 +2662,20 @@ static void draw_image(struct pixmap* wnd)
             }
         }
 #endif
-        pixmap_scale(ctx.aa_mode, pm, wnd, ctx.img_x, ctx.img_y, ctx.scale,
+        const struct pixmap* scaled = get_scaled(wnd, width, height);
+        if (scaled) {
+            pixmap_copy(scaled, wnd, ctx.img_x, ctx.img_y,
+                        ctx.current->alpha);
+            return;
+        }
+
+        const enum aa_mode aa = ctx.aa_pending ? aa_nearest : ctx.aa_mode;
+        double scale = ctx.scale;
+        if (aa != aa_nearest) {
+            // downscale from the nearest mipmap level
+            pm = image_mipmap(ctx.current, ctx.frame, &scale);
+        }
+        pixmap_scale(aa, pm, wnd, ctx.img_x, ctx.img_y, scale,
                      ctx.current->alpha);
     }
 }
@@ -857,7 +2683,9 @@ static void draw_image(struct pixmap* wnd)
 /** Mode handler: window redraw. */
 static void on_redraw(struct pixmap* window)
 {
+    motion_step();
     draw_image(window);
+    update_stats();
     info_print(window);
 }
 
@@ -896,20 +2724,50 @@ static void on_imglist(const struct image* image, enum fsevent event)
 /** Mode handler: mouse drag. */
 static void on_drag(int dx, int dy)
 {
-    const ssize_t old_x = ctx.img_x;
-    const ssize_t old_y = ctx.img_y;
+    ssize_t old_x, old_y;
+    struct timespec now;
+    double dt;
+
+    motion_stop(true);
+    old_x = ctx.img_x;
+    old_y = ctx.img_y;
+
+    // estimate panning velocity for kinetic scrolling after release
+    dt = elapsed_ms(&ctx.motion.drag);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    ctx.motion.drag = now;
+    if (dt > 0 && dt < MOTION_STEP_MAX) {
+        ctx.motion.vx = (ctx.motion.vx + dx / dt) / 2;
+        ctx.motion.vy = (ctx.motion.vy + dy / dt) / 2;
+    } else {
+        ctx.motion.vx = 0;
+        ctx.motion.vy = 0;
+    }
 
     ctx.img_x += dx;
     ctx.img_y += dy;
 
     if (ctx.img_x != old_x || ctx.img_y != old_y) {
         fixup_position(false);
+        postpone_aa();
+        app_redraw();
+    }
+}
+
+/** Mode handler: end of mouse drag. */
+static void on_drop(void)
+{
+    // keep panning if the pointer was still moving at release
+    if (ctx.motion.enable && elapsed_ms(&ctx.motion.drag) < MOTION_PAN_HOLD &&
+        hypot(ctx.motion.vx, ctx.motion.vy) >= MOTION_PAN_MIN) {
+        ctx.motion.kinetic = true;
+        clock_gettime(CLOCK_MONOTONIC, &ctx.motion.last);
         app_redraw();
     }
 }
 
 /** Mode handler: apply action. */
-static void on_action(const struct action* action)
+static void on_action(const struct action* action, size_t repeat)
 {
     switch (action->type) {
         case action_first_file:
@@ -919,7 +2777,7 @@ static void on_action(const struct action* action)
         case action_prev_file:
         case action_next_file:
         case action_rand_file:
-            next_image(action->type);
+            next_image(action->type, repeat);
             break;
         case action_skip_file:
             imglist_lock();
@@ -936,25 +2794,33 @@ static void on_action(const struct action* action)
             break;
         case action_slideshow:
             slideshow_ctl(!ctx.slideshow_enable &&
-                          next_image(action_next_file));
+                          next_image(action_next_file, 1));
             break;
         case action_step_left:
-            move_image(true, true, action->params);
+            move_image(true, true, action->params, repeat);
             break;
         case action_step_right:
-            move_image(true, false, action->params);
+            move_image(true, false, action->params, repeat);
             break;
         case action_step_up:
-            move_image(false, true, action->params);
+            move_image(false, true, action->params, repeat);
             break;
         case action_step_down:
-            move_image(false, false, action->params);
+            move_image(false, false, action->params, repeat);
             break;
         case action_zoom:
-            zoom_image(action->params);
+            while (repeat--) {
+                zoom_image(action->params);
+            }
+            imglist_lock();
+            upgrade_quality();
+            imglist_unlock();
             break;
         case action_scale:
             scale_image(action->params);
+            imglist_lock();
+            upgrade_quality();
+            imglist_unlock();
             break;
         case action_keep_zoom:
             toggle_keep_zoom();
@@ -967,10 +2833,14 @@ static void on_action(const struct action* action)
             break;
         case action_flip_vertical:
             image_flip_vertical(ctx.current);
+            image_frame_load(ctx.current, ctx.frame);
+            scaled_reset();
             app_redraw();
             break;
         case action_flip_horizontal:
             image_flip_horizontal(ctx.current);
+            image_frame_load(ctx.current, ctx.frame);
+            scaled_reset();
             app_redraw();
             break;
         case action_antialiasing:
@@ -978,6 +2848,12 @@ static void on_action(const struct action* action)
             info_update(info_status, "Anti-aliasing: %s", aa_name(ctx.aa_mode));
             app_redraw();
             break;
+        case action_level:
+        case action_window:
+            imglist_lock();
+            change_window(action->type == action_level, action->params);
+            imglist_unlock();
+            break;
         case action_svg_rerender:
             imglist_lock();
             rerender_svg();
@@ -1014,6 +2890,27 @@ static struct image* on_current(void)
     return ctx.current;
 }
 
+/**
+ * Show thumbnail of the image stretched to the window and decode the image
+ * in background, used to switch from gallery without delay.
+ * @return false if placeholder can not be shown
+ */
+static bool open_placeholder(void)
+{
+    if (opener.notify == -1 || !image_thumb_frame(ctx.current)) {
+        return false;
+    }
+
+    ctx.placeholder = true;
+    ++ctx.cache_misses;
+    opener_request(ctx.current, true);
+
+    reset_state();
+    set_scale(scale_fit_window);
+
+    return true;
+}
+
 /** Mode handler: activate viewer. */
 static void on_activate(struct image* image)
 {
@@ -1021,8 +2918,11 @@ static void on_activate(struct image* image)
     cache_out(ctx.preload, ctx.current);
     cache_out(ctx.history, ctx.current);
 
+    if (!image_has_frames(ctx.current) && open_placeholder()) {
+        return; // preloading starts when the image is decoded
+    }
     if (image_has_frames(ctx.current) ||
-        image_load(ctx.current) == imgload_success || skip_current(true)) {
+        load_image(ctx.current) == imgload_success || skip_current(true)) {
         reset_state();
         preloader_start();
     }
@@ -1031,10 +2931,19 @@ static void on_activate(struct image* image)
 /** Mode handler: deactivate viewer. */
 static struct image* on_deactivate(void)
 {
+    opener_cancel();
+    rerender_cancel();
     preloader_stop();
     animation_ctl(false);
     slideshow_ctl(false);
-    cache_put(ctx.history, ctx.current);
+    cancel_aa();
+    scaled_reset();
+    if (ctx.placeholder) {
+        ctx.placeholder = false;
+        image_free(ctx.current, IMGFREE_FRAMES);
+    } else {
+        cache_put(ctx.history, ctx.current);
+    }
 
     return ctx.current;
 }
@@ -1045,6 +2954,8 @@ void viewer_init(const struct config* cfg, struct mode_handlers* handlers)
     const char* cval_txt;
 
     ctx.aa_mode = aa_init(cfg, CFG_VIEWER, CFG_VIEW_AA);
+    ctx.aa_delay = config_get_num(cfg, CFG_VIEWER, CFG_VIEW_AA_DELAY, 0, 10000);
+    ctx.compositor = config_get_bool(cfg, CFG_VIEWER, CFG_VIEW_COMP_SCL);
     ctx.window_bkg = config_get_color(cfg, CFG_VIEWER, CFG_VIEW_WINDOW);
 
     // background for transparent images
@@ -1059,14 +2970,33 @@ void viewer_init(const struct config* cfg, struct mode_handlers* handlers)
     ctx.scale_init = config_get_oneof(cfg, CFG_VIEWER, CFG_VIEW_SCALE,
                                       scale_names, ARRAY_SIZE(scale_names));
     ctx.keep_zoom = config_get_bool(cfg, CFG_VIEWER, CFG_VIEW_KEEP_ZM);
+    ctx.motion.enable = config_get_bool(cfg, CFG_VIEWER, CFG_VIEW_SMOOTH);
     ctx.position = config_get_oneof(cfg, CFG_VIEWER, CFG_VIEW_POSITION,
                                     position_names, ARRAY_SIZE(position_names));
 
     // history and preloads caches
     cval_num = config_get_num(cfg, CFG_VIEWER, CFG_VIEW_HISTORY, 0, 1024);
     ctx.history = cache_init(cval_num);
-    cval_num = config_get_num(cfg, CFG_VIEWER, CFG_VIEW_PRELOAD, 0, 1024);
+    cache_set_memstat(ctx.history, memstat_history);
+    cval_num = config_get_num(cfg, CFG_VIEWER, CFG_VIEW_HIST_MEM, 0,
+                              MEMORY_LIMIT_MAX);
+    cache_set_limit(ctx.history, cval_num * 1024 * 1024);
+    cval_num = config_get_num(cfg, CFG_VIEWER, CFG_VIEW_HIST_PACK, 0, 1024);
+    cache_set_packed(ctx.history, cval_num);
+    ctx.preload_ahead =
+        config_get_num(cfg, CFG_VIEWER, CFG_VIEW_PRELOAD, 0, 1024);
+    ctx.preload_back =
+        config_get_num(cfg, CFG_VIEWER, CFG_VIEW_PREL_BACK, 0, 1024);
+    ctx.prefetch = config_get_num(cfg, CFG_VIEWER, CFG_VIEW_PREFETCH, 0, 1024);
+    cval_num = ctx.preload_ahead + ctx.preload_back;
+    if (cval_num) {
+        ++cval_num; // extra slot for the next random image
+    }
     ctx.preload = cache_init(cval_num);
+    cache_set_memstat(ctx.preload, memstat_preload);
+    cval_num = config_get_num(cfg, CFG_VIEWER, CFG_VIEW_PREL_MEM, 0,
+                              MEMORY_LIMIT_MAX);
+    cache_set_limit(ctx.preload, cval_num * 1024 * 1024);
 
     // setup animation timer
     ctx.animation_enable = true;
@@ -1085,10 +3015,34 @@ void viewer_init(const struct config* cfg, struct mode_handlers* handlers)
         app_watch(ctx.slideshow_fd, on_slideshow_timer, NULL);
     }
 
+    // setup background opener notification
+    opener.notify = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (opener.notify != -1) {
+        app_watch(opener.notify, on_opened, NULL);
+    }
+
+#ifdef HAVE_LIBRSVG
+    // setup background re-render notification
+    rerender.notify = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (rerender.notify != -1) {
+        app_watch(rerender.notify, on_rerendered, NULL);
+    }
+#endif // HAVE_LIBRSVG
+
+    // setup anti-aliasing delay timer
+    ctx.aa_fd = -1;
+    if (ctx.aa_delay) {
+        ctx.aa_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+        if (ctx.aa_fd != -1) {
+            app_watch(ctx.aa_fd, on_aa_timer, NULL);
+        }
+    }
+
     handlers->action = on_action;
     handlers->redraw = on_redraw;
     handlers->resize = on_resize;
     handlers->drag = on_drag;
+    handlers->drop = on_drop;
     handlers->imglist = on_imglist;
     handlers->current = on_current;
     handlers->activate = on_activate;
@@ -1097,15 +3051,29 @@ void viewer_init(const struct config* cfg, struct mode_handlers* handlers)
 
 void viewer_destroy(void)
 {
+    opener_stop();
+    rerender_cancel();
     preloader_stop();
+    prefetch_stop();
 
+    if (opener.notify != -1) {
+        close(opener.notify);
+    }
+    if (rerender.notify != -1) {
+        close(rerender.notify);
+    }
     if (ctx.animation_fd != -1) {
         close(ctx.animation_fd);
     }
     if (ctx.slideshow_fd != -1) {
         close(ctx.slideshow_fd);
     }
+    if (ctx.aa_fd != -1) {
+        close(ctx.aa_fd);
+    }
 
+    scaled_reset();
     cache_free(ctx.history);
     cache_free(ctx.preload);
+    free(ctx.rand_next);
 }
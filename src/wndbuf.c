@@ -10,28 +10,56 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
 #include <unistd.h>
 
-struct wl_buffer* wndbuf_create(struct wl_shm* shm, size_t width, size_t height)
-{
-    assert(shm);
-    assert(width > 0);
-    assert(height > 0);
+// Max number of buffers in the pool
+#define POOL_SLOTS 4
 
-    const size_t stride = width * sizeof(argb_t);
-    const size_t data_sz = stride * height;
-    const size_t buffer_sz = data_sz + sizeof(struct pixmap);
+/** Buffer description, stored at the end of the shared memory (standalone
+ * buffer) or allocated on the heap (pool buffer). */
+struct wndbuf {
+    struct pixmap pm;          ///< Pixmap mapped to the buffer data
+    bool busy;                 ///< Buffer is used by the compositor
+    wndbuf_release on_release; ///< Release handler
+    struct wndbuf_pool* pool;  ///< Owner pool, NULL for standalone buffer
+    size_t slot;               ///< Slot index in the pool
+};
 
-    struct pixmap* pm;
-    struct wl_buffer* buffer;
-    struct wl_shm_pool* pool;
+/** Grow-only shared memory pool, buffers are placed at slot offsets. */
+struct wndbuf_pool {
+    struct wl_shm* shm;                ///< Wayland shared memory interface
+    struct wl_shm_pool* pool;          ///< Wayland pool, NULL if not created
+    int fd;                            ///< Shared memory file
+    uint8_t* data;                     ///< Mapped shared memory
+    size_t size;                       ///< Size of the shared memory
+    struct wndbuf* slots[POOL_SLOTS];  ///< Buffers in the pool
+};
+
+static void on_buffer_release(void* data, struct wl_buffer* buffer)
+{
+    struct wndbuf* wb = data;
+    wb->busy = false;
+    if (wb->on_release) {
+        wb->on_release(buffer);
+    }
+}
+
+static const struct wl_buffer_listener buffer_listener = {
+    .release = on_buffer_release,
+};
 
+/**
+ * Create shared memory file.
+ * @return file descriptor or -1 on errors
+ */
+static int create_shm(void)
+{
     static size_t counter = 0;
-    int fd = -1;
     char path[64];
-    void* data;
+    int fd;
 
     // generate unique file name
     snprintf(path, sizeof(path), "/" APP_NAME "_%x_%zx", getpid(), ++counter);
@@ -42,40 +70,84 @@ struct wl_buffer* wndbuf_create(struct wl_shm* shm, size_t width, size_t height)
         const int err = errno;
         fprintf(stderr, "Unable to create shared file %s: [%i] %s\n", path, err,
                 strerror(err));
-        return NULL;
+        return -1;
     }
     shm_unlink(path);
 
+    return fd;
+}
+
+/**
+ * Set size of the shared memory file and map it.
+ * @param fd shared memory file descriptor
+ * @param size size of the shared memory
+ * @return pointer to the mapped memory or NULL on errors
+ */
+static void* map_shm(int fd, size_t size)
+{
+    void* data;
+
     // set shared memory size
-    if (ftruncate(fd, buffer_sz) == -1) {
+    if (ftruncate(fd, size) == -1) {
         const int err = errno;
-        fprintf(stderr, "Unable to truncate shared file %s: [%i] %s\n", path,
-                err, strerror(err));
-        close(fd);
+        fprintf(stderr, "Unable to truncate shared file: [%i] %s\n", err,
+                strerror(err));
         return NULL;
     }
 
     // get data pointer of the shared mem
-    data = mmap(NULL, buffer_sz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
     if (data == MAP_FAILED) {
         const int err = errno;
-        fprintf(stderr, "Unable to map shared file %s: [%i] %s\n", path, err,
+        fprintf(stderr, "Unable to map shared file: [%i] %s\n", err,
                 strerror(err));
+        return NULL;
+    }
+
+    return data;
+}
+
+struct wl_buffer* wndbuf_create(struct wl_shm* shm, size_t width, size_t height,
+                                wndbuf_release on_release)
+{
+    assert(shm);
+    assert(width > 0);
+    assert(height > 0);
+
+    const size_t stride = width * sizeof(argb_t);
+    const size_t data_sz = stride * height;
+    const size_t buffer_sz = data_sz + sizeof(struct wndbuf);
+
+    struct wndbuf* wb;
+    struct wl_buffer* buffer;
+    struct wl_shm_pool* pool;
+    void* data;
+    int fd;
+
+    fd = create_shm();
+    if (fd == -1) {
+        return NULL;
+    }
+    data = map_shm(fd, buffer_sz);
+    if (!data) {
         close(fd);
         return NULL;
     }
 
     // fill buffer user data
-    pm = (struct pixmap*)((uint8_t*)data + data_sz);
-    pm->width = width;
-    pm->height = height;
-    pm->data = data;
+    wb = (struct wndbuf*)((uint8_t*)data + data_sz);
+    wb->pm.width = width;
+    wb->pm.height = height;
+    wb->pm.data = data;
+    wb->busy = false;
+    wb->on_release = on_release;
+    wb->pool = NULL;
 
     // create wayland buffer
     pool = wl_shm_create_pool(shm, fd, buffer_sz);
     buffer = wl_shm_pool_create_buffer(pool, 0, width, height, stride,
                                        WL_SHM_FORMAT_ARGB8888);
-    wl_buffer_set_user_data(buffer, pm);
+    wl_buffer_add_listener(buffer, &buffer_listener, wb);
 
     wl_shm_pool_destroy(pool);
     close(fd);
@@ -85,17 +157,187 @@ struct wl_buffer* wndbuf_create(struct wl_shm* shm, size_t width, size_t height)
 
 struct pixmap* wndbuf_pixmap(struct wl_buffer* buffer)
 {
+    struct wndbuf* wb;
     assert(buffer);
-    return wl_buffer_get_user_data(buffer);
+    wb = wl_buffer_get_user_data(buffer);
+    return &wb->pm;
+}
+
+void wndbuf_acquire(struct wl_buffer* buffer)
+{
+    struct wndbuf* wb;
+    assert(buffer);
+    wb = wl_buffer_get_user_data(buffer);
+    wb->busy = true;
+}
+
+bool wndbuf_busy(struct wl_buffer* buffer)
+{
+    const struct wndbuf* wb;
+    assert(buffer);
+    wb = wl_buffer_get_user_data(buffer);
+    return wb->busy;
 }
 
 void wndbuf_free(struct wl_buffer* buffer)
 {
     if (buffer) {
-        struct pixmap* pm = wl_buffer_get_user_data(buffer);
-        const size_t sz =
-            pm->width * pm->height * sizeof(argb_t) + sizeof(struct pixmap);
-        munmap(pm->data, sz);
-        wl_buffer_destroy(buffer);
+        struct wndbuf* wb = wl_buffer_get_user_data(buffer);
+        if (wb->pool) {
+            // memory stays in the pool for the next buffer
+            wb->pool->slots[wb->slot] = NULL;
+            wl_buffer_destroy(buffer);
+            free(wb);
+        } else {
+            void* data = wb->pm.data;
+            const size_t sz = wb->pm.width * wb->pm.height * sizeof(argb_t) +
+                sizeof(struct wndbuf);
+            wl_buffer_destroy(buffer);
+            munmap(data, sz);
+        }
+    }
+}
+
+struct wndbuf_pool* wndbuf_pool_create(struct wl_shm* shm)
+{
+    struct wndbuf_pool* pool;
+
+    assert(shm);
+
+    pool = calloc(1, sizeof(*pool));
+    if (pool) {
+        pool->shm = shm;
+        pool->fd = -1;
+    }
+
+    return pool;
+}
+
+/**
+ * Grow the pool: the memory is never shrunk, so resizing the window back and
+ * forth doesn't recreate the shared memory.
+ * @param pool buffer pool
+ * @param size required size of the pool
+ * @return false on errors
+ */
+static bool pool_grow(struct wndbuf_pool* pool, size_t size)
+{
+    const size_t page = sysconf(_SC_PAGESIZE);
+    uint8_t* data;
+
+    if (size <= pool->size) {
+        return true;
+    }
+    size = (size + page - 1) / page * page;
+
+    if (pool->fd == -1) {
+        pool->fd = create_shm();
+        if (pool->fd == -1) {
+            return false;
+        }
+    }
+
+    data = map_shm(pool->fd, size);
+    if (!data) {
+        return false;
+    }
+    if (pool->data) {
+        munmap(pool->data, pool->size);
+    }
+
+    // remap existing buffers
+    for (size_t i = 0; i < POOL_SLOTS; ++i) {
+        struct wndbuf* wb = pool->slots[i];
+        if (wb) {
+            wb->pm.data = (argb_t*)(data +
+                                    ((uint8_t*)wb->pm.data - pool->data));
+        }
+    }
+
+    pool->data = data;
+    pool->size = size;
+
+    if (pool->pool) {
+        wl_shm_pool_resize(pool->pool, size);
+    } else {
+        pool->pool = wl_shm_create_pool(pool->shm, pool->fd, size);
+    }
+
+    return true;
+}
+
+struct wl_buffer* wndbuf_pool_get(struct wndbuf_pool* pool, size_t width,
+                                  size_t height, wndbuf_release on_release)
+{
+    assert(pool);
+    assert(width > 0);
+    assert(height > 0);
+
+    const size_t stride = width * sizeof(argb_t);
+    const size_t data_sz = stride * height;
+
+    struct wl_buffer* buffer;
+    struct wndbuf* wb;
+    size_t slot;
+
+    // get free slot
+    for (slot = 0; slot < POOL_SLOTS; ++slot) {
+        if (!pool->slots[slot]) {
+            break;
+        }
+    }
+    if (slot >= POOL_SLOTS) {
+        return NULL;
+    }
+
+    // all buffers in the pool have the same size
+    for (size_t i = 0; i < POOL_SLOTS; ++i) {
+        const struct wndbuf* other = pool->slots[i];
+        if (other &&
+            (other->pm.width != width || other->pm.height != height)) {
+            fprintf(stderr, "Window buffers of different size in pool\n");
+            return NULL;
+        }
+    }
+
+    if (!pool_grow(pool, (slot + 1) * data_sz)) {
+        return NULL;
+    }
+
+    wb = calloc(1, sizeof(*wb));
+    if (!wb) {
+        return NULL;
+    }
+    wb->pm.width = width;
+    wb->pm.height = height;
+    wb->pm.data = (argb_t*)(pool->data + slot * data_sz);
+    wb->on_release = on_release;
+    wb->pool = pool;
+    wb->slot = slot;
+
+    buffer = wl_shm_pool_create_buffer(pool->pool, slot * data_sz, width,
+                                       height, stride, WL_SHM_FORMAT_ARGB8888);
+    wl_buffer_add_listener(buffer, &buffer_listener, wb);
+    pool->slots[slot] = wb;
+
+    return buffer;
+}
+
+void wndbuf_pool_free(struct wndbuf_pool* pool)
+{
+    if (pool) {
+        for (size_t i = 0; i < POOL_SLOTS; ++i) {
+            assert(!pool->slots[i] && "buffer is still in use");
+        }
+        if (pool->pool) {
+            wl_shm_pool_destroy(pool->pool);
+        }
+        if (pool->data) {
+            munmap(pool->data, pool->size);
+        }
+        if (pool->fd != -1) {
+            close(pool->fd);
+        }
+        free(pool);
     }
 }
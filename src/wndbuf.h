@@ -8,14 +8,22 @@
 
 #include <wayland-client-protocol.h>
 
+/**
+ * Buffer release handler: called when the compositor doesn't use the buffer
+ * anymore and it can be reused for drawing.
+ * @param buffer released wayland buffer
+ */
+typedef void (*wndbuf_release)(struct wl_buffer* buffer);
+
 /**
  * Create window buffer.
  * @param shm wayland shared memory interface
  * @param width,height buffer size in pixels
+ * @param on_release buffer release handler, can be NULL
  * @return wayland buffer on NULL on errors
  */
 struct wl_buffer* wndbuf_create(struct wl_shm* shm, size_t width,
-                                size_t height);
+                                size_t height, wndbuf_release on_release);
 /**
  * Get pixmap associated with the buffer.
  * @param buffer wayland buffer
@@ -23,8 +31,49 @@ struct wl_buffer* wndbuf_create(struct wl_shm* shm, size_t width,
  */
 struct pixmap* wndbuf_pixmap(struct wl_buffer* buffer);
 
+/**
+ * Mark buffer as used by the compositor, must be called on surface attach.
+ * @param buffer wayland buffer
+ */
+void wndbuf_acquire(struct wl_buffer* buffer);
+
+/**
+ * Check if the buffer is still used by the compositor.
+ * @param buffer wayland buffer
+ * @return true if buffer is in use and can't be modified
+ */
+bool wndbuf_busy(struct wl_buffer* buffer);
+
 /**
  * Free window buffer.
  * @param buffer wayland buffer to free
  */
 void wndbuf_free(struct wl_buffer* buffer);
+
+/** Shared memory pool for window buffers. */
+struct wndbuf_pool;
+
+/**
+ * Create pool of window buffers: the shared memory is allocated on demand
+ * and reused for the buffers of the new size after window resize.
+ * @param shm wayland shared memory interface
+ * @return pointer to the pool or NULL on errors
+ */
+struct wndbuf_pool* wndbuf_pool_create(struct wl_shm* shm);
+
+/**
+ * Create window buffer in the pool, all buffers of the pool must have the
+ * same size, the buffer is freed with `wndbuf_free`.
+ * @param pool buffer pool
+ * @param width,height buffer size in pixels
+ * @param on_release buffer release handler, can be NULL
+ * @return wayland buffer on NULL on errors
+ */
+struct wl_buffer* wndbuf_pool_get(struct wndbuf_pool* pool, size_t width,
+                                  size_t height, wndbuf_release on_release);
+
+/**
+ * Free the pool, all its buffers must be freed before.
+ * @param pool buffer pool to free
+ */
+void wndbuf_pool_free(struct wndbuf_pool* pool);
@@ -0,0 +1,392 @@
+// SPDX-License-Identifier: MIT
+// Shared thumbnail cache (freedesktop.org thumbnail specification).
+// Copyright (C) 2025 Artem Senichev <artemsen@gmail.com>
+
+#include "xdgthumb.h"
+
+#include "array.h"
+#include "formats/loader.h"
+#include "formats/png.h"
+#include "fs.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Meta keys defined by the specification
+#define META_URI   "Thumb::URI"
+#define META_MTIME "Thumb::MTime"
+#define META_SIZE  "Thumb::Size"
+#define META_SOFT  "Software"
+
+// URI prefix for local files
+#define URI_PREFIX "file://"
+// Characters not escaped in URI path (same set as GLib uses)
+#define URI_ALLOWED "-._~!$&'()*+,;=:@/"
+
+// Size of MD5 digest in bytes
+#define MD5_SIZE 16
+
+/** Cache bucket: subdirectory for thumbnails of specific size. */
+struct bucket {
+    const char* name; ///< Subdirectory name
+    size_t size;      ///< Max size of thumbnail in the bucket
+};
+
+// Cache buckets in ascending order of size
+static const struct bucket buckets[] = {
+    { "normal",   128  },
+    { "large",    256  },
+    { "x-large",  512  },
+    { "xx-large", 1024 },
+};
+
+/** Shared thumbnail cache context. */
+struct xdgthumb {
+    char root[PATH_MAX]; ///< Path to the cache directory
+    size_t root_len;     ///< Length of the path
+};
+
+/** Global cache context. */
+static struct xdgthumb ctx;
+
+// MD5 sine-derived constants
+static const uint32_t md5_k[] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a,
+    0xa8304613, 0xfd469501, 0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be,
+    0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821, 0xf61e2562, 0xc040b340,
+    0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8,
+    0x676f02d9, 0x8d2a4c8a, 0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c,
+    0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70, 0x289b7ec6, 0xeaa127fa,
+    0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92,
+    0xffeff47d, 0x85845dd1, 0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1,
+    0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391,
+};
+
+// MD5 per-round shift amounts
+static const uint8_t md5_r[] = {
+    7, 12, 17, 22, 5, 9, 14, 20, 4, 11, 16, 23, 6, 10, 15, 21,
+};
+
+/**
+ * Process single 64-byte block of MD5.
+ * @param state hash state
+ * @param block data block
+ */
+static void md5_block(uint32_t state[4], const uint8_t* block)
+{
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t m[16];
+
+    for (size_t i = 0; i < ARRAY_SIZE(m); ++i) {
+        m[i] = (uint32_t)block[i * 4] | (uint32_t)block[i * 4 + 1] << 8 |
+            (uint32_t)block[i * 4 + 2] << 16 | (uint32_t)block[i * 4 + 3] << 24;
+    }
+
+    for (size_t i = 0; i < 64; ++i) {
+        const uint8_t shift = md5_r[(i / 16) * 4 + i % 4];
+        uint32_t f;
+        size_t g;
+        switch (i / 16) {
+            case 0:
+                f = (b & c) | (~b & d);
+                g = i;
+                break;
+            case 1:
+                f = (d & b) | (~d & c);
+                g = (5 * i + 1) % 16;
+                break;
+            case 2:
+                f = b ^ c ^ d;
+                g = (3 * i + 5) % 16;
+                break;
+            default:
+                f = c ^ (b | ~d);
+                g = (7 * i) % 16;
+                break;
+        }
+        f += a + md5_k[i] + m[g];
+        a = d;
+        d = c;
+        c = b;
+        b += (f << shift) | (f >> (32 - shift));
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+}
+
+/**
+ * Compute MD5 digest.
+ * @param data source data
+ * @param size size of data in bytes
+ * @param digest output digest
+ */
+static void md5(const uint8_t* data, size_t size, uint8_t digest[MD5_SIZE])
+{
+    uint32_t state[4] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };
+    const uint64_t bits = (uint64_t)size * 8;
+    uint8_t tail[128] = { 0 };
+    size_t tail_len;
+
+    while (size >= 64) {
+        md5_block(state, data);
+        data += 64;
+        size -= 64;
+    }
+
+    // padding: 0x80, zeros, message length in bits (little endian)
+    memcpy(tail, data, size);
+    tail[size] = 0x80;
+    tail_len = size < 56 ? 64 : 128;
+    for (size_t i = 0; i < 8; ++i) {
+        tail[tail_len - 8 + i] = bits >> (i * 8);
+    }
+    md5_block(state, tail);
+    if (tail_len == 128) {
+        md5_block(state, tail + 64);
+    }
+
+    for (size_t i = 0; i < MD5_SIZE; ++i) {
+        digest[i] = state[i / 4] >> ((i % 4) * 8);
+    }
+}
+
+/**
+ * Get URI of the local file.
+ * @param source path to the file
+ * @param uri output buffer
+ * @param uri_max size of the buffer
+ * @return length of the URI, 0 on errors
+ */
+static size_t file_uri(const char* source, char* uri, size_t uri_max)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    char path[PATH_MAX];
+    size_t len = sizeof(URI_PREFIX) - 1;
+
+    if (!fs_abspath(source, path, sizeof(path)) || uri_max <= len) {
+        return 0;
+    }
+    memcpy(uri, URI_PREFIX, len);
+
+    for (const char* ptr = path; *ptr; ++ptr) {
+        const uint8_t chr = *ptr;
+        if ((chr >= 'a' && chr <= 'z') || (chr >= 'A' && chr <= 'Z') ||
+            (chr >= '0' && chr <= '9') || strchr(URI_ALLOWED, chr)) {
+            if (len + 1 >= uri_max) {
+                return 0;
+            }
+            uri[len++] = chr;
+        } else {
+            if (len + 3 >= uri_max) {
+                return 0;
+            }
+            uri[len++] = '%';
+            uri[len++] = hex[chr >> 4];
+            uri[len++] = hex[chr & 0xf];
+        }
+    }
+    uri[len] = 0;
+
+    return len;
+}
+
+/**
+ * Get path to the thumbnail file.
+ * @param uri URI of the source file
+ * @param len length of the URI
+ * @param bkt cache bucket
+ * @param path output buffer
+ * @param path_max size of the buffer
+ * @return false if buffer is too small
+ */
+static bool thumb_path(const char* uri, size_t len, const struct bucket* bkt,
+                       char* path, size_t path_max)
+{
+    uint8_t digest[MD5_SIZE];
+    char name[MD5_SIZE * 2 + 1];
+    int rc;
+
+    md5((const uint8_t*)uri, len, digest);
+    for (size_t i = 0; i < MD5_SIZE; ++i) {
+        snprintf(name + i * 2, 3, "%02x", digest[i]);
+    }
+
+    rc = snprintf(path, path_max, "%s/%s/%s.png", ctx.root, bkt->name, name);
+    return rc > 0 && (size_t)rc < path_max;
+}
+
+/**
+ * Get value of meta info by key.
+ * @param img image instance
+ * @param key meta key name
+ * @return value or NULL if key not found
+ */
+static const char* get_meta(const struct image* img, const char* key)
+{
+    list_for_each(img->info, const struct image_info, it) {
+        if (strcmp(it->key, key) == 0) {
+            return it->value;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Get bucket index for the thumbnail size.
+ * @param size thumbnail size
+ * @return index of the smallest bucket that fits the size
+ */
+static size_t bucket_index(size_t size)
+{
+    size_t i = 0;
+    while (i < ARRAY_SIZE(buckets) - 1 && buckets[i].size < size) {
+        ++i;
+    }
+    return i;
+}
+
+bool xdgthumb_init(void)
+{
+    ctx.root_len =
+        fs_envpath("XDG_CACHE_HOME", "/thumbnails", ctx.root, sizeof(ctx.root));
+    if (!ctx.root_len) {
+        ctx.root_len = fs_envpath("HOME", "/.cache/thumbnails", ctx.root,
+                                  sizeof(ctx.root));
+    }
+    return ctx.root_len;
+}
+
+bool xdgthumb_load(struct image* img, size_t size, bool fill,
+                   enum aa_mode aa_mode)
+{
+    char uri[PATH_MAX * 3];
+    char path[PATH_MAX];
+    char mtime[32];
+    struct stat st;
+    size_t len;
+
+    if (!ctx.root_len || stat(img->source, &st) == -1 ||
+        !S_ISREG(st.st_mode)) {
+        return false;
+    }
+    len = file_uri(img->source, uri, sizeof(uri));
+    if (!len) {
+        return false;
+    }
+    snprintf(mtime, sizeof(mtime), "%lld", (long long)st.st_mtim.tv_sec);
+
+    // try buckets from the best matching to the largest one
+    for (size_t i = bucket_index(size); i < ARRAY_SIZE(buckets); ++i) {
+        struct image* thumb;
+        const char* val;
+
+        if (!thumb_path(uri, len, &buckets[i], path, sizeof(path)) ||
+            access(path, R_OK) == -1) {
+            continue;
+        }
+
+        thumb = image_create(path);
+        if (!thumb) {
+            return false;
+        }
+        if (image_load(thumb) == imgload_success) {
+            // the thumbnail is valid only if it was created from the same file
+            val = get_meta(thumb, META_MTIME);
+            if (val && strcmp(val, mtime) == 0) {
+                val = get_meta(thumb, META_URI);
+                if (val && strcmp(val, uri) == 0 &&
+                    image_thumb_create(thumb, size, fill, aa_mode)) {
+                    img->alpha = thumb->alpha;
+                    img->thumbnail = thumb->thumbnail;
+                    thumb->thumbnail.data = NULL;
+                }
+            }
+        }
+        image_free(thumb, IMGFREE_ALL);
+
+        if (image_has_thumb(img)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool xdgthumb_save(struct image* img, size_t size, enum aa_mode aa_mode)
+{
+    const struct bucket* bkt = &buckets[bucket_index(size)];
+    char uri[PATH_MAX * 3];
+    char path[PATH_MAX];
+    char tmp[PATH_MAX + 16];
+    const struct pixmap* full;
+    struct image* thumb;
+    struct pixmap pm;
+    struct stat st;
+    double scale;
+    size_t len;
+    bool rc;
+
+    if (!ctx.root_len || !image_has_frames(img) ||
+        stat(img->source, &st) == -1 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+    len = file_uri(img->source, uri, sizeof(uri));
+    if (!len || !thumb_path(uri, len, bkt, path, sizeof(path))) {
+        return false;
+    }
+
+    // create directories with the permissions required by specification
+    if (!fs_mkdirs(path, S_IRWXU)) {
+        return false;
+    }
+
+    // scale to fit the bucket size keeping aspect ratio, never upscale
+    full = &img->frames[0].pm;
+    scale = min(1.0, min((double)bkt->size / full->width,
+                         (double)bkt->size / full->height));
+    if (!pixmap_create(&pm, max(1, full->width * scale),
+                       max(1, full->height * scale))) {
+        return false;
+    }
+    if (aa_mode != aa_nearest) {
+        full = image_mipmap(img, 0, &scale);
+    }
+    pixmap_scale(aa_mode, full, &pm, 0, 0, scale, img->alpha);
+
+    // meta info required by specification
+    thumb = image_create(img->source);
+    if (!thumb) {
+        pixmap_free(&pm);
+        return false;
+    }
+    image_add_meta(thumb, META_URI, "%s", uri);
+    image_add_meta(thumb, META_MTIME, "%lld", (long long)st.st_mtim.tv_sec);
+    image_add_meta(thumb, META_SIZE, "%lld", (long long)st.st_size);
+    image_add_meta(thumb, META_SOFT, "swayimg");
+
+    // write to temporary file and rename it to make it atomic
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", path, (int)getpid());
+    rc = export_png(&pm, thumb->info, tmp);
+    if (rc) {
+        chmod(tmp, S_IRUSR | S_IWUSR);
+        rc = rename(tmp, path) == 0;
+    }
+    if (!rc) {
+        unlink(tmp);
+    }
+
+    image_free(thumb, IMGFREE_ALL);
+    pixmap_free(&pm);
+
+    return rc;
+}
@@ -0,0 +1,33 @@
+// SPDX-License-Identifier: MIT
+// Shared thumbnail cache (freedesktop.org thumbnail specification).
+// Copyright (C) 2025 Artem Senichev <artemsen@gmail.com>
+
+#pragma once
+
+#include "image.h"
+
+/**
+ * Initialize shared thumbnail cache: get path to the cache directory.
+ * @return true if cache directory is available
+ */
+bool xdgthumb_init(void);
+
+/**
+ * Load thumbnail from the shared cache.
+ * @param img image for loading thumbnail
+ * @param size thumbnail size
+ * @param fill scale mode (fill/fit)
+ * @param aa_mode anti-aliasing mode
+ * @return true if thumbnail loaded
+ */
+bool xdgthumb_load(struct image* img, size_t size, bool fill,
+                   enum aa_mode aa_mode);
+
+/**
+ * Save thumbnail to the shared cache.
+ * @param img image with loaded frames to create thumbnail from
+ * @param size thumbnail size, used to select cache bucket
+ * @param aa_mode anti-aliasing mode
+ * @return true if thumbnail saved
+ */
+bool xdgthumb_save(struct image* img, size_t size, enum aa_mode aa_mode);
@@ -0,0 +1,73 @@
+// SPDX-License-Identifier: MIT
+// Copyright (C) 2025 Artem Senichev <artemsen@gmail.com>
+
+extern "C" {
+#include "atlas.h"
+}
+
+#include <gtest/gtest.h>
+
+class Atlas : public ::testing::Test {
+protected:
+    void TearDown() override { atlas_destroy(); }
+};
+
+TEST_F(Atlas, Disabled)
+{
+    struct pixmap pm;
+    ASSERT_TRUE(atlas_alloc(&pm, 4, 4));
+    EXPECT_EQ(pm.width, static_cast<size_t>(4));
+    EXPECT_EQ(pm.height, static_cast<size_t>(4));
+    atlas_free(&pm);
+}
+
+TEST_F(Atlas, Reuse)
+{
+    struct pixmap pm1, pm2;
+
+    atlas_init(4, 4);
+
+    ASSERT_TRUE(atlas_alloc(&pm1, 4, 4));
+    EXPECT_EQ(pm1.data[15], static_cast<argb_t>(0));
+    pm1.data[15] = 0xffffffff;
+    argb_t* data = pm1.data;
+    atlas_free(&pm1);
+
+    // freed slot is reused and cleared
+    ASSERT_TRUE(atlas_alloc(&pm2, 2, 3));
+    EXPECT_EQ(pm2.data, data);
+    EXPECT_EQ(pm2.width, static_cast<size_t>(2));
+    EXPECT_EQ(pm2.height, static_cast<size_t>(3));
+    atlas_free(&pm2);
+}
+
+TEST_F(Atlas, Oversized)
+{
+    struct pixmap pm;
+
+    atlas_init(4, 4);
+
+    // doesn't fit into the slot, allocated on heap
+    ASSERT_TRUE(atlas_alloc(&pm, 5, 4));
+    atlas_free(&pm);
+}
+
+TEST_F(Atlas, Slabs)
+{
+    struct pixmap pm[100];
+
+    atlas_init(2, 2);
+
+    for (size_t i = 0; i < sizeof(pm) / sizeof(pm[0]); ++i) {
+        ASSERT_TRUE(atlas_alloc(&pm[i], 2, 2));
+        pm[i].data[3] = i;
+    }
+    for (size_t i = 0; i < sizeof(pm) / sizeof(pm[0]); ++i) {
+        EXPECT_EQ(pm[i].data[3], i);
+    }
+    EXPECT_GE(atlas_memory(),
+              sizeof(pm) / sizeof(pm[0]) * 2 * 2 * sizeof(argb_t));
+    for (size_t i = 0; i < sizeof(pm) / sizeof(pm[0]); ++i) {
+        atlas_free(&pm[i]);
+    }
+}
@@ -0,0 +1,306 @@
+// SPDX-License-Identifier: MIT
+// Microbenchmarks, each result is printed as a single line of JSON.
+// Copyright (C) 2025 Artem Senichev <artemsen@gmail.com>
+
+extern "C" {
+#include "config.h"
+#include "imglist.h"
+#include "layout.h"
+#include "memstat.h"
+#include "pixmap_scale.h"
+}
+
+#include <dirent.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Number of measurements of each case, the best one is reported
+#define REPEATS 5
+// Min duration of a single measurement
+#define MIN_DURATION std::chrono::milliseconds(100)
+
+/**
+ * Measure the operation and print result.
+ * @param name benchmark name
+ * @param params description of benchmark parameters
+ * @param op operation to measure
+ */
+static void measure(const char* name, const std::string& params,
+                    const std::function<void()>& op)
+{
+    using clock = std::chrono::steady_clock;
+    size_t iterations = 1;
+    double best = 0;
+
+    op(); // warm up
+
+    // calibrate number of iterations to get measurable time
+    while (true) {
+        const auto start = clock::now();
+        for (size_t i = 0; i < iterations; ++i) {
+            op();
+        }
+        if (clock::now() - start >= MIN_DURATION || iterations >= 1 << 20) {
+            break;
+        }
+        iterations *= 2;
+    }
+
+    for (size_t r = 0; r < REPEATS; ++r) {
+        const auto start = clock::now();
+        for (size_t i = 0; i < iterations; ++i) {
+            op();
+        }
+        const std::chrono::duration<double, std::nano> time =
+            clock::now() - start;
+        const double ns = time.count() / iterations;
+        if (r == 0 || ns < best) {
+            best = ns;
+        }
+    }
+
+    printf("{\"name\":\"%s\",\"params\":\"%s\",\"iterations\":%zu,"
+           "\"ns_per_op\":%.0f}\n",
+           name, params.c_str(), iterations, best);
+    fflush(stdout);
+}
+
+/**
+ * Fill pixmap with reproducible pseudo random data.
+ * @param pm pixmap to fill
+ * @param alpha fill alpha channel too
+ */
+static void fill_random(struct pixmap* pm, bool alpha)
+{
+    uint32_t seed = 0x12345678;
+    for (size_t i = 0; i < pm->width * pm->height; ++i) {
+        seed = seed * 1664525 + 1013904223; // LCG
+        pm->data[i] = alpha ? seed : (seed | ARGB_SET_A(0xff));
+    }
+}
+
+/** Benchmark: scale with each anti-aliasing mode. */
+static void bench_scale()
+{
+    const size_t sizes[][2] = { { 640, 480 }, { 1920, 1080 }, { 4000, 3000 } };
+    const double scales[] = { 0.25, 0.5, 0.9, 1.5, 3.0 };
+    const enum aa_mode modes[] = { aa_nearest, aa_box, aa_bilinear, aa_bicubic,
+                                   aa_mks13 };
+    struct pixmap dst;
+
+    // fixed output window
+    if (!pixmap_create(&dst, 1920, 1080)) {
+        return;
+    }
+
+    for (const auto& size : sizes) {
+        struct pixmap src;
+        if (!pixmap_create(&src, size[0], size[1])) {
+            continue;
+        }
+        for (size_t a = 0; a < 2; ++a) {
+            const bool alpha = a;
+            fill_random(&src, alpha);
+            for (const double scale : scales) {
+                for (const enum aa_mode aa : modes) {
+                    char params[128];
+                    snprintf(params, sizeof(params),
+                             "aa=%s,src=%zux%zu,scale=%g,alpha=%zu",
+                             aa_name(aa), size[0], size[1], scale, a);
+                    measure("pixmap_scale", params, [&]() {
+                        pixmap_scale(aa, &src, &dst, 0, 0, scale, alpha);
+                    });
+                }
+            }
+        }
+        pixmap_free(&src);
+    }
+
+    pixmap_free(&dst);
+}
+
+/** Benchmark: rotate and flip. */
+static void bench_transform()
+{
+    struct pixmap pm;
+
+    if (!pixmap_create(&pm, 1920, 1080)) {
+        return;
+    }
+    fill_random(&pm, false);
+
+    measure("pixmap_rotate", "angle=90,size=1920x1080",
+            [&]() { pixmap_rotate(&pm, 90); });
+    measure("pixmap_rotate", "angle=180,size=1920x1080",
+            [&]() { pixmap_rotate(&pm, 180); });
+    measure("pixmap_flip_vertical", "size=1920x1080",
+            [&]() { pixmap_flip_vertical(&pm); });
+    measure("pixmap_flip_horizontal", "size=1920x1080",
+            [&]() { pixmap_flip_horizontal(&pm); });
+
+    pixmap_free(&pm);
+}
+
+/**
+ * Benchmark: decode each file from the corpus.
+ * @param corpus path to the directory with images
+ */
+static void bench_decode(const char* corpus)
+{
+    std::vector<std::string> files;
+    DIR* dir = opendir(corpus);
+    struct dirent* entry;
+
+    if (!dir) {
+        fprintf(stderr, "Unable to open corpus %s\n", corpus);
+        return;
+    }
+    while ((entry = readdir(dir))) {
+        if (entry->d_name[0] != '.') {
+            files.push_back(std::string(corpus) + "/" + entry->d_name);
+        }
+    }
+    closedir(dir);
+    std::sort(files.begin(), files.end()); // reproducible order
+
+    for (const auto& file : files) {
+        struct image* img = image_create(file.c_str());
+        if (!img) {
+            continue;
+        }
+        if (image_load(img) == imgload_success) {
+            const std::string params = std::string("file=") +
+                file.substr(file.rfind('/') + 1) + ",format=" + img->format;
+            measure("image_load", params, [&]() { image_load(img); });
+        }
+        image_free(img, IMGFREE_ALL);
+    }
+}
+
+/**
+ * Create synthetic image list sources.
+ * @param num number of sources
+ * @return array of sources
+ */
+static std::vector<std::string> synthetic_sources(size_t num)
+{
+    std::vector<std::string> sources(num);
+    for (size_t i = 0; i < num; ++i) {
+        // reversed order to make sorting do the work
+        sources[i] = LDRSRC_EXEC + std::to_string(num - i);
+    }
+    return sources;
+}
+
+/**
+ * Benchmark: load image list.
+ * @param cfg config instance
+ */
+static void bench_imglist(struct config* cfg)
+{
+    const size_t sizes[] = { 10000, 100000 };
+
+    for (const size_t num : sizes) {
+        const std::vector<std::string> sources_str = synthetic_sources(num);
+        std::vector<const char*> sources(num);
+        for (size_t i = 0; i < num; ++i) {
+            sources[i] = sources_str[i].c_str();
+        }
+        measure("imglist_load", "order=alpha,num=" + std::to_string(num),
+                [&]() {
+                    imglist_init(cfg);
+                    imglist_load(&sources[0], num);
+                    imglist_destroy();
+                });
+    }
+}
+
+/**
+ * Benchmark: move selection in the gallery layout.
+ * @param cfg config instance
+ */
+static void bench_layout(struct config* cfg)
+{
+    const size_t num = 100000;
+    const std::vector<std::string> sources_str = synthetic_sources(num);
+    std::vector<const char*> sources(num);
+    struct layout layout;
+
+    for (size_t i = 0; i < num; ++i) {
+        sources[i] = sources_str[i].c_str();
+    }
+
+    imglist_init(cfg);
+    imglist_load(&sources[0], num);
+    imglist_lock();
+    layout_init(&layout, 200);
+    layout.current = imglist_first();
+    layout_resize(&layout, 1920, 1080);
+
+    const enum layout_dir dirs[] = { layout_right, layout_down, layout_pgdown,
+                                     layout_first };
+    const char* names[] = { "right", "down", "pgdown", "first" };
+    for (size_t i = 0; i < sizeof(dirs) / sizeof(dirs[0]); ++i) {
+        measure("layout_select",
+                std::string("dir=") + names[i] +
+                    ",num=" + std::to_string(num) + ",window=1920x1080",
+                [&]() {
+                    if (!layout_select(&layout, dirs[i])) {
+                        layout_select(&layout, layout_first);
+                    }
+                });
+    }
+
+    layout_free(&layout);
+    imglist_unlock();
+    imglist_destroy();
+}
+
+/** Print memory usage by category collected while running benchmarks. */
+static void print_memstat()
+{
+    for (size_t i = 0; i < MEMSTAT_NUM; ++i) {
+        const enum memstat_type type = static_cast<enum memstat_type>(i);
+        printf("{\"name\":\"memstat\",\"params\":\"type=%s\","
+               "\"live_bytes\":%zu,\"peak_bytes\":%zu}\n",
+               memstat_name(type), memstat_live(type), memstat_peak(type));
+    }
+    fflush(stdout);
+}
+
+/**
+ * Benchmark entry point.
+ * @param argc,argv optional path to the directory with images to decode
+ */
+int main(int argc, char* argv[])
+{
+    const char* corpus = argc > 1 ? argv[1] : TEST_DATA_DIR;
+    struct config* cfg;
+
+    // don't depend on user config
+    unsetenv("XDG_CONFIG_HOME");
+    unsetenv("XDG_CONFIG_DIRS");
+    unsetenv("HOME");
+    cfg = config_load();
+    if (!cfg) {
+        return EXIT_FAILURE;
+    }
+    config_set(cfg, CFG_LIST, CFG_LIST_ORDER, "alpha");
+
+    bench_scale();
+    bench_transform();
+    bench_decode(corpus);
+    bench_imglist(cfg);
+    bench_layout(cfg);
+    print_memstat();
+
+    config_free(cfg);
+
+    return EXIT_SUCCESS;
+}
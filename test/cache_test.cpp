@@ -110,3 +110,76 @@ TEST_F(Cache, Out)
     EXPECT_TRUE(cache_out(cache, img));
     EXPECT_FALSE(cache_out(cache, imglist_last()));
 }
+
+TEST_F(Cache, Packed)
+{
+    cache = cache_init(1);
+    ASSERT_TRUE(cache);
+    cache_set_packed(cache, 1);
+
+    // fill frames with gradient to check restored content
+    struct image* img = imglist_first();
+    ASSERT_TRUE(img);
+    for (size_t i = 0; i < 3; ++i) {
+        struct pixmap* pm = image_alloc_frame(img, 64, 48);
+        ASSERT_TRUE(pm);
+        for (size_t p = 0; p < pm->width * pm->height; ++p) {
+            pm->data[p] = ARGB(0xff, p, p >> 8, i);
+        }
+        ASSERT_TRUE(cache_put(cache, img));
+        img = imglist_next(img);
+    }
+
+    // first evicted, second packed, third decoded
+    img = imglist_first();
+    EXPECT_FALSE(image_has_frames(img));
+    EXPECT_FALSE(cache_out(cache, img));
+    img = imglist_next(img);
+    EXPECT_FALSE(image_has_frames(img));
+    EXPECT_LT(cache_memory(cache), 2 * 64 * 48 * sizeof(argb_t));
+
+    ASSERT_TRUE(cache_out(cache, img));
+    ASSERT_TRUE(image_has_frames(img));
+    const struct pixmap* pm = &img->frames[0].pm;
+    ASSERT_EQ(pm->width, static_cast<size_t>(64));
+    ASSERT_EQ(pm->height, static_cast<size_t>(48));
+    for (size_t p = 0; p < pm->width * pm->height; ++p) {
+        ASSERT_EQ(pm->data[p], ARGB(0xff, p, p >> 8, 1));
+    }
+    image_free(img, IMGFREE_FRAMES);
+}
+
+TEST_F(Cache, Limit)
+{
+    cache = cache_init(5);
+    ASSERT_TRUE(cache);
+
+    // each image takes 10x10 pixels, limit is enough for 2 images
+    const size_t img_size = 10 * 10 * sizeof(argb_t);
+    cache_set_limit(cache, img_size * 2 + 1);
+
+    struct image* img = imglist_first();
+    ASSERT_TRUE(img);
+    for (size_t i = 0; i < 3; ++i) {
+        ASSERT_TRUE(image_alloc_frame(img, 10, 10));
+        EXPECT_EQ(image_memory(img), img_size);
+        EXPECT_EQ(cache_fits(cache, img), i < 2);
+        ASSERT_TRUE(cache_put(cache, img));
+        img = imglist_next(img);
+    }
+
+    img = imglist_first();
+    EXPECT_FALSE(image_has_frames(img));
+    img = imglist_next(img);
+    EXPECT_TRUE(image_has_frames(img));
+    img = imglist_next(img);
+    EXPECT_TRUE(image_has_frames(img));
+    EXPECT_EQ(cache_memory(cache), img_size * 2);
+
+    // image larger than the limit
+    img = imglist_next(img);
+    ASSERT_TRUE(image_alloc_frame(img, 100, 100));
+    EXPECT_FALSE(cache_fits(cache, img));
+    EXPECT_FALSE(cache_put(cache, img));
+    image_free(img, IMGFREE_FRAMES);
+}
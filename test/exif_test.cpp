@@ -3,6 +3,7 @@
 
 extern "C" {
 #include "exif.h"
+#include "formats/loader.h"
 }
 
 #include <gtest/gtest.h>
@@ -23,6 +24,11 @@ TEST_F(Exif, Read)
                                     (std::istreambuf_iterator<char>()));
 
     process_exif(image, data.data(), data.size());
+    EXPECT_EQ(list_size(&image->info->list), static_cast<size_t>(0));
+    ASSERT_NE(image->exif, nullptr);
+
+    exif_meta(image);
+    EXPECT_EQ(image->exif, nullptr);
 
     ASSERT_EQ(list_size(&image->info->list), static_cast<size_t>(7));
 
@@ -69,11 +75,30 @@ TEST_F(Exif, Read)
     }
 }
 
+TEST_F(Exif, Orientation)
+{
+    // big endian TIFF, IFD0 with the single entry: orientation = 6
+    const uint8_t data[] = { 'E', 'x', 'i', 'f', 0,    0,    'M', 'M',
+                             0,   42,  0,   0,   0,    8,    0,   1,
+                             1,   18,  0,   3,   0,    0,    0,   1,
+                             0,   6,   0,   0,   0,    0,    0,   0 };
+    struct pixmap* pm = image_alloc_frame(image, 2, 1);
+    ASSERT_NE(pm, nullptr);
+
+    process_exif(image, data, sizeof(data));
+    EXPECT_EQ(image->frames[0].pm.width, static_cast<size_t>(1));
+    EXPECT_EQ(image->frames[0].pm.height, static_cast<size_t>(2));
+    EXPECT_EQ(image->exif_size, sizeof(data));
+}
+
 TEST_F(Exif, Fail)
 {
     process_exif(image, nullptr, 0);
+    exif_meta(image);
     EXPECT_EQ(list_size(&image->info->list), static_cast<size_t>(0));
 
     process_exif(image, reinterpret_cast<const uint8_t*>("abcd"), 4);
+    exif_meta(image);
+    EXPECT_EQ(image->exif, nullptr);
     EXPECT_EQ(list_size(&image->info->list), static_cast<size_t>(0));
 }
@@ -0,0 +1,118 @@
+// SPDX-License-Identifier: MIT
+// Copyright (C) 2025 Artem Senichev <artemsen@gmail.com>
+
+extern "C" {
+#include "fcache.h"
+}
+
+#include <dirent.h>
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#define SOURCE TEST_DATA_DIR "/image.bmp"
+
+class FrameCache : public ::testing::Test {
+protected:
+    void SetUp() override
+    {
+        char tmpl[] = "/tmp/swayimg_fcache_XXXXXX";
+        ASSERT_TRUE(mkdtemp(tmpl));
+        dir = tmpl;
+        path = dir + "/frames";
+    }
+
+    void TearDown() override
+    {
+        fcache_destroy();
+        if (image) {
+            image_free(image, IMGFREE_ALL);
+        }
+        DIR* dh = opendir(path.c_str());
+        if (dh) {
+            struct dirent* entry;
+            while ((entry = readdir(dh))) {
+                unlinkat(dirfd(dh), entry->d_name, 0);
+            }
+            closedir(dh);
+        }
+        rmdir(path.c_str());
+        rmdir(dir.c_str());
+    }
+
+    // Load image bypassing the cache
+    void LoadImage()
+    {
+        image = image_create(SOURCE);
+        ASSERT_TRUE(image);
+        ASSERT_EQ(image_load(image), imgload_success);
+    }
+
+    // Number of files in the cache
+    size_t FilesNum()
+    {
+        size_t num = 0;
+        DIR* dh = opendir(path.c_str());
+        if (dh) {
+            struct dirent* entry;
+            while ((entry = readdir(dh))) {
+                num += (entry->d_name[0] != '.');
+            }
+            closedir(dh);
+        }
+        return num;
+    }
+
+    std::string dir;
+    std::string path;
+    struct image* image = nullptr;
+};
+
+TEST_F(FrameCache, SaveLoad)
+{
+    LoadImage();
+
+    ASSERT_TRUE(fcache_init(path.c_str(), 1024 * 1024, 100));
+    fcache_save(image, 10); // too fast
+    fcache_save(image, 200);
+    fcache_destroy(); // wait for writer
+    EXPECT_EQ(FilesNum(), static_cast<size_t>(1));
+
+    ASSERT_TRUE(fcache_init(path.c_str(), 1024 * 1024, 100));
+    struct image* loaded = image_create(SOURCE);
+    ASSERT_TRUE(loaded);
+    ASSERT_TRUE(fcache_load(loaded));
+    EXPECT_STREQ(loaded->format, image->format);
+    EXPECT_EQ(loaded->alpha, image->alpha);
+    const struct pixmap* pm = &image->frames[0].pm;
+    ASSERT_EQ(loaded->frames[0].pm.width, pm->width);
+    ASSERT_EQ(loaded->frames[0].pm.height, pm->height);
+    EXPECT_EQ(memcmp(loaded->frames[0].pm.data, pm->data,
+                     pm->width * pm->height * sizeof(argb_t)),
+              0);
+    image_free(loaded, IMGFREE_ALL);
+}
+
+TEST_F(FrameCache, Miss)
+{
+    ASSERT_TRUE(fcache_init(path.c_str(), 1024 * 1024, 100));
+    struct image* img = image_create(SOURCE);
+    ASSERT_TRUE(img);
+    EXPECT_FALSE(fcache_load(img));
+    image_free(img, IMGFREE_ALL);
+
+    img = image_create("exec://cat " SOURCE);
+    ASSERT_TRUE(img);
+    EXPECT_FALSE(fcache_load(img));
+    image_free(img, IMGFREE_ALL);
+}
+
+TEST_F(FrameCache, Evict)
+{
+    LoadImage();
+
+    // limit is less than the size of a single file
+    ASSERT_TRUE(fcache_init(path.c_str(), 1, 0));
+    fcache_save(image, 1);
+    fcache_destroy();
+    EXPECT_EQ(FilesNum(), static_cast<size_t>(0));
+}
@@ -6,6 +6,8 @@ extern "C" {
 }
 
 #include <gtest/gtest.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 TEST(FileSystem, AppendPath)
 {
@@ -92,3 +94,46 @@ TEST(FileSystem, EnvPath)
     EXPECT_STREQ(path, "/root/dir/file.ext");
     unsetenv(env_key);
 }
+
+TEST(FileSystem, MakeDirs)
+{
+    char tmpl[] = "/tmp/swayimg_fs_XXXXXX";
+    ASSERT_TRUE(mkdtemp(tmpl));
+    const std::string root = tmpl;
+    struct stat st;
+
+    // file path: only parent directories are created
+    EXPECT_TRUE(fs_mkdirs((root + "/a/b/file").c_str(), S_IRWXU));
+    EXPECT_EQ(stat((root + "/a/b").c_str(), &st), 0);
+    EXPECT_TRUE(S_ISDIR(st.st_mode));
+    EXPECT_NE(stat((root + "/a/b/file").c_str(), &st), 0);
+
+    // directory path, some of directories already exist
+    EXPECT_TRUE(fs_mkdirs((root + "/a/c/").c_str(), S_IRWXU));
+    EXPECT_EQ(stat((root + "/a/c").c_str(), &st), 0);
+    EXPECT_TRUE(S_ISDIR(st.st_mode));
+
+    rmdir((root + "/a/c").c_str());
+    rmdir((root + "/a/b").c_str());
+    rmdir((root + "/a").c_str());
+    rmdir(root.c_str());
+}
+
+TEST(FileSystem, WriteReadStr)
+{
+    int fd[2];
+    ASSERT_EQ(pipe(fd), 0);
+    EXPECT_TRUE(fs_write(fd[1], "abc\0de", 7));
+    close(fd[1]);
+
+    uint8_t buf[16];
+    ASSERT_EQ(read(fd[0], buf, sizeof(buf)), 7);
+    close(fd[0]);
+
+    const uint8_t* ptr = buf;
+    const uint8_t* end = buf + 7;
+    EXPECT_STREQ(fs_read_str(&ptr, end), "abc");
+    EXPECT_STREQ(fs_read_str(&ptr, end), "de");
+    EXPECT_EQ(ptr, end);
+    EXPECT_FALSE(fs_read_str(&ptr, end));
+}
@@ -3,6 +3,7 @@
 
 extern "C" {
 #include "buildcfg.h"
+#include "formats/loader.h"
 #include "image.h"
 
 #ifdef HAVE_LIBRSVG
@@ -11,6 +12,7 @@ extern "C" {
 }
 
 #include <gtest/gtest.h>
+#include <string>
 #include <unistd.h>
 
 class Image : public ::testing::Test {
@@ -79,6 +81,44 @@ TEST_F(Image, Free)
     EXPECT_FALSE(image->format);
 }
 
+TEST_F(Image, Meta)
+{
+    image = image_create("file");
+    ASSERT_TRUE(image);
+
+    // more entries than fits into a single arena block
+    image_set_format(image, "Format %d", 1);
+    for (int i = 0; i < 100; ++i) {
+        image_add_meta(image, "Key", "Value %d", i);
+    }
+    std::string large(4096, 'x');
+    image_add_meta(image, "Large", "%s", large.c_str());
+    EXPECT_TRUE(image->arena);
+    EXPECT_STREQ(image->format, "Format 1");
+    ASSERT_EQ(list_size(&image->info->list), static_cast<size_t>(101));
+
+    // move meta info with its storage
+    struct image* new_img = image_create("file");
+    ASSERT_TRUE(new_img);
+    image_update(new_img, image);
+    EXPECT_FALSE(image->arena);
+    EXPECT_FALSE(image->info);
+    EXPECT_STREQ(new_img->format, "Format 1");
+    int index = 0;
+    list_for_each(new_img->info, const struct image_info, it) {
+        if (index < 100) {
+            EXPECT_STREQ(it->key, "Key");
+            EXPECT_EQ(it->value, "Value " + std::to_string(index));
+        } else {
+            EXPECT_EQ(it->value, large);
+        }
+        ++index;
+    }
+    EXPECT_EQ(index, 101);
+
+    image_free(new_img, IMGFREE_ALL);
+}
+
 TEST_F(Image, Transform)
 {
     Load(TEST_DATA_DIR "/image.bmp");
@@ -103,6 +143,186 @@ TEST_F(Image, Thumbnail)
     EXPECT_EQ(image->thumbnail.height, static_cast<size_t>(10));
 }
 
+TEST_F(Image, ThumbnailFrame)
+{
+    Load(TEST_DATA_DIR "/image.bmp");
+    ASSERT_TRUE(image_thumb_create(image, 10, false, aa_nearest));
+    image_free(image, IMGFREE_FRAMES);
+    ASSERT_FALSE(image_has_frames(image));
+
+    ASSERT_TRUE(image_thumb_frame(image));
+    ASSERT_TRUE(image_has_frames(image));
+    const struct pixmap* pm = &image->frames[0].pm;
+    ASSERT_EQ(pm->width, image->thumbnail.width);
+    ASSERT_EQ(pm->height, image->thumbnail.height);
+    EXPECT_EQ(memcmp(pm->data, image->thumbnail.data,
+                     pm->width * pm->height * sizeof(argb_t)),
+              0);
+}
+
+TEST_F(Image, ThumbnailCopy)
+{
+    Load(TEST_DATA_DIR "/image.bmp");
+    const struct pixmap* full = &image->frames[0].pm;
+
+    struct image* copy = image_create(image->source);
+    ASSERT_TRUE(copy);
+    ASSERT_TRUE(image_thumb_copy(copy, image, 1));
+    EXPECT_EQ(copy->frames[0].pm.width, full->width);
+    EXPECT_EQ(copy->frames[0].pm.height, full->height);
+    EXPECT_EQ(memcmp(copy->frames[0].pm.data, full->data,
+                     full->width * full->height * sizeof(argb_t)),
+              0);
+    image_free(copy, IMGFREE_FRAMES);
+
+    // use existing mipmap level
+    double scale = 0.25;
+    const struct pixmap* mip = image_mipmap(image, 0, &scale);
+    ASSERT_NE(mip, full);
+    ASSERT_TRUE(image_thumb_copy(copy, image, 1));
+    EXPECT_EQ(copy->frames[0].pm.width, mip->width);
+    EXPECT_EQ(copy->frames[0].pm.height, mip->height);
+    image_free(copy, IMGFREE_FRAMES);
+
+    // mipmap level is too small
+    ASSERT_TRUE(image_thumb_copy(copy, image, full->width));
+    EXPECT_EQ(copy->frames[0].pm.width, full->width);
+    image_free(copy, IMGFREE_ALL);
+}
+
+// Fake animation decoder: fills frame with its index
+static size_t anim_decoded;
+static bool anim_decode(struct image* img, size_t index)
+{
+    struct pixmap* pm = &img->frames[index].pm;
+    if (!pixmap_create(pm, 2, 1)) {
+        return false;
+    }
+    pm->data[0] = index;
+    ++anim_decoded;
+    return true;
+}
+static void anim_free(struct image_anim* anim)
+{
+    delete anim;
+}
+
+TEST_F(Image, LazyFrames)
+{
+    image = image_create("lazy");
+    ASSERT_TRUE(image);
+    ASSERT_TRUE(image_alloc_frames(image, 10));
+    for (size_t i = 0; i < image->num_frames; ++i) {
+        image->frames[i].pm.width = 2;
+        image->frames[i].pm.height = 1;
+    }
+    image->anim = new image_anim { anim_decode, anim_free, 0, false };
+    anim_decoded = 0;
+
+    ASSERT_TRUE(image_frame_load(image, 0));
+    ASSERT_TRUE(image_frame_load(image, 1));
+    ASSERT_TRUE(image_frame_load(image, 1)); // already loaded
+    EXPECT_EQ(anim_decoded, static_cast<size_t>(2));
+    EXPECT_EQ(image->frames[1].pm.data[0], static_cast<argb_t>(1));
+    EXPECT_EQ(image_memory(image), 2 * 2 * sizeof(argb_t));
+
+    // the first, previous and the next frames are kept
+    ASSERT_TRUE(image_frame_load(image, 5));
+    ASSERT_TRUE(image_frame_load(image, 6));
+    EXPECT_TRUE(image->frames[0].pm.data);
+    EXPECT_FALSE(image->frames[1].pm.data);
+    EXPECT_TRUE(image->frames[5].pm.data);
+    EXPECT_TRUE(image->frames[6].pm.data);
+
+    // transformation of decoded frames is deferred until they are requested
+    image_rotate(image, 90);
+    EXPECT_EQ(image->frames[0].pm.width, static_cast<size_t>(1));
+    EXPECT_EQ(image->frames[6].pm.width, static_cast<size_t>(2));
+    ASSERT_TRUE(image_frame_load(image, 6));
+    EXPECT_EQ(image->frames[6].pm.width, static_cast<size_t>(1));
+    EXPECT_EQ(image->frames[6].pm.height, static_cast<size_t>(2));
+
+    // transformation is applied to frames decoded later
+    EXPECT_EQ(image->frames[7].pm.width, static_cast<size_t>(1));
+    ASSERT_TRUE(image_frame_load(image, 7));
+    EXPECT_EQ(image->frames[7].pm.width, static_cast<size_t>(1));
+    EXPECT_EQ(image->frames[7].pm.height, static_cast<size_t>(2));
+    EXPECT_EQ(image->frames[7].pm.data[0], static_cast<argb_t>(7));
+
+    image_flip_horizontal(image);
+    ASSERT_TRUE(image_frame_load(image, 8));
+    EXPECT_EQ(image->frames[8].pm.data[0], static_cast<argb_t>(8));
+}
+
+TEST_F(Image, Bands)
+{
+    struct image_band band;
+    struct pixmap* pm;
+
+    image = image_create("bands");
+    ASSERT_TRUE(image);
+
+    // 5x5 image doesn't fit into 4 pixels: downscaled 1:3 to 2x2
+    image_set_limit(4 * sizeof(argb_t));
+    pm = image_alloc_bands(image, &band, 5, 5, 2);
+    image_set_limit(0);
+    ASSERT_TRUE(pm);
+    EXPECT_EQ(pm->width, static_cast<size_t>(2));
+    EXPECT_EQ(pm->height, static_cast<size_t>(2));
+    EXPECT_EQ(band.scale, static_cast<size_t>(3));
+    EXPECT_EQ(band.rows, static_cast<size_t>(6));
+
+    struct pixmap* part = image_band_get(&band, 0);
+    ASSERT_EQ(part->height, static_cast<size_t>(5));
+    for (size_t i = 0; i < part->width * part->height; ++i) {
+        part->data[i] = ARGB(0xff, 0, 0, i % part->width < 3 ? 0x30 : 0x60);
+    }
+    image_band_put(&band);
+    image_band_free(&band);
+
+    EXPECT_EQ(pm->data[0], ARGB(0xff, 0, 0, 0x30));
+    EXPECT_EQ(pm->data[1], ARGB(0xff, 0, 0, 0x60));
+    EXPECT_EQ(pm->data[3], ARGB(0xff, 0, 0, 0x60));
+}
+
+TEST_F(Image, BandsFullSize)
+{
+    struct image_band band;
+
+    image = image_create("bands");
+    ASSERT_TRUE(image);
+
+    struct pixmap* pm = image_alloc_bands(image, &band, 5, 5, 2);
+    ASSERT_TRUE(pm);
+    EXPECT_EQ(band.scale, static_cast<size_t>(1));
+    EXPECT_EQ(image_band_get(&band, 4)->data, &pm->data[4 * 5]);
+    EXPECT_EQ(band.pm.height, static_cast<size_t>(1));
+    image_band_free(&band);
+}
+
+TEST_F(Image, Mipmap)
+{
+    double scale;
+
+    Load(TEST_DATA_DIR "/image.bmp");
+
+    scale = 0.7;
+    EXPECT_EQ(image_mipmap(image, 0, &scale), &image->frames[0].pm);
+    EXPECT_EQ(scale, 0.7);
+    EXPECT_EQ(image->frames[0].num_mips, static_cast<size_t>(0));
+
+    scale = 0.25;
+    const struct pixmap* pm = image_mipmap(image, 0, &scale);
+    ASSERT_EQ(image->frames[0].num_mips, static_cast<size_t>(1));
+    EXPECT_EQ(pm, &image->frames[0].mips[0]);
+    EXPECT_EQ(pm->width, static_cast<size_t>(1));
+    EXPECT_EQ(pm->height, static_cast<size_t>(1));
+    EXPECT_EQ(scale, 0.5);
+
+    image_rotate(image, 90);
+    EXPECT_EQ(image->frames[0].num_mips, static_cast<size_t>(0));
+}
+
 TEST_F(Image, LoadFromExec)
 {
     image = image_create(LDRSRC_EXEC "cat " TEST_DATA_DIR "/image.bmp");
@@ -110,6 +330,134 @@ TEST_F(Image, LoadFromExec)
     ASSERT_EQ(image_load(image), imgload_success);
 }
 
+TEST_F(Image, LoadFromExecLarge)
+{
+    // output doesn't fit into the initial stream buffer
+    image = image_create(LDRSRC_EXEC "cat " TEST_DATA_DIR "/image.bmp;"
+                                     "head -c 1000000 /dev/zero");
+    ASSERT_TRUE(image);
+    ASSERT_EQ(image_load(image), imgload_success);
+    EXPECT_EQ(image->frames[0].pm.width, static_cast<size_t>(2));
+}
+
+#ifdef HAVE_LIBJPEG
+TEST_F(Image, LoadFromExecStreamJpeg)
+{
+    image = image_create(LDRSRC_EXEC "cat " TEST_DATA_DIR "/image.jpg");
+    ASSERT_TRUE(image);
+    ASSERT_EQ(image_load(image), imgload_success);
+    EXPECT_EQ(image->frames[0].pm.width, static_cast<size_t>(2));
+    EXPECT_EQ(image->file_size, static_cast<size_t>(868));
+}
+#endif // HAVE_LIBJPEG
+
+#ifdef HAVE_LIBPNG
+TEST_F(Image, LoadFromExecStreamPng)
+{
+    // padding to make the stream longer than the format detection head
+    image = image_create(LDRSRC_EXEC "cat " TEST_DATA_DIR "/image.png;"
+                                     "head -c 512 /dev/zero");
+    ASSERT_TRUE(image);
+    ASSERT_EQ(image_load(image), imgload_success);
+    EXPECT_EQ(image->file_size, static_cast<size_t>(152 + 512));
+}
+
+TEST_F(Image, LoadPngDownscaled)
+{
+    // 2x2 image doesn't fit into a single pixel
+    image = image_create(TEST_DATA_DIR "/image.png");
+    ASSERT_TRUE(image);
+    image_set_limit(sizeof(argb_t));
+    const enum image_status status = image_load(image);
+    image_set_limit(0);
+    ASSERT_EQ(status, imgload_success);
+    EXPECT_EQ(image->frames[0].pm.width, static_cast<size_t>(1));
+    EXPECT_EQ(image->frames[0].pm.height, static_cast<size_t>(1));
+}
+#endif // HAVE_LIBPNG
+
+#ifdef HAVE_LIBJPEG
+TEST_F(Image, LoadIsolated)
+{
+    image_set_isolation(true, 5);
+    Load(TEST_DATA_DIR "/image.bmp");
+    image_set_isolation(false, 0);
+
+    struct image* ref = image_create(TEST_DATA_DIR "/image.bmp");
+    ASSERT_TRUE(ref);
+    ASSERT_EQ(image_load(ref), imgload_success);
+    ASSERT_EQ(image->num_frames, ref->num_frames);
+    ASSERT_EQ(image->frames[0].pm.width, ref->frames[0].pm.width);
+    ASSERT_EQ(image->frames[0].pm.height, ref->frames[0].pm.height);
+    EXPECT_EQ(memcmp(image->frames[0].pm.data, ref->frames[0].pm.data,
+                     ref->frames[0].pm.width * ref->frames[0].pm.height *
+                         sizeof(argb_t)),
+              0);
+    EXPECT_STREQ(image->format, ref->format);
+    EXPECT_EQ(image->file_size, ref->file_size);
+    image_free(ref, IMGFREE_ALL);
+}
+
+TEST_F(Image, LoadIsolatedError)
+{
+    image_set_isolation(true, 5);
+    image = image_create(TEST_DATA_DIR "/not_exist");
+    ASSERT_TRUE(image);
+    EXPECT_NE(image_load(image), imgload_success);
+    image_set_isolation(false, 0);
+}
+
+TEST_F(Image, LoadSized)
+{
+    image = image_create(TEST_DATA_DIR "/image.jpg");
+    ASSERT_TRUE(image);
+
+    ASSERT_EQ(image_load_sized(image, 2), imgload_success);
+    EXPECT_EQ(image->frames[0].pm.width, static_cast<size_t>(2));
+    EXPECT_EQ(image->frames[0].pm.height, static_cast<size_t>(2));
+
+    ASSERT_EQ(image_load_sized(image, 1), imgload_success);
+    EXPECT_EQ(image->frames[0].pm.width, static_cast<size_t>(1));
+    EXPECT_EQ(image->frames[0].pm.height, static_cast<size_t>(1));
+}
+
+static size_t progress_calls;
+static void on_progress(const struct image* img)
+{
+    EXPECT_EQ(img->frames[0].pm.width, static_cast<size_t>(16));
+    ++progress_calls;
+}
+
+TEST_F(Image, LoadProgressive)
+{
+    image = image_create(TEST_DATA_DIR "/progressive.jpg");
+    ASSERT_TRUE(image);
+
+    progress_calls = 0;
+    image->progress = on_progress;
+    ASSERT_EQ(image_load(image), imgload_success);
+    EXPECT_EQ(progress_calls, static_cast<size_t>(1));
+    EXPECT_EQ(image->frames[0].pm.height, static_cast<size_t>(8));
+
+    // result must be the same as for single pass decoding
+    struct image* ref = image_create(TEST_DATA_DIR "/progressive.jpg");
+    ASSERT_TRUE(ref);
+    ASSERT_EQ(image_load(ref), imgload_success);
+    EXPECT_EQ(memcmp(ref->frames[0].pm.data, image->frames[0].pm.data,
+                     16 * 8 * sizeof(argb_t)),
+              0);
+    image_free(ref, IMGFREE_ALL);
+
+    // baseline image: no intermediate passes
+    image_free(image, IMGFREE_ALL);
+    image = image_create(TEST_DATA_DIR "/image.jpg");
+    ASSERT_TRUE(image);
+    image->progress = on_progress;
+    ASSERT_EQ(image_load(image), imgload_success);
+    EXPECT_EQ(progress_calls, static_cast<size_t>(1));
+}
+#endif // HAVE_LIBJPEG
+
 #ifdef HAVE_LIBRSVG
 TEST_F(Image, RescaleSVG)
 {
@@ -119,13 +467,13 @@ TEST_F(Image, RescaleSVG)
     ASSERT_TRUE(image->frames[0].pm.height == 1024);
     ASSERT_TRUE(image->frames[0].pm.width == 1024);
 
-    adjust_svg_render_size(1.5);
+    image->render_size = 1536;
 
     ASSERT_EQ(image_load(image), imgload_success);
     ASSERT_TRUE(image->frames[0].pm.height == 1536);
     ASSERT_TRUE(image->frames[0].pm.width == 1536);
 
-    reset_svg_render_size();
+    image_free(image, IMGFREE_FRAMES);
 
     ASSERT_EQ(image_load(image), imgload_success);
     ASSERT_TRUE(image->frames[0].pm.height == 1024);
@@ -133,6 +481,34 @@ TEST_F(Image, RescaleSVG)
 }
 #endif // HAVE_LIBRSVG
 
+TEST_F(Image, Window)
+{
+    Load(TEST_DATA_DIR "/image.dcm");
+    ASSERT_TRUE(image->levels);
+
+    const struct image_levels* levels = image->levels;
+    const struct pixmap* pm = &image->frames[0].pm;
+    const ssize_t min = levels->min + levels->offset;
+    const ssize_t max = levels->max + levels->offset;
+
+    // window below all samples: white image
+    ASSERT_TRUE(image_set_window(image, min - 10, 10));
+    EXPECT_EQ(pm->data[0], ARGB(0xff, 0xff, 0xff, 0xff));
+
+    // window above all samples: black image
+    ASSERT_TRUE(image_set_window(image, max + 10, 10));
+    EXPECT_EQ(pm->data[0], ARGB(0xff, 0, 0, 0));
+
+    // default window
+    ASSERT_TRUE(image_set_window(image, 0, 0));
+    EXPECT_EQ(levels->width, levels->max - levels->min + 1);
+
+    // samples are transformed with the frame
+    image_rotate(image, 90);
+    EXPECT_EQ(levels->samples.width, pm->width);
+    EXPECT_EQ(levels->samples.height, pm->height);
+}
+
 #define TEST_LOADER(n)                    \
     TEST_F(Image, Load_##n)               \
     {                                     \
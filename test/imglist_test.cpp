@@ -3,10 +3,15 @@
 
 extern "C" {
 #include "imglist.h"
+#include "tpool.h"
 }
 
 #include "config_test.h"
 
+#include <string>
+#include <unistd.h>
+#include <vector>
+
 class ImageList : public ConfigTest {
 protected:
     void TearDown() override { imglist_destroy(); }
@@ -40,6 +45,34 @@ TEST_F(ImageList, Load)
     EXPECT_STREQ(imglist_last()->source, img[2]);
 }
 
+TEST_F(ImageList, LoadDir)
+{
+    config_set(config, CFG_LIST, CFG_LIST_ORDER, "alpha");
+    config_set(config, CFG_LIST, CFG_LIST_RECURSIVE, "yes");
+    imglist_init(config);
+    tpool_start(4);
+
+    const char* const dir[] = { TEST_DATA_DIR };
+    const struct image* first = imglist_load(dir, 1);
+    tpool_destroy();
+    ASSERT_TRUE(first);
+    EXPECT_EQ(first, imglist_first());
+    EXPECT_STREQ(first->source, TEST_DATA_DIR "/exif.jpg");
+
+    // 19 files in the data dir and 1 in the subdir
+    EXPECT_EQ(imglist_size(), static_cast<size_t>(20));
+    EXPECT_TRUE(imglist_find(TEST_DATA_DIR "/swayimg/config"));
+
+    const struct image* prev = nullptr;
+    for (const struct image* it = imglist_first(); it;
+         it = imglist_next(const_cast<struct image*>(it))) {
+        if (prev) {
+            EXPECT_LT(strcoll(prev->source, it->source), 0);
+        }
+        prev = it;
+    }
+}
+
 TEST_F(ImageList, LoadFromFile)
 {
     config_set(config, CFG_LIST, CFG_LIST_ORDER, "alpha");
@@ -58,6 +91,46 @@ TEST_F(ImageList, LoadFromFile)
     EXPECT_STREQ(imglist_last()->source, "exec://3");
 }
 
+TEST_F(ImageList, LoadFromFileLarge)
+{
+    config_set(config, CFG_LIST, CFG_LIST_ORDER, "none");
+    config_set(config, CFG_LIST, CFG_LIST_FROMFILE, CFG_YES);
+    imglist_init(config);
+    tpool_start(4);
+
+    // list is parsed by parts in batches, lines cross their borders
+    char path[] = "/tmp/swayimg_list_XXXXXX";
+    const int fd = mkstemp(path);
+    ASSERT_NE(fd, -1);
+    FILE* file = fdopen(fd, "w");
+    ASSERT_TRUE(file);
+    constexpr size_t num = 50000;
+    fprintf(file, "%s\r\n", TEST_DATA_DIR "/image.bmp");
+    fprintf(file, "%s\n\n", TEST_DATA_DIR "/not_exist");
+    for (size_t i = 0; i < num; ++i) {
+        fprintf(file, "exec://%zu\n", i);
+    }
+    fprintf(file, "exec://last"); // no EOL
+    fclose(file);
+
+    const char* const lists[] = { path };
+    const struct image* first = imglist_load(lists, 1);
+    tpool_destroy();
+    unlink(path);
+
+    ASSERT_TRUE(first);
+    EXPECT_STREQ(first->source, TEST_DATA_DIR "/image.bmp");
+    ASSERT_EQ(imglist_size(), num + 2);
+    const struct image* img = imglist_next(imglist_first());
+    for (size_t i = 0; i < num; ++i) {
+        ASSERT_TRUE(img);
+        ASSERT_EQ(std::string(img->source),
+                  std::string("exec://") + std::to_string(i));
+        img = imglist_next(const_cast<struct image*>(img));
+    }
+    EXPECT_STREQ(imglist_last()->source, "exec://last");
+}
+
 TEST_F(ImageList, Duplicate)
 {
     config_set(config, CFG_LIST, CFG_LIST_ORDER, "alpha");
@@ -75,6 +148,52 @@ TEST_F(ImageList, Duplicate)
     EXPECT_STREQ(imglist_last()->source, "exec://2");
 }
 
+TEST_F(ImageList, Add)
+{
+    config_set(config, CFG_LIST, CFG_LIST_ORDER, "alpha");
+    imglist_init(config);
+
+    const char* const img[] = {
+        "exec://1",
+        "exec://3",
+    };
+    ASSERT_TRUE(imglist_load(img, sizeof(img) / sizeof(img[0])));
+
+    const char* const add[] = {
+        "exec://4",
+        "exec://2",
+        "exec://3",
+    };
+    const struct image* first =
+        imglist_add(add, sizeof(add) / sizeof(add[0]), false, false);
+    ASSERT_TRUE(first);
+    EXPECT_STREQ(first->source, "exec://4");
+    EXPECT_EQ(first->index, static_cast<size_t>(4));
+
+    ASSERT_EQ(imglist_size(), static_cast<size_t>(4));
+    EXPECT_STREQ(imglist_first()->source, "exec://1");
+    EXPECT_STREQ(imglist_next(imglist_first())->source, "exec://2");
+    EXPECT_STREQ(imglist_last()->source, "exec://4");
+}
+
+TEST_F(ImageList, AddFromFile)
+{
+    config_set(config, CFG_LIST, CFG_LIST_ORDER, "alpha");
+    imglist_init(config);
+
+    const char* const img[] = { "exec://4" };
+    ASSERT_TRUE(imglist_load(img, 1));
+
+    // list option is applied to the added sources only
+    const char* const add[] = { TEST_DATA_DIR "/filelist.txt" };
+    const struct image* first = imglist_add(add, 1, false, true);
+    ASSERT_TRUE(first);
+    EXPECT_STREQ(first->source, "exec://1");
+
+    ASSERT_EQ(imglist_size(), static_cast<size_t>(4));
+    EXPECT_STREQ(imglist_last()->source, "exec://4");
+}
+
 TEST_F(ImageList, SortAlpha)
 {
     config_set(config, CFG_LIST, CFG_LIST_ORDER, "alpha");
@@ -219,6 +338,41 @@ TEST_F(ImageList, Find)
     EXPECT_FALSE(imglist_find("not_exist"));
 }
 
+TEST_F(ImageList, FindMany)
+{
+    imglist_init(config);
+
+    constexpr size_t num = 1000;
+    std::vector<std::string> sources;
+    std::vector<const char*> imglist;
+    for (size_t i = 0; i < num; ++i) {
+        sources.push_back("exec://" + std::to_string(i));
+    }
+    for (const auto& it : sources) {
+        imglist.push_back(it.c_str());
+    }
+    ASSERT_TRUE(imglist_load(imglist.data(), imglist.size()));
+    EXPECT_EQ(imglist_size(), num);
+
+    for (size_t i = 0; i < num; i += 2) {
+        struct image* img = imglist_find(imglist[i]);
+        ASSERT_TRUE(img);
+        EXPECT_STREQ(img->source, imglist[i]);
+        imglist_remove(img);
+    }
+    EXPECT_EQ(imglist_size(), num / 2);
+
+    for (size_t i = 0; i < num; ++i) {
+        const struct image* img = imglist_find(imglist[i]);
+        if (i % 2) {
+            ASSERT_TRUE(img);
+            EXPECT_STREQ(img->source, imglist[i]);
+        } else {
+            EXPECT_FALSE(img);
+        }
+    }
+}
+
 TEST_F(ImageList, Remove)
 {
     config_set(config, CFG_LIST, CFG_LIST_ORDER, "alpha");
@@ -550,6 +704,28 @@ TEST_F(ImageList, Jump)
     EXPECT_EQ(imglist_jump(img[2], -10), nullptr);
 }
 
+TEST_F(ImageList, JumpAfterRemove)
+{
+    config_set(config, CFG_LIST, CFG_LIST_ORDER, "alpha");
+    imglist_init(config);
+
+    const char* const imglist[] = {
+        "exec://1", "exec://2", "exec://3", "exec://4", "exec://5",
+    };
+    ASSERT_TRUE(imglist_load(imglist, sizeof(imglist) / sizeof(imglist[0])));
+
+    imglist_remove(imglist_find("exec://2"));
+    ASSERT_EQ(imglist_size(), static_cast<size_t>(4));
+
+    struct image* first = imglist_first();
+    struct image* last = imglist_last();
+    EXPECT_STREQ(imglist_jump(first, 1)->source, "exec://3");
+    EXPECT_EQ(imglist_jump(first, 3), last);
+    EXPECT_EQ(imglist_jump(first, 4), nullptr);
+    EXPECT_EQ(imglist_distance(first, last), static_cast<ssize_t>(3));
+    EXPECT_EQ(last->index, static_cast<size_t>(4));
+}
+
 TEST_F(ImageList, Distance)
 {
     config_set(config, CFG_LIST, CFG_LIST_ORDER, "alpha");
@@ -111,7 +111,7 @@ TEST_F(Layout, BaseScheme)
     for (size_t i = 0; i < layout.thumb_total; ++i) {
         EXPECT_EQ(layout.thumbs[i].img, img);
         EXPECT_NE(layout.thumbs[i].x, static_cast<size_t>(0));
-        EXPECT_NE(layout.thumbs[i].y, static_cast<size_t>(0));
+        EXPECT_NE(layout.thumbs[i].y, static_cast<ssize_t>(0));
         img = imglist_next(img);
     }
 }
@@ -159,6 +159,46 @@ TEST_F(Layout, SchemeScrollDown)
     ASSERT_EQ(layout.current_row, static_cast<size_t>(2));
 }
 
+TEST_F(Layout, PixelScroll)
+{
+    InitLayout(30, 15);
+
+    // scroll less than half a row: only the view is moved
+    ASSERT_TRUE(layout_scroll(&layout, 5));
+    ASSERT_STREQ(layout.current->source, "exec://15");
+    ASSERT_STREQ(layout.thumbs[0].img->source, "exec://05");
+    ASSERT_EQ(layout.thumbs[0].y, static_cast<ssize_t>(0));
+    ASSERT_EQ(layout.thumb_total, static_cast<size_t>(25));
+
+    // scroll more than half a row: selection follows the view
+    ASSERT_TRUE(layout_scroll(&layout, 5));
+    ASSERT_STREQ(layout.current->source, "exec://20");
+    ASSERT_EQ(layout.current_row, static_cast<size_t>(2));
+    ASSERT_EQ(layout.scroll, static_cast<ssize_t>(5));
+    ASSERT_STREQ(layout.thumbs[0].img->source, "exec://05");
+    ASSERT_EQ(layout.thumbs[0].y, static_cast<ssize_t>(-5));
+    ASSERT_STREQ(layout_current(&layout)->img->source, "exec://20");
+
+    // the first row can't be scrolled down
+    ASSERT_TRUE(layout_select(&layout, layout_first));
+    ASSERT_FALSE(layout_scroll(&layout, -5));
+    ASSERT_EQ(layout.scroll, static_cast<ssize_t>(0));
+}
+
+TEST_F(Layout, SmoothSelect)
+{
+    InitLayout(30, 17);
+    layout.smooth = true;
+
+    // view is kept in place, the new row is scrolled in by the caller
+    ASSERT_STREQ(SelectNext(layout_down), "exec://22");
+    ASSERT_EQ(layout.scroll, static_cast<ssize_t>(15));
+    ASSERT_EQ(layout.above, static_cast<size_t>(1));
+    ASSERT_STREQ(layout.thumbs[0].img->source, "exec://05");
+    ASSERT_EQ(layout.thumbs[0].y, static_cast<ssize_t>(5));
+    ASSERT_STREQ(layout_current(&layout)->img->source, "exec://22");
+}
+
 TEST_F(Layout, SchemeLast)
 {
     InitLayout(7);
@@ -272,7 +312,7 @@ TEST_F(Layout, LdQueueVisibleOnly)
 {
     InitLayout(30, 15);
 
-    queue = layout_ldqueue(&layout, 0);
+    queue = layout_ldqueue(&layout, 0, 0);
     ASSERT_TRUE(queue);
 
     ASSERT_EQ(list_size(&queue->list), static_cast<size_t>(20));
@@ -297,11 +337,31 @@ TEST_F(Layout, LdQueueVisibleOnly)
     ASSERT_STREQ(last->source, "exec://05");
 }
 
+TEST_F(Layout, LdQueueVisibleFirst)
+{
+    InitLayout(30, 24);
+
+    queue = layout_ldqueue(&layout, 4, 4);
+    ASSERT_TRUE(queue);
+
+    ASSERT_EQ(list_size(&queue->list), static_cast<size_t>(24));
+
+    size_t pos = 0;
+    list_for_each(queue, struct image, it) {
+        bool visible = false;
+        for (size_t i = 0; i < layout.thumb_total; ++i) {
+            visible |= strcmp(layout.thumbs[i].img->source, it->source) == 0;
+        }
+        EXPECT_EQ(visible, pos < layout.thumb_total) << it->source;
+        ++pos;
+    }
+}
+
 TEST_F(Layout, LdQueueUnimited)
 {
     InitLayout(30, 15);
 
-    queue = layout_ldqueue(&layout, 999);
+    queue = layout_ldqueue(&layout, 999, 999);
     ASSERT_TRUE(queue);
     ASSERT_EQ(list_size(&queue->list), static_cast<size_t>(30));
 
@@ -310,6 +370,19 @@ TEST_F(Layout, LdQueueUnimited)
     ASSERT_STREQ(last->source, "exec://00");
 }
 
+TEST_F(Layout, LdQueueForward)
+{
+    InitLayout(30, 15);
+
+    queue = layout_ldqueue(&layout, 3, 0);
+    ASSERT_TRUE(queue);
+    ASSERT_EQ(list_size(&queue->list), static_cast<size_t>(23));
+
+    struct image* last = reinterpret_cast<struct image*>(list_get_last(queue));
+    ASSERT_TRUE(last);
+    ASSERT_STREQ(last->source, "exec://27");
+}
+
 TEST_F(Layout, ClearAllInvisible)
 {
     InitLayout(30, 15);
@@ -0,0 +1,72 @@
+// SPDX-License-Identifier: MIT
+// Copyright (C) 2025 Artem Senichev <artemsen@gmail.com>
+
+extern "C" {
+#include "loadsvc.h"
+}
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+class LoadService : public ::testing::Test {
+protected:
+    // Start second loader and check that it waits for the first one
+    void Wait(bool full1, bool full2, bool published, bool expect)
+    {
+        std::atomic<bool> started = false;
+        std::atomic<bool> finished = false;
+        bool own = false;
+
+        ASSERT_TRUE(loadsvc_begin("test", full1));
+
+        std::thread th([&]() {
+            started = true;
+            own = loadsvc_begin("test", full2);
+            finished = true;
+            if (own) {
+                loadsvc_end("test", full2, false);
+            }
+        });
+        while (!started) {
+            std::this_thread::yield();
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        EXPECT_FALSE(finished);
+
+        loadsvc_end("test", full1, published);
+        th.join();
+        EXPECT_EQ(own, expect);
+    }
+};
+
+TEST_F(LoadService, Single)
+{
+    EXPECT_TRUE(loadsvc_begin("test", false));
+    EXPECT_TRUE(loadsvc_begin("other", true));
+    EXPECT_TRUE(loadsvc_begin("test", true)); // thumbnail is not shared
+    loadsvc_end("test", true, true);
+    loadsvc_end("other", true, true);
+    loadsvc_end("test", false, true);
+
+    // nothing left in progress
+    EXPECT_TRUE(loadsvc_begin("test", true));
+    loadsvc_end("test", true, false);
+}
+
+TEST_F(LoadService, Published)
+{
+    Wait(true, true, true, false);
+}
+
+TEST_F(LoadService, NotPublished)
+{
+    Wait(true, true, false, true);
+}
+
+TEST_F(LoadService, Thumbnail)
+{
+    Wait(true, false, true, false);
+}
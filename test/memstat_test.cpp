@@ -0,0 +1,53 @@
+// SPDX-License-Identifier: MIT
+// Copyright (C) 2025 Artem Senichev <artemsen@gmail.com>
+
+extern "C" {
+#include "memstat.h"
+#include "pixmap.h"
+}
+
+#include <gtest/gtest.h>
+
+TEST(Memstat, AllocFree)
+{
+    const size_t live = memstat_live(memstat_text);
+
+    memstat_alloc(memstat_text, 100);
+    memstat_alloc(memstat_text, 50);
+    EXPECT_EQ(memstat_live(memstat_text), live + 150);
+    EXPECT_GE(memstat_peak(memstat_text), live + 150);
+
+    memstat_free(memstat_text, 150);
+    EXPECT_EQ(memstat_live(memstat_text), live);
+    EXPECT_GE(memstat_peak(memstat_text), live + 150);
+}
+
+TEST(Memstat, Set)
+{
+    memstat_set(memstat_preload, 1000);
+    memstat_set(memstat_preload, 10);
+    EXPECT_EQ(memstat_live(memstat_preload), static_cast<size_t>(10));
+    EXPECT_GE(memstat_peak(memstat_preload), static_cast<size_t>(1000));
+    memstat_set(memstat_preload, 0);
+}
+
+TEST(Memstat, Pixmap)
+{
+    const size_t live = memstat_live(memstat_pixmap);
+    struct pixmap pm;
+
+    ASSERT_TRUE(pixmap_create(&pm, 10, 20));
+    EXPECT_EQ(memstat_live(memstat_pixmap), live + 10 * 20 * sizeof(argb_t));
+    pixmap_free(&pm);
+    EXPECT_EQ(memstat_live(memstat_pixmap), live);
+}
+
+TEST(Memstat, Summary)
+{
+    char buf[256];
+
+    memstat_alloc(memstat_raw, 1024 * 1024);
+    memstat_summary(buf, sizeof(buf));
+    EXPECT_NE(strstr(buf, "raw 1.0/"), nullptr);
+    memstat_free(memstat_raw, 1024 * 1024);
+}
@@ -3,10 +3,14 @@
 
 extern "C" {
 #include "pixmap.h"
+#include "pixmap_ablend.h"
+#include "pixmap_conv.h"
 #include "pixmap_scale.h"
 }
 
 #include <gtest/gtest.h>
+#include <unistd.h>
+#include <vector>
 
 class Pixmap : public ::testing::Test {
 protected:
@@ -39,6 +43,136 @@ protected:
         pixmap_free(&dst1);
         pixmap_free(&dst2);
     }
+
+    void ScaleSimd(enum scale_simd simd, bool alpha)
+    {
+        const double scales[] = { 3.7, 1.3, 0.71, 0.23, 0.004 };
+        const enum aa_mode modes[] = { aa_box, aa_bilinear, aa_bicubic,
+                                       aa_mks13 };
+        struct pixmap src, dst1, dst2;
+        uint32_t seed = 0x12345678;
+
+        if (!pixmap_scale_simd(simd)) {
+            pixmap_scale_simd(simd_auto);
+            GTEST_SKIP() << "Unsupported instruction set";
+        }
+
+        pixmap_create(&src, 1023, 517);
+        for (size_t i = 0; i < src.width * src.height; ++i) {
+            seed = seed * 1103515245 + 12345;
+            src.data[i] = seed;
+            if (!alpha) {
+                src.data[i] |= ARGB_SET_A(0xff);
+            } else if (i % 7 == 0) {
+                src.data[i] &= 0x00ffffff; // fully transparent pixel
+            }
+        }
+        pixmap_create(&dst1, 333, 211);
+        pixmap_create(&dst2, 333, 211);
+
+        for (auto mode : modes) {
+            for (auto scale : scales) {
+                pixmap_fill(&dst1, 0, 0, dst1.width, dst1.height, 0x80112233);
+                pixmap_fill(&dst2, 0, 0, dst2.width, dst2.height, 0x80112233);
+                pixmap_scale_simd(simd_none);
+                pixmap_scale(mode, &src, &dst1, -5, 3, scale, alpha);
+                pixmap_scale_simd(simd);
+                pixmap_scale(mode, &src, &dst2, -5, 3, scale, alpha);
+                EXPECT_EQ(memcmp(dst1.data, dst2.data,
+                                 dst1.width * dst1.height * sizeof(argb_t)),
+                          0)
+                    << aa_name(mode) << " x" << scale;
+            }
+        }
+
+        pixmap_scale_simd(simd_auto);
+        pixmap_free(&src);
+        pixmap_free(&dst1);
+        pixmap_free(&dst2);
+    }
+
+    void BlendSimd(enum scale_simd simd)
+    {
+        const size_t num = 1027; // not aligned to the vector size
+        std::vector<argb_t> src(num), dst1(num), dst2(num);
+        uint32_t seed = 0x87654321;
+
+        if (!pixmap_scale_simd(simd)) {
+            pixmap_scale_simd(simd_auto);
+            GTEST_SKIP() << "Unsupported instruction set";
+        }
+
+        for (size_t i = 0; i < num; ++i) {
+            seed = seed * 1103515245 + 12345;
+            src[i] = seed;
+            seed = seed * 1103515245 + 12345;
+            dst1[i] = dst2[i] = seed;
+            // runs of opaque and transparent pixels
+            if ((i / 16) % 4 == 1) {
+                src[i] |= ARGB_SET_A(0xff);
+            } else if ((i / 16) % 4 == 2) {
+                src[i] &= 0x00ffffff;
+            } else if (i % 5 == 0) {
+                dst1[i] = dst2[i] = dst1[i] & 0x00ffffff;
+            }
+        }
+
+        for (size_t i = 0; i < num; ++i) {
+            alpha_blend(src[i], &dst1[i]);
+        }
+        alpha_blend_line(src.data(), dst2.data(), num);
+        pixmap_scale_simd(simd_auto);
+
+        for (size_t i = 0; i < num; ++i) {
+            for (size_t shift = 0; shift < 32; shift += 8) {
+                const int c1 = (dst1[i] >> shift) & 0xff;
+                const int c2 = (dst2[i] >> shift) & 0xff;
+                EXPECT_LE(abs(c1 - c2), 1)
+                    << "i=" << i << " " << std::hex << dst1[i] << " "
+                    << dst2[i];
+            }
+        }
+    }
+
+    void ConvSimd(enum scale_simd simd)
+    {
+        const size_t num = 1027; // not aligned to the vector size
+        std::vector<uint8_t> src(num * 8);
+        std::vector<argb_t> gray(num), rgb(num), abgr(num), rgba64(num);
+        uint32_t seed = 0x12345678;
+
+        if (!pixmap_scale_simd(simd)) {
+            pixmap_scale_simd(simd_auto);
+            GTEST_SKIP() << "Unsupported instruction set";
+        }
+
+        for (size_t i = 0; i < src.size(); ++i) {
+            seed = seed * 1103515245 + 12345;
+            src[i] = seed >> 16;
+        }
+
+        // expanding conversions are done in place
+        memcpy(gray.data(), src.data(), num);
+        pixel_conv_gray(reinterpret_cast<uint8_t*>(gray.data()), gray.data(),
+                        num);
+        memcpy(rgb.data(), src.data(), num * 3);
+        pixel_conv_rgb(reinterpret_cast<uint8_t*>(rgb.data()), rgb.data(),
+                       num);
+        pixel_conv_abgr(reinterpret_cast<const argb_t*>(src.data()),
+                        abgr.data(), num);
+        pixel_conv_rgba64be(src.data(), rgba64.data(), num);
+        pixmap_scale_simd(simd_auto);
+
+        for (size_t i = 0; i < num; ++i) {
+            const uint8_t* px3 = &src[i * 3];
+            const uint8_t* px4 = &src[i * 4];
+            const uint8_t* px8 = &src[i * 8];
+            ASSERT_EQ(gray[i], ARGB(0xff, src[i], src[i], src[i])) << i;
+            ASSERT_EQ(rgb[i], ARGB(0xff, px3[0], px3[1], px3[2])) << i;
+            ASSERT_EQ(abgr[i], ARGB(px4[3], px4[0], px4[1], px4[2])) << i;
+            ASSERT_EQ(rgba64[i], ARGB(px8[6], px8[0], px8[2], px8[4])) << i;
+        }
+    }
 };
 
 TEST_F(Pixmap, Create)
@@ -54,6 +188,27 @@ TEST_F(Pixmap, Create)
     pixmap_free(&pm);
 }
 
+TEST_F(Pixmap, CreateReuse)
+{
+    struct pixmap pm;
+
+    // large buffer of freed pixmap is reused for the same size
+    ASSERT_TRUE(pixmap_create(&pm, 1000, 1000));
+    argb_t* data = pm.data;
+    pm.data[1000 * 1000 - 1] = 0x12345678;
+    pixmap_free(&pm);
+
+    ASSERT_TRUE(pixmap_create(&pm, 1000, 1000));
+    EXPECT_EQ(pm.data, data);
+    EXPECT_EQ(pm.data[1000 * 1000 - 1], static_cast<argb_t>(0));
+    pixmap_free(&pm);
+
+    // too large buffer is not used for small pixmap
+    ASSERT_TRUE(pixmap_create(&pm, 500, 1000));
+    EXPECT_NE(pm.data, data);
+    pixmap_free(&pm);
+}
+
 TEST_F(Pixmap, Fill)
 {
     const argb_t clr = 0x12345678;
@@ -224,6 +379,27 @@ TEST_F(Pixmap, Grid)
     Compare(pm, expect);
 }
 
+TEST_F(Pixmap, GridWide)
+{
+    const argb_t clr1 = 0xffaaaaaa;
+    const argb_t clr2 = 0xffbbbbbb;
+    const size_t width = 37, height = 11, tail = 3;
+    struct pixmap pm;
+
+    ASSERT_TRUE(pixmap_create(&pm, width, height));
+    pixmap_grid(&pm, 0, 0, width, height, tail, clr1, clr2);
+
+    for (size_t y = 0; y < height; ++y) {
+        for (size_t x = 0; x < width; ++x) {
+            const bool odd = ((x / tail) % 2) ^ ((y / tail) % 2);
+            ASSERT_EQ(pm.data[y * width + x], odd ? clr1 : clr2)
+                << "x=" << x << " y=" << y;
+        }
+    }
+
+    pixmap_free(&pm);
+}
+
 TEST_F(Pixmap, Mask)
 {
     const argb_t clr = 0xffaaaaaa;
@@ -476,6 +652,34 @@ TEST_F(Pixmap, CopyAlphaOutsideBL)
     Compare(pm_dst, expect);
 }
 
+TEST_F(Pixmap, Over)
+{
+    // clang-format off
+    argb_t src[] = {
+        0xffaaaaaa, 0x80aaaaaa,
+        0x40aaaaaa, 0x00aaaaaa,
+    };
+    argb_t dst[] = {
+        0x00000000, 0x11111111, 0x22222222, 0x33333333,
+        0x44444444, 0xff555555, 0xff666666, 0x77777777,
+        0x88888888, 0xff999999, 0xffaaaaaa, 0xbbbbbbbb,
+        0xcccccccc, 0xdddddddd, 0xeeeeeeee, 0xffffffff,
+    };
+    const argb_t expect[] = {
+        0x00000000, 0x11111111, 0x22222222, 0x33333333,
+        0x44444444, 0xffaaaaaa, 0xff888888, 0x77777777,
+        0x88888888, 0xff9d9d9d, 0xffaaaaaa, 0xbbbbbbbb,
+        0xcccccccc, 0xdddddddd, 0xeeeeeeee, 0xffffffff,
+    };
+    // clang-format on
+
+    struct pixmap pm_src = { 2, 2, src };
+    struct pixmap pm_dst = { 4, 4, dst };
+    pixmap_premultiply(&pm_src);
+    pixmap_over(&pm_src, &pm_dst, 1, 1);
+    Compare(pm_dst, expect);
+}
+
 TEST_F(Pixmap, Rect)
 {
     const argb_t clr = 0xff345678;
@@ -639,6 +843,245 @@ TEST_F(Pixmap, ScaleCopyDownPos)
     ScaleCopy(aa_bilinear, pm, 2, 2, 0.5, 1, 1);
 }
 
+TEST_F(Pixmap, ScalePan)
+{
+    argb_t src[16 * 16];
+    for (size_t i = 0; i < sizeof(src) / sizeof(src[0]); ++i) {
+        src[i] = 0xff000000 | (i * 0x10307);
+    }
+    const struct pixmap pm = { 16, 16, src };
+
+    // kernels are reused from cache while moving the image
+    for (ssize_t i = 0; i < 20; ++i) {
+        ScaleCopy(aa_mks13, pm, 24, 24, 3.3, -i, -i / 2);
+        ScaleCopy(aa_bicubic, pm, 8, 8, 0.7, -i / 4, -i / 5);
+    }
+}
+
+TEST_F(Pixmap, ScaleAlphaUniform)
+{
+    const argb_t color = 0x80ff8040;
+    struct pixmap src, dst;
+
+    pixmap_create(&src, 40, 30);
+    pixmap_create(&dst, 40, 30);
+    for (size_t i = 0; i < src.width * src.height; ++i) {
+        src.data[i] = color;
+    }
+
+    // premultiplied intermediate must not lose color precision
+    pixmap_scale(aa_bicubic, &src, &dst, -3, -2, 0.77, true);
+    EXPECT_EQ(dst.data[5 * dst.width + 5], color);
+    EXPECT_EQ(dst.data[10 * dst.width + 20], color);
+    EXPECT_EQ(dst.data[5 * dst.width + 35], static_cast<argb_t>(0));
+
+    pixmap_free(&src);
+    pixmap_free(&dst);
+}
+
+TEST_F(Pixmap, ScaleSse41)
+{
+    ScaleSimd(simd_sse41, false);
+}
+
+TEST_F(Pixmap, ScaleSse41Alpha)
+{
+    ScaleSimd(simd_sse41, true);
+}
+
+TEST_F(Pixmap, ScaleAvx2)
+{
+    ScaleSimd(simd_avx2, false);
+}
+
+TEST_F(Pixmap, ScaleAvx2Alpha)
+{
+    ScaleSimd(simd_avx2, true);
+}
+
+TEST_F(Pixmap, Rotate)
+{
+    // not aligned to the tile and vector sizes
+    const size_t width = 131, height = 67;
+    const size_t angles[] = { 90, 180, 270 };
+
+    for (auto angle : angles) {
+        struct pixmap pm;
+        ASSERT_TRUE(pixmap_create(&pm, width, height));
+        for (size_t i = 0; i < width * height; ++i) {
+            pm.data[i] = i;
+        }
+
+        pixmap_rotate(&pm, angle);
+
+        ASSERT_EQ(pm.width, angle == 180 ? width : height);
+        ASSERT_EQ(pm.height, angle == 180 ? height : width);
+        for (size_t y = 0; y < height; ++y) {
+            for (size_t x = 0; x < width; ++x) {
+                size_t pos;
+                if (angle == 90) {
+                    pos = x * height + (height - y - 1);
+                } else if (angle == 180) {
+                    pos = (height - y - 1) * width + (width - x - 1);
+                } else {
+                    pos = (width - x - 1) * height + y;
+                }
+                ASSERT_EQ(pm.data[pos], y * width + x)
+                    << angle << " x=" << x << " y=" << y;
+            }
+        }
+
+        pixmap_free(&pm);
+    }
+}
+
+TEST_F(Pixmap, Transform)
+{
+    // flip followed by rotation: transpose (270) and transverse (90)
+    const size_t width = 71, height = 37;
+    const size_t angles[] = { 90, 270 };
+
+    for (auto angle : angles) {
+        struct pixmap pm;
+        ASSERT_TRUE(pixmap_create(&pm, width, height));
+        for (size_t i = 0; i < width * height; ++i) {
+            pm.data[i] = i;
+        }
+
+        pixmap_transform(&pm, true, angle);
+
+        ASSERT_EQ(pm.width, height);
+        ASSERT_EQ(pm.height, width);
+        for (size_t y = 0; y < height; ++y) {
+            for (size_t x = 0; x < width; ++x) {
+                size_t pos;
+                if (angle == 90) {
+                    pos = (width - x - 1) * height + (height - y - 1);
+                } else {
+                    pos = x * height + y;
+                }
+                ASSERT_EQ(pm.data[pos], y * width + x)
+                    << angle << " x=" << x << " y=" << y;
+            }
+        }
+
+        pixmap_free(&pm);
+    }
+}
+
+TEST_F(Pixmap, FlipHorizontal)
+{
+    const size_t width = 37, height = 5;
+    struct pixmap pm;
+
+    ASSERT_TRUE(pixmap_create(&pm, width, height));
+    for (size_t i = 0; i < width * height; ++i) {
+        pm.data[i] = i;
+    }
+
+    pixmap_flip_horizontal(&pm);
+
+    for (size_t y = 0; y < height; ++y) {
+        for (size_t x = 0; x < width; ++x) {
+            ASSERT_EQ(pm.data[y * width + x], y * width + (width - x - 1));
+        }
+    }
+
+    pixmap_free(&pm);
+}
+
+TEST_F(Pixmap, BlendSse41)
+{
+    BlendSimd(simd_sse41);
+}
+
+TEST_F(Pixmap, BlendAvx2)
+{
+    BlendSimd(simd_avx2);
+}
+
+TEST_F(Pixmap, ConvNone)
+{
+    ConvSimd(simd_none);
+}
+
+TEST_F(Pixmap, ConvSse41)
+{
+    ConvSimd(simd_sse41);
+}
+
+TEST_F(Pixmap, ScaleHalf)
+{
+    // clang-format off
+    argb_t src_data[] = {
+        0xff000000, 0xff040404, 0xff080808,
+        0xff0c0c0c, 0xff101010, 0xff141414,
+        0xff181818, 0xff1c1c1c, 0xff202020,
+    };
+    const argb_t expect[] = {
+        0xff080808, 0xff0e0e0e,
+        0xff1a1a1a, 0xff202020,
+    };
+    // clang-format on
+    const struct pixmap src = { 3, 3, src_data };
+    struct pixmap dst;
+
+    ASSERT_TRUE(pixmap_scale_half(&src, &dst, false));
+    ASSERT_EQ(dst.width, static_cast<size_t>(2));
+    ASSERT_EQ(dst.height, static_cast<size_t>(2));
+    Compare(dst, expect);
+    pixmap_free(&dst);
+}
+
+TEST_F(Pixmap, ScaleHalfAlpha)
+{
+    argb_t src_data[] = { 0xffff0000, 0x00000000, 0x80ff0000, 0x00000000 };
+    const struct pixmap src = { 2, 2, src_data };
+    struct pixmap dst;
+
+    // transparent pixels must not darken the color
+    ASSERT_TRUE(pixmap_scale_half(&src, &dst, true));
+    ASSERT_EQ(dst.width, static_cast<size_t>(1));
+    ASSERT_EQ(dst.height, static_cast<size_t>(1));
+    EXPECT_EQ(dst.data[0], static_cast<argb_t>(0x60ff0000));
+    pixmap_free(&dst);
+}
+
+TEST_F(Pixmap, Map)
+{
+    const size_t width = 1024, height = 512;
+    const size_t offset = 12; // not page aligned
+    std::vector<argb_t> pixels(width * height);
+    char path[] = "/tmp/swayimg_pixmap_XXXXXX";
+    struct pixmap pm;
+
+    for (size_t i = 0; i < pixels.size(); ++i) {
+        pixels[i] = static_cast<argb_t>(i);
+    }
+    const int fd = mkstemp(path);
+    ASSERT_NE(fd, -1);
+    unlink(path);
+    ASSERT_EQ(pwrite(fd, pixels.data(), pixels.size() * sizeof(argb_t), offset),
+              static_cast<ssize_t>(pixels.size() * sizeof(argb_t)));
+
+    EXPECT_FALSE(pixmap_map(&pm, fd, offset + 1, width, height));
+    EXPECT_FALSE(pixmap_map(&pm, fd, offset, 2, 2)); // too small
+    ASSERT_TRUE(pixmap_map(&pm, fd, offset, width, height));
+    close(fd);
+
+    EXPECT_EQ(pm.data[0], pixels[0]);
+    EXPECT_EQ(pm.data[width * height - 1], pixels[width * height - 1]);
+
+    // private mapping: writable, transposition replaces the buffer
+    pixmap_flip_vertical(&pm);
+    EXPECT_EQ(pm.data[0], pixels[(height - 1) * width]);
+    pixmap_rotate(&pm, 90);
+    EXPECT_EQ(pm.width, height);
+    EXPECT_EQ(pm.height, width);
+
+    pixmap_free(&pm);
+}
+
 /*
 TODO: This test crashes: https://github.com/artemsen/swayimg/issues/277
 
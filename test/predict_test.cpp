@@ -0,0 +1,67 @@
+// SPDX-License-Identifier: MIT
+// Copyright (C) 2025 Artem Senichev <artemsen@gmail.com>
+
+extern "C" {
+#include "predict.h"
+}
+
+#include <gtest/gtest.h>
+
+class Predict : public ::testing::Test {
+protected:
+    void SetUp() override { predict_reset(&pr); }
+    struct predict pr;
+};
+
+TEST_F(Predict, Direction)
+{
+    EXPECT_EQ(predict_direction(&pr), 0);
+
+    predict_move_at(&pr, 1, 1000);
+    EXPECT_EQ(predict_direction(&pr), 1);
+
+    predict_move_at(&pr, -1, 1100);
+    EXPECT_EQ(predict_direction(&pr), -1);
+
+    predict_reset(&pr);
+    EXPECT_EQ(predict_direction(&pr), 0);
+}
+
+TEST_F(Predict, Slow)
+{
+    size_t ahead = 2, behind = 2;
+
+    // single step after a pause
+    predict_move_at(&pr, 1, 1000);
+    predict_move_at(&pr, 1, 3000);
+    predict_split(&pr, &ahead, &behind);
+    EXPECT_EQ(ahead, static_cast<size_t>(2));
+    EXPECT_EQ(behind, static_cast<size_t>(2));
+    EXPECT_EQ(predict_skip(&pr, 100), static_cast<size_t>(0));
+}
+
+TEST_F(Predict, Fast)
+{
+    size_t ahead = 2, behind = 4;
+
+    // 20 images per second
+    for (size_t i = 1; i <= 10; ++i) {
+        predict_move_at(&pr, 1, 1000 + i * 50);
+    }
+    predict_split(&pr, &ahead, &behind);
+    EXPECT_EQ(ahead, static_cast<size_t>(5));
+    EXPECT_EQ(behind, static_cast<size_t>(1));
+    EXPECT_EQ(predict_skip(&pr, 70), static_cast<size_t>(1));
+    EXPECT_EQ(predict_skip(&pr, 120), static_cast<size_t>(2));
+}
+
+TEST_F(Predict, Reverse)
+{
+    for (size_t i = 1; i <= 10; ++i) {
+        predict_move_at(&pr, 1, 1000 + i * 50);
+    }
+    predict_move_at(&pr, -1, 1600);
+    EXPECT_EQ(predict_direction(&pr), -1);
+    EXPECT_EQ(predict_skip(&pr, 100), static_cast<size_t>(0));
+    EXPECT_EQ(predict_skip(&pr, 500), static_cast<size_t>(2));
+}
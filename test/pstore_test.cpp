@@ -0,0 +1,198 @@
+// SPDX-License-Identifier: MIT
+// Copyright (C) 2025 Artem Senichev <artemsen@gmail.com>
+
+extern "C" {
+#include "pstore.h"
+}
+
+#include <gtest/gtest.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define SOURCE TEST_DATA_DIR "/image.bmp"
+
+class PersistentStore : public ::testing::Test {
+protected:
+    void SetUp() override
+    {
+        char tmpl[] = "/tmp/swayimg_pstore_XXXXXX";
+        ASSERT_TRUE(mkdtemp(tmpl));
+        dir = tmpl;
+        path = dir + "/cache/thumbnails";
+    }
+
+    void TearDown() override
+    {
+        pstore_close();
+        if (image) {
+            image_free(image, IMGFREE_ALL);
+        }
+        unlink(path.c_str());
+        rmdir((dir + "/cache").c_str());
+        rmdir(dir.c_str());
+    }
+
+    // Create image with thumbnail
+    void CreateThumb(size_t size)
+    {
+        image = image_create(SOURCE);
+        ASSERT_TRUE(image);
+        ASSERT_EQ(image_load(image), imgload_success);
+        ASSERT_TRUE(image_thumb_create(image, size, true, aa_nearest));
+        image_free(image, IMGFREE_FRAMES);
+    }
+
+    size_t FileSize()
+    {
+        struct stat st;
+        return stat(path.c_str(), &st) == 0 ? st.st_size : 0;
+    }
+
+    std::string dir;
+    std::string path;
+    struct image* image = nullptr;
+};
+
+TEST_F(PersistentStore, SaveLoad)
+{
+    CreateThumb(4);
+
+    ASSERT_TRUE(pstore_open(path.c_str(), 1));
+    ASSERT_TRUE(pstore_save(image));
+
+    struct image* loaded = image_create(SOURCE);
+    ASSERT_TRUE(loaded);
+    ASSERT_TRUE(pstore_load(loaded)); // from appended data
+    image_free(loaded, IMGFREE_THUMB);
+
+    // reopen: load from mapped file
+    pstore_close();
+    ASSERT_TRUE(pstore_open(path.c_str(), 1));
+    ASSERT_TRUE(pstore_load(loaded));
+    EXPECT_EQ(loaded->alpha, image->alpha);
+    ASSERT_EQ(loaded->thumbnail.width, image->thumbnail.width);
+    ASSERT_EQ(loaded->thumbnail.height, image->thumbnail.height);
+    EXPECT_EQ(memcmp(loaded->thumbnail.data, image->thumbnail.data,
+                     image->thumbnail.width * image->thumbnail.height *
+                         sizeof(argb_t)),
+              0);
+    image_free(loaded, IMGFREE_ALL);
+}
+
+TEST_F(PersistentStore, Params)
+{
+    CreateThumb(4);
+
+    ASSERT_TRUE(pstore_open(path.c_str(), 1));
+    ASSERT_TRUE(pstore_save(image));
+    pstore_close();
+
+    ASSERT_TRUE(pstore_open(path.c_str(), 2));
+    struct image* loaded = image_create(SOURCE);
+    ASSERT_TRUE(loaded);
+    EXPECT_FALSE(pstore_load(loaded));
+    image_free(loaded, IMGFREE_ALL);
+}
+
+TEST_F(PersistentStore, Compact)
+{
+    CreateThumb(4);
+
+    ASSERT_TRUE(pstore_open(path.c_str(), 1));
+    ASSERT_TRUE(pstore_save(image));
+    pstore_close();
+    const size_t size = FileSize();
+
+    ASSERT_TRUE(pstore_open(path.c_str(), 1));
+    ASSERT_TRUE(pstore_save(image));
+    ASSERT_TRUE(pstore_save(image));
+    EXPECT_GT(FileSize(), size);
+    pstore_close();
+    EXPECT_EQ(FileSize(), size);
+
+    ASSERT_TRUE(pstore_open(path.c_str(), 1));
+    struct image* loaded = image_create(SOURCE);
+    ASSERT_TRUE(loaded);
+    EXPECT_TRUE(pstore_load(loaded));
+    image_free(loaded, IMGFREE_ALL);
+}
+
+TEST_F(PersistentStore, BrokenTail)
+{
+    CreateThumb(4);
+
+    ASSERT_TRUE(pstore_open(path.c_str(), 1));
+    ASSERT_TRUE(pstore_save(image));
+    pstore_close();
+    const size_t size = FileSize();
+
+    // simulate interrupted write of the next record
+    ASSERT_EQ(truncate(path.c_str(), size + 10), 0);
+
+    ASSERT_TRUE(pstore_open(path.c_str(), 1));
+    EXPECT_EQ(FileSize(), size);
+    struct image* loaded = image_create(SOURCE);
+    ASSERT_TRUE(loaded);
+    EXPECT_TRUE(pstore_load(loaded));
+    image_free(loaded, IMGFREE_ALL);
+}
+
+TEST_F(PersistentStore, Corrupted)
+{
+    CreateThumb(4);
+
+    ASSERT_TRUE(pstore_open(path.c_str(), 1));
+    ASSERT_TRUE(pstore_save(image));
+    pstore_close();
+    const size_t size = FileSize();
+
+    // damage the last byte of the thumbnail data
+    const int fd = open(path.c_str(), O_RDWR);
+    ASSERT_NE(fd, -1);
+    uint8_t byte;
+    ASSERT_EQ(pread(fd, &byte, 1, size - 1), 1);
+    byte = ~byte;
+    ASSERT_EQ(pwrite(fd, &byte, 1, size - 1), 1);
+    close(fd);
+
+    ASSERT_TRUE(pstore_open(path.c_str(), 1));
+    EXPECT_LT(FileSize(), size);
+    struct image* loaded = image_create(SOURCE);
+    ASSERT_TRUE(loaded);
+    EXPECT_FALSE(pstore_load(loaded));
+    image_free(loaded, IMGFREE_ALL);
+}
+
+TEST_F(PersistentStore, Shared)
+{
+    CreateThumb(4);
+
+    ASSERT_TRUE(pstore_open(path.c_str(), 1));
+
+    // another instance appends its record to the same file
+    const pid_t pid = fork();
+    ASSERT_NE(pid, -1);
+    if (pid == 0) {
+        const bool rc = pstore_open(path.c_str(), 2) && pstore_save(image);
+        pstore_close();
+        _exit(rc ? 0 : 1);
+    }
+    int status;
+    ASSERT_EQ(waitpid(pid, &status, 0), pid);
+    ASSERT_TRUE(WIFEXITED(status));
+    ASSERT_EQ(WEXITSTATUS(status), 0);
+
+    ASSERT_TRUE(pstore_save(image));
+    pstore_close();
+
+    struct image* loaded = image_create(SOURCE);
+    ASSERT_TRUE(loaded);
+    ASSERT_TRUE(pstore_open(path.c_str(), 1));
+    EXPECT_TRUE(pstore_load(loaded));
+    image_free(loaded, IMGFREE_THUMB);
+    ASSERT_TRUE(pstore_open(path.c_str(), 2));
+    EXPECT_TRUE(pstore_load(loaded));
+    image_free(loaded, IMGFREE_ALL);
+}
@@ -90,3 +90,11 @@ TEST(String, SearchIndex)
     ASSERT_EQ(str_index(array, "param22", 0), -1);
     ASSERT_EQ(str_index(array, "param22", 6), 1);
 }
+
+TEST(String, Hash)
+{
+    EXPECT_EQ(str_hash("", 0, STR_HASH_INIT), STR_HASH_INIT);
+    EXPECT_EQ(str_hash("a", 1, STR_HASH_INIT), 0xaf63dc4c8601ec8cULL);
+    EXPECT_EQ(str_hash("bar", 3, str_hash("foo", 3, STR_HASH_INIT)),
+              str_hash("foobar", 6, STR_HASH_INIT));
+}
@@ -9,7 +9,7 @@ void app_watch(int, fd_callback, void*) { }
 void app_reload() { }
 void app_redraw() { }
 void app_on_resize() { }
-void app_on_keyboard(xkb_keysym_t, uint8_t) { }
+void app_on_keyboard(xkb_keysym_t, uint8_t, size_t) { }
 void app_on_imglist(const struct image*, enum fsevent) { }
 void app_on_drag(int, int) { }
 void app_exit(int) { }
@@ -0,0 +1,75 @@
+// SPDX-License-Identifier: MIT
+// Copyright (C) 2025 Artem Senichev <artemsen@gmail.com>
+
+extern "C" {
+#include "pixmap_scale.h"
+#include "tpool.h"
+}
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+
+class ThreadPool : public ::testing::Test {
+protected:
+    void TearDown() override { tpool_destroy(); }
+
+    static void Count(size_t index, void* data)
+    {
+        std::atomic<size_t>* counters = static_cast<std::atomic<size_t>*>(data);
+        ++counters[index];
+    }
+};
+
+TEST_F(ThreadPool, NoWorkers)
+{
+    std::atomic<size_t> counters[10] = {};
+
+    EXPECT_EQ(tpool_threads(), static_cast<size_t>(1));
+    EXPECT_EQ(tpool_tasks(100), static_cast<size_t>(1));
+
+    tpool_run(10, Count, counters);
+    for (size_t i = 0; i < 10; ++i) {
+        EXPECT_EQ(counters[i], static_cast<size_t>(1));
+    }
+}
+
+TEST_F(ThreadPool, Run)
+{
+    std::atomic<size_t> counters[1000] = {};
+
+    tpool_start(4);
+    EXPECT_EQ(tpool_threads(), static_cast<size_t>(4));
+    EXPECT_EQ(tpool_tasks(2), static_cast<size_t>(2));
+    EXPECT_EQ(tpool_tasks(0), static_cast<size_t>(1));
+    EXPECT_GT(tpool_tasks(1000), static_cast<size_t>(4));
+
+    for (size_t n = 0; n < 10; ++n) {
+        tpool_run(1000, Count, counters);
+    }
+    for (size_t i = 0; i < 1000; ++i) {
+        EXPECT_EQ(counters[i], static_cast<size_t>(10));
+    }
+}
+
+TEST_F(ThreadPool, Scale)
+{
+    struct pixmap src, st, mt;
+
+    ASSERT_TRUE(pixmap_create(&src, 300, 200));
+    for (size_t i = 0; i < src.width * src.height; ++i) {
+        src.data[i] = ARGB(0xff, i & 0xff, (i >> 3) & 0xff, (i * 7) & 0xff);
+    }
+    ASSERT_TRUE(pixmap_create(&st, 800, 600));
+    ASSERT_TRUE(pixmap_create(&mt, 800, 600));
+
+    pixmap_scale(aa_mks13, &src, &st, 10, 20, 2.5, false);
+    tpool_start(8);
+    pixmap_scale(aa_mks13, &src, &mt, 10, 20, 2.5, false);
+    EXPECT_EQ(memcmp(st.data, mt.data, st.width * st.height * sizeof(argb_t)),
+              0);
+
+    pixmap_free(&src);
+    pixmap_free(&st);
+    pixmap_free(&mt);
+}
@@ -0,0 +1,96 @@
+// SPDX-License-Identifier: MIT
+// Copyright (C) 2025 Artem Senichev <artemsen@gmail.com>
+
+extern "C" {
+#include "trace.h"
+}
+
+#include "config_test.h"
+
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+
+class Trace : public ConfigTest {
+protected:
+    void SetUp() override
+    {
+        char tmpl[] = "/tmp/swayimg_trace_XXXXXX";
+        const int fd = mkstemp(tmpl);
+        ASSERT_NE(fd, -1);
+        close(fd);
+        path = tmpl;
+    }
+
+    void TearDown() override
+    {
+        trace_destroy();
+        unsetenv(TRACE_ENV);
+        unlink(path.c_str());
+    }
+
+    std::string Read()
+    {
+        std::ifstream file(path);
+        std::stringstream ss;
+        ss << file.rdbuf();
+        return ss.str();
+    }
+
+    std::string path;
+};
+
+TEST_F(Trace, Disabled)
+{
+    trace_init(config);
+    struct trace_span span = trace_begin("test");
+    EXPECT_FALSE(span.name);
+    trace_end(&span);
+}
+
+TEST_F(Trace, Config)
+{
+    config_set(config, CFG_GENERAL, CFG_GNRL_TRACE, path.c_str());
+    trace_init(config);
+    {
+        TRACE_SCOPE("scope");
+    }
+    trace_destroy();
+
+    const std::string trace = Read();
+    EXPECT_EQ(trace.find("{\"traceEvents\":["), static_cast<size_t>(0));
+    EXPECT_NE(trace.find("\"name\":\"scope\",\"ph\":\"X\""), std::string::npos);
+    EXPECT_NE(trace.rfind("]}"), std::string::npos);
+}
+
+TEST_F(Trace, Counter)
+{
+    config_set(config, CFG_GENERAL, CFG_GNRL_TRACE, path.c_str());
+    trace_init(config);
+    trace_counter("dropped", 3);
+    trace_destroy();
+
+    const std::string trace = Read();
+    EXPECT_NE(trace.find("\"name\":\"dropped\",\"ph\":\"C\""),
+              std::string::npos);
+    EXPECT_NE(trace.find("\"args\":{\"value\":3}"), std::string::npos);
+}
+
+TEST_F(Trace, Environment)
+{
+    setenv(TRACE_ENV, path.c_str(), 1);
+    trace_init(config);
+    struct trace_span first = trace_begin("first");
+    struct trace_span second = trace_begin("second");
+    trace_end(&second);
+    trace_end(&first);
+    trace_destroy();
+
+    const std::string trace = Read();
+    const size_t first_pos = trace.find("\"name\":\"first\"");
+    const size_t second_pos = trace.find("\"name\":\"second\"");
+    ASSERT_NE(first_pos, std::string::npos);
+    ASSERT_NE(second_pos, std::string::npos);
+    EXPECT_LT(second_pos, first_pos);
+    EXPECT_NE(trace.find("},\n{"), std::string::npos);
+}
@@ -0,0 +1,108 @@
+// SPDX-License-Identifier: MIT
+// Copyright (C) 2025 Artem Senichev <artemsen@gmail.com>
+
+extern "C" {
+#include "xdgthumb.h"
+}
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+class XdgThumb : public ::testing::Test {
+protected:
+    void SetUp() override
+    {
+        char tmpl[] = "/tmp/swayimg_xdgthumb_XXXXXX";
+        ASSERT_TRUE(mkdtemp(tmpl));
+        dir = tmpl;
+        source = dir + "/image 1.bmp";
+
+        std::ifstream src(TEST_DATA_DIR "/image.bmp", std::ios::binary);
+        std::ofstream dst(source, std::ios::binary);
+        dst << src.rdbuf();
+        dst.close();
+
+        setenv("XDG_CACHE_HOME", dir.c_str(), 1);
+        ASSERT_TRUE(xdgthumb_init());
+    }
+
+    void TearDown() override
+    {
+        if (image) {
+            image_free(image, IMGFREE_ALL);
+        }
+        std::string cmd = "rm -rf '" + dir + "'";
+        ASSERT_EQ(system(cmd.c_str()), 0);
+    }
+
+    void Save(size_t size)
+    {
+        image = image_create(source.c_str());
+        ASSERT_TRUE(image);
+        ASSERT_EQ(image_load(image), imgload_success);
+        ASSERT_TRUE(xdgthumb_save(image, size, aa_nearest));
+    }
+
+    bool Load(size_t size)
+    {
+        struct image* img = image_create(source.c_str());
+        const bool rc = xdgthumb_load(img, size, true, aa_nearest);
+        if (rc) {
+            EXPECT_EQ(img->thumbnail.width, size);
+            EXPECT_EQ(img->thumbnail.height, size);
+        }
+        image_free(img, IMGFREE_ALL);
+        return rc;
+    }
+
+    // Get number of files in the bucket
+    size_t Files(const char* bucket)
+    {
+        const std::string path = dir + "/thumbnails/" + bucket;
+        DIR* dp = opendir(path.c_str());
+        size_t num = 0;
+        if (dp) {
+            struct dirent* de;
+            while ((de = readdir(dp))) {
+                num += de->d_name[0] != '.';
+            }
+            closedir(dp);
+        }
+        return num;
+    }
+
+    std::string dir;
+    std::string source;
+    struct image* image = nullptr;
+};
+
+TEST_F(XdgThumb, SaveLoad)
+{
+    EXPECT_FALSE(Load(10));
+    Save(100);
+    EXPECT_EQ(Files("normal"), static_cast<size_t>(1));
+    EXPECT_TRUE(Load(10));
+}
+
+TEST_F(XdgThumb, Bucket)
+{
+    Save(200);
+    EXPECT_EQ(Files("normal"), static_cast<size_t>(0));
+    EXPECT_EQ(Files("large"), static_cast<size_t>(1));
+    EXPECT_TRUE(Load(100)); // larger bucket is used
+    EXPECT_FALSE(Load(600));
+}
+
+TEST_F(XdgThumb, Modified)
+{
+    Save(100);
+
+    const struct timespec times[2] = { { 1, 0 }, { 1, 0 } };
+    ASSERT_EQ(utimensat(AT_FDCWD, source.c_str(), times, 0), 0);
+
+    EXPECT_FALSE(Load(10));
+}